@@ -1,3 +1,3 @@
 LOCAL_PATH:= $(call my-dir)
 include $(LOCAL_PATH)/core/Android.mk
-#include $(LOCAL_PATH)/test/Android.mk
+include $(LOCAL_PATH)/test/Android.mk
@@ -60,6 +60,8 @@ LOCAL_HAL_FILES := \
         src/QCameraStream.cpp\
         ../usbcamcore/src/QualcommUsbCamera.cpp\
         ../usbcamcore/src/QCameraMjpegDecode.cpp\
+        ../usbcamcore/src/QCameraMjpegSwDecode.cpp\
+        ../usbcamcore/src/QCameraUsbColorConv.cpp\
         ../usbcamcore/src/QCameraUsbParm.cpp
 
 LOCAL_HAL_WRAPPER_FILES := ../wrapper/QualcommCamera.cpp
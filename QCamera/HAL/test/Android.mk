@@ -1 +1,36 @@
-
+LOCAL_PATH:= $(call my-dir)
+
+# USB camera YUYV conversion bit exactness test and benchmark
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        QCameraUsbColorConvTest.cpp \
+        ../usbcamcore/src/QCameraUsbColorConv.cpp
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/../usbcamcore/inc
+
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+
+LOCAL_MODULE := usbcam-color-conv-test
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# USB camera software MJPEG decoder bit exactness test and core scaling benchmark
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        QCameraMjpegSwDecodeTest.cpp \
+        ../usbcamcore/src/QCameraMjpegSwDecode.cpp
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/../usbcamcore/inc \
+        external/jpeg
+
+LOCAL_SHARED_LIBRARIES := libcutils liblog libjpeg
+
+LOCAL_MODULE := usbcam-mjpeg-decode-test
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
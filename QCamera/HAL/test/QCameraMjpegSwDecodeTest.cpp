@@ -0,0 +1,552 @@
+/* Copyright (c) 2012, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/******************************************************************************
+* Bit exactness test and core scaling benchmark of the USB camera software
+* MJPEG decoder.
+*
+* Test vectors of several sizes, samplings and restart intervals are encoded
+* with libjpeg from fixed seeds, with and without DHT. Each is decoded with
+* one and with N slice threads and compared against the libjpeg islow decode
+* of the same frame, sampled to NV21 or NV12 the way the decoder does.
+*
+* For the benchmark UVC style 4:2:2 frames without DHT and with one restart
+* interval per MCU row are encoded at 1920x1080 and 3840x2160, then decoded
+* with 1 up to N slice threads. Output of every thread count is checked
+* against the one thread output, and the time per frame and speedup over one
+* thread are printed. N defaults to the number of online cpus.
+*
+* Usage: usbcam-mjpeg-decode-test [max threads] [iterations]
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include <jpeglib.h>
+#include <jerror.h>
+}
+
+#include "QCameraMjpegSwDecode.h"
+
+#define DEFAULT_ITERATIONS      20
+#define MAX_THREADS             8
+#define ENC_QUALITY             85
+
+typedef struct {
+    int width;
+    int height;
+} test_size_t;
+
+static const test_size_t benchSizes[] = {
+    {1920, 1080},
+    {3840, 2160},
+};
+
+typedef struct {
+    int width;
+    int height;
+    int hSamp;
+    int vSamp;
+    int restartInterval;
+} test_vector_t;
+
+/* Odd sizes cover partial MCUs, restart interval 1 covers a RST per MCU */
+static const test_vector_t testVectors[] = {
+    {640,  480,  2, 1, 0},
+    {640,  480,  2, 1, 40},
+    {640,  480,  2, 2, 0},
+    {640,  480,  1, 1, 3},
+    {1280, 720,  2, 1, 80},
+    {1280, 720,  2, 2, 1},
+    {322,  242,  2, 1, 7},
+    {322,  242,  2, 2, 0},
+    {50,   34,   1, 1, 1},
+    {16,   8,    2, 1, 0},
+};
+
+/* libjpeg destination writing to a growing malloc'd buffer */
+typedef struct {
+    struct jpeg_destination_mgr pub;
+    unsigned char               *buf;
+    size_t                      size;
+} mem_dest_t;
+
+static void memInitDest(j_compress_ptr cinfo)
+{
+    mem_dest_t *dest = (mem_dest_t *)cinfo->dest;
+
+    dest->pub.next_output_byte = dest->buf;
+    dest->pub.free_in_buffer = dest->size;
+}
+
+static boolean memEmptyBuffer(j_compress_ptr cinfo)
+{
+    mem_dest_t *dest = (mem_dest_t *)cinfo->dest;
+    unsigned char *buf = (unsigned char *)realloc(dest->buf, dest->size * 2);
+
+    if(!buf)
+        ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+    dest->pub.next_output_byte = buf + dest->size;
+    dest->pub.free_in_buffer = dest->size;
+    dest->buf = buf;
+    dest->size *= 2;
+    return TRUE;
+}
+
+static void memTermDest(j_compress_ptr cinfo)
+{
+    mem_dest_t *dest = (mem_dest_t *)cinfo->dest;
+
+    dest->size -= dest->pub.free_in_buffer;
+}
+
+/* libjpeg source reading a frame in memory */
+static void memInitSource(j_decompress_ptr)
+{
+}
+
+static boolean memFillInput(j_decompress_ptr cinfo)
+{
+    static const JOCTET eoi[2] = {0xFF, JPEG_EOI};
+
+    /* Truncated frame, end it the way libjpeg's stdio source does */
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = sizeof(eoi);
+    return TRUE;
+}
+
+static void memSkipInput(j_decompress_ptr cinfo, long num)
+{
+    if(num > (long)cinfo->src->bytes_in_buffer)
+        num = cinfo->src->bytes_in_buffer;
+    cinfo->src->next_input_byte += num;
+    cinfo->src->bytes_in_buffer -= num;
+}
+
+static void memTermSource(j_decompress_ptr)
+{
+}
+
+/******************************************************************************
+ * Function: stripDHT
+ * Description: This function removes the DHT segments of a JPEG frame in
+ *              place, the way UVC cameras send MJPEG
+ *
+ * Input parameters:
+ *   buf                - JPEG frame
+ *   size               - frame size
+ *
+ * Return values: frame size without DHT
+ *
+ * Notes: Frames must be encoded with the default Huffman tables
+ *****************************************************************************/
+static int stripDHT(unsigned char *buf, int size)
+{
+    int pos = 2, len;
+
+    while(pos + 4 <= size && 0xFF == buf[pos] && 0xDA != buf[pos + 1]) {
+        len = 2 + ((buf[pos + 2] << 8) | buf[pos + 3]);
+        if(0xC4 == buf[pos + 1]) {
+            memmove(buf + pos, buf + pos + len, size - pos - len);
+            size -= len;
+        } else {
+            pos += len;
+        }
+    }
+    return size;
+}
+
+/******************************************************************************
+ * Function: refDecode
+ * Description: This function decodes a frame with the libjpeg islow IDCT
+ *              and samples it to NV21 or NV12 like the software decoder:
+ *              chroma of the top left luma pixel of each 2x2 block
+ *
+ * Input parameters:
+ *   frame              - JPEG frame, with DHT
+ *   size               - frame size
+ *   width, height      - frame size in pixels
+ *   out                - width * height * 3 / 2 bytes output
+ *   outFormat          - MJPEGD_SW_FMT_NV21 or MJPEGD_SW_FMT_NV12
+ *
+ * Return values: none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void refDecode(const unsigned char *frame, int size, int width,
+                      int height, unsigned char *out, int outFormat)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    struct jpeg_source_mgr src;
+    unsigned char *planes[3], *uv = out + width * height;
+    int planeWidth[3], hStep[3], vStep[3];
+    JSAMPROW rows[3][4 * DCTSIZE];
+    JSAMPARRAY comps[3];
+    int c, r, x, y, rowsPerPass;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    src.init_source = memInitSource;
+    src.fill_input_buffer = memFillInput;
+    src.skip_input_data = memSkipInput;
+    src.resync_to_restart = jpeg_resync_to_restart;
+    src.term_source = memTermSource;
+    src.next_input_byte = frame;
+    src.bytes_in_buffer = size;
+    cinfo.src = &src;
+
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.raw_data_out = TRUE;
+    cinfo.dct_method = JDCT_ISLOW;
+    jpeg_start_decompress(&cinfo);
+
+    /* Decode all components at their own resolution, padded to MCUs */
+    rowsPerPass = cinfo.max_v_samp_factor * DCTSIZE;
+    for(c = 0; c < cinfo.num_components; c++) {
+        jpeg_component_info *comp = &cinfo.comp_info[c];
+        int planeRows = (cinfo.total_iMCU_rows * comp->v_samp_factor) * DCTSIZE;
+
+        planeWidth[c] = comp->width_in_blocks * DCTSIZE;
+        planeWidth[c] = (planeWidth[c] + comp->h_samp_factor * DCTSIZE - 1) /
+                        (comp->h_samp_factor * DCTSIZE) *
+                        (comp->h_samp_factor * DCTSIZE);
+        hStep[c] = cinfo.max_h_samp_factor / comp->h_samp_factor;
+        vStep[c] = cinfo.max_v_samp_factor / comp->v_samp_factor;
+        planes[c] = (unsigned char *)malloc(planeWidth[c] * planeRows);
+        comps[c] = rows[c];
+    }
+    for(y = 0; cinfo.output_scanline < cinfo.output_height; y += rowsPerPass) {
+        for(c = 0; c < cinfo.num_components; c++) {
+            int compRows = rowsPerPass / vStep[c];
+            for(r = 0; r < compRows; r++)
+                rows[c][r] = planes[c] +
+                             (y / vStep[c] + r) * planeWidth[c];
+        }
+        jpeg_read_raw_data(&cinfo, comps, rowsPerPass);
+    }
+
+    for(y = 0; y < height; y++)
+        memcpy(out + y * width, planes[0] + y * planeWidth[0], width);
+    for(y = 0; y < height / 2; y++) {
+        for(x = 0; x < width / 2; x++) {
+            unsigned char cb = 128, cr = 128;
+            if(3 == cinfo.num_components) {
+                cb = planes[1][(2 * y / vStep[1]) * planeWidth[1] + 2 * x / hStep[1]];
+                cr = planes[2][(2 * y / vStep[2]) * planeWidth[2] + 2 * x / hStep[2]];
+            }
+            uv[y * width + 2 * x]     = MJPEGD_SW_FMT_NV21 == outFormat ? cr : cb;
+            uv[y * width + 2 * x + 1] = MJPEGD_SW_FMT_NV21 == outFormat ? cb : cr;
+        }
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    for(c = 0; c < cinfo.num_components; c++)
+        free(planes[c]);
+}
+
+/******************************************************************************
+ * Function: encodeFrame
+ * Description: This function encodes a pseudo random YCbCr frame
+ *
+ * Input parameters:
+ *   width, height      - frame size
+ *   hSamp, vSamp       - luma sampling factors, 2x1 is 4:2:2
+ *   restartInterval    - restart interval in MCUs, 0 for none
+ *   seed               - pattern seed
+ *   size               - returns frame size
+ *
+ * Return values: malloc'd frame, NULL on error
+ *
+ * Notes: Frame has DHT, see stripDHT
+ *****************************************************************************/
+static unsigned char *encodeFrame(int width, int height, int hSamp, int vSamp,
+                                  int restartInterval, unsigned seed, int *size)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    mem_dest_t dest;
+    unsigned char *row;
+    JSAMPROW rowPtr;
+    int x, y;
+
+    row = (unsigned char *)malloc(width * 3);
+    dest.size = width * height;
+    dest.buf = (unsigned char *)malloc(dest.size);
+    if(!row || !dest.buf) {
+        free(row);
+        free(dest.buf);
+        return NULL;
+    }
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    dest.pub.init_destination = memInitDest;
+    dest.pub.empty_output_buffer = memEmptyBuffer;
+    dest.pub.term_destination = memTermDest;
+    cinfo.dest = &dest.pub;
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, ENC_QUALITY, TRUE);
+    cinfo.restart_interval = restartInterval;
+    cinfo.comp_info[0].h_samp_factor = hSamp;
+    cinfo.comp_info[0].v_samp_factor = vSamp;
+    jpeg_start_compress(&cinfo, TRUE);
+
+    srand(seed);
+    for(y = 0; y < height; y++) {
+        for(x = 0; x < width * 3; x++)
+            row[x] = (unsigned char)((x * 3 + y * 5 + (rand() % 40)) ^ (x * y >> 6));
+        rowPtr = row;
+        jpeg_write_scanlines(&cinfo, &rowPtr, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    free(row);
+
+    *size = dest.size;
+    return dest.buf;
+}
+
+/******************************************************************************
+ * Function: getDiffMs
+ * Description: This function returns the time between two points in ms
+ *
+ * Input parameters:
+ *   from, to           - monotonic clock readings
+ *
+ * Return values: elapsed ms
+ *
+ * Notes: none
+ *****************************************************************************/
+static double getDiffMs(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000.0 +
+           (to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
+/******************************************************************************
+ * Function: testVectorsAt
+ * Description: This function decodes all test vectors with and without DHT
+ *              at one thread count and compares against the libjpeg output
+ *
+ * Input parameters:
+ *   threads            - number of slice threads
+ *
+ * Return values:
+ *      0   All vectors are bit exact
+ *      -1  Mismatch or error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int testVectorsAt(int threads)
+{
+    int numVectors = sizeof(testVectors) / sizeof(testVectors[0]);
+    int v, strip, i, fails = 0;
+    void *swd;
+
+    if(mjpegSwDecoderInit(&swd, threads)) {
+        printf("%d threads: decoder init failed\n", threads);
+        return -1;
+    }
+
+    for(v = 0; v < numVectors; v++) {
+        const test_vector_t *t = &testVectors[v];
+        int outSize = t->width * t->height * 3 / 2;
+        int outFormat = (v & 1) ? MJPEGD_SW_FMT_NV12 : MJPEGD_SW_FMT_NV21;
+        unsigned char *frame, *ref, *out;
+        int frameSize;
+
+        frame = encodeFrame(t->width, t->height, t->hSamp, t->vSamp,
+                            t->restartInterval, v, &frameSize);
+        ref = (unsigned char *)malloc(outSize);
+        out = (unsigned char *)malloc(outSize);
+        if(!frame || !ref || !out) {
+            printf("%dx%d: no memory\n", t->width, t->height);
+            fails++;
+            free(frame);
+            free(ref);
+            free(out);
+            continue;
+        }
+        refDecode(frame, frameSize, t->width, t->height, ref, outFormat);
+
+        for(strip = 0; strip < 2; strip++) {
+            if(strip)
+                frameSize = stripDHT(frame, frameSize);
+            memset(out, 0, outSize);
+            if(mjpegSwDecode(swd, (char *)frame, frameSize, (char *)out,
+                             (char *)out + t->width * t->height, outFormat)) {
+                printf("%4dx%-4d %dx%d ri %d%s: decode failed\n",
+                       t->width, t->height, t->hSamp, t->vSamp,
+                       t->restartInterval, strip ? " no DHT" : "");
+                fails++;
+            } else if(memcmp(out, ref, outSize)) {
+                for(i = 0; i < outSize && out[i] == ref[i]; i++);
+                printf("%4dx%-4d %dx%d ri %d%s: mismatch at byte %d\n",
+                       t->width, t->height, t->hSamp, t->vSamp,
+                       t->restartInterval, strip ? " no DHT" : "", i);
+                fails++;
+            }
+        }
+
+        free(frame);
+        free(ref);
+        free(out);
+    }
+
+    printf("%d vectors with and without DHT, %d threads (%d running): %s\n",
+           numVectors, threads, mjpegSwNumThreads(swd),
+           fails ? "FAILED" : "bit exact");
+    mjpegSwDecoderDestroy(swd);
+    return fails ? -1 : 0;
+}
+
+/******************************************************************************
+ * Function: benchSize
+ * Description: This function decodes one frame size with 1 to maxThreads
+ *              slice threads, checks the output and prints the timing
+ *
+ * Input parameters:
+ *   width, height      - frame size
+ *   maxThreads         - highest thread count
+ *   iterations         - decodes timed per thread count
+ *
+ * Return values:
+ *      0   Output of all thread counts matches
+ *      -1  Mismatch or error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int benchSize(int width, int height, int maxThreads, int iterations)
+{
+    unsigned char *frame;
+    char *ref, *out;
+    struct timespec t0, t1;
+    double ms, oneThreadMs = 0;
+    void *swd;
+    int frameSize, outSize = width * height * 3 / 2;
+    int threads, i, rc = 0;
+
+    frame = encodeFrame(width, height, 2, 1, width / 16, width, &frameSize);
+    if(frame)
+        frameSize = stripDHT(frame, frameSize);
+    ref = (char *)malloc(outSize);
+    out = (char *)malloc(outSize);
+    if(!frame || !ref || !out) {
+        printf("%dx%d: no memory\n", width, height);
+        rc = -1;
+        goto end;
+    }
+
+    for(threads = 1; threads <= maxThreads; threads++) {
+        if(mjpegSwDecoderInit(&swd, threads)) {
+            printf("%dx%d: decoder init failed\n", width, height);
+            rc = -1;
+            break;
+        }
+
+        memset(out, 0, outSize);
+        if(mjpegSwDecode(swd, (char *)frame, frameSize, out, out + width * height,
+                         MJPEGD_SW_FMT_NV21)) {
+            printf("%4dx%-4d %d threads: decode failed\n", width, height, threads);
+            rc = -1;
+        } else if(1 == threads) {
+            memcpy(ref, out, outSize);
+        } else if(memcmp(ref, out, outSize)) {
+            printf("%4dx%-4d %d threads: output differs from 1 thread\n",
+                   width, height, threads);
+            rc = -1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(i = 0; i < iterations; i++)
+            mjpegSwDecode(swd, (char *)frame, frameSize, out, out + width * height,
+                          MJPEGD_SW_FMT_NV21);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ms = getDiffMs(&t0, &t1) / iterations;
+        if(1 == threads)
+            oneThreadMs = ms;
+        printf("%4dx%-4d %d threads (%d running): %.2f ms per frame, %.2fx\n",
+               width, height, threads, mjpegSwNumThreads(swd), ms,
+               oneThreadMs / ms);
+
+        mjpegSwDecoderDestroy(swd);
+    }
+
+end:
+    free(frame);
+    free(ref);
+    free(out);
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    int maxThreads = 0;
+    int iterations = DEFAULT_ITERATIONS;
+    int i, rc = 0;
+
+    if(argc > 1)
+        maxThreads = atoi(argv[1]);
+    if(argc > 2)
+        iterations = atoi(argv[2]);
+    if(maxThreads <= 0)
+        maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(maxThreads <= 0)
+        maxThreads = 1;
+    if(maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+    if(iterations <= 0)
+        iterations = DEFAULT_ITERATIONS;
+
+    if(testVectorsAt(1))
+        rc = -1;
+    if(maxThreads > 1 && testVectorsAt(maxThreads))
+        rc = -1;
+
+    printf("\nSliced MJPEG decode, 4:2:2, 1 to %d threads, %d iterations, "
+           "%ld cpus online\n", maxThreads, iterations,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    for(i = 0; i < (int)(sizeof(benchSizes) / sizeof(benchSizes[0])); i++) {
+        if(benchSize(benchSizes[i].width, benchSizes[i].height,
+                     maxThreads, iterations))
+            rc = -1;
+    }
+    printf("\n%s\n", rc ? "Failed" : "Passed");
+    return rc;
+}
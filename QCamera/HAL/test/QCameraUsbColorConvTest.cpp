@@ -0,0 +1,284 @@
+/* Copyright (c) 2012, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/******************************************************************************
+* Bit exactness test and benchmark of the USB camera YUYV to YUV 4:2:0
+* conversion. Output of usbCamConvertYUYV is compared against the original
+* scalar conversion of the HAL at 640x480, 1280x720 and 1920x1080 for NV21,
+* NV12 and YV12, then both are timed per frame. Every kernel set compiled in
+* and supported by the CPU is tested, from the portable C kernels to the
+* one the converter picks at runtime.
+*
+* Usage: usbcam-color-conv-test [iterations]
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "QCameraUsbColorConv.h"
+
+#define ALIGN_TO(x, a)          (((x) + (a) - 1) & ~((a) - 1))
+#define DEFAULT_ITERATIONS      100
+
+typedef struct {
+    int width;
+    int height;
+} test_size_t;
+
+static const test_size_t testSizes[] = {
+    {640, 480},
+    {1280, 720},
+    {1920, 1080},
+};
+
+/******************************************************************************/
+/* Original conversion of QualcommUsbCamera.cpp, kept as reference. Despite  */
+/* its name it writes NV21: Y plane followed by interleaved CrCb.            */
+/******************************************************************************/
+static int convert_YUYV_to_420_NV12(char *in_buf, char *out_buf, int wd, int ht)
+{
+    int rc =0;
+    int row, col, uv_row;
+
+    /* Arrange Y */
+    for(row = 0; row < ht; row++)
+        for(col = 0; col < wd * 2; col += 2)
+        {
+            out_buf[row * wd + col / 2] = in_buf[row * wd * 2 + col];
+        }
+
+    /* Arrange UV */
+    for(row = 0, uv_row = ht; row < ht; row += 2, uv_row++)
+        for(col = 1; col < wd * 2; col += 4)
+        {
+            out_buf[uv_row * wd + col / 2]= in_buf[row * wd * 2 + col + 2];
+            out_buf[uv_row * wd + col / 2 + 1]  = in_buf[row * wd * 2 + col];
+        }
+
+    return rc;
+}
+
+/******************************************************************************
+ * Function: refToLayout
+ * Description: This function repacks the NV21 reference output into the
+ *              layout usbCamConvertYUYV writes for the given format
+ *
+ * Input parameters:
+ *   nv21               - reference output
+ *   out                - repacked output, of getOutSize bytes
+ *   width, height      - frame size
+ *   outFormat          - usbcam_conv_fmt_t output layout
+ *
+ * Return values: none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void refToLayout(const char *nv21, char *out, int width, int height,
+                        int outFormat)
+{
+    const char *vu = nv21 + width * height;
+    int row, col;
+
+    if(USBCAM_CONV_FMT_NV21 == outFormat) {
+        memcpy(out, nv21, width * height * 3 / 2);
+    } else if(USBCAM_CONV_FMT_NV12 == outFormat) {
+        memcpy(out, nv21, width * height);
+        for(col = 0; col < width * height / 2; col += 2) {
+            out[width * height + col]       = vu[col + 1];
+            out[width * height + col + 1]   = vu[col];
+        }
+    } else {
+        int yStride = ALIGN_TO(width, 16);
+        int cStride = ALIGN_TO(yStride / 2, 16);
+        char *v = out + yStride * height;
+        char *u = v + cStride * (height / 2);
+
+        for(row = 0; row < height; row++)
+            memcpy(out + row * yStride, nv21 + row * width, width);
+        for(row = 0; row < height / 2; row++) {
+            for(col = 0; col < width / 2; col++) {
+                v[row * cStride + col] = vu[row * width + 2 * col];
+                u[row * cStride + col] = vu[row * width + 2 * col + 1];
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * Function: getOutSize
+ * Description: This function returns the size of a converted frame
+ *
+ * Input parameters:
+ *   width, height      - frame size
+ *   outFormat          - usbcam_conv_fmt_t output layout
+ *
+ * Return values: size in bytes
+ *
+ * Notes: none
+ *****************************************************************************/
+static int getOutSize(int width, int height, int outFormat)
+{
+    if(USBCAM_CONV_FMT_YV12 == outFormat) {
+        int yStride = ALIGN_TO(width, 16);
+        int cStride = ALIGN_TO(yStride / 2, 16);
+        return yStride * height + cStride * height;
+    }
+    return width * height * 3 / 2;
+}
+
+/******************************************************************************
+ * Function: getDiffMs
+ * Description: This function returns the time between two points in ms
+ *
+ * Input parameters:
+ *   from, to           - monotonic clock readings
+ *
+ * Return values: elapsed ms
+ *
+ * Notes: none
+ *****************************************************************************/
+static double getDiffMs(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000.0 +
+           (to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
+/******************************************************************************
+ * Function: testSize
+ * Description: This function checks usbCamConvertYUYV against the reference
+ *              in all output layouts at one frame size and times both
+ *
+ * Input parameters:
+ *   width, height      - frame size
+ *   iterations         - conversions timed per layout
+ *
+ * Return values:
+ *      0   Output is bit exact in all layouts
+ *      -1  Mismatch or error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int testSize(int width, int height, int iterations)
+{
+    static const struct {
+        int         fmt;
+        const char  *name;
+    } fmts[] = {
+        {USBCAM_CONV_FMT_NV21, "nv21"},
+        {USBCAM_CONV_FMT_NV12, "nv12"},
+        {USBCAM_CONV_FMT_YV12, "yv12"},
+    };
+    int inSize = width * height * 2;
+    int maxOutSize = getOutSize(width, height, USBCAM_CONV_FMT_YV12);
+    char *in, *ref, *expected, *out;
+    struct timespec t0, t1;
+    double refMs;
+    int i, f, rc = 0;
+
+    in          = (char *)malloc(inSize);
+    ref         = (char *)malloc(width * height * 3 / 2);
+    expected    = (char *)malloc(maxOutSize);
+    out         = (char *)malloc(maxOutSize);
+    if(!in || !ref || !expected || !out) {
+        printf("%dx%d: no memory\n", width, height);
+        rc = -1;
+        goto end;
+    }
+
+    srand(width * height);
+    for(i = 0; i < inSize; i++)
+        in[i] = (char)(rand() & 0xff);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(i = 0; i < iterations; i++)
+        convert_YUYV_to_420_NV12(in, ref, width, height);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    refMs = getDiffMs(&t0, &t1) / iterations;
+
+    for(f = 0; f < (int)(sizeof(fmts) / sizeof(fmts[0])); f++) {
+        int outSize = getOutSize(width, height, fmts[f].fmt);
+
+        /* YV12 stride padding is not written, keep it equal on both sides */
+        memset(expected, 0, maxOutSize);
+        memset(out, 0, maxOutSize);
+        refToLayout(ref, expected, width, height, fmts[f].fmt);
+        if(USBCAM_CONV_NO_ERROR !=
+           usbCamConvertYUYV(in, out, width, height, fmts[f].fmt)) {
+            printf("%4dx%-4d %s: conversion failed\n", width, height, fmts[f].name);
+            rc = -1;
+            continue;
+        }
+        if(memcmp(out, expected, outSize)) {
+            for(i = 0; i < outSize && out[i] == expected[i]; i++);
+            printf("%4dx%-4d %s: mismatch at byte %d\n",
+                   width, height, fmts[f].name, i);
+            rc = -1;
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(i = 0; i < iterations; i++)
+            usbCamConvertYUYV(in, out, width, height, fmts[f].fmt);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        printf("%4dx%-4d %s: bit exact, orig %.3f ms, %s %.3f ms per frame\n",
+               width, height, fmts[f].name, refMs, usbCamConvertImplName(),
+               getDiffMs(&t0, &t1) / iterations);
+    }
+
+end:
+    free(in);
+    free(ref);
+    free(expected);
+    free(out);
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = DEFAULT_ITERATIONS;
+    int i, impl, rc = 0;
+
+    if(argc > 1)
+        iterations = atoi(argv[1]);
+    if(iterations <= 0)
+        iterations = DEFAULT_ITERATIONS;
+
+    for(impl = 0; impl < usbCamConvertNumImpls(); impl++) {
+        usbCamConvertSelectImpl(impl);
+        printf("%sYUYV to YUV420 conversion with %s kernels, %d iterations\n",
+               impl ? "\n" : "", usbCamConvertImplName(), iterations);
+        for(i = 0; i < (int)(sizeof(testSizes) / sizeof(testSizes[0])); i++) {
+            if(testSize(testSizes[i].width, testSizes[i].height, iterations))
+                rc = -1;
+        }
+    }
+    printf("\n%s\n", rc ? "Failed" : "Passed");
+    return rc;
+}
@@ -0,0 +1,66 @@
+/* Copyright (c) 2012, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __QCAMERA_MJPEG_SW_DECODE_H
+#define __QCAMERA_MJPEG_SW_DECODE_H
+
+#include <stdint.h>
+
+#include "QCameraMjpegDecode.h"
+
+/* Software (portable C) baseline JPEG decoder used when the jpegd library */
+/* is not available. Supports 8 bit baseline frames, grayscale or YCbCr    */
+/* with luma sampling of H1V1, H2V1 or H2V2, and decodes straight into     */
+/* YUV 4:2:0 semi-planar output. Frames with restart intervals (DRI) are   */
+/* split at RST markers and decoded in parallel. Depends on libc only.     */
+
+typedef enum {
+    MJPEGD_SW_FMT_NV12,         /* Y plane followed by interleaved CbCr     */
+    MJPEGD_SW_FMT_NV21,         /* Y plane followed by interleaved CrCb     */
+} mjpegd_sw_fmt_t;
+
+/* DHT marker segment of the default Huffman tables of ITU-T T.81 Annex  */
+/* K.3. UVC MJPEG frames are sent without DHT and rely on these tables.  */
+extern const uint8_t    mjpegdDefaultDHT[];
+extern const int        mjpegdDefaultDHTSize;
+
+MJPEGD_ERR mjpegSwDecoderInit(void **swd, int numThreads);
+
+MJPEGD_ERR mjpegSwDecoderDestroy(void *swd);
+
+int mjpegSwNumThreads(void *swd);
+
+MJPEGD_ERR mjpegSwDecode(
+            void        *swd,
+            const char  *mjpegBuffer,
+            int         mjpegBufferSize,
+            char        *outputYptr,
+            char        *outputUVptr,
+            int         outputFormat);
+
+#endif /* __QCAMERA_MJPEG_SW_DECODE_H */
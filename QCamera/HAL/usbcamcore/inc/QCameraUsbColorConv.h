@@ -0,0 +1,61 @@
+/* Copyright (c) 2012, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __QCAMERA_USB_COLOR_CONV_H
+#define __QCAMERA_USB_COLOR_CONV_H
+
+/* Output layouts of YUYV (YUV 4:2:2 interleaved) to YUV 4:2:0 conversion.  */
+/* Chroma is taken from even rows of the input, without averaging.          */
+typedef enum {
+    USBCAM_CONV_FMT_NV12,       /* Y plane followed by interleaved CbCr     */
+    USBCAM_CONV_FMT_NV21,       /* Y plane followed by interleaved CrCb     */
+    USBCAM_CONV_FMT_YV12,       /* Y, Cr, Cb planes. Y stride aligned to 16,*/
+                                /* chroma stride to 16 of half Y stride     */
+} usbcam_conv_fmt_t;
+
+#define USBCAM_CONV_NO_ERROR     0
+#define USBCAM_CONV_ERROR       -1
+
+int usbCamConvertYUYV(
+            const char  *inBuf,
+            char        *outBuf,
+            int         width,
+            int         height,
+            int         outFormat);
+
+const char *usbCamConvertImplName(void);
+
+/* Test hooks: kernel sets compiled in and supported by the CPU, from the */
+/* portable C ones at index 0 to the fastest. Not for use while converting */
+int usbCamConvertNumImpls(void);
+
+const char *usbCamConvertImplNameAt(int index);
+
+int usbCamConvertSelectImpl(int index);
+
+#endif /* __QCAMERA_USB_COLOR_CONV_H */
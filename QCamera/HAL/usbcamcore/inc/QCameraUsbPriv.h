@@ -35,17 +35,26 @@ namespace android {
 #define FILENAME_LENGTH     (256)
 
 /* Number of display buffers (in addition to minimum number of undequed buffers */
-#define PRVW_DISP_BUF_CNT   2
+/* Covers the ones held by convert stage, present queue and present stage, so */
+/* convert stage never waits on dequeue for a buffer held in the pipeline      */
+#define PRVW_DISP_BUF_CNT   4
 
-/* Number of V4L2 capture  buffers. */
-#define PRVW_CAP_BUF_CNT    4
+/* Number of V4L2 capture  buffers. Covers the buffers held by the preview */
+/* pipeline stages and queues, while keeping 2 queued in the driver        */
+#define PRVW_CAP_BUF_CNT    6
+
+/* Depth of the queues connecting preview pipeline stages */
+#define PRVW_PIPE_QUEUE_DEPTH   2
+
+/* Number of presented frames between preview latency reports */
+#define PRVW_STATS_FRAME_CNT    300
 
 /* Maximum buffer size for JPEG output in number of bytes */
 #define MAX_JPEG_BUFFER_SIZE    (1024 * 1024)
 
-/* Preview loop commands */
+/* Preview loop commands. These are bit flags posted to prvwCmd mailbox */
 #define USB_CAM_PREVIEW_EXIT    (0x100)
-#define USB_CAM_PREVIEW_PAUSE   (0x101)
+#define USB_CAM_PREVIEW_PAUSE   (0x400)
 #define USB_CAM_PREVIEW_TAKEPIC (0x200)
 
 /******************************************************************************
@@ -127,15 +136,66 @@ struct bufObj {
     int     len;
 };
 
+/* Preview pipeline stages for latency report */
+typedef enum {
+    PRVW_STAGE_QUEUE,           /* V4L2 dequeue to start of conversion      */
+    PRVW_STAGE_CONVERT,         /* conversion or MJPEG decode               */
+    PRVW_STAGE_PRESENT,         /* end of conversion to display enqueue done*/
+    PRVW_STAGE_TOTAL,           /* V4L2 dequeue to display enqueue done     */
+    PRVW_STAGE_MAX
+} usbcam_prvw_stage_t;
+
+/* One frame in flight in the preview pipeline */
+typedef struct {
+    struct v4l2_buffer                  capBuf;
+    int                                 dispBufId;
+    int                                 dispGen;
+    nsecs_t                             dqTs;
+    nsecs_t                             convStartTs;
+    nsecs_t                             convEndTs;
+} usbcam_prvw_frame_t;
+
+/* Bounded blocking queue connecting two preview pipeline stages */
+typedef struct {
+    usbcam_prvw_frame_t                 frames[PRVW_PIPE_QUEUE_DEPTH];
+    int                                 head;
+    int                                 count;
+    int                                 aborted;
+    pthread_mutex_t                     mutex;
+    pthread_cond_t                      notEmpty;
+    pthread_cond_t                      notFull;
+} usbcam_prvw_queue_t;
+
+/* Preview pipeline latency stats, updated by present stage */
+typedef struct {
+    int                                 frames;
+    nsecs_t                             startTs;
+    nsecs_t                             sum[PRVW_STAGE_MAX];
+    nsecs_t                             max[PRVW_STAGE_MAX];
+} usbcam_prvw_stats_t;
+
 typedef struct {
     camera_device                       hw_dev;
     Mutex                               lock;
     int                                 previewEnabledFlag;
     int                                 prvwStoppedForPicture;
     int                                 msgEnabledFlag;
-    volatile int                        prvwCmdPending;
-    volatile int                        prvwCmd;
+    /* Preview pipeline: capture, convert and present stages */
+    volatile int32_t                    prvwCmd;
     pthread_t                           previewThread;
+    pthread_t                           prvwConvertThread;
+    pthread_t                           prvwPresentThread;
+    usbcam_prvw_queue_t                 prvwConvertQ;
+    usbcam_prvw_queue_t                 prvwPresentQ;
+    /* prvwDispLock protects display buffers against set_preview_window */
+    /* prvwDispBusy is set while convert stage fills a display buffer     */
+    /* without the lock, set_preview_window waits on prvwDispCond for it  */
+    Mutex                               prvwDispLock;
+    Condition                           prvwDispCond;
+    int                                 prvwDispGen;
+    int                                 prvwDispBusy;
+    volatile int32_t                    prvwDrops;
+    usbcam_prvw_stats_t                 prvwStats;
     pthread_t                           takePictureThread;
 
     camera_notify_callback              notify_cb;
@@ -30,9 +30,11 @@
 #define ALOG_NIDEBUG 0
 #define LOG_TAG "QCameraMjpegDecode"
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 
 extern "C" {
@@ -42,23 +44,14 @@ extern "C" {
 }
 
 #include "QCameraMjpegDecode.h"
+#include "QCameraMjpegSwDecode.h"
 
-/* TBDJ: Can be removed */
-#define MIN(a,b)  (((a) < (b)) ? (a) : (b))
+/* Size of each of the 2 ping-pong input buffers of the decoder */
+#define MJPEGD_INPUT_BUF_SIZE       0xA000
 
-// Abstract the return type of the function to be run as a thread
-#define OS_THREAD_FUNC_RET_T            void *
-
-// Abstract the argument type to the thread function
-#define OS_THREAD_FUNC_ARG_T            void *
-
-// Helpful constants for return values in the thread functions
-#define OS_THREAD_FUNC_RET_SUCCEEDED    (OS_THREAD_FUNC_RET_T)0
-#define OS_THREAD_FUNC_RET_FAILED       (OS_THREAD_FUNC_RET_T)1
-
-// Abstract the function modifier placed in the beginning of the thread
-// declaration (empty for Linux)
-#define OS_THREAD_FUNC_MODIFIER
+/* Number of output buffers whose jpeg buffer bindings are retained. */
+/* Covers the display buffers the preview cycles through.            */
+#define MJPEGD_MAX_OUT_BINDINGS     8
 
 #define os_mutex_init(a) pthread_mutex_init(a, NULL)
 #define os_cond_init(a)  pthread_cond_init(a, NULL)
@@ -74,44 +67,51 @@ const char event_to_string[4][14] =
     "EVENT_ERROR",
 };
 
+/* Output buffer bound to the luma/chroma planes of one display buffer */
 typedef struct
 {
-    uint32_t   width;
-    uint32_t   height;
-    uint32_t   format;
-    uint32_t   preference;
-    uint32_t   abort_time;
-    uint16_t   back_to_back_count;
-    /* TBDJ: Is this required */
-    int32_t    rotation;
-    /* TBDJ: Is this required */
-    jpeg_rectangle_t region;
-    /* TBDJ: Is this required */
-    jpegd_scale_type_t scale_factor;
-    uint32_t   hw_rotation;
-
-    char*       inputMjpegBuffer;
-    int         inputMjpegBufferSize;
-    char*       outputYptr;
-    char*       outputUVptr;
-
-} test_args_t;
+    char*               outputYptr;
+    jpegd_output_buf_t  buf;
+} mjpegd_out_binding_t;
 
+/* Decoder session. Lives from mjpegDecoderInit to mjpegDecoderDestroy */
+/* and keeps decoder objects, input buffers and output bindings across  */
+/* frames. Only output bindings are rebuilt, on a resolution change.    */
 typedef struct
 {
-    int                   tid;
-    pthread_t             thread;
-    jpegd_obj_t           decoder;
-    uint8_t               decoding;
-    uint8_t               decode_success;
-    pthread_mutex_t       mutex;
-    pthread_cond_t        cond;
-    test_args_t           *p_args;
-    jpegd_output_buf_t    *p_whole_output_buf;
-
-} thread_ctrl_blk_t;
-
-OS_THREAD_FUNC_RET_T OS_THREAD_FUNC_MODIFIER decoder_test(OS_THREAD_FUNC_ARG_T p_thread_args);
+    uint32_t            preference;
+    int32_t             rotation;
+    jpegd_scale_type_t  scale_factor;
+    uint32_t            hw_rotation;
+
+    /* jpegd session */
+    int                 hwReady;
+    jpegd_obj_t         decoder;
+    jpegd_src_t         source;
+    uint8_t             decoding;
+    uint8_t             decode_success;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      cond;
+    uint32_t            width;
+    uint32_t            height;
+    mjpegd_out_binding_t outBindings[MJPEGD_MAX_OUT_BINDINGS];
+    int                 numOutBindings;
+    int                 nextOutBinding;
+
+    /* Software session. Fallback for jpegd. If enabled, preferred for */
+    /* frames with restart intervals it can decode slice parallel      */
+    void*               swd;
+    int                 useSw;
+    int                 preferSliced;
+
+    /* Current frame. If the frame has no DHT, the default DHT segment is */
+    /* served to the decoder at dhtInsertOffset without copying the frame */
+    char*               inputMjpegBuffer;
+    int                 inputMjpegBufferSize;
+    int                 dhtInsertOffset;
+    int                 restartInterval;
+} mjpegd_session_t;
+
 void decoder_event_handler(void        *p_user_data,
                            jpeg_event_t event,
                            void        *p_arg);
@@ -123,43 +123,69 @@ uint32_t decoder_input_req_handler(void           *p_user_data,
                                    jpeg_buffer_t   buffer,
                                    uint32_t        start_offset,
                                    uint32_t        length);
-static void* insertHuffmanTable(void *p, int size);
+static void scanFrameHeaders(mjpegd_session_t *mjpegd);
+static MJPEGD_ERR hwDecoderInit(mjpegd_session_t *mjpegd);
+static void hwDecoderDeinit(mjpegd_session_t *mjpegd);
+static void releaseOutBindings(mjpegd_session_t *mjpegd);
+static jpegd_output_buf_t* getOutBinding(mjpegd_session_t *mjpegd,
+                                         char *outputYptr, char *outputUVptr);
+static MJPEGD_ERR hwDecode(mjpegd_session_t *mjpegd,
+                          char *outputYptr, char *outputUVptr,
+                          int outputFormat);
+static MJPEGD_ERR swDecode(mjpegd_session_t *mjpegd,
+                          char *outputYptr, char *outputUVptr,
+                          int outputFormat);
 
 static int mjpegd_timer_start(timespec *p_timer);
 static int mjpegd_timer_get_elapsed(timespec *p_timer, int *elapsed_in_ms, uint8_t reset_start);
-static int mjpegd_cond_timedwait(pthread_cond_t *p_cond, pthread_mutex_t *p_mutex, uint32_t ms);
-
-// Global variables
-/* TBDJ: can be removed */
-thread_ctrl_blk_t *thread_ctrl_blks = NULL;
 
 /*
- * This function initializes the mjpeg decoder and returns the object
+ * This function initializes the mjpeg decoder session and returns the object
  */
 MJPEGD_ERR mjpegDecoderInit(void** mjpegd_obj)
 {
-    test_args_t* mjpegd;
+    mjpegd_session_t* mjpegd;
+    char value[PROPERTY_VALUE_MAX];
+    char mode[PROPERTY_VALUE_MAX];
+    MJPEGD_ERR rc;
 
     ALOGD("%s: E", __func__);
 
-    mjpegd = (test_args_t *)malloc(sizeof(test_args_t));
+    mjpegd = (mjpegd_session_t *)malloc(sizeof(mjpegd_session_t));
     if(!mjpegd)
         return MJPEGD_INSUFFICIENT_MEM;
 
-    memset(mjpegd, 0, sizeof(test_args_t));
+    memset(mjpegd, 0, sizeof(mjpegd_session_t));
 
     /* Defaults */
     /* Due to current limitation, s/w decoder is selected always */
     mjpegd->preference          = JPEG_DECODER_PREF_HW_ACCELERATED_PREFERRED;
-    mjpegd->back_to_back_count  = 1;
     mjpegd->rotation            = 0;
     mjpegd->hw_rotation         = 0;
     mjpegd->scale_factor        = (jpegd_scale_type_t)1;
+    os_mutex_init(&mjpegd->mutex);
+    os_cond_init(&mjpegd->cond);
+
+    /* hw:     jpegd always, software decoder only if jpegd fails */
+    /* sliced: jpegd, except frames the software decoder can slice */
+    /* sw:     software decoder always                             */
+    property_get("persist.camera.usbcam.mjpegd", mode, "hw");
+    mjpegd->preferSliced = !strcmp(mode, "sliced");
+
+    /* Software decoder is always available, jpegd is optional. Slice */
+    /* threads are only worth their cores when the sliced path is on  */
+    property_get("persist.camera.usbcam.mjpegd.threads", value, "0");
+    rc = mjpegSwDecoderInit(&mjpegd->swd,
+                            strcmp(mode, "hw") ? atoi(value) : 1);
+    if(rc) {
+        free(mjpegd);
+        return rc;
+    }
 
-    /* TBDJ: can be removed */
-    mjpegd->width                 = 640;
-    mjpegd->height                = 480;
-    mjpegd->abort_time            = 0;
+    if(!strcmp(mode, "sw") || hwDecoderInit(mjpegd)) {
+        ALOGI("%s: using software MJPEG decoder", __func__);
+        mjpegd->useSw = 1;
+    }
 
     *mjpegd_obj = (void *)mjpegd;
 
@@ -167,6 +193,27 @@ MJPEGD_ERR mjpegDecoderInit(void** mjpegd_obj)
     return  MJPEGD_NO_ERROR;
 }
 
+/*
+ * This function releases the mjpeg decoder session
+ */
+MJPEGD_ERR mjpegDecoderDestroy(void* mjpegd_obj)
+{
+    mjpegd_session_t* mjpegd = (mjpegd_session_t*) mjpegd_obj;
+
+    ALOGD("%s: E", __func__);
+    if(!mjpegd)
+        return MJPEGD_ERROR;
+
+    hwDecoderDeinit(mjpegd);
+    mjpegSwDecoderDestroy(mjpegd->swd);
+    pthread_cond_destroy(&mjpegd->cond);
+    pthread_mutex_destroy(&mjpegd->mutex);
+    free(mjpegd);
+
+    ALOGD("%s: X", __func__);
+    return MJPEGD_NO_ERROR;
+}
+
 MJPEGD_ERR mjpegDecode(
             void*   mjpegd_obj,
             char*   inputMjpegBuffer,
@@ -175,432 +222,399 @@ MJPEGD_ERR mjpegDecode(
             char*   outputUVptr,
             int     outputFormat)
 {
-    int rc, c, i;
-    test_args_t* mjpegd;
-    test_args_t  test_args;
+    int rc;
+    mjpegd_session_t* mjpegd;
 
     ALOGD("%s: E", __func__);
-    /* store input arguments in the context */
-    mjpegd = (test_args_t*) mjpegd_obj;
+    /* store input arguments in the session */
+    mjpegd = (mjpegd_session_t*) mjpegd_obj;
     mjpegd->inputMjpegBuffer        = inputMjpegBuffer;
     mjpegd->inputMjpegBufferSize    = inputMjpegBufferSize;
-    mjpegd->outputYptr              = outputYptr;
-    mjpegd->outputUVptr             = outputUVptr;
-    mjpegd->format                  = outputFormat;
-
-    /* TBDJ: can be removed */
-    memcpy(&test_args, mjpegd, sizeof(test_args_t));
 
     // check the formats
-    if (((test_args.format == YCRCBLP_H1V2) || (test_args.format == YCBCRLP_H1V2) ||
-      (test_args.format == YCRCBLP_H1V1) || (test_args.format == YCBCRLP_H1V1)) &&
-      !(test_args.preference == JPEG_DECODER_PREF_HW_ACCELERATED_ONLY)) {
-        ALOGE("%s:These formats are not supported by SW format %d", __func__, test_args.format);
-        return 1;
-    }
-
-    // Create thread control blocks
-    thread_ctrl_blks = (thread_ctrl_blk_t *)malloc( sizeof(thread_ctrl_blk_t));
-    if (!thread_ctrl_blks)
-    {
-        ALOGE("%s: decoder_test failed: insufficient memory in creating thread control blocks", __func__);
+    if (((outputFormat == YCRCBLP_H1V2) || (outputFormat == YCBCRLP_H1V2) ||
+      (outputFormat == YCRCBLP_H1V1) || (outputFormat == YCBCRLP_H1V1)) &&
+      !(mjpegd->preference == JPEG_DECODER_PREF_HW_ACCELERATED_ONLY)) {
+        ALOGE("%s:These formats are not supported by SW format %d", __func__, outputFormat);
         return 1;
     }
-    memset(thread_ctrl_blks, 0, sizeof(thread_ctrl_blk_t));
-    // Initialize the blocks and kick off the threads
-        thread_ctrl_blks[i].tid = i;
-        thread_ctrl_blks[i].p_args = &test_args;
-        os_mutex_init(&thread_ctrl_blks[i].mutex);
-        os_cond_init(&thread_ctrl_blks[i].cond);
 
-    rc = (int)decoder_test(&thread_ctrl_blks[i]);
+    scanFrameHeaders(mjpegd);
 
-    if (!rc)
-        ALOGD("%s: decoder_test finished successfully ", __func__);
-    else
-        ALOGE("%s: decoder_test failed",__func__);
+    if(!mjpegd->useSw &&
+       (!mjpegd->preferSliced || !mjpegd->restartInterval ||
+        mjpegSwNumThreads(mjpegd->swd) < 2)) {
+        rc = hwDecode(mjpegd, outputYptr, outputUVptr, outputFormat);
+        if(!rc) {
+            ALOGD("%s: X rc: %d", __func__, rc);
+            return rc;
+        }
+        ALOGE("%s: jpegd decode failed, retrying with software decoder",
+              __func__);
+    }
+    rc = swDecode(mjpegd, outputYptr, outputUVptr, outputFormat);
 
     ALOGD("%s: X rc: %d", __func__, rc);
 
     return rc;
 }
 
-OS_THREAD_FUNC_RET_T OS_THREAD_FUNC_MODIFIER decoder_test(OS_THREAD_FUNC_ARG_T arg)
+/*
+ * This function walks the marker segments of the current frame up to SOS.
+ * dhtInsertOffset is set to the offset of SOS if the frame has no DHT of
+ * its own (UVC MJPEG frames usually have none), else to -1.
+ * restartInterval is set from DRI, 0 if the frame has none
+ */
+static void scanFrameHeaders(mjpegd_session_t *mjpegd)
 {
-    int rc, i;
-    jpegd_obj_t         decoder;
-    jpegd_src_t         source;
-    jpegd_dst_t         dest;
-    jpegd_cfg_t         config;
-    jpeg_hdr_t          header;
-    jpegd_output_buf_t  p_output_buffers;
-    uint32_t            output_buffers_count = 1; // currently only 1 buffer a time is supported
-    uint8_t use_pmem = true;
-    timespec os_timer;
-    thread_ctrl_blk_t *p_thread_arg = (thread_ctrl_blk_t *)arg;
-    test_args_t *p_args = p_thread_arg->p_args;
-    uint32_t            output_width;
-    uint32_t            output_height;
-    uint32_t total_time = 0;
+    const uint8_t *buf = (const uint8_t *)mjpegd->inputMjpegBuffer;
+    int size = mjpegd->inputMjpegBufferSize;
+    int pos = 2, hasDHT = 0;
+
+    mjpegd->dhtInsertOffset = -1;
+    mjpegd->restartInterval = 0;
+    if(size < 4 || 0xFF != buf[0] || 0xD8 != buf[1])
+        return;
+
+    while(pos + 4 <= size) {
+        if(0xFF != buf[pos]) {
+            pos++;
+            continue;
+        }
+        if(0xFF == buf[pos + 1]) {
+            pos++;
+            continue;
+        }
+        if(0xC4 == buf[pos + 1])
+            hasDHT = 1;
+        if(0xDD == buf[pos + 1] && pos + 6 <= size)
+            mjpegd->restartInterval = (buf[pos + 4] << 8) | buf[pos + 5];
+        if(0xDA == buf[pos + 1]) {
+            if(!hasDHT)
+                mjpegd->dhtInsertOffset = pos;
+            return;
+        }
+        pos += 2 + ((buf[pos + 2] << 8) | buf[pos + 3]);
+    }
+}
 
-    ALOGD("%s: E", __func__);
+/*
+ * This function sets up the jpegd objects retained by the session:
+ * the decoder and its input buffers
+ */
+static MJPEGD_ERR hwDecoderInit(mjpegd_session_t *mjpegd)
+{
+    int rc;
+    uint8_t use_pmem = true;
 
     // Determine whether pmem should be used (useful for pc environment testing where
     // pmem is not available)
-    if ((jpegd_preference_t)p_args->preference == JPEG_DECODER_PREF_SOFTWARE_PREFERRED ||
-        (jpegd_preference_t)p_args->preference == JPEG_DECODER_PREF_SOFTWARE_ONLY) {
+    if ((jpegd_preference_t)mjpegd->preference == JPEG_DECODER_PREF_SOFTWARE_PREFERRED ||
+        (jpegd_preference_t)mjpegd->preference == JPEG_DECODER_PREF_SOFTWARE_ONLY) {
         use_pmem = false;
     }
 
-    if (((jpegd_preference_t)p_args->preference !=
-      JPEG_DECODER_PREF_HW_ACCELERATED_ONLY) &&
-      ((jpegd_preference_t)p_args->scale_factor > 0)) {
-        ALOGI("%s: Setting scale factor to 1x", __func__);
-    }
-
-    ALOGD("%s: before jpegd_init p_thread_arg: %p", __func__, p_thread_arg);
-
-    // Initialize decoder
-    rc = jpegd_init(&decoder,
+    rc = jpegd_init(&mjpegd->decoder,
                     &decoder_event_handler,
                     &decoder_output_handler,
-                    p_thread_arg);
-
+                    mjpegd);
     if (JPEG_FAILED(rc)) {
-        ALOGE("%s: decoder_test: jpegd_init failed", __func__);
-        goto fail;
+        ALOGE("%s: jpegd_init failed", __func__);
+        return MJPEGD_ERROR;
     }
-    p_thread_arg->decoder = decoder;
 
     // Set source information
-    source.p_input_req_handler = &decoder_input_req_handler;
-    source.total_length        = p_args->inputMjpegBufferSize & 0xffffffff;
-
-    rc = jpeg_buffer_init(&source.buffers[0]);
-    if (JPEG_SUCCEEDED(rc)) {
-        /* TBDJ: why buffer [1] */
-        rc = jpeg_buffer_init(&source.buffers[1]);
-    }
-    if (JPEG_SUCCEEDED(rc)) {
-#if 1
-        rc = jpeg_buffer_allocate(source.buffers[0], 0xA000, use_pmem);
-#else
-        rc = jpeg_buffer_use_external_buffer(source.buffers[0],
-                                             (uint8_t *)p_args->inputMjpegBuffer,
-                                             p_args->inputMjpegBufferSize,
-                                             0);
-#endif
-        ALOGD("%s: source.buffers[0]:%p compressed buffer ptr = %p", __func__,
-              source.buffers[0], p_args->inputMjpegBuffer);
-    }
-    if (JPEG_SUCCEEDED(rc)) {
-#if 1
-        rc = jpeg_buffer_allocate(source.buffers[1], 0xA000, use_pmem);
-#else
-         rc = jpeg_buffer_use_external_buffer(source.buffers[1],
-                                             (uint8_t *)p_args->inputMjpegBuffer,
-                                             p_args->inputMjpegBufferSize,
-                                             0);
-#endif
-        ALOGD("%s: source.buffers[1]:%p compressed buffer ptr  = %p", __func__,
-              source.buffers[1], p_args->inputMjpegBuffer);
-   }
+    mjpegd->source.p_input_req_handler = &decoder_input_req_handler;
+
+    rc = jpeg_buffer_init(&mjpegd->source.buffers[0]);
+    if (JPEG_SUCCEEDED(rc))
+        rc = jpeg_buffer_init(&mjpegd->source.buffers[1]);
+    if (JPEG_SUCCEEDED(rc))
+        rc = jpeg_buffer_allocate(mjpegd->source.buffers[0],
+                                  MJPEGD_INPUT_BUF_SIZE, use_pmem);
+    if (JPEG_SUCCEEDED(rc))
+        rc = jpeg_buffer_allocate(mjpegd->source.buffers[1],
+                                  MJPEGD_INPUT_BUF_SIZE, use_pmem);
     if (JPEG_FAILED(rc)) {
-        jpeg_buffer_destroy(&source.buffers[0]);
-        jpeg_buffer_destroy(&source.buffers[1]);
-        goto fail;
+        ALOGE("%s: input buffer allocation failed", __func__);
+        jpeg_buffer_destroy(&mjpegd->source.buffers[0]);
+        jpeg_buffer_destroy(&mjpegd->source.buffers[1]);
+        jpegd_destroy(&mjpegd->decoder);
+        return MJPEGD_ERROR;
     }
 
-   ALOGI("%s: *** Starting back-to-back decoding of %d frame(s)***\n",
-                 __func__, p_args->back_to_back_count);
+    mjpegd->hwReady = 1;
+    return MJPEGD_NO_ERROR;
+}
 
-	 // Loop to perform n back-to-back decoding (to the same output file)
-    for(i = 0; i < p_args->back_to_back_count; i++) {
-        if(mjpegd_timer_start(&os_timer) < 0) {
-            ALOGE("%s: failed to get start time", __func__);
-        }
+/*
+ * This function releases the jpegd objects retained by the session
+ */
+static void hwDecoderDeinit(mjpegd_session_t *mjpegd)
+{
+    if(!mjpegd->hwReady)
+        return;
+
+    releaseOutBindings(mjpegd);
+    jpeg_buffer_destroy(&mjpegd->source.buffers[0]);
+    jpeg_buffer_destroy(&mjpegd->source.buffers[1]);
+    jpegd_destroy(&mjpegd->decoder);
+    mjpegd->hwReady = 0;
+}
 
-        /* TBDJ: Every frame? */
-        ALOGD("%s: before jpegd_set_source source.p_arg:%p", __func__, source.p_arg);
-        rc = jpegd_set_source(decoder, &source);
-        if (JPEG_FAILED(rc))
-        {
-            ALOGE("%s: jpegd_set_source failed", __func__);
-            goto fail;
-        }
+/*
+ * This function releases all output buffer bindings
+ */
+static void releaseOutBindings(mjpegd_session_t *mjpegd)
+{
+    for(int i = 0; i < mjpegd->numOutBindings; i++) {
+        jpeg_buffer_destroy(&mjpegd->outBindings[i].buf.data.yuv.luma_buf);
+        jpeg_buffer_destroy(&mjpegd->outBindings[i].buf.data.yuv.chroma_buf);
+    }
+    memset(mjpegd->outBindings, 0, sizeof(mjpegd->outBindings));
+    mjpegd->numOutBindings = 0;
+    mjpegd->nextOutBinding = 0;
+}
 
-        rc = jpegd_read_header(decoder, &header);
-        if (JPEG_FAILED(rc))
-        {
-            ALOGE("%s: jpegd_read_header failed", __func__);
-            goto fail;
-        }
-        p_args->width = header.main.width;
-        p_args->height = header.main.height;
-        ALOGD("%s: main dimension: (%dx%d) subsampling: (%d)", __func__,
-                header.main.width, header.main.height, (int)header.main.subsampling);
-
-        // main image decoding:
-        // Set destination information
-        dest.width = (p_args->width) ? (p_args->width) : header.main.width;
-        dest.height = (p_args->height) ? (p_args->height) : header.main.height;
-        dest.output_format = (jpeg_color_format_t) p_args->format;
-        dest.region = p_args->region;
-
-        // if region is defined, re-assign the output width/height
-        output_width  = dest.width;
-        output_height = dest.height;
-
-        if (p_args->region.right || p_args->region.bottom)
-        {
-            if (0 == p_args->rotation || 180 == p_args->rotation)
-            {
-                output_width  = MIN((dest.width),
-                        (uint32_t)(dest.region.right  - dest.region.left + 1));
-                output_height = MIN((dest.height),
-                        (uint32_t)(dest.region.bottom - dest.region.top  + 1));
-            }
-            // Swap output width/height for 90/270 rotation cases
-            else if (90 == p_args->rotation || 270 == p_args->rotation)
-            {
-                output_height  = MIN((dest.height),
-                        (uint32_t)(dest.region.right  - dest.region.left + 1));
-                output_width   = MIN((dest.width),
-                        (uint32_t)(dest.region.bottom - dest.region.top  + 1));
-            }
-            // Unsupported rotation cases
-            else
-            {
-                goto fail;
-            }
-        }
+/*
+ * This function returns the output buffer bound to the given planes,
+ * binding them on first use. Bindings are sized for the session resolution
+ */
+static jpegd_output_buf_t* getOutBinding(mjpegd_session_t *mjpegd,
+                                         char *outputYptr, char *outputUVptr)
+{
+    mjpegd_out_binding_t *binding;
+    uint32_t size = mjpegd->width * mjpegd->height * SQUARE(mjpegd->scale_factor);
+    int rc;
 
-        if (dest.output_format == YCRCBLP_H2V2 || dest.output_format == YCBCRLP_H2V2 ||
-            dest.output_format == YCRCBLP_H2V1 || dest.output_format == YCBCRLP_H2V1 ||
-            dest.output_format == YCRCBLP_H1V2 || dest.output_format == YCBCRLP_H1V2 ||
-            dest.output_format == YCRCBLP_H1V1 || dest.output_format == YCBCRLP_H1V1) {
-            jpeg_buffer_init(&p_output_buffers.data.yuv.luma_buf);
-            jpeg_buffer_init(&p_output_buffers.data.yuv.chroma_buf);
-        } else {
-            jpeg_buffer_init(&p_output_buffers.data.rgb.rgb_buf);
+    for(int i = 0; i < mjpegd->numOutBindings; i++)
+        if(mjpegd->outBindings[i].outputYptr == outputYptr)
+            return &mjpegd->outBindings[i].buf;
 
-        }
+    /* New output buffer: use a free slot, else recycle the oldest one */
+    if(mjpegd->numOutBindings < MJPEGD_MAX_OUT_BINDINGS) {
+        binding = &mjpegd->outBindings[mjpegd->numOutBindings++];
+    } else {
+        binding = &mjpegd->outBindings[mjpegd->nextOutBinding];
+        mjpegd->nextOutBinding =
+            (mjpegd->nextOutBinding + 1) % MJPEGD_MAX_OUT_BINDINGS;
+        jpeg_buffer_destroy(&binding->buf.data.yuv.luma_buf);
+        jpeg_buffer_destroy(&binding->buf.data.yuv.chroma_buf);
+    }
+    memset(binding, 0, sizeof(*binding));
+
+    // Assign 0 to tile width and height
+    // to indicate that no tiling is requested.
+    binding->buf.tile_width  = 0;
+    binding->buf.tile_height = 0;
+    binding->buf.is_in_q     = 0;
+
+    rc = jpeg_buffer_init(&binding->buf.data.yuv.luma_buf);
+    if (JPEG_SUCCEEDED(rc))
+        rc = jpeg_buffer_init(&binding->buf.data.yuv.chroma_buf);
+    if (JPEG_SUCCEEDED(rc))
+        rc = jpeg_buffer_use_external_buffer(
+                binding->buf.data.yuv.luma_buf,
+                (uint8_t*)outputYptr, size, 0);
+    if (JPEG_SUCCEEDED(rc))
+        rc = jpeg_buffer_use_external_buffer(
+                binding->buf.data.yuv.chroma_buf,
+                (uint8_t*)outputUVptr, size / 2, 0);
+    if (JPEG_FAILED(rc)) {
+        ALOGE("%s: binding output buffer failed", __func__);
+        jpeg_buffer_destroy(&binding->buf.data.yuv.luma_buf);
+        jpeg_buffer_destroy(&binding->buf.data.yuv.chroma_buf);
+        /* Keep the slot consistent: an unused binding matches no buffer */
+        memset(binding, 0, sizeof(*binding));
+        return NULL;
+    }
+    binding->outputYptr = outputYptr;
+    return &binding->buf;
+}
 
-        {
-            // Assign 0 to tile width and height
-            // to indicate that no tiling is requested.
-            p_output_buffers.tile_width  = 0;
-            p_output_buffers.tile_height = 0;
-        }
-        p_output_buffers.is_in_q = 0;
-
-        switch (dest.output_format)
-        {
-        case YCRCBLP_H2V2:
-        case YCBCRLP_H2V2:
-//        case YCRCBLP_H2V1:
-//        case YCBCRLP_H2V1:
-//        case YCRCBLP_H1V2:
-//        case YCBCRLP_H1V2:
-//        case YCRCBLP_H1V1:
-//        case YCBCRLP_H1V1:
-            jpeg_buffer_use_external_buffer(
-               p_output_buffers.data.yuv.luma_buf,
-               (uint8_t*)p_args->outputYptr,
-               p_args->width * p_args->height * SQUARE(p_args->scale_factor),
-               0);
-            jpeg_buffer_use_external_buffer(
-                p_output_buffers.data.yuv.chroma_buf,
-                (uint8_t*)p_args->outputUVptr,
-                p_args->width * p_args->height / 2 * SQUARE(p_args->scale_factor),
-                0);
-            break;
-
-        default:
-            ALOGE("%s: decoder_test: unsupported output format", __func__);
-            goto fail;
-        }
+/*
+ * This function decodes the current frame with the retained jpegd session
+ */
+static MJPEGD_ERR hwDecode(mjpegd_session_t *mjpegd,
+                          char *outputYptr, char *outputUVptr,
+                          int outputFormat)
+{
+    int                 rc;
+    jpegd_dst_t         dest;
+    jpegd_cfg_t         config;
+    jpeg_hdr_t          header;
+    jpegd_output_buf_t  *p_output_buffer;
+    timespec            os_timer;
+    int                 diff;
 
-        // Set up configuration
-        memset(&config, 0, sizeof(jpegd_cfg_t));
-        config.preference = (jpegd_preference_t) p_args->preference;
-        config.decode_from = JPEGD_DECODE_FROM_AUTO;
-        config.rotation = p_args->rotation;
-        config.scale_factor = p_args->scale_factor;
-        config.hw_rotation = p_args->hw_rotation;
-        dest.back_to_back_count = p_args->back_to_back_count;
-
-        // Start decoding
-        p_thread_arg->decoding = true;
-
-        rc = jpegd_start(decoder, &config, &dest, &p_output_buffers, output_buffers_count);
-        dest.back_to_back_count--;
-
-        if(JPEG_FAILED(rc)) {
-            ALOGE("%s: decoder_test: jpegd_start failed (rc=%d)\n",
-                    __func__, rc);
-            goto fail;
-        }
+    if(mjpegd_timer_start(&os_timer) < 0) {
+        ALOGE("%s: failed to get start time", __func__);
+    }
 
-        ALOGD("%s: decoder_test: jpegd_start succeeded", __func__);
-
-        // Do abort
-        if (p_args->abort_time) {
-            os_mutex_lock(&p_thread_arg->mutex);
-            while (p_thread_arg->decoding)
-            {
-                rc = mjpegd_cond_timedwait(&p_thread_arg->cond, &p_thread_arg->mutex, p_args->abort_time);
-                if (rc == JPEGERR_ETIMEDOUT)
-                {
-                    // Do abort
-                    os_mutex_unlock(&p_thread_arg->mutex);
-                    rc = jpegd_abort(decoder);
-                    if (rc)
-                    {
-                        ALOGE("%s: decoder_test: jpegd_abort failed: %d", __func__, rc);
-                        goto fail;
-                    }
-                    break;
-                }
-            }
-            if (p_thread_arg->decoding)
-                os_mutex_unlock(&p_thread_arg->mutex);
-        } else {
-            // Wait until decoding is done or stopped due to error
-            os_mutex_lock(&p_thread_arg->mutex);
-            while (p_thread_arg->decoding)
-            {
-                os_cond_wait(&p_thread_arg->cond, &p_thread_arg->mutex);
-            }
-            os_mutex_unlock(&p_thread_arg->mutex);
-        }
+    mjpegd->source.total_length = mjpegd->inputMjpegBufferSize & 0xffffffff;
+    if(mjpegd->dhtInsertOffset >= 0)
+        mjpegd->source.total_length += mjpegdDefaultDHTSize;
 
-        int diff;
-        // Display the time elapsed
-        if (mjpegd_timer_get_elapsed(&os_timer, &diff, 0) < 0) {
-            ALOGE("%s: decoder_test: failed to get elapsed time", __func__);
-        } else {
-            if(p_args->abort_time) {
-                if(p_thread_arg->decoding) {
-                    ALOGI("%s: decoder_test: decoding aborted successfully after %d ms", __func__, diff);
-                    goto buffer_clean_up;
-                }
-                else
-                {
-                    ALOGI("%s: decoder_test: decoding stopped before abort is issued. "
-                                    "decode time: %d ms", __func__, diff);
-                }
-            }
-            else {
-                if(p_thread_arg->decode_success) {
-                    total_time += diff;
-                    ALOGI("%s: decode time: %d ms (%d frame(s), total=%dms, avg=%dms/frame)",
-                            __func__, diff, i+1, total_time, total_time/(i+1));
-                }
-                else
-                {
-                    fprintf(stderr, "decoder_test: decode failed\n");
-                }
-            }
-        }
+    /* Rewinds the decoder onto the new frame. Input buffers are reused */
+    rc = jpegd_set_source(mjpegd->decoder, &mjpegd->source);
+    if (JPEG_FAILED(rc))
+    {
+        ALOGE("%s: jpegd_set_source failed", __func__);
+        return MJPEGD_ERROR;
     }
 
-    if(p_thread_arg->decode_success) {
-        ALOGD("%s: Frame(s) = %d, Total Time = %dms, Avg. decode time = %dms/frame)\n",
-                 __func__, p_args->back_to_back_count, total_time, total_time/p_args->back_to_back_count);
+    rc = jpegd_read_header(mjpegd->decoder, &header);
+    if (JPEG_FAILED(rc))
+    {
+        ALOGE("%s: jpegd_read_header failed", __func__);
+        return MJPEGD_ERROR;
+    }
+
+    /* Output bindings are sized for the resolution; rebind on change */
+    if(header.main.width != mjpegd->width ||
+       header.main.height != mjpegd->height) {
+        ALOGI("%s: resolution changed %dx%d -> %dx%d subsampling: (%d)",
+              __func__, mjpegd->width, mjpegd->height,
+              header.main.width, header.main.height,
+              (int)header.main.subsampling);
+        releaseOutBindings(mjpegd);
+        mjpegd->width  = header.main.width;
+        mjpegd->height = header.main.height;
     }
 
-buffer_clean_up:
-    // Clean up decoder and allocate buffers
-    jpeg_buffer_destroy(&source.buffers[0]);
-    jpeg_buffer_destroy(&source.buffers[1]);
-    switch (dest.output_format)
+    switch (outputFormat)
     {
     case YCRCBLP_H2V2:
     case YCBCRLP_H2V2:
-    case YCRCBLP_H2V1:
-    case YCBCRLP_H2V1:
-    case YCRCBLP_H1V2:
-    case YCBCRLP_H1V2:
-    case YCRCBLP_H1V1:
-    case YCBCRLP_H1V1:
-        jpeg_buffer_destroy(&p_output_buffers.data.yuv.luma_buf);
-        jpeg_buffer_destroy(&p_output_buffers.data.yuv.chroma_buf);
         break;
     default:
-        break;
+        ALOGE("%s: unsupported output format", __func__);
+        return MJPEGD_ERROR;
     }
-    jpegd_destroy(&decoder);
 
-    if (!p_thread_arg->decode_success)
+    p_output_buffer = getOutBinding(mjpegd, outputYptr, outputUVptr);
+    if(!p_output_buffer)
+        return MJPEGD_ERROR;
+    p_output_buffer->is_in_q = 0;
+
+    // Set destination information
+    memset(&dest, 0, sizeof(jpegd_dst_t));
+    dest.width              = mjpegd->width;
+    dest.height             = mjpegd->height;
+    dest.output_format      = (jpeg_color_format_t) outputFormat;
+    dest.back_to_back_count = 1;
+
+    // Set up configuration
+    memset(&config, 0, sizeof(jpegd_cfg_t));
+    config.preference = (jpegd_preference_t) mjpegd->preference;
+    config.decode_from = JPEGD_DECODE_FROM_AUTO;
+    config.rotation = mjpegd->rotation;
+    config.scale_factor = mjpegd->scale_factor;
+    config.hw_rotation = mjpegd->hw_rotation;
+
+    // Start decoding
+    mjpegd->decoding       = true;
+    mjpegd->decode_success = false;
+
+    rc = jpegd_start(mjpegd->decoder, &config, &dest, p_output_buffer, 1);
+    if(JPEG_FAILED(rc)) {
+        ALOGE("%s: jpegd_start failed (rc=%d)\n", __func__, rc);
+        mjpegd->decoding = false;
+        return MJPEGD_ERROR;
+    }
+
+    // Wait until decoding is done or stopped due to error
+    os_mutex_lock(&mjpegd->mutex);
+    while (mjpegd->decoding)
     {
-        goto fail;
+        os_cond_wait(&mjpegd->cond, &mjpegd->mutex);
     }
+    os_mutex_unlock(&mjpegd->mutex);
 
-    ALOGD("%s: X", __func__);
-    return OS_THREAD_FUNC_RET_SUCCEEDED;
-fail:
+    if (mjpegd_timer_get_elapsed(&os_timer, &diff, 0) < 0) {
+        ALOGE("%s: failed to get elapsed time", __func__);
+    } else {
+        ALOGD("%s: decode time: %d ms", __func__, diff);
+    }
 
-    ALOGD("%s: X", __func__);
-    return OS_THREAD_FUNC_RET_FAILED;
+    return mjpegd->decode_success ? MJPEGD_NO_ERROR : MJPEGD_ERROR;
+}
+
+/*
+ * This function decodes the current frame with the software decoder
+ */
+static MJPEGD_ERR swDecode(mjpegd_session_t *mjpegd,
+                          char *outputYptr, char *outputUVptr,
+                          int outputFormat)
+{
+    int swFormat;
+
+    switch (outputFormat)
+    {
+    case YCRCBLP_H2V2:
+        swFormat = MJPEGD_SW_FMT_NV21;
+        break;
+    case YCBCRLP_H2V2:
+        swFormat = MJPEGD_SW_FMT_NV12;
+        break;
+    default:
+        ALOGE("%s: unsupported output format", __func__);
+        return MJPEGD_ERROR;
+    }
+
+    return mjpegSwDecode(mjpegd->swd,
+                         mjpegd->inputMjpegBuffer,
+                         mjpegd->inputMjpegBufferSize,
+                         outputYptr,
+                         outputUVptr,
+                         swFormat);
 }
 
 void decoder_event_handler(void        *p_user_data,
                            jpeg_event_t event,
                            void        *p_arg)
 {
-    thread_ctrl_blk_t *p_thread_arg = (thread_ctrl_blk_t *)p_user_data;
+    mjpegd_session_t *mjpegd = (mjpegd_session_t *)p_user_data;
 
     ALOGD("%s: E", __func__);
 
     ALOGD("%s: Event: %s\n", __func__, event_to_string[event]);
     if (event == JPEG_EVENT_DONE)
     {
-        p_thread_arg->decode_success = true;
-        ALOGD("%s: decode_success: %d\n", __func__, p_thread_arg->decode_success);
+        mjpegd->decode_success = true;
+        ALOGD("%s: decode_success: %d\n", __func__, mjpegd->decode_success);
     }
     // If it is not a warning event, decoder has stopped; Signal
     // main thread to clean up
     if (event != JPEG_EVENT_WARNING)
     {
-        os_mutex_lock(&p_thread_arg->mutex);
-        p_thread_arg->decoding = false;
-        os_cond_signal(&p_thread_arg->cond);
-        os_mutex_unlock(&p_thread_arg->mutex);
+        os_mutex_lock(&mjpegd->mutex);
+        mjpegd->decoding = false;
+        os_cond_signal(&mjpegd->cond);
+        os_mutex_unlock(&mjpegd->mutex);
     }
     ALOGD("%s: X", __func__);
 
 }
 
 // consumes the output buffer.
-/*TBDJ: Can be removed. Is this related to tiling */
+// Only called for tiled output, which is not requested
 int decoder_output_handler(void *p_user_data,
                            jpegd_output_buf_t *p_output_buffer,
                            uint32_t first_row_id,
                            uint8_t is_last_buffer)
 {
-    uint8_t* whole_output_buf_ptr, *tiling_buf_ptr;
+    mjpegd_session_t *mjpegd = (mjpegd_session_t *)p_user_data;
 
     ALOGD("%s: E", __func__);
 
-    thread_ctrl_blk_t *p_thread_arg = (thread_ctrl_blk_t *)p_user_data;
-
-    jpeg_buffer_get_addr(p_thread_arg->p_whole_output_buf->data.rgb.rgb_buf, &whole_output_buf_ptr);
-    jpeg_buffer_get_addr(p_output_buffer->data.rgb.rgb_buf, &tiling_buf_ptr);
-
     if (p_output_buffer->tile_height != 1)
         return JPEGERR_EUNSUPPORTED;
 
-    // testing purpose only
-    // This is to simulate that the user needs to bail out when error happens
-    // in the middle of decoding
-    //if (first_row_id == 162)
-     //   return JPEGERR_EFAILED;
-
     // do not enqueue any buffer if it reaches the last buffer
     if (!is_last_buffer)
     {
-        jpegd_enqueue_output_buf(p_thread_arg->decoder, p_output_buffer, 1);
+        jpegd_enqueue_output_buf(mjpegd->decoder, p_output_buffer, 1);
     }
     ALOGD("%s: X", __func__);
 
@@ -612,6 +626,10 @@ int decoder_output_handler(void *p_user_data,
 //                                    p_reader->next_byte_offset,
 //                                    MAX_BYTES_TO_FETCH);
 
+/*
+ * Serves the frame to the decoder. If the frame has no DHT, the default
+ * DHT segment is spliced in at dhtInsertOffset on the fly
+ */
 uint32_t decoder_input_req_handler(void           *p_user_data,
                                    jpeg_buffer_t   buffer,
                                    uint32_t        start_offset,
@@ -619,29 +637,43 @@ uint32_t decoder_input_req_handler(void           *p_user_data,
 {
     uint32_t buf_size;
     uint8_t *buf_ptr;
-    int bytes_to_read, bytes_read, rc;
-    thread_ctrl_blk_t *p_thread_arg = (thread_ctrl_blk_t *)p_user_data;
-    thread_ctrl_blk_t *thread_ctrl_blk = (thread_ctrl_blk_t *)p_user_data;
-    test_args_t*    mjpegd = (test_args_t*) thread_ctrl_blk->p_args;
+    uint32_t bytes_to_read, bytes_read = 0;
+    mjpegd_session_t *mjpegd = (mjpegd_session_t *)p_user_data;
+    uint32_t ins = (uint32_t)mjpegd->dhtInsertOffset;
+    uint32_t dhtLen = mjpegd->dhtInsertOffset >= 0 ? mjpegdDefaultDHTSize : 0;
+    uint32_t total = mjpegd->inputMjpegBufferSize + dhtLen;
 
     ALOGD("%s: E", __func__);
 
     jpeg_buffer_get_max_size(buffer, &buf_size);
     jpeg_buffer_get_addr(buffer, &buf_ptr);
+    if (start_offset >= total)
+        return 0;
     bytes_to_read = (length < buf_size) ? length : buf_size;
-    bytes_read = 0;
+    if (bytes_to_read > total - start_offset)
+        bytes_to_read = total - start_offset;
 
     ALOGD("%s: buf_ptr = %p, start_offset = %d, length = %d buf_size = %d bytes_to_read = %d", __func__, buf_ptr, start_offset, length, buf_size, bytes_to_read);
-    if (bytes_to_read)
+    while (bytes_read < bytes_to_read)
     {
-        /* TBDJ: Should avoid this Mem copy */
-#if 1
-        memcpy(buf_ptr, (char *)mjpegd->inputMjpegBuffer + start_offset, bytes_to_read);
-#else
-        if(JPEGERR_SUCCESS != jpeg_buffer_set_start_offset(buffer, start_offset))
-            ALOGE("%s: jpeg_buffer_set_start_offset failed", __func__);
-#endif
-        bytes_read = bytes_to_read;
+        uint32_t pos = start_offset + bytes_read;
+        uint32_t n = bytes_to_read - bytes_read;
+        const uint8_t *src;
+
+        if (!dhtLen || pos < ins) {
+            /* Frame bytes before the DHT insertion point (or no DHT) */
+            src = (const uint8_t *)mjpegd->inputMjpegBuffer + pos;
+            if (dhtLen && n > ins - pos)
+                n = ins - pos;
+        } else if (pos < ins + dhtLen) {
+            src = mjpegdDefaultDHT + (pos - ins);
+            if (n > ins + dhtLen - pos)
+                n = ins + dhtLen - pos;
+        } else {
+            src = (const uint8_t *)mjpegd->inputMjpegBuffer + pos - dhtLen;
+        }
+        memcpy(buf_ptr + bytes_read, src, n);
+        bytes_read += n;
     }
 
     ALOGD("%s: X", __func__);
@@ -677,25 +709,3 @@ static int mjpegd_timer_get_elapsed(timespec *p_timer, int *elapsed_in_ms, uint8
 
     return JPEGERR_SUCCESS;
 }
-
-int mjpegd_cond_timedwait(pthread_cond_t *p_cond, pthread_mutex_t *p_mutex, uint32_t ms)
-{
-    struct timespec ts;
-    int rc = clock_gettime(CLOCK_REALTIME, &ts);
-    if (rc < 0) return rc;
-
-    if (ms >= 1000) {
-       ts.tv_sec += (ms/1000);
-       ts.tv_nsec += ((ms%1000) * 1000000);
-    } else {
-        ts.tv_nsec += (ms * 1000000);
-    }
-
-    rc = pthread_cond_timedwait(p_cond, p_mutex, &ts);
-    if (rc == ETIMEDOUT)
-    {
-        rc = JPEGERR_ETIMEDOUT;
-    }
-    return rc;
-}
-
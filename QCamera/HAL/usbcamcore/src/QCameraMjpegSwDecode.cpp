@@ -0,0 +1,1183 @@
+/* Copyright (c) 2012, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//#define ALOG_NDEBUG 0
+#define ALOG_NIDEBUG 0
+#define LOG_TAG "QCameraMjpegSwDecode"
+#include <utils/Log.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "QCameraMjpegSwDecode.h"
+
+/* Number of code bits resolved by a single Huffman lookup */
+#define HUFF_FAST_BITS          9
+
+/* Upper limit of slice decoding threads, including the caller's */
+#define MJPEGD_SW_MAX_THREADS   8
+
+/* Restart intervals are handed out to threads in this many chunks per */
+/* thread, to balance intervals of uneven complexity                   */
+#define MJPEGD_SW_JOBS_PER_THREAD 4
+
+/* Markers */
+#define M_SOF0                  0xC0
+#define M_SOF1                  0xC1
+#define M_DHT                   0xC4
+#define M_RST0                  0xD0
+#define M_RST7                  0xD7
+#define M_SOI                   0xD8
+#define M_EOI                   0xD9
+#define M_SOS                   0xDA
+#define M_DQT                   0xDB
+#define M_DRI                   0xDD
+
+/* Integer IDCT constants (13 bit fixed point), as in the IJG islow IDCT */
+#define CONST_BITS              13
+#define PASS1_BITS              2
+#define FIX_0_298631336         2446
+#define FIX_0_390180644         3196
+#define FIX_0_541196100         4433
+#define FIX_0_765366865         6270
+#define FIX_0_899976223         7373
+#define FIX_1_175875602         9633
+#define FIX_1_501321110         12299
+#define FIX_1_847759065         15137
+#define FIX_1_961570560         16069
+#define FIX_2_053119869         16819
+#define FIX_2_562915447         20995
+#define FIX_3_072711026         25172
+#define DESCALE(x, n)           (((x) + (1 << ((n) - 1))) >> (n))
+/* Left shift of negative values is undefined, shift as unsigned like IJG */
+#define LEFT_SHIFT(x, n)        ((int32_t)((uint32_t)(x) << (n)))
+
+typedef struct {
+    /* (code length << 8) | symbol for codes up to HUFF_FAST_BITS, else 0 */
+    uint16_t    fast[1 << HUFF_FAST_BITS];
+    int32_t     maxcode[17];
+    int32_t     mincode[17];
+    int32_t     valptr[17];
+    uint8_t     vals[256];
+} mjpegd_huff_t;
+
+typedef struct {
+    int         id;
+    int         h;
+    int         v;
+    int         tq;
+    int         td;
+    int         ta;
+} mjpegd_comp_t;
+
+/* Entropy decoder state of one run of MCUs between restart markers */
+typedef struct {
+    const uint8_t   *p;
+    const uint8_t   *end;
+    uint64_t        bitBuf;         /* MSB aligned */
+    int             bitCnt;
+    int             dcPred[3];
+    int32_t         coef[64];
+    uint8_t         pix[3][16 * 16];
+} mjpegd_slice_t;
+
+typedef struct {
+    /* Tables retained across frames */
+    mjpegd_huff_t   huff[2][4];     /* [DC/AC][table id]               */
+    uint8_t         dhtSeg[1024];   /* last DHT segments, to skip       */
+    int             dhtSegLen;      /* rebuilding unchanged tables      */
+    uint16_t        qt[4][64];      /* natural order                    */
+
+    /* Frame geometry, recomputed only when SOF changes */
+    int             width;
+    int             height;
+    int             ncomp;
+    mjpegd_comp_t   comp[3];
+    int             hmax;
+    int             vmax;
+    int             mcuW;
+    int             mcuH;
+    int             mcusX;
+    int             mcusY;
+    int             restartInterval;
+
+    /* Current frame */
+    const uint8_t   *scan;
+    const uint8_t   *scanEnd;
+    uint8_t         *outY;
+    uint8_t         *outUV;
+    int             swapUV;
+
+    /* Restart intervals of current frame. segStart[i] is the first byte */
+    /* of interval i, segStart[numSegs] the end of the scan              */
+    const uint8_t   **segStart;
+    int             segCap;
+    int             numSegs;
+    int             mcusPerSeg;
+
+    /* Slice worker pool. Threads persist for the session and pick    */
+    /* chunks of segsPerJob intervals from nextSeg until none is left */
+    int             numThreads;
+    pthread_t       threads[MJPEGD_SW_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t  workCond;
+    pthread_cond_t  doneCond;
+    int             jobGen;
+    int             busy;
+    int             exit;
+    int             nextSeg;
+    int             segsPerJob;
+} mjpegd_sw_t;
+
+/* Zigzag to natural order */
+static const uint8_t zigzag[64 + 16] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+    /* Extra entries so that corrupt run lengths stay in the array */
+    63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63,
+};
+
+const uint8_t mjpegdDefaultDHT[] = {
+    0xFF, M_DHT, 0x01, 0xA2,
+    /* DC luminance */
+    0x00,
+    0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+    /* AC luminance */
+    0x10,
+    0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03,
+    0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7D,
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+    0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08,
+    0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16,
+    0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+    0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+    0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
+    0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+    0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4,
+    0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA,
+    0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA,
+    /* DC chrominance */
+    0x01,
+    0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+    /* AC chrominance */
+    0x11,
+    0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04,
+    0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77,
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+    0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+    0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34,
+    0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+    0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96,
+    0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+    0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4,
+    0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+    0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2,
+    0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+    0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9,
+    0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA,
+};
+
+const int mjpegdDefaultDHTSize = sizeof(mjpegdDefaultDHT);
+
+static inline int get16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+/******************************************************************************
+ * Function: buildHuffTable
+ * Description: This function builds decoding tables from the code length
+ *              counts and symbols of a DHT table
+ *
+ * Input parameters:
+ *   h                   - Huffman table to build
+ *   counts              - number of codes of each length 1..16
+ *   vals                - symbols in order of increasing code length
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR
+ *   MJPEGD_ERROR        invalid table
+ *
+ * Notes: none
+ *****************************************************************************/
+static MJPEGD_ERR buildHuffTable(mjpegd_huff_t *h, const uint8_t *counts,
+                                 const uint8_t *vals)
+{
+    int code = 0, k = 0;
+
+    memset(h->fast, 0, sizeof(h->fast));
+    for(int l = 1; l <= 16; l++) {
+        h->valptr[l]  = k;
+        h->mincode[l] = code;
+        for(int i = 0; i < counts[l - 1]; i++, k++, code++) {
+            if(k >= 256 || code >= (1 << l))
+                return MJPEGD_ERROR;
+            h->vals[k] = vals[k];
+            if(l <= HUFF_FAST_BITS) {
+                int shift = HUFF_FAST_BITS - l;
+                for(int j = 0; j < (1 << shift); j++)
+                    h->fast[(code << shift) | j] = (uint16_t)((l << 8) | vals[k]);
+            }
+        }
+        h->maxcode[l] = counts[l - 1] ? code - 1 : -1;
+        code <<= 1;
+    }
+    return MJPEGD_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: parseDHT
+ * Description: This function parses the tables of one DHT segment
+ *
+ * Input parameters:
+ *   sw                  - decoder handle
+ *   p                   - segment payload (after length field)
+ *   len                 - payload length
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR
+ *   MJPEGD_ERROR        invalid segment
+ *
+ * Notes: none
+ *****************************************************************************/
+static MJPEGD_ERR parseDHT(mjpegd_sw_t *sw, const uint8_t *p, int len)
+{
+    while(len > 17) {
+        int tc = p[0] >> 4, th = p[0] & 0x0F, n = 0;
+
+        for(int i = 1; i <= 16; i++)
+            n += p[i];
+        if(tc > 1 || th > 3 || len < 17 + n)
+            return MJPEGD_ERROR;
+        if(buildHuffTable(&sw->huff[tc][th], p + 1, p + 17))
+            return MJPEGD_ERROR;
+        p   += 17 + n;
+        len -= 17 + n;
+    }
+    return len ? MJPEGD_ERROR : MJPEGD_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: parseSOF
+ * Description: This function parses the frame header and recomputes MCU
+ *              geometry
+ *
+ * Input parameters:
+ *   sw                  - decoder handle
+ *   p                   - segment payload (after length field)
+ *   len                 - payload length
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR
+ *   MJPEGD_ERROR        invalid or unsupported frame
+ *
+ * Notes: none
+ *****************************************************************************/
+static MJPEGD_ERR parseSOF(mjpegd_sw_t *sw, const uint8_t *p, int len)
+{
+    int ncomp;
+
+    if(len < 6 || 8 != p[0])
+        return MJPEGD_ERROR;
+    ncomp = p[5];
+    if((1 != ncomp && 3 != ncomp) || len < 6 + 3 * ncomp)
+        return MJPEGD_ERROR;
+
+    sw->height = get16(p + 1);
+    sw->width  = get16(p + 3);
+    sw->ncomp  = ncomp;
+    if(!sw->width || !sw->height)
+        return MJPEGD_ERROR;
+
+    for(int i = 0; i < ncomp; i++) {
+        sw->comp[i].id = p[6 + 3 * i];
+        sw->comp[i].h  = p[7 + 3 * i] >> 4;
+        sw->comp[i].v  = p[7 + 3 * i] & 0x0F;
+        sw->comp[i].tq = p[8 + 3 * i] & 0x03;
+    }
+
+    if(1 == ncomp) {
+        /* Single component scans are not interleaved: 1 block per MCU */
+        sw->comp[0].h = sw->comp[0].v = 1;
+    } else {
+        /* Luma H1V1, H2V1 or H2V2 with full size chroma blocks */
+        if(sw->comp[0].h < 1 || sw->comp[0].h > 2 ||
+           sw->comp[0].v < 1 || sw->comp[0].v > sw->comp[0].h)
+            return MJPEGD_ERROR;
+        for(int i = 1; i < 3; i++)
+            if(1 != sw->comp[i].h || 1 != sw->comp[i].v)
+                return MJPEGD_ERROR;
+    }
+    sw->hmax  = sw->comp[0].h;
+    sw->vmax  = sw->comp[0].v;
+    sw->mcuW  = 8 * sw->hmax;
+    sw->mcuH  = 8 * sw->vmax;
+    sw->mcusX = (sw->width + sw->mcuW - 1) / sw->mcuW;
+    sw->mcusY = (sw->height + sw->mcuH - 1) / sw->mcuH;
+    return MJPEGD_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: parseHeaders
+ * Description: This function walks the marker segments up to SOS, updates
+ *              the tables retained in the decoder and locates the scan data
+ *
+ * Input parameters:
+ *   sw                  - decoder handle
+ *   in                  - JPEG frame
+ *   size                - frame size in bytes
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR
+ *   MJPEGD_ERROR        invalid or unsupported frame
+ *
+ * Notes: Tables not redefined by the frame keep their previous contents.
+ *        Huffman tables are reset to defaults if the frame has no DHT
+ *****************************************************************************/
+static MJPEGD_ERR parseHeaders(mjpegd_sw_t *sw, const uint8_t *in, int size)
+{
+    const uint8_t   *p = in, *end = in + size;
+    int             dhtLen = 0, sofSeen = 0;
+    uint8_t         dht[sizeof(sw->dhtSeg)];
+
+    if(size < 4 || 0xFF != p[0] || M_SOI != p[1])
+        return MJPEGD_ERROR;
+    p += 2;
+    sw->restartInterval = 0;
+
+    while(p + 4 <= end) {
+        int marker, len;
+
+        if(0xFF != *p++)
+            continue;
+        marker = *p++;
+        if(0xFF == marker || 0x00 == marker) {
+            p--;
+            continue;
+        }
+        if(M_EOI == marker || (marker >= M_RST0 && marker <= M_RST7))
+            return MJPEGD_ERROR;
+
+        len = get16(p);
+        if(len < 2 || p + len > end)
+            return MJPEGD_ERROR;
+
+        switch(marker) {
+        case M_SOF0:
+        case M_SOF1:
+            if(parseSOF(sw, p + 2, len - 2))
+                return MJPEGD_ERROR;
+            sofSeen = 1;
+            break;
+
+        case M_DHT:
+            /* Collect all DHT segments, they are applied at SOS */
+            if(dhtLen + len - 2 > (int)sizeof(dht))
+                return MJPEGD_ERROR;
+            memcpy(dht + dhtLen, p + 2, len - 2);
+            dhtLen += len - 2;
+            break;
+
+        case M_DQT: {
+            const uint8_t *q = p + 2, *qEnd = p + len;
+            while(q < qEnd) {
+                int pq = q[0] >> 4, tq = q[0] & 0x03;
+                if(q + 1 + 64 * (pq + 1) > qEnd)
+                    return MJPEGD_ERROR;
+                for(int i = 0; i < 64; i++)
+                    sw->qt[tq][zigzag[i]] = pq ? get16(q + 1 + 2 * i) : q[1 + i];
+                q += 1 + 64 * (pq + 1);
+            }
+            break;
+        }
+
+        case M_DRI:
+            if(len < 4)
+                return MJPEGD_ERROR;
+            sw->restartInterval = get16(p + 2);
+            break;
+
+        case M_SOS: {
+            int ns = p[2];
+            if(!sofSeen || ns != sw->ncomp || len < 6 + 2 * ns)
+                return MJPEGD_ERROR;
+            for(int i = 0; i < ns; i++) {
+                int cs = p[3 + 2 * i], t = p[4 + 2 * i];
+                if(cs != sw->comp[i].id)
+                    return MJPEGD_ERROR;
+                sw->comp[i].td = (t >> 4) & 0x03;
+                sw->comp[i].ta = t & 0x03;
+            }
+
+            /* Rebuild Huffman tables only when they differ from last frame */
+            if(!dhtLen) {
+                memcpy(dht, mjpegdDefaultDHT + 4, mjpegdDefaultDHTSize - 4);
+                dhtLen = mjpegdDefaultDHTSize - 4;
+            }
+            if(dhtLen != sw->dhtSegLen || memcmp(dht, sw->dhtSeg, dhtLen)) {
+                sw->dhtSegLen = 0;
+                if(parseDHT(sw, dht, dhtLen))
+                    return MJPEGD_ERROR;
+                memcpy(sw->dhtSeg, dht, dhtLen);
+                sw->dhtSegLen = dhtLen;
+            }
+
+            sw->scan    = p + len;
+            sw->scanEnd = end;
+            return MJPEGD_NO_ERROR;
+        }
+
+        default:
+            break;
+        }
+        p += len;
+    }
+    return MJPEGD_ERROR;
+}
+
+/******************************************************************************
+*  Entropy decoding
+******************************************************************************/
+static inline void fillBits(mjpegd_slice_t *s)
+{
+    while(s->bitCnt <= 56) {
+        uint32_t byte = 0;
+
+        if(s->p < s->end) {
+            byte = *s->p;
+            if(0xFF == byte) {
+                /* Stuffed zero byte is skipped. A marker stops the read */
+                /* and zero bits are returned until the slice ends       */
+                if(s->p + 1 < s->end && 0x00 == s->p[1])
+                    s->p += 2;
+                else
+                    byte = 0, s->end = s->p;
+            } else
+                s->p++;
+        }
+        s->bitBuf |= (uint64_t)byte << (56 - s->bitCnt);
+        s->bitCnt += 8;
+    }
+}
+
+static inline int getBits(mjpegd_slice_t *s, int n)
+{
+    int v;
+
+    if(s->bitCnt < n)
+        fillBits(s);
+    v = (int)(s->bitBuf >> (64 - n));
+    s->bitBuf <<= n;
+    s->bitCnt -= n;
+    return v;
+}
+
+static inline int extend(int v, int n)
+{
+    return v < (1 << (n - 1)) ? v - (1 << n) + 1 : v;
+}
+
+static inline int huffDecode(mjpegd_slice_t *s, const mjpegd_huff_t *h)
+{
+    int e, code;
+
+    if(s->bitCnt < 16)
+        fillBits(s);
+    e = h->fast[s->bitBuf >> (64 - HUFF_FAST_BITS)];
+    if(e) {
+        s->bitBuf <<= e >> 8;
+        s->bitCnt -= e >> 8;
+        return e & 0xFF;
+    }
+    for(int l = HUFF_FAST_BITS + 1; l <= 16; l++) {
+        code = (int)(s->bitBuf >> (64 - l));
+        if(code <= h->maxcode[l]) {
+            s->bitBuf <<= l;
+            s->bitCnt -= l;
+            return h->vals[h->valptr[l] + code - h->mincode[l]];
+        }
+    }
+    /* Invalid code: skip it, the frame is corrupt anyway */
+    s->bitBuf <<= 16;
+    s->bitCnt -= 16;
+    return 0;
+}
+
+/******************************************************************************
+ * Function: decodeBlock
+ * Description: This function decodes and dequantizes the coefficients of
+ *              one 8x8 block
+ *
+ * Input parameters:
+ *   s                   - slice state. Coefficients are returned in s->coef
+ *   dc, ac              - Huffman tables
+ *   qt                  - quantization table, natural order
+ *   dcPred              - DC predictor of the component
+ *
+ * Return values: index of the last non-zero coefficient in zigzag order
+ *
+ * Notes: none
+ *****************************************************************************/
+static int decodeBlock(mjpegd_slice_t *s, const mjpegd_huff_t *dc,
+                       const mjpegd_huff_t *ac, const uint16_t *qt,
+                       int *dcPred)
+{
+    int t, k, last = 0;
+
+    memset(s->coef, 0, sizeof(s->coef));
+
+    t = huffDecode(s, dc);
+    if(t)
+        *dcPred += extend(getBits(s, t), t);
+    s->coef[0] = *dcPred * qt[0];
+
+    for(k = 1; k < 64; k++) {
+        int rs = huffDecode(s, ac), r = rs >> 4, sz = rs & 0x0F;
+        if(sz) {
+            k += r;
+            if(k > 63)
+                break;
+            s->coef[zigzag[k]] = extend(getBits(s, sz), sz) * qt[zigzag[k]];
+            last = k;
+        } else if(15 == r)
+            k += 15;
+        else
+            break;
+    }
+    return last;
+}
+
+static inline uint8_t clamp255(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+/******************************************************************************
+ * Function: idctBlock
+ * Description: This function runs the integer inverse DCT of one block and
+ *              stores level shifted samples
+ *
+ * Input parameters:
+ *   coef                - dequantized coefficients, natural order
+ *   last                - index of last non-zero coefficient in zigzag order
+ *   out                 - output samples
+ *   stride              - output stride in bytes
+ *
+ * Return values: none
+ *
+ * Notes: Same arithmetic as the IJG islow IDCT, so output matches libjpeg
+ *        with JDCT_ISLOW
+ *****************************************************************************/
+static void idctBlock(const int32_t *coef, int last, uint8_t *out, int stride)
+{
+    int32_t ws[64];
+
+    /* DC only block is common at webcam bitrates */
+    if(0 == last) {
+        uint8_t dc = clamp255(DESCALE(LEFT_SHIFT(coef[0], PASS1_BITS), PASS1_BITS + 3) + 128);
+        for(int y = 0; y < 8; y++, out += stride)
+            memset(out, dc, 8);
+        return;
+    }
+
+    /* Pass 1: columns */
+    for(int c = 0; c < 8; c++) {
+        const int32_t *in = coef + c;
+        int32_t *w = ws + c;
+        int32_t tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+        int32_t z1, z2, z3, z4, z5;
+
+        if(!(in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56])) {
+            int32_t dc = LEFT_SHIFT(in[0], PASS1_BITS);
+            for(int r = 0; r < 8; r++)
+                w[8 * r] = dc;
+            continue;
+        }
+
+        z2 = in[16];
+        z3 = in[48];
+        z1 = (z2 + z3) * FIX_0_541196100;
+        tmp2 = z1 - z3 * FIX_1_847759065;
+        tmp3 = z1 + z2 * FIX_0_765366865;
+        z2 = in[0];
+        z3 = in[32];
+        tmp0 = LEFT_SHIFT(z2 + z3, CONST_BITS);
+        tmp1 = LEFT_SHIFT(z2 - z3, CONST_BITS);
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        tmp0 = in[56];
+        tmp1 = in[40];
+        tmp2 = in[24];
+        tmp3 = in[8];
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        z4 = tmp1 + tmp3;
+        z5 = (z3 + z4) * FIX_1_175875602;
+        tmp0 *= FIX_0_298631336;
+        tmp1 *= FIX_2_053119869;
+        tmp2 *= FIX_3_072711026;
+        tmp3 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 = z3 * -FIX_1_961570560 + z5;
+        z4 = z4 * -FIX_0_390180644 + z5;
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        w[0]  = DESCALE(tmp10 + tmp3, CONST_BITS - PASS1_BITS);
+        w[56] = DESCALE(tmp10 - tmp3, CONST_BITS - PASS1_BITS);
+        w[8]  = DESCALE(tmp11 + tmp2, CONST_BITS - PASS1_BITS);
+        w[48] = DESCALE(tmp11 - tmp2, CONST_BITS - PASS1_BITS);
+        w[16] = DESCALE(tmp12 + tmp1, CONST_BITS - PASS1_BITS);
+        w[40] = DESCALE(tmp12 - tmp1, CONST_BITS - PASS1_BITS);
+        w[24] = DESCALE(tmp13 + tmp0, CONST_BITS - PASS1_BITS);
+        w[32] = DESCALE(tmp13 - tmp0, CONST_BITS - PASS1_BITS);
+    }
+
+    /* Pass 2: rows */
+    for(int r = 0; r < 8; r++, out += stride) {
+        const int32_t *w = ws + 8 * r;
+        int32_t tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+        int32_t z1, z2, z3, z4, z5;
+        const int n = CONST_BITS + PASS1_BITS + 3;
+
+        z2 = w[2];
+        z3 = w[6];
+        z1 = (z2 + z3) * FIX_0_541196100;
+        tmp2 = z1 - z3 * FIX_1_847759065;
+        tmp3 = z1 + z2 * FIX_0_765366865;
+        tmp0 = LEFT_SHIFT(w[0] + w[4], CONST_BITS);
+        tmp1 = LEFT_SHIFT(w[0] - w[4], CONST_BITS);
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        tmp0 = w[7];
+        tmp1 = w[5];
+        tmp2 = w[3];
+        tmp3 = w[1];
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        z4 = tmp1 + tmp3;
+        z5 = (z3 + z4) * FIX_1_175875602;
+        tmp0 *= FIX_0_298631336;
+        tmp1 *= FIX_2_053119869;
+        tmp2 *= FIX_3_072711026;
+        tmp3 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 = z3 * -FIX_1_961570560 + z5;
+        z4 = z4 * -FIX_0_390180644 + z5;
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        out[0] = clamp255(DESCALE(tmp10 + tmp3, n) + 128);
+        out[7] = clamp255(DESCALE(tmp10 - tmp3, n) + 128);
+        out[1] = clamp255(DESCALE(tmp11 + tmp2, n) + 128);
+        out[6] = clamp255(DESCALE(tmp11 - tmp2, n) + 128);
+        out[2] = clamp255(DESCALE(tmp12 + tmp1, n) + 128);
+        out[5] = clamp255(DESCALE(tmp12 - tmp1, n) + 128);
+        out[3] = clamp255(DESCALE(tmp13 + tmp0, n) + 128);
+        out[4] = clamp255(DESCALE(tmp13 - tmp0, n) + 128);
+    }
+}
+
+/******************************************************************************
+ * Function: storeMcu
+ * Description: This function writes the samples of one decoded MCU to the
+ *              YUV 4:2:0 semi-planar output, clipped to the image size
+ *
+ * Input parameters:
+ *   sw                  - decoder handle
+ *   s                   - slice state holding the MCU samples
+ *   mcuX, mcuY          - MCU position in MCUs
+ *
+ * Return values: none
+ *
+ * Notes: Chroma of H2V1 and H1V1 frames is taken from even rows/columns,
+ *        like the YUYV conversion of the preview path
+ *****************************************************************************/
+static void storeMcu(mjpegd_sw_t *sw, mjpegd_slice_t *s, int mcuX, int mcuY)
+{
+    int x0 = mcuX * sw->mcuW, y0 = mcuY * sw->mcuH;
+    int w  = sw->width - x0 < sw->mcuW ? sw->width - x0 : sw->mcuW;
+    int h  = sw->height - y0 < sw->mcuH ? sw->height - y0 : sw->mcuH;
+    uint8_t *dst = sw->outY + y0 * sw->width + x0;
+
+    for(int y = 0; y < h; y++, dst += sw->width)
+        memcpy(dst, s->pix[0] + y * sw->mcuW, w);
+
+    if(1 == sw->ncomp)
+        return;
+
+    /* Chroma plane is width/2 x height/2 CbCr pairs */
+    {
+        int cw = (x0 + w) / 2 - x0 / 2, ch = (y0 + h) / 2 - y0 / 2;
+        int xs = 2 / sw->hmax, ys = 2 / sw->vmax;
+        const uint8_t *cb = s->pix[sw->swapUV ? 2 : 1];
+        const uint8_t *cr = s->pix[sw->swapUV ? 1 : 2];
+
+        dst = sw->outUV + (y0 / 2) * sw->width + x0;
+        for(int y = 0; y < ch; y++, dst += sw->width) {
+            const uint8_t *u = cb + y * ys * 8, *v = cr + y * ys * 8;
+            for(int x = 0; x < cw; x++) {
+                dst[2 * x]     = u[x * xs];
+                dst[2 * x + 1] = v[x * xs];
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * Function: decodeMcus
+ * Description: This function decodes a run of MCUs of the scan into the
+ *              output buffers
+ *
+ * Input parameters:
+ *   sw                  - decoder handle
+ *   s                   - slice state, positioned at the first MCU
+ *   first               - index of first MCU in raster order
+ *   count               - number of MCUs to decode
+ *
+ * Return values: none
+ *
+ * Notes: Predictors are reset by caller at restart boundaries
+ *****************************************************************************/
+static void decodeMcus(mjpegd_sw_t *sw, mjpegd_slice_t *s, int first,
+                       int count)
+{
+    int mcuX = first % sw->mcusX, mcuY = first / sw->mcusX;
+
+    for(int n = 0; n < count; n++) {
+        for(int c = 0; c < sw->ncomp; c++) {
+            const mjpegd_comp_t *comp = &sw->comp[c];
+            const mjpegd_huff_t *dc = &sw->huff[0][comp->td];
+            const mjpegd_huff_t *ac = &sw->huff[1][comp->ta];
+            int stride = 8 * comp->h;
+
+            for(int by = 0; by < comp->v; by++)
+                for(int bx = 0; bx < comp->h; bx++) {
+                    int last = decodeBlock(s, dc, ac, sw->qt[comp->tq],
+                                           &s->dcPred[c]);
+                    idctBlock(s->coef, last,
+                              s->pix[c] + by * 8 * stride + bx * 8, stride);
+                }
+        }
+        storeMcu(sw, s, mcuX, mcuY);
+        if(++mcuX == sw->mcusX) {
+            mcuX = 0;
+            mcuY++;
+        }
+    }
+}
+
+/******************************************************************************
+ * Function: findSegments
+ * Description: This function locates the restart intervals of the scan by
+ *              their RST markers
+ *
+ * Input parameters:
+ *   sw                  - decoder handle
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR
+ *   MJPEGD_ERROR        markers do not match the restart interval
+ *   MJPEGD_INSUFFICIENT_MEM
+ *
+ * Notes: Entropy coded data never contains 0xFF followed by a marker code,
+ *        so a byte scan finds the intervals without decoding
+ *****************************************************************************/
+static MJPEGD_ERR findSegments(mjpegd_sw_t *sw)
+{
+    int total = sw->mcusX * sw->mcusY;
+    int expected = (total + sw->restartInterval - 1) / sw->restartInterval;
+    const uint8_t *p = sw->scan, *end = sw->scanEnd;
+
+    if(expected + 1 > sw->segCap) {
+        const uint8_t **seg = (const uint8_t **)realloc(sw->segStart,
+                                  (expected + 1) * sizeof(*seg));
+        if(!seg)
+            return MJPEGD_INSUFFICIENT_MEM;
+        sw->segStart = seg;
+        sw->segCap   = expected + 1;
+    }
+
+    sw->numSegs     = 0;
+    sw->mcusPerSeg  = sw->restartInterval;
+    sw->segStart[sw->numSegs++] = p;
+    while(p + 1 < end &&
+          (p = (const uint8_t *)memchr(p, 0xFF, end - p - 1)) != NULL) {
+        int m = p[1];
+        if(m >= M_RST0 && m <= M_RST7) {
+            if(sw->numSegs == expected)
+                return MJPEGD_ERROR;
+            sw->segStart[sw->numSegs++] = p + 2;
+            p += 2;
+        } else if(0x00 == m || 0xFF == m) {
+            p++;
+        } else {
+            /* EOI or any other marker ends the scan */
+            break;
+        }
+    }
+    sw->segStart[sw->numSegs] = p ? p : end;
+    return sw->numSegs == expected ? MJPEGD_NO_ERROR : MJPEGD_ERROR;
+}
+
+/******************************************************************************
+ * Function: decodeSegments
+ * Description: This function decodes chunks of restart intervals until all
+ *              intervals of the frame are taken. Run by every slice thread
+ *
+ * Input parameters:
+ *   sw                  - decoder handle
+ *
+ * Return values: none
+ *
+ * Notes: Each interval starts with reset predictors on a byte boundary and
+ *        writes only its own MCUs, so intervals are independent
+ *****************************************************************************/
+static void decodeSegments(mjpegd_sw_t *sw)
+{
+    mjpegd_slice_t  slice;
+    int             total = sw->mcusX * sw->mcusY;
+
+    while(1) {
+        int first, last;
+
+        pthread_mutex_lock(&sw->lock);
+        first = sw->nextSeg;
+        sw->nextSeg += sw->segsPerJob;
+        pthread_mutex_unlock(&sw->lock);
+        if(first >= sw->numSegs)
+            break;
+        last = first + sw->segsPerJob;
+        if(last > sw->numSegs)
+            last = sw->numSegs;
+
+        for(int i = first; i < last; i++) {
+            int mcu = i * sw->mcusPerSeg;
+            int count = total - mcu < sw->mcusPerSeg ? total - mcu : sw->mcusPerSeg;
+
+            memset(&slice, 0, sizeof(slice));
+            slice.p   = sw->segStart[i];
+            /* Interval ends at the next RST marker */
+            slice.end = i + 1 < sw->numSegs ? sw->segStart[i + 1] - 2
+                                            : sw->segStart[i + 1];
+            decodeMcus(sw, &slice, mcu, count);
+        }
+    }
+}
+
+/******************************************************************************
+ * Function: sliceThread
+ * Description: This is thread function of slice decoding workers
+ *
+ * Input parameters:
+ *   arg                 - decoder handle
+ *
+ * Return values: NULL
+ *
+ * Notes: none
+ *****************************************************************************/
+static void *sliceThread(void *arg)
+{
+    mjpegd_sw_t *sw = (mjpegd_sw_t *)arg;
+    int         gen = 0;
+
+    pthread_mutex_lock(&sw->lock);
+    while(1) {
+        while(!sw->exit && gen == sw->jobGen)
+            pthread_cond_wait(&sw->workCond, &sw->lock);
+        if(sw->exit)
+            break;
+        gen = sw->jobGen;
+        pthread_mutex_unlock(&sw->lock);
+
+        decodeSegments(sw);
+
+        pthread_mutex_lock(&sw->lock);
+        if(0 == --sw->busy)
+            pthread_cond_signal(&sw->doneCond);
+    }
+    pthread_mutex_unlock(&sw->lock);
+    return NULL;
+}
+
+/******************************************************************************
+ * Function: decodeSlices
+ * Description: This function decodes the restart intervals of the frame on
+ *              the worker pool and the calling thread
+ *
+ * Input parameters:
+ *   sw                  - decoder handle
+ *
+ * Return values: none
+ *
+ * Notes: Returns when all intervals are decoded
+ *****************************************************************************/
+static void decodeSlices(mjpegd_sw_t *sw)
+{
+    pthread_mutex_lock(&sw->lock);
+    sw->nextSeg    = 0;
+    sw->segsPerJob = sw->numSegs / (sw->numThreads * MJPEGD_SW_JOBS_PER_THREAD);
+    if(sw->segsPerJob < 1)
+        sw->segsPerJob = 1;
+    sw->busy = sw->numThreads - 1;
+    sw->jobGen++;
+    pthread_cond_broadcast(&sw->workCond);
+    pthread_mutex_unlock(&sw->lock);
+
+    decodeSegments(sw);
+
+    pthread_mutex_lock(&sw->lock);
+    while(sw->busy)
+        pthread_cond_wait(&sw->doneCond, &sw->lock);
+    pthread_mutex_unlock(&sw->lock);
+}
+
+/******************************************************************************
+ * Function: mjpegSwDecoderInit
+ * Description: This function creates a software decoder session and its
+ *              slice worker threads
+ *
+ * Input parameters:
+ *   swd                 - the session handle is returned in this arg
+ *   numThreads          - number of slice decoding threads, including the
+ *                         caller. 0 selects the number of online CPUs
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR
+ *   MJPEGD_INSUFFICIENT_MEM
+ *
+ * Notes: If threads can't be created, decoding runs with fewer threads
+ *****************************************************************************/
+MJPEGD_ERR mjpegSwDecoderInit(void **swd, int numThreads)
+{
+    mjpegd_sw_t *sw = (mjpegd_sw_t *)calloc(1, sizeof(mjpegd_sw_t));
+
+    if(!sw)
+        return MJPEGD_INSUFFICIENT_MEM;
+
+    if(numThreads <= 0)
+        numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(numThreads < 1)
+        numThreads = 1;
+    if(numThreads > MJPEGD_SW_MAX_THREADS)
+        numThreads = MJPEGD_SW_MAX_THREADS;
+
+    pthread_mutex_init(&sw->lock, NULL);
+    pthread_cond_init(&sw->workCond, NULL);
+    pthread_cond_init(&sw->doneCond, NULL);
+    sw->numThreads = 1;
+    while(sw->numThreads < numThreads) {
+        if(pthread_create(&sw->threads[sw->numThreads], NULL, sliceThread, sw)) {
+            ALOGE("%s: created %d of %d slice threads", __func__,
+                  sw->numThreads - 1, numThreads - 1);
+            break;
+        }
+        sw->numThreads++;
+    }
+    ALOGI("%s: %d slice thread(s)", __func__, sw->numThreads);
+
+    *swd = sw;
+    return MJPEGD_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: mjpegSwDecoderDestroy
+ * Description: This function releases a software decoder session
+ *
+ * Input parameters:
+ *   swd                 - session handle
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR
+ *
+ * Notes: none
+ *****************************************************************************/
+MJPEGD_ERR mjpegSwDecoderDestroy(void *swd)
+{
+    mjpegd_sw_t *sw = (mjpegd_sw_t *)swd;
+
+    if(!sw)
+        return MJPEGD_ERROR;
+
+    pthread_mutex_lock(&sw->lock);
+    sw->exit = 1;
+    pthread_cond_broadcast(&sw->workCond);
+    pthread_mutex_unlock(&sw->lock);
+    for(int i = 1; i < sw->numThreads; i++)
+        pthread_join(sw->threads[i], NULL);
+
+    pthread_cond_destroy(&sw->doneCond);
+    pthread_cond_destroy(&sw->workCond);
+    pthread_mutex_destroy(&sw->lock);
+    free(sw->segStart);
+    free(sw);
+    return MJPEGD_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: mjpegSwNumThreads
+ * Description: This function returns the number of slice decoding threads
+ *
+ * Input parameters:
+ *   swd                 - session handle
+ *
+ * Return values: number of threads, including the caller's
+ *
+ * Notes: none
+ *****************************************************************************/
+int mjpegSwNumThreads(void *swd)
+{
+    return swd ? ((mjpegd_sw_t *)swd)->numThreads : 0;
+}
+
+/******************************************************************************
+ * Function: mjpegSwDecode
+ * Description: This function decodes one JPEG frame to YUV 4:2:0 semi-planar
+ *
+ * Input parameters:
+ *   swd                 - session handle
+ *   mjpegBuffer         - JPEG frame
+ *   mjpegBufferSize     - frame size in bytes
+ *   outputYptr          - luma plane, width x height
+ *   outputUVptr         - chroma plane, width x height/2
+ *   outputFormat        - mjpegd_sw_fmt_t
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR
+ *   MJPEGD_ERROR        invalid or unsupported frame
+ *
+ * Notes: Output buffers must match the frame size. Corrupt entropy coded
+ *        data is decoded as far as possible and not reported as error.
+ *        Frames with restart intervals are decoded slice parallel
+ *****************************************************************************/
+MJPEGD_ERR mjpegSwDecode(
+            void        *swd,
+            const char  *mjpegBuffer,
+            int         mjpegBufferSize,
+            char        *outputYptr,
+            char        *outputUVptr,
+            int         outputFormat)
+{
+    mjpegd_sw_t     *sw = (mjpegd_sw_t *)swd;
+    mjpegd_slice_t  slice;
+    int             total, ri, done;
+
+    if(!sw || !mjpegBuffer || !outputYptr || !outputUVptr)
+        return MJPEGD_ERROR;
+    if(parseHeaders(sw, (const uint8_t *)mjpegBuffer, mjpegBufferSize)) {
+        ALOGE("%s: invalid or unsupported frame", __func__);
+        return MJPEGD_ERROR;
+    }
+
+    sw->outY   = (uint8_t *)outputYptr;
+    sw->outUV  = (uint8_t *)outputUVptr;
+    sw->swapUV = (MJPEGD_SW_FMT_NV21 == outputFormat);
+    if(1 == sw->ncomp)
+        memset(sw->outUV, 128, sw->width * (sw->height / 2));
+
+    total = sw->mcusX * sw->mcusY;
+    if(sw->numThreads > 1 && sw->restartInterval &&
+       sw->restartInterval < total && !findSegments(sw)) {
+        decodeSlices(sw);
+        ALOGD("%s: decoded %dx%d, %d slices on %d threads", __func__,
+              sw->width, sw->height, sw->numSegs, sw->numThreads);
+        return MJPEGD_NO_ERROR;
+    }
+
+    /* Decode restart intervals in sequence, realigning on RST markers */
+    ri    = sw->restartInterval ? sw->restartInterval : total;
+    memset(&slice, 0, sizeof(slice));
+    slice.p   = sw->scan;
+    slice.end = sw->scanEnd;
+    for(done = 0; done < total; done += ri) {
+        int count = total - done < ri ? total - done : ri;
+
+        if(done) {
+            /* Skip to and past the next RST marker */
+            const uint8_t *p = slice.p;
+            while(p + 1 < sw->scanEnd &&
+                  !(0xFF == p[0] && p[1] >= M_RST0 && p[1] <= M_RST7))
+                p++;
+            if(p + 1 >= sw->scanEnd)
+                break;
+            slice.p      = p + 2;
+            slice.end    = sw->scanEnd;
+            slice.bitBuf = 0;
+            slice.bitCnt = 0;
+            memset(slice.dcPred, 0, sizeof(slice.dcPred));
+        }
+        decodeMcus(sw, &slice, done, count);
+    }
+
+    ALOGD("%s: decoded %dx%d, %d MCUs, restart interval %d", __func__,
+          sw->width, sw->height, total, sw->restartInterval);
+    return MJPEGD_NO_ERROR;
+}
@@ -0,0 +1,510 @@
+/* Copyright (c) 2012, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//#define ALOG_NDEBUG 0
+#define ALOG_NIDEBUG 0
+#define LOG_TAG "QCameraUsbColorConv"
+#include <utils/Log.h>
+#include <cutils/properties.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define USBCAM_CONV_NEON        1
+#include <arm_neon.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#define USBCAM_CONV_X86         1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#include "QCameraUsbColorConv.h"
+
+#define ALIGN_TO(x, a)          (((x) + (a) - 1) & ~((a) - 1))
+
+/* Row kernels of one implementation. Widths are in pixels and even.        */
+/* yuvRowSP converts Y and interleaved chroma of an even row, yuvRowP Y and */
+/* planar chroma of an even row, and yRow only Y of an odd row.             */
+typedef struct {
+    const char  *name;
+    void        (*yRow)(const uint8_t *src, uint8_t *dstY, int width);
+    void        (*yuvRowSP)(const uint8_t *src, uint8_t *dstY,
+                            uint8_t *dstUV, int width, int swapUV);
+    void        (*yuvRowP)(const uint8_t *src, uint8_t *dstY,
+                           uint8_t *dstU, uint8_t *dstV, int width);
+} usbcam_conv_impl_t;
+
+#define USBCAM_CONV_MAX_IMPLS   3
+
+static pthread_once_t           convImplOnce = PTHREAD_ONCE_INIT;
+static const usbcam_conv_impl_t *convImpl = NULL;
+/* Kernel sets supported by the CPU, slowest first */
+static const usbcam_conv_impl_t *convImpls[USBCAM_CONV_MAX_IMPLS];
+static int                      numConvImpls = 0;
+
+/******************************************************************************
+*  Portable C kernels. Also used for the tail of a row by the SIMD kernels.
+******************************************************************************/
+static void yRow_C(const uint8_t *src, uint8_t *dstY, int width)
+{
+    for(int x = 0; x < width; x++)
+        dstY[x] = src[2 * x];
+}
+
+static void yuvRowSP_C(const uint8_t *src, uint8_t *dstY,
+                       uint8_t *dstUV, int width, int swapUV)
+{
+    int uIdx = swapUV ? 1 : 0;
+    int vIdx = swapUV ? 0 : 1;
+
+    for(int x = 0; x < width; x += 2)
+    {
+        dstY[x]             = src[2 * x];
+        dstY[x + 1]         = src[2 * x + 2];
+        dstUV[x + uIdx]     = src[2 * x + 1];
+        dstUV[x + vIdx]     = src[2 * x + 3];
+    }
+}
+
+static void yuvRowP_C(const uint8_t *src, uint8_t *dstY,
+                      uint8_t *dstU, uint8_t *dstV, int width)
+{
+    for(int x = 0; x < width; x += 2)
+    {
+        dstY[x]             = src[2 * x];
+        dstY[x + 1]         = src[2 * x + 2];
+        dstU[x / 2]         = src[2 * x + 1];
+        dstV[x / 2]         = src[2 * x + 3];
+    }
+}
+
+static const usbcam_conv_impl_t convImplC = {
+    "c", yRow_C, yuvRowSP_C, yuvRowP_C
+};
+
+#ifdef USBCAM_CONV_NEON
+/******************************************************************************
+*  NEON kernels, 32 pixels per iteration. vld4 splits YUYV into Y0, U, Y1, V
+******************************************************************************/
+static void yRow_NEON(const uint8_t *src, uint8_t *dstY, int width)
+{
+    int x = 0;
+    for(; x + 32 <= width; x += 32)
+    {
+        uint8x16x4_t yuyv = vld4q_u8(src + 2 * x);
+        uint8x16x2_t y;
+        y.val[0] = yuyv.val[0];
+        y.val[1] = yuyv.val[2];
+        vst2q_u8(dstY + x, y);
+    }
+    yRow_C(src + 2 * x, dstY + x, width - x);
+}
+
+static void yuvRowSP_NEON(const uint8_t *src, uint8_t *dstY,
+                          uint8_t *dstUV, int width, int swapUV)
+{
+    int x = 0;
+    for(; x + 32 <= width; x += 32)
+    {
+        uint8x16x4_t yuyv = vld4q_u8(src + 2 * x);
+        uint8x16x2_t y, uv;
+        y.val[0] = yuyv.val[0];
+        y.val[1] = yuyv.val[2];
+        uv.val[0] = swapUV ? yuyv.val[3] : yuyv.val[1];
+        uv.val[1] = swapUV ? yuyv.val[1] : yuyv.val[3];
+        vst2q_u8(dstY + x, y);
+        vst2q_u8(dstUV + x, uv);
+    }
+    yuvRowSP_C(src + 2 * x, dstY + x, dstUV + x, width - x, swapUV);
+}
+
+static void yuvRowP_NEON(const uint8_t *src, uint8_t *dstY,
+                         uint8_t *dstU, uint8_t *dstV, int width)
+{
+    int x = 0;
+    for(; x + 32 <= width; x += 32)
+    {
+        uint8x16x4_t yuyv = vld4q_u8(src + 2 * x);
+        uint8x16x2_t y;
+        y.val[0] = yuyv.val[0];
+        y.val[1] = yuyv.val[2];
+        vst2q_u8(dstY + x, y);
+        vst1q_u8(dstU + x / 2, yuyv.val[1]);
+        vst1q_u8(dstV + x / 2, yuyv.val[3]);
+    }
+    yuvRowP_C(src + 2 * x, dstY + x, dstU + x / 2, dstV + x / 2, width - x);
+}
+
+static const usbcam_conv_impl_t convImplNeon = {
+    "neon", yRow_NEON, yuvRowSP_NEON, yuvRowP_NEON
+};
+#endif /* USBCAM_CONV_NEON */
+
+#ifdef USBCAM_CONV_X86
+/******************************************************************************
+*  SSE2 kernels, 16 pixels per iteration. Y is the low byte of each 16 bit
+*  word of YUYV and chroma the high byte, so both are split with mask/shift
+*  and narrowed with packus.
+******************************************************************************/
+static void yRow_SSE2(const uint8_t *src, uint8_t *dstY, int width)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    int x = 0;
+    for(; x + 16 <= width; x += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 16));
+        __m128i y = _mm_packus_epi16(_mm_and_si128(a, mask),
+                                     _mm_and_si128(b, mask));
+        _mm_storeu_si128((__m128i *)(dstY + x), y);
+    }
+    yRow_C(src + 2 * x, dstY + x, width - x);
+}
+
+static void yuvRowSP_SSE2(const uint8_t *src, uint8_t *dstY,
+                          uint8_t *dstUV, int width, int swapUV)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    int x = 0;
+    for(; x + 16 <= width; x += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 16));
+        __m128i y = _mm_packus_epi16(_mm_and_si128(a, mask),
+                                     _mm_and_si128(b, mask));
+        __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                      _mm_srli_epi16(b, 8));
+        if(swapUV)
+            uv = _mm_or_si128(_mm_slli_epi16(uv, 8), _mm_srli_epi16(uv, 8));
+        _mm_storeu_si128((__m128i *)(dstY + x), y);
+        _mm_storeu_si128((__m128i *)(dstUV + x), uv);
+    }
+    yuvRowSP_C(src + 2 * x, dstY + x, dstUV + x, width - x, swapUV);
+}
+
+static void yuvRowP_SSE2(const uint8_t *src, uint8_t *dstY,
+                         uint8_t *dstU, uint8_t *dstV, int width)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for(; x + 16 <= width; x += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 16));
+        __m128i y = _mm_packus_epi16(_mm_and_si128(a, mask),
+                                     _mm_and_si128(b, mask));
+        __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                      _mm_srli_epi16(b, 8));
+        __m128i u = _mm_packus_epi16(_mm_and_si128(uv, mask), zero);
+        __m128i v = _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero);
+        _mm_storeu_si128((__m128i *)(dstY + x), y);
+        _mm_storel_epi64((__m128i *)(dstU + x / 2), u);
+        _mm_storel_epi64((__m128i *)(dstV + x / 2), v);
+    }
+    yuvRowP_C(src + 2 * x, dstY + x, dstU + x / 2, dstV + x / 2, width - x);
+}
+
+static const usbcam_conv_impl_t convImplSse2 = {
+    "sse2", yRow_SSE2, yuvRowSP_SSE2, yuvRowP_SSE2
+};
+
+/******************************************************************************
+*  AVX2 kernels, 32 pixels per iteration. packus works within 128 bit lanes,
+*  so its result is reordered with permute4x64.
+******************************************************************************/
+#define AVX2_TARGET             __attribute__((target("avx2")))
+#define AVX2_LANE_ORDER         0xd8
+
+AVX2_TARGET static void yRow_AVX2(const uint8_t *src, uint8_t *dstY, int width)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+    for(; x + 32 <= width; x += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * x));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * x + 32));
+        __m256i y = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                        _mm256_and_si256(b, mask));
+        y = _mm256_permute4x64_epi64(y, AVX2_LANE_ORDER);
+        _mm256_storeu_si256((__m256i *)(dstY + x), y);
+    }
+    yRow_C(src + 2 * x, dstY + x, width - x);
+}
+
+AVX2_TARGET static void yuvRowSP_AVX2(const uint8_t *src, uint8_t *dstY,
+                                      uint8_t *dstUV, int width, int swapUV)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+    for(; x + 32 <= width; x += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * x));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * x + 32));
+        __m256i y = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                        _mm256_and_si256(b, mask));
+        __m256i uv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+                                         _mm256_srli_epi16(b, 8));
+        y = _mm256_permute4x64_epi64(y, AVX2_LANE_ORDER);
+        uv = _mm256_permute4x64_epi64(uv, AVX2_LANE_ORDER);
+        if(swapUV)
+            uv = _mm256_or_si256(_mm256_slli_epi16(uv, 8),
+                                 _mm256_srli_epi16(uv, 8));
+        _mm256_storeu_si256((__m256i *)(dstY + x), y);
+        _mm256_storeu_si256((__m256i *)(dstUV + x), uv);
+    }
+    yuvRowSP_C(src + 2 * x, dstY + x, dstUV + x, width - x, swapUV);
+}
+
+AVX2_TARGET static void yuvRowP_AVX2(const uint8_t *src, uint8_t *dstY,
+                                     uint8_t *dstU, uint8_t *dstV, int width)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+    for(; x + 32 <= width; x += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * x));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * x + 32));
+        __m256i y = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                        _mm256_and_si256(b, mask));
+        __m256i uv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+                                         _mm256_srli_epi16(b, 8));
+        y = _mm256_permute4x64_epi64(y, AVX2_LANE_ORDER);
+        uv = _mm256_permute4x64_epi64(uv, AVX2_LANE_ORDER);
+        /* 16 U in the low lane, 16 V in the high lane */
+        __m256i uu_vv = _mm256_packus_epi16(_mm256_and_si256(uv, mask),
+                                            _mm256_srli_epi16(uv, 8));
+        uu_vv = _mm256_permute4x64_epi64(uu_vv, AVX2_LANE_ORDER);
+        _mm256_storeu_si256((__m256i *)(dstY + x), y);
+        _mm_storeu_si128((__m128i *)(dstU + x / 2),
+                         _mm256_castsi256_si128(uu_vv));
+        _mm_storeu_si128((__m128i *)(dstV + x / 2),
+                         _mm256_extracti128_si256(uu_vv, 1));
+    }
+    yuvRowP_C(src + 2 * x, dstY + x, dstU + x / 2, dstV + x / 2, width - x);
+}
+
+static const usbcam_conv_impl_t convImplAvx2 = {
+    "avx2", yRow_AVX2, yuvRowSP_AVX2, yuvRowP_AVX2
+};
+#endif /* USBCAM_CONV_X86 */
+
+/******************************************************************************
+ * Function: selectConvImpl
+ * Description: This function picks the fastest kernels supported by the CPU.
+ *              Setting persist.camera.usbcam.conv to "c" forces the portable
+ *              C kernels.
+ *
+ * Input parameters: none
+ *
+ * Return values: none
+ *
+ * Notes: Run once through pthread_once
+ *****************************************************************************/
+static void selectConvImpl(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    convImpls[numConvImpls++] = &convImplC;
+#ifdef USBCAM_CONV_NEON
+    convImpls[numConvImpls++] = &convImplNeon;
+#endif
+#ifdef USBCAM_CONV_X86
+    convImpls[numConvImpls++] = &convImplSse2;
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        convImpls[numConvImpls++] = &convImplAvx2;
+#endif
+
+    property_get("persist.camera.usbcam.conv", value, "auto");
+    if(strcmp(value, "c"))
+        convImpl = convImpls[numConvImpls - 1];
+    else
+        convImpl = &convImplC;
+    ALOGI("%s: YUYV conversion uses %s kernels", __func__, convImpl->name);
+}
+
+/******************************************************************************
+ * Function: usbCamConvertImplName
+ * Description: This function returns the name of the kernels in use
+ *
+ * Input parameters: none
+ *
+ * Return values:
+ *      "c", "neon", "sse2" or "avx2"
+ *
+ * Notes: none
+ *****************************************************************************/
+const char *usbCamConvertImplName(void)
+{
+    pthread_once(&convImplOnce, selectConvImpl);
+    return convImpl->name;
+}
+
+/******************************************************************************
+ * Function: usbCamConvertNumImpls
+ * Description: This function returns the number of kernel sets compiled in
+ *              and supported by the CPU
+ *
+ * Input parameters: none
+ *
+ * Return values: number of kernel sets, at least 1
+ *
+ * Notes: Test hook
+ *****************************************************************************/
+int usbCamConvertNumImpls(void)
+{
+    pthread_once(&convImplOnce, selectConvImpl);
+    return numConvImpls;
+}
+
+/******************************************************************************
+ * Function: usbCamConvertImplNameAt
+ * Description: This function returns the name of a supported kernel set
+ *
+ * Input parameters:
+ *   index              - 0 to usbCamConvertNumImpls() - 1
+ *
+ * Return values:
+ *      kernel set name, NULL if index is out of range
+ *
+ * Notes: Test hook
+ *****************************************************************************/
+const char *usbCamConvertImplNameAt(int index)
+{
+    pthread_once(&convImplOnce, selectConvImpl);
+    if(index < 0 || index >= numConvImpls)
+        return NULL;
+    return convImpls[index]->name;
+}
+
+/******************************************************************************
+ * Function: usbCamConvertSelectImpl
+ * Description: This function makes usbCamConvertYUYV use a supported kernel
+ *              set, overriding the runtime choice
+ *
+ * Input parameters:
+ *   index              - 0 to usbCamConvertNumImpls() - 1
+ *
+ * Return values:
+ *      USBCAM_CONV_NO_ERROR    Success
+ *      USBCAM_CONV_ERROR       Index out of range
+ *
+ * Notes: Test hook. Must not be called while a conversion is running
+ *****************************************************************************/
+int usbCamConvertSelectImpl(int index)
+{
+    pthread_once(&convImplOnce, selectConvImpl);
+    if(index < 0 || index >= numConvImpls)
+        return USBCAM_CONV_ERROR;
+    convImpl = convImpls[index];
+    return USBCAM_CONV_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: usbCamConvertYUYV
+ * Description: This function converts a YUYV frame to YUV 4:2:0 in the
+ *              requested layout. No in place conversion is supported.
+ *
+ * Input parameters:
+ *   inBuf              - YUYV input frame, width * 2 bytes per row
+ *   outBuf             - output frame
+ *   width              - frame width in pixels, must be even
+ *   height             - frame height in pixels
+ *   outFormat          - usbcam_conv_fmt_t output layout
+ *
+ * Return values:
+ *      USBCAM_CONV_NO_ERROR    Success
+ *      USBCAM_CONV_ERROR       Error
+ *
+ * Notes: Chroma of row 2n comes from input row 2n, matching the original
+ *        scalar conversion of this HAL bit for bit.
+ *****************************************************************************/
+int usbCamConvertYUYV(const char *inBuf, char *outBuf,
+                      int width, int height, int outFormat)
+{
+    const uint8_t   *src = (const uint8_t *)inBuf;
+    uint8_t         *dst = (uint8_t *)outBuf;
+    int             srcStride = width * 2;
+    int             row;
+
+    if(!inBuf || !outBuf || width <= 0 || height <= 0 || (width & 1)) {
+        ALOGE("%s: Invalid args: in %p out %p %dx%d", __func__,
+              inBuf, outBuf, width, height);
+        return USBCAM_CONV_ERROR;
+    }
+
+    pthread_once(&convImplOnce, selectConvImpl);
+
+    switch(outFormat)
+    {
+    case USBCAM_CONV_FMT_NV12:
+    case USBCAM_CONV_FMT_NV21:
+    {
+        uint8_t *dstY   = dst;
+        uint8_t *dstUV  = dst + width * height;
+        int     swapUV  = (USBCAM_CONV_FMT_NV21 == outFormat);
+
+        for(row = 0; row < height; row += 2)
+        {
+            convImpl->yuvRowSP(src + row * srcStride, dstY + row * width,
+                               dstUV + (row / 2) * width, width, swapUV);
+            if(row + 1 < height)
+                convImpl->yRow(src + (row + 1) * srcStride,
+                               dstY + (row + 1) * width, width);
+        }
+        break;
+    }
+    case USBCAM_CONV_FMT_YV12:
+    {
+        int     yStride = ALIGN_TO(width, 16);
+        int     cStride = ALIGN_TO(yStride / 2, 16);
+        uint8_t *dstY   = dst;
+        uint8_t *dstV   = dst + yStride * height;
+        uint8_t *dstU   = dstV + cStride * ((height + 1) / 2);
+
+        for(row = 0; row < height; row += 2)
+        {
+            convImpl->yuvRowP(src + row * srcStride, dstY + row * yStride,
+                              dstU + (row / 2) * cStride,
+                              dstV + (row / 2) * cStride, width);
+            if(row + 1 < height)
+                convImpl->yRow(src + (row + 1) * srcStride,
+                               dstY + (row + 1) * yStride, width);
+        }
+        break;
+    }
+    default:
+        ALOGE("%s: Unsupported output format %d", __func__, outFormat);
+        return USBCAM_CONV_ERROR;
+    }
+
+    return USBCAM_CONV_NO_ERROR;
+}
@@ -193,7 +193,9 @@ int usbCamInitDefaultParameters(camera_hardware_t *camHal)
     camHal->thumbnailJpegQlty   = DEFAULT_USBCAM_THUMBNAIL_QLTY;
     camHal->previewEnabledFlag  = 0;
     camHal->prvwStoppedForPicture = 0;
-    camHal->prvwCmdPending      = 0;
+    camHal->prvwCmd             = 0;
+    camHal->prvwDispGen         = 0;
+    camHal->prvwDispBusy        = 0;
     camHal->takePictInProgress  = 0;
 
     //Set picture size values
@@ -32,6 +32,7 @@
 
 #include <utils/Log.h>
 #include <utils/threads.h>
+#include <cutils/atomic.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -45,6 +46,7 @@
 #include "QualcommUsbCamera.h"
 #include "QCameraUsbPriv.h"
 #include "QCameraMjpegDecode.h"
+#include "QCameraUsbColorConv.h"
 #include "QCameraUsbParm.h"
 #include <gralloc_priv.h>
 #include <genlock.h>
@@ -108,17 +110,35 @@ static int launchTakePictureThread(     camera_hardware_t *camHal);
 static int initDisplayBuffers(          camera_hardware_t *camHal);
 static int deInitDisplayBuffers(        camera_hardware_t *camHal);
 static int stopPreviewInternal(         camera_hardware_t *camHal);
-static int get_buf_from_cam(            camera_hardware_t *camHal);
-static int put_buf_to_cam(              camera_hardware_t *camHal);
+static int get_buf_from_cam(            camera_hardware_t *camHal,
+                                        struct v4l2_buffer *buf);
+static int put_buf_to_cam(              camera_hardware_t *camHal,
+                                        struct v4l2_buffer *buf);
 static int prvwThreadTakePictureInternal(camera_hardware_t *camHal);
 static int get_buf_from_display( camera_hardware_t *camHal, int *buffer_id);
 static int put_buf_to_display(   camera_hardware_t *camHal, int buffer_id);
-static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id);
-static void * previewloop(void *);
+static int cancel_buf_to_display(camera_hardware_t *camHal, int buffer_id);
+static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal,
+                                        struct v4l2_buffer *capBuf,
+                                        int buffer_id);
+static int prvwQueueInit(usbcam_prvw_queue_t *q);
+static void prvwQueueDeinit(usbcam_prvw_queue_t *q);
+static int prvwQueuePush(usbcam_prvw_queue_t *q, usbcam_prvw_frame_t *frame);
+static int prvwQueuePop(usbcam_prvw_queue_t *q, usbcam_prvw_frame_t *frame);
+static void prvwQueueAbort(usbcam_prvw_queue_t *q);
+static void prvwQueueDrain(camera_hardware_t *camHal, usbcam_prvw_queue_t *q);
+static void prvwPostCmd(camera_hardware_t *camHal, int cmd);
+static void prvwConvertDone(camera_hardware_t *camHal);
+static void prvwUpdateStats(camera_hardware_t *camHal,
+                            usbcam_prvw_frame_t *frame, nsecs_t presentTs);
+static void prvwDumpStats(camera_hardware_t *camHal);
+static void * prvwCaptureThread(void *);
+static void * prvwConvertThread(void *);
+static void * prvwPresentThread(void *);
 static void * takePictureThread(void *);
-static int convert_YUYV_to_420_NV12(char *in_buf, char *out_buf, int wd, int ht);
 static int get_uvc_device(char *devname);
 static int getPreviewCaptureFmt(camera_hardware_t *camHal);
+static int getConvOutputFormat(int dispFormat);
 static int allocate_ion_memory(QCameraHalMemInfo_t *mem_info, int ion_type);
 static int deallocate_ion_memory(QCameraHalMemInfo_t *mem_info);
 static int ioctlLoop(int fd, int ioctlCmd, void *args);
@@ -266,6 +286,11 @@ int usbcam_set_preview_window(struct camera_device * device,
 
     VALIDATE_DEVICE_HDL(camHal, device, -1);
     Mutex::Autolock autoLock(camHal->lock);
+    /* Keep preview pipeline off display buffers while they are replaced */
+    Mutex::Autolock dispLock(camHal->prvwDispLock);
+    camHal->prvwDispGen++;
+    while(camHal->prvwDispBusy)
+        camHal->prvwDispCond.wait(camHal->prvwDispLock);
 
     /* if window is already set, then de-init previous buffers */
     if(camHal->window){
@@ -563,8 +588,7 @@ int usbcam_take_picture(struct camera_device * device)
     /* This implementation requests preview thread to take picture */
     if(camHal->previewEnabledFlag)
     {
-        camHal->prvwCmdPending++;
-        camHal->prvwCmd         = USB_CAM_PREVIEW_TAKEPIC;
+        prvwPostCmd(camHal, USB_CAM_PREVIEW_TAKEPIC);
         ALOGD("%s: Take picture command set ", __func__);
     }else{
         ALOGE("%s: Take picture without preview started!", __func__);
@@ -698,48 +722,6 @@ int usbcam_dump(struct camera_device * device, int fd)
 *  Static function definitions below
 *****************************************************************************/
 
-/******************************************************************************/
-/* No in place conversion supported. Output buffer and input MUST should be   */
-/* different input buffer for a 4x4 pixel video                             ***/
-/******                  YUYVYUYV          00 01 02 03 04 05 06 07 ************/
-/******                  YUYVYUYV          08 09 10 11 12 13 14 15 ************/
-/******                  YUYVYUYV          16 17 18 19 20 21 22 23 ************/
-/******                  YUYVYUYV          24 25 26 27 28 29 30 31 ************/
-/******************************************************************************/
-/* output generated by this function ******************************************/
-/************************** YYYY            00 02 04 06            ************/
-/************************** YYYY            08 10 12 14            ************/
-/************************** YYYY            16 18 20 22            ************/
-/************************** YYYY            24 26 28 30            ************/
-/************************** VUVU            03 01 07 05            ************/
-/************************** VUVU            19 17 23 21            ************/
-/******************************************************************************/
-
-static int convert_YUYV_to_420_NV12(char *in_buf, char *out_buf, int wd, int ht)
-{
-    int rc =0;
-    int row, col, uv_row;
-
-    ALOGD("%s: E", __func__);
-    /* Arrange Y */
-    for(row = 0; row < ht; row++)
-        for(col = 0; col < wd * 2; col += 2)
-        {
-            out_buf[row * wd + col / 2] = in_buf[row * wd * 2 + col];
-        }
-
-    /* Arrange UV */
-    for(row = 0, uv_row = ht; row < ht; row += 2, uv_row++)
-        for(col = 1; col < wd * 2; col += 4)
-        {
-            out_buf[uv_row * wd + col / 2]= in_buf[row * wd * 2 + col + 2];
-            out_buf[uv_row * wd + col / 2 + 1]  = in_buf[row * wd * 2 + col];
-        }
-
-    ALOGD("%s: X", __func__);
-    return rc;
-}
-
 /******************************************************************************
  * Function: initDisplayBuffers
  * Description: This function initializes the preview buffers
@@ -1137,6 +1119,35 @@ static int getMjpegdOutputFormat(int dispFormat)
     return mjpegOutputFormat;
 }
 
+/******************************************************************************
+ * Function: getConvOutputFormat
+ * Description: This function maps display pixel format enum to YUYV
+ *              conversion output format enum
+ *
+ * Input parameters:
+ *   dispFormat              - Display pixel format
+ *
+ * Return values:
+ *      (int)usbcam_conv_fmt_t
+ *      -1  Display format is not supported by the conversion
+ *
+ * Notes: none
+ *****************************************************************************/
+static int getConvOutputFormat(int dispFormat)
+{
+    switch(dispFormat)
+    {
+    case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        return USBCAM_CONV_FMT_NV21;
+    case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+        return USBCAM_CONV_FMT_NV12;
+    case HAL_PIXEL_FORMAT_YV12:
+        return USBCAM_CONV_FMT_YV12;
+    default:
+        return -1;
+    }
+}
+
 /******************************************************************************
  * Function: ioctlLoop
  * Description: This function is a blocking call around ioctl
@@ -1462,7 +1473,7 @@ static int stopUsbCamCapture(camera_hardware_t *camHal)
 
 /******************************************************************************
  * Function: stopPreviewInternal
- * Description: This function sends EXIT command to prview loop thread,
+ * Description: This function sends EXIT command to prview pipeline threads,
  *              stops usb camera capture and uninitializes MMAP. This function
  *              assumes that calling function has locked camHal->lock
  *
@@ -1482,16 +1493,35 @@ static int stopPreviewInternal(camera_hardware_t *camHal)
 
     if(camHal->previewEnabledFlag)
     {
-        camHal->prvwCmdPending++;
-        camHal->prvwCmd         = USB_CAM_PREVIEW_EXIT;
+        prvwPostCmd(camHal, USB_CAM_PREVIEW_EXIT);
 
-        /* yield lock while waiting for the preview thread to exit */
+        /* yield lock while waiting for the preview threads to exit. */
+        /* Capture stage exits first and aborts the downstream queues */
         camHal->lock.unlock();
         if(pthread_join(camHal->previewThread, NULL)){
             ALOGE("%s: Error in pthread_join preview thread", __func__);
         }
+        if(pthread_join(camHal->prvwConvertThread, NULL)){
+            ALOGE("%s: Error in pthread_join convert thread", __func__);
+        }
+        if(pthread_join(camHal->prvwPresentThread, NULL)){
+            ALOGE("%s: Error in pthread_join present thread", __func__);
+        }
         camHal->lock.lock();
 
+        /* Return display buffers of in-flight frames to the window */
+        prvwQueueDrain(camHal, &camHal->prvwConvertQ);
+        prvwQueueDrain(camHal, &camHal->prvwPresentQ);
+        prvwQueueDeinit(&camHal->prvwConvertQ);
+        prvwQueueDeinit(&camHal->prvwPresentQ);
+        prvwDumpStats(camHal);
+
+        /* Decoder session is kept for the whole preview session */
+        if(camHal->mjpegd) {
+            mjpegDecoderDestroy(camHal->mjpegd);
+            camHal->mjpegd = NULL;
+        }
+
         if(stopUsbCamCapture(camHal)){
             ALOGE("%s: Error in stopUsbCamCapture", __func__);
             rc = -1;
@@ -1548,7 +1578,7 @@ static int prvwThreadTakePictureInternal(camera_hardware_t *camHal)
     /************************************************************************/
     /* - Dequeue capture buffer from USB camera                             */
     /************************************************************************/
-    if (0 == get_buf_from_cam(camHal))
+    if (0 == get_buf_from_cam(camHal, &camHal->curCaptureBuf))
         ALOGD("%s: get_buf_from_cam success", __func__);
     else
         ALOGE("%s: get_buf_from_cam error", __func__);
@@ -1606,7 +1636,7 @@ static int prvwThreadTakePictureInternal(camera_hardware_t *camHal)
     /************************************************************************/
     /* - Enqueue capture buffer back to USB camera                          */
     /************************************************************************/
-       if(0 == put_buf_to_cam(camHal)) {
+       if(0 == put_buf_to_cam(camHal, &camHal->curCaptureBuf)) {
             ALOGD("%s: put_buf_to_cam success", __func__);
         }
         else
@@ -1673,10 +1703,11 @@ int cache_ops(QCameraHalMemInfo_t *mem_info,
 /******************************************************************************
  * Function: get_buf_from_cam
  * Description: This funtions gets/acquires 1 capture buffer from the camera
- *              driver. The fetched buffer is stored in curCaptureBuf
+ *              driver
  *
  * Input parameters:
  *   camHal              - camera HAL handle
+ *   buf                 - The fetched buffer is returned in this arg
  *
  * Return values:
  *   0      No error
@@ -1684,18 +1715,18 @@ int cache_ops(QCameraHalMemInfo_t *mem_info,
  *
  * Notes: none
  *****************************************************************************/
-static int get_buf_from_cam(camera_hardware_t *camHal)
+static int get_buf_from_cam(camera_hardware_t *camHal, struct v4l2_buffer *buf)
 {
     int rc = -1;
 
     ALOGD("%s: E", __func__);
     {
-        memset(&camHal->curCaptureBuf, 0, sizeof(camHal->curCaptureBuf));
+        memset(buf, 0, sizeof(*buf));
 
-        camHal->curCaptureBuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        camHal->curCaptureBuf.memory = V4L2_MEMORY_MMAP;
+        buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf->memory = V4L2_MEMORY_MMAP;
 
-        if (-1 == ioctlLoop(camHal->fd, VIDIOC_DQBUF, &camHal->curCaptureBuf)){
+        if (-1 == ioctlLoop(camHal->fd, VIDIOC_DQBUF, buf)){
             switch (errno) {
             case EAGAIN:
                 ALOGE("%s: EAGAIN error", __func__);
@@ -1714,8 +1745,8 @@ static int get_buf_from_cam(camera_hardware_t *camHal)
         {
             rc = 0;
             ALOGD("%s: VIDIOC_DQBUF: %d successful, %d bytes",
-                 __func__, camHal->curCaptureBuf.index,
-                 camHal->curCaptureBuf.bytesused);
+                 __func__, buf->index,
+                 buf->bytesused);
         }
     }
     ALOGD("%s: X", __func__);
@@ -1729,6 +1760,7 @@ static int get_buf_from_cam(camera_hardware_t *camHal)
  *
  * Input parameters:
  *   camHal              - camera HAL handle
+ *   buf                 - capture buffer to be released
  *
  * Return values:
  *   0      No error
@@ -1736,15 +1768,15 @@ static int get_buf_from_cam(camera_hardware_t *camHal)
  *
  * Notes: none
  *****************************************************************************/
-static int put_buf_to_cam(camera_hardware_t *camHal)
+static int put_buf_to_cam(camera_hardware_t *camHal, struct v4l2_buffer *buf)
 {
     ALOGD("%s: E", __func__);
 
-    camHal->curCaptureBuf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    camHal->curCaptureBuf.memory      = V4L2_MEMORY_MMAP;
+    buf->type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf->memory      = V4L2_MEMORY_MMAP;
 
 
-    if (-1 == ioctlLoop(camHal->fd, VIDIOC_QBUF, &camHal->curCaptureBuf))
+    if (-1 == ioctlLoop(camHal->fd, VIDIOC_QBUF, buf))
     {
         ALOGE("%s: VIDIOC_QBUF failed ", __func__);
         return 1;
@@ -1902,6 +1934,58 @@ static int put_buf_to_display(camera_hardware_t *camHal, int buffer_id)
     return err;
 }
 
+/******************************************************************************
+ * Function: cancel_buf_to_display
+ * Description: This funtion returns 1 dequeued buffer back to the display
+ *              window without displaying it
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *  buffer_id               - id of the buffer that needs to be cancelled
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int cancel_buf_to_display(camera_hardware_t *camHal, int buffer_id)
+{
+    int err = 0;
+    preview_stream_ops    *mPreviewWindow;
+
+    ALOGD("%s: E", __func__);
+
+    if (camHal == NULL) {
+        ALOGE("%s: camHal = NULL", __func__);
+        return -1;
+    }
+
+    mPreviewWindow = camHal->window;
+    if( mPreviewWindow == NULL) {
+        ALOGE("%s: mPreviewWindow = NULL", __func__);
+        return -1;
+    }
+
+    if (GENLOCK_FAILURE ==
+        genlock_unlock_buffer(
+            (native_handle_t *)
+            (*(camHal->previewMem.buffer_handle[buffer_id])))) {
+       ALOGE("%s: genlock_unlock_buffer failed: hdl =%p",
+            __func__, (*(camHal->previewMem.buffer_handle[buffer_id])) );
+    }
+
+    err = mPreviewWindow->cancel_buffer(mPreviewWindow,
+      (buffer_handle_t *)camHal->previewMem.buffer_handle[buffer_id]);
+    if(err)
+        ALOGE("%s: cancel_buffer failed: %p\n",
+             __func__, camHal->previewMem.buffer_handle[buffer_id]);
+
+    ALOGD("%s: X", __func__);
+
+    return err;
+}
+
 /******************************************************************************
  * Function: put_buf_to_display
  * Description: This funtion transfers the content from capture buffer to
@@ -1909,6 +1993,7 @@ static int put_buf_to_display(camera_hardware_t *camHal, int buffer_id)
  *
  * Input parameters:
  *  camHal                  - camera HAL handle
+ *  capBuf                  - capture buffer holding the camera frame
  *  buffer_id               - id of the buffer that needs to be enqueued
  *
  * Return values:
@@ -1917,7 +2002,9 @@ static int put_buf_to_display(camera_hardware_t *camHal, int buffer_id)
  *
  * Notes: none
  *****************************************************************************/
-static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id)
+static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal,
+                                        struct v4l2_buffer *capBuf,
+                                        int buffer_id)
 {
     int rc = -1;
 
@@ -1928,17 +2015,17 @@ static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id
     /* If input and output are raw formats, but different color format, */
     /* call color conversion routine                                    */
     if( (V4L2_PIX_FMT_YUYV == camHal->captureFormat) &&
-        (HAL_PIXEL_FORMAT_YCrCb_420_SP == camHal->dispFormat))
+        (0 <= getConvOutputFormat(camHal->dispFormat)))
     {
-        convert_YUYV_to_420_NV12(
-            (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
+        rc = usbCamConvertYUYV(
+            (char *)camHal->buffers[capBuf->index].data,
             (char *)camHal->previewMem.camera_memory[buffer_id]->data,
             camHal->prevWidth,
-            camHal->prevHeight);
+            camHal->prevHeight,
+            getConvOutputFormat(camHal->dispFormat));
         ALOGD("%s: Copied %d bytes from camera buffer %d to display buffer: %d",
-             __func__, camHal->curCaptureBuf.bytesused,
-             camHal->curCaptureBuf.index, buffer_id);
-        rc = 0;
+             __func__, capBuf->bytesused,
+             capBuf->index, buffer_id);
     }
 
     /* If camera buffer is MJPEG encoded, call mjpeg decode call */
@@ -1954,8 +2041,8 @@ static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id
         {
             rc = mjpegDecode(
                 (void*)camHal->mjpegd,
-                (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
-                camHal->curCaptureBuf.bytesused,
+                (char *)camHal->buffers[capBuf->index].data,
+                capBuf->bytesused,
                 (char *)camHal->previewMem.camera_memory[buffer_id]->data,
                 (char *)camHal->previewMem.camera_memory[buffer_id]->data +
                     camHal->prevWidth * camHal->prevHeight,
@@ -1967,9 +2054,284 @@ static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id
     return rc;
 }
 
+/******************************************************************************
+ * Function: prvwQueueInit
+ * Description: This function initializes a preview pipeline queue
+ *
+ * Input parameters:
+ *  q                       - queue handle
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int prvwQueueInit(usbcam_prvw_queue_t *q)
+{
+    memset(q->frames, 0, sizeof(q->frames));
+    q->head     = 0;
+    q->count    = 0;
+    q->aborted  = 0;
+    if(pthread_mutex_init(&q->mutex, NULL))
+        return -1;
+    pthread_cond_init(&q->notEmpty, NULL);
+    pthread_cond_init(&q->notFull, NULL);
+    return 0;
+}
+
+/******************************************************************************
+ * Function: prvwQueueDeinit
+ * Description: This function de-initializes a preview pipeline queue
+ *
+ * Input parameters:
+ *  q                       - queue handle
+ *
+ * Return values: none
+ *
+ * Notes: No thread may be waiting on the queue
+ *****************************************************************************/
+static void prvwQueueDeinit(usbcam_prvw_queue_t *q)
+{
+    pthread_cond_destroy(&q->notFull);
+    pthread_cond_destroy(&q->notEmpty);
+    pthread_mutex_destroy(&q->mutex);
+}
+
+/******************************************************************************
+ * Function: prvwQueuePush
+ * Description: This function appends a frame to a preview pipeline queue,
+ *              blocking while the queue is full
+ *
+ * Input parameters:
+ *  q                       - queue handle
+ *  frame                   - frame to be copied into the queue
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Queue is aborted. Frame is not queued
+ *
+ * Notes: none
+ *****************************************************************************/
+static int prvwQueuePush(usbcam_prvw_queue_t *q, usbcam_prvw_frame_t *frame)
+{
+    int rc = -1;
+
+    pthread_mutex_lock(&q->mutex);
+    while(!q->aborted && PRVW_PIPE_QUEUE_DEPTH == q->count)
+        pthread_cond_wait(&q->notFull, &q->mutex);
+    if(!q->aborted) {
+        q->frames[(q->head + q->count) % PRVW_PIPE_QUEUE_DEPTH] = *frame;
+        q->count++;
+        pthread_cond_signal(&q->notEmpty);
+        rc = 0;
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return rc;
+}
+
+/******************************************************************************
+ * Function: prvwQueuePop
+ * Description: This function removes the oldest frame from a preview pipeline
+ *              queue, blocking while the queue is empty
+ *
+ * Input parameters:
+ *  q                       - queue handle
+ *  frame                   - the frame is copied out into this arg
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Queue is aborted. Remaining frames are left for prvwQueueDrain
+ *
+ * Notes: none
+ *****************************************************************************/
+static int prvwQueuePop(usbcam_prvw_queue_t *q, usbcam_prvw_frame_t *frame)
+{
+    int rc = -1;
+
+    pthread_mutex_lock(&q->mutex);
+    while(!q->aborted && 0 == q->count)
+        pthread_cond_wait(&q->notEmpty, &q->mutex);
+    if(!q->aborted) {
+        *frame = q->frames[q->head];
+        q->head = (q->head + 1) % PRVW_PIPE_QUEUE_DEPTH;
+        q->count--;
+        pthread_cond_signal(&q->notFull);
+        rc = 0;
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return rc;
+}
+
+/******************************************************************************
+ * Function: prvwQueueAbort
+ * Description: This function aborts a preview pipeline queue, waking up all
+ *              threads blocked on it
+ *
+ * Input parameters:
+ *  q                       - queue handle
+ *
+ * Return values: none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void prvwQueueAbort(usbcam_prvw_queue_t *q)
+{
+    pthread_mutex_lock(&q->mutex);
+    q->aborted = 1;
+    pthread_cond_broadcast(&q->notEmpty);
+    pthread_cond_broadcast(&q->notFull);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+/******************************************************************************
+ * Function: prvwQueueDrain
+ * Description: This function releases display buffers of the frames left in
+ *              an aborted preview pipeline queue
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *  q                       - queue handle
+ *
+ * Return values: none
+ *
+ * Notes: Capture buffers are not queued back, since VIDIOC_STREAMOFF
+ *        follows and returns all of them to the driver
+ *****************************************************************************/
+static void prvwQueueDrain(camera_hardware_t *camHal, usbcam_prvw_queue_t *q)
+{
+    Mutex::Autolock dispLock(camHal->prvwDispLock);
+
+    for(; q->count > 0; q->count--) {
+        usbcam_prvw_frame_t *frame = &q->frames[q->head];
+        q->head = (q->head + 1) % PRVW_PIPE_QUEUE_DEPTH;
+#if DISPLAY
+        if(frame->dispBufId >= 0 && frame->dispGen == camHal->prvwDispGen)
+            cancel_buf_to_display(camHal, frame->dispBufId);
+#endif
+    }
+}
+
+/******************************************************************************
+ * Function: prvwConvertDone
+ * Description: This function marks the end of display buffer access of the
+ *              convert stage, and wakes up set_preview_window if waiting
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *
+ * Return values: none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void prvwConvertDone(camera_hardware_t *camHal)
+{
+    Mutex::Autolock dispLock(camHal->prvwDispLock);
+
+    camHal->prvwDispBusy = 0;
+    camHal->prvwDispCond.broadcast();
+}
+
+/******************************************************************************
+ * Function: prvwPostCmd
+ * Description: This function posts a command to the preview pipeline
+ *              mailbox. Commands are bit flags, so pending commands are not
+ *              overwritten
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *  cmd                     - USB_CAM_PREVIEW_* command
+ *
+ * Return values: none
+ *
+ * Notes: Lock free. Commands are taken by the capture stage
+ *****************************************************************************/
+static void prvwPostCmd(camera_hardware_t *camHal, int cmd)
+{
+    android_atomic_or(cmd, &camHal->prvwCmd);
+}
+
+/******************************************************************************
+ * Function: prvwUpdateStats
+ * Description: This function accounts per stage latency of a presented
+ *              frame, and reports the stats every PRVW_STATS_FRAME_CNT frames
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *  frame                   - presented frame
+ *  presentTs               - time when display enqueue is done
+ *
+ * Return values: none
+ *
+ * Notes: Only called from present stage
+ *****************************************************************************/
+static void prvwUpdateStats(camera_hardware_t *camHal,
+                            usbcam_prvw_frame_t *frame, nsecs_t presentTs)
+{
+    usbcam_prvw_stats_t *stats = &camHal->prvwStats;
+    nsecs_t             lat[PRVW_STAGE_MAX];
+
+    lat[PRVW_STAGE_QUEUE]   = frame->convStartTs - frame->dqTs;
+    lat[PRVW_STAGE_CONVERT] = frame->convEndTs - frame->convStartTs;
+    lat[PRVW_STAGE_PRESENT] = presentTs - frame->convEndTs;
+    lat[PRVW_STAGE_TOTAL]   = presentTs - frame->dqTs;
+
+    if(0 == stats->frames)
+        stats->startTs = frame->dqTs;
+    for(int i = 0; i < PRVW_STAGE_MAX; i++) {
+        stats->sum[i] += lat[i];
+        if(lat[i] > stats->max[i])
+            stats->max[i] = lat[i];
+    }
+    stats->frames++;
+
+    if(stats->frames >= PRVW_STATS_FRAME_CNT)
+        prvwDumpStats(camHal);
+}
+
+/******************************************************************************
+ * Function: prvwDumpStats
+ * Description: This function logs fps and per stage latency of the frames
+ *              presented since last report, and resets the stats
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *
+ * Return values: none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void prvwDumpStats(camera_hardware_t *camHal)
+{
+    usbcam_prvw_stats_t *stats = &camHal->prvwStats;
+    long long           duration, fps100;
+    long long           avg[PRVW_STAGE_MAX], max[PRVW_STAGE_MAX];
+    int                 drops;
+
+    drops = android_atomic_and(0, &camHal->prvwDrops);
+    if(stats->frames > 0) {
+        duration = systemTime() - stats->startTs;
+        fps100 = duration ? stats->frames * 100000000000LL / duration : 0;
+        for(int i = 0; i < PRVW_STAGE_MAX; i++) {
+            avg[i] = stats->sum[i] / stats->frames / 1000;
+            max[i] = stats->max[i] / 1000;
+        }
+        ALOGI("%s: %d frames, %d dropped, %lld.%02lld fps", __func__,
+            stats->frames, drops, fps100 / 100, fps100 % 100);
+        ALOGI("%s: avg/max us: queue %lld/%lld convert %lld/%lld "
+            "present %lld/%lld total %lld/%lld", __func__,
+            avg[PRVW_STAGE_QUEUE], max[PRVW_STAGE_QUEUE],
+            avg[PRVW_STAGE_CONVERT], max[PRVW_STAGE_CONVERT],
+            avg[PRVW_STAGE_PRESENT], max[PRVW_STAGE_PRESENT],
+            avg[PRVW_STAGE_TOTAL], max[PRVW_STAGE_TOTAL]);
+    }
+    memset(stats, 0, sizeof(*stats));
+}
+
 /******************************************************************************
  * Function: launch_preview_thread
- * Description: This is a wrapper function to start preview thread
+ * Description: This is a wrapper function to start preview pipeline threads:
+ *              capture, convert and present stages
  *
  * Input parameters:
  *  camHal                  - camera HAL handle
@@ -1990,18 +2352,34 @@ static int launch_preview_thread(camera_hardware_t *camHal)
         return -1;
     }
 
+    camHal->prvwCmd = 0;
+    camHal->prvwDrops = 0;
+    memset(&camHal->prvwStats, 0, sizeof(camHal->prvwStats));
+    if(prvwQueueInit(&camHal->prvwConvertQ))
+        return -1;
+    if(prvwQueueInit(&camHal->prvwPresentQ)) {
+        prvwQueueDeinit(&camHal->prvwConvertQ);
+        return -1;
+    }
+
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    pthread_create(&camHal->previewThread, &attr, previewloop, camHal);
+    pthread_create(&camHal->prvwPresentThread, &attr, prvwPresentThread, camHal);
+    pthread_create(&camHal->prvwConvertThread, &attr, prvwConvertThread, camHal);
+    pthread_create(&camHal->previewThread, &attr, prvwCaptureThread, camHal);
+    pthread_attr_destroy(&attr);
 
     ALOGD("%s: X", __func__);
     return rc;
 }
 
 /******************************************************************************
- * Function: launch_preview_thread
- * Description: This is thread funtion for preivew loop
+ * Function: prvwCaptureThread
+ * Description: This is thread funtion for capture stage of preview pipeline.
+ *              It dequeues filled buffers from USB camera and passes them to
+ *              convert stage, so that dequeue of frame N+1 overlaps the
+ *              conversion of frame N
  *
  * Input parameters:
  *  hcamHal                 - camera HAL handle
@@ -2010,20 +2388,15 @@ static int launch_preview_thread(camera_hardware_t *camHal)
  *   0      No error
  *   -1     Error
  *
- * Notes: none
+ * Notes: Preview commands are processed by this stage
  *****************************************************************************/
-static void * previewloop(void *hcamHal)
+static void * prvwCaptureThread(void *hcamHal)
 {
     int                 rc;
-    int                 buffer_id   = 0;
-    pid_t               tid         = 0;
-    camera_hardware_t   *camHal     = NULL;
-    int                 msgType     = 0;
-    camera_memory_t     *data       = NULL;
-    camera_frame_metadata_t *metadata= NULL;
-    camera_memory_t     *previewMem = NULL;
+    int                 cmd;
+    camera_hardware_t   *camHal     = (camera_hardware_t *)hcamHal;
+    usbcam_prvw_frame_t frame;
 
-    camHal = (camera_hardware_t *)hcamHal;
     ALOGD("%s: E", __func__);
 
     if(!camHal) {
@@ -2031,26 +2404,37 @@ static void * previewloop(void *hcamHal)
         return NULL ;
     }
 
-    tid  = gettid();
     /* TBR: Set appropriate thread priority */
-    androidSetThreadPriority(tid, ANDROID_PRIORITY_NORMAL);
+    androidSetThreadPriority(gettid(), ANDROID_PRIORITY_NORMAL);
     prctl(PR_SET_NAME, (unsigned long)"Camera HAL preview thread", 0, 0, 0);
 
     /************************************************************************/
-    /* - Time wait (select) on camera fd for input read buffer              */
     /* - Check if any preview thread commands are set. If set, process      */
-    /* - Dequeue display buffer from surface                                */
+    /* - Time wait (select) on camera fd for input read buffer              */
     /* - Dequeue capture buffer from USB camera                             */
-    /* - Convert capture format to display format                           */
-    /* - If preview frames callback is requested, callback with prvw buffers*/
-    /* - Enqueue display buffer back to surface                             */
-    /* - Enqueue capture buffer back to USB camera                          */
+    /* - Pass capture buffer to convert stage                               */
     /************************************************************************/
     while(1) {
         fd_set fds;
         struct timeval tv;
         int r = 0;
 
+    /************************************************************************/
+    /* - Check if any preview thread commands are set. If set, process      */
+    /************************************************************************/
+        cmd = android_atomic_and(0, &camHal->prvwCmd);
+        if(cmd & USB_CAM_PREVIEW_EXIT){
+            ALOGI("%s: Exiting coz USB_CAM_PREVIEW_EXIT", __func__);
+            break;
+        }
+        if(cmd & USB_CAM_PREVIEW_TAKEPIC){
+            Mutex::Autolock autoLock(camHal->lock);
+            rc = prvwThreadTakePictureInternal(camHal);
+            if(rc)
+                ALOGE("%s: prvwThreadTakePictureInternal returned error",
+                __func__);
+        }
+
         FD_ZERO(&fds);
 #if CAPTURE
         FD_SET(camHal->fd, &fds);
@@ -2078,177 +2462,306 @@ static void * previewloop(void *hcamHal)
 
         if (0 == r) {
             ALOGD("%s: select timeout\n", __func__);
+#if CAPTURE
+            continue;
+#endif
         }
 
-        /* Protect the context for one iteration of preview loop */
-        /* this gets unlocked at the end of the while */
-        Mutex::Autolock autoLock(camHal->lock);
-
+        memset(&frame, 0, sizeof(frame));
+        frame.dispBufId = -1;
+#if CAPTURE
     /************************************************************************/
-    /* - Check if any preview thread commands are set. If set, process      */
+    /* - Dequeue capture buffer from USB camera                             */
     /************************************************************************/
-        if(camHal->prvwCmdPending)
-        {
-            /* command is serviced. Hence command pending = 0  */
-            camHal->prvwCmdPending--;
-            //sempost(ack)
-            if(USB_CAM_PREVIEW_EXIT == camHal->prvwCmd){
-                /* unlock before exiting the thread */
-                camHal->lock.unlock();
-                ALOGI("%s: Exiting coz USB_CAM_PREVIEW_EXIT", __func__);
-                return (void *)0;
-            }else if(USB_CAM_PREVIEW_TAKEPIC == camHal->prvwCmd){
-                rc = prvwThreadTakePictureInternal(camHal);
-                if(rc)
-                    ALOGE("%s: prvwThreadTakePictureInternal returned error",
-                    __func__);
-            }
+        if (0 == get_buf_from_cam(camHal, &frame.capBuf))
+            ALOGD("%s: get_buf_from_cam success", __func__);
+        else{
+            ALOGE("%s: get_buf_from_cam error", __func__);
+            continue;
         }
+#endif
+        frame.dqTs = systemTime();
 
-        /* Null check on preview window. If null, sleep */
-        if(!camHal->window) {
-            ALOGD("%s: sleeping coz camHal->window = NULL",__func__);
-            camHal->lock.unlock();
-            sleep(2);
-            continue;
+    /************************************************************************/
+    /* - Pass capture buffer to convert stage                               */
+    /************************************************************************/
+        if(prvwQueuePush(&camHal->prvwConvertQ, &frame)) {
+            ALOGE("%s: convert queue aborted", __func__);
+            break;
         }
-#if DISPLAY
+    }
+
+    /* Stop downstream stages. Frames left in queues are drained on stop */
+    prvwQueueAbort(&camHal->prvwConvertQ);
+
+    ALOGD("%s: X", __func__);
+    return (void *)0;
+}
+
+/******************************************************************************
+ * Function: prvwConvertThread
+ * Description: This is thread funtion for convert stage of preview pipeline.
+ *              It dequeues a display buffer, converts or decodes the capture
+ *              buffer into it, queues the capture buffer back to USB camera
+ *              and passes the display buffer to present stage
+ *
+ * Input parameters:
+ *  hcamHal                 - camera HAL handle
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: none
+ *****************************************************************************/
+static void * prvwConvertThread(void *hcamHal)
+{
+    camera_hardware_t   *camHal     = (camera_hardware_t *)hcamHal;
+    usbcam_prvw_frame_t frame;
+    int                 buffer_id   = 0;
+
+    ALOGD("%s: E", __func__);
+
+    androidSetThreadPriority(gettid(), ANDROID_PRIORITY_NORMAL);
+    prctl(PR_SET_NAME, (unsigned long)"Camera HAL preview convert", 0, 0, 0);
+
     /************************************************************************/
+    /* - Get capture buffer from capture stage                              */
     /* - Dequeue display buffer from surface                                */
+    /* - Convert capture format to display format                           */
+    /* - Enqueue capture buffer back to USB camera                          */
+    /* - Pass display buffer to present stage                               */
     /************************************************************************/
-        if(0 == get_buf_from_display(camHal, &buffer_id)) {
-            ALOGD("%s: get_buf_from_display success: %d",
-                 __func__, buffer_id);
-        }else{
-            ALOGE("%s: get_buf_from_display failed. Skipping the loop",
-                 __func__);
+    while(0 == prvwQueuePop(&camHal->prvwConvertQ, &frame)) {
+        frame.convStartTs = systemTime();
+
+        /* Dequeue and conversion run without prvwDispLock, dequeue may wait */
+        /* for present stage, which takes the lock. prvwDispBusy keeps       */
+        /* set_preview_window from replacing the buffers meanwhile           */
+        camHal->prvwDispLock.lock();
+        /* Null check on preview window. If null, drop the frame */
+        if(!camHal->window) {
+            camHal->prvwDispLock.unlock();
+            ALOGD("%s: dropping frame coz camHal->window = NULL",
+                __func__);
+            android_atomic_inc(&camHal->prvwDrops);
+#if CAPTURE
+            put_buf_to_cam(camHal, &frame.capBuf);
+#endif
             continue;
         }
-#endif
+        frame.dispGen = camHal->prvwDispGen;
+        camHal->prvwDispBusy = 1;
+        camHal->prvwDispLock.unlock();
 
-#if CAPTURE
+        {
+#if DISPLAY
     /************************************************************************/
-    /* - Dequeue capture buffer from USB camera                             */
+    /* - Dequeue display buffer from surface                                */
     /************************************************************************/
-        if (0 == get_buf_from_cam(camHal))
-            ALOGD("%s: get_buf_from_cam success", __func__);
-        else
-            ALOGE("%s: get_buf_from_cam error", __func__);
+            if(0 == get_buf_from_display(camHal, &buffer_id)) {
+                ALOGD("%s: get_buf_from_display success: %d",
+                     __func__, buffer_id);
+            }else{
+                ALOGE("%s: get_buf_from_display failed. Dropping the frame",
+                     __func__);
+                android_atomic_inc(&camHal->prvwDrops);
+                prvwConvertDone(camHal);
+#if CAPTURE
+                put_buf_to_cam(camHal, &frame.capBuf);
+#endif
+                continue;
+            }
 #endif
+            frame.dispBufId = buffer_id;
 
 #if FILE_DUMP_CAMERA
-        /* Debug code to dump frames from camera */
-        {
-            static int frame_cnt = 0;
-            /* currently hardcoded for Bytes-Per-Pixel = 1.5 */
-            fileDump("/data/USBcam.yuv",
-            (char*)camHal->buffers[camHal->curCaptureBuf.index].data,
-            camHal->prevWidth * camHal->prevHeight * 1.5,
-            &frame_cnt);
-        }
+            /* Debug code to dump frames from camera */
+            {
+                static int frame_cnt = 0;
+                /* currently hardcoded for Bytes-Per-Pixel = 1.5 */
+                fileDump("/data/USBcam.yuv",
+                (char*)camHal->buffers[frame.capBuf.index].data,
+                camHal->prevWidth * camHal->prevHeight * 1.5,
+                &frame_cnt);
+            }
 #endif
 
 #if MEMSET
-        static int color = 30;
-        color += 50;
-        if(color > 200) {
-            color = 30;
-        }
-        ALOGE("%s: Setting to the color: %d\n", __func__, color);
-        /* currently hardcoded for format of type Bytes-Per-Pixel = 1.5 */
-        memset(camHal->previewMem.camera_memory[buffer_id]->data,
-               color, camHal->dispWidth * camHal->dispHeight * 1.5 + 2 * 1024);
+            static int color = 30;
+            color += 50;
+            if(color > 200) {
+                color = 30;
+            }
+            ALOGE("%s: Setting to the color: %d\n", __func__, color);
+            /* currently hardcoded for format of type Bytes-Per-Pixel = 1.5 */
+            memset(camHal->previewMem.camera_memory[buffer_id]->data,
+                   color, camHal->dispWidth * camHal->dispHeight * 1.5 + 2 * 1024);
 #else
-        convert_data_frm_cam_to_disp(camHal, buffer_id);
-        ALOGD("%s: Copied data to buffer_id: %d", __func__, buffer_id);
+            convert_data_frm_cam_to_disp(camHal, &frame.capBuf, buffer_id);
+            ALOGD("%s: Copied data to buffer_id: %d", __func__, buffer_id);
 #endif
 
 #if FILE_DUMP_B4_DISP
-        /* Debug code to dump display buffers */
-        {
-            static int frame_cnt = 0;
-            /* currently hardcoded for Bytes-Per-Pixel = 1.5 */
-            fileDump("/data/display.yuv",
-                (char*) camHal->previewMem.camera_memory[buffer_id]->data,
-                camHal->dispWidth * camHal->dispHeight * 1.5,
-                &frame_cnt);
-            ALOGD("%s: Written buf_index: %d ", __func__, buffer_id);
-        }
+            /* Debug code to dump display buffers */
+            {
+                static int frame_cnt = 0;
+                /* currently hardcoded for Bytes-Per-Pixel = 1.5 */
+                fileDump("/data/display.yuv",
+                    (char*) camHal->previewMem.camera_memory[buffer_id]->data,
+                    camHal->dispWidth * camHal->dispHeight * 1.5,
+                    &frame_cnt);
+                ALOGD("%s: Written buf_index: %d ", __func__, buffer_id);
+            }
 #endif
-
-#if DISPLAY
-    /************************************************************************/
-    /* - Enqueue display buffer back to surface                             */
-    /************************************************************************/
-       if(0 == put_buf_to_display(camHal, buffer_id)) {
-            ALOGD("%s: put_buf_to_display success: %d", __func__, buffer_id);
         }
-        else
-            ALOGE("%s: put_buf_to_display error", __func__);
-#endif
+        prvwConvertDone(camHal);
 
 #if CAPTURE
-     /************************************************************************/
+    /************************************************************************/
     /* - Enqueue capture buffer back to USB camera                          */
     /************************************************************************/
-       if(0 == put_buf_to_cam(camHal)) {
+        if(0 == put_buf_to_cam(camHal, &frame.capBuf)) {
             ALOGD("%s: put_buf_to_cam success", __func__);
         }
         else
             ALOGE("%s: put_buf_to_cam error", __func__);
 #endif
+        frame.convEndTs = systemTime();
 
-#if CALL_BACK
     /************************************************************************/
-    /* - If preview frames callback is requested, callback with prvw buffers*/
+    /* - Pass display buffer to present stage                               */
     /************************************************************************/
-        /* TBD: change the 1.5 hardcoding to Bytes Per Pixel */
-        int previewBufSize = camHal->prevWidth * camHal->prevHeight * 1.5;
-
-        msgType |=  CAMERA_MSG_PREVIEW_FRAME;
-
-        if(previewBufSize !=
-            camHal->previewMem.private_buffer_handle[buffer_id]->size) {
-
-            previewMem = camHal->get_memory(
-                camHal->previewMem.private_buffer_handle[buffer_id]->fd,
-                previewBufSize,
-                1,
-                camHal->cb_ctxt);
-
-              if (!previewMem || !previewMem->data) {
-                  ALOGE("%s: get_memory failed.\n", __func__);
-              }
-              else {
-                  data = previewMem;
-                  ALOGD("%s: GetMemory successful. data = %p",
-                            __func__, data);
-                  ALOGD("%s: previewBufSize = %d, priv_buf_size: %d",
-                    __func__, previewBufSize,
-                    camHal->previewMem.private_buffer_handle[buffer_id]->size);
-              }
+        if(prvwQueuePush(&camHal->prvwPresentQ, &frame)) {
+            Mutex::Autolock dispLock(camHal->prvwDispLock);
+#if DISPLAY
+            if(frame.dispGen == camHal->prvwDispGen)
+                cancel_buf_to_display(camHal, frame.dispBufId);
+#endif
+            break;
         }
-        else{
-            data =   camHal->previewMem.camera_memory[buffer_id];
-            ALOGD("%s: No GetMemory, no invalid fmt. data = %p, idx=%d",
-                __func__, data, buffer_id);
+    }
+
+    prvwQueueAbort(&camHal->prvwPresentQ);
+
+    ALOGD("%s: X", __func__);
+    return (void *)0;
+}
+
+/******************************************************************************
+ * Function: prvwPresentThread
+ * Description: This is thread funtion for present stage of preview pipeline.
+ *              It enqueues converted display buffers to surface and calls
+ *              back with preview frames
+ *
+ * Input parameters:
+ *  hcamHal                 - camera HAL handle
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: none
+ *****************************************************************************/
+static void * prvwPresentThread(void *hcamHal)
+{
+    camera_hardware_t   *camHal     = (camera_hardware_t *)hcamHal;
+    usbcam_prvw_frame_t frame;
+    int                 buffer_id;
+    int                 msgType     = 0;
+    camera_memory_t     *data       = NULL;
+    camera_frame_metadata_t *metadata= NULL;
+    camera_memory_t     *previewMem = NULL;
+
+    ALOGD("%s: E", __func__);
+
+    androidSetThreadPriority(gettid(), ANDROID_PRIORITY_NORMAL);
+    prctl(PR_SET_NAME, (unsigned long)"Camera HAL preview present", 0, 0, 0);
+
+    /************************************************************************/
+    /* - Get display buffer from convert stage                              */
+    /* - Enqueue display buffer back to surface                             */
+    /* - If preview frames callback is requested, callback with prvw buffers*/
+    /************************************************************************/
+    while(0 == prvwQueuePop(&camHal->prvwPresentQ, &frame)) {
+        buffer_id   = frame.dispBufId;
+        data        = NULL;
+        previewMem  = NULL;
+
+        {
+            Mutex::Autolock dispLock(camHal->prvwDispLock);
+
+            /* Display buffers were re-initialized by set_preview_window */
+            if(frame.dispGen != camHal->prvwDispGen) {
+                ALOGD("%s: dropping frame of old preview window", __func__);
+                android_atomic_inc(&camHal->prvwDrops);
+                continue;
+            }
+#if DISPLAY
+    /************************************************************************/
+    /* - Enqueue display buffer back to surface                             */
+    /************************************************************************/
+            if(0 == put_buf_to_display(camHal, buffer_id)) {
+                ALOGD("%s: put_buf_to_display success: %d", __func__, buffer_id);
+            }
+            else
+                ALOGE("%s: put_buf_to_display error", __func__);
+#endif
+
+#if CALL_BACK
+            /* TBD: change the 1.5 hardcoding to Bytes Per Pixel */
+            int previewBufSize = camHal->prevWidth * camHal->prevHeight * 1.5;
+
+            msgType |=  CAMERA_MSG_PREVIEW_FRAME;
+
+            if(previewBufSize !=
+                camHal->previewMem.private_buffer_handle[buffer_id]->size) {
+
+                previewMem = camHal->get_memory(
+                    camHal->previewMem.private_buffer_handle[buffer_id]->fd,
+                    previewBufSize,
+                    1,
+                    camHal->cb_ctxt);
+
+                  if (!previewMem || !previewMem->data) {
+                      ALOGE("%s: get_memory failed.\n", __func__);
+                  }
+                  else {
+                      data = previewMem;
+                      ALOGD("%s: GetMemory successful. data = %p",
+                                __func__, data);
+                      ALOGD("%s: previewBufSize = %d, priv_buf_size: %d",
+                        __func__, previewBufSize,
+                        camHal->previewMem.private_buffer_handle[buffer_id]->size);
+                  }
+            }
+            else{
+                data =   camHal->previewMem.camera_memory[buffer_id];
+                ALOGD("%s: No GetMemory, no invalid fmt. data = %p, idx=%d",
+                    __func__, data, buffer_id);
+            }
+#endif
         }
-        /* Unlock and lock around the callback. */
+        prvwUpdateStats(camHal, &frame, systemTime());
+
+#if CALL_BACK
+    /************************************************************************/
+    /* - If preview frames callback is requested, callback with prvw buffers*/
+    /************************************************************************/
+        /* Callback without any lock held. */
         /* Sometimes 'disable_msg' is issued in the callback context, */
         /* leading to deadlock */
-        camHal->lock.unlock();
         if((camHal->msgEnabledFlag & CAMERA_MSG_PREVIEW_FRAME) &&
             camHal->data_cb){
             ALOGD("%s: before data callback", __func__);
             camHal->data_cb(msgType, data, 0,metadata, camHal->cb_ctxt);
             ALOGD("%s: after data callback: %p", __func__, camHal->data_cb);
         }
-        camHal->lock.lock();
         if (previewMem)
             previewMem->release(previewMem);
 #endif
+    }
 
-    }//while(1)
     ALOGD("%s: X", __func__);
     return (void *)0;
 }
@@ -2540,7 +3053,7 @@ static void * takePictureThread(void *hcamHal)
     /************************************************************************/
     /* - Dequeue capture buffer from USB camera                             */
     /************************************************************************/
-    if (0 == get_buf_from_cam(camHal))
+    if (0 == get_buf_from_cam(camHal, &camHal->curCaptureBuf))
         ALOGD("%s: get_buf_from_cam success", __func__);
     else
         ALOGE("%s: get_buf_from_cam error", __func__);
@@ -2611,7 +3124,7 @@ static void * takePictureThread(void *hcamHal)
     /************************************************************************/
     /* - Enqueue capture buffer back to USB camera                          */
     /************************************************************************/
-    if(0 == put_buf_to_cam(camHal)) {
+    if(0 == put_buf_to_cam(camHal, &camHal->curCaptureBuf)) {
         ALOGD("%s: put_buf_to_cam success", __func__);
     }
     else
@@ -2827,10 +3340,11 @@ int encodeJpeg(camera_hardware_t *camHal)
         return -1;
     }
 
-    rc = convert_YUYV_to_420_NV12(
+    rc = usbCamConvertYUYV(
         (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
-        (char *)jpegInMem->data, camHal->pictWidth, camHal->pictHeight);
-    ERROR_CHECK_EXIT(rc, "convert_YUYV_to_420_NV12");
+        (char *)jpegInMem->data, camHal->pictWidth, camHal->pictHeight,
+        USBCAM_CONV_FMT_NV21);
+    ERROR_CHECK_EXIT(rc, "usbCamConvertYUYV");
     /************************************************************************/
     /* - Populate JPEG encoding parameters from the camHal context          */
     /************************************************************************/
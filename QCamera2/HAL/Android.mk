@@ -12,7 +12,9 @@ LOCAL_SRC_FILES := \
         QCameraStateMachine.cpp \
         QCameraChannel.cpp \
         QCameraStream.cpp \
+        QCameraStreamMetrics.cpp \
 	QCameraPostProc.cpp \
+        QCameraDumpWriter.cpp \
         QCamera2HWICallbacks.cpp \
         QCameraParameters.cpp
 
@@ -169,13 +169,8 @@ int QCamera2HardwareInterface::msg_type_enabled(struct camera_device *device, in
         ALOGE("NULL camera device");
         return BAD_VALUE;
     }
-    hw->lockAPI();
-    ret = hw->processAPI(QCAMERA_SM_EVT_MSG_TYPE_ENABLED, (void *)msg_type);
-    if (ret == NO_ERROR) {
-        hw->waitAPIResult(QCAMERA_SM_EVT_MSG_TYPE_ENABLED);
-        ret = hw->m_apiResult.enabled;
-    }
-    hw->unlockAPI();
+    // read only query, no need to go through statemachine thread
+    ret = hw->msgTypeEnabled(msg_type);
 
    return ret;
 }
@@ -230,13 +225,8 @@ int QCamera2HardwareInterface::preview_enabled(struct camera_device *device)
         return BAD_VALUE;
     }
 
-    hw->lockAPI();
-    ret = hw->processAPI(QCAMERA_SM_EVT_PREVIEW_ENABLED, NULL);
-    if (ret == NO_ERROR) {
-        hw->waitAPIResult(QCAMERA_SM_EVT_PREVIEW_ENABLED);
-        ret = hw->m_apiResult.enabled;
-    }
-    hw->unlockAPI();
+    // read only query, no need to go through statemachine thread
+    ret = hw->m_stateMachine.isPreviewEnabled() ? 1 : 0;
 
     return ret;
 }
@@ -308,13 +298,8 @@ int QCamera2HardwareInterface::recording_enabled(struct camera_device *device)
         ALOGE("NULL camera device");
         return BAD_VALUE;
     }
-    hw->lockAPI();
-    ret = hw->processAPI(QCAMERA_SM_EVT_RECORDING_ENABLED, NULL);
-    if (ret == NO_ERROR) {
-        hw->waitAPIResult(QCAMERA_SM_EVT_RECORDING_ENABLED);
-        ret = hw->m_apiResult.enabled;
-    }
-    hw->unlockAPI();
+    // read only query, no need to go through statemachine thread
+    ret = hw->m_stateMachine.isRecordingEnabled() ? 1 : 0;
 
     return ret;
 }
@@ -572,6 +557,7 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(int cameraId)
     mCameraDevice.ops = &mCameraOps;
     mCameraDevice.priv = this;
 
+    pthread_mutex_init(&m_apiLock, NULL);
     pthread_mutex_init(&m_lock, NULL);
     pthread_cond_init(&m_cond, NULL);
     memset(&m_apiResult, 0, sizeof(qcamera_api_result_t));
@@ -584,6 +570,7 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(int cameraId)
 QCamera2HardwareInterface::~QCamera2HardwareInterface()
 {
     closeCamera();
+    pthread_mutex_destroy(&m_apiLock);
     pthread_mutex_destroy(&m_lock);
     pthread_cond_destroy(&m_cond);
 
@@ -633,6 +620,7 @@ int QCamera2HardwareInterface::openCamera()
     }
 
     mParameters.init(gCamCapability[mCameraId], mCameraHandle);
+    m_dumpWriter.init(mParameters.getEnabledFileDumpMask());
     mCameraOpened = true;
 
     return NO_ERROR;
@@ -663,8 +651,14 @@ int QCamera2HardwareInterface::closeCamera()
     mCameraHandle = NULL;
 
     m_evtNotifyTh.exit();
+
+    // finish frame dumps still queued by stream callbacks
+    m_dumpWriter.deinit();
     mCameraOpened = false;
 
+    // give free stream buffers kept warm for this session back to ION
+    QCameraMemoryPool::getInstance().flush();
+
     return rc;
 }
 
@@ -843,6 +837,8 @@ QCameraMemory *QCamera2HardwareInterface::allocateStreamBuf(
     if (!mem)
         return NULL;
 
+    mem->setCachePolicy(getStreamCachePolicy(stream_type));
+
     rc = mem->allocate(bufferCnt, size);
     if (rc < 0) {
         delete mem;
@@ -851,6 +847,52 @@ QCameraMemory *QCamera2HardwareInterface::allocateStreamBuf(
     return mem;
 }
 
+/*===========================================================================
+ * FUNCTION   : getStreamCachePolicy
+ *
+ * DESCRIPTION: choose cache maintenance of stream buffers by whether the cpu
+ *              ever reads them. Hardware writes all stream buffers, so
+ *              cleaning is never needed. Buffers only passed on to display
+ *              or encoder by handle need no cache ops at all.
+ *
+ * PARAMETERS :
+ *   @stream_type : type of stream
+ *
+ * RETURN     : cache policy for the stream memory
+ *==========================================================================*/
+qcamera_cache_policy_t QCamera2HardwareInterface::getStreamCachePolicy(
+    cam_stream_type_t stream_type)
+{
+    int dumpMask = mParameters.getEnabledFileDumpMask();
+
+    switch (stream_type) {
+    case CAM_STREAM_TYPE_PREVIEW:
+        // preview callbacks may be enabled later, in that case the preview
+        // callback switches to INVALIDATE through prepareCpuRead
+        if (msgTypeEnabled(CAMERA_MSG_PREVIEW_FRAME) == 0 &&
+            (dumpMask & QCAMERA_DUMP_FRM_PREVIEW) == 0) {
+            return QCAMERA_CACHE_POLICY_SKIP;
+        }
+        return QCAMERA_CACHE_POLICY_INVALIDATE;
+    case CAM_STREAM_TYPE_VIDEO:
+        // in metadata mode the encoder only gets the buffer handle
+        if (mStoreMetaDataInFrame > 0 &&
+            (dumpMask & QCAMERA_DUMP_FRM_VIDEO) == 0) {
+            return QCAMERA_CACHE_POLICY_SKIP;
+        }
+        return QCAMERA_CACHE_POLICY_INVALIDATE;
+    case CAM_STREAM_TYPE_POSTVIEW:
+    case CAM_STREAM_TYPE_SNAPSHOT:
+    case CAM_STREAM_TYPE_RAW:
+    case CAM_STREAM_TYPE_METADATA:
+        // read by cpu for callbacks, exif/metadata parsing or dumps
+        return QCAMERA_CACHE_POLICY_INVALIDATE;
+    case CAM_STREAM_TYPE_OFFLINE_PROC:
+    default:
+        return QCAMERA_CACHE_POLICY_FULL;
+    }
+}
+
 QCameraHeapMemory *QCamera2HardwareInterface::allocateStreamInfoBuf(
     cam_stream_type_t stream_type)
 {
@@ -902,6 +944,46 @@ QCameraHeapMemory *QCamera2HardwareInterface::allocateStreamInfoBuf(
     return streamInfoBuf;
 }
 
+/*===========================================================================
+ * FUNCTION   : canReuseStreamBuf
+ *
+ * DESCRIPTION: check if buffers of a stream can be kept as they are when
+ *              the stream is reconfigured
+ *
+ * PARAMETERS :
+ *   @stream_type : type of stream
+ *   @mem         : buffers the stream currently has
+ *   @size        : frame length of new stream config
+ *
+ * RETURN     : true if buffers can be reused, false if they need to be
+ *              allocated again
+ *==========================================================================*/
+bool QCamera2HardwareInterface::canReuseStreamBuf(
+    cam_stream_type_t stream_type, QCameraMemory *mem, int size)
+{
+    for (int i = 0; i < mem->getCnt(); i++) {
+        if (mem->getSize(i) < size) {
+            return false;
+        }
+    }
+
+    switch (stream_type) {
+    case CAM_STREAM_TYPE_PREVIEW:
+    case CAM_STREAM_TYPE_POSTVIEW: {
+        // display reads gralloc buffers with the geometry the window
+        // handed them out with, so it has to be unchanged
+        cam_dimension_t dim;
+        mParameters.getStreamDimension(stream_type, dim);
+        return static_cast<QCameraGrallocMemory *>(mem)->isWindowInfo(
+                mPreviewWindow, dim.width, dim.height,
+                mParameters.getPreviewHalPixelFormat());
+        }
+    default:
+        break;
+    }
+    return true;
+}
+
 int QCamera2HardwareInterface::setPreviewWindow(
         struct preview_stream_ops *window)
 {
@@ -923,21 +1005,22 @@ int QCamera2HardwareInterface::setCallBacks(camera_notify_callback notify_cb,
     return NO_ERROR;
 }
 
+// mMsgEnabled is read without lock by msg_type_enabled and data callbacks
 int QCamera2HardwareInterface::enableMsgType(int32_t msg_type)
 {
-    mMsgEnabled |= msg_type;
+    __atomic_fetch_or(&mMsgEnabled, msg_type, __ATOMIC_RELEASE);
     return NO_ERROR;
 }
 
 int QCamera2HardwareInterface::disableMsgType(int32_t msg_type)
 {
-    mMsgEnabled &= ~msg_type;
+    __atomic_fetch_and(&mMsgEnabled, ~msg_type, __ATOMIC_RELEASE);
     return NO_ERROR;
 }
 
 int QCamera2HardwareInterface::msgTypeEnabled(int32_t msg_type)
 {
-    return (mMsgEnabled & msg_type);
+    return (__atomic_load_n(&mMsgEnabled, __ATOMIC_ACQUIRE) & msg_type);
 }
 
 int QCamera2HardwareInterface::startPreview()
@@ -992,6 +1075,36 @@ int QCamera2HardwareInterface::stopPreview()
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : reconfigPreview
+ *
+ * DESCRIPTION: apply new preview size/format by reconfiguring the preview
+ *              stream alone, metadata and other streams keep running
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code, preview needs a full restart
+ *==========================================================================*/
+int32_t QCamera2HardwareInterface::reconfigPreview()
+{
+    cam_dimension_t dim;
+    cam_format_t fmt;
+
+    // preview stream of ZSL channel is bundled, it restarts with channel
+    if (!mParameters.isPreviewReconfigOnly() ||
+        mParameters.isZSLMode() ||
+        m_channels[QCAMERA_CH_TYPE_PREVIEW] == NULL) {
+        return INVALID_OPERATION;
+    }
+
+    mParameters.getStreamDimension(CAM_STREAM_TYPE_PREVIEW, dim);
+    mParameters.getStreamFormat(CAM_STREAM_TYPE_PREVIEW, fmt);
+    return m_channels[QCAMERA_CH_TYPE_PREVIEW]->reconfigStream(
+            CAM_STREAM_TYPE_PREVIEW, dim, fmt);
+}
+
 int QCamera2HardwareInterface::storeMetaDataInBuffers(int enable)
 {
     mStoreMetaDataInFrame = enable;
@@ -1275,10 +1388,23 @@ int QCamera2HardwareInterface::release()
     return NO_ERROR;
 }
 
-int QCamera2HardwareInterface::dump(int /*fd*/)
+int QCamera2HardwareInterface::dump(int fd)
 {
-    ALOGE("%s: not supported yet", __func__);
-    return INVALID_OPERATION;
+    QCameraMemoryPool::getInstance().dump(fd);
+    QCameraMemory::dumpCacheStats(fd);
+    // frames kept in dump ring are written on request only
+    m_dumpWriter.flushRing();
+    m_dumpWriter.dump(fd);
+    m_stateMachine.dump(fd);
+
+    const char hdr[] = "Stream metrics:\n";
+    write(fd, hdr, sizeof(hdr) - 1);
+    for (int i = 0; i < QCAMERA_CH_TYPE_MAX; i++) {
+        if (m_channels[i] != NULL) {
+            m_channels[i]->dumpMetrics(fd);
+        }
+    }
+    return NO_ERROR;
 }
 
 int QCamera2HardwareInterface::processAPI(qcamera_sm_evt_enum_t api, void *api_payload)
@@ -1301,7 +1427,9 @@ void QCamera2HardwareInterface::evtHandle(uint32_t /*camera_handle*/,
             (mm_camera_event_t *)malloc(sizeof(mm_camera_event_t));
         if (NULL != payload) {
             *payload = *evt;
-            obj->processEvt(QCAMERA_SM_EVT_EVT_NOTIFY, payload);
+            if (obj->processEvt(QCAMERA_SM_EVT_EVT_NOTIFY, payload) != NO_ERROR) {
+                free(payload);
+            }
         }
     } else {
         ALOGE("%s: NULL user_data", __func__);
@@ -1327,7 +1455,9 @@ void QCamera2HardwareInterface::jpegEvtHandle(jpeg_job_status_t status,
             payload->thumbnailDroppedFlag = thumbnailDroppedFlag;
             payload->out_data = out_data;
             payload->data_size = data_size;
-            obj->processEvt(QCAMERA_SM_EVT_JPEG_EVT_NOTIFY, payload);
+            if (obj->processEvt(QCAMERA_SM_EVT_JPEG_EVT_NOTIFY, payload) != NO_ERROR) {
+                free(payload);
+            }
         }
     } else {
         ALOGE("%s: NULL user_data", __func__);
@@ -1483,6 +1613,9 @@ int32_t QCamera2HardwareInterface::processJpegNotify(qcamera_jpeg_evt_payload_t
 
 void QCamera2HardwareInterface::lockAPI()
 {
+    // m_lock is released while waiting for API result, so it cannot keep
+    // a second API caller from overwriting m_apiResult of the first one
+    pthread_mutex_lock(&m_apiLock);
     pthread_mutex_lock(&m_lock);
 }
 
@@ -1498,6 +1631,7 @@ void QCamera2HardwareInterface::waitAPIResult(qcamera_sm_evt_enum_t api_evt)
 void QCamera2HardwareInterface::unlockAPI()
 {
     pthread_mutex_unlock(&m_lock);
+    pthread_mutex_unlock(&m_apiLock);
 }
 
 void QCamera2HardwareInterface::signalAPIResult(qcamera_api_result_t *result)
@@ -1697,6 +1831,7 @@ int32_t QCamera2HardwareInterface::addZSLChannel()
     attr.look_back = mParameters.getZSLBackLookCount();
     attr.post_frame_skip = mParameters.getZSLBurstInterval();
     attr.water_mark = mParameters.getZSLQueueDepth();
+    attr.priority = mParameters.getZSLPriority();
     rc = pChannel->init(&attr,
                         zsl_channel_cb,
                         this);
@@ -1730,6 +1865,18 @@ int32_t QCamera2HardwareInterface::addZSLChannel()
         return rc;
     }
 
+    if (MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS == attr.priority) {
+        // focus state of each frame comes from metadata bundled with it
+        rc = pChannel->addStream(*this, CAM_STREAM_TYPE_METADATA,
+                                 &gCamCapability[mCameraId]->padding_info,
+                                 metadata_stream_cb_routine, this);
+        if (rc != NO_ERROR) {
+            ALOGE("%s: add metadata stream failed, ret = %d", __func__, rc);
+            delete pChannel;
+            return rc;
+        }
+    }
+
     m_channels[QCAMERA_CH_TYPE_ZSL] = pChannel;
     return rc;
 }
@@ -1928,9 +2075,14 @@ int32_t QCamera2HardwareInterface::stopChannel(qcamera_ch_type_enum_t ch_type)
 int32_t QCamera2HardwareInterface::preparePreview()
 {
     int32_t rc = NO_ERROR;
-    rc = addChannel(QCAMERA_CH_TYPE_METADATA);
-    if (rc != NO_ERROR) {
-        return rc;
+
+    // with ZSL focus priority, metadata stream is bundled in ZSL channel
+    if (!mParameters.isZSLMode() ||
+        MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS != mParameters.getZSLPriority()) {
+        rc = addChannel(QCAMERA_CH_TYPE_METADATA);
+        if (rc != NO_ERROR) {
+            return rc;
+        }
     }
 
     if (mParameters.isZSLMode()) {
@@ -2122,11 +2274,12 @@ int32_t QCamera2HardwareInterface::processHistogramStats(cam_histogram_data_t *h
     return NO_ERROR;
 }
 
-int QCamera2HardwareInterface::updateParameters(const char *parms, bool &needRestart)
+int QCamera2HardwareInterface::updateParameters(const char *parms,
+                                                bool &needRestart,
+                                                bool restartAllowed)
 {
     String8 str = String8(parms);
-    QCameraParameters param(str);
-    return mParameters.updateParameters(param, needRestart);
+    return mParameters.updateParameters(str, needRestart, restartAllowed);
 }
 
 int QCamera2HardwareInterface::commitParameterChanges()
@@ -2162,12 +2315,43 @@ int QCamera2HardwareInterface::getJpegRotation() {
     return mParameters.getJpegRotation();
 }
 
-QCameraExif *QCamera2HardwareInterface::getExifData()
+int32_t QCamera2HardwareInterface::getStaticExifData(QCameraExif *exif)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    // tags that don't change within a session
+    memset(value, 0, sizeof(value));
+    if (property_get("ro.product.manufacturer", value, "QCOM-AA") > 0) {
+        exif->addEntry(EXIFTAGID_MAKE,
+                       EXIF_ASCII,
+                       strlen(value) + 1,
+                       (void *)value);
+    }
+
+    memset(value, 0, sizeof(value));
+    if (property_get("ro.product.model", value, "QCAM-AA") > 0) {
+        exif->addEntry(EXIFTAGID_MODEL,
+                       EXIF_ASCII,
+                       strlen(value) + 1,
+                       (void *)value);
+    }
+
+    memset(value, 0, sizeof(value));
+    if (property_get("ro.build.description", value, "QCAM-AA") > 0) {
+        exif->addEntry(EXIFTAGID_SOFTWARE,
+                       EXIF_ASCII,
+                       strlen(value) + 1,
+                       (void *)value);
+    }
+
+    return NO_ERROR;
+}
+
+int32_t QCamera2HardwareInterface::getExifData(QCameraExif *exif)
 {
-    QCameraExif *exif = new QCameraExif();
     if (exif == NULL) {
-        ALOGE("%s: No memory for QCameraExif", __func__);
-        return NULL;
+        ALOGE("%s: No QCameraExif to fill", __func__);
+        return BAD_VALUE;
     }
 
     int32_t rc = NO_ERROR;
@@ -2279,7 +2463,7 @@ QCameraExif *QCamera2HardwareInterface::getExifData()
         ALOGE("%s: getExifGpsDataTimeStamp failed", __func__);
     }
 
-    return exif;
+    return NO_ERROR;
 }
 
 int32_t QCamera2HardwareInterface::setHistogram(bool histogram_en)
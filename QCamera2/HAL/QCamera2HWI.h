@@ -40,6 +40,7 @@
 #include "QCameraStateMachine.h"
 #include "QCameraAllocator.h"
 #include "QCameraPostProc.h"
+#include "QCameraDumpWriter.h"
 
 extern "C" {
 #include <mm_camera_interface.h>
@@ -130,6 +131,8 @@ public:
     // Implementation of QCameraAllocator
     virtual QCameraMemory *allocateStreamBuf(cam_stream_type_t stream_type, int size);
     virtual QCameraHeapMemory *allocateStreamInfoBuf(cam_stream_type_t stream_type);
+    virtual bool canReuseStreamBuf(cam_stream_type_t stream_type,
+                                   QCameraMemory *mem, int size);
 
     friend class QCameraStateMachine;
     friend class QCameraPostProcessor;
@@ -147,6 +150,7 @@ private:
     int msgTypeEnabled(int32_t msg_type);
     int startPreview();
     int stopPreview();
+    int32_t reconfigPreview();
     int storeMetaDataInBuffers(int enable);
     int startRecording();
     int stopRecording();
@@ -174,14 +178,15 @@ private:
     void signalAPIResult(qcamera_api_result_t *result);
 
     // update entris to set parameters and check if restart is needed
-    int updateParameters(const char *parms, bool &needRestart);
+    int updateParameters(const char *parms, bool &needRestart,
+                         bool restartAllowed);
     // send request to server to set parameters
     int commitParameterChanges();
 
     bool needDebugFps();
     bool needOfflineReprocess();
-    void debugShowVideoFPS();
-    void debugShowPreviewFPS();
+    void debugShowVideoFPS(QCameraStream *stream);
+    void debugShowPreviewFPS(QCameraStream *stream);
     void dumpFrameToFile(const void *data, uint32_t size,
                          int index, int dump_type);
     void releaseSuperBuf(mm_camera_super_buf_t *super_buf);
@@ -189,7 +194,8 @@ private:
     void getThumbnailSize(cam_dimension_t &dim);
     int getJpegQuality();
     int getJpegRotation();
-    QCameraExif *getExifData();
+    int32_t getExifData(QCameraExif *exif);
+    int32_t getStaticExifData(QCameraExif *exif);
 
     int32_t processAutoFocusEvent(cam_auto_focus_data_t &focus_data);
     int32_t processZoomEvent(uint32_t status);
@@ -224,6 +230,7 @@ private:
     int32_t prepareHardwareForSnapshot();
     bool needProcessPreviewFrame() {return m_stateMachine.isPreviewRunning();};
     bool isNoDisplayMode() {return mParameters.isNoDisplayMode();};
+    qcamera_cache_policy_t getStreamCachePolicy(cam_stream_type_t stream_type);
     uint8_t numOfSnapshotsExpected() {return mParameters.getNumOfSnapshots();};
 
     static void evtHandle(uint32_t camera_handle,
@@ -286,6 +293,8 @@ private:
 
     QCameraStateMachine m_stateMachine;   // state machine
     QCameraPostProcessor m_postprocessor; // post processor
+    QCameraDumpWriter m_dumpWriter;       // async frame dump writer
+    pthread_mutex_t m_apiLock;            // serializes API calls
     pthread_mutex_t m_lock;
     pthread_cond_t m_cond;
     qcamera_api_result_t m_apiResult;
@@ -166,7 +166,7 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
     }
 
     if (pme->needDebugFps()) {
-        pme->debugShowPreviewFPS();
+        pme->debugShowPreviewFPS(stream);
     }
 
     pme->dumpFrameToFile(frame->buffer, frame->frame_len,
@@ -192,6 +192,7 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
     // Handle preview data callback
     if (pme->mDataCb != NULL && pme->msgTypeEnabled(CAMERA_MSG_PREVIEW_FRAME) > 0) {
         camera_memory_t *previewMem = NULL;
+        memory->prepareCpuRead(idx);
         camera_memory_t *data = NULL;
         int previewBufSize;
         cam_dimension_t preview_dim;
@@ -283,7 +284,7 @@ void QCamera2HardwareInterface::nodisplay_preview_stream_cb_routine(
     }
 
     if (pme->needDebugFps()) {
-        pme->debugShowPreviewFPS();
+        pme->debugShowPreviewFPS(stream);
     }
     pme->dumpFrameToFile(frame->buffer, frame->frame_len,
                          frame->frame_idx, QCAMERA_DUMP_FRM_PREVIEW);
@@ -292,10 +293,11 @@ void QCamera2HardwareInterface::nodisplay_preview_stream_cb_routine(
     camera_memory_t *preview_mem =
         previewMemObj->getMemory(frame->buf_idx, false);
     if (NULL != previewMemObj && NULL != preview_mem) {
-        previewMemObj->cleanCache(frame->buf_idx);
         if (pme->needProcessPreviewFrame() &&
             pme->mDataCb != NULL &&
             pme->msgTypeEnabled(CAMERA_MSG_PREVIEW_FRAME) > 0 ) {
+            // cpu only reads the frame, invalidated on bufDone, no clean
+            previewMemObj->prepareCpuRead(frame->buf_idx);
             //Sending preview callback if corresponding Msgs are enabled
             pme->mDataCb(CAMERA_MSG_PREVIEW_FRAME, preview_mem,
                          0, NULL, pme->mCallbackCookie);
@@ -405,7 +407,7 @@ void QCamera2HardwareInterface::video_stream_cb_routine(mm_camera_super_buf_t *s
     mm_camera_buf_def_t *frame = super_frame->bufs[0];
 
     if (pme->needDebugFps()) {
-        pme->debugShowVideoFPS();
+        pme->debugShowVideoFPS(stream);
     }
 
     ALOGE("%s: Stream(%d), Timestamp: %ld %ld",
@@ -603,7 +605,7 @@ void QCamera2HardwareInterface::metadata_stream_cb_routine(mm_camera_super_buf_t
     if (pMetaData->is_focus_valid) {
         // process focus info
         qcamera_sm_internal_evt_payload_t *payload =
-            (qcamera_sm_internal_evt_payload_t *)sizeof(qcamera_sm_internal_evt_payload_t);
+            (qcamera_sm_internal_evt_payload_t *)malloc(sizeof(qcamera_sm_internal_evt_payload_t));
         if (NULL != payload) {
             memset(payload, 0, sizeof(qcamera_sm_internal_evt_payload_t));
             payload->evt_type = QCAMERA_INTERNAL_EVT_FOCUS_UPDATE;
@@ -690,35 +692,8 @@ void QCamera2HardwareInterface::dumpFrameToFile(const void *data,
         return;
     }
 
-    char buf[32];
-    switch (dump_type) {
-    case QCAMERA_DUMP_FRM_PREVIEW:
-        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "preview", index, "yuv");
-        break;
-    case QCAMERA_DUMP_FRM_THUMBNAIL:
-        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "thumbnail", index, "yuv");
-        break;
-    case QCAMERA_DUMP_FRM_SNAPSHOT:
-        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "main", index, "yuv");
-        break;
-    case QCAMERA_DUMP_FRM_VIDEO:
-        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "video", index, "yuv");
-        break;
-    case QCAMERA_DUMP_FRM_RAW:
-        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "raw", index, "raw");
-        break;
-    case QCAMERA_DUMP_FRM_JPEG:
-        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "jpeg", index, "jpg");
-        break;
-    default:
-        ALOGE("%s: Not supported for dumping stream type %d", __func__, dump_type);
-        return;
-    }
-
-    ALOGE("dump %s size =%d", buf, size);
-    int file_fd = open(buf, O_RDWR | O_CREAT, 0777);
-    write(file_fd, data, size);
-    close(file_fd);
+    // copied and written on the dump writer thread
+    m_dumpWriter.dumpFrame(data, size, index, dump_type);
 }
 
 /*===========================================================================
@@ -726,24 +701,16 @@ void QCamera2HardwareInterface::dumpFrameToFile(const void *data,
  *
  * DESCRIPTION: helper function to log video frame FPS for debug purpose.
  *
- * PARAMETERS : None
+ * PARAMETERS :
+ *   @stream  : video stream object
  *
  * RETURN     : None
  *==========================================================================*/
-void QCamera2HardwareInterface::debugShowVideoFPS()
+void QCamera2HardwareInterface::debugShowVideoFPS(QCameraStream *stream)
 {
-    static int n_vFrameCount = 0;
-    static int n_vLastFrameCount = 0;
-    static nsecs_t n_vLastFpsTime = 0;
-    static float n_vFps = 0;
-    n_vFrameCount++;
-    nsecs_t now = systemTime();
-    nsecs_t diff = now - n_vLastFpsTime;
-    if (diff > ms2ns(250)) {
-        n_vFps =  ((n_vFrameCount - n_vLastFrameCount) * float(s2ns(1))) / diff;
-        ALOGE("Video Frames Per Second: %.4f", n_vFps);
-        n_vLastFpsTime = now;
-        n_vLastFrameCount = n_vFrameCount;
+    float fps;
+    if (stream->getMetrics().pollFps(fps)) {
+        ALOGE("Video Frames Per Second: %.4f", fps);
     }
 }
 
@@ -752,24 +719,16 @@ void QCamera2HardwareInterface::debugShowVideoFPS()
  *
  * DESCRIPTION: helper function to log preview frame FPS for debug purpose.
  *
- * PARAMETERS : None
+ * PARAMETERS :
+ *   @stream  : preview stream object
  *
  * RETURN     : None
  *==========================================================================*/
-void QCamera2HardwareInterface::debugShowPreviewFPS()
+void QCamera2HardwareInterface::debugShowPreviewFPS(QCameraStream *stream)
 {
-    static int n_pFrameCount = 0;
-    static int n_pLastFrameCount = 0;
-    static nsecs_t n_pLastFpsTime = 0;
-    static float n_pFps = 0;
-    n_pFrameCount++;
-    nsecs_t now = systemTime();
-    nsecs_t diff = now - n_pLastFpsTime;
-    if (diff > ms2ns(250)) {
-        n_pFps =  ((n_pFrameCount - n_pLastFrameCount) * float(s2ns(1))) / diff;
-        ALOGE("Preview Frames Per Second: %.4f", n_pFps);
-        n_pLastFpsTime = now;
-        n_pLastFrameCount = n_pFrameCount;
+    float fps;
+    if (stream->getMetrics().pollFps(fps)) {
+        ALOGE("Preview Frames Per Second: %.4f", fps);
     }
 }
 
@@ -43,6 +43,8 @@ class QCameraAllocator {
 public:
     virtual QCameraMemory *allocateStreamBuf(cam_stream_type_t stream_type, int size) = 0;
     virtual QCameraHeapMemory *allocateStreamInfoBuf(cam_stream_type_t stream_type) = 0;
+    virtual bool canReuseStreamBuf(cam_stream_type_t stream_type,
+                                   QCameraMemory *mem, int size) = 0;
     virtual ~QCameraAllocator() {}
 };
 
@@ -44,6 +44,8 @@ QCameraChannel::QCameraChannel(uint32_t cam_handle,
     m_handle = 0;
     m_numStreams = 0;
     memset(mStreams, 0, sizeof(mStreams));
+    mDataCB = NULL;
+    mUserData = NULL;
 }
 
 QCameraChannel::QCameraChannel()
@@ -54,6 +56,8 @@ QCameraChannel::QCameraChannel()
     m_handle = 0;
     m_numStreams = 0;
     memset(mStreams, 0, sizeof(mStreams));
+    mDataCB = NULL;
+    mUserData = NULL;
 }
 
 QCameraChannel::~QCameraChannel()
@@ -73,10 +77,13 @@ int32_t QCameraChannel::init(mm_camera_channel_attr_t *attr,
                              mm_camera_buf_notify_t dataCB,
                              void *userData)
 {
+    // superbufs go through dataNotifyCB to collect stream metrics
+    mDataCB = dataCB;
+    mUserData = userData;
     m_handle = m_camOps->add_channel(m_camHandle,
                                       attr,
-                                      dataCB,
-                                      userData);
+                                      dataCB != NULL ? dataNotifyCB : NULL,
+                                      this);
     if (m_handle == 0) {
         ALOGE("%s: Add channel failed", __func__);
         return UNKNOWN_ERROR;
@@ -144,6 +151,18 @@ int32_t QCameraChannel::stop()
     return rc;
 }
 
+int32_t QCameraChannel::reconfigStream(cam_stream_type_t stream_type,
+                                       const cam_dimension_t &dim,
+                                       cam_format_t fmt)
+{
+    for (int i = 0; i < m_numStreams; i++) {
+        if (mStreams[i] != NULL && mStreams[i]->isTypeOf(stream_type)) {
+            return mStreams[i]->reconfig(dim, fmt);
+        }
+    }
+    return BAD_VALUE;
+}
+
 int32_t QCameraChannel::bufDone(mm_camera_super_buf_t *recvd_frame)
 {
     int32_t rc = NO_ERROR;
@@ -152,7 +171,7 @@ int32_t QCameraChannel::bufDone(mm_camera_super_buf_t *recvd_frame)
              for (int j = 0; j < m_numStreams; j++) {
                  if (mStreams[j] != NULL &&
                      mStreams[j]->getMyHandle() == recvd_frame->bufs[i]->stream_id) {
-                     rc = mStreams[j]->bufDone(recvd_frame->bufs[j]->buf_idx);
+                     rc = mStreams[j]->bufDone(recvd_frame->bufs[i]->buf_idx);
                      break; // break loop j
                  }
              }
@@ -162,6 +181,54 @@ int32_t QCameraChannel::bufDone(mm_camera_super_buf_t *recvd_frame)
     return rc;
 }
 
+void QCameraChannel::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
+                                  void *userdata)
+{
+    QCameraChannel *pme = (QCameraChannel *)userdata;
+    QCameraStream *streams[MAX_STREAM_NUM_IN_BUNDLE];
+    nsecs_t ts[MAX_STREAM_NUM_IN_BUNDLE];
+    nsecs_t lastTs = 0;
+
+    if (pme == NULL || pme->mDataCB == NULL) {
+        ALOGE("%s: invalid channel", __func__);
+        return;
+    }
+
+    // kernel timestamps of the frames matched into this superbuf
+    for (int i = 0; i < recvd_frame->num_bufs; i++) {
+        mm_camera_buf_def_t *buf = recvd_frame->bufs[i];
+        streams[i] = (buf != NULL) ? pme->getStreamByHandle(buf->stream_id) : NULL;
+        ts[i] = 0;
+        if (streams[i] == NULL) {
+            continue;
+        }
+        streams[i]->getMetrics().frameArrived(buf);
+        streams[i]->getMetrics().callbackStarted(buf);
+        ts[i] = seconds_to_nanoseconds(buf->ts.tv_sec) + buf->ts.tv_nsec;
+        if (ts[i] > lastTs) {
+            lastTs = ts[i];
+        }
+    }
+    if (recvd_frame->num_bufs > 1) {
+        for (int i = 0; i < recvd_frame->num_bufs; i++) {
+            if (streams[i] != NULL && ts[i] != 0) {
+                streams[i]->getMetrics().superBufSpread(lastTs - ts[i]);
+            }
+        }
+    }
+
+    pme->mDataCB(recvd_frame, pme->mUserData);
+}
+
+void QCameraChannel::dumpMetrics(int fd)
+{
+    for (int i = 0; i < m_numStreams; i++) {
+        if (mStreams[i] != NULL) {
+            mStreams[i]->dumpMetrics(fd);
+        }
+    }
+}
+
 int32_t QCameraChannel::processZoomDone(preview_stream_ops_t *previewWindow)
 {
     int32_t rc = NO_ERROR;
@@ -57,10 +57,16 @@ public:
                               void *userdata);
     virtual int32_t start();
     virtual int32_t stop();
+    virtual int32_t reconfigStream(cam_stream_type_t stream_type,
+                                   const cam_dimension_t &dim,
+                                   cam_format_t fmt);
     virtual int32_t bufDone(mm_camera_super_buf_t *recvd_frame);
     virtual int32_t processZoomDone(preview_stream_ops_t *previewWindow);
     QCameraStream *getStreamByHandle(uint32_t streamHandle);
     uint32_t getMyHandle() const {return m_handle;};
+    void dumpMetrics(int fd);
+
+    static void dataNotifyCB(mm_camera_super_buf_t *recvd_frame, void *userdata);
 protected:
     uint32_t m_camHandle;
     mm_camera_ops_t *m_camOps;
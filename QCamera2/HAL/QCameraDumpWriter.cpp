@@ -0,0 +1,731 @@
+/* Copyright (c) 2012, The Linux Foundataion. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#define LOG_TAG "QCameraDumpWriter"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utils/Log.h>
+#include <utils/Errors.h>
+#include <cutils/properties.h>
+
+#include "QCamera2HWI.h"
+#include "QCameraDumpWriter.h"
+
+/* frame copies are page aligned and padded so they can be written with O_DIRECT */
+#define DUMP_BUF_ALIGN 4096
+
+namespace android {
+
+/*===========================================================================
+ * FUNCTION   : dumpTypeToIdx
+ *
+ * DESCRIPTION: map a QCAMERA_DUMP_FRM_* bit to an array index
+ *
+ * PARAMETERS :
+ *   @dump_type : type of the frame
+ *
+ * RETURN     : index, -1 if dump_type is not a single known type
+ *==========================================================================*/
+static int dumpTypeToIdx(int dump_type)
+{
+    for (int i = 0; i < QCAMERA_DUMP_FRM_TYPE_MAX; i++) {
+        if (dump_type == (1 << i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraDumpWriter
+ *
+ * DESCRIPTION: constructor of QCameraDumpWriter.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraDumpWriter::QCameraDumpWriter()
+    : m_writeQ(releaseFrame, this),
+      m_bActive(false),
+      m_nMaxPending(0),
+      m_nMaxPendingBytes(0),
+      m_nSkip(1),
+      m_nStartDelay(0),
+      m_nDuration(0),
+      m_bDirectIO(false),
+      m_nRingSize(0),
+      m_nPending(0),
+      m_nPendingBytes(0),
+      m_nRingHead(0),
+      m_nRingCnt(0),
+      m_nFreeCnt(0),
+      m_nQueued(0),
+      m_nWritten(0),
+      m_nDropped(0),
+      m_nErrors(0),
+      m_nBytesWritten(0),
+      m_nEnqueueTime(0),
+      m_nMaxWriteTime(0)
+{
+    memset(m_nFrameCnt, 0, sizeof(m_nFrameCnt));
+    memset(m_nFirstTs, 0, sizeof(m_nFirstTs));
+    memset(m_ring, 0, sizeof(m_ring));
+    memset(m_freeBufs, 0, sizeof(m_freeBufs));
+    pthread_mutex_init(&m_lock, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraDumpWriter
+ *
+ * DESCRIPTION: deconstructor of QCameraDumpWriter.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraDumpWriter::~QCameraDumpWriter()
+{
+    deinit();
+    pthread_mutex_destroy(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : init
+ *
+ * DESCRIPTION: read dump config and launch writer thread. Nothing is done
+ *              if no dump type is enabled.
+ *
+ * PARAMETERS :
+ *   @dumpMask : mask of enabled QCAMERA_DUMP_FRM_* types
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraDumpWriter::init(int dumpMask)
+{
+    char prop[PROPERTY_VALUE_MAX];
+
+    if (m_bActive || dumpMask == 0) {
+        return NO_ERROR;
+    }
+
+    // max frames and MB waiting for the writer before frames are dropped
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dumpimg.queue", prop, "8");
+    m_nMaxPending = atoi(prop) > 0 ? atoi(prop) : 1;
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dumpimg.queue_mb", prop, "64");
+    m_nMaxPendingBytes = (atoi(prop) > 0 ? atoi(prop) : 1) << 20;
+
+    // sampling: every Nth frame, within [start, start + duration) ms
+    // after the first frame of each dump type
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dumpimg.skip", prop, "1");
+    m_nSkip = atoi(prop) > 1 ? atoi(prop) : 1;
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dumpimg.start_ms", prop, "0");
+    m_nStartDelay = milliseconds_to_nanoseconds(atoi(prop));
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dumpimg.duration_ms", prop, "0");
+    m_nDuration = milliseconds_to_nanoseconds(atoi(prop));
+
+    // keep last K frames in memory, written only when HAL dump() is called
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dumpimg.ring", prop, "0");
+    m_nRingSize = atoi(prop) > 0 ? atoi(prop) : 0;
+    if (m_nRingSize > MAX_DUMP_RING_FRAMES) {
+        m_nRingSize = MAX_DUMP_RING_FRAMES;
+    }
+
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dumpimg.direct", prop, "0");
+    m_bDirectIO = atoi(prop) > 0;
+
+    memset(m_nFrameCnt, 0, sizeof(m_nFrameCnt));
+    memset(m_nFirstTs, 0, sizeof(m_nFirstTs));
+    m_nPending = m_nPendingBytes = 0;
+    m_nRingHead = m_nRingCnt = 0;
+
+    ALOGI("%s: mask 0x%x, queue %d/%d MB, skip %d, window %lld+%lld ms, "
+          "ring %d, direct %d", __func__, dumpMask, m_nMaxPending,
+          m_nMaxPendingBytes >> 20, m_nSkip,
+          (long long)nanoseconds_to_milliseconds(m_nStartDelay),
+          (long long)nanoseconds_to_milliseconds(m_nDuration),
+          m_nRingSize, m_bDirectIO);
+
+    pthread_mutex_lock(&m_lock);
+    m_bActive = true;
+    pthread_mutex_unlock(&m_lock);
+    m_writeTh.launch(writerRoutine, this);
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : deinit
+ *
+ * DESCRIPTION: stop writer thread after the frames already queued are
+ *              written. Frames left in the ring are discarded. No frame
+ *              is queued once m_bActive is cleared under m_lock.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraDumpWriter::deinit()
+{
+    pthread_mutex_lock(&m_lock);
+    if (!m_bActive) {
+        pthread_mutex_unlock(&m_lock);
+        return NO_ERROR;
+    }
+    m_bActive = false;
+    pthread_mutex_unlock(&m_lock);
+
+    m_writeTh.exit();
+    // release frames the writer thread did not get to. Not through
+    // m_writeQ.flush(), which would free the recycled frame again.
+    void *left = NULL;
+    while (NULL != (left = m_writeQ.dequeue())) {
+        releaseFrame(left, this);
+    }
+
+    ALOGI("%s: queued %d, written %d (%llu KB), dropped %d, errors %d",
+          __func__, m_nQueued, m_nWritten,
+          (unsigned long long)(m_nBytesWritten >> 10), m_nDropped, m_nErrors);
+
+    pthread_mutex_lock(&m_lock);
+    for (uint32_t i = 0; i < m_nRingCnt; i++) {
+        qcamera_dump_frame_t *frame = m_ring[(m_nRingHead + i) % m_nRingSize];
+        free(frame->data);
+        free(frame);
+    }
+    m_nRingHead = m_nRingCnt = 0;
+    for (uint32_t i = 0; i < m_nFreeCnt; i++) {
+        free(m_freeBufs[i]->data);
+        free(m_freeBufs[i]);
+        m_freeBufs[i] = NULL;
+    }
+    m_nFreeCnt = 0;
+    pthread_mutex_unlock(&m_lock);
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : needDump
+ *
+ * DESCRIPTION: apply frame sampling. Must be called with m_lock held.
+ *
+ * PARAMETERS :
+ *   @type_idx : index of dump type
+ *
+ * RETURN     : true if the frame is to be dumped
+ *==========================================================================*/
+bool QCameraDumpWriter::needDump(int type_idx)
+{
+    uint32_t cnt = m_nFrameCnt[type_idx]++;
+    nsecs_t now = systemTime();
+
+    if (cnt == 0) {
+        m_nFirstTs[type_idx] = now;
+    }
+    if ((cnt % m_nSkip) != 0) {
+        return false;
+    }
+    nsecs_t elapsed = now - m_nFirstTs[type_idx];
+    if (elapsed < m_nStartDelay) {
+        return false;
+    }
+    if (m_nDuration > 0 && elapsed >= m_nStartDelay + m_nDuration) {
+        return false;
+    }
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : dumpFrame
+ *
+ * DESCRIPTION: copy a frame and queue it for writing, or keep it in the
+ *              ring. Never blocks on file io; the frame is dropped if the
+ *              write queue is full or the writer is stopped meanwhile.
+ *
+ * PARAMETERS :
+ *   @data      : data ptr
+ *   @size      : length of data buffer
+ *   @index     : identifier for data
+ *   @dump_type : type of the frame (QCAMERA_DUMP_FRM_*)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::dumpFrame(const void *data, uint32_t size,
+                                  int index, int dump_type)
+{
+    nsecs_t start = systemTime();
+    int type_idx = dumpTypeToIdx(dump_type);
+    qcamera_dump_frame_t *frame = NULL;
+
+    if (type_idx < 0 || NULL == data || 0 == size) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (!m_bActive || !needDump(type_idx)) {
+        pthread_mutex_unlock(&m_lock);
+        return;
+    }
+    if (0 == m_nRingSize) {
+        // reserve room in write queue, one frame is always allowed
+        if (m_nPending >= m_nMaxPending ||
+            (m_nPending > 0 && m_nPendingBytes + size > m_nMaxPendingBytes)) {
+            m_nDropped++;
+            pthread_mutex_unlock(&m_lock);
+            ALOGD("%s: write queue full, drop %d_%d", __func__, dump_type, index);
+            return;
+        }
+        m_nPending++;
+        m_nPendingBytes += size;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    // copy outside of lock, other stream threads keep going
+    frame = getFrameBuf(size);
+    if (NULL == frame) {
+        ALOGE("%s: no memory for frame copy of %d bytes", __func__, size);
+        pthread_mutex_lock(&m_lock);
+        m_nDropped++;
+        if (0 == m_nRingSize) {
+            m_nPending--;
+            m_nPendingBytes -= size;
+        }
+        pthread_mutex_unlock(&m_lock);
+        return;
+    }
+    memcpy(frame->data, data, size);
+    frame->size = size;
+    frame->index = index;
+    frame->dump_type = dump_type;
+
+    if (0 == m_nRingSize) {
+        // queue under lock, so deinit cannot stop the writer in between
+        bool active = false;
+        bool queued = false;
+        pthread_mutex_lock(&m_lock);
+        active = m_bActive;
+        if (active && m_writeQ.enqueue((void *)frame)) {
+            m_writeTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+            queued = true;
+        }
+        if (!active) {
+            m_nPending--;
+            m_nPendingBytes -= size;
+        }
+        pthread_mutex_unlock(&m_lock);
+        if (!active) {
+            // free bufs are already released by deinit
+            free(frame->data);
+            free(frame);
+            return;
+        }
+        if (!queued) {
+            writeDone(frame);
+            return;
+        }
+    } else {
+        qcamera_dump_frame_t *oldest = NULL;
+        pthread_mutex_lock(&m_lock);
+        if (!m_bActive) {
+            // ring is already released by deinit
+            pthread_mutex_unlock(&m_lock);
+            free(frame->data);
+            free(frame);
+            return;
+        }
+        if (m_nRingCnt == m_nRingSize) {
+            oldest = m_ring[m_nRingHead];
+            m_nRingHead = (m_nRingHead + 1) % m_nRingSize;
+            m_nRingCnt--;
+        }
+        m_ring[(m_nRingHead + m_nRingCnt) % m_nRingSize] = frame;
+        m_nRingCnt++;
+        pthread_mutex_unlock(&m_lock);
+        if (NULL != oldest) {
+            putFrameBuf(oldest);
+        }
+    }
+
+    pthread_mutex_lock(&m_lock);
+    m_nQueued++;
+    m_nEnqueueTime += systemTime() - start;
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : flushRing
+ *
+ * DESCRIPTION: queue all frames held in the ring for writing
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraDumpWriter::flushRing()
+{
+    qcamera_dump_frame_t *frames[MAX_DUMP_RING_FRAMES];
+    uint32_t cnt;
+
+    if (0 == m_nRingSize) {
+        return NO_ERROR;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (!m_bActive) {
+        pthread_mutex_unlock(&m_lock);
+        return NO_ERROR;
+    }
+    cnt = m_nRingCnt;
+    for (uint32_t i = 0; i < cnt; i++) {
+        frames[i] = m_ring[(m_nRingHead + i) % m_nRingSize];
+        m_nPending++;
+        m_nPendingBytes += frames[i]->size;
+    }
+    m_nRingHead = m_nRingCnt = 0;
+
+    ALOGI("%s: writing %d frames from dump ring", __func__, cnt);
+    uint32_t queued = 0;
+    for (; queued < cnt; queued++) {
+        if (!m_writeQ.enqueue((void *)frames[queued])) {
+            break;
+        }
+        m_writeTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    for (uint32_t i = queued; i < cnt; i++) {
+        writeDone(frames[i]);
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: write dump writer config and statistics to fd
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to dump into
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::dump(int fd)
+{
+    char buf[256];
+    int len;
+
+    pthread_mutex_lock(&m_lock);
+    if (!m_bActive) {
+        pthread_mutex_unlock(&m_lock);
+        return;
+    }
+    len = snprintf(buf, sizeof(buf),
+            "Frame dump: queued %d, written %d (%llu KB), dropped %d, "
+            "errors %d, pending %d, ring %d/%d\n",
+            m_nQueued, m_nWritten, (unsigned long long)(m_nBytesWritten >> 10),
+            m_nDropped, m_nErrors, m_nPending, m_nRingCnt, m_nRingSize);
+    write(fd, buf, len);
+    len = snprintf(buf, sizeof(buf),
+            "  avg enqueue %lld us, max write %lld us\n",
+            (long long)(m_nQueued ?
+                nanoseconds_to_microseconds(m_nEnqueueTime / m_nQueued) : 0),
+            (long long)nanoseconds_to_microseconds(m_nMaxWriteTime));
+    write(fd, buf, len);
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : getFrameBuf
+ *
+ * DESCRIPTION: get a frame copy buffer of at least size bytes, recycled
+ *              if possible
+ *
+ * PARAMETERS :
+ *   @size    : needed size
+ *
+ * RETURN     : frame buffer, NULL if out of memory
+ *==========================================================================*/
+qcamera_dump_frame_t *QCameraDumpWriter::getFrameBuf(uint32_t size)
+{
+    qcamera_dump_frame_t *frame = NULL;
+    uint32_t cap = (size + DUMP_BUF_ALIGN - 1) & ~(DUMP_BUF_ALIGN - 1);
+
+    pthread_mutex_lock(&m_lock);
+    for (uint32_t i = 0; i < m_nFreeCnt; i++) {
+        if (m_freeBufs[i]->cap >= cap) {
+            frame = m_freeBufs[i];
+            m_freeBufs[i] = m_freeBufs[--m_nFreeCnt];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    if (NULL != frame) {
+        return frame;
+    }
+
+    frame = (qcamera_dump_frame_t *)malloc(sizeof(qcamera_dump_frame_t));
+    if (NULL == frame) {
+        return NULL;
+    }
+    memset(frame, 0, sizeof(qcamera_dump_frame_t));
+    if (posix_memalign(&frame->data, DUMP_BUF_ALIGN, cap) != 0) {
+        free(frame);
+        return NULL;
+    }
+    frame->cap = cap;
+    return frame;
+}
+
+/*===========================================================================
+ * FUNCTION   : putFrameBuf
+ *
+ * DESCRIPTION: return a frame copy buffer for recycling
+ *
+ * PARAMETERS :
+ *   @frame   : frame buffer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::putFrameBuf(qcamera_dump_frame_t *frame)
+{
+    pthread_mutex_lock(&m_lock);
+    if (m_nFreeCnt < MAX_DUMP_FREE_BUFS) {
+        m_freeBufs[m_nFreeCnt++] = frame;
+        frame = NULL;
+    }
+    pthread_mutex_unlock(&m_lock);
+    if (NULL != frame) {
+        free(frame->data);
+        free(frame);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : writeDone
+ *
+ * DESCRIPTION: release a frame taken out of the write queue
+ *
+ * PARAMETERS :
+ *   @frame   : frame buffer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::writeDone(qcamera_dump_frame_t *frame)
+{
+    pthread_mutex_lock(&m_lock);
+    m_nPending--;
+    m_nPendingBytes -= frame->size;
+    pthread_mutex_unlock(&m_lock);
+    putFrameBuf(frame);
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseFrame
+ *
+ * DESCRIPTION: release function for frames flushed from write queue
+ *
+ * PARAMETERS :
+ *   @data      : frame buffer
+ *   @user_data : ptr to QCameraDumpWriter
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::releaseFrame(void *data, void *user_data)
+{
+    QCameraDumpWriter *pme = (QCameraDumpWriter *)user_data;
+    if (NULL != pme && NULL != data) {
+        pme->writeDone((qcamera_dump_frame_t *)data);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : writeFrame
+ *
+ * DESCRIPTION: write one frame into its dump file under /data
+ *
+ * PARAMETERS :
+ *   @frame   : frame buffer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::writeFrame(qcamera_dump_frame_t *frame)
+{
+    char buf[32];
+    nsecs_t start = systemTime();
+    uint32_t len = frame->size;
+    uint32_t written = 0;
+    int file_fd = -1;
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    switch (frame->dump_type) {
+    case QCAMERA_DUMP_FRM_PREVIEW:
+        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "preview", frame->index, "yuv");
+        break;
+    case QCAMERA_DUMP_FRM_THUMBNAIL:
+        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "thumbnail", frame->index, "yuv");
+        break;
+    case QCAMERA_DUMP_FRM_SNAPSHOT:
+        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "main", frame->index, "yuv");
+        break;
+    case QCAMERA_DUMP_FRM_VIDEO:
+        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "video", frame->index, "yuv");
+        break;
+    case QCAMERA_DUMP_FRM_RAW:
+        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "raw", frame->index, "raw");
+        break;
+    case QCAMERA_DUMP_FRM_JPEG:
+        snprintf(buf, sizeof(buf), "/data/%s_%d.%s", "jpeg", frame->index, "jpg");
+        break;
+    default:
+        ALOGE("%s: Not supported for dumping stream type %d", __func__, frame->dump_type);
+        return;
+    }
+
+    if (m_bDirectIO) {
+        // O_DIRECT needs block multiples, write the padded copy and trim
+        file_fd = open(buf, flags | O_DIRECT, 0777);
+        if (file_fd >= 0) {
+            len = frame->cap;
+        }
+    }
+    if (file_fd < 0) {
+        file_fd = open(buf, flags, 0777);
+    }
+    if (file_fd < 0) {
+        ALOGE("%s: open %s failed (%s)", __func__, buf, strerror(errno));
+        pthread_mutex_lock(&m_lock);
+        m_nErrors++;
+        pthread_mutex_unlock(&m_lock);
+        return;
+    }
+
+    while (written < len) {
+        ssize_t ret = write(file_fd, (uint8_t *)frame->data + written, len - written);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            ALOGE("%s: write %s failed (%s)", __func__, buf, strerror(errno));
+            break;
+        }
+        written += ret;
+    }
+    if (len != frame->size && ftruncate(file_fd, frame->size) != 0) {
+        ALOGE("%s: truncate %s failed (%s)", __func__, buf, strerror(errno));
+    }
+    close(file_fd);
+    ALOGD("%s: dump %s size =%d", __func__, buf, frame->size);
+
+    nsecs_t duration = systemTime() - start;
+    pthread_mutex_lock(&m_lock);
+    if (written < len) {
+        m_nErrors++;
+    } else {
+        m_nWritten++;
+        m_nBytesWritten += frame->size;
+    }
+    if (duration > m_nMaxWriteTime) {
+        m_nMaxWriteTime = duration;
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : writerRoutine
+ *
+ * DESCRIPTION: writer thread routine. Frames still queued on exit are
+ *              written before the thread returns.
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr (QCameraDumpWriter)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCameraDumpWriter::writerRoutine(void *data)
+{
+    int running = 1;
+    int ret;
+    QCameraDumpWriter *pme = (QCameraDumpWriter *)data;
+    QCameraCmdThread *cmdThread = &pme->m_writeTh;
+    qcamera_dump_frame_t *frame = NULL;
+
+    ALOGD("%s: E", __func__);
+    do {
+        do {
+            ret = sem_wait(&cmdThread->cmd_sem);
+            if (ret != 0 && errno != EINVAL) {
+                ALOGE("%s: sem_wait error (%s)",
+                           __func__, strerror(errno));
+                return NULL;
+            }
+        } while (ret != 0);
+
+        // we got notified about new cmd avail in cmd queue
+        camera_cmd_type_t cmd = cmdThread->getCmd();
+        switch (cmd) {
+        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
+            frame = (qcamera_dump_frame_t *)pme->m_writeQ.dequeue();
+            if (NULL != frame) {
+                pme->writeFrame(frame);
+                pme->writeDone(frame);
+            }
+            break;
+        case CAMERA_CMD_TYPE_EXIT:
+            while (NULL != (frame = (qcamera_dump_frame_t *)pme->m_writeQ.dequeue())) {
+                pme->writeFrame(frame);
+                pme->writeDone(frame);
+            }
+            running = 0;
+            break;
+        default:
+            break;
+        }
+    } while (running);
+    ALOGD("%s: X", __func__);
+    return NULL;
+}
+
+}; // namespace android
@@ -0,0 +1,119 @@
+/* Copyright (c) 2012, The Linux Foundataion. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_DUMP_WRITER_H__
+#define __QCAMERA_DUMP_WRITER_H__
+
+#include <pthread.h>
+#include <utils/Timers.h>
+#include "QCameraQueue.h"
+#include "QCameraCmdThread.h"
+
+namespace android {
+
+/* num of QCAMERA_DUMP_FRM_* types */
+#define QCAMERA_DUMP_FRM_TYPE_MAX    6
+/* max num of frames kept in the dump ring */
+#define MAX_DUMP_RING_FRAMES         32
+/* max num of recycled frame copies */
+#define MAX_DUMP_FREE_BUFS           8
+
+typedef struct {
+    int dump_type;          // QCAMERA_DUMP_FRM_*
+    int index;              // frame identifier used in file name
+    uint32_t size;          // valid bytes in data
+    uint32_t cap;           // allocated bytes of data
+    void *data;             // copy of the frame
+} qcamera_dump_frame_t;
+
+// Writes frame dumps enabled by persist.camera.dumpimg on its own thread.
+// Frames are copied on enqueue so stream buffers go back to the driver
+// right away. When the write queue is full frames are dropped instead of
+// stalling the stream callback. Frames can be sampled (every Nth frame,
+// time window per dump type) or kept in a ring of the last K frames that
+// is only written on demand (HAL dump()).
+class QCameraDumpWriter {
+public:
+    QCameraDumpWriter();
+    virtual ~QCameraDumpWriter();
+
+    int32_t init(int dumpMask);
+    int32_t deinit();
+    void dumpFrame(const void *data, uint32_t size, int index, int dump_type);
+    int32_t flushRing();
+    void dump(int fd);
+
+private:
+    static void *writerRoutine(void *data);
+    static void releaseFrame(void *data, void *user_data);
+
+    bool needDump(int type_idx);
+    qcamera_dump_frame_t *getFrameBuf(uint32_t size);
+    void putFrameBuf(qcamera_dump_frame_t *frame);
+    void writeFrame(qcamera_dump_frame_t *frame);
+    void writeDone(qcamera_dump_frame_t *frame);
+
+    QCameraQueue m_writeQ;              // frames waiting to be written
+    QCameraCmdThread m_writeTh;         // writer thread
+    pthread_mutex_t m_lock;             // protects state and stats below
+    bool m_bActive;
+
+    // config from persist.camera.dumpimg.* properties
+    uint32_t m_nMaxPending;             // max frames in write queue
+    uint32_t m_nMaxPendingBytes;        // max bytes in write queue
+    uint32_t m_nSkip;                   // dump every Nth frame of a type
+    nsecs_t m_nStartDelay;              // window start after first frame
+    nsecs_t m_nDuration;                // window length, 0 for no limit
+    bool m_bDirectIO;                   // write with O_DIRECT
+    uint32_t m_nRingSize;               // ring of last K frames, 0 for off
+
+    // state
+    uint32_t m_nPending;
+    uint32_t m_nPendingBytes;
+    uint32_t m_nFrameCnt[QCAMERA_DUMP_FRM_TYPE_MAX];
+    nsecs_t m_nFirstTs[QCAMERA_DUMP_FRM_TYPE_MAX];
+    qcamera_dump_frame_t *m_ring[MAX_DUMP_RING_FRAMES];
+    uint32_t m_nRingHead;               // oldest frame in ring
+    uint32_t m_nRingCnt;
+    qcamera_dump_frame_t *m_freeBufs[MAX_DUMP_FREE_BUFS];
+    uint32_t m_nFreeCnt;
+
+    // stats
+    uint32_t m_nQueued;
+    uint32_t m_nWritten;
+    uint32_t m_nDropped;
+    uint32_t m_nErrors;
+    uint64_t m_nBytesWritten;
+    nsecs_t m_nEnqueueTime;             // total time spent in dumpFrame
+    nsecs_t m_nMaxWriteTime;
+};
+
+}; // namespace android
+
+#endif /* __QCAMERA_DUMP_WRITER_H__ */
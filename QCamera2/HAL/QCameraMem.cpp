@@ -30,8 +30,11 @@
 #define LOG_TAG "QCameraHWI_Mem"
 
 #include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <cutils/properties.h>
 #include <utils/Log.h>
 #include <utils/Errors.h>
 #include <genlock.h>
@@ -45,11 +48,69 @@ extern "C" {
 
 namespace android {
 
+// process wide cache maintenance counters
+static pthread_mutex_t gCacheStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// bumped whenever a buffer is freed, see getBufGeneration
+static uint32_t gBufGeneration = 0;
+static struct {
+    uint64_t ops;           // cache ops issued to ion
+    uint64_t skipped;       // cache ops dropped by cache policy
+    uint64_t bytes;         // bytes flushed or invalidated
+    uint64_t saved;         // bytes not touched thanks to policy and range
+    nsecs_t windowStart;
+    uint64_t windowBytes;
+    uint64_t bytesPerSec;   // rate over the last complete window
+    int logRate;            // persist.camera.cache.stats
+} gCacheStats = {0, 0, 0, 0, 0, 0, 0, -1};
+
+static void updateCacheStats(uint32_t bytes, uint32_t saved)
+{
+    nsecs_t now = systemTime();
+
+    pthread_mutex_lock(&gCacheStatsLock);
+    if (bytes > 0) {
+        gCacheStats.ops++;
+    } else {
+        gCacheStats.skipped++;
+    }
+    gCacheStats.bytes += bytes;
+    gCacheStats.saved += saved;
+    gCacheStats.windowBytes += bytes;
+    if (gCacheStats.windowStart == 0) {
+        gCacheStats.windowStart = now;
+    } else if (now - gCacheStats.windowStart >= seconds_to_nanoseconds(1)) {
+        gCacheStats.bytesPerSec = gCacheStats.windowBytes *
+                seconds_to_nanoseconds(1) / (now - gCacheStats.windowStart);
+        gCacheStats.windowBytes = 0;
+        gCacheStats.windowStart = now;
+        if (gCacheStats.logRate < 0) {
+            char prop[PROPERTY_VALUE_MAX];
+            memset(prop, 0, sizeof(prop));
+            property_get("persist.camera.cache.stats", prop, "0");
+            gCacheStats.logRate = atoi(prop);
+        }
+        if (gCacheStats.logRate > 0) {
+            ALOGD("cache ops: %llu KB/s, total %llu ops %llu KB, "
+                  "skipped %llu ops, saved %llu KB",
+                  (unsigned long long)(gCacheStats.bytesPerSec >> 10),
+                  (unsigned long long)gCacheStats.ops,
+                  (unsigned long long)(gCacheStats.bytes >> 10),
+                  (unsigned long long)gCacheStats.skipped,
+                  (unsigned long long)(gCacheStats.saved >> 10));
+        }
+    }
+    pthread_mutex_unlock(&gCacheStatsLock);
+}
+
 // QCaemra2Memory base class
 
 QCameraMemory::QCameraMemory()
 {
     mBufferCount = 0;
+    mHeapId = 0;
+    mCachePolicy = QCAMERA_CACHE_POLICY_FULL;
+    mCacheLen = 0;
     for (int i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
         mMemInfo[i].fd = 0;
         mMemInfo[i].main_ion_fd = 0;
@@ -66,6 +127,7 @@ int QCameraMemory::cacheOpsInternal(int index, unsigned int cmd, void *vaddr)
 {
     struct ion_flush_data cache_inv_data;
     struct ion_custom_data custom_data;
+    uint32_t length;
     int ret = OK;
 
     if (index >= mBufferCount) {
@@ -73,16 +135,28 @@ int QCameraMemory::cacheOpsInternal(int index, unsigned int cmd, void *vaddr)
         return BAD_INDEX;
     }
 
+    cmd = filterCacheCmd(cmd);
+    if (cmd == 0) {
+        updateCacheStats(0, mMemInfo[index].size);
+        return OK;
+    }
+
+    // only the planes of the frame are touched, not the page/pool padding
+    length = mMemInfo[index].size;
+    if (mCacheLen > 0 && mCacheLen < length) {
+        length = mCacheLen;
+    }
+
     memset(&cache_inv_data, 0, sizeof(cache_inv_data));
     memset(&custom_data, 0, sizeof(custom_data));
     cache_inv_data.vaddr = vaddr;
     cache_inv_data.fd = mMemInfo[index].fd;
     cache_inv_data.handle = mMemInfo[index].handle;
-    cache_inv_data.length = mMemInfo[index].size;
+    cache_inv_data.length = length;
     custom_data.cmd = cmd;
     custom_data.arg = (unsigned long)&cache_inv_data;
 
-    ALOGD("addr = %p, fd = %d, handle = %p length = %d, ION Fd = %d",
+    ALOGV("addr = %p, fd = %d, handle = %p length = %d, ION Fd = %d",
          cache_inv_data.vaddr, cache_inv_data.fd,
          cache_inv_data.handle, cache_inv_data.length,
          mMemInfo[index].main_ion_fd);
@@ -90,9 +164,174 @@ int QCameraMemory::cacheOpsInternal(int index, unsigned int cmd, void *vaddr)
     if (ret < 0)
         ALOGE("%s: Cache Invalidate failed: %s\n", __func__, strerror(errno));
 
+    updateCacheStats(length, mMemInfo[index].size - length);
     return ret;
 }
 
+/*===========================================================================
+ * FUNCTION   : filterCacheCmd
+ *
+ * DESCRIPTION: reduce a requested cache op to what the cache policy needs
+ *
+ * PARAMETERS :
+ *   @cmd     : requested ION_IOC_*_CACHES op
+ *
+ * RETURN     : cache op to issue, 0 if none is needed
+ *==========================================================================*/
+unsigned int QCameraMemory::filterCacheCmd(unsigned int cmd) const
+{
+    switch (mCachePolicy) {
+    case QCAMERA_CACHE_POLICY_SKIP:
+        return 0;
+    case QCAMERA_CACHE_POLICY_CLEAN:
+        // no cpu reads, nothing to invalidate
+        if (cmd == ION_IOC_INV_CACHES)
+            return 0;
+        return ION_IOC_CLEAN_CACHES;
+    case QCAMERA_CACHE_POLICY_INVALIDATE:
+        // no cpu writes, no dirty lines to clean
+        if (cmd == ION_IOC_CLEAN_CACHES)
+            return 0;
+        return ION_IOC_INV_CACHES;
+    case QCAMERA_CACHE_POLICY_FULL:
+    default:
+        return cmd;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : cacheOpsBatch
+ *
+ * DESCRIPTION: do one cache op on a set of buffers in a single pass. The
+ *              policy is applied once for the whole set and duplicated
+ *              indices are only flushed once.
+ *
+ * PARAMETERS :
+ *   @indices : buffer indices
+ *   @count   : number of indices
+ *   @cmd     : ION_IOC_*_CACHES op
+ *
+ * RETURN     : 0 on success, last error otherwise
+ *==========================================================================*/
+int QCameraMemory::cacheOpsBatch(const int *indices, int count, unsigned int cmd)
+{
+    uint32_t done = 0;
+    int rc = OK;
+
+    if (filterCacheCmd(cmd) == 0) {
+        for (int i = 0; i < count; i++) {
+            if (indices[i] >= 0 && indices[i] < mBufferCount)
+                updateCacheStats(0, mMemInfo[indices[i]].size);
+        }
+        return OK;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int index = indices[i];
+        if (index < 0 || index >= mBufferCount) {
+            rc = BAD_INDEX;
+            continue;
+        }
+        if (done & (1U << index))
+            continue;
+        done |= (1U << index);
+        int ret = cacheOps(index, cmd);
+        if (ret < 0)
+            rc = ret;
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : prepareCpuRead
+ *
+ * DESCRIPTION: called before the cpu starts reading buffers of a memory
+ *              object set up with SKIP policy (e.g. preview callbacks
+ *              enabled while streaming). Switches to INVALIDATE policy and
+ *              invalidates the buffer about to be read. Other policies
+ *              already keep the buffers coherent, nothing to do for them.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer the cpu is going to read
+ *
+ * RETURN     : 0 on success, error from the cache op otherwise
+ *==========================================================================*/
+int QCameraMemory::prepareCpuRead(int index)
+{
+    if (mCachePolicy != QCAMERA_CACHE_POLICY_SKIP)
+        return OK;
+    mCachePolicy = QCAMERA_CACHE_POLICY_INVALIDATE;
+    return invalidateCache(index);
+}
+
+/*===========================================================================
+ * FUNCTION   : setCacheRange
+ *
+ * DESCRIPTION: limit cache ops to the planes of the frame layout
+ *
+ * PARAMETERS :
+ *   @offset  : frame len/offset info of the stream
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::setCacheRange(const cam_frame_len_offset_t &offset)
+{
+    uint32_t len = 0;
+
+    for (int i = 0; i < offset.num_planes && i < VIDEO_MAX_PLANES; i++) {
+        len += offset.mp[i].len;
+    }
+    if (len == 0 || len > offset.frame_len) {
+        len = offset.frame_len;
+    }
+    mCacheLen = len;
+}
+
+/*===========================================================================
+ * FUNCTION   : dumpCacheStats
+ *
+ * DESCRIPTION: write process wide cache maintenance counters to fd
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to dump into
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::dumpCacheStats(int fd)
+{
+    char buf[256];
+    int len;
+
+    pthread_mutex_lock(&gCacheStatsLock);
+    len = snprintf(buf, sizeof(buf),
+            "Cache ops: %llu KB/s, total %llu ops %llu KB, "
+            "skipped %llu ops, saved %llu KB\n",
+            (unsigned long long)(gCacheStats.bytesPerSec >> 10),
+            (unsigned long long)gCacheStats.ops,
+            (unsigned long long)(gCacheStats.bytes >> 10),
+            (unsigned long long)gCacheStats.skipped,
+            (unsigned long long)(gCacheStats.saved >> 10));
+    pthread_mutex_unlock(&gCacheStatsLock);
+    write(fd, buf, len);
+}
+
+/*===========================================================================
+ * FUNCTION   : getBufGeneration
+ *
+ * DESCRIPTION: get process wide generation of buffer allocations. It changes
+ *              every time a buffer is freed, after which its fd number and
+ *              mapping address may be handed out again for another buffer.
+ *              Users caching state per fd/vaddr drop it on a change.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : generation count
+ *==========================================================================*/
+uint32_t QCameraMemory::getBufGeneration()
+{
+    return __atomic_load_n(&gBufGeneration, __ATOMIC_ACQUIRE);
+}
+
 int QCameraMemory::getFd(int index) const
 {
     if (index >= mBufferCount)
@@ -141,9 +380,11 @@ void QCameraMemory::getBufDef(const cam_frame_len_offset_t &offset,
     }
 }
 
-int QCameraMemory::alloc(int count, int size, int heap_id)
+int QCameraMemory::alloc(int count, int size, int heap_id, void **vaddrs)
 {
     int rc = OK;
+    QCameraMemoryPool &pool = QCameraMemoryPool::getInstance();
+
     if (count > MM_CAMERA_MAX_NUM_FRAMES) {
         ALOGE("Buffer count %d out of bound. Max is %d", count, MM_CAMERA_MAX_NUM_FRAMES);
         return BAD_INDEX;
@@ -153,22 +394,46 @@ int QCameraMemory::alloc(int count, int size, int heap_id)
         return INVALID_OPERATION;
     }
 
+    mHeapId = heap_id;
     for (int i = 0; i < count; i ++) {
+        void *vaddr = NULL;
+        if (pool.get(mMemInfo[i], &vaddr, heap_id, size)) {
+            // pooled buffer, keep its mapping only if the caller wants one
+            if (vaddrs != NULL) {
+                vaddrs[i] = vaddr;
+            } else if (vaddr != NULL) {
+                munmap(vaddr, mMemInfo[i].size);
+            }
+            continue;
+        }
+        if (vaddrs != NULL) {
+            vaddrs[i] = NULL;
+        }
         rc = allocOneBuffer(mMemInfo[i], heap_id, size);
         if (rc < 0) {
             ALOGE("AllocateIonMemory failed");
-            for (int j = i-1; j >= 0; j--)
-                deallocOneBuffer(mMemInfo[j]);
+            for (int j = i-1; j >= 0; j--) {
+                pool.put(mMemInfo[j], vaddrs != NULL ? vaddrs[j] : NULL, heap_id);
+                if (vaddrs != NULL) {
+                    vaddrs[j] = NULL;
+                }
+            }
             break;
         }
     }
     return rc;
 }
 
-void QCameraMemory::dealloc()
+void QCameraMemory::dealloc(void **vaddrs)
 {
-    for (int i = 0; i < mBufferCount; i++)
-        deallocOneBuffer(mMemInfo[i]);
+    QCameraMemoryPool &pool = QCameraMemoryPool::getInstance();
+
+    for (int i = 0; i < mBufferCount; i++) {
+        pool.put(mMemInfo[i], vaddrs != NULL ? vaddrs[i] : NULL, mHeapId);
+        if (vaddrs != NULL) {
+            vaddrs[i] = NULL;
+        }
+    }
 }
 
 int QCameraMemory::allocOneBuffer(QCameraMemInfo &memInfo, int heap_id, int size)
@@ -240,6 +505,253 @@ void QCameraMemory::deallocOneBuffer(QCameraMemInfo &memInfo)
     }
     memInfo.handle = NULL;
     memInfo.size = 0;
+    __atomic_add_fetch(&gBufGeneration, 1, __ATOMIC_RELEASE);
+}
+
+// QCameraMemoryPool, process wide cache of free ION buffers
+
+QCameraMemoryPool &QCameraMemoryPool::getInstance()
+{
+    static QCameraMemoryPool sPool;
+    return sPool;
+}
+
+QCameraMemoryPool::QCameraMemoryPool()
+{
+    char prop[PROPERTY_VALUE_MAX];
+
+    pthread_mutex_init(&mLock, NULL);
+    memset(mEntries, 0, sizeof(mEntries));
+    mNumEntries = 0;
+    mCachedBytes = 0;
+    mPeakCachedBytes = 0;
+    mHits = mMisses = mReturns = mEvictions = 0;
+    mHitBytes = mMissBytes = 0;
+
+    // budget of free buffers kept warm, in MB. 0 disables the pool
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.mem.pool.mb", prop, "96");
+    mMaxBytes = (size_t)atoi(prop) << 20;
+
+    // free buffers not reused within this time are given back to ION
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.mem.pool.keepms", prop, "10000");
+    mKeepWarmNs = milliseconds_to_nanoseconds(atoi(prop));
+}
+
+QCameraMemoryPool::~QCameraMemoryPool()
+{
+    flush();
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : get
+ *
+ * DESCRIPTION: take a free buffer of the same heap from the pool. Best fit
+ *              is used, a buffer may be at most 1/8 larger than requested
+ *              so that one resolution bucket does not hold the next.
+ *
+ * PARAMETERS :
+ *   @memInfo : filled with the pooled buffer on hit
+ *   @vaddr   : filled with the HAL mapping of the buffer, NULL if unmapped
+ *   @heap_id : ion heap mask the buffer has to come from
+ *   @size    : requested size
+ *
+ * RETURN     : true on pool hit, false if caller has to allocate from ION
+ *==========================================================================*/
+bool QCameraMemoryPool::get(QCameraMemory::QCameraMemInfo &memInfo,
+        void **vaddr, int heap_id, int size)
+{
+    uint32_t len = (size + 4095) & (~4095);
+    uint32_t maxLen = len + len / 8;
+    int best = -1;
+
+    pthread_mutex_lock(&mLock);
+    trimLocked(mMaxBytes, systemTime());
+    for (int i = 0; i < mNumEntries; i++) {
+        PoolEntry &e = mEntries[i];
+        if (e.heap_id != heap_id || e.info.size < len || e.info.size > maxLen) {
+            continue;
+        }
+        // smallest fit, most recently returned on ties (still cache warm)
+        if (best < 0 || e.info.size < mEntries[best].info.size ||
+            (e.info.size == mEntries[best].info.size &&
+             e.idle_ts > mEntries[best].idle_ts)) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        mMisses++;
+        mMissBytes += len;
+        pthread_mutex_unlock(&mLock);
+        return false;
+    }
+
+    memInfo = mEntries[best].info;
+    *vaddr = mEntries[best].vaddr;
+    mCachedBytes -= memInfo.size;
+    mNumEntries--;
+    memmove(&mEntries[best], &mEntries[best + 1],
+            (mNumEntries - best) * sizeof(PoolEntry));
+    mHits++;
+    mHitBytes += memInfo.size;
+    pthread_mutex_unlock(&mLock);
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : put
+ *
+ * DESCRIPTION: return a buffer to the pool. Ownership of the ion handle,
+ *              fds and mapping moves to the pool and memInfo is cleared.
+ *              Oldest buffers are released when the budget is exceeded.
+ *
+ * PARAMETERS :
+ *   @memInfo : buffer to return
+ *   @vaddr   : HAL mapping of the buffer, or NULL
+ *   @heap_id : ion heap mask the buffer was allocated from
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::put(QCameraMemory::QCameraMemInfo &memInfo,
+        void *vaddr, int heap_id)
+{
+    if (memInfo.main_ion_fd <= 0) {
+        return;
+    }
+
+    if (vaddr != NULL) {
+        // write back CPU lines now, so they can not land on top of data the
+        // next owner's hardware writes into this buffer
+        struct ion_flush_data flush_data;
+        struct ion_custom_data custom_data;
+        memset(&flush_data, 0, sizeof(flush_data));
+        memset(&custom_data, 0, sizeof(custom_data));
+        flush_data.vaddr = vaddr;
+        flush_data.fd = memInfo.fd;
+        flush_data.handle = memInfo.handle;
+        flush_data.length = memInfo.size;
+        custom_data.cmd = ION_IOC_CLEAN_INV_CACHES;
+        custom_data.arg = (unsigned long)&flush_data;
+        if (ioctl(memInfo.main_ion_fd, ION_IOC_CUSTOM, &custom_data) < 0) {
+            ALOGE("%s: cache flush failed: %s", __func__, strerror(errno));
+        }
+    }
+
+    pthread_mutex_lock(&mLock);
+    mReturns++;
+    if (memInfo.size > mMaxBytes) {
+        pthread_mutex_unlock(&mLock);
+        if (vaddr != NULL) {
+            munmap(vaddr, memInfo.size);
+        }
+        QCameraMemory::deallocOneBuffer(memInfo);
+        return;
+    }
+
+    trimLocked(mMaxBytes - memInfo.size, systemTime());
+    if (mNumEntries == QCAMERA_MEM_POOL_MAX_BUFS) {
+        releaseEntryLocked(0);
+        mEvictions++;
+    }
+    PoolEntry &e = mEntries[mNumEntries++];
+    e.info = memInfo;
+    e.vaddr = vaddr;
+    e.heap_id = heap_id;
+    e.idle_ts = systemTime();
+    mCachedBytes += memInfo.size;
+    if (mCachedBytes > mPeakCachedBytes) {
+        mPeakCachedBytes = mCachedBytes;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    memInfo.fd = 0;
+    memInfo.main_ion_fd = 0;
+    memInfo.handle = NULL;
+    memInfo.size = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : flush
+ *
+ * DESCRIPTION: release all free buffers back to ION and log pool stats
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::flush()
+{
+    pthread_mutex_lock(&mLock);
+    ALOGD("%s: hits %u (%llu KB), misses %u (%llu KB), returns %u, "
+          "evictions %u, peak %u KB", __func__,
+          mHits, (unsigned long long)(mHitBytes >> 10),
+          mMisses, (unsigned long long)(mMissBytes >> 10),
+          mReturns, mEvictions, (uint32_t)(mPeakCachedBytes >> 10));
+    while (mNumEntries > 0) {
+        releaseEntryLocked(mNumEntries - 1);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: write pool content and hit/miss statistics to fd
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to dump into
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::dump(int fd)
+{
+    char buf[256];
+    int len;
+
+    pthread_mutex_lock(&mLock);
+    len = snprintf(buf, sizeof(buf),
+            "ION buffer pool: %d free bufs, %u KB cached (peak %u KB, "
+            "budget %u KB, keep warm %lld ms)\n",
+            mNumEntries, (uint32_t)(mCachedBytes >> 10),
+            (uint32_t)(mPeakCachedBytes >> 10), (uint32_t)(mMaxBytes >> 10),
+            (long long)nanoseconds_to_milliseconds(mKeepWarmNs));
+    write(fd, buf, len);
+    len = snprintf(buf, sizeof(buf),
+            "  hits %u (%llu KB), misses %u (%llu KB), returns %u, "
+            "evictions %u\n",
+            mHits, (unsigned long long)(mHitBytes >> 10),
+            mMisses, (unsigned long long)(mMissBytes >> 10),
+            mReturns, mEvictions);
+    write(fd, buf, len);
+    pthread_mutex_unlock(&mLock);
+}
+
+void QCameraMemoryPool::releaseEntryLocked(int index)
+{
+    PoolEntry &e = mEntries[index];
+
+    mCachedBytes -= e.info.size;
+    if (e.vaddr != NULL) {
+        munmap(e.vaddr, e.info.size);
+    }
+    QCameraMemory::deallocOneBuffer(e.info);
+    // keep entries ordered by return time, oldest first
+    mNumEntries--;
+    memmove(&mEntries[index], &mEntries[index + 1],
+            (mNumEntries - index) * sizeof(PoolEntry));
+}
+
+// release buffers idle longer than the keep warm time, then oldest first
+// until no more than budget bytes are cached
+void QCameraMemoryPool::trimLocked(size_t budget, nsecs_t now)
+{
+    while (mNumEntries > 0 &&
+           (mCachedBytes > budget || now - mEntries[0].idle_ts > mKeepWarmNs)) {
+        releaseEntryLocked(0);
+        mEvictions++;
+    }
 }
 
 // QCameraHeapMemory for ion memory used internally in HAL.
@@ -266,37 +778,34 @@ void *QCameraHeapMemory::getPtr(int index)
 int QCameraHeapMemory::allocate(int count, int size)
 {
     int heap_mask = (0x1 << ION_CP_MM_HEAP_ID | 0x1 << ION_CAMERA_HEAP_ID);
-    int rc = alloc(count, size, heap_mask);
+    int rc = alloc(count, size, heap_mask, mPtr);
     if (rc < 0)
         return rc;
 
+    mBufferCount = count;
     for (int i = 0; i < count; i ++) {
+        // buffers from the pool come with their mapping
+        if (mPtr[i] != NULL)
+            continue;
         void *vaddr = mmap(NULL,
                     mMemInfo[i].size,
                     PROT_READ | PROT_WRITE,
                     MAP_SHARED,
                     mMemInfo[i].fd, 0);
         if (vaddr == MAP_FAILED) {
-            for (int j = i-1; j >= 0; j --) {
-                munmap(mPtr[i], mMemInfo[i].size);
-                rc = NO_MEMORY;
-                break;
-            }
-        } else
-            mPtr[i] = vaddr;
+            ALOGE("%s: mmap failed: %s", __func__, strerror(errno));
+            deallocate();
+            return NO_MEMORY;
+        }
+        mPtr[i] = vaddr;
     }
-    if (rc == 0)
-        mBufferCount = count;
     return OK;
 }
 
 void QCameraHeapMemory::deallocate()
 {
-    for (int i = 0; i < mBufferCount; i++) {
-        munmap(mPtr[i], mMemInfo[i].size);
-        mPtr[i] = NULL;
-    }
-    dealloc();
+    // mappings go back to the pool together with the buffers
+    dealloc(mPtr);
     mBufferCount = 0;
 }
 
@@ -446,8 +955,7 @@ void QCameraVideoMemory::deallocate()
         mMetadata[i]->release(mMetadata[i]);
         mMetadata[i] = NULL;
     }
-    QCameraStreamMemory::dealloc();
-    mBufferCount = 0;
+    QCameraStreamMemory::deallocate();
 }
 
 camera_memory_t *QCameraVideoMemory::getMemory(int index, bool metadata) const
@@ -509,6 +1017,14 @@ void QCameraGrallocMemory::setWindowInfo(preview_stream_ops_t *window,
     mFormat = format;
 }
 
+// true if buffers were dequeued with this window geometry
+bool QCameraGrallocMemory::isWindowInfo(preview_stream_ops_t *window,
+        int width, int height, int format) const
+{
+    return mWindow == window && mWidth == width &&
+           mHeight == height && mFormat == format;
+}
+
 int QCameraGrallocMemory::displayBuffer(int index)
 {
     int err = NO_ERROR;
@@ -752,6 +1268,7 @@ void QCameraGrallocMemory::deallocate()
         ALOGD("put buffer %d successfully", cnt);
     }
     mBufferCount = 0;
+    __atomic_add_fetch(&gBufGeneration, 1, __ATOMIC_RELEASE);
     ALOGI(" %s : X ",__FUNCTION__);
 }
 
@@ -764,11 +1281,9 @@ int QCameraGrallocMemory::cacheOps(int index, unsigned int cmd)
 
 int QCameraGrallocMemory::getRegFlags(uint8_t *regFlags) const
 {
-    int i = 0;
-    for (i = 0; i < mMinUndequeuedBuffers; i ++)
-        regFlags[i] = 0;
-    for (; i < mBufferCount; i ++)
-        regFlags[i] = 1;
+    // buffers held by the window are queued to kernel once displayed
+    for (int i = 0; i < mBufferCount; i ++)
+        regFlags[i] = (mLocalFlag[i] != BUFFER_NOT_OWNED) ? 1 : 0;
     return NO_ERROR;
 }
 
@@ -32,6 +32,8 @@
 
 #include <hardware/camera.h>
 #include <utils/Mutex.h>
+#include <utils/Timers.h>
+#include <pthread.h>
 
 extern "C" {
 #include <sys/types.h>
@@ -41,6 +43,14 @@ extern "C" {
 
 namespace android {
 
+// Which cache ops a memory object really needs, by who touches its buffers
+typedef enum {
+    QCAMERA_CACHE_POLICY_FULL,          // do cache ops as requested
+    QCAMERA_CACHE_POLICY_SKIP,          // cpu never touches the buffers
+    QCAMERA_CACHE_POLICY_CLEAN,         // cpu writes, hardware only reads
+    QCAMERA_CACHE_POLICY_INVALIDATE,    // hardware writes, cpu only reads
+} qcamera_cache_policy_t;
+
 // Base class for all memory types. Abstract.
 class QCameraMemory {
 
@@ -48,6 +58,13 @@ public:
     int cleanCache(int index) {return cacheOps(index, ION_IOC_CLEAN_CACHES);}
     int invalidateCache(int index) {return cacheOps(index, ION_IOC_INV_CACHES);}
     int cleanInvalidateCache(int index) {return cacheOps(index, ION_IOC_CLEAN_INV_CACHES);}
+    int cacheOpsBatch(const int *indices, int count, unsigned int cmd);
+    void setCachePolicy(qcamera_cache_policy_t policy) {mCachePolicy = policy;}
+    qcamera_cache_policy_t getCachePolicy() const {return mCachePolicy;}
+    void setCacheRange(const cam_frame_len_offset_t &offset);
+    int prepareCpuRead(int index);
+    static void dumpCacheStats(int fd);
+    static uint32_t getBufGeneration();
     int getFd(int index) const;
     int getSize(int index) const;
     int getCnt() const;
@@ -66,6 +83,8 @@ public:
                 mm_camera_buf_def_t &bufDef, int index) const;
 
 protected:
+    friend class QCameraMemoryPool;
+
     struct QCameraMemInfo {
         int fd;
         int main_ion_fd;
@@ -73,16 +92,68 @@ protected:
         uint32_t size;
     };
 
-    int alloc(int count, int size, int heap_id);
-    void dealloc();
-    int allocOneBuffer(struct QCameraMemInfo &memInfo, int heap_id, int size);
-    void deallocOneBuffer(struct QCameraMemInfo &memInfo);
+    // vaddrs (optional) receives/hands back mappings of pooled buffers
+    int alloc(int count, int size, int heap_id, void **vaddrs = NULL);
+    void dealloc(void **vaddrs = NULL);
+    static int allocOneBuffer(struct QCameraMemInfo &memInfo, int heap_id, int size);
+    static void deallocOneBuffer(struct QCameraMemInfo &memInfo);
     int cacheOpsInternal(int index, unsigned int cmd, void *vaddr);
+    unsigned int filterCacheCmd(unsigned int cmd) const;
 
     int mBufferCount;
+    int mHeapId;
+    qcamera_cache_policy_t mCachePolicy;
+    uint32_t mCacheLen;         // bytes touched per buffer, 0 for full buffer
     struct QCameraMemInfo mMemInfo[MM_CAMERA_MAX_NUM_FRAMES];
 };
 
+#define QCAMERA_MEM_POOL_MAX_BUFS 64
+
+// Process wide pool of free ION buffers. QCameraMemory::alloc draws from it
+// and QCameraMemory::dealloc returns to it, so buffers released when a
+// channel is deleted are reused by the next one (e.g. preview -> video ->
+// ZSL switches) instead of being freed and allocated from ION again.
+// Free buffers are kept warm up to a byte budget and an idle timeout.
+class QCameraMemoryPool {
+public:
+    static QCameraMemoryPool &getInstance();
+
+    bool get(QCameraMemory::QCameraMemInfo &memInfo, void **vaddr,
+             int heap_id, int size);
+    void put(QCameraMemory::QCameraMemInfo &memInfo, void *vaddr, int heap_id);
+    void flush();
+    void dump(int fd);
+
+private:
+    struct PoolEntry {
+        QCameraMemory::QCameraMemInfo info;
+        void *vaddr;            // HAL mapping kept with the buffer, or NULL
+        int heap_id;
+        nsecs_t idle_ts;        // time the buffer was returned
+    };
+
+    QCameraMemoryPool();
+    ~QCameraMemoryPool();
+    void releaseEntryLocked(int index);
+    void trimLocked(size_t budget, nsecs_t now);
+
+    pthread_mutex_t mLock;
+    PoolEntry mEntries[QCAMERA_MEM_POOL_MAX_BUFS];
+    int mNumEntries;
+    size_t mCachedBytes;
+    size_t mMaxBytes;           // keep-warm budget, 0 disables pooling
+    nsecs_t mKeepWarmNs;        // free buffers idle longer are released
+
+    // statistics
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mReturns;
+    uint32_t mEvictions;
+    uint64_t mHitBytes;
+    uint64_t mMissBytes;
+    size_t mPeakCachedBytes;
+};
+
 // Internal heap memory is used for memories used internally
 // They are allocated from /dev/ion.
 class QCameraHeapMemory : public QCameraMemory {
@@ -158,6 +229,7 @@ public:
     virtual int getMatchBufIndex(const void *opaque, bool metadata) const;
 
     void setWindowInfo(preview_stream_ops_t *window, int width, int height, int format);
+    bool isWindowInfo(preview_stream_ops_t *window, int width, int height, int format) const;
     // Enqueue/display buffer[index] onto the native window,
     // and dequeue one buffer from it.
     // Returns the buffer index of the dequeued buffer.
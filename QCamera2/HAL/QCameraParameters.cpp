@@ -331,6 +331,16 @@ const QCameraParameters::QCameraMap QCameraParameters::TRUE_FALSE_MODES_MAP[] =
     { VALUE_TRUE,  1}
 };
 
+const QCameraParameters::QCameraParmHandler QCameraParameters::PARM_HANDLERS[] = {
+    { KEY_QC_AUTO_EXPOSURE,   NULL,             &QCameraParameters::setAutoExposure,     RESTART_NONE },
+    { KEY_PREVIEW_SIZE,       NULL,             &QCameraParameters::setPreviewSize,      RESTART_PREVIEW_STREAM },
+    { KEY_VIDEO_SIZE,         KEY_PREVIEW_SIZE, &QCameraParameters::setVideoSize,        RESTART_PREVIEW },
+    { KEY_PICTURE_SIZE,       NULL,             &QCameraParameters::setPictureSize,      RESTART_PREVIEW_IN_ZSL },
+    { KEY_PREVIEW_FORMAT,     NULL,             &QCameraParameters::setPreviewFormat,    RESTART_PREVIEW_STREAM },
+    { KEY_PICTURE_FORMAT,     NULL,             &QCameraParameters::setPictureFormat,    RESTART_PREVIEW_IN_ZSL },
+    { KEY_PREVIEW_FRAME_RATE, NULL,             &QCameraParameters::setPreviewFrameRate, RESTART_NONE },
+};
+
 #define DEFAULT_CAMERA_AREA "(0, 0, 0, 0, 0)"
 
 QCameraParameters::QCameraParameters()
@@ -343,6 +353,8 @@ QCameraParameters::QCameraParameters()
       m_bHistogramEnabled(false),
       m_bFaceDetectionEnabled(false),
       m_bDebugFps(false),
+      m_bZslFocusPriority(true),
+      m_bPreviewReconfigOnly(false),
       m_nDumpFrameEnabled(0),
       mFocusMode(CAM_FOCUS_MODE_MAX),
       mPreviewFormat(CAM_FORMAT_YUV_420_NV21)
@@ -353,6 +365,8 @@ QCameraParameters::QCameraParameters()
     m_bDebugFps = atoi(value) > 0 ? true : false;
     property_get("persist.camera.dumpimg", value, "0");
     m_nDumpFrameEnabled = atoi(value);
+    property_get("persist.camera.zsl.focus_prio", value, "1");
+    m_bZslFocusPriority = atoi(value) > 0 ? true : false;
 }
 
 QCameraParameters::QCameraParameters(const String8 &params)
@@ -364,6 +378,8 @@ QCameraParameters::QCameraParameters(const String8 &params)
       m_bHistogramEnabled(false),
       m_bFaceDetectionEnabled(false),
       m_bDebugFps(false),
+      m_bZslFocusPriority(true),
+      m_bPreviewReconfigOnly(false),
       m_nDumpFrameEnabled(0),
       mFocusMode(CAM_FOCUS_MODE_MAX),
       mPreviewFormat(CAM_FORMAT_YUV_420_NV21)
@@ -676,31 +692,113 @@ status_t QCameraParameters::setPreviewFrameRate(const QCameraParameters& params)
     return rc;
 }
 
-status_t QCameraParameters::updateParameters(QCameraParameters& params,
-                                                        bool &needRestart)
+// true if key is added, removed or has a new value in params
+bool QCameraParameters::isKeyChanged(const QCameraParameters& params,
+                                     const char *key) const
+{
+    const char *newVal = params.get(key);
+    const char *curVal = get(key);
+    if (newVal == NULL || curVal == NULL) {
+        return newVal != curVal;
+    }
+    return strcmp(newVal, curVal) != 0;
+}
+
+// true if a key read by the handler is changed in params
+bool QCameraParameters::isHandlerNeeded(const QCameraParameters& params,
+                                        const QCameraParmHandler &h) const
+{
+    if (isKeyChanged(params, h.key)) {
+        return true;
+    }
+    return h.altKey != NULL && params.get(h.key) == NULL &&
+           isKeyChanged(params, h.altKey);
+}
+
+// true if any changed key in params needs preview restart. Checked before
+// running any handler, so nothing is applied when restart is not allowed.
+bool QCameraParameters::checkRestart(const QCameraParameters& params) const
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(PARM_HANDLERS) / sizeof(PARM_HANDLERS[0]); i++) {
+        const QCameraParmHandler &h = PARM_HANDLERS[i];
+        if (h.restart == RESTART_NONE ||
+            (h.restart == RESTART_PREVIEW_IN_ZSL && !mZslMode)) {
+            continue;
+        }
+        if (isHandlerNeeded(params, h)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// run handlers of changed keys only; restart need comes from the handler table
+status_t QCameraParameters::applyChangedParameters(const QCameraParameters& params,
+                                                   bool &needRestart)
 {
     status_t final_rc = NO_ERROR;
     status_t rc;
+    size_t i;
+    bool streamOnly = true;
+
+    for (i = 0; i < sizeof(PARM_HANDLERS) / sizeof(PARM_HANDLERS[0]); i++) {
+        const QCameraParmHandler &h = PARM_HANDLERS[i];
+        if (!isHandlerNeeded(params, h)) {
+            continue;
+        }
+        ALOGV("%s: %s changed", __func__, h.key);
+        if ((rc = (this->*h.handler)(params))) {
+            final_rc = rc;
+            continue;
+        }
+        if (h.restart == RESTART_PREVIEW_STREAM) {
+            needRestart = true;
+        } else if (h.restart == RESTART_PREVIEW ||
+                   (h.restart == RESTART_PREVIEW_IN_ZSL && mZslMode)) {
+            needRestart = true;
+            streamOnly = false;
+        }
+    }
+    m_bPreviewReconfigOnly = needRestart && streamOnly;
+    return final_rc;
+}
+
+// parameters identical to the last ones applied are not even parsed.
+// If restartAllowed is false, parameters needing restart are rejected with
+// BAD_VALUE and none of the new values is applied.
+status_t QCameraParameters::updateParameters(const String8 &flattened,
+                                             bool &needRestart,
+                                             bool restartAllowed)
+{
+    status_t final_rc = NO_ERROR;
 
+    needRestart = false;
+    m_bPreviewReconfigOnly = false;
     parm_buffer_t *p_table = (parm_buffer_t*)DATA_PTR(m_pParamHeap,0);
     if(initBatchUpdateTable(p_table) < 0 ) {
         ALOGE("%s:Failed to initialize group update table",__func__);
-        rc = BAD_TYPE;
-        goto SET_PARAM_DONE;
+        return BAD_TYPE;
     }
 
-    if ((rc = setAutoExposure(params)))                 final_rc = rc;
-    if ((rc = setPreviewSize(params)))                  final_rc = rc;
-    if ((rc = setVideoSize(params)))                    final_rc = rc;
-    if ((rc = setPictureSize(params)))                  final_rc = rc;
-    if ((rc = setPreviewFormat(params)))                final_rc = rc;
-    if ((rc = setPictureFormat(params)))                final_rc = rc;
-    if ((rc = setPreviewFrameRate(params)))             final_rc = rc;
-
+    if (flattened == mLastFlattened) {
+        ALOGV("%s: parameters not changed", __func__);
+        return NO_ERROR;
+    }
 
-    //TODO
-    needRestart = false;
-SET_PARAM_DONE:
+    QCameraParameters params(flattened);
+    if (!restartAllowed && checkRestart(params)) {
+        ALOGE("%s: Cannot set parameters that requires restart", __func__);
+        needRestart = true;
+        return BAD_VALUE;
+    }
+    final_rc = applyChangedParameters(params, needRestart);
+    if (final_rc == NO_ERROR) {
+        mLastFlattened = flattened;
+    } else {
+        mLastFlattened.clear();
+    }
     return final_rc;
 }
 
@@ -1226,6 +1324,7 @@ void QCameraParameters::deinit()
     //clear all entries in the map
     String8 emptyStr;
     QCameraParameters::unflatten(emptyStr);
+    mLastFlattened.clear();
 
     if (NULL != m_pCamOpsTbl) {
         m_pCamOpsTbl->ops->unmap_buf(
@@ -1531,6 +1630,13 @@ int QCameraParameters::getZSLBackLookCount()
     return look_back;
 }
 
+mm_camera_super_buf_priority_t QCameraParameters::getZSLPriority()
+{
+    // focus priority needs metadata stream bundled in ZSL channel
+    return m_bZslFocusPriority ? MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS :
+                                 MM_CAMERA_SUPER_BUF_PRIORITY_NORMAL;
+}
+
 int QCameraParameters::setRecordingHintValue(bool /*value*/)
 {
     // TODO
@@ -1838,8 +1944,7 @@ cam_focus_mode_type QCameraParameters::getFocusMode()
 
 int32_t QCameraParameters::initBatchUpdateTable(parm_buffer_t *p_table)
 {
-    memset(p_table, 0, sizeof(parm_buffer_t));
-    p_table->first_flagged_entry = CAM_INTF_PARM_MAX;
+    cam_parm_batch_init(p_table);
     return NO_ERROR;
 }
 
@@ -1848,77 +1953,34 @@ int32_t QCameraParameters::AddSetParmEntryToBatch(parm_buffer_t *p_table,
                                                   uint32_t paramLength,
                                                   void *paramValue)
 {
-    int position = paramType;
-    int current, next;
-
-    /*************************************************************************
-    *                 Code to take care of linking next flags                *
-    *************************************************************************/
-    current = GET_FIRST_PARAM_ID(p_table);
-    if (position == current){
-        //DO NOTHING
-    } else if (position < current){
-        SET_NEXT_PARAM_ID(position, p_table, current);
-        SET_FIRST_PARAM_ID(p_table, position);
-    } else {
-        /* Search for the position in the linked list where we need to slot in*/
-        while (position > GET_NEXT_PARAM_ID(current, p_table))
-            current = GET_NEXT_PARAM_ID(current, p_table);
-
-        /*If node already exists no need to alter linking*/
-        if (position != GET_NEXT_PARAM_ID(current, p_table)) {
-            next = GET_NEXT_PARAM_ID(current, p_table);
-            SET_NEXT_PARAM_ID(current, p_table, position);
-            SET_NEXT_PARAM_ID(position, p_table, next);
-        }
-    }
-
-    /*************************************************************************
-    *                   Copy contents into entry                             *
-    *************************************************************************/
-
-    if (paramLength > sizeof(parm_type_t)) {
+    if (paramLength > cam_parm_value_size(paramType)) {
         ALOGE("%s:Size of input larger than max entry size",__func__);
         return BAD_VALUE;
     }
-    memcpy(POINTER_OF(paramType,p_table), paramValue, paramLength);
+    if (cam_parm_batch_set(p_table, paramType, paramLength, paramValue) != 0) {
+        ALOGE("%s:Failed to add parm %d to batch", __func__, paramType);
+        return BAD_VALUE;
+    }
     return NO_ERROR;
 }
 
 int32_t QCameraParameters::AddGetParmEntryToBatch(parm_buffer_t *p_table,
                                                   cam_intf_parm_type_t paramType)
 {
-    int position = paramType;
-    int current, next;
-
-    /*************************************************************************
-    *                 Code to take care of linking next flags                *
-    *************************************************************************/
-    current = GET_FIRST_PARAM_ID(p_table);
-    if (position == current){
-        //DO NOTHING
-    } else if (position < current){
-        SET_NEXT_PARAM_ID(position, p_table, current);
-        SET_FIRST_PARAM_ID(p_table, position);
-    } else {
-        /* Search for the position in the linked list where we need to slot in*/
-        while (position > GET_NEXT_PARAM_ID(current, p_table))
-            current = GET_NEXT_PARAM_ID(current, p_table);
-
-        /*If node already exists no need to alter linking*/
-        if (position != GET_NEXT_PARAM_ID(current, p_table)) {
-            next=GET_NEXT_PARAM_ID(current, p_table);
-            SET_NEXT_PARAM_ID(current, p_table, position);
-            SET_NEXT_PARAM_ID(position, p_table, next);
-        }
+    if (NULL == cam_parm_batch_add(p_table, paramType)) {
+        ALOGE("%s:Failed to add parm %d to batch", __func__, paramType);
+        return BAD_VALUE;
     }
-
     return NO_ERROR;
 }
 
 int32_t QCameraParameters::commitSetBatch()
 {
     parm_buffer_t *p_table = (parm_buffer_t*) DATA_PTR(m_pParamHeap, 0);
+    if (p_table->used == 0) {
+        // nothing changed, spare the round trip to server
+        return NO_ERROR;
+    }
     return m_pCamOpsTbl->ops->set_parms(m_pCamOpsTbl->camera_handle, p_table);
 }
 
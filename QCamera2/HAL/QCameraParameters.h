@@ -266,7 +266,8 @@ public:
     void deinit();
     status_t assign(QCameraParameters& params);
     status_t initDefaultParameters();
-    status_t updateParameters(QCameraParameters&, bool &needRestart);
+    status_t updateParameters(const String8 &flattened, bool &needRestart,
+                              bool restartAllowed);
     status_t commitParameters();
     status_t setAutoExposure(const QCameraParameters& );
     status_t setPreviewSize(const QCameraParameters& );
@@ -286,7 +287,10 @@ public:
     int getZSLBurstInterval();
     int getZSLQueueDepth();
     int getZSLBackLookCount();
+    mm_camera_super_buf_priority_t getZSLPriority();
     bool isZSLMode() {return mZslMode;};
+    // restart asked by last update only needs preview stream reconfigured
+    bool isPreviewReconfigOnly() {return m_bPreviewReconfigOnly;};
     bool isNoDisplayMode();
     bool isWNREnabled();
     bool isSmoothZoomRunning();
@@ -331,6 +335,8 @@ private:
     String8 createFrameratesString(const cam_fps_range_t *fps, int len);
     String8 createZoomRatioValuesString(int *zoomRatios, int length);
     int lookupAttr(const QCameraMap arr[], int len, const char *name);
+    status_t applyChangedParameters(const QCameraParameters& params, bool &needRestart);
+    bool isKeyChanged(const QCameraParameters& params, const char *key) const;
 
     // ops for batch set/get params with server
     int initBatchUpdateTable(parm_buffer_t *p_table);
@@ -362,6 +368,25 @@ private:
     static const QCameraMap DENOISE_ON_OFF_MODES_MAP[];
     static const QCameraMap TRUE_FALSE_MODES_MAP[];
 
+    // Handlers of parameters from application. A handler is only run when
+    // one of the keys it reads changed since the last update.
+    typedef enum {
+        RESTART_NONE,           // takes effect without restarting preview
+        RESTART_PREVIEW_STREAM, // only preview stream is configured from it
+        RESTART_PREVIEW,        // preview streams are configured from it
+        RESTART_PREVIEW_IN_ZSL, // ZSL snapshot stream is configured from it
+    } ParmRestartType;
+    typedef struct {
+        const char *key;
+        const char *altKey;     // read by handler when key is absent, may be NULL
+        status_t (QCameraParameters::*handler)(const QCameraParameters&);
+        ParmRestartType restart;
+    } QCameraParmHandler;
+    static const QCameraParmHandler PARM_HANDLERS[];
+    bool isHandlerNeeded(const QCameraParameters& params,
+                         const QCameraParmHandler &h) const;
+    bool checkRestart(const QCameraParameters& params) const;
+
     cam_capability_t *m_pCapability;
     mm_camera_vtbl_t *m_pCamOpsTbl;
     QCameraHeapMemory *m_pParamHeap;
@@ -370,11 +395,15 @@ private:
     bool m_bHistogramEnabled;       // if histogram is enabled
     bool m_bFaceDetectionEnabled;   // if face detection is enabled
     bool m_bDebugFps;               // if FPS need to be logged
+    bool m_bZslFocusPriority;       // if ZSL queue prefers focused frames
+    bool m_bPreviewReconfigOnly;    // if restart can be done by reconfiguring preview stream
     int  m_nDumpFrameEnabled;       // mask for type of dumping enabled
     cam_focus_mode_type mFocusMode;
 
     cam_format_t mPreviewFormat;
     int32_t mFps;
+
+    String8 mLastFlattened;         // last parameters applied without error
 };
 
 }; // namespace android
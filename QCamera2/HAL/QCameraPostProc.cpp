@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <utils/Log.h>
 #include <utils/Errors.h>
+#include <cutils/properties.h>
 
 #include "QCamera2HWI.h"
 #include "QCameraPostProc.h"
@@ -57,9 +58,19 @@ QCameraPostProcessor::QCameraPostProcessor(QCamera2HardwareInterface *cam_ctrl)
       m_ongoingPPQ(releaseOngoingPPData, this),
       m_inputJpegQ(releaseJpegInputData, this),
       m_ongoingJpegQ(releaseOngoingJpegData, this),
-      m_dataNotifyQ(releaseOutputData, this)
+      m_dataNotifyQ(releaseOutputData, this),
+      m_nMaxJpegJobs(DEFAULT_JPEG_CONCURRENT_JOBS),
+      m_bJpegActive(false),
+      m_nJpegSubmitSeq(0),
+      m_nJpegDeliverSeq(0),
+      m_bJpegDelivering(false)
 {
     memset(&mJpegHandle, 0, sizeof(mJpegHandle));
+    memset(m_jpegDoneJobs, 0, sizeof(m_jpegDoneJobs));
+    memset(&m_jpegLatency, 0, sizeof(m_jpegLatency));
+    memset(m_jpegOutBufs, 0, sizeof(m_jpegOutBufs));
+    pthread_mutex_init(&m_jpegLock, NULL);
+    pthread_mutex_init(&m_jpegBufLock, NULL);
 }
 
 /*===========================================================================
@@ -73,6 +84,8 @@ QCameraPostProcessor::QCameraPostProcessor(QCamera2HardwareInterface *cam_ctrl)
  *==========================================================================*/
 QCameraPostProcessor::~QCameraPostProcessor()
 {
+    pthread_mutex_destroy(&m_jpegLock);
+    pthread_mutex_destroy(&m_jpegBufLock);
 }
 
 /*===========================================================================
@@ -90,9 +103,30 @@ QCameraPostProcessor::~QCameraPostProcessor()
  *==========================================================================*/
 int32_t QCameraPostProcessor::init(jpeg_encode_callback_t jpeg_cb, void *user_data)
 {
+    char prop[PROPERTY_VALUE_MAX];
+    int num_jobs;
+
     mJpegCB = jpeg_cb;
     mJpegUserData = user_data;
 
+    // num of jpeg jobs that can be encoded at the same time
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.jpeg.sessions", prop, "0");
+    num_jobs = atoi(prop);
+    if (num_jobs <= 0) {
+        num_jobs = DEFAULT_JPEG_CONCURRENT_JOBS;
+    } else if (num_jobs > MAX_JPEG_CONCURRENT_JOBS) {
+        num_jobs = MAX_JPEG_CONCURRENT_JOBS;
+    }
+    m_nMaxJpegJobs = num_jobs;
+
+    // static exif tags don't change within a session, build them only once
+    for (int i = 0; i < MAX_JPEG_CONCURRENT_JOBS; i++) {
+        m_jpegExif[i].clear();
+        m_parent->getStaticExifData(&m_jpegExif[i]);
+        m_jpegExif[i].setStaticEntries();
+    }
+
     //TODO: jpeg_open causes panic. Comment out for now.
 #if 0
     mJpegClientHandle = jpeg_open(&mJpegHandle);
@@ -124,6 +158,9 @@ int32_t QCameraPostProcessor::deinit()
     m_dataProcTh.exit();
     m_dataNotifyTh.exit();
 
+    // all jobs and callbacks are flushed by now, release pooled jpeg bufs
+    deinitJpegOutBufs();
+
     if(mJpegClientHandle > 0) {
         int rc = mJpegHandle.close(mJpegClientHandle);
         ALOGE("%s: Jpeg closed, rc = %d, mJpegClientHandle = %x",
@@ -169,6 +206,12 @@ int32_t QCameraPostProcessor::start()
         }
     }
 
+    // size jpeg output buf pool for current picture size. Failure is not
+    // fatal since bufs will be allocated on demand in encodeData.
+    if (initJpegOutBufs() != NO_ERROR) {
+        ALOGE("%s: cannot preallocate jpeg output bufs", __func__);
+    }
+
     m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC, FALSE, FALSE);
     m_dataNotifyTh.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC, FALSE, FALSE);
 
@@ -194,6 +237,9 @@ int32_t QCameraPostProcessor::stop()
     // dataProc Thread need to process "stop" as sync call because abort jpeg job should be a sync call
     m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC, TRUE, TRUE);
 
+    // report shot-to-shot latency of the jpegs delivered since start
+    dumpJpegLatency();
+
     if (m_parent->needOfflineReprocess()) {
         m_parent->stopChannel(QCAMERA_CH_TYPE_REPROCESS);
         m_parent->delChannel(QCAMERA_CH_TYPE_REPROCESS);
@@ -317,8 +363,6 @@ int32_t QCameraPostProcessor::processData(mm_camera_super_buf_t *frame)
 int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
 {
     int32_t rc = NO_ERROR;
-    QCameraHeapMemory *jpegMemObj = NULL;
-    camera_memory_t *jpeg_mem = NULL;
 
     // find job by jobId
     qcamera_jpeg_data_t *job = findJpegJobByJobId(evt->jobId);
@@ -326,45 +370,79 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
     if (job == NULL) {
         ALOGE("%s: Cannot find jpeg job by jobId(%d)", __func__, evt->jobId);
         rc = BAD_VALUE;
-        goto end;
+    } else {
+        job->status = evt->status;
+        job->thumbnailDroppedFlag = evt->thumbnailDroppedFlag;
+        job->data_size = evt->data_size;
+        job->done_ts = systemTime();
+
+        // jobs may finish out of order, delivery is done in order of submission
+        rc = completeJpegJob(job);
     }
 
+    // wait up data proc thread to do next job,
+    // if previous request is blocked due to ongoing jpeg job
+    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : sendJpegNotify
+ *
+ * DESCRIPTION: send encoded jpeg of a done job to upper layer through data
+ *              notify thread.
+ *
+ * PARAMETERS :
+ *   @job     : ptr to a done jpeg job
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraPostProcessor::sendJpegNotify(qcamera_jpeg_data_t *job)
+{
+    int32_t rc = NO_ERROR;
+    QCameraHeapMemory *jpegMemObj = NULL;
+    camera_memory_t *jpeg_mem = NULL;
+
     if (m_parent->mDataCb == NULL ||
         m_parent->msgTypeEnabled(CAMERA_MSG_COMPRESSED_IMAGE) == 0 ) {
         ALOGD("%s: No dataCB or CAMERA_MSG_COMPRESSED_IMAGE not enabled",
               __func__);
-        rc = NO_ERROR;
-        goto end;
+        return NO_ERROR;
     }
 
-    if(evt->status == JPEG_JOB_STATUS_ERROR) {
+    if(job->status == JPEG_JOB_STATUS_ERROR) {
         ALOGE("%s: Error event handled from jpeg, status = %d",
-              __func__, evt->status);
+              __func__, job->status);
         rc = FAILED_TRANSACTION;
         goto end;
     }
 
-    if(evt->thumbnailDroppedFlag) {
+    if(job->thumbnailDroppedFlag) {
         ALOGE("%s : Error in thumbnail encoding, thumbnail dropped",
               __func__);
     }
 
-    m_parent->dumpFrameToFile(evt->out_data,
-                              evt->data_size,
-                              evt->jobId,
+    m_parent->dumpFrameToFile(job->out_data,
+                              job->data_size,
+                              job->jobId,
                               QCAMERA_DUMP_FRM_JPEG);
-    ALOGD("%s: Dump jpeg_size=%d", __func__, evt->data_size);
+    ALOGD("%s: Dump jpeg_size=%d", __func__, job->data_size);
 
-    // alloc jpeg memory from heap
+    // copy the encoded jpeg out of the pooled ION buf into a fresh heap buf.
+    // upper layer may hold on to the callback memory after the data CB
+    // returns, while the pooled buf is reused by the next encode job.
     jpegMemObj = new QCameraHeapMemory();
-    if (NULL != jpegMemObj) {
+    if (NULL == jpegMemObj) {
         rc = NO_MEMORY;
         ALOGE("%s : new QCameraHeapMemory for jpeg, ret = NO_MEMORY",
               __func__);
         goto end;
     }
 
-    rc = jpegMemObj->allocate(1, evt->data_size);
+    rc = jpegMemObj->allocate(1, job->data_size);
     if(rc != OK) {
         rc = NO_MEMORY;
         ALOGE("%s : initHeapMem for jpeg, ret = NO_MEMORY", __func__);
@@ -377,7 +455,7 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
         ALOGE("%s : initHeapMem for jpeg, ret = NO_MEMORY", __func__);
         goto end;
     }
-    memcpy(jpeg_mem->data, evt->out_data, evt->data_size);
+    memcpy(jpeg_mem->data, job->out_data, job->data_size);
 
     ALOGE("%s : Calling upperlayer callback to store JPEG image", __func__);
     rc = sendDataNotify(CAMERA_MSG_COMPRESSED_IMAGE,
@@ -402,19 +480,436 @@ end:
         }
     }
 
-    // release internal data for jpeg job
-    if (job != NULL) {
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : startJpegJob
+ *
+ * DESCRIPTION: send a frame to mm-jpeg-interface for encoding. The job takes
+ *              the next slot in submission order, so its result will be
+ *              delivered after all jobs started before it.
+ *
+ * PARAMETERS :
+ *   @super_buf : frame to be encoded
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *
+ * NOTE       : super_buf is owned by the job after this call, in both success
+ *              and failure cases.
+ *==========================================================================*/
+int32_t QCameraPostProcessor::startJpegJob(mm_camera_super_buf_t *super_buf)
+{
+    int32_t ret = NO_ERROR;
+    qcamera_jpeg_data_t *jpeg_job =
+        (qcamera_jpeg_data_t *)malloc(sizeof(qcamera_jpeg_data_t));
+    if (jpeg_job == NULL) {
+        ALOGE("%s: no mem for qcamera_jpeg_data_t", __func__);
+        releaseSuperBuf(super_buf);
+        free(super_buf);
+        sendDataNotify(CAMERA_MSG_COMPRESSED_IMAGE,
+                       NULL,
+                       0,
+                       NULL,
+                       NULL);
+        return NO_MEMORY;
+    }
+    memset(jpeg_job, 0, sizeof(qcamera_jpeg_data_t));
+
+    pthread_mutex_lock(&m_jpegLock);
+    jpeg_job->seq = m_nJpegSubmitSeq++;
+    pthread_mutex_unlock(&m_jpegLock);
+    jpeg_job->submit_ts = systemTime();
+
+    ret = encodeData(super_buf, jpeg_job);
+    if (0 != ret) {
+        releaseSuperBuf(super_buf);
+        free(super_buf);
+        // error is reported in order as well
+        jpeg_job->status = JPEG_JOB_STATUS_ERROR;
+        jpeg_job->done_ts = systemTime();
+        completeJpegJob(jpeg_job);
+    } else {
+        // add into ongoing jpeg job Q
+        m_ongoingJpegQ.enqueue((void *)jpeg_job);
+    }
+
+    return ret;
+}
+
+/*===========================================================================
+ * FUNCTION   : completeJpegJob
+ *
+ * DESCRIPTION: mark a jpeg job as done, and deliver all done jobs that are
+ *              next in submission order to upper layer.
+ *
+ * PARAMETERS :
+ *   @job     : ptr to the done jpeg job. It will be released after delivery.
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *
+ * NOTE       : jobs are taken off the reorder ring under m_jpegLock and
+ *              delivered after releasing it. Only one thread delivers at a
+ *              time, a job completed meanwhile is left in the ring for it,
+ *              so delivery stays in submission order.
+ *==========================================================================*/
+int32_t QCameraPostProcessor::completeJpegJob(qcamera_jpeg_data_t *job)
+{
+    int32_t rc = NO_ERROR;
+    qcamera_jpeg_data_t *ready_jobs[MAX_JPEG_CONCURRENT_JOBS];
+    int num_ready;
+
+    pthread_mutex_lock(&m_jpegLock);
+    if (!m_bJpegActive) {
+        // postprocessor is stopped, drop the job
+        pthread_mutex_unlock(&m_jpegLock);
         releaseJpegJobData(job);
         free(job);
+        return NO_ERROR;
     }
 
-    // wait up data proc thread to do next job,
-    // if previous request is blocked due to ongoing jpeg job
-    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    m_jpegDoneJobs[job->seq % MAX_JPEG_CONCURRENT_JOBS] = job;
+    if (m_bJpegDelivering) {
+        // the delivering thread will pick it up when its turn comes
+        pthread_mutex_unlock(&m_jpegLock);
+        return NO_ERROR;
+    }
+    m_bJpegDelivering = true;
+
+    for (;;) {
+        // take done jobs next in order off the ring
+        num_ready = 0;
+        while (m_nJpegDeliverSeq != m_nJpegSubmitSeq) {
+            uint32_t idx = m_nJpegDeliverSeq % MAX_JPEG_CONCURRENT_JOBS;
+            qcamera_jpeg_data_t *done_job = m_jpegDoneJobs[idx];
+            if (NULL == done_job || done_job->seq != m_nJpegDeliverSeq) {
+                break;
+            }
+            m_jpegDoneJobs[idx] = NULL;
+            m_nJpegDeliverSeq++;
+            updateJpegLatency(done_job);
+            ready_jobs[num_ready++] = done_job;
+        }
+        if (0 == num_ready) {
+            break;
+        }
+        pthread_mutex_unlock(&m_jpegLock);
+
+        for (int i = 0; i < num_ready; i++) {
+            rc = sendJpegNotify(ready_jobs[i]);
+
+            // release internal data for jpeg job
+            releaseJpegJobData(ready_jobs[i]);
+            free(ready_jobs[i]);
+        }
+
+        pthread_mutex_lock(&m_jpegLock);
+    }
+    m_bJpegDelivering = false;
+    pthread_mutex_unlock(&m_jpegLock);
 
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : getNumOfJpegJobsInFlight
+ *
+ * DESCRIPTION: get num of jpeg jobs that are sent but not delivered yet
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : num of jpeg jobs in flight
+ *==========================================================================*/
+uint32_t QCameraPostProcessor::getNumOfJpegJobsInFlight()
+{
+    uint32_t num_jobs;
+    pthread_mutex_lock(&m_jpegLock);
+    num_jobs = m_nJpegSubmitSeq - m_nJpegDeliverSeq;
+    pthread_mutex_unlock(&m_jpegLock);
+    return num_jobs;
+}
+
+/*===========================================================================
+ * FUNCTION   : flushJpegJobs
+ *
+ * DESCRIPTION: release all done jpeg jobs waiting for delivery and reset
+ *              job ordering.
+ *
+ * PARAMETERS :
+ *   @active  : if done jobs can be delivered after flush
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPostProcessor::flushJpegJobs(bool active)
+{
+    pthread_mutex_lock(&m_jpegLock);
+    for (int i = 0; i < MAX_JPEG_CONCURRENT_JOBS; i++) {
+        if (NULL != m_jpegDoneJobs[i]) {
+            releaseJpegJobData(m_jpegDoneJobs[i]);
+            free(m_jpegDoneJobs[i]);
+            m_jpegDoneJobs[i] = NULL;
+        }
+    }
+    m_nJpegSubmitSeq = 0;
+    m_nJpegDeliverSeq = 0;
+    m_bJpegActive = active;
+    pthread_mutex_unlock(&m_jpegLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : updateJpegLatency
+ *
+ * DESCRIPTION: update shot-to-shot latency stats when a jpeg is delivered.
+ *              Must be called with m_jpegLock held.
+ *
+ * PARAMETERS :
+ *   @job     : ptr to the delivered jpeg job
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPostProcessor::updateJpegLatency(qcamera_jpeg_data_t *job)
+{
+    nsecs_t now = systemTime();
+    nsecs_t encode = job->done_ts - job->submit_ts;
+    nsecs_t s2s = 0;
+
+    if (m_jpegLatency.num_shots > 0) {
+        s2s = now - m_jpegLatency.last_ts;
+        if (m_jpegLatency.num_shots == 1 || s2s < m_jpegLatency.min_s2s) {
+            m_jpegLatency.min_s2s = s2s;
+        }
+        if (s2s > m_jpegLatency.max_s2s) {
+            m_jpegLatency.max_s2s = s2s;
+        }
+        m_jpegLatency.sum_s2s += s2s;
+    }
+    m_jpegLatency.num_shots++;
+    m_jpegLatency.last_ts = now;
+    m_jpegLatency.sum_encode += encode;
+
+    ALOGD("%s: shot %d (jobId %d): encode %lld us, shot-to-shot %lld us",
+          __func__, m_jpegLatency.num_shots, job->jobId,
+          encode / 1000, s2s / 1000);
+}
+
+/*===========================================================================
+ * FUNCTION   : dumpJpegLatency
+ *
+ * DESCRIPTION: log shot-to-shot latency summary of jpegs delivered since
+ *              last dump, and reset the stats.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPostProcessor::dumpJpegLatency()
+{
+    pthread_mutex_lock(&m_jpegLock);
+    if (m_jpegLatency.num_shots > 1) {
+        ALOGD("%s: %d shots with %d concurrent jobs: shot-to-shot avg %lld us, "
+              "min %lld us, max %lld us, encode avg %lld us",
+              __func__, m_jpegLatency.num_shots, m_nMaxJpegJobs,
+              m_jpegLatency.sum_s2s / (m_jpegLatency.num_shots - 1) / 1000,
+              m_jpegLatency.min_s2s / 1000,
+              m_jpegLatency.max_s2s / 1000,
+              m_jpegLatency.sum_encode / m_jpegLatency.num_shots / 1000);
+    } else if (m_jpegLatency.num_shots == 1) {
+        ALOGD("%s: 1 shot: encode %lld us",
+              __func__, m_jpegLatency.sum_encode / 1000);
+    }
+    memset(&m_jpegLatency, 0, sizeof(m_jpegLatency));
+    pthread_mutex_unlock(&m_jpegLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : initJpegOutBufs
+ *
+ * DESCRIPTION: size jpeg output buf pool for current picture size. Free bufs
+ *              of another size class are released, and bufs for all
+ *              concurrent jpeg jobs are preallocated so that no allocation
+ *              happens per shot.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraPostProcessor::initJpegOutBufs()
+{
+    int32_t rc = NO_ERROR;
+    cam_dimension_t dim;
+    uint32_t size;
+    int num_bufs = 0;
+
+    memset(&dim, 0, sizeof(dim));
+    m_parent->mParameters.getStreamDimension(CAM_STREAM_TYPE_SNAPSHOT, dim);
+    if (dim.width <= 0 || dim.height <= 0) {
+        ALOGE("%s: invalid picture size %dx%d", __func__, dim.width, dim.height);
+        return BAD_VALUE;
+    }
+    // encoded jpeg never exceeds the YUV420 input frame
+    size = (uint32_t)(dim.width * dim.height * 3 / 2);
+    size = (size + JPEG_OUT_BUF_SIZE_ALIGN - 1) & ~(JPEG_OUT_BUF_SIZE_ALIGN - 1);
+
+    pthread_mutex_lock(&m_jpegBufLock);
+    for (int i = 0; i < MAX_JPEG_OUT_BUFS; i++) {
+        qcamera_jpeg_out_buf_t *buf = &m_jpegOutBufs[i];
+        if (NULL != buf->mem && !buf->in_use && buf->size != size) {
+            buf->mem->deallocate();
+            delete buf->mem;
+            buf->mem = NULL;
+            buf->size = 0;
+        }
+        if (NULL != buf->mem && buf->size == size) {
+            num_bufs++;
+        }
+    }
+
+    for (int i = 0; i < MAX_JPEG_OUT_BUFS && num_bufs < m_nMaxJpegJobs; i++) {
+        qcamera_jpeg_out_buf_t *buf = &m_jpegOutBufs[i];
+        if (NULL != buf->mem) {
+            continue;
+        }
+        buf->mem = new QCameraHeapMemory();
+        if (NULL == buf->mem) {
+            rc = NO_MEMORY;
+            break;
+        }
+        if (buf->mem->allocate(1, size) != OK) {
+            delete buf->mem;
+            buf->mem = NULL;
+            rc = NO_MEMORY;
+            break;
+        }
+        buf->size = size;
+        buf->in_use = false;
+        num_bufs++;
+    }
+    pthread_mutex_unlock(&m_jpegBufLock);
+
+    ALOGD("%s: %d jpeg output bufs of size %d for picture %dx%d",
+          __func__, num_bufs, size, dim.width, dim.height);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : deinitJpegOutBufs
+ *
+ * DESCRIPTION: release all bufs in jpeg output buf pool
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *
+ * NOTE       : must be called after all jpeg jobs and data callbacks are
+ *              flushed, since bufs still in use are released as well.
+ *==========================================================================*/
+void QCameraPostProcessor::deinitJpegOutBufs()
+{
+    pthread_mutex_lock(&m_jpegBufLock);
+    for (int i = 0; i < MAX_JPEG_OUT_BUFS; i++) {
+        qcamera_jpeg_out_buf_t *buf = &m_jpegOutBufs[i];
+        if (NULL != buf->mem) {
+            if (buf->in_use) {
+                ALOGE("%s: jpeg output buf %d still in use", __func__, i);
+            }
+            buf->mem->deallocate();
+            delete buf->mem;
+        }
+    }
+    memset(m_jpegOutBufs, 0, sizeof(m_jpegOutBufs));
+    pthread_mutex_unlock(&m_jpegBufLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : getJpegOutBuf
+ *
+ * DESCRIPTION: get a free buf from jpeg output buf pool. The smallest free
+ *              buf that fits is used. If none fits, a free buf of another
+ *              size class or an empty slot is (re)allocated.
+ *
+ * PARAMETERS :
+ *   @len     : min length of the buf
+ *
+ * RETURN     : ptr to the buf, NULL if pool is exhausted or no memory
+ *==========================================================================*/
+qcamera_jpeg_out_buf_t *QCameraPostProcessor::getJpegOutBuf(uint32_t len)
+{
+    qcamera_jpeg_out_buf_t *buf = NULL;
+    qcamera_jpeg_out_buf_t *spare = NULL;
+    uint32_t size =
+        (len + JPEG_OUT_BUF_SIZE_ALIGN - 1) & ~(JPEG_OUT_BUF_SIZE_ALIGN - 1);
+
+    pthread_mutex_lock(&m_jpegBufLock);
+    for (int i = 0; i < MAX_JPEG_OUT_BUFS; i++) {
+        qcamera_jpeg_out_buf_t *cur = &m_jpegOutBufs[i];
+        if (cur->in_use) {
+            continue;
+        }
+        if (NULL != cur->mem && cur->size >= len) {
+            if (NULL == buf || cur->size < buf->size) {
+                buf = cur;
+            }
+        } else if (NULL == spare || NULL != spare->mem) {
+            // prefer empty slot over freeing a buf of another size class
+            spare = cur;
+        }
+    }
+
+    if (NULL == buf && NULL != spare) {
+        if (NULL != spare->mem) {
+            spare->mem->deallocate();
+            delete spare->mem;
+            spare->mem = NULL;
+            spare->size = 0;
+        }
+        spare->mem = new QCameraHeapMemory();
+        if (NULL != spare->mem) {
+            if (spare->mem->allocate(1, size) == OK) {
+                spare->size = size;
+                buf = spare;
+            } else {
+                delete spare->mem;
+                spare->mem = NULL;
+            }
+        }
+        ALOGD("%s: allocated jpeg output buf of size %d", __func__, size);
+    }
+
+    if (NULL != buf) {
+        buf->in_use = true;
+    } else {
+        ALOGE("%s: no jpeg output buf available for len %d", __func__, len);
+    }
+    pthread_mutex_unlock(&m_jpegBufLock);
+
+    return buf;
+}
+
+/*===========================================================================
+ * FUNCTION   : putJpegOutBuf
+ *
+ * DESCRIPTION: return a buf back to jpeg output buf pool
+ *
+ * PARAMETERS :
+ *   @buf     : ptr to the buf
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPostProcessor::putJpegOutBuf(qcamera_jpeg_out_buf_t *buf)
+{
+    if (NULL != buf) {
+        pthread_mutex_lock(&m_jpegBufLock);
+        buf->in_use = false;
+        pthread_mutex_unlock(&m_jpegBufLock);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : processPPData
  *
@@ -463,9 +958,9 @@ int32_t QCameraPostProcessor::processPPData(mm_camera_super_buf_t *frame)
  *
  * RETURN     : ptr to a jpeg job struct. NULL if not found.
  *
- * NOTE       : Currently only one job is sending to mm-jpeg-interface for jpeg
- *              encoding. Therefore simply dequeue from the ongoing Jpeg Queue
- *              will serve the purpose to find the jpeg job.
+ * NOTE       : Multiple jobs can be ongoing in mm-jpeg-interface and may
+ *              finish out of order, so the job is looked up by its ID and
+ *              removed from the ongoing Jpeg Queue.
  *==========================================================================*/
 qcamera_jpeg_data_t *QCameraPostProcessor::findJpegJobByJobId(uint32_t jobId)
 {
@@ -475,11 +970,29 @@ qcamera_jpeg_data_t *QCameraPostProcessor::findJpegJobByJobId(uint32_t jobId)
         return NULL;
     }
 
-    // currely only one jpeg job ongoing, so simply dequeue the head
-    job = (qcamera_jpeg_data_t *)m_ongoingJpegQ.dequeue();
+    job = (qcamera_jpeg_data_t *)m_ongoingJpegQ.dequeue(matchJpegJobId,
+                                                        (void *)&jobId);
     return job;
 }
 
+/*===========================================================================
+ * FUNCTION   : matchJpegJobId
+ *
+ * DESCRIPTION: callback function to match a jpeg job by its job ID
+ *
+ * PARAMETERS :
+ *   @data       : ptr to jpeg job data
+ *   @match_data : ptr to job ID to be matched
+ *
+ * RETURN     : true if job ID matches
+ *==========================================================================*/
+bool QCameraPostProcessor::matchJpegJobId(void *data, void *match_data)
+{
+    qcamera_jpeg_data_t *job = (qcamera_jpeg_data_t *)data;
+    uint32_t jobId = *((uint32_t *)match_data);
+    return (NULL != job && job->jobId == jobId);
+}
+
 /*===========================================================================
  * FUNCTION   : releaseOutputData
  *
@@ -637,8 +1150,9 @@ void QCameraPostProcessor::releaseSuperBuf(mm_camera_super_buf_t *super_buf)
  * RETURN     : None
  *
  * NOTE       : original source frame need to be queued back to kernel for
- *              future use. Output buf of jpeg job need to be released since
- *              it's allocated for each job. Exif object need to be deleted.
+ *              future use. Output buf of jpeg job need to be returned to the
+ *              pool if not handed over to upper layer. Exif object is owned
+ *              by postprocessor and reused by later jobs.
  *==========================================================================*/
 void QCameraPostProcessor::releaseJpegJobData(qcamera_jpeg_data_t *job)
 {
@@ -648,15 +1162,13 @@ void QCameraPostProcessor::releaseJpegJobData(qcamera_jpeg_data_t *job)
             free(job->src_frame);
             job->src_frame = NULL;
         }
-        if (NULL != job->out_data) {
-            free(job->out_data);
-            job->out_data = NULL;
+        if (NULL != job->out_buf) {
+            putJpegOutBuf(job->out_buf);
+            job->out_buf = NULL;
         }
+        job->out_data = NULL;
 
-        if(NULL != job->exif_info) {
-            delete job->exif_info;
-            job->exif_info = NULL;
-        }
+        job->exif_info = NULL;
     }
 }
 
@@ -811,7 +1323,7 @@ int32_t QCameraPostProcessor::encodeData(mm_camera_super_buf_t *recvd_frame,
     ALOGV("%s : E", __func__);
     int32_t ret = NO_ERROR;
     mm_jpeg_job jpg_job;
-    uint8_t *out_data = NULL;
+    qcamera_jpeg_out_buf_t *out_buf = NULL;
     uint32_t jobId = 0;
     QCameraStream *main_stream = NULL;
     mm_camera_buf_def_t *main_frame = NULL;
@@ -880,11 +1392,16 @@ int32_t QCameraPostProcessor::encodeData(mm_camera_super_buf_t *recvd_frame,
         jpeg_quality = 85;
     }
 
-    // get exif data
-    jpeg_job_data->exif_info = m_parent->getExifData();
-    if (jpeg_job_data->exif_info == NULL) {
+    // get exif data. Jobs in flight never exceed MAX_JPEG_CONCURRENT_JOBS,
+    // so exif object of the slot is not used by any other job.
+    jpeg_job_data->exif_info =
+        &m_jpegExif[jpeg_job_data->seq % MAX_JPEG_CONCURRENT_JOBS];
+    jpeg_job_data->exif_info->reset();
+    ret = m_parent->getExifData(jpeg_job_data->exif_info);
+    if (ret != NO_ERROR) {
         ALOGE("%s: cannot get exif data", __func__);
-        return NO_MEMORY;
+        jpeg_job_data->exif_info = NULL;
+        return ret;
     }
 
     jpg_job.job_type = JPEG_JOB_TYPE_ENCODE;
@@ -920,16 +1437,22 @@ int32_t QCameraPostProcessor::encodeData(mm_camera_super_buf_t *recvd_frame,
         }
     }
 
-    //fill in the sink img info
-    out_data = (uint8_t *)malloc(main_frame->frame_len);
-    if (NULL == out_data) {
+    //fill in the sink img info from jpeg output buf pool
+    out_buf = getJpegOutBuf(main_frame->frame_len);
+    if (NULL == out_buf) {
         ALOGE("%s: ERROR: no memory for sink_img buf", __func__);
-        ret = -1;
+        ret = NO_MEMORY;
         goto on_error;
     }
 
     jpg_job.encode_job.encode_parm.buf_info.sink_img.buf_len = main_frame->frame_len;
-    jpg_job.encode_job.encode_parm.buf_info.sink_img.buf_vaddr = out_data;
+    jpg_job.encode_job.encode_parm.buf_info.sink_img.buf_vaddr =
+        (uint8_t *)out_buf->mem->getPtr(0);
+    jpg_job.encode_job.encode_parm.buf_info.sink_img.fd = out_buf->mem->getFd(0);
+    // read after all bufs of the job are allocated, so any free that could
+    // have recycled their fd or vaddr is already counted
+    jpg_job.encode_job.encode_parm.buf_info.buf_gen =
+        QCameraMemory::getBufGeneration();
 
     if (mJpegClientHandle > 0) {
         ret = mJpegHandle.start_job(mJpegClientHandle, &jpg_job, &jobId);
@@ -944,20 +1467,18 @@ int32_t QCameraPostProcessor::encodeData(mm_camera_super_buf_t *recvd_frame,
 
     // remember job info
     jpeg_job_data->jobId = jobId;
-    jpeg_job_data->out_data = out_data;
+    jpeg_job_data->out_buf = out_buf;
+    jpeg_job_data->out_data = (uint8_t *)out_buf->mem->getPtr(0);
     jpeg_job_data->src_frame = recvd_frame;
 
     ALOGV("%s : X", __func__);
     return NO_ERROR;
 
 on_error:
-    if (out_data != NULL) {
-        free(out_data);
-    }
-    if (jpeg_job_data->exif_info != NULL) {
-        delete jpeg_job_data->exif_info;
-        jpeg_job_data->exif_info = NULL;
+    if (out_buf != NULL) {
+        putJpegOutBuf(out_buf);
     }
+    jpeg_job_data->exif_info = NULL;
     return ret;
 }
 
@@ -1047,6 +1568,7 @@ void *QCameraPostProcessor::dataNotifyRoutine(void *data)
                         (qcamera_data_argm_t *)pme->m_dataNotifyQ.dequeue();
                     if (NULL != app_cb) {
                         // free app_cb
+                        pme->releaseNotifyData(app_cb);
                         free(app_cb);
                     }
                 }
@@ -1104,11 +1626,15 @@ void *QCameraPostProcessor::dataProcessRoutine(void *data)
         switch (cmd) {
         case CAMERA_CMD_TYPE_START_DATA_PROC:
             is_active = TRUE;
+            pme->flushJpegJobs(true);
             break;
         case CAMERA_CMD_TYPE_STOP_DATA_PROC:
             {
                 is_active = FALSE;
 
+                // stop delivering jpeg jobs, drop any done job not delivered yet
+                pme->flushJpegJobs(false);
+
                 // cancel all ongoing jpeg jobs
                 qcamera_jpeg_data_t *jpeg_job =
                     (qcamera_jpeg_data_t *)pme->m_ongoingJpegQ.dequeue();
@@ -1138,41 +1664,19 @@ void *QCameraPostProcessor::dataProcessRoutine(void *data)
             {
                 ALOGD("%s: active is %d", __func__, is_active);
                 if (is_active == TRUE) {
-                    // check if there is any ongoing jpeg jobs
-                    if (pme->m_ongoingJpegQ.isEmpty()) {
-                        // no ongoing jpeg job, we are fine to send jpeg encoding job
+                    // send jpeg encoding jobs as long as there is room
+                    // for more concurrent jobs
+                    while (pme->getNumOfJpegJobsInFlight() < pme->m_nMaxJpegJobs) {
                         mm_camera_super_buf_t *super_buf =
                             (mm_camera_super_buf_t *)pme->m_inputJpegQ.dequeue();
+                        if (NULL == super_buf) {
+                            break;
+                        }
 
-                        if (NULL != super_buf) {
-                            //play shutter sound
-                            pme->m_parent->playShutter();
+                        //play shutter sound
+                        pme->m_parent->playShutter();
 
-                            qcamera_jpeg_data_t *jpeg_job =
-                                (qcamera_jpeg_data_t *)malloc(sizeof(qcamera_jpeg_data_t));
-                            if (jpeg_job != NULL) {
-                                memset(jpeg_job, 0, sizeof(qcamera_jpeg_data_t));
-                                ret = pme->encodeData(super_buf, jpeg_job);
-                            } else {
-                                ALOGE("%s: no mem for qcamera_jpeg_data_t", __func__);
-                                ret = -1;
-                            }
-                            if (0 != ret) {
-                                pme->releaseSuperBuf(super_buf);
-                                free(super_buf);
-                                if (jpeg_job != NULL) {
-                                    free(jpeg_job);
-                                }
-                                pme->sendDataNotify(CAMERA_MSG_COMPRESSED_IMAGE,
-                                                    NULL,
-                                                    0,
-                                                    NULL,
-                                                    NULL);
-                            } else {
-                                // add into ongoing jpeg job Q
-                                pme->m_ongoingJpegQ.enqueue((void *)jpeg_job);
-                            }
-                        }
+                        pme->startJpegJob(super_buf);
                     }
 
                     qcamera_pp_request_t *request =
@@ -1260,7 +1764,10 @@ void *QCameraPostProcessor::dataProcessRoutine(void *data)
  * RETURN     : None
  *==========================================================================*/
 QCameraExif::QCameraExif()
-    : m_nNumEntries(0)
+    : m_nNumEntries(0),
+      m_nNumStaticEntries(0),
+      m_nArenaUsed(0),
+      m_nStaticArenaUsed(0)
 {
     memset(m_Entries, 0, sizeof(m_Entries));
 }
@@ -1268,7 +1775,8 @@ QCameraExif::QCameraExif()
 /*===========================================================================
  * FUNCTION   : ~QCameraExif
  *
- * DESCRIPTION: deconstructor of QCameraExif. Will release internal memory ptr.
+ * DESCRIPTION: deconstructor of QCameraExif. Tag data lives in the internal
+ *              arena, so nothing needs to be released.
  *
  * PARAMETERS : None
  *
@@ -1276,80 +1784,82 @@ QCameraExif::QCameraExif()
  *==========================================================================*/
 QCameraExif::~QCameraExif()
 {
-    for (uint32_t i = 0; i < m_nNumEntries; i++) {
-        switch (m_Entries[i].tag_entry.type) {
-        case EXIF_BYTE:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._bytes != NULL) {
-                    free(m_Entries[i].tag_entry.data._bytes);
-                    m_Entries[i].tag_entry.data._bytes = NULL;
-                }
-            }
-            break;
-        case EXIF_ASCII:
-            {
-                if (m_Entries[i].tag_entry.data._ascii != NULL) {
-                    free(m_Entries[i].tag_entry.data._ascii);
-                    m_Entries[i].tag_entry.data._ascii = NULL;
-                }
-            }
-            break;
-        case EXIF_SHORT:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._shorts != NULL) {
-                    free(m_Entries[i].tag_entry.data._shorts);
-                    m_Entries[i].tag_entry.data._shorts = NULL;
-                }
-            }
-            break;
-        case EXIF_LONG:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._longs != NULL) {
-                    free(m_Entries[i].tag_entry.data._longs);
-                    m_Entries[i].tag_entry.data._longs = NULL;
-                }
-            }
-            break;
-        case EXIF_RATIONAL:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._rats != NULL) {
-                    free(m_Entries[i].tag_entry.data._rats);
-                    m_Entries[i].tag_entry.data._rats = NULL;
-                }
-            }
-            break;
-        case EXIF_UNDEFINED:
-            {
-                if (m_Entries[i].tag_entry.data._undefined != NULL) {
-                    free(m_Entries[i].tag_entry.data._undefined);
-                    m_Entries[i].tag_entry.data._undefined = NULL;
-                }
-            }
-            break;
-        case EXIF_SLONG:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._slongs != NULL) {
-                    free(m_Entries[i].tag_entry.data._slongs);
-                    m_Entries[i].tag_entry.data._slongs = NULL;
-                }
-            }
-            break;
-        case EXIF_SRATIONAL:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._srats != NULL) {
-                    free(m_Entries[i].tag_entry.data._srats);
-                    m_Entries[i].tag_entry.data._srats = NULL;
-                }
-            }
-            break;
-        }
+}
+
+/*===========================================================================
+ * FUNCTION   : setStaticEntries
+ *
+ * DESCRIPTION: mark all entries added so far as static, so that they are
+ *              kept by reset and don't need to be rebuilt for every jpeg
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraExif::setStaticEntries()
+{
+    m_nNumStaticEntries = m_nNumEntries;
+    m_nStaticArenaUsed = m_nArenaUsed;
+}
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: drop all per-shot entries, keeping static ones. Arena space
+ *              of the dropped entries is reused by the next addEntry.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraExif::reset()
+{
+    memset(&m_Entries[m_nNumStaticEntries], 0,
+           (m_nNumEntries - m_nNumStaticEntries) * sizeof(QEXIF_INFO_DATA));
+    m_nNumEntries = m_nNumStaticEntries;
+    m_nArenaUsed = m_nStaticArenaUsed;
+}
+
+/*===========================================================================
+ * FUNCTION   : clear
+ *
+ * DESCRIPTION: drop all entries including static ones
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraExif::clear()
+{
+    memset(m_Entries, 0, sizeof(m_Entries));
+    m_nNumEntries = 0;
+    m_nNumStaticEntries = 0;
+    m_nArenaUsed = 0;
+    m_nStaticArenaUsed = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : allocData
+ *
+ * DESCRIPTION: allocate tag data from internal arena
+ *
+ * PARAMETERS :
+ *   @size    : size of the data in bytes
+ *
+ * RETURN     : ptr to the data, NULL if arena is exhausted
+ *==========================================================================*/
+void *QCameraExif::allocData(uint32_t size)
+{
+    // keep every allocation aligned for rational types
+    uint32_t aligned = (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    if (m_nArenaUsed + aligned > sizeof(m_Arena)) {
+        ALOGE("%s: exif arena exhausted, used %d, request %d",
+              __func__, m_nArenaUsed, size);
+        return NULL;
     }
+    void *data = (uint8_t *)m_Arena + m_nArenaUsed;
+    m_nArenaUsed += aligned;
+    return data;
 }
 
 /*===========================================================================
@@ -1372,144 +1882,111 @@ int32_t QCameraExif::addEntry(exif_tag_id_t tagid,
                               uint32_t count,
                               void *data)
 {
-    int32_t rc = NO_ERROR;
     if(m_nNumEntries >= MAX_EXIF_TABLE_ENTRIES) {
         ALOGE("%s: Number of entries exceeded limit", __func__);
         return NO_MEMORY;
     }
 
-    m_Entries[m_nNumEntries].tag_id = tagid;
-    m_Entries[m_nNumEntries].tag_entry.type = type;
-    m_Entries[m_nNumEntries].tag_entry.count = count;
-    m_Entries[m_nNumEntries].tag_entry.copy = 1;
+    QEXIF_INFO_DATA *entry = &m_Entries[m_nNumEntries];
+    uint32_t size = 0;
+    void *values = NULL;
+
+    // size of the data that can't be held in the entry itself
     switch (type) {
     case EXIF_BYTE:
-        {
-            if (count > 1) {
-                uint8_t *values = (uint8_t *)malloc(count);
-                if (values == NULL) {
-                    ALOGE("%s: No memory for byte array", __func__);
-                    rc = NO_MEMORY;
-                } else {
-                    memcpy(values, data, count);
-                    m_Entries[m_nNumEntries].tag_entry.data._bytes = values;
-                }
-            } else {
-                m_Entries[m_nNumEntries].tag_entry.data._byte = *(uint8_t *)data;
-            }
-        }
+        size = (count > 1) ? count : 0;
         break;
     case EXIF_ASCII:
-        {
-            char *str = NULL;
-            str = (char *)malloc(count + 1);
-            if (str == NULL) {
-                ALOGE("%s: No memory for ascii string", __func__);
-                rc = NO_MEMORY;
-            } else {
-                memset(str, 0, count + 1);
-                memcpy(str, data, count);
-                m_Entries[m_nNumEntries].tag_entry.data._ascii = str;
-            }
+        size = count + 1;
+        break;
+    case EXIF_SHORT:
+        size = (count > 1) ? count * sizeof(uint16_t) : 0;
+        break;
+    case EXIF_LONG:
+        size = (count > 1) ? count * sizeof(uint32_t) : 0;
+        break;
+    case EXIF_RATIONAL:
+        size = (count > 1) ? count * sizeof(rat_t) : 0;
+        break;
+    case EXIF_UNDEFINED:
+        size = count;
+        break;
+    case EXIF_SLONG:
+        size = (count > 1) ? count * sizeof(int32_t) : 0;
+        break;
+    case EXIF_SRATIONAL:
+        size = (count > 1) ? count * sizeof(srat_t) : 0;
+        break;
+    }
+
+    if (size > 0) {
+        values = allocData(size);
+        if (values == NULL) {
+            ALOGE("%s: No memory for tag 0x%x", __func__, tagid);
+            return NO_MEMORY;
+        }
+        memset(values, 0, size);
+        memcpy(values, data, (type == EXIF_ASCII) ? count : size);
+    }
+
+    entry->tag_id = tagid;
+    entry->tag_entry.type = type;
+    entry->tag_entry.count = count;
+    entry->tag_entry.copy = 1;
+    switch (type) {
+    case EXIF_BYTE:
+        if (count > 1) {
+            entry->tag_entry.data._bytes = (uint8_t *)values;
+        } else {
+            entry->tag_entry.data._byte = *(uint8_t *)data;
         }
         break;
+    case EXIF_ASCII:
+        entry->tag_entry.data._ascii = (char *)values;
+        break;
     case EXIF_SHORT:
-        {
-            if (count > 1) {
-                uint16_t *values = (uint16_t *)malloc(count * sizeof(uint16_t));
-                if (values == NULL) {
-                    ALOGE("%s: No memory for short array", __func__);
-                    rc = NO_MEMORY;
-                } else {
-                    memcpy(values, data, count * sizeof(uint16_t));
-                    m_Entries[m_nNumEntries].tag_entry.data._shorts = values;
-                }
-            } else {
-                m_Entries[m_nNumEntries].tag_entry.data._short = *(uint16_t *)data;
-            }
+        if (count > 1) {
+            entry->tag_entry.data._shorts = (uint16_t *)values;
+        } else {
+            entry->tag_entry.data._short = *(uint16_t *)data;
         }
         break;
     case EXIF_LONG:
-        {
-            if (count > 1) {
-                uint32_t *values = (uint32_t *)malloc(count * sizeof(uint32_t));
-                if (values == NULL) {
-                    ALOGE("%s: No memory for long array", __func__);
-                    rc = NO_MEMORY;
-                } else {
-                    memcpy(values, data, count * sizeof(uint32_t));
-                    m_Entries[m_nNumEntries].tag_entry.data._longs = values;
-                }
-            } else {
-                m_Entries[m_nNumEntries].tag_entry.data._long = *(uint32_t *)data;
-            }
+        if (count > 1) {
+            entry->tag_entry.data._longs = (uint32_t *)values;
+        } else {
+            entry->tag_entry.data._long = *(uint32_t *)data;
         }
         break;
     case EXIF_RATIONAL:
-        {
-            if (count > 1) {
-                rat_t *values = (rat_t *)malloc(count * sizeof(rat_t));
-                if (values == NULL) {
-                    ALOGE("%s: No memory for rational array", __func__);
-                    rc = NO_MEMORY;
-                } else {
-                    memcpy(values, data, count * sizeof(rat_t));
-                    m_Entries[m_nNumEntries].tag_entry.data._rats = values;
-                }
-            } else {
-                m_Entries[m_nNumEntries].tag_entry.data._rat = *(rat_t *)data;
-            }
+        if (count > 1) {
+            entry->tag_entry.data._rats = (rat_t *)values;
+        } else {
+            entry->tag_entry.data._rat = *(rat_t *)data;
         }
         break;
     case EXIF_UNDEFINED:
-        {
-            uint8_t *values = (uint8_t *)malloc(count);
-            if (values == NULL) {
-                ALOGE("%s: No memory for undefined array", __func__);
-                rc = NO_MEMORY;
-            } else {
-                memcpy(values, data, count);
-                m_Entries[m_nNumEntries].tag_entry.data._undefined = values;
-            }
-        }
+        entry->tag_entry.data._undefined = (uint8_t *)values;
         break;
     case EXIF_SLONG:
-        {
-            if (count > 1) {
-                int32_t *values = (int32_t *)malloc(count * sizeof(int32_t));
-                if (values == NULL) {
-                    ALOGE("%s: No memory for signed long array", __func__);
-                    rc = NO_MEMORY;
-                } else {
-                    memcpy(values, data, count * sizeof(int32_t));
-                    m_Entries[m_nNumEntries].tag_entry.data._slongs = values;
-                }
-            } else {
-                m_Entries[m_nNumEntries].tag_entry.data._slong = *(int32_t *)data;
-            }
+        if (count > 1) {
+            entry->tag_entry.data._slongs = (int32_t *)values;
+        } else {
+            entry->tag_entry.data._slong = *(int32_t *)data;
         }
         break;
     case EXIF_SRATIONAL:
-        {
-            if (count > 1) {
-                srat_t *values = (srat_t *)malloc(count * sizeof(srat_t));
-                if (values == NULL) {
-                    ALOGE("%s: No memory for signed rational array", __func__);
-                    rc = NO_MEMORY;
-                } else {
-                    memcpy(values, data, count * sizeof(srat_t));
-                    m_Entries[m_nNumEntries].tag_entry.data._srats = values;
-                }
-            } else {
-                m_Entries[m_nNumEntries].tag_entry.data._srat = *(srat_t *)data;
-            }
+        if (count > 1) {
+            entry->tag_entry.data._srats = (srat_t *)values;
+        } else {
+            entry->tag_entry.data._srat = *(srat_t *)data;
         }
         break;
     }
 
     // Increase number of entries
     m_nNumEntries++;
-    return rc;
+    return NO_ERROR;
 }
 
 }; // namespace android
@@ -34,20 +34,54 @@ extern "C" {
 #include <mm_camera_interface.h>
 #include <mm_jpeg_interface.h>
 }
+#include <utils/Timers.h>
 #include "QCamera2HWI.h"
 
 namespace android {
 
+/* max num of jpeg encoding jobs that can be in flight at the same time */
+#define MAX_JPEG_CONCURRENT_JOBS     4
+/* default num of concurrent jpeg jobs if not overridden by
+ * persist.camera.jpeg.sessions */
+#define DEFAULT_JPEG_CONCURRENT_JOBS 2
+/* max num of pooled jpeg output bufs, covering jobs in flight and done
+ * jobs waiting for in-order delivery */
+#define MAX_JPEG_OUT_BUFS            (MAX_JPEG_CONCURRENT_JOBS * 2)
+/* jpeg output bufs are allocated in size classes of this granularity */
+#define JPEG_OUT_BUF_SIZE_ALIGN      (1024 * 1024)
+
 class QCameraExif;
 
+typedef struct {
+    QCameraHeapMemory *mem;          // ION backed buf, NULL if slot is empty
+    uint32_t size;                   // size class of the buf
+    bool in_use;                     // flag if buf is used by a jpeg job
+} qcamera_jpeg_out_buf_t;
+
 typedef struct {
     uint32_t jobId;                  // job ID
     uint32_t client_hdl;             // handle of jpeg client (obtained when open jpeg)
     uint8_t *out_data;               // ptr to output buf (need to be released after job is done)
-    QCameraExif *exif_info;          // ptr to exif object (need to be released after job is done)
+    qcamera_jpeg_out_buf_t *out_buf; // pooled buf out_data points into
+    QCameraExif *exif_info;          // ptr to exif object (owned by postprocessor, reset per job)
     mm_camera_super_buf_t *src_frame;// source frame (need to be returned back to kernel after done)
+    uint32_t seq;                    // submission order of the job
+    jpeg_job_status_t status;        // jpeg encoding status
+    uint8_t thumbnailDroppedFlag;    // flag indicating if thumbnail is dropped
+    uint32_t data_size;              // lenght of valid jpeg buf after encoding
+    nsecs_t submit_ts;               // time when job is sent for encoding
+    nsecs_t done_ts;                 // time when encoding is done
 } qcamera_jpeg_data_t;
 
+typedef struct {
+    uint32_t num_shots;              // num of jpegs delivered
+    nsecs_t last_ts;                 // time when last jpeg is delivered
+    nsecs_t min_s2s;                 // min shot-to-shot latency
+    nsecs_t max_s2s;                 // max shot-to-shot latency
+    nsecs_t sum_s2s;                 // sum of shot-to-shot latency
+    nsecs_t sum_encode;              // sum of encoding latency
+} qcamera_jpeg_latency_t;
+
 typedef struct {
     uint32_t jobId;                  // job ID
     mm_camera_super_buf_t *src_frame;// source frame (need to be returned back to kernel after done)
@@ -73,7 +107,9 @@ typedef struct {
     QCameraHeapMemory *      jpeg_mem; // jpeg heap mem for release after CB
 } qcamera_data_argm_t;
 
-#define MAX_EXIF_TABLE_ENTRIES 14
+#define MAX_EXIF_TABLE_ENTRIES 17
+/* size of the arena backing exif tag data of one jpeg */
+#define EXIF_ARENA_SIZE        1024
 class QCameraExif
 {
 public:
@@ -84,12 +120,21 @@ public:
                      exif_tag_type_t type,
                      uint32_t count,
                      void *data);
+    void setStaticEntries();
+    void reset();
+    void clear();
     uint32_t getNumOfEntries() {return m_nNumEntries;};
     QEXIF_INFO_DATA *getEntries() {return m_Entries;};
 
 private:
+    void *allocData(uint32_t size);
+
     QEXIF_INFO_DATA m_Entries[MAX_EXIF_TABLE_ENTRIES];  // exif tags for JPEG encoder
     uint32_t  m_nNumEntries;                            // number of valid entries
+    uint32_t  m_nNumStaticEntries;                      // number of entries kept across reset
+    uint64_t  m_Arena[EXIF_ARENA_SIZE / sizeof(uint64_t)]; // backing buf of tag data
+    uint32_t  m_nArenaUsed;                             // bytes used in arena
+    uint32_t  m_nStaticArenaUsed;                       // bytes used by static entries
 };
 
 class QCameraPostProcessor
@@ -114,6 +159,17 @@ private:
                            camera_frame_metadata_t *metadata,
                            QCameraHeapMemory *jpeg_mem);
     qcamera_jpeg_data_t *findJpegJobByJobId(uint32_t jobId);
+    uint32_t getNumOfJpegJobsInFlight();
+    int32_t startJpegJob(mm_camera_super_buf_t *super_buf);
+    int32_t completeJpegJob(qcamera_jpeg_data_t *job);
+    int32_t sendJpegNotify(qcamera_jpeg_data_t *job);
+    void flushJpegJobs(bool active);
+    void updateJpegLatency(qcamera_jpeg_data_t *job);
+    void dumpJpegLatency();
+    int32_t initJpegOutBufs();
+    void deinitJpegOutBufs();
+    qcamera_jpeg_out_buf_t *getJpegOutBuf(uint32_t len);
+    void putJpegOutBuf(qcamera_jpeg_out_buf_t *buf);
     mm_jpeg_color_format getColorfmtFromImgFmt(cam_format_t img_fmt);
     jpeg_enc_src_img_fmt_t getJpegImgTypeFromImgFmt(cam_format_t img_fmt);
     int32_t encodeData(mm_camera_super_buf_t *recvd_frame,
@@ -132,6 +188,7 @@ private:
     static void releaseJpegInputData(void *data, void *user_data);
     static void releaseOngoingJpegData(void *data, void *user_data);
     static void releaseOngoingPPData(void *data, void *user_data);
+    static bool matchJpegJobId(void *data, void *match_data);
 
     static void *dataProcessRoutine(void *data);
     static void *dataNotifyRoutine(void *data);
@@ -152,6 +209,26 @@ private:
     QCameraCmdThread m_dataProcTh;      // thread for data processing
     QCameraQueue m_dataNotifyQ;         // data notify queue
     QCameraCmdThread m_dataNotifyTh;    // thread handling data notify to service layer
+
+    // jpeg jobs are encoded concurrently but delivered in submission order
+    pthread_mutex_t m_jpegLock;         // lock protecting jpeg job ordering
+    uint32_t m_nMaxJpegJobs;            // max num of jpeg jobs in flight
+    bool m_bJpegActive;                 // flag if jpeg jobs can be delivered
+    uint32_t m_nJpegSubmitSeq;          // seq of next jpeg job to be sent
+    uint32_t m_nJpegDeliverSeq;         // seq of next jpeg job to be delivered
+    bool m_bJpegDelivering;             // flag if a thread is delivering done jobs
+    qcamera_jpeg_data_t *m_jpegDoneJobs[MAX_JPEG_CONCURRENT_JOBS]; // done jobs waiting for delivery
+    qcamera_jpeg_latency_t m_jpegLatency; // shot-to-shot latency stats
+
+    // jpeg output bufs are reused across shots. Encoded jpeg is copied out
+    // for upper layer callback, so a buf is back in the pool once its job
+    // is delivered
+    pthread_mutex_t m_jpegBufLock;      // lock protecting jpeg output buf pool
+    qcamera_jpeg_out_buf_t m_jpegOutBufs[MAX_JPEG_OUT_BUFS];
+
+    // exif objects reused across shots, indexed by job seq. Static tags are
+    // built once in init and kept when per-shot tags are reset.
+    QCameraExif m_jpegExif[MAX_JPEG_CONCURRENT_JOBS];
 };
 
 }; // namespace android
@@ -205,6 +205,80 @@ void* QCameraQueue::dequeue()
     return data;
 }
 
+/*===========================================================================
+ * FUNCTION   : peek
+ *
+ * DESCRIPTION: get data at the head of the queue without dequeuing it. The
+ *              data stays valid only as long as no one else dequeues it.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : data ptr. NULL if not any data in the queue.
+ *==========================================================================*/
+void* QCameraQueue::peek()
+{
+    camera_q_node* node = NULL;
+    void* data = NULL;
+    struct cam_list *head = NULL;
+    struct cam_list *pos = NULL;
+
+    pthread_mutex_lock(&m_lock);
+    head = &m_head.list;
+    pos = head->next;
+    if (pos != head) {
+        node = member_of(pos, camera_q_node, list);
+        data = node->data;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    return data;
+}
+
+/*===========================================================================
+ * FUNCTION   : dequeue
+ *
+ * DESCRIPTION: dequeue the first data from the queue that matches
+ *
+ * PARAMETERS :
+ *   @match      : function ptr to check if a node data matches
+ *   @match_data : data to be passed to the match function
+ *
+ * RETURN     : data ptr. NULL if no matching data in the queue.
+ *==========================================================================*/
+void* QCameraQueue::dequeue(match_fn match, void *match_data)
+{
+    camera_q_node* node = NULL;
+    void* data = NULL;
+    struct cam_list *head = NULL;
+    struct cam_list *pos = NULL;
+
+    if (NULL == match) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    head = &m_head.list;
+    pos = head->next;
+    while (pos != head) {
+        node = member_of(pos, camera_q_node, list);
+        if (match(node->data, match_data)) {
+            cam_list_del_node(&node->list);
+            m_size--;
+            break;
+        }
+        node = NULL;
+        pos = pos->next;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    if (NULL != node) {
+        data = node->data;
+        free(node);
+    }
+
+    return data;
+}
+
 /*===========================================================================
  * FUNCTION   : flush
  *
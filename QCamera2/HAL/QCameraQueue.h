@@ -36,6 +36,7 @@
 namespace android {
 
 typedef void (*release_data_fn)(void* data, void *user_data);
+typedef bool (*match_fn)(void *data, void *match_data);
 
 class QCameraQueue {
 public:
@@ -46,6 +47,8 @@ public:
     bool enqueueWithPriority(void *data);
     void flush();
     void* dequeue();
+    void* dequeue(match_fn match, void *match_data);
+    void* peek();
     bool isEmpty();
 private:
     typedef struct {
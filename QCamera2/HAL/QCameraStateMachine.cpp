@@ -36,6 +36,52 @@
 
 namespace android {
 
+// bound of pending cmds per priority class. Internal evts beyond bound make
+// room by merging two pending focus updates of the same focus state. Focus
+// state changes, ctrl evts and APIs are never lost, their queues grow beyond
+// bound and it is only counted. APIs are serialized by HWI, so its queue
+// only needs room for EXIT.
+static const int SM_QUEUE_MAX_DEPTH[] = {32, 4, 4};
+static const char *SM_QUEUE_NAMES[] = {"ctrl", "internal", "api"};
+
+/*===========================================================================
+ * FUNCTION   : mergeSameFocusState
+ *
+ * DESCRIPTION: match fn walking pending internal cmds oldest first. Matches
+ *              the first focus update that reports the same focus state as
+ *              the one before it, after moving its focus data into that one.
+ *              Removing the match then loses no focus state change.
+ *
+ * PARAMETERS :
+ *   @data       : pending cmd
+ *   @match_data : ptr to the cmd visited before, NULL at start. Left
+ *                 pointing to the cmd that took the data of the match.
+ *
+ * RETURN     : true  -- cmd was merged into the one before and can go
+ *              false -- keep cmd
+ *==========================================================================*/
+bool QCameraStateMachine::mergeSameFocusState(void *data, void *match_data)
+{
+    qcamera_sm_cmd_t *node = (qcamera_sm_cmd_t *)data;
+    qcamera_sm_cmd_t **prev = (qcamera_sm_cmd_t **)match_data;
+    qcamera_sm_internal_evt_payload_t *cur =
+        (qcamera_sm_internal_evt_payload_t *)node->evt_payload;
+    qcamera_sm_internal_evt_payload_t *before = NULL;
+
+    if (NULL != *prev) {
+        before = (qcamera_sm_internal_evt_payload_t *)(*prev)->evt_payload;
+    }
+    if (NULL != cur && NULL != before &&
+        QCAMERA_INTERNAL_EVT_FOCUS_UPDATE == cur->evt_type &&
+        QCAMERA_INTERNAL_EVT_FOCUS_UPDATE == before->evt_type &&
+        cur->focus_data.focus_state == before->focus_data.focus_state) {
+        before->focus_data = cur->focus_data;
+        return true;
+    }
+    *prev = node;
+    return false;
+}
+
 /*===========================================================================
  * FUNCTION   : smEvtProcRoutine
  *
@@ -64,12 +110,7 @@ void *QCameraStateMachine::smEvtProcRoutine(void *data)
         } while (ret != 0);
 
         // we got notified about new cmd avail in cmd queue
-        // first check API cmd queue
-        qcamera_sm_cmd_t *node = (qcamera_sm_cmd_t *)pme->api_queue.dequeue();
-        if (node == NULL) {
-            // no API cmd, then check evt cmd queue
-            node = (qcamera_sm_cmd_t *)pme->evt_queue.dequeue();
-        }
+        qcamera_sm_cmd_t *node = pme->dequeueCmd();
         if (node != NULL) {
             switch (node->cmd) {
             case QCAMERA_SM_CMD_TYPE_API:
@@ -90,7 +131,7 @@ void *QCameraStateMachine::smEvtProcRoutine(void *data)
             default:
                 break;
             }
-            free(node);
+            pme->freeCmd(node);
             node = NULL;
         }
     } while (running);
@@ -108,12 +149,25 @@ void *QCameraStateMachine::smEvtProcRoutine(void *data)
  *
  * RETURN     : none
  *==========================================================================*/
-QCameraStateMachine::QCameraStateMachine(QCamera2HardwareInterface *ctrl) :
-    api_queue(),
-    evt_queue()
+QCameraStateMachine::QCameraStateMachine(QCamera2HardwareInterface *ctrl)
 {
     m_parent = ctrl;
     m_state = QCAMERA_SM_STATE_PREVIEW_STOPPED;
+    m_publishedState = m_state;
+    pthread_mutex_init(&m_cmdPoolLock, NULL);
+    memset(m_cmdPool, 0, sizeof(m_cmdPool));
+    for (int i = 0; i < SM_CMD_POOL_DEPTH; i++) {
+        m_freeCmds[i] = &m_cmdPool[i];
+    }
+    m_freeCmdCnt = SM_CMD_POOL_DEPTH;
+    m_cmdOverflowCnt = 0;
+    pthread_mutex_init(&m_queueLock, NULL);
+    memset(m_queueDepth, 0, sizeof(m_queueDepth));
+    memset(m_queuePeak, 0, sizeof(m_queuePeak));
+    memset(m_overMaxCnt, 0, sizeof(m_overMaxCnt));
+    memset(m_coalesceCnt, 0, sizeof(m_coalesceCnt));
+    m_enqueueSeq = 0;
+    m_lastInternalCmd = NULL;
     cmd_pid = 0;
     sem_init(&cmd_sem, 0, 0);
     pthread_create(&cmd_pid,
@@ -134,13 +188,16 @@ QCameraStateMachine::QCameraStateMachine(QCamera2HardwareInterface *ctrl) :
 QCameraStateMachine::~QCameraStateMachine()
 {
     if (cmd_pid != 0) {
-        qcamera_sm_cmd_t *node =
-            (qcamera_sm_cmd_t *)malloc(sizeof(qcamera_sm_cmd_t));
+        qcamera_sm_cmd_t *node = allocCmd();
         if (NULL != node) {
-            memset(node, 0, sizeof(qcamera_sm_cmd_t));
             node->cmd = QCAMERA_SM_CMD_TYPE_EXIT;
 
-            api_queue.enqueue((void *)node);
+            // bypass bound, exit has to get through
+            pthread_mutex_lock(&m_queueLock);
+            node->seq = m_enqueueSeq++;
+            m_queues[QCAMERA_SM_PRIO_API].enqueue((void *)node);
+            m_queueDepth[QCAMERA_SM_PRIO_API]++;
+            pthread_mutex_unlock(&m_queueLock);
             sem_post(&cmd_sem);
 
             /* wait until cmd thread exits */
@@ -151,6 +208,74 @@ QCameraStateMachine::~QCameraStateMachine()
         cmd_pid = 0;
     }
     sem_destroy(&cmd_sem);
+
+    // cmds left behind go back to pool here, queues would free() them
+    qcamera_sm_cmd_t *node = NULL;
+    while (NULL != (node = dequeueCmd())) {
+        if (QCAMERA_SM_CMD_TYPE_EVT == node->cmd) {
+            free(node->evt_payload);
+        }
+        freeCmd(node);
+    }
+    if (m_cmdOverflowCnt > 0) {
+        ALOGD("%s: %d cmds allocated beyond pool", __func__, m_cmdOverflowCnt);
+    }
+    pthread_mutex_destroy(&m_queueLock);
+    pthread_mutex_destroy(&m_cmdPoolLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : allocCmd
+ *
+ * DESCRIPTION: get a cmd node from preallocated pool. Falls back to heap
+ *              if pool is exhausted.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : ptr to zeroed cmd node, NULL if no memory
+ *==========================================================================*/
+QCameraStateMachine::qcamera_sm_cmd_t *QCameraStateMachine::allocCmd()
+{
+    qcamera_sm_cmd_t *node = NULL;
+
+    pthread_mutex_lock(&m_cmdPoolLock);
+    if (m_freeCmdCnt > 0) {
+        node = m_freeCmds[--m_freeCmdCnt];
+    } else {
+        m_cmdOverflowCnt++;
+    }
+    pthread_mutex_unlock(&m_cmdPoolLock);
+
+    if (NULL == node) {
+        node = (qcamera_sm_cmd_t *)malloc(sizeof(qcamera_sm_cmd_t));
+        if (NULL == node) {
+            return NULL;
+        }
+    }
+    memset(node, 0, sizeof(qcamera_sm_cmd_t));
+    return node;
+}
+
+/*===========================================================================
+ * FUNCTION   : freeCmd
+ *
+ * DESCRIPTION: return a cmd node to pool, or to heap if it was not from pool.
+ *
+ * PARAMETERS :
+ *   @node    : cmd node from allocCmd
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStateMachine::freeCmd(qcamera_sm_cmd_t *node)
+{
+    if (node < m_cmdPool || node >= m_cmdPool + SM_CMD_POOL_DEPTH) {
+        free(node);
+        return;
+    }
+
+    pthread_mutex_lock(&m_cmdPoolLock);
+    m_freeCmds[m_freeCmdCnt++] = node;
+    pthread_mutex_unlock(&m_cmdPoolLock);
 }
 
 /*===========================================================================
@@ -169,35 +294,34 @@ QCameraStateMachine::~QCameraStateMachine()
 int32_t QCameraStateMachine::procAPI(qcamera_sm_evt_enum_t evt,
                                      void *api_payload)
 {
-    qcamera_sm_cmd_t *node =
-        (qcamera_sm_cmd_t *)malloc(sizeof(qcamera_sm_cmd_t));
+    qcamera_sm_cmd_t *node = allocCmd();
     if (NULL == node) {
         ALOGE("%s: No memory for qcamera_sm_cmd_t", __func__);
         return NO_MEMORY;
     }
 
-    memset(node, 0, sizeof(qcamera_sm_cmd_t));
     node->cmd = QCAMERA_SM_CMD_TYPE_API;
     node->evt = evt;
     node->evt_payload = api_payload;
-    if (api_queue.enqueue((void *)node)) {
-        sem_post(&cmd_sem);
-        return NO_ERROR;
-    } else {
-        free(node);
-        return UNKNOWN_ERROR;
+    int32_t rc = enqueueCmd(QCAMERA_SM_PRIO_API, node);
+    if (rc != NO_ERROR) {
+        freeCmd(node);
     }
+    return rc;
 }
 
 /*===========================================================================
  * FUNCTION   : procEvt
  *
  * DESCRIPTION: process incoming envent from mm-camera-interface and
- *              mm-jpeg-interface.
+ *              mm-jpeg-interface. Per frame internal evts go to the internal
+ *              class and may be merged into a pending one, all others to
+ *              the ctrl class.
  *
  * PARAMETERS :
  *   @evt          : event to be processed
- *   @evt_payload  : event payload. Can be NULL if not needed.
+ *   @evt_payload  : event payload. Can be NULL if not needed. Owned by
+ *                   statemachine on success, by caller on failure.
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
@@ -206,24 +330,214 @@ int32_t QCameraStateMachine::procAPI(qcamera_sm_evt_enum_t evt,
 int32_t QCameraStateMachine::procEvt(qcamera_sm_evt_enum_t evt,
                                      void *evt_payload)
 {
-    qcamera_sm_cmd_t *node =
-        (qcamera_sm_cmd_t *)malloc(sizeof(qcamera_sm_cmd_t));
+    qcamera_sm_prio_t prio = QCAMERA_SM_PRIO_CTRL;
+    if (QCAMERA_SM_EVT_EVT_INTERNAL == evt) {
+        if (coalesceEvt(evt, evt_payload)) {
+            free(evt_payload);
+            return NO_ERROR;
+        }
+        prio = QCAMERA_SM_PRIO_INTERNAL;
+    }
+
+    qcamera_sm_cmd_t *node = allocCmd();
     if (NULL == node) {
         ALOGE("%s: No memory for qcamera_sm_cmd_t", __func__);
         return NO_MEMORY;
     }
 
-    memset(node, 0, sizeof(qcamera_sm_cmd_t));
     node->cmd = QCAMERA_SM_CMD_TYPE_EVT;
     node->evt = evt;
     node->evt_payload = evt_payload;
-    if (evt_queue.enqueue((void *)node)) {
-        sem_post(&cmd_sem);
-        return NO_ERROR;
-    } else {
-        free(node);
+    int32_t rc = enqueueCmd(prio, node);
+    if (rc != NO_ERROR) {
+        freeCmd(node);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : enqueueCmd
+ *
+ * DESCRIPTION: queue a cmd in its priority class and wake up cmd thread.
+ *              When the internal class is full the oldest pending focus
+ *              update followed by one of the same focus state is merged
+ *              into it. If every pending update changes focus state, or for
+ *              other classes, cmds beyond max depth are queued and counted.
+ *
+ * PARAMETERS :
+ *   @prio    : priority class
+ *   @node    : cmd to be queued
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraStateMachine::enqueueCmd(qcamera_sm_prio_t prio,
+                                        qcamera_sm_cmd_t *node)
+{
+    qcamera_sm_cmd_t *dropped = NULL;
+
+    pthread_mutex_lock(&m_queueLock);
+    if (m_queueDepth[prio] >= SM_QUEUE_MAX_DEPTH[prio] &&
+        QCAMERA_SM_PRIO_INTERNAL == prio) {
+        // its sem post is left for the new cmd
+        qcamera_sm_cmd_t *merged_into = NULL;
+        dropped = (qcamera_sm_cmd_t *)m_queues[prio].dequeue(
+            mergeSameFocusState, &merged_into);
+        if (NULL != dropped) {
+            m_queueDepth[prio]--;
+            m_coalesceCnt[prio]++;
+            if (dropped == m_lastInternalCmd) {
+                m_lastInternalCmd = merged_into;
+            }
+        }
+    }
+    if (m_queueDepth[prio] >= SM_QUEUE_MAX_DEPTH[prio]) {
+        m_overMaxCnt[prio]++;
+        ALOGD("%s: %s queue beyond max depth %d, evt %d",
+              __func__, SM_QUEUE_NAMES[prio], m_queueDepth[prio], node->evt);
+    }
+
+    node->enqueue_ts = systemTime();
+    node->seq = m_enqueueSeq++;
+    if (!m_queues[prio].enqueue((void *)node)) {
+        pthread_mutex_unlock(&m_queueLock);
         return UNKNOWN_ERROR;
     }
+    if (++m_queueDepth[prio] > m_queuePeak[prio]) {
+        m_queuePeak[prio] = m_queueDepth[prio];
+    }
+    if (QCAMERA_SM_PRIO_INTERNAL == prio) {
+        m_lastInternalCmd = node;
+    }
+    pthread_mutex_unlock(&m_queueLock);
+
+    if (NULL != dropped) {
+        free(dropped->evt_payload);
+        freeCmd(dropped);
+    } else {
+        sem_post(&cmd_sem);
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : dequeueCmd
+ *
+ * DESCRIPTION: take the oldest cmd of the highest priority evt class that
+ *              has one, and account its queue delay. Evts queued after the
+ *              oldest pending API wait for that API, so the order between
+ *              APIs and evts is kept as queued.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : ptr to cmd, NULL if all queues are empty
+ *==========================================================================*/
+QCameraStateMachine::qcamera_sm_cmd_t *QCameraStateMachine::dequeueCmd()
+{
+    qcamera_sm_cmd_t *node = NULL;
+    qcamera_sm_cmd_t *api = NULL;
+    int prio;
+
+    pthread_mutex_lock(&m_queueLock);
+    api = (qcamera_sm_cmd_t *)m_queues[QCAMERA_SM_PRIO_API].peek();
+    for (prio = 0; prio < QCAMERA_SM_PRIO_MAX; prio++) {
+        node = (qcamera_sm_cmd_t *)m_queues[prio].peek();
+        if (NULL == node ||
+            (QCAMERA_SM_PRIO_API != prio && NULL != api &&
+             (int32_t)(node->seq - api->seq) > 0)) {
+            node = NULL;
+            continue;
+        }
+        node = (qcamera_sm_cmd_t *)m_queues[prio].dequeue();
+        if (NULL != node) {
+            m_queueDepth[prio]--;
+            if (node == m_lastInternalCmd) {
+                m_lastInternalCmd = NULL;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_queueLock);
+
+    if (NULL != node && 0 != node->enqueue_ts) {
+        m_queueDelay[prio].record(systemTime() - node->enqueue_ts);
+    }
+    return node;
+}
+
+/*===========================================================================
+ * FUNCTION   : coalesceEvt
+ *
+ * DESCRIPTION: merge a focus update into the newest pending internal cmd if
+ *              that one reports the same focus state, so that a busy cmd
+ *              thread only sees the latest focus distances. Updates that
+ *              change focus state are never merged, each of them may end
+ *              in a focus callback to app.
+ *
+ * PARAMETERS :
+ *   @evt          : event to be processed
+ *   @evt_payload  : event payload
+ *
+ * RETURN     : true  -- merged, evt_payload is no longer needed
+ *              false -- not merged, evt has to be queued
+ *==========================================================================*/
+bool QCameraStateMachine::coalesceEvt(qcamera_sm_evt_enum_t evt,
+                                      void *evt_payload)
+{
+    qcamera_sm_internal_evt_payload_t *newEvt =
+        (qcamera_sm_internal_evt_payload_t *)evt_payload;
+    bool merged = false;
+
+    if (NULL == newEvt ||
+        QCAMERA_INTERNAL_EVT_FOCUS_UPDATE != newEvt->evt_type) {
+        return false;
+    }
+
+    pthread_mutex_lock(&m_queueLock);
+    if (NULL != m_lastInternalCmd && evt == m_lastInternalCmd->evt) {
+        qcamera_sm_internal_evt_payload_t *pending =
+            (qcamera_sm_internal_evt_payload_t *)m_lastInternalCmd->evt_payload;
+        if (NULL != pending &&
+            QCAMERA_INTERNAL_EVT_FOCUS_UPDATE == pending->evt_type &&
+            pending->focus_data.focus_state == newEvt->focus_data.focus_state) {
+            pending->focus_data = newEvt->focus_data;
+            m_coalesceCnt[QCAMERA_SM_PRIO_INTERNAL]++;
+            merged = true;
+        }
+    }
+    pthread_mutex_unlock(&m_queueLock);
+    return merged;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: write per priority class queue stats and queue delay
+ *              histograms to fd. Called from cmd thread, which is the only
+ *              writer of the histograms.
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to dump into
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStateMachine::dump(int fd)
+{
+    char buf[1024];
+    int len = 0;
+
+    len += snprintf(buf + len, sizeof(buf) - len, "Statemachine queues:\n");
+    for (int i = 0; i < QCAMERA_SM_PRIO_MAX; i++) {
+        pthread_mutex_lock(&m_queueLock);
+        len += snprintf(buf + len, sizeof(buf) - len,
+                "  %s: pending %d, peak %d, max %d, over max %u, coalesced %u\n",
+                SM_QUEUE_NAMES[i], m_queueDepth[i], m_queuePeak[i],
+                SM_QUEUE_MAX_DEPTH[i], m_overMaxCnt[i], m_coalesceCnt[i]);
+        pthread_mutex_unlock(&m_queueLock);
+        len += m_queueDelay[i].print(buf + len, sizeof(buf) - len, "queue delay");
+    }
+    write(fd, buf, len);
 }
 
 /*===========================================================================
@@ -349,7 +663,7 @@ int32_t QCameraStateMachine::procEvtPreviewStoppedState(qcamera_sm_evt_enum_t ev
     case QCAMERA_SM_EVT_SET_PARAMS:
         {
             bool needRestart = false;
-            rc = m_parent->updateParameters((char*)payload, needRestart);
+            rc = m_parent->updateParameters((char*)payload, needRestart, true);
             if (rc == NO_ERROR) {
                 rc = m_parent->commitParameterChanges();
             }
@@ -382,7 +696,7 @@ int32_t QCameraStateMachine::procEvtPreviewStoppedState(qcamera_sm_evt_enum_t ev
         {
             if (m_parent->mPreviewWindow == NULL) {
                 // preview window is not set yet, move to previewReady state
-                m_state = QCAMERA_SM_STATE_PREVIEW_READY;
+                setState(QCAMERA_SM_STATE_PREVIEW_READY);
                 rc = NO_ERROR;
             } else {
                 rc = m_parent->preparePreview();
@@ -392,7 +706,7 @@ int32_t QCameraStateMachine::procEvtPreviewStoppedState(qcamera_sm_evt_enum_t ev
                         m_parent->unpreparePreview();
                     } else {
                         // start preview success, move to previewing state
-                        m_state = QCAMERA_SM_STATE_PREVIEWING;
+                        setState(QCAMERA_SM_STATE_PREVIEWING);
                     }
                 }
             }
@@ -410,7 +724,7 @@ int32_t QCameraStateMachine::procEvtPreviewStoppedState(qcamera_sm_evt_enum_t ev
                 if (rc != NO_ERROR) {
                     m_parent->unpreparePreview();
                 } else {
-                    m_state = QCAMERA_SM_STATE_PREVIEWING;
+                    setState(QCAMERA_SM_STATE_PREVIEWING);
                 }
             }
             result.status = rc;
@@ -524,9 +838,9 @@ int32_t QCameraStateMachine::procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt,
                 rc = m_parent->startPreview();
                 if (rc != NO_ERROR) {
                     m_parent->unpreparePreview();
-                    m_state = QCAMERA_SM_STATE_PREVIEW_STOPPED;
+                    setState(QCAMERA_SM_STATE_PREVIEW_STOPPED);
                 } else {
-                    m_state = QCAMERA_SM_STATE_PREVIEWING;
+                    setState(QCAMERA_SM_STATE_PREVIEWING);
                 }
             }
 
@@ -582,7 +896,7 @@ int32_t QCameraStateMachine::procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt,
     case QCAMERA_SM_EVT_SET_PARAMS:
         {
             bool needRestart = false;
-            rc = m_parent->updateParameters((char*)payload, needRestart);
+            rc = m_parent->updateParameters((char*)payload, needRestart, true);
             if (rc == NO_ERROR) {
                 rc = m_parent->commitParameterChanges();
             }
@@ -625,7 +939,7 @@ int32_t QCameraStateMachine::procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt,
         {
             m_parent->unpreparePreview();
             rc = 0;
-            m_state = QCAMERA_SM_STATE_PREVIEW_STOPPED;
+            setState(QCAMERA_SM_STATE_PREVIEW_STOPPED);
             result.status = rc;
             result.request_api = evt;
             result.result_type = QCAMERA_API_RESULT_TYPE_DEF;
@@ -808,16 +1122,25 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
     case QCAMERA_SM_EVT_SET_PARAMS:
         {
             bool needRestart = false;
-            rc = m_parent->updateParameters((char*)payload, needRestart);
+            rc = m_parent->updateParameters((char*)payload, needRestart, true);
             if (rc == NO_ERROR) {
-                if (needRestart) {
+                if (needRestart &&
+                    m_parent->reconfigPreview() == NO_ERROR) {
+                    // only preview stream was affected and got reconfigured
+                    // in place, rest of the pipeline kept streaming
+                    rc = m_parent->commitParameterChanges();
+                } else if (needRestart) {
                     // need restart preview for parameters to take effect
-                    // stop preview
+                    // stop preview, which also deletes preview channels
                     m_parent->stopPreview();
                     // commit parameter changes to server
                     rc = m_parent->commitParameterChanges();
                     // start preview again
-                    m_parent->startPreview();
+                    if (m_parent->preparePreview() == NO_ERROR) {
+                        if (m_parent->startPreview() != NO_ERROR) {
+                            m_parent->unpreparePreview();
+                        }
+                    }
                 } else {
                     rc = m_parent->commitParameterChanges();
                 }
@@ -862,7 +1185,7 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
     case QCAMERA_SM_EVT_STOP_PREVIEW:
         {
             rc = m_parent->stopPreview();
-            m_state = QCAMERA_SM_STATE_PREVIEW_STOPPED;
+            setState(QCAMERA_SM_STATE_PREVIEW_STOPPED);
             result.status = rc;
             result.request_api = evt;
             result.result_type = QCAMERA_API_RESULT_TYPE_DEF;
@@ -930,7 +1253,7 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
             rc = m_parent->startRecording();
             if (rc == NO_ERROR) {
                 // move state to recording state
-                m_state = QCAMERA_SM_STATE_RECORDING;
+                setState(QCAMERA_SM_STATE_RECORDING);
             }
             result.status = rc;
             result.request_api = evt;
@@ -943,10 +1266,10 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
             rc = m_parent->takePicture();
             if (rc == NO_ERROR) {
                 // move state to picture taking state
-                m_state = QCAMERA_SM_STATE_PIC_TAKING;
+                setState(QCAMERA_SM_STATE_PIC_TAKING);
             } else {
                 // move state to preview stopped state
-                m_state = QCAMERA_SM_STATE_PREVIEW_STOPPED;
+                setState(QCAMERA_SM_STATE_PREVIEW_STOPPED);
             }
             result.status = rc;
             result.request_api = evt;
@@ -1096,7 +1419,7 @@ int32_t QCameraStateMachine::procEvtPicTakingState(qcamera_sm_evt_enum_t evt,
     case QCAMERA_SM_EVT_SET_PARAMS:
         {
             bool needRestart = false;
-            rc = m_parent->updateParameters((char*)payload, needRestart);
+            rc = m_parent->updateParameters((char*)payload, needRestart, true);
             if (rc == NO_ERROR) {
                 rc = m_parent->commitParameterChanges();
             }
@@ -1208,7 +1531,7 @@ int32_t QCameraStateMachine::procEvtPicTakingState(qcamera_sm_evt_enum_t evt,
     case QCAMERA_SM_EVT_CANCEL_PICTURE:
         {
             rc = m_parent->cancelPicture();
-            m_state = QCAMERA_SM_STATE_PREVIEW_STOPPED;
+            setState(QCAMERA_SM_STATE_PREVIEW_STOPPED);
             result.status = rc;
             result.request_api = evt;
             result.result_type = QCAMERA_API_RESULT_TYPE_DEF;
@@ -1268,7 +1591,7 @@ int32_t QCameraStateMachine::procEvtPicTakingState(qcamera_sm_evt_enum_t evt,
     case QCAMERA_SM_EVT_SNAPSHOT_DONE:
         {
             rc = m_parent->cancelPicture();
-            m_state = QCAMERA_SM_STATE_PREVIEW_STOPPED;
+            setState(QCAMERA_SM_STATE_PREVIEW_STOPPED);
         }
         break;
     default:
@@ -1358,16 +1681,11 @@ int32_t QCameraStateMachine::procEvtRecordingState(qcamera_sm_evt_enum_t evt,
     case QCAMERA_SM_EVT_SET_PARAMS:
         {
             bool needRestart = false;
-            rc = m_parent->updateParameters((char*)payload, needRestart);
+            // cannot set parameters that requires restart during recording,
+            // they are rejected before any value is applied
+            rc = m_parent->updateParameters((char*)payload, needRestart, false);
             if (rc == NO_ERROR) {
-                if (needRestart) {
-                    // cannot set parameters that requires restart during recording
-                    ALOGE("%s: Cannot set parameters that requires restart during recording",
-                          __func__);
-                    rc = BAD_VALUE;
-                } else {
-                    rc = m_parent->commitParameterChanges();
-                }
+                rc = m_parent->commitParameterChanges();
             }
             result.status = rc;
             result.request_api = evt;
@@ -1467,7 +1785,7 @@ int32_t QCameraStateMachine::procEvtRecordingState(qcamera_sm_evt_enum_t evt,
         {
             rc = m_parent->takeLiveSnapshot();
             if (rc == 0) {
-                m_state = QCAMERA_SM_STATE_VIDEO_PIC_TAKING;
+                setState(QCAMERA_SM_STATE_VIDEO_PIC_TAKING);
             }
             result.status = rc;
             result.request_api = evt;
@@ -1489,7 +1807,7 @@ int32_t QCameraStateMachine::procEvtRecordingState(qcamera_sm_evt_enum_t evt,
     case QCAMERA_SM_EVT_STOP_RECORDING:
         {
             rc = m_parent->stopRecording();
-            m_state = QCAMERA_SM_STATE_PREVIEWING;
+            setState(QCAMERA_SM_STATE_PREVIEWING);
             result.status = rc;
             result.request_api = evt;
             result.result_type = QCAMERA_API_RESULT_TYPE_DEF;
@@ -1635,16 +1953,11 @@ int32_t QCameraStateMachine::procEvtVideoPicTakingState(qcamera_sm_evt_enum_t ev
     case QCAMERA_SM_EVT_SET_PARAMS:
         {
             bool needRestart = false;
-            rc = m_parent->updateParameters((char*)payload, needRestart);
+            // cannot set parameters that requires restart during recording,
+            // they are rejected before any value is applied
+            rc = m_parent->updateParameters((char*)payload, needRestart, false);
             if (rc == NO_ERROR) {
-                if (needRestart) {
-                    // cannot set parameters that requires restart during recording
-                    ALOGE("%s: Cannot set parameters that requires restart during recording",
-                          __func__);
-                    rc = BAD_VALUE;
-                } else {
-                    rc = m_parent->commitParameterChanges();
-                }
+                rc = m_parent->commitParameterChanges();
             }
             result.status = rc;
             result.request_api = evt;
@@ -1743,7 +2056,7 @@ int32_t QCameraStateMachine::procEvtVideoPicTakingState(qcamera_sm_evt_enum_t ev
     case QCAMERA_SM_EVT_STOP_RECORDING:
         {
             rc = m_parent->stopRecording();
-            m_state = QCAMERA_SM_STATE_PREVIEW_PIC_TAKING;
+            setState(QCAMERA_SM_STATE_PREVIEW_PIC_TAKING);
             result.status = rc;
             result.request_api = evt;
             result.result_type = QCAMERA_API_RESULT_TYPE_DEF;
@@ -1762,7 +2075,7 @@ int32_t QCameraStateMachine::procEvtVideoPicTakingState(qcamera_sm_evt_enum_t ev
     case QCAMERA_SM_EVT_CANCEL_PICTURE:
         {
             rc = m_parent->cancelLiveSnapshot();
-            m_state = QCAMERA_SM_STATE_RECORDING;
+            setState(QCAMERA_SM_STATE_RECORDING);
             result.status = rc;
             result.request_api = evt;
             result.result_type = QCAMERA_API_RESULT_TYPE_DEF;
@@ -1821,7 +2134,7 @@ int32_t QCameraStateMachine::procEvtVideoPicTakingState(qcamera_sm_evt_enum_t ev
     case QCAMERA_SM_EVT_SNAPSHOT_DONE:
         {
             rc = m_parent->cancelLiveSnapshot();
-            m_state = QCAMERA_SM_STATE_RECORDING;
+            setState(QCAMERA_SM_STATE_RECORDING);
         }
         break;
     default:
@@ -1900,7 +2213,7 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
     case QCAMERA_SM_EVT_SET_PARAMS:
         {
             bool needRestart = false;
-            rc = m_parent->updateParameters((char*)payload, needRestart);
+            rc = m_parent->updateParameters((char*)payload, needRestart, true);
             if (rc == NO_ERROR) {
                 if (needRestart) {
                     // need restart preview for parameters to take effect
@@ -2020,7 +2333,7 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
     case QCAMERA_SM_EVT_CANCEL_PICTURE:
         {
             rc = m_parent->cancelLiveSnapshot();
-            m_state = QCAMERA_SM_STATE_PREVIEWING;
+            setState(QCAMERA_SM_STATE_PREVIEWING);
             result.status = rc;
             result.request_api = evt;
             result.result_type = QCAMERA_API_RESULT_TYPE_DEF;
@@ -2032,7 +2345,7 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
             m_parent->stopChannel(QCAMERA_CH_TYPE_PREVIEW);
             m_parent->delChannel(QCAMERA_CH_TYPE_PREVIEW);
             m_parent->delChannel(QCAMERA_CH_TYPE_VIDEO);
-            m_state = QCAMERA_SM_STATE_PIC_TAKING;
+            setState(QCAMERA_SM_STATE_PIC_TAKING);
             rc = NO_ERROR;
             result.status = rc;
             result.request_api = evt;
@@ -2044,7 +2357,7 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
         {
             rc = m_parent->stopRecording();
             if (rc == NO_ERROR) {
-                m_state = QCAMERA_SM_STATE_VIDEO_PIC_TAKING;
+                setState(QCAMERA_SM_STATE_VIDEO_PIC_TAKING);
             }
             result.status = rc;
             result.request_api = evt;
@@ -2104,7 +2417,7 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
     case QCAMERA_SM_EVT_SNAPSHOT_DONE:
         {
             rc = m_parent->cancelLiveSnapshot();
-            m_state = QCAMERA_SM_STATE_PREVIEWING;
+            setState(QCAMERA_SM_STATE_PREVIEWING);
         }
         break;
     default:
@@ -2115,6 +2428,87 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : setState
+ *
+ * DESCRIPTION: move statemachine to a new state and publish it to readers
+ *              in other threads. Called by cmd thread only, before API
+ *              result is signaled, so that a query following an API call
+ *              always sees the state that call left.
+ *
+ * PARAMETERS :
+ *   @state   : new state
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStateMachine::setState(qcamera_state_enum_t state)
+{
+    m_state = state;
+    __atomic_store_n(&m_publishedState, (int32_t)state, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : getPublishedState
+ *
+ * DESCRIPTION: get state last published by cmd thread. Safe to call from
+ *              any thread without lock.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : statemachine state
+ *==========================================================================*/
+QCameraStateMachine::qcamera_state_enum_t QCameraStateMachine::getPublishedState()
+{
+    return (qcamera_state_enum_t)__atomic_load_n(&m_publishedState,
+                                                 __ATOMIC_ACQUIRE);
+}
+
+/*===========================================================================
+ * FUNCTION   : isPreviewEnabled
+ *
+ * DESCRIPTION: lock free answer to preview_enabled, same as what
+ *              QCAMERA_SM_EVT_PREVIEW_ENABLED gives in current state.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true -- preview enabled
+ *              false -- preview not enabled
+ *==========================================================================*/
+bool QCameraStateMachine::isPreviewEnabled()
+{
+    switch (getPublishedState()) {
+    case QCAMERA_SM_STATE_PREVIEW_READY:
+    case QCAMERA_SM_STATE_PREVIEWING:
+    case QCAMERA_SM_STATE_VIDEO_PIC_TAKING:
+    case QCAMERA_SM_STATE_PREVIEW_PIC_TAKING:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : isRecordingEnabled
+ *
+ * DESCRIPTION: lock free answer to recording_enabled, same as what
+ *              QCAMERA_SM_EVT_RECORDING_ENABLED gives in current state.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true -- recording enabled
+ *              false -- recording not enabled
+ *==========================================================================*/
+bool QCameraStateMachine::isRecordingEnabled()
+{
+    switch (getPublishedState()) {
+    case QCAMERA_SM_STATE_RECORDING:
+    case QCAMERA_SM_STATE_VIDEO_PIC_TAKING:
+        return true;
+    default:
+        return false;
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : isPreviewRunning
  *
@@ -2127,7 +2521,7 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
  *==========================================================================*/
 bool QCameraStateMachine::isPreviewRunning()
 {
-    switch (m_state) {
+    switch (getPublishedState()) {
     case QCAMERA_SM_STATE_PREVIEWING:
     case QCAMERA_SM_STATE_RECORDING:
     case QCAMERA_SM_STATE_VIDEO_PIC_TAKING:
@@ -34,6 +34,7 @@
 #include <semaphore.h>
 #include "QCameraQueue.h"
 #include "QCameraChannel.h"
+#include "QCameraStreamMetrics.h"
 
 extern "C" {
 #include <mm_camera_interface.h>
@@ -139,6 +140,13 @@ public:
 
     bool isPreviewRunning(); // check if preview is running
 
+    // lock free queries, served from state published by cmd thread
+    // without a round trip through it
+    bool isPreviewEnabled();   // answer to preview_enabled
+    bool isRecordingEnabled(); // answer to recording_enabled
+
+    void dump(int fd); // queue stats, called from cmd thread
+
 private:
     typedef enum {
         QCAMERA_SM_STATE_PREVIEW_STOPPED,          // preview is stopped
@@ -158,13 +166,34 @@ private:
         QCAMERA_SM_CMD_TYPE_MAX
     } qcamera_sm_cmd_type_t;
 
+    // priority classes of cmds. Among evts cmd thread serves higher class
+    // first, while APIs and evts are served in the order they are queued.
+    typedef enum {
+        QCAMERA_SM_PRIO_CTRL,                      // server/jpeg evt, snapshot done
+        QCAMERA_SM_PRIO_INTERNAL,                  // per frame internal evt, coalesced
+        QCAMERA_SM_PRIO_API,                       // API, caller waits for result
+        QCAMERA_SM_PRIO_MAX
+    } qcamera_sm_prio_t;
+
     typedef struct {
         qcamera_sm_cmd_type_t cmd;                  // cmd type (where it comes from)
         qcamera_sm_evt_enum_t evt;                  // event type
         void *evt_payload;                          // ptr to payload
+        nsecs_t enqueue_ts;                         // time queued, for queue delay
+        uint32_t seq;                               // queue order across classes
     } qcamera_sm_cmd_t;
 
+    // APIs are serialized, so in flight cmds are mostly evts
+    static const int SM_CMD_POOL_DEPTH = 32;
+
     int32_t stateMachine(qcamera_sm_evt_enum_t evt, void *payload);
+    void setState(qcamera_state_enum_t state);
+    qcamera_state_enum_t getPublishedState();
+    qcamera_sm_cmd_t *allocCmd();
+    void freeCmd(qcamera_sm_cmd_t *node);
+    int32_t enqueueCmd(qcamera_sm_prio_t prio, qcamera_sm_cmd_t *node);
+    qcamera_sm_cmd_t *dequeueCmd();
+    bool coalesceEvt(qcamera_sm_evt_enum_t evt, void *evt_payload);
     int32_t procEvtPreviewStoppedState(qcamera_sm_evt_enum_t evt, void *payload);
     int32_t procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt, void *payload);
     int32_t procEvtPreviewingState(qcamera_sm_evt_enum_t evt, void *payload);
@@ -175,14 +204,29 @@ private:
 
     // main statemachine process routine
     static void *smEvtProcRoutine(void *data);
+    // match fn making room in a full internal queue
+    static bool mergeSameFocusState(void *data, void *match_data);
 
     QCamera2HardwareInterface *m_parent;  // ptr to HWI
     qcamera_state_enum_t m_state;         // statemachine state
-    QCameraQueue api_queue;               // cmd queue for APIs
-    QCameraQueue evt_queue;               // cmd queue for evt from mm-camera-intf/mm-jpeg-intf
+    int32_t m_publishedState;             // copy of m_state for other threads
+    QCameraQueue m_queues[QCAMERA_SM_PRIO_MAX]; // cmd queue per priority class
+    pthread_mutex_t m_queueLock;          // guards queue bookkeeping below
+    int m_queueDepth[QCAMERA_SM_PRIO_MAX];
+    int m_queuePeak[QCAMERA_SM_PRIO_MAX];
+    uint32_t m_overMaxCnt[QCAMERA_SM_PRIO_MAX]; // cmds queued beyond max depth
+    uint32_t m_enqueueSeq;                // seq of next queued cmd
+    uint32_t m_coalesceCnt[QCAMERA_SM_PRIO_MAX];
+    qcamera_sm_cmd_t *m_lastInternalCmd;  // newest pending internal cmd, for coalescing
+    QCameraLatencyHist m_queueDelay[QCAMERA_SM_PRIO_MAX]; // cmd thread only
     pthread_t cmd_pid;                    // cmd thread ID
     sem_t cmd_sem;                        // semaphore for cmd thread
 
+    qcamera_sm_cmd_t m_cmdPool[SM_CMD_POOL_DEPTH]; // preallocated cmd nodes
+    qcamera_sm_cmd_t *m_freeCmds[SM_CMD_POOL_DEPTH];
+    int m_freeCmdCnt;
+    uint32_t m_cmdOverflowCnt;            // cmds malloc'ed due to empty pool
+    pthread_mutex_t m_cmdPoolLock;
 };
 
 }; // namespace android
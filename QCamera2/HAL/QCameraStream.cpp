@@ -64,6 +64,16 @@ int32_t QCameraStream::put_bufs(
     return stream->putBufs(ops_tbl);
 }
 
+int32_t QCameraStream::invalidate_buf(uint32_t index, void *user_data)
+{
+    QCameraStream *stream = reinterpret_cast<QCameraStream *>(user_data);
+    if (!stream || !stream->mStreamBufs) {
+        ALOGE("invalidateBuf invalid stream pointer");
+        return NO_MEMORY;
+    }
+    return stream->mStreamBufs->invalidateCache(index);
+}
+
 QCameraStream::QCameraStream(QCameraAllocator &allocator,
                              uint32_t camHandle,
                              uint32_t chId,
@@ -78,11 +88,14 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
         mDataCB(NULL),
         mStreamInfoBuf(NULL),
         mStreamBufs(NULL),
+        mKeptBufs(NULL),
+        mKeepBufs(false),
         mAllocator(allocator)
 {
     mMemVtbl.user_data = this;
     mMemVtbl.get_bufs = get_bufs;
     mMemVtbl.put_bufs = put_bufs;
+    mMemVtbl.invalidate_buf = invalidate_buf;
     memset(&mBufDef[0], 0, sizeof(mBufDef));
     memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
     memcpy(&mPaddingInfo, paddingInfo, sizeof(cam_padding_info_t));
@@ -168,6 +181,7 @@ done:
 int32_t QCameraStream::start()
 {
     int32_t rc = 0;
+    mMetrics.reset();
     rc = mProcTh.launch(dataProcRoutine, this);
     return rc;
 }
@@ -179,6 +193,53 @@ int32_t QCameraStream::stop()
     return rc;
 }
 
+// Give stream a new dimension/format while its channel keeps running.
+// Only this stream is restarted, and its buffers are kept if they fit.
+int32_t QCameraStream::reconfig(const cam_dimension_t &dim, cam_format_t fmt)
+{
+    int32_t rc = NO_ERROR;
+    mm_camera_stream_config_t stream_config;
+    cam_dimension_t oldDim = mStreamInfo->dim;
+    cam_format_t oldFmt = mStreamInfo->fmt;
+
+    // no frame of old config may reach the owner after stream info changes
+    mProcTh.exit();
+
+    mStreamInfo->dim = dim;
+    mStreamInfo->fmt = fmt;
+    stream_config.stream_info = mStreamInfo;
+    stream_config.mem_vtbl = mMemVtbl;
+    stream_config.stream_cb = dataNotifyCB;
+    stream_config.padding_info = mPaddingInfo;
+    stream_config.userdata = this;
+
+    mKeepBufs = true;
+    rc = mCamOps->reconfig_stream(mCamHandle,
+                mChannelHandle, mHandle, &stream_config);
+    mKeepBufs = false;
+    if (rc < 0) {
+        ALOGE("Failed to reconfig stream, rc = %d", rc);
+        mStreamInfo->dim = oldDim;
+        mStreamInfo->fmt = oldFmt;
+    }
+
+    // bufs were kept but stream failed before getting them back
+    if (mKeptBufs != NULL) {
+        for (int i = 0; i < mKeptBufs->getCnt(); i++) {
+            mCamOps->unmap_stream_buf(mCamHandle, mChannelHandle, mHandle,
+                    CAM_MAPPING_BUF_TYPE_STREAM_BUF, i, -1);
+        }
+        mKeptBufs->deallocate();
+        delete mKeptBufs;
+        mKeptBufs = NULL;
+    }
+
+    // frames queued while stream was stopping point to old bufs
+    mDataQ.flush();
+    mProcTh.launch(dataProcRoutine, this);
+    return rc;
+}
+
 int32_t QCameraStream::processZoomDone(preview_stream_ops_t *previewWindow)
 {
     int32_t rc = 0;
@@ -222,6 +283,7 @@ void QCameraStream::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
         ALOGE("%s: Not a valid stream to handle buf", __func__);
         return;
     }
+    stream->mMetrics.frameArrived(recvd_frame->bufs[0]);
 
     mm_camera_super_buf_t *frame =
         (mm_camera_super_buf_t *)malloc(sizeof(mm_camera_super_buf_t));
@@ -262,6 +324,7 @@ void *QCameraStream::dataProcRoutine(void *data)
                 mm_camera_super_buf_t *frame =
                     (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
                 if (NULL != frame) {
+                    pme->mMetrics.callbackStarted(frame->bufs[0]);
                     if (pme->mDataCB != NULL) {
                         pme->mDataCB(frame, pme, pme->mUserData);
                     } else {
@@ -295,6 +358,7 @@ int32_t QCameraStream::bufDone(int index)
     rc = mCamOps->qbuf(mCamHandle, mChannelHandle, &mBufDef[index]);
     if (rc < 0)
         return rc;
+    mMetrics.bufReturned(index);
 
     mStreamBufs->invalidateCache(index);
     return rc;
@@ -329,26 +393,45 @@ int32_t QCameraStream::getBufs(cam_frame_len_offset_t *offset,
 
     mFrameLenOffset = *offset;
 
-    //Allocate and map stream info buffer
-    mStreamBufs = mAllocator.allocateStreamBuf(mStreamInfo->stream_type,
-                                mFrameLenOffset.frame_len);
-    if (!mStreamBufs) {
-        ALOGE("Failed to allocate stream buffers");
-        return NO_MEMORY;
+    // bufs kept over reconfig are handed out again, still mapped,
+    // if the new frame fits in them
+    if (mKeptBufs != NULL) {
+        if (mAllocator.canReuseStreamBuf(mStreamInfo->stream_type,
+                    mKeptBufs, mFrameLenOffset.frame_len)) {
+            mStreamBufs = mKeptBufs;
+        } else {
+            for (int i = 0; i < mKeptBufs->getCnt(); i++) {
+                ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+            }
+            mKeptBufs->deallocate();
+            delete mKeptBufs;
+        }
+        mKeptBufs = NULL;
     }
 
-    mNumBufs = mStreamBufs->getCnt();
-    for (int i = 0; i < mNumBufs; i++) {
-        rc = ops_tbl->map_ops(i, -1, mStreamBufs->getFd(i),
-                mStreamBufs->getSize(i), ops_tbl->userdata);
-        if (rc < 0) {
-            ALOGE("getBufs: map_stream_buf failed: %d", rc);
-            for (int j = 0; j < i; j++) {
-                ops_tbl->unmap_ops(j, -1, ops_tbl->userdata);
+    if (mStreamBufs == NULL) {
+        //Allocate and map stream info buffer
+        mStreamBufs = mAllocator.allocateStreamBuf(mStreamInfo->stream_type,
+                                    mFrameLenOffset.frame_len);
+        if (!mStreamBufs) {
+            ALOGE("Failed to allocate stream buffers");
+            return NO_MEMORY;
+        }
+
+        mNumBufs = mStreamBufs->getCnt();
+        for (int i = 0; i < mNumBufs; i++) {
+            rc = ops_tbl->map_ops(i, -1, mStreamBufs->getFd(i),
+                    mStreamBufs->getSize(i), ops_tbl->userdata);
+            if (rc < 0) {
+                ALOGE("getBufs: map_stream_buf failed: %d", rc);
+                for (int j = 0; j < i; j++) {
+                    ops_tbl->unmap_ops(j, -1, ops_tbl->userdata);
+                }
+                mStreamBufs->deallocate();
+                delete mStreamBufs;
+                mStreamBufs = NULL;
+                return INVALID_OPERATION;
             }
-            mStreamBufs->deallocate();
-            delete mStreamBufs;
-            return INVALID_OPERATION;
         }
     }
 
@@ -361,12 +444,20 @@ int32_t QCameraStream::getBufs(cam_frame_len_offset_t *offset,
         }
         mStreamBufs->deallocate();
         delete mStreamBufs;
+        mStreamBufs = NULL;
         return NO_MEMORY;
     }
 
+    int indices[MM_CAMERA_MAX_NUM_FRAMES];
     for (int i = 0; i < mNumBufs; i++) {
         mStreamBufs->getBufDef(mFrameLenOffset, mBufDef[i], i);
+        indices[i] = i;
     }
+
+    // buffers may come from the memory pool with lines of a former owner
+    // still cached, drop them before hardware starts writing
+    mStreamBufs->setCacheRange(mFrameLenOffset);
+    mStreamBufs->cacheOpsBatch(indices, mNumBufs, ION_IOC_INV_CACHES);
     rc = mStreamBufs->getRegFlags(regFlags);
     if (rc < 0) {
         ALOGE("getBufs: getRegFlags failed %d", rc);
@@ -375,6 +466,7 @@ int32_t QCameraStream::getBufs(cam_frame_len_offset_t *offset,
         }
         mStreamBufs->deallocate();
         delete mStreamBufs;
+        mStreamBufs = NULL;
         return INVALID_OPERATION;
     }
 
@@ -387,6 +479,14 @@ int32_t QCameraStream::getBufs(cam_frame_len_offset_t *offset,
 int32_t QCameraStream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
 {
     int rc = NO_ERROR;
+    if (mKeepBufs) {
+        // stream is being reconfigured, getBufs decides if they are reused
+        memset(&mBufDef[0], 0, sizeof(mBufDef));
+        mKeptBufs = mStreamBufs;
+        mStreamBufs = NULL;
+        return NO_ERROR;
+    }
+
     for (int i = 0; i < mNumBufs; i++) {
         rc = ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
         if (rc < 0) {
@@ -397,6 +497,7 @@ int32_t QCameraStream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
     memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
     mStreamBufs->deallocate();
     delete mStreamBufs;
+    mStreamBufs = NULL;
 
     return rc;
 }
@@ -443,4 +544,19 @@ int32_t QCameraStream::getFormat(cam_format_t &fmt)
     return -1;
 }
 
+void QCameraStream::dumpMetrics(int fd)
+{
+    static const char *names[] = {
+        "default", "preview", "postview", "snapshot",
+        "video", "raw", "metadata", "offline_proc"
+    };
+    const char *name = "unknown";
+
+    if (mStreamInfo != NULL &&
+        (size_t)mStreamInfo->stream_type < sizeof(names) / sizeof(names[0])) {
+        name = names[mStreamInfo->stream_type];
+    }
+    mMetrics.dump(fd, name);
+}
+
 }; // namespace android
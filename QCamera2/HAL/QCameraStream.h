@@ -34,6 +34,7 @@
 #include "QCameraCmdThread.h"
 #include "QCameraMem.h"
 #include "QCameraAllocator.h"
+#include "QCameraStreamMetrics.h"
 
 extern "C" {
 #include <mm_camera_interface.h>
@@ -63,6 +64,7 @@ public:
     virtual int32_t processDataNotify(mm_camera_super_buf_t *bufs);
     virtual int32_t start();
     virtual int32_t stop();
+    virtual int32_t reconfig(const cam_dimension_t &dim, cam_format_t fmt);
 
     static void dataNotifyCB(mm_camera_super_buf_t *recvd_frame, void *userdata);
     static void *dataProcRoutine(void *data);
@@ -72,6 +74,8 @@ public:
     int32_t getCropInfo(cam_rect_t &crop);
     int32_t getFrameDimension(cam_dimension_t &dim);
     int32_t getFormat(cam_format_t &fmt);
+    QCameraStreamMetrics &getMetrics() {return mMetrics;}
+    void dumpMetrics(int fd);
 
 private:
     uint32_t mCamHandle;
@@ -89,10 +93,13 @@ private:
 
     QCameraHeapMemory *mStreamInfoBuf;
     QCameraMemory *mStreamBufs;
+    QCameraMemory *mKeptBufs; // still mapped bufs held over reconfig
+    bool mKeepBufs;           // putBufs keeps bufs for reconfig
     QCameraAllocator &mAllocator;
     mm_camera_buf_def_t mBufDef[MM_CAMERA_MAX_NUM_FRAMES];
     cam_frame_len_offset_t mFrameLenOffset;
     cam_padding_info_t mPaddingInfo;
+    QCameraStreamMetrics mMetrics; // frame timing of this stream
 
     static int32_t get_bufs(
                      cam_frame_len_offset_t *offset,
@@ -104,6 +111,7 @@ private:
     static int32_t put_bufs(
                      mm_camera_map_unmap_ops_tbl_t *ops_tbl,
                      void *user_data);
+    static int32_t invalidate_buf(uint32_t index, void *user_data);
 
     int32_t getBufs(cam_frame_len_offset_t *offset,
                      uint8_t *num_bufs,
@@ -0,0 +1,446 @@
+/* Copyright (c) 2012, The Linux Foundataion. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#define LOG_TAG "QCameraStreamMetrics"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/Log.h>
+#include "QCameraStreamMetrics.h"
+
+namespace android {
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: clear all recorded values
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraLatencyHist::reset()
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mCount = 0;
+    mMin = 0;
+    mMax = 0;
+    mSum = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : valueToIdx
+ *
+ * DESCRIPTION: find bucket of a value. Values below QCAMERA_HIST_SUB_CNT
+ *              have a bucket each, above that every power of 2 is split
+ *              into QCAMERA_HIST_SUB_CNT linear buckets.
+ *
+ * PARAMETERS :
+ *   @val     : value in us
+ *
+ * RETURN     : bucket index
+ *==========================================================================*/
+int QCameraLatencyHist::valueToIdx(int64_t val)
+{
+    if (val < QCAMERA_HIST_SUB_CNT) {
+        return val < 0 ? 0 : (int)val;
+    }
+    int msb = 63 - __builtin_clzll((uint64_t)val);
+    if (msb >= QCAMERA_HIST_MAX_BITS) {
+        return QCAMERA_HIST_BUCKETS - 1;
+    }
+    return (msb - QCAMERA_HIST_SUB_BITS + 1) * QCAMERA_HIST_SUB_CNT +
+        (int)((val >> (msb - QCAMERA_HIST_SUB_BITS)) & (QCAMERA_HIST_SUB_CNT - 1));
+}
+
+/*===========================================================================
+ * FUNCTION   : idxToValue
+ *
+ * DESCRIPTION: middle value of a bucket
+ *
+ * PARAMETERS :
+ *   @idx     : bucket index
+ *
+ * RETURN     : value in us
+ *==========================================================================*/
+int64_t QCameraLatencyHist::idxToValue(int idx)
+{
+    if (idx < QCAMERA_HIST_SUB_CNT) {
+        return idx;
+    }
+    int msb = idx / QCAMERA_HIST_SUB_CNT + QCAMERA_HIST_SUB_BITS - 1;
+    int64_t sub = idx % QCAMERA_HIST_SUB_CNT;
+    int shift = msb - QCAMERA_HIST_SUB_BITS;
+    return ((QCAMERA_HIST_SUB_CNT + sub) << shift) + ((1LL << shift) >> 1);
+}
+
+/*===========================================================================
+ * FUNCTION   : record
+ *
+ * DESCRIPTION: add one value
+ *
+ * PARAMETERS :
+ *   @val     : value in ns
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraLatencyHist::record(nsecs_t val)
+{
+    int64_t us = nanoseconds_to_microseconds(val);
+    if (us < 0) {
+        us = 0;
+    }
+    mBuckets[valueToIdx(us)]++;
+    if (mCount == 0 || us < mMin) {
+        mMin = us;
+    }
+    if (us > mMax) {
+        mMax = us;
+    }
+    mSum += us;
+    mCount++;
+}
+
+/*===========================================================================
+ * FUNCTION   : getPercentile
+ *
+ * DESCRIPTION: value below or at which pct percent of values fall
+ *
+ * PARAMETERS :
+ *   @pct     : percentile, 0 - 100
+ *
+ * RETURN     : value in us, 0 if nothing recorded
+ *==========================================================================*/
+int64_t QCameraLatencyHist::getPercentile(double pct) const
+{
+    uint32_t target = (uint32_t)(pct * mCount / 100.0 + 0.5);
+    uint32_t acc = 0;
+
+    if (mCount == 0) {
+        return 0;
+    }
+    if (target == 0) {
+        target = 1;
+    }
+    for (int i = 0; i < QCAMERA_HIST_BUCKETS; i++) {
+        acc += mBuckets[i];
+        if (acc >= target) {
+            int64_t val = idxToValue(i);
+            if (val < mMin) {
+                return mMin;
+            }
+            return val > mMax ? mMax : val;
+        }
+    }
+    return mMax;
+}
+
+/*===========================================================================
+ * FUNCTION   : print
+ *
+ * DESCRIPTION: print summary of the histogram into one line
+ *
+ * PARAMETERS :
+ *   @buf     : output buffer
+ *   @len     : size of output buffer
+ *   @name    : name of the histogram
+ *
+ * RETURN     : num of chars written
+ *==========================================================================*/
+int QCameraLatencyHist::print(char *buf, size_t len, const char *name) const
+{
+    int n = snprintf(buf, len,
+            "    %-18s n %u, min %lld, p50 %lld, p90 %lld, p99 %lld, "
+            "max %lld, mean %lld us\n",
+            name, mCount, (long long)getMin(), (long long)getPercentile(50),
+            (long long)getPercentile(90), (long long)getPercentile(99),
+            (long long)getMax(), (long long)getMean());
+    return (n < 0 || (size_t)n >= len) ? (int)len - 1 : n;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraStreamMetrics
+ *
+ * DESCRIPTION: constructor of QCameraStreamMetrics
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraStreamMetrics::QCameraStreamMetrics()
+{
+    pthread_mutex_init(&mLock, NULL);
+    reset();
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraStreamMetrics
+ *
+ * DESCRIPTION: deconstructor of QCameraStreamMetrics
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraStreamMetrics::~QCameraStreamMetrics()
+{
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: clear all metrics, called when the stream starts
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStreamMetrics::reset()
+{
+    pthread_mutex_lock(&mLock);
+    mDequeueToCb.reset();
+    mCbToBufDone.reset();
+    mSuperBufSpread.reset();
+    mInterval.reset();
+    mJitter.reset();
+    memset(mCbTs, 0, sizeof(mCbTs));
+    mFrames = 0;
+    mDrops = 0;
+    mLastFrameIdx = 0;
+    mFirstFrameTs = 0;
+    mLastFrameTs = 0;
+    mLastInterval = 0;
+    mFpsLastFrames = 0;
+    mFpsLastTs = 0;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : bufTimestamp
+ *
+ * DESCRIPTION: kernel timestamp of a buffer
+ *
+ * PARAMETERS :
+ *   @buf     : stream buffer
+ *
+ * RETURN     : timestamp in ns, 0 if the buffer carries none
+ *==========================================================================*/
+nsecs_t QCameraStreamMetrics::bufTimestamp(const mm_camera_buf_def_t *buf)
+{
+    return seconds_to_nanoseconds(buf->ts.tv_sec) + buf->ts.tv_nsec;
+}
+
+/*===========================================================================
+ * FUNCTION   : frameArrived
+ *
+ * DESCRIPTION: account a new frame of the stream. A frame delivered both
+ *              to the stream callback and in a channel superbuf is only
+ *              counted once.
+ *
+ * PARAMETERS :
+ *   @buf     : stream buffer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStreamMetrics::frameArrived(const mm_camera_buf_def_t *buf)
+{
+    nsecs_t ts = bufTimestamp(buf);
+
+    pthread_mutex_lock(&mLock);
+    if (mFrames > 0 && ts != 0 && ts <= mLastFrameTs) {
+        // seen already, or late from the other delivery path
+        pthread_mutex_unlock(&mLock);
+        return;
+    }
+    if (mFrames > 0 && buf->frame_idx > mLastFrameIdx + 1) {
+        mDrops += buf->frame_idx - mLastFrameIdx - 1;
+    }
+    if (ts != 0) {
+        if (mLastFrameTs != 0) {
+            nsecs_t interval = ts - mLastFrameTs;
+            mInterval.record(interval);
+            if (mLastInterval != 0) {
+                nsecs_t delta = interval - mLastInterval;
+                mJitter.record(delta < 0 ? -delta : delta);
+            }
+            mLastInterval = interval;
+        } else {
+            mFirstFrameTs = ts;
+        }
+        mLastFrameTs = ts;
+    }
+    mLastFrameIdx = buf->frame_idx;
+    mFrames++;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : callbackStarted
+ *
+ * DESCRIPTION: account a buffer being handed to its data callback. Only
+ *              the first callback of a buffer is timed.
+ *
+ * PARAMETERS :
+ *   @buf     : stream buffer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStreamMetrics::callbackStarted(const mm_camera_buf_def_t *buf)
+{
+    nsecs_t now = systemTime();
+    nsecs_t ts = bufTimestamp(buf);
+
+    if (buf->buf_idx < 0 || buf->buf_idx >= MM_CAMERA_MAX_NUM_FRAMES) {
+        return;
+    }
+
+    pthread_mutex_lock(&mLock);
+    if (mCbTs[buf->buf_idx] == 0) {
+        mCbTs[buf->buf_idx] = now;
+        if (ts != 0 && now >= ts) {
+            mDequeueToCb.record(now - ts);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : bufReturned
+ *
+ * DESCRIPTION: account a buffer returned to kernel
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStreamMetrics::bufReturned(int index)
+{
+    nsecs_t now = systemTime();
+
+    if (index < 0 || index >= MM_CAMERA_MAX_NUM_FRAMES) {
+        return;
+    }
+
+    pthread_mutex_lock(&mLock);
+    if (mCbTs[index] != 0) {
+        mCbToBufDone.record(now - mCbTs[index]);
+        mCbTs[index] = 0;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : superBufSpread
+ *
+ * DESCRIPTION: account how far the kernel timestamp of a frame of this
+ *              stream lags the latest frame of its superbuf. This is the
+ *              spread of the sensor timestamps, not the time the frame
+ *              spent queued in the channel, which also includes dequeue
+ *              and matching delays.
+ *
+ * PARAMETERS :
+ *   @lag     : timestamp lag in ns
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStreamMetrics::superBufSpread(nsecs_t lag)
+{
+    pthread_mutex_lock(&mLock);
+    mSuperBufSpread.record(lag);
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : pollFps
+ *
+ * DESCRIPTION: frame rate since the last successful poll, updated at most
+ *              every 250 ms
+ *
+ * PARAMETERS :
+ *   @fps     : output frame rate
+ *
+ * RETURN     : true if fps is updated
+ *==========================================================================*/
+bool QCameraStreamMetrics::pollFps(float &fps)
+{
+    bool updated = false;
+    nsecs_t now = systemTime();
+
+    pthread_mutex_lock(&mLock);
+    nsecs_t diff = now - mFpsLastTs;
+    if (diff > ms2ns(250)) {
+        fps = ((mFrames - mFpsLastFrames) * float(s2ns(1))) / diff;
+        mFpsLastTs = now;
+        mFpsLastFrames = mFrames;
+        updated = true;
+    }
+    pthread_mutex_unlock(&mLock);
+    return updated;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: write stream metrics to fd
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to dump into
+ *   @name    : name of the stream
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStreamMetrics::dump(int fd, const char *name)
+{
+    char buf[1024];
+    int len = 0;
+    float fps = 0;
+
+    pthread_mutex_lock(&mLock);
+    if (mFrames > 1 && mLastFrameTs > mFirstFrameTs) {
+        fps = ((mFrames - 1) * float(s2ns(1))) / (mLastFrameTs - mFirstFrameTs);
+    }
+    len += snprintf(buf + len, sizeof(buf) - len,
+            "  Stream %s: frames %u, drops %u, avg fps %.2f\n",
+            name, mFrames, mDrops, fps);
+    len += mDequeueToCb.print(buf + len, sizeof(buf) - len, "dequeue->callback");
+    len += mCbToBufDone.print(buf + len, sizeof(buf) - len, "callback->bufDone");
+    if (mSuperBufSpread.getCount() > 0) {
+        len += mSuperBufSpread.print(buf + len, sizeof(buf) - len, "superbuf ts spread");
+    }
+    len += mInterval.print(buf + len, sizeof(buf) - len, "frame interval");
+    len += mJitter.print(buf + len, sizeof(buf) - len, "jitter");
+    pthread_mutex_unlock(&mLock);
+
+    write(fd, buf, len);
+}
+
+}; // namespace android
@@ -0,0 +1,118 @@
+/* Copyright (c) 2012, The Linux Foundataion. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_STREAM_METRICS_H__
+#define __QCAMERA_STREAM_METRICS_H__
+
+#include <pthread.h>
+#include <utils/Timers.h>
+
+extern "C" {
+#include <mm_camera_interface.h>
+}
+
+namespace android {
+
+/* 8 sub buckets per power of 2, values kept within 6.25% */
+#define QCAMERA_HIST_SUB_BITS        3
+#define QCAMERA_HIST_SUB_CNT         (1 << QCAMERA_HIST_SUB_BITS)
+/* values up to 2^27 us (~134 s) */
+#define QCAMERA_HIST_MAX_BITS        27
+#define QCAMERA_HIST_BUCKETS \
+    ((QCAMERA_HIST_MAX_BITS - QCAMERA_HIST_SUB_BITS + 1) * QCAMERA_HIST_SUB_CNT)
+
+// Log-linear latency histogram in microseconds (HdrHistogram style):
+// fixed size, no allocation on record, bounded relative error.
+class QCameraLatencyHist {
+public:
+    QCameraLatencyHist() { reset(); }
+    void reset();
+    void record(nsecs_t val);
+    uint32_t getCount() const { return mCount; }
+    int64_t getPercentile(double pct) const;
+    int64_t getMin() const { return mCount ? mMin : 0; }
+    int64_t getMax() const { return mMax; }
+    int64_t getMean() const { return mCount ? mSum / mCount : 0; }
+    int print(char *buf, size_t len, const char *name) const;
+
+private:
+    static int valueToIdx(int64_t val);
+    static int64_t idxToValue(int idx);
+
+    uint32_t mBuckets[QCAMERA_HIST_BUCKETS];
+    uint32_t mCount;
+    int64_t mMin;
+    int64_t mMax;
+    int64_t mSum;
+};
+
+// Frame timing of one stream. Fed from stream/channel data callbacks and
+// bufDone, printed by HAL dump(). Kernel buffer timestamps are taken on
+// CLOCK_MONOTONIC, same clock as systemTime().
+class QCameraStreamMetrics {
+public:
+    QCameraStreamMetrics();
+    virtual ~QCameraStreamMetrics();
+
+    void reset();
+    void frameArrived(const mm_camera_buf_def_t *buf);
+    void callbackStarted(const mm_camera_buf_def_t *buf);
+    void bufReturned(int index);
+    void superBufSpread(nsecs_t lag);
+    bool pollFps(float &fps);
+    void dump(int fd, const char *name);
+
+private:
+    static nsecs_t bufTimestamp(const mm_camera_buf_def_t *buf);
+
+    pthread_mutex_t mLock;
+
+    QCameraLatencyHist mDequeueToCb;    // kernel timestamp -> data callback
+    QCameraLatencyHist mCbToBufDone;    // data callback -> bufDone
+    QCameraLatencyHist mSuperBufSpread; // kernel ts lag behind superbuf latest
+    QCameraLatencyHist mInterval;       // between kernel timestamps
+    QCameraLatencyHist mJitter;         // change of consecutive intervals
+
+    nsecs_t mCbTs[MM_CAMERA_MAX_NUM_FRAMES]; // callback time per buf, 0 if none
+
+    uint32_t mFrames;
+    uint32_t mDrops;                    // gaps in frame_idx
+    uint32_t mLastFrameIdx;
+    nsecs_t mFirstFrameTs;
+    nsecs_t mLastFrameTs;
+    nsecs_t mLastInterval;
+
+    // windowed fps for persist.debug.sf.showfps
+    uint32_t mFpsLastFrames;
+    nsecs_t mFpsLastTs;
+};
+
+}; // namespace android
+
+#endif /* __QCAMERA_STREAM_METRICS_H__ */
@@ -30,6 +30,8 @@
 #ifndef __QCAMERA_INTF_H__
 #define __QCAMERA_INTF_H__
 
+#include <stddef.h>
+#include <string.h>
 #include "cam_types.h"
 
 #define CAM_PRIV_IOCTL_BASE (V4L2_CID_PRIVATE_BASE + 14)
@@ -196,76 +198,234 @@ typedef struct {
  *                 Code for Domain Socket Based Parameters                   *
  ****************************************************************************/
 
-#define POINTER_OF(PARAM_ID,TABLE_PTR)    \
-        (&(TABLE_PTR->entry[PARAM_ID].data))
-
-#define GET_FIRST_PARAM_ID(TABLE_PTR)     \
-        (TABLE_PTR->first_flagged_entry)
-
-#define SET_FIRST_PARAM_ID(TABLE_PTR,PARAM_ID)     \
-        TABLE_PTR->first_flagged_entry=PARAM_ID
-
-#define GET_NEXT_PARAM_ID(CURRENT_PARAM_ID,TABLE_PTR)    \
-        (TABLE_PTR->entry[CURRENT_PARAM_ID].next_flagged_entry)
-
-#define SET_NEXT_PARAM_ID(CURRENT_PARAM_ID,TABLE_PTR,NEXT_PARAM_ID)    \
-        TABLE_PTR->entry[CURRENT_PARAM_ID].next_flagged_entry=NEXT_PARAM_ID;
+/* Parameters are passed to and from server in parm_buffer_t, a versioned
+ * batch of packed entries. Each entry is a cam_parm_entry_hdr_t followed by
+ * the value of the parameter, padded to CAM_PARM_ALIGN. Only parameters
+ * added since the batch was last initialized are present, in the order
+ * first added: the dirty bitmap marks their ids and offset[] locates each
+ * of them in data[]. Adding, updating or looking up an entry is O(1), and
+ * initializing or copying a batch costs only the bytes in use. */
 
 #define INCLUDE(PARAM_ID,DATATYPE,COUNT)  \
-        DATATYPE member_variable_##PARAM_ID[ COUNT ]
+        DATATYPE member_variable_##PARAM_ID[ COUNT ];
 
-typedef union {
 /**************************************************************************************
  *          ID from (cam_intf_parm_type_t)          DATATYPE                     COUNT
  **************************************************************************************/
-    INCLUDE(CAM_INTF_PARM_QUERY_FLASH4SNAP,         int32_t,                     1); //read only
-
-    INCLUDE(CAM_INTF_PARM_EXPOSURE,                 int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_SHARPNESS,                int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_CONTRAST,                 int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_SATURATION,               int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_BRIGHTNESS,               int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_WHITE_BALANCE,            int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_ISO,                      int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_ZOOM,                     int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_ANTIBANDING,              int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_EFFECT,                   int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_FPS_RANGE,                cam_fps_range_t,             1);
-    INCLUDE(CAM_INTF_PARM_EXPOSURE_COMPENSATION,    int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_LED_MODE,                 int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_ROLLOFF,                  int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_MODE,                     int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_AEC_ALGO_TYPE,            int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_FOCUS_ALGO_TYPE,          int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_AEC_ROI,                  cam_set_aec_roi_t,           1);
-    INCLUDE(CAM_INTF_PARM_AF_ROI,                   cam_roi_info_t,              1);
-    INCLUDE(CAM_INTF_PARM_FOCUS_MODE,               int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_BESTSHOT_MODE,            int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_SCE_FACTOR,               int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_FD,                       cam_fd_set_parm_t,           1);
-    INCLUDE(CAM_INTF_PARM_AEC_LOCK,                 int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_AWB_LOCK,                 int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_MCE,                      int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_HFR,                      int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_REDEYE_REDUCTION,         int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_WAVELET_DENOISE,          cam_denoise_param_t,         1);
-    INCLUDE(CAM_INTF_PARM_HISTOGRAM,                int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_ASD_ENABLE,               int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_RECORDING_HINT,           int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_DIS_ENABLE,               int32_t,                     1);
-    INCLUDE(CAM_INTF_PARM_HDR,                      cam_exp_bracketing_t,        1);
+#define CAM_INTF_PARM_TABLE(INCLUDE) \
+    INCLUDE(CAM_INTF_PARM_QUERY_FLASH4SNAP,         int32_t,                     1) /* read only */ \
+    INCLUDE(CAM_INTF_PARM_EXPOSURE,                 int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_SHARPNESS,                int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_CONTRAST,                 int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_SATURATION,               int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_BRIGHTNESS,               int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_WHITE_BALANCE,            int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_ISO,                      int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_ZOOM,                     int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_ANTIBANDING,              int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_EFFECT,                   int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_FPS_RANGE,                cam_fps_range_t,             1) \
+    INCLUDE(CAM_INTF_PARM_EXPOSURE_COMPENSATION,    int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_LED_MODE,                 int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_ROLLOFF,                  int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_MODE,                     int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_AEC_ALGO_TYPE,            int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_FOCUS_ALGO_TYPE,          int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_AEC_ROI,                  cam_set_aec_roi_t,           1) \
+    INCLUDE(CAM_INTF_PARM_AF_ROI,                   cam_roi_info_t,              1) \
+    INCLUDE(CAM_INTF_PARM_FOCUS_MODE,               int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_BESTSHOT_MODE,            int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_SCE_FACTOR,               int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_FD,                       cam_fd_set_parm_t,           1) \
+    INCLUDE(CAM_INTF_PARM_AEC_LOCK,                 int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_AWB_LOCK,                 int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_MCE,                      int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_HFR,                      int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_REDEYE_REDUCTION,         int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_WAVELET_DENOISE,          cam_denoise_param_t,         1) \
+    INCLUDE(CAM_INTF_PARM_HISTOGRAM,                int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_ASD_ENABLE,               int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_RECORDING_HINT,           int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_DIS_ENABLE,               int32_t,                     1) \
+    INCLUDE(CAM_INTF_PARM_HDR,                      cam_exp_bracketing_t,        1)
+
+typedef union {
+    CAM_INTF_PARM_TABLE(INCLUDE)
 } parm_type_t;
 
-/****************************DO NOT MODIFY BELOW THIS LINE!!!!*********************/
+#define CAM_PARM_BATCH_VERSION      1
+#define CAM_PARM_ALIGN              4
+#define CAM_PARM_ALIGNED(LEN)       \
+        (((LEN) + CAM_PARM_ALIGN - 1) & ~(CAM_PARM_ALIGN - 1))
 
 typedef struct {
-    parm_type_t data;
-    uint8_t next_flagged_entry;
-} parm_entry_type_t;
+    uint16_t id;                /* cam_intf_parm_type_t */
+    uint16_t len;               /* bytes of value following the header */
+} cam_parm_entry_hdr_t;
+
+#define CAM_PARM_ENTRY_SPACE(PARAM_ID,DATATYPE,COUNT)  \
+        + sizeof(cam_parm_entry_hdr_t) + CAM_PARM_ALIGNED(sizeof(DATATYPE) * (COUNT))
+
+/* room for every parameter at once */
+#define CAM_PARM_BATCH_DATA_SIZE    (0 CAM_INTF_PARM_TABLE(CAM_PARM_ENTRY_SPACE))
+#define CAM_PARM_BITMAP_WORDS       ((CAM_INTF_PARM_MAX + 31) / 32)
+#define CAM_PARM_OFFSET_CNT         ((CAM_INTF_PARM_MAX + 1) & ~1)
 
 typedef struct {
-    uint8_t first_flagged_entry;
-    parm_entry_type_t entry[CAM_INTF_PARM_MAX];
+    uint32_t version;                           /* CAM_PARM_BATCH_VERSION */
+    uint32_t used;                              /* bytes of data[] in use */
+    uint32_t dirty[CAM_PARM_BITMAP_WORDS];      /* ids present in batch */
+    uint16_t offset[CAM_PARM_OFFSET_CNT];       /* entry offset in data[],
+                                                 * valid only if id is dirty */
+    uint8_t data[CAM_PARM_BATCH_DATA_SIZE];     /* packed entries */
 } parm_buffer_t;
 
+#define CAM_PARM_SIZE_CASE(PARAM_ID,DATATYPE,COUNT)  \
+        case PARAM_ID: return (uint32_t)(sizeof(DATATYPE) * (COUNT));
+
+/* size of the value of a parameter, 0 for unknown id */
+static inline uint32_t cam_parm_value_size(uint32_t id)
+{
+    switch (id) {
+    CAM_INTF_PARM_TABLE(CAM_PARM_SIZE_CASE)
+    default:
+        return 0;
+    }
+}
+
+static inline int cam_parm_is_dirty(const parm_buffer_t *p_table, uint32_t id)
+{
+    return (id < CAM_INTF_PARM_MAX) &&
+           (p_table->dirty[id / 32] & (1u << (id % 32)));
+}
+
+/* empty the batch */
+static inline void cam_parm_batch_init(parm_buffer_t *p_table)
+{
+    p_table->version = CAM_PARM_BATCH_VERSION;
+    p_table->used = 0;
+    memset(p_table->dirty, 0, sizeof(p_table->dirty));
+}
+
+/* bytes of the batch in use, what needs to be copied to duplicate it */
+static inline uint32_t cam_parm_batch_size(const parm_buffer_t *p_table)
+{
+    return (uint32_t)offsetof(parm_buffer_t, data) + p_table->used;
+}
+
+static inline void cam_parm_batch_copy(parm_buffer_t *dst, const parm_buffer_t *src)
+{
+    memcpy(dst, src, cam_parm_batch_size(src));
+}
+
+/* value of a parameter in the batch, NULL if not present */
+static inline void *cam_parm_batch_get(const parm_buffer_t *p_table, uint32_t id)
+{
+    if (!cam_parm_is_dirty(p_table, id)) {
+        return NULL;
+    }
+    return (void *)(p_table->data + p_table->offset[id] +
+                    sizeof(cam_parm_entry_hdr_t));
+}
+
+/* add a parameter to the batch and return where its value goes. A newly
+ * added value is zeroed; a parameter already present keeps its value and
+ * position. Returns NULL for unknown id. */
+static inline void *cam_parm_batch_add(parm_buffer_t *p_table, uint32_t id)
+{
+    cam_parm_entry_hdr_t *hdr;
+    uint32_t len = cam_parm_value_size(id);
+    uint32_t space = (uint32_t)sizeof(cam_parm_entry_hdr_t) + CAM_PARM_ALIGNED(len);
+
+    if (0 == len) {
+        return NULL;
+    }
+    if (cam_parm_is_dirty(p_table, id)) {
+        return cam_parm_batch_get(p_table, id);
+    }
+    if (p_table->used + space > CAM_PARM_BATCH_DATA_SIZE) {
+        return NULL;
+    }
+    hdr = (cam_parm_entry_hdr_t *)(p_table->data + p_table->used);
+    hdr->id = (uint16_t)id;
+    hdr->len = (uint16_t)len;
+    memset(hdr + 1, 0, CAM_PARM_ALIGNED(len));
+    p_table->offset[id] = (uint16_t)p_table->used;
+    p_table->dirty[id / 32] |= (1u << (id % 32));
+    p_table->used += space;
+    return (void *)(hdr + 1);
+}
+
+/* add or update a parameter with a value of up to its declared size,
+ * the rest of a shorter value reads as zero. Returns 0 on success. */
+static inline int32_t cam_parm_batch_set(parm_buffer_t *p_table,
+                                         uint32_t id,
+                                         uint32_t len,
+                                         const void *value)
+{
+    void *dst;
+
+    if (len > cam_parm_value_size(id)) {
+        return -1;
+    }
+    dst = cam_parm_batch_add(p_table, id);
+    if (NULL == dst) {
+        return -1;
+    }
+    if (len < cam_parm_value_size(id)) {
+        memset(dst, 0, cam_parm_value_size(id));
+    }
+    memcpy(dst, value, len);
+    return 0;
+}
+
+/* walk entries in the batch: pass NULL for the first one, the previous one
+ * for the next. Returns NULL after the last entry. */
+static inline cam_parm_entry_hdr_t *cam_parm_batch_next(const parm_buffer_t *p_table,
+                                                        const cam_parm_entry_hdr_t *prev)
+{
+    uint32_t pos = 0;
+
+    if (NULL != prev) {
+        pos = (uint32_t)((const uint8_t *)prev - p_table->data) +
+              (uint32_t)sizeof(cam_parm_entry_hdr_t) + CAM_PARM_ALIGNED(prev->len);
+    }
+    if (pos + sizeof(cam_parm_entry_hdr_t) > p_table->used) {
+        return NULL;
+    }
+    return (cam_parm_entry_hdr_t *)(p_table->data + pos);
+}
+
+/* check a batch received from the other side before decoding it:
+ * version, bounds, and that entries and index agree.
+ * Returns 0 if the batch is sane. */
+static inline int32_t cam_parm_batch_validate(const parm_buffer_t *p_table,
+                                              uint32_t size)
+{
+    const cam_parm_entry_hdr_t *hdr = NULL;
+    uint32_t cnt = 0, i;
+
+    if (size < offsetof(parm_buffer_t, data) ||
+        CAM_PARM_BATCH_VERSION != p_table->version ||
+        p_table->used > CAM_PARM_BATCH_DATA_SIZE ||
+        cam_parm_batch_size(p_table) > size) {
+        return -1;
+    }
+    while (NULL != (hdr = cam_parm_batch_next(p_table, hdr))) {
+        uint32_t pos = (uint32_t)((const uint8_t *)hdr - p_table->data);
+        if (!cam_parm_is_dirty(p_table, hdr->id) ||
+            p_table->offset[hdr->id] != pos ||
+            hdr->len != cam_parm_value_size(hdr->id) ||
+            pos + sizeof(cam_parm_entry_hdr_t) + CAM_PARM_ALIGNED(hdr->len) >
+                p_table->used) {
+            return -1;
+        }
+        cnt++;
+    }
+    for (i = 0; i < CAM_PARM_BITMAP_WORDS; i++) {
+        cnt -= (uint32_t)__builtin_popcount(p_table->dirty[i]);
+    }
+    return (0 == cnt) ? 0 : -1;
+}
+
 #endif /* __QCAMERA_INTF_H__ */
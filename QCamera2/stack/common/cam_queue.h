@@ -29,6 +29,9 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "cam_list.h"
 
+/* default number of preallocated nodes per queue */
+#define CAM_QUEUE_DEFAULT_POOL_DEPTH 16
+
 typedef struct {
     struct cam_list list;
     void *data;
@@ -38,28 +41,99 @@ typedef struct {
     cam_node_t head; /* dummy head */
     uint32_t size;
     pthread_mutex_t lock;
+
+    /* preallocated node pool, so that enq/deq does not hit the heap
+     * in steady state. Nodes are only malloc'ed when pool is exhausted */
+    cam_node_t *pool;
+    struct cam_list free_list;
+    uint32_t pool_depth;
+    uint32_t free_cnt;     /* num of nodes in free_list */
+    uint32_t overflow_cnt; /* num of nodes malloc'ed due to empty pool */
 } cam_queue_t;
 
-static inline int32_t cam_queue_init(cam_queue_t *queue)
+static inline int32_t cam_queue_init_with_depth(cam_queue_t *queue,
+                                                uint32_t depth)
 {
+    uint32_t i;
+
     pthread_mutex_init(&queue->lock, NULL);
     cam_list_init(&queue->head.list);
     queue->size = 0;
+
+    cam_list_init(&queue->free_list);
+    queue->free_cnt = 0;
+    queue->overflow_cnt = 0;
+    queue->pool_depth = 0;
+    queue->pool = NULL;
+    if (depth > 0) {
+        queue->pool = (cam_node_t *)malloc(sizeof(cam_node_t) * depth);
+        if (NULL != queue->pool) {
+            memset(queue->pool, 0, sizeof(cam_node_t) * depth);
+            queue->pool_depth = depth;
+            for (i = 0; i < depth; i++) {
+                cam_list_add_tail_node(&queue->pool[i].list, &queue->free_list);
+            }
+            queue->free_cnt = depth;
+        }
+    }
     return 0;
 }
 
+static inline int32_t cam_queue_init(cam_queue_t *queue)
+{
+    return cam_queue_init_with_depth(queue, CAM_QUEUE_DEFAULT_POOL_DEPTH);
+}
+
+/* get a free node from pool, fall back to heap if pool is exhausted.
+ * need to be called with queue->lock held */
+static inline cam_node_t *cam_queue_get_node(cam_queue_t *queue)
+{
+    cam_node_t *node = NULL;
+    struct cam_list *pos = queue->free_list.next;
+
+    if (pos != &queue->free_list) {
+        node = member_of(pos, cam_node_t, list);
+        cam_list_del_node(&node->list);
+        queue->free_cnt--;
+    } else {
+        node = (cam_node_t *)malloc(sizeof(cam_node_t));
+        if (NULL == node) {
+            return NULL;
+        }
+        queue->overflow_cnt++;
+    }
+
+    memset(node, 0, sizeof(cam_node_t));
+    return node;
+}
+
+/* return a node to pool, or to heap if it was not from pool.
+ * need to be called with queue->lock held */
+static inline void cam_queue_put_node(cam_queue_t *queue, cam_node_t *node)
+{
+    if ((NULL != queue->pool) &&
+        (node >= queue->pool) &&
+        (node < queue->pool + queue->pool_depth)) {
+        node->data = NULL;
+        cam_list_add_tail_node(&node->list, &queue->free_list);
+        queue->free_cnt++;
+    } else {
+        free(node);
+    }
+}
+
 static inline int32_t cam_queue_enq(cam_queue_t *queue, void *data)
 {
-    cam_node_t *node =
-        (cam_node_t *)malloc(sizeof(cam_node_t));
+    cam_node_t *node = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    node = cam_queue_get_node(queue);
     if (NULL == node) {
+        pthread_mutex_unlock(&queue->lock);
         return -1;
     }
 
-    memset(node, 0, sizeof(cam_node_t));
     node->data = data;
-
-    pthread_mutex_lock(&queue->lock);
     cam_list_add_tail_node(&node->list, &queue->head.list);
     queue->size++;
     pthread_mutex_unlock(&queue->lock);
@@ -81,13 +155,10 @@ static inline void *cam_queue_deq(cam_queue_t *queue)
         node = member_of(pos, cam_node_t, list);
         cam_list_del_node(&node->list);
         queue->size--;
-    }
-    pthread_mutex_unlock(&queue->lock);
-
-    if (NULL != node) {
         data = node->data;
-        free(node);
+        cam_queue_put_node(queue, node);
     }
+    pthread_mutex_unlock(&queue->lock);
 
     return data;
 }
@@ -114,7 +185,7 @@ static inline int32_t cam_queue_flush(cam_queue_t *queue)
         if (NULL != node->data) {
             free(node->data);
         }
-        free(node);
+        cam_queue_put_node(queue, node);
 
     }
     queue->size = 0;
@@ -126,5 +197,12 @@ static inline int32_t cam_queue_deinit(cam_queue_t *queue)
 {
     cam_queue_flush(queue);
     pthread_mutex_destroy(&queue->lock);
+    if (NULL != queue->pool) {
+        free(queue->pool);
+        queue->pool = NULL;
+    }
+    queue->pool_depth = 0;
+    queue->free_cnt = 0;
+    cam_list_init(&queue->free_list);
     return 0;
 }
@@ -42,6 +42,7 @@
 
 #define MAX_ZOOMS_CNT 64
 #define MAX_SIZES_CNT 12
+#define CAM_MAX_NUM_BUFS_PER_MAP 32
 #define MAX_EXP_BRACKETING_LENGTH 32
 #define MAX_ROI 5
 
@@ -219,9 +220,23 @@ typedef struct {
     unsigned long cookie; /* could be job_id(uint32_t) to identify unmapping job */
 } cam_buf_unmap_type;
 
+/* list of buffers mapped in one message. fds are passed in the same
+ * order as the list through one SCM_RIGHTS control msg */
+typedef struct {
+    uint32_t length;
+    cam_buf_map_type buf_maps[CAM_MAX_NUM_BUFS_PER_MAP];
+} cam_buf_map_type_list;
+
+typedef struct {
+    uint32_t length;
+    cam_buf_unmap_type buf_unmaps[CAM_MAX_NUM_BUFS_PER_MAP];
+} cam_buf_unmap_type_list;
+
 typedef enum {
     CAM_MAPPING_TYPE_FD_MAPPING,
     CAM_MAPPING_TYPE_FD_UNMAPPING,
+    CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING,   /* one ack for whole list */
+    CAM_MAPPING_TYPE_FD_BUNDLED_UNMAPPING, /* one ack for whole list */
     CAM_MAPPING_TYPE_MAX
 } cam_mapping_type;
 
@@ -233,6 +248,16 @@ typedef struct {
     } payload;
 } cam_sock_packet_t;
 
+/* bundled map/unmap msg. Only sent to servers known to handle it, older
+ * servers expect every msg to be a cam_sock_packet_t */
+typedef struct {
+    cam_mapping_type msg_type;
+    union {
+        cam_buf_map_type_list buf_map_list;
+        cam_buf_unmap_type_list buf_unmap_list;
+    } payload;
+} cam_sock_bundled_packet_t;
+
 typedef enum {
     CAM_MODE_2D = (1<<0),
     CAM_MODE_3D = (1<<1)
@@ -169,6 +169,10 @@ typedef struct {
 *                stream buffers
 *    @put_bufs : function definition for deallocating
 *                stream buffers
+*    @invalidate_buf : function definition for invalidating
+*                cpu cache of a stream buffer before the
+*                interface reads it. Optional, NULL if the
+*                buffers are not cached
 *    @user_data: user data pointer
 **/
 typedef struct {
@@ -181,6 +185,7 @@ typedef struct {
                        void *user_data);
   int32_t (*put_bufs) (mm_camera_map_unmap_ops_tbl_t *ops_tbl,
                        void *user_data);
+  int32_t (*invalidate_buf) (uint32_t index, void *user_data);
 } mm_camera_stream_mem_vtbl_t;
 
 /** mm_camera_stream_config_t: structure for stream
@@ -217,13 +222,16 @@ typedef enum {
 /** mm_camera_super_buf_priority_t: enum for super buffer
 *                                   matching priority
 *    @MM_CAMERA_SUPER_BUF_PRIORITY_NORMAL :
-*       Save the frame no matter focused or not. Currently only
-*       this type is supported.
+*       Save the frame no matter focused or not.
 *    @MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS :
-*       only queue the frame that is focused. Will enable meta
-*       data header to carry focus info
+*       only queue the frame that is focused, based on metadata
+*       stream bundled in the channel. Unfocused frames are only
+*       kept while no focused frame is queued. Newest queued frames
+*       are delivered upon request. Metadata bufs are invalidated
+*       through invalidate_buf of the stream mem vtbl before read.
 *    @MM_CAMERA_SUPER_BUF_PRIORITY_EXPOSURE_BRACKETING :
-*       after shutter, only queue matched exposure index
+*       after shutter, only queue matched exposure index.
+*       Not supported yet, handled as NORMAL
 **/
 typedef enum {
     MM_CAMERA_SUPER_BUF_PRIORITY_NORMAL = 0,
@@ -422,6 +430,24 @@ typedef struct {
                               uint32_t stream_id,
                               mm_camera_stream_config_t *config);
 
+    /** reconfig_stream: function definition for reconfiguring a stream.
+     *                   If channel is started, only this stream is
+     *                   restarted with the new config. Buffers are got
+     *                   again through config->mem_vtbl, upper layer may
+     *                   return the ones it already has if they fit.
+     *                   Fails for streams bundled into super buf.
+     *    @camera_handle : camera handler
+     *    @ch_id : channel handler
+     *    @stream_id : stream handler
+     *    @config : pointer to a stream configuration structure
+     *  Return value: 0 -- success
+     *                -1 -- failure
+     **/
+    int32_t (*reconfig_stream) (uint32_t camera_handle,
+                                uint32_t ch_id,
+                                uint32_t stream_id,
+                                mm_camera_stream_config_t *config);
+
     /** map_stream_buf: fucntion definition for mapping
      *                 stream buffer via domain socket
      *    @camera_handle : camer handler
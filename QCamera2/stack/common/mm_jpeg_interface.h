@@ -129,6 +129,12 @@ typedef struct {
 typedef struct {
     src_image_buffer_config src_imgs;
     out_image_buffer_info sink_img;
+
+    /* generation of buffer allocations, caller changes it whenever a buffer
+     * that may have been passed in an earlier job is freed. fd and vaddr
+     * of a freed buffer can come back for a new one, so buffers kept
+     * registered with the encoder are dropped when it changes */
+    uint32_t buf_gen;
 } jpeg_image_buffer_config;
 
 typedef struct {
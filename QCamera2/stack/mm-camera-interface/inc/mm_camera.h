@@ -46,6 +46,13 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MM_CAMERA_DEV_OPEN_TRIES 2
 #define MM_CAMERA_DEV_OPEN_RETRY_SLEEP 20
 
+/* num of preallocated nodes for matched super bufs */
+#define MM_CHANNEL_SUPERBUF_POOL_DEPTH 16
+
+/* depth of preallocated cmd nodes per cmd thread */
+#define MM_CAMERA_CMD_POOL_DEPTH_EVT 8
+#define MM_CAMERA_CMD_POOL_DEPTH_DATA 32
+
 #ifndef TRUE
 #define TRUE 1
 #endif
@@ -90,12 +97,44 @@ typedef struct {
 
 typedef void (*mm_camera_cmd_cb_t)(mm_camera_cmdcb_t * cmd_cb, void* user_data);
 
+typedef struct {
+    pthread_mutex_t lock;
+    mm_camera_cmdcb_t *nodes;       /* preallocated cmd nodes */
+    mm_camera_cmdcb_t **free_nodes; /* stack of free cmd nodes */
+    uint32_t depth;
+    uint32_t free_cnt;
+    uint32_t overflow_cnt;          /* num of cmd nodes malloc'ed due to empty pool */
+} mm_camera_cmd_pool_t;
+
+typedef enum {
+    /* mutex protected list woken by semaphore, allows multiple producers */
+    MM_CAMERA_CMD_QUEUE_TYPE_LIST,
+    /* lock-free ring woken by eventfd, only for a single producer thread.
+     * Not used by default: the eventfd wakeup measured slower than the
+     * semaphore at 240 fps (mm-qcamera-bench3 -q) */
+    MM_CAMERA_CMD_QUEUE_TYPE_SPSC,
+    MM_CAMERA_CMD_QUEUE_TYPE_MAX
+} mm_camera_cmd_queue_type_t;
+
+typedef struct {
+    mm_camera_cmdcb_t **slots;
+    uint32_t mask;  /* num of slots - 1, num of slots is power of 2 */
+    uint32_t head;  /* next slot to read, only updated by consumer */
+    uint32_t tail;  /* next slot to write, only updated by producer */
+    int32_t efd;    /* eventfd to wake up consumer */
+} mm_camera_cmd_ring_t;
+
 typedef struct {
     cam_queue_t cmd_queue; /* cmd queue (queuing dataCB, asyncCB, or exitCMD) */
     pthread_t cmd_pid;           /* cmd thread ID */
     sem_t cmd_sem;               /* semaphore for cmd thread */
     mm_camera_cmd_cb_t cb;       /* cb for cmd */
     void* user_data;             /* user_data for cb */
+    mm_camera_cmd_pool_t cmd_pool; /* pool of cmd nodes */
+    mm_camera_cmd_queue_type_t queue_type;
+    /* ring for SPSC type. cmd_queue is then only used for exitCMD
+     * and for cmds overflowed from a full ring */
+    mm_camera_cmd_ring_t ring;
 } mm_camera_cmd_thread_t;
 
 typedef enum {
@@ -121,13 +160,16 @@ typedef struct {
      * for MM_CAMERA_POLL_TYPE_EVT, only index 0 is valid;
      * for MM_CAMERA_POLL_TYPE_DATA, depends on valid stream fd */
     mm_camera_poll_entry_t poll_entries[MAX_STREAM_NUM_IN_BUNDLE];
-    int32_t pfds[2];
+    int32_t efd;        /* eventfd to wake up poll thread for cmds */
+    int32_t epoll_fd;   /* epoll set of efd and entry fds */
+    /* entry fds currently in epoll set, only touched by poll thread */
+    int32_t polled_fds[MAX_STREAM_NUM_IN_BUNDLE];
     pthread_t pid;
     int32_t state;
     int timeoutms;
-    uint32_t cmd;
-    struct pollfd poll_fds[MAX_STREAM_NUM_IN_BUNDLE + 1];
-    uint8_t num_fds;
+    uint32_t cmd;       /* mask of pending cmds, protected by mutex */
+    uint32_t cmd_seq;   /* seq of last cmd sent, protected by mutex */
+    uint32_t done_seq;  /* seq of last cmd processed, protected by mutex */
     pthread_mutex_t mutex;
     pthread_cond_t cond_v;
     int32_t status;
@@ -185,6 +227,12 @@ typedef struct {
     uint8_t in_kernel;
 } mm_stream_buf_status_t;
 
+typedef enum {
+    MM_STREAM_MAP_BATCH_NONE,   /* map/unmap ops are sent one by one */
+    MM_STREAM_MAP_BATCH_MAP,    /* map ops are collected into map_batch */
+    MM_STREAM_MAP_BATCH_UNMAP,  /* unmap ops are collected into map_batch */
+} mm_stream_map_batch_mode_t;
+
 typedef struct mm_stream {
     uint32_t my_hdl; /* local stream id */
     uint32_t server_stream_id; /* stream id from server */
@@ -212,6 +260,11 @@ typedef struct mm_stream {
     mm_camera_buf_def_t* buf; /* ptr to buf array */
     mm_stream_buf_status_t* buf_status; /* ptr to buf status array */
 
+    /* stream buf map/unmap batching while get_bufs/put_bufs run */
+    mm_stream_map_batch_mode_t map_batch_mode;
+    cam_sock_bundled_packet_t map_batch; /* pending bundled map/unmap msg */
+    int map_batch_fds[CAM_MAX_NUM_BUFS_PER_MAP]; /* fds of pending maps */
+
     /* reference to parent channel_obj */
     struct mm_channel* ch_obj;
 
@@ -233,6 +286,7 @@ typedef enum {
     MM_CHANNEL_EVT_ADD_STREAM,
     MM_CHANNEL_EVT_DEL_STREAM,
     MM_CHANNEL_EVT_CONFIG_STREAM,
+    MM_CHANNEL_EVT_RECONFIG_STREAM,
     MM_CHANNEL_EVT_START,
     MM_CHANNEL_EVT_STOP,
     MM_CHANNEL_EVT_PAUSE,
@@ -282,16 +336,35 @@ typedef struct {
     uint8_t num_of_bufs;
     mm_camera_buf_info_t super_buf[MAX_STREAM_NUM_IN_BUNDLE];
     uint8_t matched;
+    uint8_t is_settled; /* focus/exposure settled, for priority matching */
 } mm_channel_queue_node_t;
 
 typedef struct {
-    cam_queue_t que;
+    uint32_t frame_idx;   /* frame idx of bufs held in this slot */
+    uint32_t stream_mask; /* bit i set if buf of bundled_streams[i] is held */
+    mm_channel_queue_node_t super_buf;
+} mm_channel_match_slot_t;
+
+typedef struct {
+    cam_queue_t que; /* queue of matched super bufs */
     uint8_t num_streams;
     /* container for bundled stream handlers */
     uint32_t bundled_streams[MAX_STREAM_NUM_IN_BUNDLE];
     mm_camera_channel_attr_t attr;
     uint32_t expected_frame_id;
     uint32_t match_cnt;
+    /* idx of metadata stream in bundled_streams, -1 if not bundled */
+    int8_t meta_s_idx;
+    uint32_t settled_cnt; /* num of settled super bufs in que */
+
+    /* the only partially matched super buf, empty if stream_mask is 0 */
+    mm_channel_match_slot_t partial;
+
+    /* preallocated nodes for matched super bufs */
+    mm_channel_queue_node_t node_pool[MM_CHANNEL_SUPERBUF_POOL_DEPTH];
+    mm_channel_queue_node_t *free_nodes[MM_CHANNEL_SUPERBUF_POOL_DEPTH];
+    uint32_t free_cnt;
+    uint32_t overflow_cnt; /* num of nodes malloc'ed due to empty pool */
 } mm_channel_queue_t;
 
 typedef struct {
@@ -357,6 +430,7 @@ typedef struct mm_camera_obj {
     int ref_count;
     int32_t ctrl_fd;
     int32_t ds_fd; /* domain socket fd */
+    uint8_t bundled_map; /* server handles bundled map/unmap msgs */
     pthread_mutex_t cam_lock;
     pthread_mutex_t cb_lock; /* lock for evt cb */
     mm_channel_t ch[MM_CAMERA_CHANNEL_MAX];
@@ -395,6 +469,12 @@ extern int32_t mm_camera_util_sendmsg(mm_camera_obj_t *my_obj,
                                       void *msg,
                                       uint32_t buf_size,
                                       int sendfd);
+/* send bundled msg throught domain socket for fd mapping */
+extern int32_t mm_camera_util_bundled_sendmsg(mm_camera_obj_t *my_obj,
+                                              void *msg,
+                                              uint32_t buf_size,
+                                              int sendfds[CAM_MAX_NUM_BUFS_PER_MAP],
+                                              int numfds);
 /* Check if hardware target is A family */
 uint8_t mm_camera_util_chip_is_a_family(void);
 
@@ -437,6 +517,10 @@ extern int32_t mm_camera_config_stream(mm_camera_obj_t *my_obj,
                                        uint32_t ch_id,
                                        uint32_t stream_id,
                                        mm_camera_stream_config_t *config);
+extern int32_t mm_camera_reconfig_stream(mm_camera_obj_t *my_obj,
+                                         uint32_t ch_id,
+                                         uint32_t stream_id,
+                                         mm_camera_stream_config_t *config);
 extern int32_t mm_camera_start_channel(mm_camera_obj_t *my_obj,
                                        uint32_t ch_id);
 extern int32_t mm_camera_stop_channel(mm_camera_obj_t *my_obj,
@@ -513,6 +597,8 @@ extern int32_t mm_stream_unmap_buf(mm_stream_t *my_obj,
                                    uint8_t buf_type,
                                    uint32_t frame_idx,
                                    int32_t plane_idx);
+extern int32_t mm_stream_invalidate_buf(mm_stream_t *my_obj,
+                                        uint32_t index);
 
 
 /* utiltity fucntion declared in mm-camera-inteface2.c
@@ -538,7 +624,15 @@ extern int32_t mm_camera_poll_thread_del_poll_fd(
 extern int32_t mm_camera_cmd_thread_launch(
                                 mm_camera_cmd_thread_t * cmd_thread,
                                 mm_camera_cmd_cb_t cb,
-                                void* user_data);
+                                void* user_data,
+                                uint32_t pool_depth,
+                                mm_camera_cmd_queue_type_t queue_type);
 extern int32_t mm_camera_cmd_thread_release(mm_camera_cmd_thread_t * cmd_thread);
+extern int32_t mm_camera_cmd_thread_enqueue(mm_camera_cmd_thread_t * cmd_thread,
+                                            mm_camera_cmdcb_t *node);
+extern mm_camera_cmdcb_t *mm_camera_cmd_thread_alloc_cmd(
+                                mm_camera_cmd_thread_t * cmd_thread);
+extern void mm_camera_cmd_thread_free_cmd(mm_camera_cmd_thread_t * cmd_thread,
+                                          mm_camera_cmdcb_t *node);
 
 #endif /* __MM_CAMERA_H__ */
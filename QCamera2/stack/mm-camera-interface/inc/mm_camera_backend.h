@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of Code Aurora Forum, Inc. nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __MM_CAMERA_BACKEND_H__
+#define __MM_CAMERA_BACKEND_H__
+
+#include "mm_camera_sock.h"
+#include "mm_camera.h"
+
+/* everything mm-camera-interface asks from the kernel driver and from the
+ * mm-camera server. Selected once per process by env MM_CAMERA_BACKEND or
+ * property persist.camera.backend: "kernel" (default) or "sim". */
+typedef struct {
+    const char *name;
+
+    /* fill in video node names of cameras, return num of cameras.
+     * NULL means discovering cameras through /dev/mediaN */
+    int (*enum_cameras)(char (*dev_names)[MM_CAMERA_DEV_NAME_LEN], int max_cameras);
+
+    /* video node, used for both camera ctrl fd and stream fds */
+    int (*open)(const char *dev_name, int flags);
+    int (*close)(int fd);
+    int (*ioctl)(int fd, unsigned long request, void *arg);
+
+    /* domain socket to server */
+    int (*sock_create)(int cam_id, mm_camera_sock_type_t sock_type);
+    void (*sock_close)(int fd);
+    int (*sock_sendmsg)(int fd, void *msg, uint32_t buf_size, int sendfd);
+    int (*sock_bundle_sendmsg)(int fd, void *msg, uint32_t buf_size,
+                               int sendfds[CAM_MAX_NUM_BUFS_PER_MAP], int numfds);
+    /* server is known to handle cam_sock_bundled_packet_t. Else bundling
+     * is off unless enabled by property persist.camera.bundled_map */
+    uint8_t bundled_map;
+
+    /* poll events of ctrl fd telling a server event can be dequeued */
+    uint32_t evt_poll_events;
+} mm_camera_backend_ops_t;
+
+extern const mm_camera_backend_ops_t *mm_camera_backend(void);
+
+/* if stream buf map/unmap msgs can be bundled for the server */
+extern uint8_t mm_camera_backend_bundled_map(void);
+
+/* shortcuts used in place of the matching syscalls */
+extern int mm_camera_dev_open(const char *dev_name, int flags);
+extern int mm_camera_dev_close(int fd);
+extern int mm_camera_dev_ioctl(int fd, unsigned long request, void *arg);
+
+/* loopback backend, see mm_camera_sim.c */
+extern const mm_camera_backend_ops_t mm_camera_sim_backend;
+
+#endif /*__MM_CAMERA_BACKEND_H__*/
@@ -32,6 +32,8 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <inttypes.h>
 
+#include "cam_types.h"
+
 typedef enum {
     MM_CAMERA_SOCK_TYPE_UDP,
     MM_CAMERA_SOCK_TYPE_TCP,
@@ -45,6 +47,13 @@ int mm_camera_socket_sendmsg(
   uint32_t buf_size,
   int sendfd);
 
+int mm_camera_socket_bundle_sendmsg(
+  int fd,
+  void *msg,
+  uint32_t buf_size,
+  int sendfds[CAM_MAX_NUM_BUFS_PER_MAP],
+  int numfds);
+
 int mm_camera_socket_recvmsg(
   int fd,
   void *msg,
@@ -40,6 +40,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mm_camera_sock.h"
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
+#include "mm_camera_backend.h"
 
 #define SET_PARM_BIT32(parm, parm_arr) \
     (parm_arr[parm/32] |= (1<<(parm%32)))
@@ -157,7 +158,7 @@ static void mm_camera_event_notify(void* user_data)
     if (NULL != my_obj) {
         /* read evt */
         memset(&ev, 0, sizeof(ev));
-        rc = ioctl(my_obj->ctrl_fd, VIDIOC_DQEVENT, &ev);
+        rc = mm_camera_dev_ioctl(my_obj->ctrl_fd, VIDIOC_DQEVENT, &ev);
 
         if (rc >= 0 && ev.id == MSM_CAMERA_MSM_NOTIFY) {
             msm_evt = (struct msm_v4l2_event_data *)ev.u.data;
@@ -172,9 +173,8 @@ static void mm_camera_event_notify(void* user_data)
             case CAM_EVENT_TYPE_AUTO_FOCUS_DONE:
             case CAM_EVENT_TYPE_ZOOM_DONE:
                 {
-                    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+                    node = mm_camera_cmd_thread_alloc_cmd(&my_obj->evt_thread);
                     if (NULL != node) {
-                        memset(node, 0, sizeof(mm_camera_cmdcb_t));
                         node->cmd_type = MM_CAMERA_CMD_TYPE_EVT_CB;
                         node->u.evt.server_event_type = msm_evt->command;
                         if (msm_evt->status == MSM_CAMERA_STATUS_SUCCESS) {
@@ -189,10 +189,11 @@ static void mm_camera_event_notify(void* user_data)
                 break;
             }
             if (NULL != node) {
-                /* enqueue to evt cmd thread */
-                cam_queue_enq(&(my_obj->evt_thread.cmd_queue), node);
-                /* wake up evt cmd thread */
-                sem_post(&(my_obj->evt_thread.cmd_sem));
+                /* enqueue to evt cmd thread and wake it up */
+                if (0 != mm_camera_cmd_thread_enqueue(&my_obj->evt_thread, node)) {
+                    CDBG_ERROR("%s: enqueue to evt thread failed", __func__);
+                    mm_camera_cmd_thread_free_cmd(&my_obj->evt_thread, node);
+                }
             }
         }
     }
@@ -218,16 +219,17 @@ int32_t mm_camera_enqueue_evt(mm_camera_obj_t *my_obj,
     int32_t rc = 0;
     mm_camera_cmdcb_t *node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&my_obj->evt_thread);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_EVT_CB;
         node->u.evt = *event;
 
-        /* enqueue to evt cmd thread */
-        cam_queue_enq(&(my_obj->evt_thread.cmd_queue), node);
-        /* wake up evt cmd thread */
-        sem_post(&(my_obj->evt_thread.cmd_sem));
+        /* enqueue to evt cmd thread and wake it up */
+        rc = mm_camera_cmd_thread_enqueue(&my_obj->evt_thread, node);
+        if (0 != rc) {
+            CDBG_ERROR("%s: enqueue to evt thread failed", __func__);
+            mm_camera_cmd_thread_free_cmd(&my_obj->evt_thread, node);
+        }
     } else {
         CDBG_ERROR("%s: No memory for mm_camera_node_t", __func__);
         rc = -1;
@@ -265,7 +267,7 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
 
     do{
         n_try--;
-        my_obj->ctrl_fd = open(dev_name, O_RDWR | O_NONBLOCK);
+        my_obj->ctrl_fd = mm_camera_dev_open(dev_name, O_RDWR | O_NONBLOCK);
         CDBG("%s:  ctrl_fd = %d, errno == %d", __func__, my_obj->ctrl_fd, errno);
         if((my_obj->ctrl_fd > 0) || (errno != EIO) || (n_try <= 0 )) {
             CDBG_ERROR("%s:  opened, break out while loop", __func__);
@@ -287,7 +289,7 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
     n_try = MM_CAMERA_DEV_OPEN_TRIES;
     do {
         n_try--;
-        my_obj->ds_fd = mm_camera_socket_create(cam_idx, MM_CAMERA_SOCK_TYPE_UDP);
+        my_obj->ds_fd = mm_camera_backend()->sock_create(cam_idx, MM_CAMERA_SOCK_TYPE_UDP);
         CDBG("%s:  ds_fd = %d, errno = %d", __func__, my_obj->ds_fd, errno);
         if((my_obj->ds_fd > 0) || (n_try <= 0 )) {
             CDBG("%s:  opened, break out while loop", __func__);
@@ -305,6 +307,10 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
         goto on_error;
     }
 
+    my_obj->bundled_map = mm_camera_backend_bundled_map();
+    CDBG_HIGH("%s: bundled buf mapping %s", __func__,
+              my_obj->bundled_map ? "on" : "off");
+
     pthread_mutex_init(&my_obj->cb_lock, NULL);
     pthread_mutex_init(&my_obj->evt_lock, NULL);
     pthread_cond_init(&my_obj->evt_cond, NULL);
@@ -312,7 +318,9 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
     CDBG("%s : Launch evt Thread in Cam Open",__func__);
     mm_camera_cmd_thread_launch(&my_obj->evt_thread,
                                 mm_camera_dispatch_app_event,
-                                (void *)my_obj);
+                                (void *)my_obj,
+                                MM_CAMERA_CMD_POOL_DEPTH_EVT,
+                                MM_CAMERA_CMD_QUEUE_TYPE_LIST);
 
     /* launch event poll thread
      * we will add evt fd into event poll thread upon user first register for evt */
@@ -328,11 +336,11 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
 
 on_error:
     if (my_obj->ctrl_fd > 0) {
-        close(my_obj->ctrl_fd);
+        mm_camera_dev_close(my_obj->ctrl_fd);
         my_obj->ctrl_fd = 0;
     }
     if (my_obj->ds_fd > 0) {
-        mm_camera_socket_close(my_obj->ds_fd);
+        mm_camera_backend()->sock_close(my_obj->ds_fd);
        my_obj->ds_fd = 0;
     }
 
@@ -367,11 +375,11 @@ int32_t mm_camera_close(mm_camera_obj_t *my_obj)
     mm_camera_cmd_thread_release(&my_obj->evt_thread);
 
     if(my_obj->ctrl_fd > 0) {
-        close(my_obj->ctrl_fd);
+        mm_camera_dev_close(my_obj->ctrl_fd);
         my_obj->ctrl_fd = -1;
     }
     if(my_obj->ds_fd > 0) {
-        mm_camera_socket_close(my_obj->ds_fd);
+        mm_camera_backend()->sock_close(my_obj->ds_fd);
         my_obj->ds_fd = -1;
     }
 
@@ -514,7 +522,7 @@ int32_t mm_camera_query_capability(mm_camera_obj_t *my_obj)
 
     /* get camera capabilities */
     memset(&cap, 0, sizeof(cap));
-    rc = ioctl(my_obj->ctrl_fd, VIDIOC_QUERYCAP, &cap);
+    rc = mm_camera_dev_ioctl(my_obj->ctrl_fd, VIDIOC_QUERYCAP, &cap);
     if (rc != 0) {
         CDBG_ERROR("%s: cannot get camera capabilities, rc = %d\n", __func__, rc);
     }
@@ -859,6 +867,50 @@ int32_t mm_camera_config_stream(mm_camera_obj_t *my_obj,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_reconfig_stream
+ *
+ * DESCRIPTION: reconfigure a stream, restarting only that stream if its
+ *              channel is already started
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @ch_id        : channel handle
+ *   @stream_id    : stream handle
+ *   @config       : new stream configuration
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_reconfig_stream(mm_camera_obj_t *my_obj,
+                                  uint32_t ch_id,
+                                  uint32_t stream_id,
+                                  mm_camera_stream_config_t *config)
+{
+    int32_t rc = -1;
+    mm_channel_t * ch_obj =
+        mm_camera_util_get_channel_by_handler(my_obj, ch_id);
+    mm_evt_paylod_config_stream_t payload;
+
+    if (NULL != ch_obj) {
+        pthread_mutex_lock(&ch_obj->ch_lock);
+        pthread_mutex_unlock(&my_obj->cam_lock);
+
+        memset(&payload, 0, sizeof(mm_evt_paylod_config_stream_t));
+        payload.stream_id = stream_id;
+        payload.config = config;
+        rc = mm_channel_fsm_fn(ch_obj,
+                               MM_CHANNEL_EVT_RECONFIG_STREAM,
+                               (void*)&payload,
+                               NULL);
+    } else {
+        pthread_mutex_unlock(&my_obj->cam_lock);
+    }
+
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_start_channel
  *
@@ -1287,7 +1339,7 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
     sub.id = MSM_CAMERA_MSM_NOTIFY;
     if(FALSE == reg_flag) {
         /* unsubscribe */
-        rc = ioctl(my_obj->ctrl_fd, VIDIOC_UNSUBSCRIBE_EVENT, &sub);
+        rc = mm_camera_dev_ioctl(my_obj->ctrl_fd, VIDIOC_UNSUBSCRIBE_EVENT, &sub);
         if (rc < 0) {
             CDBG_ERROR("%s: unsubscribe event rc = %d", __func__, rc);
             return rc;
@@ -1296,7 +1348,7 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
         rc = mm_camera_poll_thread_del_poll_fd(&my_obj->evt_poll_thread,
                                                my_obj->my_hdl);
     } else {
-        rc = ioctl(my_obj->ctrl_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
+        rc = mm_camera_dev_ioctl(my_obj->ctrl_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
         if (rc < 0) {
             CDBG_ERROR("%s: subscribe event rc = %d", __func__, rc);
             return rc;
@@ -1360,7 +1412,43 @@ int32_t mm_camera_util_sendmsg(mm_camera_obj_t *my_obj,
 {
     int32_t rc = -1;
     int32_t status;
-    if(mm_camera_socket_sendmsg(my_obj->ds_fd, msg, buf_size, sendfd) > 0) {
+    if(mm_camera_backend()->sock_sendmsg(my_obj->ds_fd, msg, buf_size, sendfd) > 0) {
+        /* wait for event that mapping/unmapping is done */
+        mm_camera_util_wait_for_event(my_obj, CAM_EVENT_TYPE_MAP_UNMAP_DONE, &status);
+        if (MSM_CAMERA_STATUS_SUCCESS == status) {
+            rc = 0;
+        }
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_bundled_sendmsg
+ *
+ * DESCRIPTION: utility function to send bundled msg via domain socket,
+ *              all fds of the bundle are passed in one message
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @msg          : message to be sent
+ *   @buf_size     : size of the message to be sent
+ *   @sendfds      : file descriptors to be passed across process
+ *   @numfds       : number of file descriptors in sendfds
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_util_bundled_sendmsg(mm_camera_obj_t *my_obj,
+                                       void *msg,
+                                       uint32_t buf_size,
+                                       int sendfds[CAM_MAX_NUM_BUFS_PER_MAP],
+                                       int numfds)
+{
+    int32_t rc = -1;
+    int32_t status;
+    if(mm_camera_backend()->sock_bundle_sendmsg(my_obj->ds_fd, msg, buf_size,
+                                                sendfds, numfds) > 0) {
         /* wait for event that mapping/unmapping is done */
         mm_camera_util_wait_for_event(my_obj, CAM_EVENT_TYPE_MAP_UNMAP_DONE, &status);
         if (MSM_CAMERA_STATUS_SUCCESS == status) {
@@ -1464,7 +1552,7 @@ int32_t mm_camera_util_s_ctrl(int32_t fd,  uint32_t id, int32_t *value)
     if (value != NULL) {
         control.value = *value;
     }
-    rc = ioctl(fd, VIDIOC_S_CTRL, &control);
+    rc = mm_camera_dev_ioctl(fd, VIDIOC_S_CTRL, &control);
 
     CDBG("%s: fd=%d, S_CTRL, id=0x%x, value = 0x%x, rc = %d\n",
          __func__, fd, id, (uint32_t)value, rc);
@@ -1498,7 +1586,7 @@ int32_t mm_camera_util_g_ctrl( int32_t fd, uint32_t id, int32_t *value)
     if (value != NULL) {
         control.value = *value;
     }
-    rc = ioctl(fd, VIDIOC_G_CTRL, &control);
+    rc = mm_camera_dev_ioctl(fd, VIDIOC_G_CTRL, &control);
     CDBG("%s: fd=%d, G_CTRL, id=0x%x, rc = %d\n", __func__, fd, id, rc);
     if (value != NULL) {
         *value = control.value;
@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of Code Aurora Forum, Inc. nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#ifdef _ANDROID_
+#include <cutils/properties.h>
+#endif
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_backend.h"
+
+static int mm_camera_kernel_open(const char *dev_name, int flags)
+{
+    return open(dev_name, flags);
+}
+
+static int mm_camera_kernel_ioctl(int fd, unsigned long request, void *arg)
+{
+    return ioctl(fd, request, arg);
+}
+
+static const mm_camera_backend_ops_t mm_camera_kernel_backend = {
+    .name = "kernel",
+    .enum_cameras = NULL,
+    .open = mm_camera_kernel_open,
+    .close = close,
+    .ioctl = mm_camera_kernel_ioctl,
+    .sock_create = mm_camera_socket_create,
+    .sock_close = mm_camera_socket_close,
+    .sock_sendmsg = mm_camera_socket_sendmsg,
+    .sock_bundle_sendmsg = mm_camera_socket_bundle_sendmsg,
+    /* servers predating bundled msgs never ack them, and nothing times
+     * out the wait for MAP_UNMAP_DONE */
+    .bundled_map = 0,
+    .evt_poll_events = EPOLLPRI,
+};
+
+static const mm_camera_backend_ops_t *g_backend = &mm_camera_kernel_backend;
+static pthread_once_t g_backend_once = PTHREAD_ONCE_INIT;
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_backend_select
+ *
+ * DESCRIPTION: pick backend from env MM_CAMERA_BACKEND, or from property
+ *              persist.camera.backend if env is not set
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_backend_select(void)
+{
+    const char *name = getenv("MM_CAMERA_BACKEND");
+#ifdef _ANDROID_
+    char prop[PROPERTY_VALUE_MAX];
+    if (NULL == name) {
+        memset(prop, 0, sizeof(prop));
+        property_get("persist.camera.backend", prop, "kernel");
+        name = prop;
+    }
+#endif
+    if (NULL != name && 0 == strcmp(name, mm_camera_sim_backend.name)) {
+        g_backend = &mm_camera_sim_backend;
+    }
+    CDBG_HIGH("%s: using %s backend", __func__, g_backend->name);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_backend
+ *
+ * DESCRIPTION: get backend in use
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : ptr to backend ops
+ *==========================================================================*/
+const mm_camera_backend_ops_t *mm_camera_backend(void)
+{
+    pthread_once(&g_backend_once, mm_camera_backend_select);
+    return g_backend;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_backend_bundled_map
+ *
+ * DESCRIPTION: check if stream buf map/unmap msgs may be bundled, either
+ *              because the backend server is known to handle them, or as
+ *              enabled by property persist.camera.bundled_map for a server
+ *              that does
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : 1 if bundled msgs can be sent, else 0
+ *==========================================================================*/
+uint8_t mm_camera_backend_bundled_map(void)
+{
+#ifdef _ANDROID_
+    char prop[PROPERTY_VALUE_MAX];
+#endif
+
+    if (mm_camera_backend()->bundled_map) {
+        return 1;
+    }
+#ifdef _ANDROID_
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.bundled_map", prop, "0");
+    if (atoi(prop) > 0) {
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+int mm_camera_dev_open(const char *dev_name, int flags)
+{
+    return mm_camera_backend()->open(dev_name, flags);
+}
+
+int mm_camera_dev_close(int fd)
+{
+    return mm_camera_backend()->close(fd);
+}
+
+int mm_camera_dev_ioctl(int fd, unsigned long request, void *arg)
+{
+    return mm_camera_backend()->ioctl(fd, request, arg);
+}
@@ -58,6 +58,9 @@ int32_t mm_channel_del_stream(mm_channel_t *my_obj,
 int32_t mm_channel_config_stream(mm_channel_t *my_obj,
                                  uint32_t stream_id,
                                  mm_camera_stream_config_t *config);
+int32_t mm_channel_reconfig_stream(mm_channel_t *my_obj,
+                                   uint32_t stream_id,
+                                   mm_camera_stream_config_t *config);
 int32_t mm_channel_start(mm_channel_t *my_obj);
 int32_t mm_channel_stop(mm_channel_t *my_obj);
 int32_t mm_channel_request_super_buf(mm_channel_t *my_obj,
@@ -99,6 +102,9 @@ int32_t mm_channel_superbuf_comp_and_enqueue(mm_channel_t *ch_obj,
                                              mm_channel_queue_t * queue,
                                              mm_camera_buf_info_t *buf);
 mm_channel_queue_node_t* mm_channel_superbuf_dequeue(mm_channel_queue_t * queue);
+mm_channel_queue_node_t* mm_channel_superbuf_dequeue_internal(mm_channel_queue_t * queue);
+void mm_channel_superbuf_node_release(mm_channel_queue_t * queue,
+                                      mm_channel_queue_node_t* super_buf);
 int32_t mm_channel_superbuf_bufdone_overflow(mm_channel_t *my_obj,
                                              mm_channel_queue_t *queue);
 int32_t mm_channel_superbuf_skip(mm_channel_t *my_obj,
@@ -227,10 +233,9 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
                 CDBG("%s: Send superbuf to HAL, pending_cnt=%d",
                      __func__, ch_obj->pending_cnt);
 
-                /* send sem_post to wake up cb thread to dispatch super buffer */
-                cb_node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+                /* wake up cb thread to dispatch super buffer */
+                cb_node = mm_camera_cmd_thread_alloc_cmd(&ch_obj->cb_thread);
                 if (NULL != cb_node) {
-                    memset(cb_node, 0, sizeof(mm_camera_cmdcb_t));
                     cb_node->cmd_type = MM_CAMERA_CMD_TYPE_SUPER_BUF_DATA_CB;
                     cb_node->u.superbuf.num_bufs = node->num_of_bufs;
                     for (i=0; i<node->num_of_bufs; i++) {
@@ -239,11 +244,14 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
                     cb_node->u.superbuf.camera_handle = ch_obj->cam_obj->my_hdl;
                     cb_node->u.superbuf.ch_id = ch_obj->my_hdl;
 
-                    /* enqueue to cb thread */
-                    cam_queue_enq(&(ch_obj->cb_thread.cmd_queue), cb_node);
-
-                    /* wake up cb thread */
-                    sem_post(&(ch_obj->cb_thread.cmd_sem));
+                    /* enqueue to cb thread and wake it up */
+                    if (0 != mm_camera_cmd_thread_enqueue(&ch_obj->cb_thread, cb_node)) {
+                        CDBG_ERROR("%s: enqueue to cb thread failed", __func__);
+                        mm_camera_cmd_thread_free_cmd(&ch_obj->cb_thread, cb_node);
+                        for (i=0; i<node->num_of_bufs; i++) {
+                            mm_channel_qbuf(ch_obj, node->super_buf[i].buf);
+                        }
+                    }
                 } else {
                     CDBG_ERROR("%s: No memory for mm_camera_node_t", __func__);
                     /* buf done with the nonuse super buf */
@@ -258,7 +266,7 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
                     mm_channel_qbuf(ch_obj, node->super_buf[i].buf);
                 }
             }
-            free(node);
+            mm_channel_superbuf_node_release(&ch_obj->bundle.superbuf_queue, node);
         } else {
             /* no superbuf avail, break the loop */
             break;
@@ -396,7 +404,9 @@ int32_t mm_channel_fsm_fn_stopped(mm_channel_t *my_obj,
         }
         break;
     case MM_CHANNEL_EVT_CONFIG_STREAM:
+    case MM_CHANNEL_EVT_RECONFIG_STREAM:
         {
+            /* nothing is streaming yet, reconfig is a plain config */
             mm_evt_paylod_config_stream_t *payload =
                 (mm_evt_paylod_config_stream_t *)in_val;
             rc = mm_channel_config_stream(my_obj,
@@ -496,6 +506,15 @@ int32_t mm_channel_fsm_fn_active(mm_channel_t *my_obj,
             rc = mm_channel_cancel_super_buf_request(my_obj);
         }
         break;
+    case MM_CHANNEL_EVT_RECONFIG_STREAM:
+        {
+            mm_evt_paylod_config_stream_t *payload =
+                (mm_evt_paylod_config_stream_t *)in_val;
+            rc = mm_channel_reconfig_stream(my_obj,
+                                            payload->stream_id,
+                                            payload->config);
+        }
+        break;
     case MM_CHANNEL_EVT_SET_STREAM_PARM:
         {
             mm_evt_paylod_set_get_stream_parms_t *payload =
@@ -743,6 +762,88 @@ int32_t mm_channel_config_stream(mm_channel_t *my_obj,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_reconfig_stream
+ *
+ * DESCRIPTION: reconfigure a started stream in place. Only this stream is
+ *              stopped, given the new config and started again, other
+ *              streams of the channel keep streaming. Upper layer may hand
+ *              back the buffers it already has if they fit the new config.
+ *              Not supported for streams bundled into super buf, since
+ *              matching of super buf needs all of them to restart together.
+ *
+ * PARAMETERS :
+ *   @my_obj       : channel object
+ *   @stream_id    : stream handle
+ *   @config       : new stream configuration
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_channel_reconfig_stream(mm_channel_t *my_obj,
+                                   uint32_t stream_id,
+                                   mm_camera_stream_config_t *config)
+{
+    int32_t rc = -1;
+    mm_stream_t * stream_obj = NULL;
+    CDBG("%s : E stream ID = %d", __func__, stream_id);
+    stream_obj = mm_channel_util_get_stream_by_handler(my_obj, stream_id);
+
+    if (NULL == stream_obj) {
+        CDBG_ERROR("%s :Invalid Stream Object for stream_id = %d", __func__, stream_id);
+        return rc;
+    }
+
+    if (stream_obj->is_bundled) {
+        CDBG_ERROR("%s: stream_id = %d is bundled, restart channel instead",
+                   __func__, stream_id);
+        return rc;
+    }
+
+    if (MM_STREAM_STATE_ACTIVE != stream_obj->state) {
+        CDBG_ERROR("%s: stream_id = %d not active, state = %d",
+                   __func__, stream_id, stream_obj->state);
+        return rc;
+    }
+
+    /* stream off and give bufs back to upper layer */
+    mm_stream_fsm_fn(stream_obj, MM_STREAM_EVT_STOP, NULL, NULL);
+    mm_stream_fsm_fn(stream_obj, MM_STREAM_EVT_UNREG_BUF, NULL, NULL);
+    mm_stream_fsm_fn(stream_obj, MM_STREAM_EVT_PUT_BUF, NULL, NULL);
+
+    rc = mm_stream_fsm_fn(stream_obj,
+                          MM_STREAM_EVT_SET_FMT,
+                          (void *)config,
+                          NULL);
+    if (0 != rc) {
+        CDBG_ERROR("%s: set fmt failed", __func__);
+        return rc;
+    }
+
+    rc = mm_stream_fsm_fn(stream_obj, MM_STREAM_EVT_GET_BUF, NULL, NULL);
+    if (0 != rc) {
+        CDBG_ERROR("%s: get buf failed", __func__);
+        return rc;
+    }
+
+    rc = mm_stream_fsm_fn(stream_obj, MM_STREAM_EVT_REG_BUF, NULL, NULL);
+    if (0 != rc) {
+        CDBG_ERROR("%s: reg buf failed", __func__);
+        mm_stream_fsm_fn(stream_obj, MM_STREAM_EVT_PUT_BUF, NULL, NULL);
+        return rc;
+    }
+
+    rc = mm_stream_fsm_fn(stream_obj, MM_STREAM_EVT_START, NULL, NULL);
+    if (0 != rc) {
+        CDBG_ERROR("%s: start stream failed", __func__);
+        mm_stream_fsm_fn(stream_obj, MM_STREAM_EVT_UNREG_BUF, NULL, NULL);
+        mm_stream_fsm_fn(stream_obj, MM_STREAM_EVT_PUT_BUF, NULL, NULL);
+    }
+    CDBG("%s : X rc = %d",__func__,rc);
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_start
  *
@@ -779,23 +880,33 @@ int32_t mm_channel_start(mm_channel_t *my_obj)
         mm_channel_superbuf_queue_init(&my_obj->bundle.superbuf_queue);
         my_obj->bundle.superbuf_queue.num_streams = num_streams_to_start;
         my_obj->bundle.superbuf_queue.expected_frame_id = 0;
+        my_obj->bundle.superbuf_queue.meta_s_idx = -1;
 
         for (i = 0; i < num_streams_to_start; i++) {
             /* set bundled flag to streams */
             s_objs[i]->is_bundled = 1;
             /* init bundled streams to invalid value -1 */
             my_obj->bundle.superbuf_queue.bundled_streams[i] = s_objs[i]->my_hdl;
+            /* metadata stream carries focus/exposure info for priority matching */
+            if (NULL != s_objs[i]->stream_info &&
+                CAM_STREAM_TYPE_METADATA == s_objs[i]->stream_info->stream_type) {
+                my_obj->bundle.superbuf_queue.meta_s_idx = i;
+            }
         }
 
         /* launch cb thread for dispatching super buf through cb */
         mm_camera_cmd_thread_launch(&my_obj->cb_thread,
                                     mm_channel_dispatch_super_buf,
-                                    (void*)my_obj);
+                                    (void*)my_obj,
+                                    MM_CAMERA_CMD_POOL_DEPTH_DATA,
+                                    MM_CAMERA_CMD_QUEUE_TYPE_LIST);
 
         /* launch cmd thread for super buf dataCB */
         mm_camera_cmd_thread_launch(&my_obj->cmd_thread,
                                     mm_channel_process_stream_buf,
-                                    (void*)my_obj);
+                                    (void*)my_obj,
+                                    MM_CAMERA_CMD_POOL_DEPTH_DATA,
+                                    MM_CAMERA_CMD_QUEUE_TYPE_LIST);
 
         /* set flag to TRUE */
         my_obj->bundle.is_active = TRUE;
@@ -912,6 +1023,7 @@ int32_t mm_channel_stop(mm_channel_t *my_obj)
 
     /* destroy super buf cmd thread */
     if (TRUE == my_obj->bundle.is_active) {
+        mm_camera_channel_attr_t attr = my_obj->bundle.superbuf_queue.attr;
         /* first stop bundle thread */
         mm_camera_cmd_thread_release(&my_obj->cmd_thread);
         mm_camera_cmd_thread_release(&my_obj->cb_thread);
@@ -919,8 +1031,11 @@ int32_t mm_channel_stop(mm_channel_t *my_obj)
         /* deinit superbuf queue */
         mm_channel_superbuf_queue_deinit(&my_obj->bundle.superbuf_queue);
 
-        /* memset bundle info */
-        memset(&my_obj->bundle, 0, sizeof(mm_channel_bundle_t));
+        /* reset bundle info, but keep what add_channel gave us so that
+         * the channel can be started again */
+        my_obj->bundle.is_active = FALSE;
+        memset(&my_obj->bundle.superbuf_queue, 0, sizeof(mm_channel_queue_t));
+        my_obj->bundle.superbuf_queue.attr = attr;
     }
 
     /* since all streams are stopped, we are safe to
@@ -958,17 +1073,17 @@ int32_t mm_channel_request_super_buf(mm_channel_t *my_obj, uint32_t num_buf_requ
     /* set pending_cnt
      * will trigger dispatching super frames if pending_cnt > 0 */
     /* send sem_post to wake up cmd thread to dispatch super buffer */
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&my_obj->cmd_thread);
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_REQ_DATA_CB;
         node->u.req_buf.num_buf_requested = num_buf_requested;
 
-        /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
-
-        /* wake up cmd thread */
-        sem_post(&(my_obj->cmd_thread.cmd_sem));
+        /* enqueue to cmd thread and wake it up */
+        rc = mm_camera_cmd_thread_enqueue(&my_obj->cmd_thread, node);
+        if (0 != rc) {
+            CDBG_ERROR("%s: enqueue to cmd thread failed", __func__);
+            mm_camera_cmd_thread_free_cmd(&my_obj->cmd_thread, node);
+        }
     } else {
         CDBG_ERROR("%s: No memory for mm_camera_node_t", __func__);
         rc = -1;
@@ -1201,7 +1316,17 @@ int32_t mm_channel_unmap_stream_buf(mm_channel_t *my_obj,
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
 {
-    return cam_queue_init(&queue->que);
+    uint32_t i;
+
+    memset(&queue->partial, 0, sizeof(queue->partial));
+
+    for (i = 0; i < MM_CHANNEL_SUPERBUF_POOL_DEPTH; i++) {
+        queue->free_nodes[i] = &queue->node_pool[i];
+    }
+    queue->free_cnt = MM_CHANNEL_SUPERBUF_POOL_DEPTH;
+    queue->overflow_cnt = 0;
+
+    return cam_queue_init_with_depth(&queue->que, MM_CHANNEL_SUPERBUF_POOL_DEPTH);
 }
 
 /*===========================================================================
@@ -1218,9 +1343,78 @@ int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_deinit(mm_channel_queue_t * queue)
 {
+    mm_channel_queue_node_t* super_buf = NULL;
+
+    /* matched nodes may come from pool, release them before
+     * queue is flushed */
+    super_buf = (mm_channel_queue_node_t*)cam_queue_deq(&queue->que);
+    while (NULL != super_buf) {
+        mm_channel_superbuf_node_release(queue, super_buf);
+        super_buf = (mm_channel_queue_node_t*)cam_queue_deq(&queue->que);
+    }
+
+    if (queue->overflow_cnt > 0) {
+        CDBG_HIGH("%s: superbuf pool (depth %d) overflowed %d times",
+                  __func__, MM_CHANNEL_SUPERBUF_POOL_DEPTH, queue->overflow_cnt);
+    }
+    memset(&queue->partial, 0, sizeof(queue->partial));
     return cam_queue_deinit(&queue->que);
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_node_alloc
+ *
+ * DESCRIPTION: get a node for a matched superbuf from the pool of the
+ *              superbuf queue. Falls back to heap if pool is exhausted.
+ *              Only called from channel cmd thread.
+ *
+ * PARAMETERS :
+ *   @queue   : superbuf queue
+ *
+ * RETURN     : ptr to a zeroed superbuf node, NULL if no memory
+ *==========================================================================*/
+static mm_channel_queue_node_t* mm_channel_superbuf_node_alloc(mm_channel_queue_t * queue)
+{
+    mm_channel_queue_node_t* super_buf = NULL;
+
+    if (queue->free_cnt > 0) {
+        super_buf = queue->free_nodes[--queue->free_cnt];
+    } else {
+        super_buf = (mm_channel_queue_node_t*)malloc(sizeof(mm_channel_queue_node_t));
+        if (NULL == super_buf) {
+            return NULL;
+        }
+        queue->overflow_cnt++;
+    }
+
+    memset(super_buf, 0, sizeof(mm_channel_queue_node_t));
+    return super_buf;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_node_release
+ *
+ * DESCRIPTION: return a superbuf node got from mm_channel_superbuf_dequeue
+ *              back to the pool of the superbuf queue. Only called from
+ *              channel cmd thread, or after it is stopped.
+ *
+ * PARAMETERS :
+ *   @queue   : superbuf queue
+ *   @super_buf : superbuf node to be released
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_channel_superbuf_node_release(mm_channel_queue_t * queue,
+                                      mm_channel_queue_node_t* super_buf)
+{
+    if ((super_buf >= queue->node_pool) &&
+        (super_buf < queue->node_pool + MM_CHANNEL_SUPERBUF_POOL_DEPTH)) {
+        queue->free_nodes[queue->free_cnt++] = super_buf;
+    } else {
+        free(super_buf);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_util_seq_comp_w_rollover
  *
@@ -1250,10 +1444,143 @@ int8_t mm_channel_util_seq_comp_w_rollover(uint32_t v1,
     return ret;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_evict_slot
+ *
+ * DESCRIPTION: release a partially matched superbuf, all bufs held by the
+ *              slot will be returned to kernel
+ *
+ * PARAMETERS :
+ *   @ch_obj  : channel object
+ *   @queue   : superbuf queue
+ *   @slot    : match slot to be evicted
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_evict_slot(mm_channel_t* ch_obj,
+                                           mm_channel_queue_t * queue,
+                                           mm_channel_match_slot_t *slot)
+{
+    uint8_t i;
+
+    for (i = 0; i < queue->num_streams; i++) {
+        if (slot->stream_mask & (1 << i)) {
+            mm_channel_qbuf(ch_obj, slot->super_buf.super_buf[i].buf);
+        }
+    }
+    memset(slot, 0, sizeof(mm_channel_match_slot_t));
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_is_settled
+ *
+ * DESCRIPTION: check focus state of a matched superbuf from the metadata
+ *              stream bundled in the channel. Metadata buf is invalidated
+ *              before reading, as it is written by hardware.
+ *
+ * PARAMETERS :
+ *   @ch_obj  : channel object
+ *   @queue   : superbuf queue
+ *   @super_buf : matched superbuf
+ *
+ * RETURN     : 1 -- focus settled, or no info to tell
+ *              0 -- focus is still moving
+ *==========================================================================*/
+static uint8_t mm_channel_superbuf_is_settled(mm_channel_t* ch_obj,
+                                              mm_channel_queue_t * queue,
+                                              mm_channel_queue_node_t* super_buf)
+{
+    cam_metadata_info_t *meta = NULL;
+    mm_camera_buf_def_t *meta_buf = NULL;
+    mm_stream_t *s_obj = NULL;
+
+    if (MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS != queue->attr.priority ||
+        queue->meta_s_idx < 0) {
+        return 1;
+    }
+
+    meta_buf = super_buf->super_buf[queue->meta_s_idx].buf;
+    if (NULL == meta_buf || NULL == meta_buf->buffer) {
+        return 1;
+    }
+
+    s_obj = mm_channel_util_get_stream_by_handler(ch_obj,
+                                                  queue->bundled_streams[queue->meta_s_idx]);
+    if (NULL == s_obj ||
+        0 != mm_stream_invalidate_buf(s_obj, meta_buf->buf_idx)) {
+        /* cannot trust cached content */
+        return 1;
+    }
+
+    meta = (cam_metadata_info_t *)meta_buf->buffer;
+    if (meta->is_focus_valid &&
+        CAM_AF_FOCUSED != meta->focus_data.focus_state) {
+        return 0;
+    }
+    return 1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_priority_filter
+ *
+ * DESCRIPTION: decide if a matched superbuf should be queued based on the
+ *              priority attribute. In focus priority mode, unsettled frames
+ *              are only queued while no settled frame is available, and the
+ *              first settled frame flushes all unsettled ones in queue.
+ *              Need to be called with que.lock held.
+ *
+ * PARAMETERS :
+ *   @ch_obj  : channel object
+ *   @queue   : superbuf queue
+ *   @super_buf : matched superbuf
+ *
+ * RETURN     : 1 -- superbuf to be queued
+ *              0 -- superbuf to be dropped
+ *==========================================================================*/
+static uint8_t mm_channel_superbuf_priority_filter(mm_channel_t* ch_obj,
+                                                   mm_channel_queue_t * queue,
+                                                   mm_channel_queue_node_t* super_buf)
+{
+    mm_channel_queue_node_t* old_buf = NULL;
+    uint8_t i;
+
+    if (MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS != queue->attr.priority) {
+        return 1;
+    }
+
+    if (!super_buf->is_settled) {
+        /* keep unsettled frame only if there is nothing better */
+        return (0 == queue->settled_cnt) ? 1 : 0;
+    }
+
+    if (0 == queue->settled_cnt) {
+        /* first settled frame, flush unsettled frames queued before */
+        while (queue->match_cnt > 0) {
+            old_buf = mm_channel_superbuf_dequeue_internal(queue);
+            if (NULL == old_buf) {
+                break;
+            }
+            for (i = 0; i < old_buf->num_of_bufs; i++) {
+                if (NULL != old_buf->super_buf[i].buf) {
+                    mm_channel_qbuf(ch_obj, old_buf->super_buf[i].buf);
+                }
+            }
+            mm_channel_superbuf_node_release(queue, old_buf);
+        }
+    }
+    return 1;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_superbuf_comp_and_enqueue
  *
- * DESCRIPTION: implementation for matching logic for superbuf
+ * DESCRIPTION: implementation for matching logic for superbuf. Only one
+ *              partial superbuf is pending at a time, kept in a match slot
+ *              outside the queue, so matching a buf is done without walking
+ *              the queue. A buf of a newer frame releases the pending partial
+ *              superbuf, a buf of an older frame is released itself. Once all
+ *              bundled streams are present for a frame, the superbuf is moved
+ *              into the queue of matched superbufs.
  *
  * PARAMETERS :
  *   @ch_obj  : channel object
@@ -1270,10 +1597,10 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                         mm_camera_buf_info_t *buf_info)
 {
     cam_node_t* node = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
+    mm_channel_match_slot_t *slot = NULL;
     mm_channel_queue_node_t* super_buf = NULL;
-    uint8_t buf_s_idx, i;
+    uint32_t full_mask;
+    uint8_t buf_s_idx;
 
     CDBG("%s: E", __func__);
     for (buf_s_idx = 0; buf_s_idx < queue->num_streams; buf_s_idx++) {
@@ -1293,141 +1620,78 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
         return 0;
     }
 
-    if (MM_CAMERA_SUPER_BUF_PRIORITY_NORMAL != queue->attr.priority) {
-        /* TODO */
-        /* need to decide if we want to queue the frame based on focus or exposure
-         * if frame not to be queued, we need to qbuf it back */
-    }
-
     /* comp */
     pthread_mutex_lock(&queue->que.lock);
-    head = &queue->que.head.list;
-    /* get the last one in the queue which is possibly having no matching */
-    pos = head->next;
-    while (pos != head) {
-        node = member_of(pos, cam_node_t, list);
-        super_buf = (mm_channel_queue_node_t*)node->data;
-        if (NULL != super_buf) {
-            if (super_buf->matched) {
-                /* find a matched super buf, move to next one */
-                pos = pos->next;
-                continue;
-            } else {
-                /* have an unmatched super buf, break the loop */
-                break;
-            }
+    slot = &queue->partial;
+    if (slot->stream_mask != 0 && slot->frame_idx != buf_info->frame_idx) {
+        if (mm_channel_util_seq_comp_w_rollover(slot->frame_idx,
+                                                buf_info->frame_idx) > 0) {
+            /* pending superbuf is of a newer frame, the new buf is too old */
+            mm_channel_qbuf(ch_obj, buf_info->buf);
+            pthread_mutex_unlock(&queue->que.lock);
+            return 0;
         }
+        /* new buf is newer, pending superbuf can never be matched */
+        CDBG("%s: evict stale superbuf of frame %d", __func__, slot->frame_idx);
+        mm_channel_superbuf_evict_slot(ch_obj, queue, slot);
     }
 
-    if (pos == head) {
-        CDBG("%s: all nodes in queue are mtached, or no node in queue, create a new node", __func__);
-        /* all nodes in queue are mtached, or no node in queue
-         * create a new node */
-        mm_channel_queue_node_t *new_buf = NULL;
-        cam_node_t* new_node = NULL;
-
-        new_buf = (mm_channel_queue_node_t*)malloc(sizeof(mm_channel_queue_node_t));
-        new_node = (cam_node_t*)malloc(sizeof(cam_node_t));
-        if (NULL != new_buf && NULL != new_node) {
-            memset(new_buf, 0, sizeof(mm_channel_queue_node_t));
-            memset(new_node, 0, sizeof(cam_node_t));
-            new_node->data = (void *)new_buf;
-            new_buf->num_of_bufs = queue->num_streams;
-            new_buf->super_buf[buf_s_idx] = *buf_info;
-
-            /* enqueue */
-            //cam_list_add_tail_node(&node->list, &queue->que.head.list);
-            cam_list_add_tail_node(&new_node->list, &queue->que.head.list);
-            queue->que.size++;
+    if (slot->stream_mask & (1 << buf_s_idx)) {
+        /* already have the frame from this stream, ignore the new one */
+        mm_channel_qbuf(ch_obj, buf_info->buf);
+        pthread_mutex_unlock(&queue->que.lock);
+        return 0;
+    }
 
-            if(queue->num_streams == 1) {
-                new_buf->matched = 1;
+    CDBG("%s: add stream = %d frame id = %d ",
+         __func__, buf_info->stream_id, buf_info->frame_idx);
+    if (0 == slot->stream_mask) {
+        slot->frame_idx = buf_info->frame_idx;
+        slot->super_buf.num_of_bufs = queue->num_streams;
+    }
+    slot->stream_mask |= (1 << buf_s_idx);
+    slot->super_buf.super_buf[buf_s_idx] = *buf_info;
+
+    full_mask = (1 << queue->num_streams) - 1;
+    if (slot->stream_mask == full_mask) {
+        /* all bundled streams are present, move to matched queue */
+        slot->super_buf.matched = 1;
+        slot->super_buf.is_settled =
+            mm_channel_superbuf_is_settled(ch_obj, queue, &slot->super_buf);
+        if (!mm_channel_superbuf_priority_filter(ch_obj, queue, &slot->super_buf)) {
+            /* not a wanted frame by priority, release it */
+            CDBG("%s: drop unsettled frame %d", __func__, slot->frame_idx);
+            mm_channel_superbuf_evict_slot(ch_obj, queue, slot);
+            pthread_mutex_unlock(&queue->que.lock);
+            return 0;
+        }
 
-                if (new_buf->matched) {
-                    queue->expected_frame_id = buf_info->frame_idx + queue->attr.post_frame_skip;
-                    queue->match_cnt++;
-                }
+        super_buf = mm_channel_superbuf_node_alloc(queue);
+        node = cam_queue_get_node(&queue->que);
+        if (NULL != super_buf && NULL != node) {
+            *super_buf = slot->super_buf;
+            node->data = (void *)super_buf;
+            cam_list_add_tail_node(&node->list, &queue->que.head.list);
+            queue->que.size++;
+            if (super_buf->is_settled) {
+                queue->settled_cnt++;
             }
+
+            memset(slot, 0, sizeof(mm_channel_match_slot_t));
+
+            queue->expected_frame_id = buf_info->frame_idx + queue->attr.post_frame_skip;
+            queue->match_cnt++;
+            CDBG("%s, match_cnt = %d", __func__, queue->match_cnt);
         } else {
             /* No memory */
-            if (NULL != new_buf) {
-                free(new_buf);
-            }
-            if (NULL != new_node) {
-                free(new_node);
-            }
-            /* qbuf the new buf since we cannot enqueue */
-            mm_channel_qbuf(ch_obj, buf_info->buf);
-        }
-    } else {
-        CDBG("%s: find an unmatched super buf", __func__);
-        /* find an unmatched super buf */
-        if (super_buf->super_buf[buf_s_idx].frame_idx == 0) {
-            /* new frame from the stream_id */
-            uint8_t is_new = 1;
-            uint32_t frame_idx;
-
-            for (i=0; i < super_buf->num_of_bufs; i++) {
-            //for (i=0; i < buf_s_idx; i++) {
-                if(super_buf->super_buf[i].buf == NULL) {
-                    continue;
-                }
-                frame_idx = super_buf->super_buf[i].buf->frame_idx;
-                if (frame_idx == 0) {
-                    continue;
-                }
-                if (frame_idx < buf_info->frame_idx) {
-                    /* existing frame is older than the new frame, qbuf it */
-                    mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
-                    memset(&super_buf->super_buf[i], 0, sizeof(mm_camera_buf_info_t));
-                } else if (frame_idx > buf_info->frame_idx) {
-                    /* new frame is older */
-                    is_new = 0;
-                    break;
-                }else{
-                    //TODO: reveiw again
-                    break;
-                }
-            }
-            if (is_new) {
-                CDBG("%s: add stream = %d frame id = %d ",
-                     __func__, buf_info->stream_id, buf_info->frame_idx);
-                super_buf->super_buf[buf_s_idx] = *buf_info;
-
-                /* check if superbuf is all matched */
-                super_buf->matched = 1;
-                for (i=0; i < super_buf->num_of_bufs; i++) {
-                    if (super_buf->super_buf[i].frame_idx == 0) {
-                        super_buf->matched = 0;
-                        break;
-                    }
-                }
-
-                if (super_buf->matched) {
-                    queue->expected_frame_id = buf_info->frame_idx + queue->attr.post_frame_skip;
-                    queue->match_cnt++;
-                    CDBG("%s, match_cnt = %d", __func__, queue->match_cnt);
-                }
-            } else {
-                mm_channel_qbuf(ch_obj, buf_info->buf);
+            if (NULL != super_buf) {
+                mm_channel_superbuf_node_release(queue, super_buf);
             }
-        } else {
-            if (super_buf->super_buf[buf_s_idx].frame_idx < buf_info->frame_idx) {
-                CDBG("%s: new frame is newer, add into superbuf", __func__);
-                /* current frames in superbuf are older than the new frame
-                 * qbuf all current frames */
-                for (i=0; i<super_buf->num_of_bufs; i++) {
-                    if (super_buf->super_buf[i].frame_idx != 0) {
-                            mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
-                            memset(&super_buf->super_buf[i], 0, sizeof(mm_camera_buf_info_t));
-                    }
-                }
-                /* add the new frame into the superbuf */
-                super_buf->super_buf[buf_s_idx] = *buf_info;
-            } else {
-                /* the new frame is older, just ignor */
-                mm_channel_qbuf(ch_obj, buf_info->buf);
+            if (NULL != node) {
+                cam_queue_put_node(&queue->que, node);
             }
+            /* qbuf the matched bufs since we cannot enqueue */
+            mm_channel_superbuf_evict_slot(ch_obj, queue, slot);
         }
     }
     pthread_mutex_unlock(&queue->que.lock);
@@ -1456,20 +1720,16 @@ mm_channel_queue_node_t* mm_channel_superbuf_dequeue_internal(mm_channel_queue_t
     head = &queue->que.head.list;
     pos = head->next;
     if (pos != head) {
-        /* get the first node */
+        /* get the first node, only matched super bufs are in queue */
         node = member_of(pos, cam_node_t, list);
         super_buf = (mm_channel_queue_node_t*)node->data;
-        if (NULL != super_buf) {
-            if (super_buf->matched) {
-                /* we found a mtaching super buf, dequeue it */
-                cam_list_del_node(&node->list);
-                queue->que.size--;
-                queue->match_cnt--;
-                free(node);
-            } else {
-                super_buf = NULL;
-            }
+        cam_list_del_node(&node->list);
+        queue->que.size--;
+        queue->match_cnt--;
+        if (super_buf->is_settled) {
+            queue->settled_cnt--;
         }
+        cam_queue_put_node(&queue->que, node);
     }
 
     return super_buf;
@@ -1532,7 +1792,7 @@ int32_t mm_channel_superbuf_bufdone_overflow(mm_channel_t* my_obj,
                     mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
                 }
             }
-            free(super_buf);
+            mm_channel_superbuf_node_release(queue, super_buf);
         }
     }
     pthread_mutex_unlock(&queue->que.lock);
@@ -1547,6 +1807,8 @@ int32_t mm_channel_superbuf_bufdone_overflow(mm_channel_t* my_obj,
  *
  * DESCRIPTION: depends on the lookback configuration of the channel attribute,
  *              unwanted superbufs will be removed from the superbuf queue.
+ *              In focus priority mode, only the newest requested superbufs
+ *              within the lookback window are kept.
  *
  * PARAMETERS :
  *   @my_obj  : channel object
@@ -1560,15 +1822,23 @@ int32_t mm_channel_superbuf_skip(mm_channel_t* my_obj,
                                  mm_channel_queue_t * queue)
 {
     int32_t rc = 0, i;
+    uint32_t keep_cnt = queue->attr.look_back;
     mm_channel_queue_node_t* super_buf = NULL;
     if (MM_CAMERA_SUPER_BUF_NOTIFY_CONTINUOUS == queue->attr.notify_mode) {
         /* for continuous streaming mode, no skip is needed */
         return 0;
     }
 
+    if (MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS == queue->attr.priority &&
+        my_obj->pending_cnt > 0 &&
+        my_obj->pending_cnt < keep_cnt) {
+        /* queue only has settled frames if any, deliver the newest ones */
+        keep_cnt = my_obj->pending_cnt;
+    }
+
     /* bufdone overflowed bufs */
     pthread_mutex_lock(&queue->que.lock);
-    while (queue->match_cnt > queue->attr.look_back) {
+    while (queue->match_cnt > keep_cnt) {
         super_buf = mm_channel_superbuf_dequeue_internal(queue);
         if (NULL != super_buf) {
             for (i=0; i<super_buf->num_of_bufs; i++) {
@@ -1576,7 +1846,7 @@ int32_t mm_channel_superbuf_skip(mm_channel_t* my_obj,
                     mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
                 }
             }
-            free(super_buf);
+            mm_channel_superbuf_node_release(queue, super_buf);
         }
     }
     pthread_mutex_unlock(&queue->que.lock);
@@ -41,6 +41,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mm_camera_interface.h"
 #include "mm_camera_sock.h"
 #include "mm_camera.h"
+#include "mm_camera_backend.h"
 
 static pthread_mutex_t g_intf_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -646,6 +647,47 @@ static int32_t mm_camera_intf_config_stream(uint32_t camera_handle,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_intf_reconfig_stream
+ *
+ * DESCRIPTION: reconfigure a stream. If the channel is started, only this
+ *              stream is restarted, the rest of the channel keeps streaming.
+ *
+ * PARAMETERS :
+ *   @camera_handle: camera handle
+ *   @ch_id        : channel handle
+ *   @stream_id    : stream handle
+ *   @config       : new stream configuration
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_intf_reconfig_stream(uint32_t camera_handle,
+                                              uint32_t ch_id,
+                                              uint32_t stream_id,
+                                              mm_camera_stream_config_t *config)
+{
+    int32_t rc = -1;
+    mm_camera_obj_t * my_obj = NULL;
+
+    CDBG("%s :E handle = %d, ch_id = %d,stream_id = %d",
+         __func__, camera_handle, ch_id, stream_id);
+
+    pthread_mutex_lock(&g_intf_lock);
+    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+
+    if(my_obj) {
+        pthread_mutex_lock(&my_obj->cam_lock);
+        pthread_mutex_unlock(&g_intf_lock);
+        rc = mm_camera_reconfig_stream(my_obj, ch_id, stream_id, config);
+    } else {
+        pthread_mutex_unlock(&g_intf_lock);
+    }
+    CDBG("%s :X rc = %d", __func__, rc);
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_intf_start_channel
  *
@@ -1080,6 +1122,13 @@ uint8_t get_num_of_cameras()
     CDBG("%s : E", __func__);
     /* lock the mutex */
     pthread_mutex_lock(&g_intf_lock);
+    if (NULL != mm_camera_backend()->enum_cameras) {
+        g_cam_ctrl.num_cam = (uint8_t)mm_camera_backend()->enum_cameras(
+            g_cam_ctrl.video_dev_name, MM_CAMERA_MAX_NUM_SENSORS);
+        pthread_mutex_unlock(&g_intf_lock);
+        CDBG("%s: num_cameras=%d\n", __func__, g_cam_ctrl.num_cam);
+        return g_cam_ctrl.num_cam;
+    }
     while (1) {
         char dev_name[32];
         int num_entities;
@@ -1154,6 +1203,7 @@ static mm_camera_ops_t mm_camera_ops = {
     .add_stream = mm_camera_intf_add_stream,
     .delete_stream = mm_camera_intf_del_stream,
     .config_stream = mm_camera_intf_config_stream,
+    .reconfig_stream = mm_camera_intf_reconfig_stream,
     .qbuf = mm_camera_intf_qbuf,
     .map_stream_buf = mm_camera_intf_map_stream_buf,
     .unmap_stream_buf = mm_camera_intf_unmap_stream_buf,
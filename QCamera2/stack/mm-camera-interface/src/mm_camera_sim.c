@@ -0,0 +1,1578 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of Code Aurora Forum, Inc. nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Loopback backend: stands in for the msm camera kernel driver and the
+ * mm-camera server, so the interface can run on a build host. Frames are
+ * produced by one thread per camera at the configured rate; buffers and
+ * info structs mapped through the "domain socket" are mmapped here the
+ * same way the server does. Configured by env MM_CAMERA_SIM_<KEY> or by
+ * property persist.camera.sim.<key>:
+ *   num_cams  : number of cameras                          (1)
+ *   width     : sensor width                               (1920)
+ *   height    : sensor height                              (1080)
+ *   fmt       : nv21, nv12 or yv12                         (nv21)
+ *   fps       : frame rate                                 (30)
+ *   jitter_us : max random deviation of frame time         (0)
+ *   drop_pct  : percent of frames dropped by the "sensor"  (0)
+ *   fill      : 0 - leave buffers untouched,
+ *               1 - stamp frame sequence/timestamp at start of buffer,
+ *               2 - memset whole buffer                    (1)
+ *   msg_us    : server time to handle one socket message   (0)
+ *   af_period : frames per focus sweep reported in metadata
+ *               stream bufs, 0 for no focus data             (0)
+ *   af_scan   : frames of each sweep still scanning, the
+ *               rest of the sweep reports focused            (0)
+ *   replay    : file of recorded arrivals to replay instead of
+ *               free running frames, read at frame source start ("")
+ *
+ * A replay file holds whitespace separated "<stream>:<frame_idx>" entries.
+ * <stream> is the index of the stream in the order the streams of the
+ * camera were added. One entry is delivered per frame period, in file
+ * order, and only once the previous one has been dequeued and the target
+ * stream has a free buf, so the client sees exactly the recorded order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#ifdef _ANDROID_
+#include <cutils/properties.h>
+#endif
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera_backend.h"
+
+#define MM_SIM_MAX_FDS          64
+#define MM_SIM_MAX_STREAMS      8
+#define MM_SIM_MAX_EVTS         16
+/* slot 0 is for buffers with one fd for all planes (plane_idx = -1) */
+#define MM_SIM_MAX_MAPS         (VIDEO_MAX_PLANES + 1)
+#define MM_SIM_CFG_LEN          92
+
+typedef enum {
+    MM_SIM_FD_CTRL,
+    MM_SIM_FD_STREAM,
+    MM_SIM_FD_SOCK,
+} mm_sim_fd_type_t;
+
+typedef struct {
+    void *vaddr;
+    uint32_t size;
+} mm_sim_map_t;
+
+typedef struct {
+    uint32_t buf_idx;
+    uint32_t sequence;
+    struct timeval timestamp;
+} mm_sim_frame_t;
+
+typedef struct {
+    uint32_t stream_idx;
+    uint32_t frame_idx;
+} mm_sim_arrival_t;
+
+typedef struct {
+    uint8_t used;
+    int pipe_fd[2];                 /* [0] is handed out as stream fd */
+    uint32_t server_stream_id;
+    uint8_t streaming;
+    uint32_t num_bufs;
+    struct msm_v4l2_format_data fmt;
+    mm_sim_map_t info;              /* cam_stream_info_t */
+    mm_sim_map_t bufs[MM_CAMERA_MAX_NUM_FRAMES][MM_SIM_MAX_MAPS];
+    struct v4l2_plane planes[MM_CAMERA_MAX_NUM_FRAMES][VIDEO_MAX_PLANES];
+    uint32_t num_planes[MM_CAMERA_MAX_NUM_FRAMES];
+
+    /* bufs owned by "kernel", waiting to be filled */
+    uint32_t queued[MM_CAMERA_MAX_NUM_FRAMES];
+    uint32_t queued_head;
+    uint32_t queued_cnt;
+
+    /* filled bufs waiting for DQBUF */
+    mm_sim_frame_t done[MM_CAMERA_MAX_NUM_FRAMES];
+    uint32_t done_head;
+    uint32_t done_cnt;
+
+    uint32_t frames;
+    uint32_t drops;                 /* frames lost for no queued buf */
+} mm_sim_stream_t;
+
+typedef struct {
+    uint8_t opened;
+    int ctrl_pipe[2];               /* [0] is handed out as ctrl fd */
+    int sock_pipe[2];               /* [0] is handed out as socket fd */
+    mm_sim_map_t capability;        /* cam_capability_t */
+    mm_sim_map_t parm;              /* parm_buffer_t */
+    parm_buffer_t parm_store;       /* parms as last set by client */
+    uint32_t next_server_stream_id;
+    mm_sim_stream_t streams[MM_SIM_MAX_STREAMS];
+
+    struct msm_v4l2_event_data evts[MM_SIM_MAX_EVTS];
+    uint32_t evt_head;
+    uint32_t evt_cnt;
+
+    /* frame source */
+    uint32_t num_streaming;
+    uint32_t frame_gen;             /* bumped to stop current frame thread */
+    pthread_t frame_tid;
+    uint8_t frame_tid_valid;
+    pthread_cond_t frame_cond;
+    uint32_t sequence;
+
+    /* recorded arrivals being replayed, NULL if free running */
+    mm_sim_arrival_t *replay;
+    uint32_t replay_cnt;
+    uint32_t replay_pos;
+} mm_sim_camera_t;
+
+typedef struct {
+    int fd;
+    mm_sim_fd_type_t type;
+    uint8_t cam_idx;
+    uint8_t stream_idx;
+} mm_sim_fd_t;
+
+typedef struct {
+    int num_cams;
+    int width;
+    int height;
+    cam_format_t fmt;
+    int fps;
+    int jitter_us;
+    int drop_pct;
+    int fill;
+    int msg_us;
+    int af_period;
+    int af_scan;
+    char replay[MM_SIM_CFG_LEN];
+} mm_sim_cfg_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    mm_sim_cfg_t cfg;
+    mm_sim_fd_t fds[MM_SIM_MAX_FDS];
+    mm_sim_camera_t cams[MM_CAMERA_MAX_NUM_SENSORS];
+} mm_sim_ctrl_t;
+
+static mm_sim_ctrl_t g_sim = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+static pthread_once_t g_sim_once = PTHREAD_ONCE_INIT;
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_get_cfg_str
+ *
+ * DESCRIPTION: read one config value from env MM_CAMERA_SIM_<KEY>, or from
+ *              property persist.camera.sim.<key> if env is not set
+ *
+ * PARAMETERS :
+ *   @key     : lower case config key
+ *   @value   : buf to store value, at least PROPERTY_VALUE_MAX long
+ *   @len     : length of value buf
+ *   @def     : default value
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_sim_get_cfg_str(const char *key, char *value, size_t len,
+                               const char *def)
+{
+    char name[64];
+    const char *env;
+    size_t i, n;
+
+    n = (size_t)snprintf(name, sizeof(name), "MM_CAMERA_SIM_");
+    for (i = 0; key[i] != '\0' && n + 1 < sizeof(name); i++, n++) {
+        name[n] = (char)toupper((unsigned char)key[i]);
+    }
+    name[n] = '\0';
+
+    env = getenv(name);
+    if (NULL != env) {
+        strncpy(value, env, len - 1);
+        value[len - 1] = '\0';
+        return;
+    }
+#ifdef _ANDROID_
+    snprintf(name, sizeof(name), "persist.camera.sim.%s", key);
+    property_get(name, value, def);
+#else
+    strncpy(value, def, len - 1);
+    value[len - 1] = '\0';
+#endif
+}
+
+static int mm_sim_get_cfg_int(const char *key, int def)
+{
+    char value[MM_SIM_CFG_LEN];
+    char def_str[16];
+
+    snprintf(def_str, sizeof(def_str), "%d", def);
+    mm_sim_get_cfg_str(key, value, sizeof(value), def_str);
+    return atoi(value);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_init
+ *
+ * DESCRIPTION: read configuration, called once per process
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_sim_init(void)
+{
+    mm_sim_cfg_t *cfg = &g_sim.cfg;
+    char fmt[MM_SIM_CFG_LEN];
+    int i;
+
+    cfg->num_cams = mm_sim_get_cfg_int("num_cams", 1);
+    if (cfg->num_cams < 0) {
+        cfg->num_cams = 0;
+    } else if (cfg->num_cams > MM_CAMERA_MAX_NUM_SENSORS) {
+        cfg->num_cams = MM_CAMERA_MAX_NUM_SENSORS;
+    }
+    cfg->width = mm_sim_get_cfg_int("width", 1920);
+    cfg->height = mm_sim_get_cfg_int("height", 1080);
+    cfg->fps = mm_sim_get_cfg_int("fps", 30);
+    if (cfg->fps <= 0) {
+        cfg->fps = 30;
+    }
+    cfg->jitter_us = mm_sim_get_cfg_int("jitter_us", 0);
+    cfg->drop_pct = mm_sim_get_cfg_int("drop_pct", 0);
+    cfg->fill = mm_sim_get_cfg_int("fill", 1);
+    cfg->msg_us = mm_sim_get_cfg_int("msg_us", 0);
+    cfg->af_period = mm_sim_get_cfg_int("af_period", 0);
+    cfg->af_scan = mm_sim_get_cfg_int("af_scan", 0);
+    mm_sim_get_cfg_str("replay", cfg->replay, sizeof(cfg->replay), "");
+
+    mm_sim_get_cfg_str("fmt", fmt, sizeof(fmt), "nv21");
+    if (0 == strcmp(fmt, "nv12")) {
+        cfg->fmt = CAM_FORMAT_YUV_420_NV12;
+    } else if (0 == strcmp(fmt, "yv12")) {
+        cfg->fmt = CAM_FORMAT_YUV_420_YV12;
+    } else {
+        cfg->fmt = CAM_FORMAT_YUV_420_NV21;
+    }
+
+    for (i = 0; i < MM_SIM_MAX_FDS; i++) {
+        g_sim.fds[i].fd = -1;
+    }
+    for (i = 0; i < MM_CAMERA_MAX_NUM_SENSORS; i++) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&g_sim.cams[i].frame_cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+
+    CDBG_HIGH("%s: %d cams, %dx%d fmt %d @ %d fps, jitter %d us, drop %d%%",
+              __func__, cfg->num_cams, cfg->width, cfg->height, cfg->fmt,
+              cfg->fps, cfg->jitter_us, cfg->drop_pct);
+}
+
+static inline void mm_sim_once(void)
+{
+    pthread_once(&g_sim_once, mm_sim_init);
+}
+
+/* following helpers must be called with g_sim.lock held */
+
+static mm_sim_fd_t *mm_sim_fd_lookup(int fd)
+{
+    int i;
+    for (i = 0; i < MM_SIM_MAX_FDS; i++) {
+        if (g_sim.fds[i].fd == fd) {
+            return &g_sim.fds[i];
+        }
+    }
+    return NULL;
+}
+
+static mm_sim_fd_t *mm_sim_fd_add(int fd, mm_sim_fd_type_t type,
+                                  uint8_t cam_idx, uint8_t stream_idx)
+{
+    mm_sim_fd_t *entry = mm_sim_fd_lookup(-1);
+    if (NULL != entry) {
+        entry->fd = fd;
+        entry->type = type;
+        entry->cam_idx = cam_idx;
+        entry->stream_idx = stream_idx;
+    }
+    return entry;
+}
+
+static void mm_sim_map(mm_sim_map_t *map, int fd, uint32_t size)
+{
+    void *vaddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == vaddr) {
+        CDBG_ERROR("%s: mmap fd %d size %u failed (%s)",
+                   __func__, fd, size, strerror(errno));
+        return;
+    }
+    map->vaddr = vaddr;
+    map->size = size;
+}
+
+static void mm_sim_unmap(mm_sim_map_t *map)
+{
+    if (NULL != map->vaddr) {
+        munmap(map->vaddr, map->size);
+    }
+    map->vaddr = NULL;
+    map->size = 0;
+}
+
+static void mm_sim_pipe_drain(int fd)
+{
+    char tmp[64];
+    while (read(fd, tmp, sizeof(tmp)) > 0) {
+    }
+}
+
+static void mm_sim_pipe_kick(int fd)
+{
+    char c = 0;
+    if (write(fd, &c, 1) != 1) {
+        CDBG_ERROR("%s: write to fd %d failed (%s)", __func__, fd, strerror(errno));
+    }
+}
+
+static void mm_sim_post_evt(mm_sim_camera_t *cam, uint32_t command, uint32_t status)
+{
+    struct msm_v4l2_event_data *evt;
+
+    if (cam->evt_cnt >= MM_SIM_MAX_EVTS) {
+        CDBG_ERROR("%s: evt queue full, evt %u dropped", __func__, command);
+        return;
+    }
+    evt = &cam->evts[(cam->evt_head + cam->evt_cnt) % MM_SIM_MAX_EVTS];
+    memset(evt, 0, sizeof(*evt));
+    evt->command = command;
+    evt->status = status;
+    cam->evt_cnt++;
+    mm_sim_pipe_kick(cam->ctrl_pipe[1]);
+}
+
+static mm_sim_stream_t *mm_sim_get_stream_by_server_id(mm_sim_camera_t *cam,
+                                                       uint32_t server_stream_id)
+{
+    int i;
+    for (i = 0; i < MM_SIM_MAX_STREAMS; i++) {
+        if (cam->streams[i].used &&
+            cam->streams[i].server_stream_id == server_stream_id) {
+            return &cam->streams[i];
+        }
+    }
+    return NULL;
+}
+
+static void mm_sim_stream_flush(mm_sim_stream_t *stream)
+{
+    stream->queued_head = stream->queued_cnt = 0;
+    stream->done_head = stream->done_cnt = 0;
+    mm_sim_pipe_drain(stream->pipe_fd[0]);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_fill_meta
+ *
+ * DESCRIPTION: write metadata of a frame into a metadata stream buffer, as
+ *              the server does. Only focus data is reported, its state
+ *              follows the configured focus sweep.
+ *
+ * PARAMETERS :
+ *   @stream  : stream the buffer belongs to
+ *   @idx     : buffer index
+ *   @frame   : frame the metadata is of
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_sim_fill_meta(mm_sim_stream_t *stream, uint32_t idx,
+                             mm_sim_frame_t *frame)
+{
+    mm_sim_map_t *map = stream->bufs[idx];
+    cam_metadata_info_t *meta;
+    int i;
+
+    for (i = 0; i < MM_SIM_MAX_MAPS; i++) {
+        if (NULL != map[i].vaddr && map[i].size >= sizeof(cam_metadata_info_t)) {
+            meta = (cam_metadata_info_t *)map[i].vaddr;
+            memset(meta, 0, sizeof(cam_metadata_info_t));
+            meta->is_focus_valid = 1;
+            if ((int)(frame->sequence % g_sim.cfg.af_period) < g_sim.cfg.af_scan) {
+                meta->focus_data.focus_state = CAM_AF_SCANNING;
+            } else {
+                meta->focus_data.focus_state = CAM_AF_FOCUSED;
+            }
+            break;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_fill_buf
+ *
+ * DESCRIPTION: write frame content into a stream buffer, as configured.
+ *              Metadata stream bufs get metadata if a focus sweep is set.
+ *
+ * PARAMETERS :
+ *   @stream  : stream the buffer belongs to
+ *   @idx     : buffer index
+ *   @frame   : frame to be written
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_sim_fill_buf(mm_sim_stream_t *stream, uint32_t idx,
+                            mm_sim_frame_t *frame)
+{
+    mm_sim_map_t *map = stream->bufs[idx];
+    uint32_t stamp[4];
+    int i;
+
+    if (g_sim.cfg.af_period > 0 && NULL != stream->info.vaddr &&
+        CAM_STREAM_TYPE_METADATA ==
+            ((cam_stream_info_t *)stream->info.vaddr)->stream_type) {
+        mm_sim_fill_meta(stream, idx, frame);
+        return;
+    }
+
+    if (1 == g_sim.cfg.fill) {
+        /* first mapped plane only */
+        for (i = 0; i < MM_SIM_MAX_MAPS; i++) {
+            if (NULL != map[i].vaddr && map[i].size >= sizeof(stamp)) {
+                stamp[0] = frame->sequence;
+                stamp[1] = idx;
+                stamp[2] = (uint32_t)frame->timestamp.tv_sec;
+                stamp[3] = (uint32_t)frame->timestamp.tv_usec;
+                memcpy(map[i].vaddr, stamp, sizeof(stamp));
+                break;
+            }
+        }
+    } else if (2 == g_sim.cfg.fill) {
+        for (i = 0; i < MM_SIM_MAX_MAPS; i++) {
+            if (NULL != map[i].vaddr) {
+                memset(map[i].vaddr, (int)(frame->sequence & 0xff), map[i].size);
+            }
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_produce_frame
+ *
+ * DESCRIPTION: hand one sensor frame to every streaming stream of a camera.
+ *              All streams get the same sequence, so that bundled streams
+ *              can be matched into super buf as with the real server.
+ *
+ * PARAMETERS :
+ *   @cam     : camera object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_sim_produce_frame(mm_sim_camera_t *cam)
+{
+    mm_sim_frame_t frame;
+    struct timespec now;
+    int i;
+
+    /* sequence is consumed even if the frame is dropped, so that the
+     * client sees a gap in frame_idx */
+    cam->sequence++;
+    if (g_sim.cfg.drop_pct > 0 && (rand() % 100) < g_sim.cfg.drop_pct) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    frame.sequence = cam->sequence;
+    frame.timestamp.tv_sec = now.tv_sec;
+    frame.timestamp.tv_usec = now.tv_nsec / 1000;
+
+    for (i = 0; i < MM_SIM_MAX_STREAMS; i++) {
+        mm_sim_stream_t *stream = &cam->streams[i];
+        if (!stream->used || !stream->streaming) {
+            continue;
+        }
+        /* offline reprocess streams only output what is fed to them */
+        if (NULL != stream->info.vaddr &&
+            CAM_STREAM_TYPE_OFFLINE_PROC ==
+                ((cam_stream_info_t *)stream->info.vaddr)->stream_type) {
+            continue;
+        }
+        stream->frames++;
+        if (0 == stream->queued_cnt) {
+            stream->drops++;
+            continue;
+        }
+        frame.buf_idx = stream->queued[stream->queued_head];
+        stream->queued_head = (stream->queued_head + 1) % MM_CAMERA_MAX_NUM_FRAMES;
+        stream->queued_cnt--;
+
+        mm_sim_fill_buf(stream, frame.buf_idx, &frame);
+        stream->done[(stream->done_head + stream->done_cnt) %
+                     MM_CAMERA_MAX_NUM_FRAMES] = frame;
+        stream->done_cnt++;
+        mm_sim_pipe_kick(stream->pipe_fd[1]);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_replay_load
+ *
+ * DESCRIPTION: read the configured replay file into the camera object
+ *
+ * PARAMETERS :
+ *   @cam     : camera object
+ *
+ * RETURN     : none, camera stays free running if there is nothing to replay
+ *==========================================================================*/
+static void mm_sim_replay_load(mm_sim_camera_t *cam)
+{
+    mm_sim_arrival_t *arrivals = NULL, *tmp;
+    uint32_t cnt = 0, max = 0, stream_idx, frame_idx;
+    FILE *fp;
+
+    free(cam->replay);
+    cam->replay = NULL;
+    cam->replay_cnt = cam->replay_pos = 0;
+    if ('\0' == g_sim.cfg.replay[0]) {
+        return;
+    }
+
+    fp = fopen(g_sim.cfg.replay, "r");
+    if (NULL == fp) {
+        CDBG_ERROR("%s: cannot open %s (%s)",
+                   __func__, g_sim.cfg.replay, strerror(errno));
+        return;
+    }
+    while (2 == fscanf(fp, " %u:%u", &stream_idx, &frame_idx)) {
+        if (stream_idx >= MM_SIM_MAX_STREAMS) {
+            CDBG_ERROR("%s: invalid stream %u", __func__, stream_idx);
+            continue;
+        }
+        if (cnt == max) {
+            max = max ? max * 2 : 256;
+            tmp = (mm_sim_arrival_t *)realloc(arrivals, max * sizeof(*arrivals));
+            if (NULL == tmp) {
+                break;
+            }
+            arrivals = tmp;
+        }
+        arrivals[cnt].stream_idx = stream_idx;
+        arrivals[cnt].frame_idx = frame_idx;
+        cnt++;
+    }
+    fclose(fp);
+
+    CDBG_HIGH("%s: %u arrivals to replay from %s", __func__, cnt, g_sim.cfg.replay);
+    cam->replay = arrivals;
+    cam->replay_cnt = cnt;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_replay_frame
+ *
+ * DESCRIPTION: deliver the next recorded arrival, if the previous one has
+ *              been dequeued and the target stream has a buf to fill
+ *
+ * PARAMETERS :
+ *   @cam     : camera object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_sim_replay_frame(mm_sim_camera_t *cam)
+{
+    mm_sim_arrival_t *arrival;
+    mm_sim_stream_t *stream;
+    mm_sim_frame_t frame;
+    struct timespec now;
+    int i;
+
+    if (cam->replay_pos >= cam->replay_cnt) {
+        return;
+    }
+    for (i = 0; i < MM_SIM_MAX_STREAMS; i++) {
+        if (cam->streams[i].used && cam->streams[i].done_cnt > 0) {
+            return;
+        }
+    }
+    arrival = &cam->replay[cam->replay_pos];
+    stream = &cam->streams[arrival->stream_idx];
+    if (!stream->used || !stream->streaming || 0 == stream->queued_cnt) {
+        return;
+    }
+    cam->replay_pos++;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    frame.sequence = arrival->frame_idx;
+    frame.timestamp.tv_sec = now.tv_sec;
+    frame.timestamp.tv_usec = now.tv_nsec / 1000;
+    frame.buf_idx = stream->queued[stream->queued_head];
+    stream->queued_head = (stream->queued_head + 1) % MM_CAMERA_MAX_NUM_FRAMES;
+    stream->queued_cnt--;
+    stream->frames++;
+
+    mm_sim_fill_buf(stream, frame.buf_idx, &frame);
+    stream->done[(stream->done_head + stream->done_cnt) %
+                 MM_CAMERA_MAX_NUM_FRAMES] = frame;
+    stream->done_cnt++;
+    mm_sim_pipe_kick(stream->pipe_fd[1]);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_frame_routine
+ *
+ * DESCRIPTION: frame source thread of a camera. Runs while any stream of
+ *              the camera is on, at configured fps with random jitter.
+ *              Replays recorded arrivals instead if configured.
+ *
+ * PARAMETERS :
+ *   @data    : camera object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void *mm_sim_frame_routine(void *data)
+{
+    mm_sim_camera_t *cam = (mm_sim_camera_t *)data;
+    const int64_t period_ns = 1000000000LL / g_sim.cfg.fps;
+    struct timespec start, wake;
+    int64_t n = 0, due_ns;
+    uint32_t gen;
+
+    pthread_mutex_lock(&g_sim.lock);
+    gen = cam->frame_gen;
+    mm_sim_replay_load(cam);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (gen == cam->frame_gen) {
+        n++;
+        due_ns = n * period_ns;
+        if (g_sim.cfg.jitter_us > 0) {
+            due_ns += (int64_t)((rand() % (2 * g_sim.cfg.jitter_us + 1)) -
+                                g_sim.cfg.jitter_us) * 1000;
+        }
+        due_ns += start.tv_nsec;
+        wake.tv_sec = start.tv_sec + (time_t)(due_ns / 1000000000LL);
+        wake.tv_nsec = (long)(due_ns % 1000000000LL);
+
+        while (gen == cam->frame_gen &&
+               ETIMEDOUT != pthread_cond_timedwait(&cam->frame_cond,
+                                                   &g_sim.lock, &wake)) {
+        }
+        if (gen != cam->frame_gen) {
+            break;
+        }
+        if (NULL != cam->replay) {
+            mm_sim_replay_frame(cam);
+        } else {
+            mm_sim_produce_frame(cam);
+        }
+    }
+    free(cam->replay);
+    cam->replay = NULL;
+    pthread_mutex_unlock(&g_sim.lock);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_stream_on_off
+ *
+ * DESCRIPTION: start/stop a stream, and the frame source of its camera on
+ *              first stream on/last stream off
+ *
+ * PARAMETERS :
+ *   @cam     : camera object
+ *   @stream  : stream object
+ *   @on      : TRUE for stream on
+ *
+ * RETURN     : none
+ * NOTE       : called with g_sim.lock held, lock is released on return
+ *==========================================================================*/
+static void mm_sim_stream_on_off(mm_sim_camera_t *cam,
+                                 mm_sim_stream_t *stream,
+                                 uint8_t on)
+{
+    pthread_t tid;
+
+    if (on == stream->streaming) {
+        pthread_mutex_unlock(&g_sim.lock);
+        return;
+    }
+    stream->streaming = on;
+    if (on) {
+        stream->frames = stream->drops = 0;
+        if (1 == ++cam->num_streaming) {
+            cam->frame_gen++;
+            if (0 == pthread_create(&cam->frame_tid, NULL,
+                                    mm_sim_frame_routine, cam)) {
+                cam->frame_tid_valid = 1;
+            }
+        }
+        pthread_mutex_unlock(&g_sim.lock);
+        return;
+    }
+
+    CDBG_HIGH("%s: stream %u: %u frames, %u dropped for no buf",
+              __func__, stream->server_stream_id, stream->frames, stream->drops);
+    mm_sim_stream_flush(stream);
+    if (0 == --cam->num_streaming && cam->frame_tid_valid) {
+        cam->frame_gen++;
+        cam->frame_tid_valid = 0;
+        tid = cam->frame_tid;
+        pthread_cond_signal(&cam->frame_cond);
+        pthread_mutex_unlock(&g_sim.lock);
+        pthread_join(tid, NULL);
+        return;
+    }
+    pthread_mutex_unlock(&g_sim.lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_parm_set
+ *
+ * DESCRIPTION: decode a parm batch from client and merge its entries into
+ *              the parms kept by server
+ *
+ * PARAMETERS :
+ *   @store   : parms kept by server
+ *   @map     : mapped parm buffer of client
+ *
+ * RETURN     : 0 on success, -1 for a malformed batch
+ *==========================================================================*/
+static int mm_sim_parm_set(parm_buffer_t *store, const mm_sim_map_t *map)
+{
+    const parm_buffer_t *parm = (const parm_buffer_t *)map->vaddr;
+    const cam_parm_entry_hdr_t *hdr = NULL;
+
+    if (0 != cam_parm_batch_validate(parm, map->size)) {
+        CDBG_ERROR("%s: malformed parm batch", __func__);
+        return -1;
+    }
+    while (NULL != (hdr = cam_parm_batch_next(parm, hdr))) {
+        cam_parm_batch_set(store, hdr->id, hdr->len, hdr + 1);
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_parm_get
+ *
+ * DESCRIPTION: fill entries of a parm batch from client with the values
+ *              last set, zero for the ones never set
+ *
+ * PARAMETERS :
+ *   @store   : parms kept by server
+ *   @map     : mapped parm buffer of client
+ *
+ * RETURN     : 0 on success, -1 for a malformed batch
+ *==========================================================================*/
+static int mm_sim_parm_get(const parm_buffer_t *store, mm_sim_map_t *map)
+{
+    parm_buffer_t *parm = (parm_buffer_t *)map->vaddr;
+    cam_parm_entry_hdr_t *hdr = NULL;
+    const void *value;
+
+    if (0 != cam_parm_batch_validate(parm, map->size)) {
+        CDBG_ERROR("%s: malformed parm batch", __func__);
+        return -1;
+    }
+    while (NULL != (hdr = cam_parm_batch_next(parm, hdr))) {
+        value = cam_parm_batch_get(store, hdr->id);
+        if (NULL != value) {
+            memcpy(hdr + 1, value, hdr->len);
+        } else {
+            memset(hdr + 1, 0, hdr->len);
+        }
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_ctrl_ioctl
+ *
+ * DESCRIPTION: ioctl on camera ctrl fd
+ *
+ * PARAMETERS :
+ *   @cam     : camera object
+ *   @request : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ * NOTE       : called with g_sim.lock held
+ *==========================================================================*/
+static int mm_sim_ctrl_ioctl(mm_sim_camera_t *cam, unsigned long request, void *arg)
+{
+    struct v4l2_control *ctrl;
+    struct v4l2_event *ev;
+    cam_capability_t *cap;
+    const mm_sim_cfg_t *cfg = &g_sim.cfg;
+
+    switch (request) {
+    case VIDIOC_QUERYCAP:
+        cap = (cam_capability_t *)cam->capability.vaddr;
+        if (NULL == cap || cam->capability.size < sizeof(cam_capability_t)) {
+            errno = EINVAL;
+            return -1;
+        }
+        memset(cap, 0, sizeof(cam_capability_t));
+        cap->modes_supported = CAM_MODE_2D;
+        cap->position = CAM_POSITION_BACK;
+        cap->focal_length = 4.6f;
+        cap->hor_view_angle = 54.8f;
+        cap->ver_view_angle = 42.5f;
+        cap->zoom_ratio_tbl_cnt = 1;
+        cap->zoom_ratio_tbl[0] = 100;
+        cap->preview_sizes_tbl_cnt = 3;
+        cap->preview_sizes_tbl[0].width = cfg->width;
+        cap->preview_sizes_tbl[0].height = cfg->height;
+        cap->preview_sizes_tbl[1].width = 1280;
+        cap->preview_sizes_tbl[1].height = 720;
+        cap->preview_sizes_tbl[2].width = 640;
+        cap->preview_sizes_tbl[2].height = 480;
+        cap->video_sizes_tbl_cnt = cap->preview_sizes_tbl_cnt;
+        memcpy(cap->video_sizes_tbl, cap->preview_sizes_tbl,
+               sizeof(cap->video_sizes_tbl));
+        cap->picture_sizes_tbl_cnt = cap->preview_sizes_tbl_cnt;
+        memcpy(cap->picture_sizes_tbl, cap->preview_sizes_tbl,
+               sizeof(cap->picture_sizes_tbl));
+        cap->fps_ranges_tbl_cnt = 1;
+        cap->fps_ranges_tbl[0].min_fps = (float)cfg->fps;
+        cap->fps_ranges_tbl[0].max_fps = (float)cfg->fps;
+        cap->max_video_snapshot_size.width = cfg->width;
+        cap->max_video_snapshot_size.height = cfg->height;
+        cap->supported_preview_fmt_cnt = 1;
+        cap->supported_preview_fmts[0] = cfg->fmt;
+        cap->supported_picture_fmt_cnt = 1;
+        cap->supported_picture_fmts[0] = CAM_FORMAT_YUV_420_NV21;
+        cap->supported_focus_modes_cnt = 2;
+        cap->supported_focus_modes[0] = CAM_FOCUS_MODE_AUTO;
+        cap->supported_focus_modes[1] = CAM_FOCUS_MODE_FIXED;
+        cap->padding_info.width_padding = CAM_PAD_TO_32;
+        cap->padding_info.height_padding = CAM_PAD_TO_32;
+        cap->padding_info.plane_padding = CAM_PAD_TO_4K;
+        return 0;
+    case VIDIOC_SUBSCRIBE_EVENT:
+    case VIDIOC_UNSUBSCRIBE_EVENT:
+        return 0;
+    case VIDIOC_DQEVENT:
+        if (0 == cam->evt_cnt) {
+            errno = EAGAIN;
+            return -1;
+        }
+        ev = (struct v4l2_event *)arg;
+        memset(ev, 0, sizeof(*ev));
+        ev->type = MSM_CAMERA_V4L2_EVENT_TYPE;
+        ev->id = MSM_CAMERA_MSM_NOTIFY;
+        memcpy(ev->u.data, &cam->evts[cam->evt_head],
+               sizeof(struct msm_v4l2_event_data));
+        cam->evt_head = (cam->evt_head + 1) % MM_SIM_MAX_EVTS;
+        cam->evt_cnt--;
+        {
+            char c;
+            if (read(cam->ctrl_pipe[0], &c, 1) != 1) {
+                CDBG_ERROR("%s: evt pipe out of sync", __func__);
+            }
+        }
+        return 0;
+    case VIDIOC_S_CTRL:
+        ctrl = (struct v4l2_control *)arg;
+        switch (ctrl->id) {
+        case CAM_PRIV_PARM:
+            if (NULL != cam->parm.vaddr &&
+                0 != mm_sim_parm_set(&cam->parm_store, &cam->parm)) {
+                errno = EINVAL;
+                return -1;
+            }
+            break;
+        case CAM_PRIV_DO_AUTO_FOCUS:
+            mm_sim_post_evt(cam, CAM_EVENT_TYPE_AUTO_FOCUS_DONE,
+                            MSM_CAMERA_STATUS_SUCCESS);
+            break;
+        default:
+            break;
+        }
+        return 0;
+    case VIDIOC_G_CTRL:
+        ctrl = (struct v4l2_control *)arg;
+        if (CAM_PRIV_PARM == ctrl->id && NULL != cam->parm.vaddr &&
+            0 != mm_sim_parm_get(&cam->parm_store, &cam->parm)) {
+            errno = EINVAL;
+            return -1;
+        }
+        return 0;
+    default:
+        CDBG_ERROR("%s: unsupported ioctl 0x%lx", __func__, request);
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_stream_ioctl
+ *
+ * DESCRIPTION: ioctl on stream fd
+ *
+ * PARAMETERS :
+ *   @cam     : camera object
+ *   @stream  : stream object
+ *   @request : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ * NOTE       : called with g_sim.lock held, lock is released on return
+ *==========================================================================*/
+static int mm_sim_stream_ioctl(mm_sim_camera_t *cam, mm_sim_stream_t *stream,
+                               unsigned long request, void *arg)
+{
+    struct v4l2_streamparm *s_parm;
+    struct v4l2_format *v4l2_fmt;
+    struct v4l2_requestbuffers *bufreq;
+    struct v4l2_buffer *vb;
+    mm_sim_frame_t *frame;
+    uint32_t i, n;
+    int rc = 0;
+
+    switch (request) {
+    case VIDIOC_S_PARM:
+        s_parm = (struct v4l2_streamparm *)arg;
+        stream->server_stream_id = ++cam->next_server_stream_id;
+        s_parm->parm.capture.extendedmode = stream->server_stream_id;
+        break;
+    case VIDIOC_S_FMT:
+        v4l2_fmt = (struct v4l2_format *)arg;
+        memcpy(&stream->fmt, v4l2_fmt->fmt.raw_data, sizeof(stream->fmt));
+        break;
+    case VIDIOC_S_CTRL:
+    case VIDIOC_G_CTRL:
+        break;
+    case VIDIOC_REQBUFS:
+        bufreq = (struct v4l2_requestbuffers *)arg;
+        if (bufreq->count > MM_CAMERA_MAX_NUM_FRAMES) {
+            errno = EINVAL;
+            rc = -1;
+            break;
+        }
+        stream->num_bufs = bufreq->count;
+        if (0 == bufreq->count) {
+            mm_sim_stream_flush(stream);
+        }
+        break;
+    case VIDIOC_QBUF:
+        vb = (struct v4l2_buffer *)arg;
+        if (vb->index >= stream->num_bufs ||
+            stream->queued_cnt >= MM_CAMERA_MAX_NUM_FRAMES) {
+            errno = EINVAL;
+            rc = -1;
+            break;
+        }
+        n = vb->length < VIDEO_MAX_PLANES ? vb->length : VIDEO_MAX_PLANES;
+        for (i = 0; i < n; i++) {
+            stream->planes[vb->index][i] = vb->m.planes[i];
+        }
+        stream->num_planes[vb->index] = n;
+        stream->queued[(stream->queued_head + stream->queued_cnt) %
+                       MM_CAMERA_MAX_NUM_FRAMES] = vb->index;
+        stream->queued_cnt++;
+        break;
+    case VIDIOC_DQBUF:
+        vb = (struct v4l2_buffer *)arg;
+        if (0 == stream->done_cnt) {
+            errno = EAGAIN;
+            rc = -1;
+            break;
+        }
+        frame = &stream->done[stream->done_head];
+        stream->done_head = (stream->done_head + 1) % MM_CAMERA_MAX_NUM_FRAMES;
+        stream->done_cnt--;
+        {
+            char c;
+            if (read(stream->pipe_fd[0], &c, 1) != 1) {
+                CDBG_ERROR("%s: stream pipe out of sync", __func__);
+            }
+        }
+        vb->index = frame->buf_idx;
+        vb->sequence = frame->sequence;
+        vb->timestamp = frame->timestamp;
+        n = stream->num_planes[frame->buf_idx];
+        if (vb->length < n) {
+            n = vb->length;
+        }
+        for (i = 0; i < n; i++) {
+            vb->m.planes[i].reserved[0] =
+                stream->planes[frame->buf_idx][i].reserved[0];
+            vb->m.planes[i].data_offset =
+                stream->planes[frame->buf_idx][i].data_offset;
+        }
+        vb->length = n;
+        break;
+    case VIDIOC_STREAMON:
+    case VIDIOC_STREAMOFF:
+        mm_sim_stream_on_off(cam, stream, VIDIOC_STREAMON == request);
+        return 0;
+    default:
+        CDBG_ERROR("%s: unsupported ioctl 0x%lx", __func__, request);
+        errno = EINVAL;
+        rc = -1;
+        break;
+    }
+    pthread_mutex_unlock(&g_sim.lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_sock_map_one
+ *
+ * DESCRIPTION: server side of a single buffer map/unmap entry
+ *
+ * PARAMETERS :
+ *   @cam       : camera object
+ *   @mapping   : 1 to map, 0 to unmap
+ *   @type      : buffer type
+ *   @stream_id : server stream id, for stream buffer types
+ *   @frame_idx : frame index, for stream buf type
+ *   @plane_idx : plane index, for stream buf type
+ *   @fd        : fd of buffer to be mapped
+ *   @size      : size of buffer to be mapped
+ *
+ * RETURN     : MSM_CAMERA_STATUS_SUCCESS or failure status
+ * NOTE       : called with g_sim.lock held
+ *==========================================================================*/
+static uint32_t mm_sim_sock_map_one(mm_sim_camera_t *cam,
+                                    uint8_t mapping,
+                                    cam_mapping_buf_type type,
+                                    uint32_t stream_id,
+                                    uint32_t frame_idx,
+                                    int32_t plane_idx,
+                                    int fd,
+                                    size_t size)
+{
+    mm_sim_stream_t *stream = NULL;
+    mm_sim_map_t *map = NULL;
+
+    switch (type) {
+    case CAM_MAPPING_BUF_TYPE_CAPABILITY:
+        map = &cam->capability;
+        break;
+    case CAM_MAPPING_BUF_TYPE_PARM_BUF:
+        map = &cam->parm;
+        break;
+    case CAM_MAPPING_BUF_TYPE_STREAM_INFO:
+        stream = mm_sim_get_stream_by_server_id(cam, stream_id);
+        if (NULL != stream) {
+            map = &stream->info;
+        }
+        break;
+    case CAM_MAPPING_BUF_TYPE_STREAM_BUF:
+        stream = mm_sim_get_stream_by_server_id(cam, stream_id);
+        if (NULL != stream && frame_idx < MM_CAMERA_MAX_NUM_FRAMES &&
+            plane_idx >= -1 && plane_idx < VIDEO_MAX_PLANES) {
+            map = &stream->bufs[frame_idx][plane_idx + 1];
+        }
+        break;
+    case CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF:
+        /* nothing reads offline input here */
+        return MSM_CAMERA_STATUS_SUCCESS;
+    default:
+        break;
+    }
+
+    if (NULL == map) {
+        CDBG_ERROR("%s: invalid map type %d stream %u idx %u",
+                   __func__, type, stream_id, frame_idx);
+        return MSM_CAMERA_STATUS_FAIL;
+    }
+
+    mm_sim_unmap(map);
+    if (mapping) {
+        /* stream buf content is only touched if asked to fill it */
+        if (CAM_MAPPING_BUF_TYPE_STREAM_BUF == type && 0 == g_sim.cfg.fill) {
+            return MSM_CAMERA_STATUS_SUCCESS;
+        }
+        mm_sim_map(map, fd, size);
+        if (NULL == map->vaddr) {
+            return MSM_CAMERA_STATUS_FAIL;
+        }
+    }
+    return MSM_CAMERA_STATUS_SUCCESS;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_sock_handle
+ *
+ * DESCRIPTION: server side of map/unmap message from domain socket. A
+ *              bundled message is handled entry by entry and fails as a
+ *              whole if any entry fails.
+ *
+ * PARAMETERS :
+ *   @cam      : camera object
+ *   @msg      : message received, cam_sock_packet_t or for bundled msg
+ *               types cam_sock_bundled_packet_t
+ *   @buf_size : size of message
+ *   @fds      : fds passed along with message
+ *   @numfds   : number of fds in @fds
+ *
+ * RETURN     : MSM_CAMERA_STATUS_SUCCESS or failure status
+ * NOTE       : called with g_sim.lock held
+ *==========================================================================*/
+static uint32_t mm_sim_sock_handle(mm_sim_camera_t *cam,
+                                   void *msg,
+                                   uint32_t buf_size,
+                                   int *fds,
+                                   int numfds)
+{
+    cam_sock_packet_t *packet = (cam_sock_packet_t *)msg;
+    cam_sock_bundled_packet_t *bundle = (cam_sock_bundled_packet_t *)msg;
+    uint32_t status = MSM_CAMERA_STATUS_SUCCESS;
+    uint32_t i;
+
+    if ((CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING == packet->msg_type ||
+         CAM_MAPPING_TYPE_FD_BUNDLED_UNMAPPING == packet->msg_type) &&
+        buf_size < sizeof(cam_sock_bundled_packet_t)) {
+        return MSM_CAMERA_STATUS_FAIL;
+    }
+
+    switch (packet->msg_type) {
+    case CAM_MAPPING_TYPE_FD_MAPPING:
+        if (numfds < 1) {
+            return MSM_CAMERA_STATUS_FAIL;
+        }
+        return mm_sim_sock_map_one(cam, 1,
+                                   packet->payload.buf_map.type,
+                                   packet->payload.buf_map.stream_id,
+                                   packet->payload.buf_map.frame_idx,
+                                   packet->payload.buf_map.plane_idx,
+                                   fds[0],
+                                   packet->payload.buf_map.size);
+    case CAM_MAPPING_TYPE_FD_UNMAPPING:
+        return mm_sim_sock_map_one(cam, 0,
+                                   packet->payload.buf_unmap.type,
+                                   packet->payload.buf_unmap.stream_id,
+                                   packet->payload.buf_unmap.frame_idx,
+                                   packet->payload.buf_unmap.plane_idx,
+                                   -1, 0);
+    case CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING:
+        {
+            cam_buf_map_type_list *list = &bundle->payload.buf_map_list;
+            if (list->length > CAM_MAX_NUM_BUFS_PER_MAP ||
+                (int)list->length != numfds) {
+                return MSM_CAMERA_STATUS_FAIL;
+            }
+            for (i = 0; i < list->length; i++) {
+                if (MSM_CAMERA_STATUS_SUCCESS !=
+                    mm_sim_sock_map_one(cam, 1,
+                                        list->buf_maps[i].type,
+                                        list->buf_maps[i].stream_id,
+                                        list->buf_maps[i].frame_idx,
+                                        list->buf_maps[i].plane_idx,
+                                        fds[i],
+                                        list->buf_maps[i].size)) {
+                    status = MSM_CAMERA_STATUS_FAIL;
+                }
+            }
+        }
+        break;
+    case CAM_MAPPING_TYPE_FD_BUNDLED_UNMAPPING:
+        {
+            cam_buf_unmap_type_list *list = &bundle->payload.buf_unmap_list;
+            if (list->length > CAM_MAX_NUM_BUFS_PER_MAP) {
+                return MSM_CAMERA_STATUS_FAIL;
+            }
+            for (i = 0; i < list->length; i++) {
+                if (MSM_CAMERA_STATUS_SUCCESS !=
+                    mm_sim_sock_map_one(cam, 0,
+                                        list->buf_unmaps[i].type,
+                                        list->buf_unmaps[i].stream_id,
+                                        list->buf_unmaps[i].frame_idx,
+                                        list->buf_unmaps[i].plane_idx,
+                                        -1, 0)) {
+                    status = MSM_CAMERA_STATUS_FAIL;
+                }
+            }
+        }
+        break;
+    default:
+        CDBG_ERROR("%s: unknown msg type %d", __func__, packet->msg_type);
+        status = MSM_CAMERA_STATUS_FAIL;
+        break;
+    }
+    return status;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_enum_cameras
+ *
+ * DESCRIPTION: backend op, name the simulated cameras video0..videoN
+ *
+ * PARAMETERS :
+ *   @dev_names   : array to store video node names
+ *   @max_cameras : size of dev_names
+ *
+ * RETURN     : number of cameras
+ *==========================================================================*/
+static int mm_sim_enum_cameras(char (*dev_names)[MM_CAMERA_DEV_NAME_LEN],
+                               int max_cameras)
+{
+    int i, num;
+
+    mm_sim_once();
+    num = g_sim.cfg.num_cams < max_cameras ? g_sim.cfg.num_cams : max_cameras;
+    for (i = 0; i < num; i++) {
+        snprintf(dev_names[i], MM_CAMERA_DEV_NAME_LEN, "video%d", i);
+    }
+    return num;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_open
+ *
+ * DESCRIPTION: backend op, open video node of a simulated camera. First
+ *              open of a camera gives its ctrl fd, later ones stream fds.
+ *              Fds are read ends of pipes, so that they can be polled.
+ *
+ * PARAMETERS :
+ *   @dev_name : /dev/videoN
+ *   @flags    : open flags, ignored
+ *
+ * RETURN     : fd, or -1 with errno set
+ *==========================================================================*/
+static int mm_sim_open(const char *dev_name, int flags)
+{
+    unsigned int cam_idx;
+    mm_sim_camera_t *cam;
+    mm_sim_stream_t *stream = NULL;
+    int pipe_fd[2];
+    int i;
+
+    (void)flags;
+    mm_sim_once();
+    if (1 != sscanf(dev_name, "/dev/video%u", &cam_idx) ||
+        cam_idx >= (unsigned int)g_sim.cfg.num_cams) {
+        errno = ENODEV;
+        return -1;
+    }
+    if (0 != pipe2(pipe_fd, O_NONBLOCK | O_CLOEXEC)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_sim.lock);
+    cam = &g_sim.cams[cam_idx];
+    if (!cam->opened) {
+        if (NULL == mm_sim_fd_add(pipe_fd[0], MM_SIM_FD_CTRL, cam_idx, 0)) {
+            goto on_error;
+        }
+        cam->opened = 1;
+        cam->ctrl_pipe[0] = pipe_fd[0];
+        cam->ctrl_pipe[1] = pipe_fd[1];
+        cam->sock_pipe[0] = cam->sock_pipe[1] = -1;
+        cam->next_server_stream_id = 0;
+        cam->evt_head = cam->evt_cnt = 0;
+        cam_parm_batch_init(&cam->parm_store);
+    } else {
+        for (i = 0; i < MM_SIM_MAX_STREAMS; i++) {
+            if (!cam->streams[i].used) {
+                stream = &cam->streams[i];
+                break;
+            }
+        }
+        if (NULL == stream ||
+            NULL == mm_sim_fd_add(pipe_fd[0], MM_SIM_FD_STREAM, cam_idx, (uint8_t)i)) {
+            goto on_error;
+        }
+        memset(stream, 0, sizeof(*stream));
+        stream->used = 1;
+        stream->pipe_fd[0] = pipe_fd[0];
+        stream->pipe_fd[1] = pipe_fd[1];
+    }
+    pthread_mutex_unlock(&g_sim.lock);
+    return pipe_fd[0];
+
+on_error:
+    pthread_mutex_unlock(&g_sim.lock);
+    close(pipe_fd[0]);
+    close(pipe_fd[1]);
+    errno = EBUSY;
+    return -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_close
+ *
+ * DESCRIPTION: backend op, close ctrl or stream fd
+ *
+ * PARAMETERS :
+ *   @fd      : fd to be closed
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_sim_close(int fd)
+{
+    mm_sim_fd_t *entry;
+    mm_sim_camera_t *cam;
+    mm_sim_stream_t *stream;
+    int i, j;
+
+    mm_sim_once();
+    pthread_mutex_lock(&g_sim.lock);
+    entry = mm_sim_fd_lookup(fd);
+    if (NULL == entry || MM_SIM_FD_SOCK == entry->type) {
+        pthread_mutex_unlock(&g_sim.lock);
+        errno = EBADF;
+        return -1;
+    }
+    cam = &g_sim.cams[entry->cam_idx];
+    entry->fd = -1;
+
+    if (MM_SIM_FD_STREAM == entry->type) {
+        stream = &cam->streams[entry->stream_idx];
+        if (stream->streaming) {
+            /* releases lock */
+            mm_sim_stream_on_off(cam, stream, 0);
+            pthread_mutex_lock(&g_sim.lock);
+        }
+        mm_sim_unmap(&stream->info);
+        for (i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
+            for (j = 0; j < MM_SIM_MAX_MAPS; j++) {
+                mm_sim_unmap(&stream->bufs[i][j]);
+            }
+        }
+        close(stream->pipe_fd[0]);
+        close(stream->pipe_fd[1]);
+        stream->used = 0;
+    } else {
+        mm_sim_unmap(&cam->capability);
+        mm_sim_unmap(&cam->parm);
+        close(cam->ctrl_pipe[0]);
+        close(cam->ctrl_pipe[1]);
+        cam->opened = 0;
+    }
+    pthread_mutex_unlock(&g_sim.lock);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_ioctl
+ *
+ * DESCRIPTION: backend op, dispatch ioctl to ctrl or stream handler
+ *
+ * PARAMETERS :
+ *   @fd      : ctrl or stream fd
+ *   @request : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_sim_ioctl(int fd, unsigned long request, void *arg)
+{
+    mm_sim_fd_t *entry;
+    mm_sim_camera_t *cam;
+    int rc;
+
+    mm_sim_once();
+    pthread_mutex_lock(&g_sim.lock);
+    entry = mm_sim_fd_lookup(fd);
+    if (NULL == entry || MM_SIM_FD_SOCK == entry->type) {
+        pthread_mutex_unlock(&g_sim.lock);
+        errno = EBADF;
+        return -1;
+    }
+    cam = &g_sim.cams[entry->cam_idx];
+    if (MM_SIM_FD_STREAM == entry->type) {
+        /* releases lock */
+        return mm_sim_stream_ioctl(cam, &cam->streams[entry->stream_idx],
+                                   request, arg);
+    }
+    rc = mm_sim_ctrl_ioctl(cam, request, arg);
+    pthread_mutex_unlock(&g_sim.lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_sock_create
+ *
+ * DESCRIPTION: backend op, connect to the simulated server of a camera
+ *
+ * PARAMETERS :
+ *   @cam_id    : camera index
+ *   @sock_type : socket type, ignored
+ *
+ * RETURN     : fd, or -1 on failure
+ *==========================================================================*/
+static int mm_sim_sock_create(int cam_id, mm_camera_sock_type_t sock_type)
+{
+    mm_sim_camera_t *cam;
+    int pipe_fd[2];
+
+    (void)sock_type;
+    mm_sim_once();
+    if (cam_id < 0 || cam_id >= g_sim.cfg.num_cams ||
+        0 != pipe2(pipe_fd, O_NONBLOCK | O_CLOEXEC)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_sim.lock);
+    cam = &g_sim.cams[cam_id];
+    if (!cam->opened || cam->sock_pipe[0] >= 0 ||
+        NULL == mm_sim_fd_add(pipe_fd[0], MM_SIM_FD_SOCK, (uint8_t)cam_id, 0)) {
+        pthread_mutex_unlock(&g_sim.lock);
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        return -1;
+    }
+    cam->sock_pipe[0] = pipe_fd[0];
+    cam->sock_pipe[1] = pipe_fd[1];
+    pthread_mutex_unlock(&g_sim.lock);
+    return pipe_fd[0];
+}
+
+static void mm_sim_sock_close(int fd)
+{
+    mm_sim_fd_t *entry;
+    mm_sim_camera_t *cam;
+
+    mm_sim_once();
+    pthread_mutex_lock(&g_sim.lock);
+    entry = mm_sim_fd_lookup(fd);
+    if (NULL != entry && MM_SIM_FD_SOCK == entry->type) {
+        cam = &g_sim.cams[entry->cam_idx];
+        entry->fd = -1;
+        close(cam->sock_pipe[0]);
+        close(cam->sock_pipe[1]);
+        cam->sock_pipe[0] = cam->sock_pipe[1] = -1;
+    }
+    pthread_mutex_unlock(&g_sim.lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_sock_deliver
+ *
+ * DESCRIPTION: hand a message to the simulated server and answer it with
+ *              MAP_UNMAP_DONE event on ctrl fd, as the server does. Each
+ *              call costs one msg_us round trip regardless of its size.
+ *
+ * PARAMETERS :
+ *   @fd       : socket fd
+ *   @msg      : message to be sent
+ *   @buf_size : size of message
+ *   @fds      : fds to be passed along with message
+ *   @numfds   : number of fds in @fds
+ *
+ * RETURN     : bytes sent, or -1 on failure
+ *==========================================================================*/
+static int mm_sim_sock_deliver(int fd, void *msg, uint32_t buf_size,
+                               int *fds, int numfds)
+{
+    mm_sim_fd_t *entry;
+    mm_sim_camera_t *cam;
+    uint32_t status;
+
+    mm_sim_once();
+    if (NULL == msg || buf_size < sizeof(cam_sock_packet_t)) {
+        return -1;
+    }
+    if (g_sim.cfg.msg_us > 0) {
+        usleep((useconds_t)g_sim.cfg.msg_us);
+    }
+    pthread_mutex_lock(&g_sim.lock);
+    entry = mm_sim_fd_lookup(fd);
+    if (NULL == entry || MM_SIM_FD_SOCK != entry->type) {
+        pthread_mutex_unlock(&g_sim.lock);
+        return -1;
+    }
+    cam = &g_sim.cams[entry->cam_idx];
+    status = mm_sim_sock_handle(cam, msg, buf_size, fds, numfds);
+    mm_sim_post_evt(cam, CAM_EVENT_TYPE_MAP_UNMAP_DONE, status);
+    pthread_mutex_unlock(&g_sim.lock);
+    return (int)buf_size;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_sock_sendmsg
+ *
+ * DESCRIPTION: backend op, send message to the simulated server
+ *
+ * PARAMETERS :
+ *   @fd       : socket fd
+ *   @msg      : message to be sent
+ *   @buf_size : size of message
+ *   @sendfd   : fd to be passed along with message
+ *
+ * RETURN     : bytes sent, or -1 on failure
+ *==========================================================================*/
+static int mm_sim_sock_sendmsg(int fd, void *msg, uint32_t buf_size, int sendfd)
+{
+    return mm_sim_sock_deliver(fd, msg, buf_size, &sendfd, (sendfd > 0) ? 1 : 0);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_sim_sock_bundle_sendmsg
+ *
+ * DESCRIPTION: backend op, send bundled message to the simulated server
+ *
+ * PARAMETERS :
+ *   @fd       : socket fd
+ *   @msg      : message to be sent
+ *   @buf_size : size of message
+ *   @sendfds  : fds to be passed along with message
+ *   @numfds   : number of fds in @sendfds
+ *
+ * RETURN     : bytes sent, or -1 on failure
+ *==========================================================================*/
+static int mm_sim_sock_bundle_sendmsg(int fd, void *msg, uint32_t buf_size,
+                                      int sendfds[CAM_MAX_NUM_BUFS_PER_MAP],
+                                      int numfds)
+{
+    if (numfds < 0 || numfds > CAM_MAX_NUM_BUFS_PER_MAP) {
+        return -1;
+    }
+    return mm_sim_sock_deliver(fd, msg, buf_size, sendfds, numfds);
+}
+
+const mm_camera_backend_ops_t mm_camera_sim_backend = {
+    .name = "sim",
+    .enum_cameras = mm_sim_enum_cameras,
+    .open = mm_sim_open,
+    .close = mm_sim_close,
+    .ioctl = mm_sim_ioctl,
+    .sock_create = mm_sim_sock_create,
+    .sock_close = mm_sim_sock_close,
+    .sock_sendmsg = mm_sim_sock_sendmsg,
+    .sock_bundle_sendmsg = mm_sim_sock_bundle_sendmsg,
+    .bundled_map = 1,
+    /* events are signalled through a pipe */
+    .evt_poll_events = EPOLLIN,
+};
@@ -161,6 +161,65 @@ int mm_camera_socket_sendmsg(
     return sendmsg(fd, &(msgh), 0);
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_socket_bundle_sendmsg
+ *
+ * DESCRIPTION:  send msg carrying multiple fds through domain socket
+ *   @fd      : socket fd
+ *   @msg     : pointer to msg to be sent over domain socket
+ *   @buf_size: size of msg
+ *   @sendfds : file descriptors to be sent, in one SCM_RIGHTS control msg
+ *   @numfds  : number of fds in sendfds, up to CAM_MAX_NUM_BUFS_PER_MAP
+ *
+ * RETURN     : the total bytes of sent msg
+ *==========================================================================*/
+int mm_camera_socket_bundle_sendmsg(
+  int fd,
+  void *msg,
+  uint32_t buf_size,
+  int sendfds[CAM_MAX_NUM_BUFS_PER_MAP],
+  int numfds)
+{
+    struct msghdr msgh;
+    struct iovec iov[1];
+    struct cmsghdr *cmsghp = NULL;
+    char control[CMSG_SPACE(sizeof(int) * CAM_MAX_NUM_BUFS_PER_MAP)];
+
+    if (msg == NULL || numfds < 0 || numfds > CAM_MAX_NUM_BUFS_PER_MAP) {
+      CDBG_ERROR("%s: invalid msg %p or numfds %d", __func__, msg, numfds);
+      return -1;
+    }
+
+    memset(&msgh, 0, sizeof(msgh));
+    msgh.msg_name = NULL;
+    msgh.msg_namelen = 0;
+
+    iov[0].iov_base = msg;
+    iov[0].iov_len = buf_size;
+    msgh.msg_iov = iov;
+    msgh.msg_iovlen = 1;
+    CDBG("%s: iov_len=%d, numfds=%d", __func__, iov[0].iov_len, numfds);
+
+    msgh.msg_control = NULL;
+    msgh.msg_controllen = 0;
+
+    if (numfds > 0) {
+      msgh.msg_control = control;
+      msgh.msg_controllen = CMSG_SPACE(sizeof(int) * numfds);
+      cmsghp = CMSG_FIRSTHDR(&msgh);
+      if (cmsghp == NULL) {
+        CDBG_ERROR("%s: ctrl msg NULL", __func__);
+        return -1;
+      }
+      cmsghp->cmsg_level = SOL_SOCKET;
+      cmsghp->cmsg_type = SCM_RIGHTS;
+      cmsghp->cmsg_len = CMSG_LEN(sizeof(int) * numfds);
+      memcpy(CMSG_DATA(cmsghp), sendfds, sizeof(int) * numfds);
+    }
+
+    return sendmsg(fd, &(msgh), 0);
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_socket_recvmsg
  *
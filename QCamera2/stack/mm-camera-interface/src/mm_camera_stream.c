@@ -41,6 +41,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
+#include "mm_camera_backend.h"
 
 /* internal function decalre */
 int32_t mm_stream_qbuf(mm_stream_t *my_obj,
@@ -139,18 +140,17 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
     if (my_obj->is_bundled) {
         mm_camera_cmdcb_t* node = NULL;
 
-        /* send sem_post to wake up channel cmd thread to enqueue to super buffer */
-        node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+        /* wake up channel cmd thread to enqueue to super buffer */
+        node = mm_camera_cmd_thread_alloc_cmd(&my_obj->ch_obj->cmd_thread);
         if (NULL != node) {
-            memset(node, 0, sizeof(mm_camera_cmdcb_t));
             node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
             node->u.buf = *buf_info;
 
-            /* enqueue to cmd thread */
-            cam_queue_enq(&(my_obj->ch_obj->cmd_thread.cmd_queue), node);
-
-            /* wake up cmd thread */
-            sem_post(&(my_obj->ch_obj->cmd_thread.cmd_sem));
+            /* enqueue to cmd thread and wake it up */
+            if (0 != mm_camera_cmd_thread_enqueue(&my_obj->ch_obj->cmd_thread, node)) {
+                CDBG_ERROR("%s: enqueue to channel cmd thread failed", __func__);
+                mm_camera_cmd_thread_free_cmd(&my_obj->ch_obj->cmd_thread, node);
+            }
         } else {
             CDBG_ERROR("%s: No memory for mm_camera_node_t", __func__);
         }
@@ -165,18 +165,17 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
     if(has_cb) {
         mm_camera_cmdcb_t* node = NULL;
 
-        /* send sem_post to wake up cmd thread to dispatch dataCB */
-        node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+        /* wake up cmd thread to dispatch dataCB */
+        node = mm_camera_cmd_thread_alloc_cmd(&my_obj->cmd_thread);
         if (NULL != node) {
-            memset(node, 0, sizeof(mm_camera_cmdcb_t));
             node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
             node->u.buf = *buf_info;
 
-            /* enqueue to cmd thread */
-            cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
-
-            /* wake up cmd thread */
-            sem_post(&(my_obj->cmd_thread.cmd_sem));
+            /* enqueue to cmd thread and wake it up */
+            if (0 != mm_camera_cmd_thread_enqueue(&my_obj->cmd_thread, node)) {
+                CDBG_ERROR("%s: enqueue to stream cmd thread failed", __func__);
+                mm_camera_cmd_thread_free_cmd(&my_obj->cmd_thread, node);
+            }
         } else {
             CDBG_ERROR("%s: No memory for mm_camera_node_t", __func__);
         }
@@ -401,7 +400,7 @@ int32_t mm_stream_fsm_inited(mm_stream_t *my_obj,
         snprintf(dev_name, sizeof(dev_name), "/dev/%s",
                  mm_camera_util_get_dev_name(my_obj->ch_obj->cam_obj->my_hdl));
 
-        my_obj->fd = open(dev_name, O_RDWR | O_NONBLOCK);
+        my_obj->fd = mm_camera_dev_open(dev_name, O_RDWR | O_NONBLOCK);
         if (my_obj->fd <= 0) {
             CDBG_ERROR("%s: open dev returned %d\n", __func__, my_obj->fd);
             rc = -1;
@@ -415,7 +414,7 @@ int32_t mm_stream_fsm_inited(mm_stream_t *my_obj,
             /* failed setting ext_mode
              * close fd */
             if(my_obj->fd > 0) {
-                close(my_obj->fd);
+                mm_camera_dev_close(my_obj->fd);
                 my_obj->fd = 0;
             }
             break;
@@ -674,7 +673,9 @@ int32_t mm_stream_fsm_reg(mm_stream_t * my_obj,
             if (has_cb) {
                 mm_camera_cmd_thread_launch(&my_obj->cmd_thread,
                                             mm_stream_dispatch_app_data,
-                                            (void *)my_obj);
+                                            (void *)my_obj,
+                                            MM_CAMERA_CMD_POOL_DEPTH_DATA,
+                                            MM_CAMERA_CMD_QUEUE_TYPE_LIST);
             }
 
             rc = mm_stream_streamon(my_obj);
@@ -840,7 +841,7 @@ int32_t mm_stream_release(mm_stream_t *my_obj)
     /* close fd */
     if(my_obj->fd > 0)
     {
-        close(my_obj->fd);
+        mm_camera_dev_close(my_obj->fd);
     }
 
     /* destroy mutex */
@@ -881,7 +882,7 @@ int32_t mm_stream_streamon(mm_stream_t *my_obj)
     if (rc < 0) {
         return rc;
     }
-    rc = ioctl(my_obj->fd, VIDIOC_STREAMON, &buf_type);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_STREAMON, &buf_type);
     if (rc < 0) {
         CDBG_ERROR("%s: ioctl VIDIOC_STREAMON failed: rc=%d\n",
                    __func__, rc);
@@ -915,7 +916,7 @@ int32_t mm_stream_streamoff(mm_stream_t *my_obj)
     mm_camera_poll_thread_del_poll_fd(&my_obj->ch_obj->poll_thread[0], my_obj->my_hdl);
 
     /* step2: stream off */
-    rc = ioctl(my_obj->fd, VIDIOC_STREAMOFF, &buf_type);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_STREAMOFF, &buf_type);
     if (rc < 0) {
         CDBG_ERROR("%s: STREAMOFF failed: %s\n",
                 __func__, strerror(errno));
@@ -955,7 +956,7 @@ int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
     vb.m.planes = &planes[0];
     vb.length = num_planes;
 
-    rc = ioctl(my_obj->fd, VIDIOC_DQBUF, &vb);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_DQBUF, &vb);
     if (rc < 0) {
         CDBG_ERROR("%s: VIDIOC_DQBUF ioctl call failed (rc=%d)\n",
                    __func__, rc);
@@ -1091,7 +1092,7 @@ int32_t mm_stream_set_ext_mode(mm_stream_t * my_obj)
     memset(&s_parm, 0, sizeof(s_parm));
     s_parm.type =  V4L2_BUF_TYPE_PRIVATE;
 
-    rc = ioctl(my_obj->fd, VIDIOC_S_PARM, &s_parm);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_S_PARM, &s_parm);
     CDBG("%s:stream fd=%d, rc=%d, extended_mode=%d\n",
          __func__, my_obj->fd, rc, s_parm.parm.capture.extendedmode);
     if (rc == 0) {
@@ -1131,7 +1132,7 @@ int32_t mm_stream_qbuf(mm_stream_t *my_obj, mm_camera_buf_def_t *buf)
     CDBG("%s:stream_hdl=%d,fd=%d,frame idx=%d,num_planes = %d\n", __func__,
          buf->stream_id, buf->fd, buffer.index, buffer.length);
 
-    rc = ioctl(my_obj->fd, VIDIOC_QBUF, &buffer);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_QBUF, &buffer);
     CDBG("%s: qbuf idx:%d, rc:%d", __func__, buffer.index, rc);
     return rc;
 }
@@ -1182,7 +1183,7 @@ int32_t mm_stream_request_buf(mm_stream_t * my_obj)
     bufreq.count = buf_num;
     bufreq.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
     bufreq.memory = V4L2_MEMORY_USERPTR;
-    rc = ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
     if (rc < 0) {
       CDBG_ERROR("%s: fd=%d, ioctl VIDIOC_REQBUFS failed: rc=%d\n",
            __func__, my_obj->fd, rc);
@@ -1287,13 +1288,106 @@ int32_t mm_stream_unmap_buf(mm_stream_t * my_obj,
                                   0);
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_stream_invalidate_buf
+ *
+ * DESCRIPTION: invalidate cpu cache of a stream buffer through the mem vtbl
+ *              of upper layer, before the interface reads its content
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @index        : index of the buffer within the stream buffers
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_stream_invalidate_buf(mm_stream_t * my_obj,
+                                 uint32_t index)
+{
+    if (NULL == my_obj->mem_vtbl.invalidate_buf) {
+        /* bufs not cached */
+        return 0;
+    }
+    if (index >= my_obj->buf_num) {
+        CDBG_ERROR("%s: invalid buf index %d", __func__, index);
+        return -1;
+    }
+    return my_obj->mem_vtbl.invalidate_buf(index, my_obj->mem_vtbl.user_data);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_map_batch_flush
+ *
+ * DESCRIPTION: send pending stream buffer map/unmap entries collected while
+ *              in batch mode to server as one bundled message. If server
+ *              rejects the bundle, the entries are sent one by one instead.
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_stream_map_batch_flush(mm_stream_t *my_obj)
+{
+    int32_t rc = 0;
+    uint32_t i, len;
+    cam_sock_bundled_packet_t *batch = &my_obj->map_batch;
+    uint8_t mapping = (MM_STREAM_MAP_BATCH_MAP == my_obj->map_batch_mode);
+
+    len = mapping ? batch->payload.buf_map_list.length :
+                    batch->payload.buf_unmap_list.length;
+    if (0 == len) {
+        return 0;
+    }
+
+    batch->msg_type = mapping ? CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING :
+                                CAM_MAPPING_TYPE_FD_BUNDLED_UNMAPPING;
+    rc = mm_camera_util_bundled_sendmsg(my_obj->ch_obj->cam_obj,
+                                        batch,
+                                        sizeof(cam_sock_bundled_packet_t),
+                                        my_obj->map_batch_fds,
+                                        mapping ? (int)len : 0);
+    if (0 != rc) {
+        CDBG_HIGH("%s: bundled %s of %d bufs failed, fall back to single msgs",
+                  __func__, mapping ? "map" : "unmap", len);
+        rc = 0;
+        for (i = 0; i < len; i++) {
+            int32_t ret;
+            if (mapping) {
+                cam_buf_map_type *m = &batch->payload.buf_map_list.buf_maps[i];
+                ret = mm_stream_map_buf(my_obj, m->type, m->frame_idx,
+                                        m->plane_idx, m->fd, m->size);
+            } else {
+                cam_buf_unmap_type *m = &batch->payload.buf_unmap_list.buf_unmaps[i];
+                ret = mm_stream_unmap_buf(my_obj, m->type, m->frame_idx,
+                                          m->plane_idx);
+            }
+            if (0 != ret) {
+                rc = -1;
+            }
+        }
+    }
+
+    if (mapping) {
+        batch->payload.buf_map_list.length = 0;
+    } else {
+        batch->payload.buf_unmap_list.length = 0;
+    }
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_stream_map_buf_ops
  *
  * DESCRIPTION: ops for mapping stream buffer via domain socket to server.
  *              This function will be passed to upper layer as part of ops table
  *              to be used by upper layer when allocating stream buffers and mapping
- *              buffers to server via domain socket.
+ *              buffers to server via domain socket. While stream buffers are
+ *              being initialized, the mapping is only queued here and sent
+ *              to server in one bundled message afterwards.
  *
  * PARAMETERS :
  *   @frame_idx    : index of buffer within the stream buffers, only valid if
@@ -1317,6 +1411,28 @@ static int32_t mm_stream_map_buf_ops(uint32_t frame_idx,
                                      void *userdata)
 {
     mm_stream_t *my_obj = (mm_stream_t *)userdata;
+
+    if (MM_STREAM_MAP_BATCH_MAP == my_obj->map_batch_mode) {
+        cam_buf_map_type_list *list = &my_obj->map_batch.payload.buf_map_list;
+        cam_buf_map_type *entry;
+
+        if (CAM_MAX_NUM_BUFS_PER_MAP <= list->length &&
+            0 != mm_stream_map_batch_flush(my_obj)) {
+            return -1;
+        }
+        entry = &list->buf_maps[list->length];
+        memset(entry, 0, sizeof(cam_buf_map_type));
+        entry->type = CAM_MAPPING_BUF_TYPE_STREAM_BUF;
+        entry->stream_id = my_obj->server_stream_id;
+        entry->frame_idx = frame_idx;
+        entry->plane_idx = plane_idx;
+        entry->fd = fd;
+        entry->size = size;
+        my_obj->map_batch_fds[list->length] = fd;
+        list->length++;
+        return 0;
+    }
+
     return mm_stream_map_buf(my_obj,
                              CAM_MAPPING_BUF_TYPE_STREAM_BUF,
                              frame_idx, plane_idx, fd, size);
@@ -1328,7 +1444,9 @@ static int32_t mm_stream_map_buf_ops(uint32_t frame_idx,
  * DESCRIPTION: ops for unmapping stream buffer via domain socket to server.
  *              This function will be passed to upper layer as part of ops table
  *              to be used by upper layer when allocating stream buffers and unmapping
- *              buffers to server via domain socket.
+ *              buffers to server via domain socket. While stream buffers are
+ *              being released, the unmapping is only queued here and sent
+ *              to server in one bundled message afterwards.
  *
  * PARAMETERS :
  *   @frame_idx    : index of buffer within the stream buffers, only valid if
@@ -1348,6 +1466,39 @@ static int32_t mm_stream_unmap_buf_ops(uint32_t frame_idx,
                                        void *userdata)
 {
     mm_stream_t *my_obj = (mm_stream_t *)userdata;
+    uint32_t i;
+
+    if (MM_STREAM_MAP_BATCH_MAP == my_obj->map_batch_mode) {
+        /* upper layer backs out of a mapping not yet sent to server,
+         * simply drop it from the pending bundle */
+        cam_buf_map_type_list *list = &my_obj->map_batch.payload.buf_map_list;
+        for (i = 0; i < list->length; i++) {
+            if (list->buf_maps[i].frame_idx == frame_idx &&
+                list->buf_maps[i].plane_idx == plane_idx) {
+                list->length--;
+                list->buf_maps[i] = list->buf_maps[list->length];
+                my_obj->map_batch_fds[i] = my_obj->map_batch_fds[list->length];
+                return 0;
+            }
+        }
+    } else if (MM_STREAM_MAP_BATCH_UNMAP == my_obj->map_batch_mode) {
+        cam_buf_unmap_type_list *list = &my_obj->map_batch.payload.buf_unmap_list;
+        cam_buf_unmap_type *entry;
+
+        if (CAM_MAX_NUM_BUFS_PER_MAP <= list->length &&
+            0 != mm_stream_map_batch_flush(my_obj)) {
+            return -1;
+        }
+        entry = &list->buf_unmaps[list->length];
+        memset(entry, 0, sizeof(cam_buf_unmap_type));
+        entry->type = CAM_MAPPING_BUF_TYPE_STREAM_BUF;
+        entry->stream_id = my_obj->server_stream_id;
+        entry->frame_idx = frame_idx;
+        entry->plane_idx = plane_idx;
+        list->length++;
+        return 0;
+    }
+
     return mm_stream_unmap_buf(my_obj,
                                CAM_MAPPING_BUF_TYPE_STREAM_BUF,
                                frame_idx,
@@ -1385,6 +1536,12 @@ int32_t mm_stream_init_bufs(mm_stream_t * my_obj)
     ops_tbl.unmap_ops = mm_stream_unmap_buf_ops;
     ops_tbl.userdata = my_obj;
 
+    /* collect buffer mappings and send them to server in one go */
+    if (my_obj->ch_obj->cam_obj->bundled_map) {
+        my_obj->map_batch_mode = MM_STREAM_MAP_BATCH_MAP;
+    }
+    my_obj->map_batch.payload.buf_map_list.length = 0;
+
     rc = my_obj->mem_vtbl.get_bufs(&my_obj->frame_offset,
                                    &my_obj->buf_num,
                                    &reg_flags,
@@ -1394,6 +1551,18 @@ int32_t mm_stream_init_bufs(mm_stream_t * my_obj)
 
     if (0 != rc) {
         CDBG_ERROR("%s: Error get buf, rc = %d\n", __func__, rc);
+        /* upper layer has unmapped what it mapped, drop pending ones */
+        my_obj->map_batch.payload.buf_map_list.length = 0;
+        my_obj->map_batch_mode = MM_STREAM_MAP_BATCH_NONE;
+        return rc;
+    }
+
+    rc = mm_stream_map_batch_flush(my_obj);
+    my_obj->map_batch_mode = MM_STREAM_MAP_BATCH_NONE;
+    if (0 != rc) {
+        CDBG_ERROR("%s: Error map bufs to server, rc = %d\n", __func__, rc);
+        mm_stream_deinit_bufs(my_obj);
+        free(reg_flags);
         return rc;
     }
 
@@ -1449,8 +1618,19 @@ int32_t mm_stream_deinit_bufs(mm_stream_t * my_obj)
     ops_tbl.unmap_ops = mm_stream_unmap_buf_ops;
     ops_tbl.userdata = my_obj;
 
+    /* collect buffer unmappings and send them to server in one go */
+    if (my_obj->ch_obj->cam_obj->bundled_map) {
+        my_obj->map_batch_mode = MM_STREAM_MAP_BATCH_UNMAP;
+    }
+    my_obj->map_batch.payload.buf_unmap_list.length = 0;
+
     rc = my_obj->mem_vtbl.put_bufs(&ops_tbl,
                                    my_obj->mem_vtbl.user_data);
+    if (0 != mm_stream_map_batch_flush(my_obj)) {
+        CDBG_ERROR("%s: Error unmap bufs from server", __func__);
+        rc = -1;
+    }
+    my_obj->map_batch_mode = MM_STREAM_MAP_BATCH_NONE;
 
     free(my_obj->buf);
     my_obj->buf = NULL;
@@ -1533,7 +1713,7 @@ int32_t mm_stream_unreg_buf(mm_stream_t * my_obj)
     bufreq.count = 0;
     bufreq.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
     bufreq.memory = V4L2_MEMORY_USERPTR;
-    rc = ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
     if (rc < 0) {
         CDBG_ERROR("%s: fd=%d, VIDIOC_REQBUFS failed, rc=%d\n",
               __func__, my_obj->fd, rc);
@@ -2202,7 +2382,7 @@ int32_t mm_stream_set_fmt(mm_stream_t *my_obj)
     }
 
     memcpy(fmt.fmt.raw_data, &msm_fmt, sizeof(msm_fmt));
-    rc = ioctl(my_obj->fd, VIDIOC_S_FMT, &fmt);
+    rc = mm_camera_dev_ioctl(my_obj->fd, VIDIOC_S_FMT, &fmt);
     return rc;
 }
 
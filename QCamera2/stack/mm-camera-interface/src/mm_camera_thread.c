@@ -33,12 +33,14 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <poll.h>
 #include <semaphore.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
 
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
+#include "mm_camera_backend.h"
 
 typedef enum {
     /* poll entries updated */
@@ -55,15 +57,19 @@ typedef enum {
     MM_CAMERA_POLL_TASK_STATE_MAX
 } mm_camera_poll_task_state_type_t;
 
-typedef struct {
-    uint8_t cmd;
-    mm_camera_event_t event;
-} mm_camera_sig_evt_t;
+/* epoll data of the cmd eventfd, entry idx + 1 is used for entry fds */
+#define MM_CAMERA_POLL_EFD_TAG       0
+#define MM_CAMERA_POLL_MAX_EVENTS    (MAX_STREAM_NUM_IN_BUNDLE + 1)
+/* backoff range when epoll_wait keeps failing */
+#define MM_CAMERA_POLL_MIN_BACKOFF_US 1000
+#define MM_CAMERA_POLL_MAX_BACKOFF_US 100000
 
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_sig
  *
- * DESCRIPTION: synchorinzed call to send a command through pipe.
+ * DESCRIPTION: synchorinzed call to send a command to poll thread. Cmds are
+ *              posted as bits of a pending mask and the thread is woken up
+ *              through eventfd. Caller waits until its cmd is processed.
  *
  * PARAMETERS :
  *   @poll_cb      : ptr to poll thread object
@@ -76,50 +82,49 @@ typedef struct {
 static int32_t mm_camera_poll_sig(mm_camera_poll_thread_t *poll_cb,
                                   uint32_t cmd)
 {
-    /* send through pipe */
-    /* get the mutex */
-    mm_camera_sig_evt_t cmd_evt;
-    int len;
+    uint64_t val = 1;
+    uint32_t seq;
+    int32_t rc = 0;
 
     CDBG("%s: E cmd = %d", __func__,cmd);
-    memset(&cmd_evt, 0, sizeof(cmd_evt));
-    cmd_evt.cmd = cmd;
     pthread_mutex_lock(&poll_cb->mutex);
-    /* reset the statue to false */
-    poll_cb->status = FALSE;
+    poll_cb->cmd |= (1 << cmd);
+    seq = ++poll_cb->cmd_seq;
     /* send cmd to worker */
-
-    len = write(poll_cb->pfds[1], &cmd_evt, sizeof(cmd_evt));
-    if(len < 1) {
-        CDBG_ERROR("%s: len = %d, errno = %d", __func__, len, errno);
-    }
-    CDBG("%s: begin IN mutex write done, len = %d", __func__, len);
-    /* wait till worker task gives positive signal */
-    if (FALSE == poll_cb->status) {
-        CDBG("%s: wait", __func__);
-        pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
+    if (write(poll_cb->efd, &val, sizeof(val)) != sizeof(val)) {
+        CDBG_ERROR("%s: eventfd write error (%s)", __func__, strerror(errno));
+        rc = -1;
+    } else {
+        /* wait till worker task has processed this cmd. seq may wrap */
+        while ((int32_t)(poll_cb->done_seq - seq) < 0) {
+            CDBG("%s: wait", __func__);
+            pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
+        }
     }
     /* done */
     pthread_mutex_unlock(&poll_cb->mutex);
     CDBG("%s: X", __func__);
-    return 0;
+    return rc;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig
+ * FUNCTION   : mm_camera_poll_sig_done
  *
  * DESCRIPTION: signal the status of done
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
+ *   @seq     : seq of last cmd processed
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_sig_done(mm_camera_poll_thread_t *poll_cb)
+static void mm_camera_poll_sig_done(mm_camera_poll_thread_t *poll_cb,
+                                    uint32_t seq)
 {
     pthread_mutex_lock(&poll_cb->mutex);
     poll_cb->status = TRUE;
-    pthread_cond_signal(&poll_cb->cond_v);
+    poll_cb->done_seq = seq;
+    pthread_cond_broadcast(&poll_cb->cond_v);
     CDBG("%s: done, in mutex", __func__);
     pthread_mutex_unlock(&poll_cb->mutex);
 }
@@ -142,74 +147,88 @@ static void mm_camera_poll_set_state(mm_camera_poll_thread_t *poll_cb,
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_proc_pipe
+ * FUNCTION   : mm_camera_poll_update_fds
  *
- * DESCRIPTION: polling thread routine to process pipe
+ * DESCRIPTION: sync epoll set with poll entries. Every polled fd is removed
+ *              and valid entry fds are added again, so that an fd number
+ *              closed and reused in between is registered properly. Only
+ *              done on entry updates, never per wakeup.
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_proc_pipe(mm_camera_poll_thread_t *poll_cb)
+static void mm_camera_poll_update_fds(mm_camera_poll_thread_t *poll_cb)
 {
-    ssize_t read_len;
+    struct epoll_event ev;
+    int num_entries;
     int i;
-    mm_camera_sig_evt_t cmd_evt;
-    read_len = read(poll_cb->pfds[0], &cmd_evt, sizeof(cmd_evt));
-    CDBG("%s: read_fd = %d, read_len = %d, expect_len = %d cmd = %d",
-         __func__, poll_cb->pfds[0], (int)read_len, (int)sizeof(cmd_evt), cmd_evt.cmd);
-    switch (cmd_evt.cmd) {
-    case MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED:
-        /* we always have index 0 for pipe read */
-        poll_cb->num_fds = 0;
-        poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->pfds[0];
-        poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-        poll_cb->num_fds++;
-
-        if (MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type) {
-            if (poll_cb->poll_entries[0].fd > 0) {
-                /* fd is valid, we update poll_fds */
-                poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[0].fd;
-                poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                poll_cb->num_fds++;
-            }
-        } else if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) {
-            for(i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
-                if(poll_cb->poll_entries[i].fd > 0) {
-                    /* fd is valid, we update poll_fds to this fd */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[i].fd;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                    poll_cb->num_fds++;
-                } else {
-                    /* fd is invalid, we set the entry to -1 to prevent polling.
-                     * According to spec, polling will not poll on entry with fd=-1.
-                     * If this is not the case, we need to skip these invalid fds
-                     * when updating this array.
-                     * We still keep fd=-1 in this array because this makes easier to
-                     * map cb associated with this fd once incoming data avail by directly
-                     * using the index-1(0 is reserved for pipe read, so need to reduce index by 1) */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = -1;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = 0;
-                    poll_cb->num_fds++;
-                }
+
+    num_entries = (MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type) ?
+        1 : MAX_STREAM_NUM_IN_BUNDLE;
+    for (i = 0; i < num_entries; i++) {
+        if (poll_cb->polled_fds[i] > 0) {
+            /* fd may be closed already, then it left the set by itself */
+            epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_DEL, poll_cb->polled_fds[i], NULL);
+            poll_cb->polled_fds[i] = -1;
+        }
+        if (poll_cb->poll_entries[i].fd > 0) {
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN | EPOLLRDNORM | EPOLLPRI;
+            ev.data.u32 = i + 1;
+            if (epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_ADD,
+                          poll_cb->poll_entries[i].fd, &ev) < 0) {
+                CDBG_ERROR("%s: epoll add fd %d failed (%s)", __func__,
+                           poll_cb->poll_entries[i].fd, strerror(errno));
+            } else {
+                poll_cb->polled_fds[i] = poll_cb->poll_entries[i].fd;
             }
         }
-        mm_camera_poll_sig_done(poll_cb);
-        break;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_poll_proc_cmd
+ *
+ * DESCRIPTION: polling thread routine to process pending cmds
+ *
+ * PARAMETERS :
+ *   @poll_cb : ptr to poll thread object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_poll_proc_cmd(mm_camera_poll_thread_t *poll_cb)
+{
+    uint64_t val;
+    uint32_t cmd;
+    uint32_t seq;
 
-    case MM_CAMERA_PIPE_CMD_EXIT:
-    default:
+    if (read(poll_cb->efd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+        CDBG_ERROR("%s: eventfd read error (%s)", __func__, strerror(errno));
+    }
+
+    pthread_mutex_lock(&poll_cb->mutex);
+    cmd = poll_cb->cmd;
+    seq = poll_cb->cmd_seq;
+    poll_cb->cmd = 0;
+    pthread_mutex_unlock(&poll_cb->mutex);
+    CDBG("%s: cmd mask = 0x%x, seq = %d", __func__, cmd, seq);
+
+    if (cmd & (1 << MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED)) {
+        mm_camera_poll_update_fds(poll_cb);
+    }
+    if (cmd & (1 << MM_CAMERA_PIPE_CMD_EXIT)) {
         mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_STOPPED);
-        mm_camera_poll_sig_done(poll_cb);
-        break;
     }
+    mm_camera_poll_sig_done(poll_cb, seq);
 }
 
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_fn
  *
- * DESCRIPTION: polling thread routine
+ * DESCRIPTION: polling thread routine. Only the ready fds returned by
+ *              epoll_wait are dispatched.
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
@@ -218,48 +237,66 @@ static void mm_camera_poll_proc_pipe(mm_camera_poll_thread_t *poll_cb)
  *==========================================================================*/
 static void *mm_camera_poll_fn(mm_camera_poll_thread_t *poll_cb)
 {
+    struct epoll_event events[MM_CAMERA_POLL_MAX_EVENTS];
+    mm_camera_poll_entry_t *entry;
+    uint32_t backoff_us = 0;
     int rc = 0, i;
 
-    CDBG("%s: poll type = %d, num_fd = %d poll_cb = %p\n",
-         __func__, poll_cb->poll_type, poll_cb->num_fds,poll_cb);
+    CDBG("%s: poll type = %d, poll_cb = %p\n",
+         __func__, poll_cb->poll_type, poll_cb);
     do {
-         for(i = 0; i < poll_cb->num_fds; i++) {
-            poll_cb->poll_fds[i].events = POLLIN|POLLRDNORM|POLLPRI;
-         }
-
-         rc = poll(poll_cb->poll_fds, poll_cb->num_fds, poll_cb->timeoutms);
-         if(rc > 0) {
-            if ((poll_cb->poll_fds[0].revents & POLLIN) &&
-                (poll_cb->poll_fds[0].revents & POLLRDNORM)) {
-                /* if we have data on pipe, we only process pipe in this iteration */
-                CDBG("%s: cmd received on pipe\n", __func__);
-                mm_camera_poll_proc_pipe(poll_cb);
-            } else {
-                for(i=1; i<poll_cb->num_fds; i++) {
-                    /* Checking for ctrl events */
-                    if ((poll_cb->poll_type == MM_CAMERA_POLL_TYPE_EVT) &&
-                        (poll_cb->poll_fds[i].revents & POLLPRI)) {
-                        CDBG("%s: mm_camera_evt_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
-
-                    if ((MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) &&
-                        (poll_cb->poll_fds[i].revents & POLLIN) &&
-                        (poll_cb->poll_fds[i].revents & POLLRDNORM)) {
-                        CDBG("%s: mm_stream_data_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
-                }
+        rc = epoll_wait(poll_cb->epoll_fd, events,
+                        MM_CAMERA_POLL_MAX_EVENTS, poll_cb->timeoutms);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-        } else {
-            /* in error case sleep 10 us and then continue. hard coded here */
-            usleep(10);
+            /* persistent error, back off exponentially instead of spinning */
+            backoff_us = (backoff_us == 0) ? MM_CAMERA_POLL_MIN_BACKOFF_US :
+                backoff_us * 2;
+            if (backoff_us > MM_CAMERA_POLL_MAX_BACKOFF_US) {
+                backoff_us = MM_CAMERA_POLL_MAX_BACKOFF_US;
+            }
+            CDBG_ERROR("%s: epoll_wait failed (%s), retry in %d us",
+                       __func__, strerror(errno), backoff_us);
+            usleep(backoff_us);
             continue;
         }
+        backoff_us = 0;
+
+        /* if we have a cmd, we only process cmd in this iteration.
+         * fds are level triggered, ready ones show up again */
+        for (i = 0; i < rc; i++) {
+            if (MM_CAMERA_POLL_EFD_TAG == events[i].data.u32) {
+                CDBG("%s: cmd received on eventfd\n", __func__);
+                mm_camera_poll_proc_cmd(poll_cb);
+                break;
+            }
+        }
+        if (i < rc) {
+            continue;
+        }
+
+        for (i = 0; i < rc; i++) {
+            entry = &poll_cb->poll_entries[events[i].data.u32 - 1];
+            /* Checking for ctrl events */
+            if ((MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type) &&
+                (events[i].events & mm_camera_backend()->evt_poll_events)) {
+                CDBG("%s: mm_camera_evt_notify\n", __func__);
+                if (NULL != entry->notify_cb) {
+                    entry->notify_cb(entry->user_data);
+                }
+            }
+
+            if ((MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) &&
+                (events[i].events & EPOLLIN) &&
+                (events[i].events & EPOLLRDNORM)) {
+                CDBG("%s: mm_stream_data_notify\n", __func__);
+                if (NULL != entry->notify_cb) {
+                    entry->notify_cb(entry->user_data);
+                }
+            }
+        }
     } while (poll_cb->state == MM_CAMERA_POLL_TASK_STATE_POLL);
     return NULL;
 }
@@ -278,11 +315,8 @@ static void *mm_camera_poll_thread(void *data)
 {
     mm_camera_poll_thread_t *poll_cb = (mm_camera_poll_thread_t *)data;
 
-    /* add pipe read fd into poll first */
-    poll_cb->poll_fds[poll_cb->num_fds++].fd = poll_cb->pfds[0];
-
-    mm_camera_poll_sig_done(poll_cb);
     mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_POLL);
+    mm_camera_poll_sig_done(poll_cb, 0);
     return mm_camera_poll_fn(poll_cb);
 }
 
@@ -395,22 +429,48 @@ int32_t mm_camera_poll_thread_del_poll_fd(mm_camera_poll_thread_t * poll_cb,
 int32_t mm_camera_poll_thread_launch(mm_camera_poll_thread_t * poll_cb,
                                      mm_camera_poll_thread_type_t poll_type)
 {
+    struct epoll_event ev;
     int32_t rc = 0;
+    int i;
+
     poll_cb->poll_type = poll_type;
+    poll_cb->cmd = 0;
+    poll_cb->cmd_seq = 0;
+    poll_cb->done_seq = 0;
+    for (i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
+        poll_cb->polled_fds[i] = -1;
+    }
 
-    poll_cb->pfds[0] = 0;
-    poll_cb->pfds[1] = 0;
-    rc = pipe(poll_cb->pfds);
-    if(rc < 0) {
-        CDBG_ERROR("%s: pipe open rc=%d\n", __func__, rc);
+    poll_cb->efd = eventfd(0, EFD_NONBLOCK);
+    if (poll_cb->efd < 0) {
+        CDBG_ERROR("%s: eventfd failed (%s)", __func__, strerror(errno));
+        return -1;
+    }
+    poll_cb->epoll_fd = epoll_create(MM_CAMERA_POLL_MAX_EVENTS);
+    if (poll_cb->epoll_fd < 0) {
+        CDBG_ERROR("%s: epoll_create failed (%s)", __func__, strerror(errno));
+        close(poll_cb->efd);
+        poll_cb->efd = -1;
+        return -1;
+    }
+    /* add cmd eventfd into epoll first */
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = MM_CAMERA_POLL_EFD_TAG;
+    if (epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_ADD, poll_cb->efd, &ev) < 0) {
+        CDBG_ERROR("%s: epoll add eventfd failed (%s)", __func__, strerror(errno));
+        close(poll_cb->epoll_fd);
+        close(poll_cb->efd);
+        poll_cb->epoll_fd = -1;
+        poll_cb->efd = -1;
         return -1;
     }
 
     poll_cb->timeoutms = -1;  /* Infinite seconds */
 
-    CDBG("%s: poll_type = %d, read fd = %d, write fd = %d timeout = %d",
+    CDBG("%s: poll_type = %d, eventfd = %d, epoll fd = %d timeout = %d",
         __func__, poll_cb->poll_type,
-        poll_cb->pfds[0], poll_cb->pfds[1],poll_cb->timeoutms);
+        poll_cb->efd, poll_cb->epoll_fd, poll_cb->timeoutms);
 
     pthread_mutex_init(&poll_cb->mutex, NULL);
     pthread_cond_init(&poll_cb->cond_v, NULL);
@@ -419,7 +479,7 @@ int32_t mm_camera_poll_thread_launch(mm_camera_poll_thread_t * poll_cb,
     pthread_mutex_lock(&poll_cb->mutex);
     poll_cb->status = 0;
     pthread_create(&poll_cb->pid, NULL, mm_camera_poll_thread, (void *)poll_cb);
-    if(!poll_cb->status) {
+    while (!poll_cb->status) {
         pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
     }
     pthread_mutex_unlock(&poll_cb->mutex);
@@ -442,12 +502,12 @@ int32_t mm_camera_poll_thread_release(mm_camera_poll_thread_t *poll_cb)
         CDBG_ERROR("%s: pthread dead already\n", __func__);
     }
 
-    /* close pipe */
-    if(poll_cb->pfds[0]) {
-        close(poll_cb->pfds[0]);
+    /* close eventfd and epoll set */
+    if (poll_cb->epoll_fd >= 0) {
+        close(poll_cb->epoll_fd);
     }
-    if(poll_cb->pfds[1]) {
-        close(poll_cb->pfds[1]);
+    if (poll_cb->efd >= 0) {
+        close(poll_cb->efd);
     }
 
     pthread_mutex_destroy(&poll_cb->mutex);
@@ -456,26 +516,393 @@ int32_t mm_camera_poll_thread_release(mm_camera_poll_thread_t *poll_cb)
     return rc;
 }
 
-static void *mm_camera_cmd_thread(void *data)
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_pool_init
+ *
+ * DESCRIPTION: preallocate cmd nodes for a cmd thread, so that enqueuing
+ *              a cmd in the frame path does not need heap allocation
+ *
+ * PARAMETERS :
+ *   @pool    : ptr to cmd node pool
+ *   @depth   : number of cmd nodes to be preallocated
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_cmd_pool_init(mm_camera_cmd_pool_t *pool,
+                                       uint32_t depth)
+{
+    uint32_t i;
+
+    memset(pool, 0, sizeof(mm_camera_cmd_pool_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    if (0 == depth) {
+        return 0;
+    }
+
+    pool->nodes = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t) * depth);
+    pool->free_nodes = (mm_camera_cmdcb_t **)malloc(sizeof(mm_camera_cmdcb_t *) * depth);
+    if (NULL == pool->nodes || NULL == pool->free_nodes) {
+        CDBG_ERROR("%s: No memory for cmd pool (depth %d)", __func__, depth);
+        if (NULL != pool->nodes) {
+            free(pool->nodes);
+            pool->nodes = NULL;
+        }
+        if (NULL != pool->free_nodes) {
+            free(pool->free_nodes);
+            pool->free_nodes = NULL;
+        }
+        return -1;
+    }
+
+    for (i = 0; i < depth; i++) {
+        pool->free_nodes[i] = &pool->nodes[i];
+    }
+    pool->depth = depth;
+    pool->free_cnt = depth;
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_pool_deinit
+ *
+ * DESCRIPTION: release preallocated cmd nodes of a cmd thread
+ *
+ * PARAMETERS :
+ *   @pool    : ptr to cmd node pool
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_cmd_pool_deinit(mm_camera_cmd_pool_t *pool)
+{
+    if (pool->overflow_cnt > 0) {
+        CDBG_HIGH("%s: cmd pool (depth %d) overflowed %d times",
+                  __func__, pool->depth, pool->overflow_cnt);
+    }
+    if (NULL != pool->nodes) {
+        free(pool->nodes);
+    }
+    if (NULL != pool->free_nodes) {
+        free(pool->free_nodes);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    memset(pool, 0, sizeof(mm_camera_cmd_pool_t));
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_alloc_cmd
+ *
+ * DESCRIPTION: get a cmd node to be enqueued into a cmd thread. Node is
+ *              drawn from the preallocated pool of the cmd thread, and only
+ *              allocated from heap when the pool is exhausted.
+ *
+ * PARAMETERS :
+ *   @cmd_thread : ptr to cmd thread object
+ *
+ * RETURN     : ptr to a zeroed cmd node, NULL if no memory
+ *==========================================================================*/
+mm_camera_cmdcb_t *mm_camera_cmd_thread_alloc_cmd(mm_camera_cmd_thread_t * cmd_thread)
+{
+    mm_camera_cmd_pool_t *pool = &cmd_thread->cmd_pool;
+    mm_camera_cmdcb_t *node = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_cnt > 0) {
+        node = pool->free_nodes[--pool->free_cnt];
+    } else {
+        pool->overflow_cnt++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (NULL == node) {
+        node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+        if (NULL == node) {
+            return NULL;
+        }
+    }
+
+    memset(node, 0, sizeof(mm_camera_cmdcb_t));
+    return node;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_free_cmd
+ *
+ * DESCRIPTION: return a cmd node to the pool of the cmd thread it was
+ *              allocated from.
+ *
+ * PARAMETERS :
+ *   @cmd_thread : ptr to cmd thread object
+ *   @node       : cmd node to be released
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_cmd_thread_free_cmd(mm_camera_cmd_thread_t * cmd_thread,
+                                   mm_camera_cmdcb_t *node)
+{
+    mm_camera_cmd_pool_t *pool = &cmd_thread->cmd_pool;
+
+    if ((NULL != pool->nodes) &&
+        (node >= pool->nodes) &&
+        (node < pool->nodes + pool->depth)) {
+        pthread_mutex_lock(&pool->lock);
+        pool->free_nodes[pool->free_cnt++] = node;
+        pthread_mutex_unlock(&pool->lock);
+    } else {
+        free(node);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_ring_init
+ *
+ * DESCRIPTION: initialize a single producer/single consumer cmd ring
+ *
+ * PARAMETERS :
+ *   @ring    : ptr to cmd ring
+ *   @depth   : min number of slots, rounded up to power of 2
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_cmd_ring_init(mm_camera_cmd_ring_t *ring,
+                                       uint32_t depth)
+{
+    uint32_t num_slots = 1;
+
+    memset(ring, 0, sizeof(mm_camera_cmd_ring_t));
+    ring->efd = -1;
+    while (num_slots < depth) {
+        num_slots <<= 1;
+    }
+
+    ring->slots = (mm_camera_cmdcb_t **)malloc(sizeof(mm_camera_cmdcb_t *) * num_slots);
+    if (NULL == ring->slots) {
+        CDBG_ERROR("%s: No memory for cmd ring (%d slots)", __func__, num_slots);
+        return -1;
+    }
+    ring->mask = num_slots - 1;
+
+    ring->efd = eventfd(0, 0);
+    if (ring->efd < 0) {
+        CDBG_ERROR("%s: eventfd failed (%s)", __func__, strerror(errno));
+        free(ring->slots);
+        ring->slots = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_ring_deinit
+ *
+ * DESCRIPTION: deinitialize a cmd ring
+ *
+ * PARAMETERS :
+ *   @ring    : ptr to cmd ring
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_cmd_ring_deinit(mm_camera_cmd_ring_t *ring)
+{
+    if (ring->efd >= 0) {
+        close(ring->efd);
+    }
+    if (NULL != ring->slots) {
+        free(ring->slots);
+    }
+    memset(ring, 0, sizeof(mm_camera_cmd_ring_t));
+    ring->efd = -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_ring_push
+ *
+ * DESCRIPTION: push a cmd into ring. Can only be called from the producer.
+ *
+ * PARAMETERS :
+ *   @ring    : ptr to cmd ring
+ *   @node    : cmd to be pushed
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- ring is full
+ *==========================================================================*/
+static int32_t mm_camera_cmd_ring_push(mm_camera_cmd_ring_t *ring,
+                                       mm_camera_cmdcb_t *node)
+{
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (tail - head > ring->mask) {
+        return -1;
+    }
+    ring->slots[tail & ring->mask] = node;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_ring_pop
+ *
+ * DESCRIPTION: pop a cmd from ring. Can only be called from the consumer.
+ *
+ * PARAMETERS :
+ *   @ring    : ptr to cmd ring
+ *
+ * RETURN     : ptr to cmd, NULL if ring is empty
+ *==========================================================================*/
+static mm_camera_cmdcb_t *mm_camera_cmd_ring_pop(mm_camera_cmd_ring_t *ring)
+{
+    mm_camera_cmdcb_t *node = NULL;
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return NULL;
+    }
+    node = ring->slots[head & ring->mask];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return node;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_wake
+ *
+ * DESCRIPTION: wake up cmd thread to process newly enqueued cmd
+ *
+ * PARAMETERS :
+ *   @cmd_thread : ptr to cmd thread object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_cmd_thread_wake(mm_camera_cmd_thread_t * cmd_thread)
+{
+    uint64_t val = 1;
+
+    if (MM_CAMERA_CMD_QUEUE_TYPE_SPSC == cmd_thread->queue_type) {
+        if (write(cmd_thread->ring.efd, &val, sizeof(val)) != sizeof(val)) {
+            CDBG_ERROR("%s: eventfd write error (%s)", __func__, strerror(errno));
+        }
+    } else {
+        sem_post(&cmd_thread->cmd_sem);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_wait
+ *
+ * DESCRIPTION: block cmd thread until new cmd is available
+ *
+ * PARAMETERS :
+ *   @cmd_thread : ptr to cmd thread object
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_cmd_thread_wait(mm_camera_cmd_thread_t * cmd_thread)
 {
-    int running = 1;
     int ret;
-    mm_camera_cmd_thread_t *cmd_thread =
-                (mm_camera_cmd_thread_t *)data;
-    mm_camera_cmdcb_t* node = NULL;
+    uint64_t val;
 
-    do {
+    if (MM_CAMERA_CMD_QUEUE_TYPE_SPSC == cmd_thread->queue_type) {
+        do {
+            ret = read(cmd_thread->ring.efd, &val, sizeof(val));
+            if (ret < 0 && errno != EINTR) {
+                CDBG_ERROR("%s: eventfd read error (%s)",
+                           __func__, strerror(errno));
+                return -1;
+            }
+        } while (ret < 0);
+    } else {
         do {
             ret = sem_wait(&cmd_thread->cmd_sem);
             if (ret != 0 && errno != EINVAL) {
                 CDBG_ERROR("%s: sem_wait error (%s)",
                            __func__, strerror(errno));
-                return NULL;
+                return -1;
             }
         } while (ret != 0);
+    }
+    return 0;
+}
 
-        /* we got notified about new cmd avail in cmd queue */
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_dequeue
+ *
+ * DESCRIPTION: dequeue next cmd to be processed by cmd thread. For SPSC type,
+ *              ring is always drained before the overflow list, which keeps
+ *              cmds in order since producer stays on the list until it's empty.
+ *
+ * PARAMETERS :
+ *   @cmd_thread : ptr to cmd thread object
+ *
+ * RETURN     : ptr to cmd, NULL if no cmd available
+ *==========================================================================*/
+static mm_camera_cmdcb_t *mm_camera_cmd_thread_dequeue(mm_camera_cmd_thread_t * cmd_thread)
+{
+    mm_camera_cmdcb_t *node = NULL;
+
+    if (MM_CAMERA_CMD_QUEUE_TYPE_SPSC == cmd_thread->queue_type) {
+        node = mm_camera_cmd_ring_pop(&cmd_thread->ring);
+    }
+    if (NULL == node) {
         node = (mm_camera_cmdcb_t*)cam_queue_deq(&cmd_thread->cmd_queue);
+    }
+    return node;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_enqueue
+ *
+ * DESCRIPTION: enqueue a cmd into cmd thread and wake it up. For SPSC type,
+ *              this can only be called from the single producer thread.
+ *
+ * PARAMETERS :
+ *   @cmd_thread : ptr to cmd thread object
+ *   @node       : cmd to be enqueued
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_cmd_thread_enqueue(mm_camera_cmd_thread_t * cmd_thread,
+                                     mm_camera_cmdcb_t *node)
+{
+    int32_t rc = -1;
+
+    if (MM_CAMERA_CMD_QUEUE_TYPE_SPSC == cmd_thread->queue_type &&
+        0 == __atomic_load_n(&cmd_thread->cmd_queue.size, __ATOMIC_ACQUIRE)) {
+        /* once ring overflowed, keep using the list until consumer
+         * drains it, so that cmds are delivered in order */
+        rc = mm_camera_cmd_ring_push(&cmd_thread->ring, node);
+    }
+    if (0 != rc) {
+        rc = cam_queue_enq(&cmd_thread->cmd_queue, node);
+    }
+    if (0 == rc) {
+        mm_camera_cmd_thread_wake(cmd_thread);
+    }
+    return rc;
+}
+
+static void *mm_camera_cmd_thread(void *data)
+{
+    int running = 1;
+    mm_camera_cmd_thread_t *cmd_thread =
+                (mm_camera_cmd_thread_t *)data;
+    mm_camera_cmdcb_t* node = NULL;
+
+    do {
+        if (0 != mm_camera_cmd_thread_wait(cmd_thread)) {
+            return NULL;
+        }
+
+        /* we got notified about new cmd avail in cmd queue */
+        node = mm_camera_cmd_thread_dequeue(cmd_thread);
         while (node != NULL) {
             switch (node->cmd_type) {
             case MM_CAMERA_CMD_TYPE_EVT_CB:
@@ -491,8 +918,8 @@ static void *mm_camera_cmd_thread(void *data)
                 running = 0;
                 break;
             }
-            free(node);
-            node = (mm_camera_cmdcb_t*)cam_queue_deq(&cmd_thread->cmd_queue);
+            mm_camera_cmd_thread_free_cmd(cmd_thread, node);
+            node = mm_camera_cmd_thread_dequeue(cmd_thread);
         } /* (node != NULL) */
     } while (running);
     return NULL;
@@ -500,12 +927,23 @@ static void *mm_camera_cmd_thread(void *data)
 
 int32_t mm_camera_cmd_thread_launch(mm_camera_cmd_thread_t * cmd_thread,
                                     mm_camera_cmd_cb_t cb,
-                                    void* user_data)
+                                    void* user_data,
+                                    uint32_t pool_depth,
+                                    mm_camera_cmd_queue_type_t queue_type)
 {
     int32_t rc = 0;
 
+    cmd_thread->queue_type = queue_type;
+    if (MM_CAMERA_CMD_QUEUE_TYPE_SPSC == queue_type) {
+        if (0 != mm_camera_cmd_ring_init(&cmd_thread->ring, pool_depth)) {
+            /* fall back to list since it works for any producer */
+            cmd_thread->queue_type = MM_CAMERA_CMD_QUEUE_TYPE_LIST;
+        }
+    }
+
     sem_init(&cmd_thread->cmd_sem, 0, 0);
-    cam_queue_init(&cmd_thread->cmd_queue);
+    cam_queue_init_with_depth(&cmd_thread->cmd_queue, pool_depth);
+    mm_camera_cmd_pool_init(&cmd_thread->cmd_pool, pool_depth);
     cmd_thread->cb = cb;
     cmd_thread->user_data = user_data;
 
@@ -520,17 +958,18 @@ int32_t mm_camera_cmd_thread_launch(mm_camera_cmd_thread_t * cmd_thread,
 int32_t mm_camera_cmd_thread_stop(mm_camera_cmd_thread_t * cmd_thread)
 {
     int32_t rc = 0;
-    mm_camera_cmdcb_t* node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    mm_camera_cmdcb_t* node = mm_camera_cmd_thread_alloc_cmd(cmd_thread);
     if (NULL == node) {
         CDBG_ERROR("%s: No memory for mm_camera_cmdcb_t", __func__);
         return -1;
     }
 
-    memset(node, 0, sizeof(mm_camera_cmdcb_t));
     node->cmd_type = MM_CAMERA_CMD_TYPE_EXIT;
 
+    /* exitCMD always goes through the list, since caller is not
+     * the producer of a SPSC ring */
     cam_queue_enq(&cmd_thread->cmd_queue, node);
-    sem_post(&cmd_thread->cmd_sem);
+    mm_camera_cmd_thread_wake(cmd_thread);
 
     /* wait until cmd thread exits */
     if (pthread_join(cmd_thread->cmd_pid, NULL) != 0) {
@@ -542,7 +981,26 @@ int32_t mm_camera_cmd_thread_stop(mm_camera_cmd_thread_t * cmd_thread)
 int32_t mm_camera_cmd_thread_destroy(mm_camera_cmd_thread_t * cmd_thread)
 {
     int32_t rc = 0;
+    mm_camera_cmdcb_t* node = NULL;
+
+    /* cmd nodes left in queue may come from pool, release them
+     * back before queue and pool are destroyed */
+    node = mm_camera_cmd_thread_dequeue(cmd_thread);
+    while (NULL != node) {
+        mm_camera_cmd_thread_free_cmd(cmd_thread, node);
+        node = mm_camera_cmd_thread_dequeue(cmd_thread);
+    }
+
+    if (cmd_thread->cmd_queue.overflow_cnt > 0) {
+        CDBG_HIGH("%s: cmd queue (depth %d) overflowed %d times",
+                  __func__, cmd_thread->cmd_queue.pool_depth,
+                  cmd_thread->cmd_queue.overflow_cnt);
+    }
     cam_queue_deinit(&cmd_thread->cmd_queue);
+    if (MM_CAMERA_CMD_QUEUE_TYPE_SPSC == cmd_thread->queue_type) {
+        mm_camera_cmd_ring_deinit(&cmd_thread->ring);
+    }
+    mm_camera_cmd_pool_deinit(&cmd_thread->cmd_pool);
     sem_destroy(&cmd_thread->cmd_sem);
     memset(cmd_thread, 0, sizeof(mm_camera_cmd_thread_t));
     return rc;
@@ -71,4 +71,166 @@ LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_EXECUTABLE)
 
+# buffer flow benchmark, links interface lib directly
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS:= \
+        $(mmcamera_debug_defines) \
+        $(mmcamera_debug_cflags)
+
+ifeq ($(strip $(TARGET_USES_ION)),true)
+LOCAL_CFLAGS += -DUSE_ION
+endif
+
+LOCAL_CFLAGS += -D_ANDROID_
+LOCAL_CFLAGS += -DCAMERA_ION_HEAP_ID=ION_CP_MM_HEAP_ID
+LOCAL_CFLAGS += -DCAMERA_ION_FALLBACK_HEAP_ID=ION_IOMMU_HEAP_ID
+LOCAL_CFLAGS += -Wall -Werror
+
+LOCAL_SRC_FILES:= \
+        src/mm_qcamera_bench.c \
+        src/mm_qcamera_bench_util.c
+
+LOCAL_C_INCLUDES:=$(LOCAL_PATH)/inc
+LOCAL_C_INCLUDES+= \
+        frameworks/native/include/media/openmax \
+        $(LOCAL_PATH)/../common \
+        $(LOCAL_PATH)/../mm-camera-interface/inc \
+        $(LOCAL_PATH)/../../../mm-image-codec/qexif \
+        $(LOCAL_PATH)/../../../mm-image-codec/qomx_core
+
+LOCAL_C_INCLUDES+= $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include/media
+LOCAL_C_INCLUDES+= $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
+LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+
+LOCAL_SHARED_LIBRARIES:= \
+         libcutils libmmcamera_interface3
+
+LOCAL_MODULE:= mm-qcamera-bench3
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# node pool unit test, no heap allocation per frame on sim backend
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS:= \
+        $(mmcamera_debug_defines) \
+        $(mmcamera_debug_cflags)
+
+LOCAL_CFLAGS += -D_ANDROID_
+LOCAL_CFLAGS += -Wall -Werror
+
+LOCAL_SRC_FILES:= src/mm_qcamera_pool_test.c
+
+LOCAL_C_INCLUDES:=$(LOCAL_PATH)/inc
+LOCAL_C_INCLUDES+= \
+        frameworks/native/include/media/openmax \
+        $(LOCAL_PATH)/../common \
+        $(LOCAL_PATH)/../../../mm-image-codec/qexif \
+        $(LOCAL_PATH)/../../../mm-image-codec/qomx_core
+
+LOCAL_C_INCLUDES+= $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include/media
+LOCAL_C_INCLUDES+= $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
+LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+
+LOCAL_SHARED_LIBRARIES:= \
+         libcutils libdl libmmcamera_interface3
+
+LOCAL_MODULE:= mm-qcamera-pool-test3
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# super buf matcher replay test, recorded arrival orders on sim backend
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS:= \
+        $(mmcamera_debug_defines) \
+        $(mmcamera_debug_cflags)
+
+LOCAL_CFLAGS += -D_ANDROID_
+LOCAL_CFLAGS += -Wall -Werror
+
+LOCAL_SRC_FILES:= src/mm_qcamera_replay_test.c
+
+LOCAL_C_INCLUDES:=$(LOCAL_PATH)/inc
+LOCAL_C_INCLUDES+= \
+        frameworks/native/include/media/openmax \
+        $(LOCAL_PATH)/../common \
+        $(LOCAL_PATH)/../../../mm-image-codec/qexif \
+        $(LOCAL_PATH)/../../../mm-image-codec/qomx_core
+
+LOCAL_C_INCLUDES+= $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include/media
+LOCAL_C_INCLUDES+= $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
+LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+
+LOCAL_SHARED_LIBRARIES:= \
+         libcutils libmmcamera_interface3
+
+LOCAL_MODULE:= mm-qcamera-replay-test3
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# ZSL focus priority super buf queue test on sim backend
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS:= \
+        $(mmcamera_debug_defines) \
+        $(mmcamera_debug_cflags)
+
+LOCAL_CFLAGS += -D_ANDROID_
+LOCAL_CFLAGS += -Wall -Werror
+
+LOCAL_SRC_FILES:= src/mm_qcamera_zsl_focus_test.c
+
+LOCAL_C_INCLUDES:=$(LOCAL_PATH)/inc
+LOCAL_C_INCLUDES+= \
+        frameworks/native/include/media/openmax \
+        $(LOCAL_PATH)/../common \
+        $(LOCAL_PATH)/../../../mm-image-codec/qexif \
+        $(LOCAL_PATH)/../../../mm-image-codec/qomx_core
+
+LOCAL_C_INCLUDES+= $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include/media
+LOCAL_C_INCLUDES+= $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
+LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+
+LOCAL_SHARED_LIBRARIES:= \
+         libcutils libmmcamera_interface3
+
+LOCAL_MODULE:= mm-qcamera-zsl-focus-test3
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# HAL API call rate benchmark under preview frame load, loads HAL module
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS:= \
+        $(mmcamera_debug_defines) \
+        $(mmcamera_debug_cflags)
+
+LOCAL_CFLAGS += -D_ANDROID_
+LOCAL_CFLAGS += -Wall -Werror
+
+LOCAL_SRC_FILES:= \
+        src/mm_qcamera_hal_bench.c \
+        src/mm_qcamera_bench_util.c
+
+LOCAL_C_INCLUDES:=$(LOCAL_PATH)/inc
+
+LOCAL_SHARED_LIBRARIES:= \
+         libcutils libdl libhardware
+
+LOCAL_MODULE:= mm-qcamera-hal-bench3
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
 LOCAL_PATH := $(OLD_LOCAL_PATH)
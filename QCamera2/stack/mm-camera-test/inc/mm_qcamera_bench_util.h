@@ -0,0 +1,54 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of Code Aurora Forum, Inc. nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __MM_QCAMERA_BENCH_UTIL_H__
+#define __MM_QCAMERA_BENCH_UTIL_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/* latency sample helpers shared by mm-qcamera-bench3 and
+ * mm-qcamera-hal-bench3 */
+
+#define BENCH_MAX_SAMPLES   (64 * 1024)
+
+typedef struct {
+    double samples[BENCH_MAX_SAMPLES];
+    uint32_t cnt;
+} bench_lat_t;
+
+extern double bench_diff_us(const struct timespec *from,
+                            const struct timespec *to);
+/* samples past BENCH_MAX_SAMPLES are dropped */
+extern void bench_lat_add(bench_lat_t *lat, double val);
+/* sorts samples, prints count, mean, p50/p90/p99 and max in given unit */
+extern void bench_lat_print(const char *name, bench_lat_t *lat,
+                            const char *unit);
+
+#endif /* __MM_QCAMERA_BENCH_UTIL_H__ */
@@ -100,6 +100,37 @@ int mm_app_load_hal(mm_camera_app_t *my_cam_app)
     return MM_CAMERA_OK;
 }
 
+static int mm_app_allocate_file_memory(mm_camera_app_buf_t *buf)
+{
+    char path[] = "/tmp/mm-qcamera-XXXXXX";
+    uint32_t len = (buf->mem_info.size + 4095) & (~4095);
+    void *data = NULL;
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        CDBG_ERROR("%s: mkstemp failed %s\n", __func__, strerror(errno));
+        return -MM_CAMERA_E_GENERAL;
+    }
+    unlink(path);
+    if (ftruncate(fd, len) < 0) {
+        CDBG_ERROR("%s: ftruncate failed %s\n", __func__, strerror(errno));
+        close(fd);
+        return -MM_CAMERA_E_GENERAL;
+    }
+    data = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        CDBG_ERROR("%s: mmap failed %s\n", __func__, strerror(errno));
+        close(fd);
+        return -MM_CAMERA_E_GENERAL;
+    }
+    buf->mem_info.main_ion_fd = 0;
+    buf->mem_info.fd = fd;
+    buf->mem_info.handle = NULL;
+    buf->mem_info.size = len;
+    buf->mem_info.data = data;
+    return MM_CAMERA_OK;
+}
+
 int mm_app_allocate_ion_memory(mm_camera_app_buf_t *buf, int ion_type)
 {
     int rc = MM_CAMERA_OK;
@@ -111,6 +142,10 @@ int mm_app_allocate_ion_memory(mm_camera_app_buf_t *buf, int ion_type)
 
     main_ion_fd = open("/dev/ion", O_RDONLY);
     if (main_ion_fd <= 0) {
+        if (NULL != getenv("MM_CAMERA_BACKEND")) {
+            /* no ion on build host, simulated camera can map any fd */
+            return mm_app_allocate_file_memory(buf);
+        }
         CDBG_ERROR("Ion dev open failed %s\n", strerror(errno));
         goto ION_OPEN_FAILED;
     }
@@ -736,7 +771,7 @@ int main(int argc, char **argv)
 
     CDBG("\nCamera Test Application\n");
 
-    while ((c = getopt(argc, argv, "tdh")) != -1) {
+    while ((c = getopt(argc, argv, "tdsh")) != -1) {
         switch (c) {
            case 't':
                run_tc = 1;
@@ -744,11 +779,16 @@ int main(int argc, char **argv)
            case 'd':
                run_dual_tc = 1;
                break;
+           case 's':
+               /* must be set before interface lib picks its backend */
+               setenv("MM_CAMERA_BACKEND", "sim", 1);
+               break;
            case 'h':
            default:
-               printf("usage: %s [-t] [-d] \n", argv[0]);
+               printf("usage: %s [-t] [-d] [-s] \n", argv[0]);
                printf("-t:   Unit test        \n");
                printf("-d:   Dual camera test \n");
+               printf("-s:   Simulated camera \n");
                return 0;
         }
     }
@@ -0,0 +1,1172 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Buffer flow benchmark of mm-camera-interface. Runs a preview channel
+ * (optionally with a bundled video stream matched into super bufs) for a
+ * fixed time and reports frame latency from kernel timestamp to stream and
+ * super buf callbacks, frame drops and CPU cost per frame. With -p, touch
+ * AF/AE parameter updates are sent at the given rate while streaming and
+ * the cost of encoding the batch and of set_parms is reported too. With
+ * -r/-R, preview switches between two aspect ratios while streaming, either
+ * by reconfiguring the stream in place or by restarting the channel, and
+ * the gap from the switch request to the first frame of new size is
+ * reported. With -q, no camera is opened: cmd nodes are enqueued at the
+ * given rate into a cmd thread of each queue type (SPSC ring and list) and
+ * the latency from enqueue to dispatch in the cmd thread is reported. With
+ * -e, no camera is opened either: the given number of pipes are polled
+ * by data poll threads, as many as needed at MAX_STREAM_NUM_IN_BUNDLE fds
+ * each like channels, and are signaled round robin at 30/s each. Latency
+ * from signal to notify and CPU cost per wake are reported, then the same
+ * is run on threads looping on poll() the way the poll thread did before
+ * it moved to epoll, as a baseline. Meant to be run
+ * against the simulated backend (-s) on a build host, but works on target
+ * with the real driver as well. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <semaphore.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef USE_ION
+#include <linux/msm_ion.h>
+#endif
+
+#include "mm_qcamera_dbg.h"
+#include "mm_qcamera_app.h"
+#include "mm_camera.h"
+#include "mm_qcamera_bench_util.h"
+
+#define BENCH_MAX_STREAMS   2
+#define BENCH_MAX_POLL_FDS  256
+#define BENCH_POLL_FD_FPS   30
+
+typedef struct {
+    uint32_t s_id;
+    cam_stream_type_t type;
+    uint8_t num_bufs;
+    mm_camera_app_buf_t info_buf;
+    mm_camera_app_buf_t bufs[MM_CAMERA_MAX_NUM_FRAMES];
+    cam_stream_info_t *info;
+    uint8_t keep_bufs;          /* put_bufs keeps bufs for reconfig */
+    uint8_t bufs_kept;          /* bufs kept by put_bufs, still mapped */
+    uint32_t reuses;            /* reconfigs that reused kept bufs */
+
+    /* written by callback thread only */
+    uint32_t frames;
+    uint32_t drops;
+    uint32_t last_frame_idx;
+    bench_lat_t cb_lat;
+} bench_stream_t;
+
+typedef struct {
+    mm_camera_vtbl_t *cam;
+    uint32_t ch_id;
+    mm_camera_app_buf_t cap_buf;
+    uint8_t num_streams;
+    bench_stream_t streams[BENCH_MAX_STREAMS];
+    uint32_t super_bufs;
+    bench_lat_t super_lat;
+    pthread_mutex_t lock;
+
+    /* parameter updates, main thread only */
+    mm_camera_app_buf_t parm_buf;
+    uint32_t parm_fails;
+    bench_lat_t parm_enc_lat;   /* in us */
+    bench_lat_t parm_set_lat;   /* in us */
+
+    /* preview size switches */
+    uint32_t first_frames;      /* frames seen since last switch */
+    struct timespec first_ts;   /* when first of them arrived */
+    uint8_t switching;          /* frames are of old size */
+    uint32_t switch_fails;
+    bench_lat_t switch_lat;     /* request to first new frame, in ms */
+    bench_lat_t switch_call_lat;/* time spent in the switch call, in ms */
+} bench_obj_t;
+
+static double bench_age_ms(const struct timespec *ts)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return bench_diff_us(ts, &now) / 1000.0;
+}
+
+/* ion on target, an unlinked tmp file on build host */
+static int bench_alloc(mm_camera_app_buf_t *buf, uint32_t size)
+{
+    char path[] = "/tmp/mm-qcamera-bench-XXXXXX";
+    void *data;
+    int fd;
+
+    memset(buf, 0, sizeof(*buf));
+    size = (size + 4095) & (~4095);
+#ifdef USE_ION
+    {
+        struct ion_allocation_data alloc;
+        struct ion_fd_data ion_info_fd;
+        int ion_fd = open("/dev/ion", O_RDONLY);
+        if (ion_fd > 0) {
+            memset(&alloc, 0, sizeof(alloc));
+            alloc.len = size;
+            alloc.align = 4096;
+            alloc.flags = ION_FLAG_CACHED;
+            alloc.heap_mask = (0x1 << CAMERA_ION_HEAP_ID) |
+                              (0x1 << CAMERA_ION_FALLBACK_HEAP_ID);
+            memset(&ion_info_fd, 0, sizeof(ion_info_fd));
+            if (ioctl(ion_fd, ION_IOC_ALLOC, &alloc) >= 0) {
+                ion_info_fd.handle = alloc.handle;
+                if (ioctl(ion_fd, ION_IOC_SHARE, &ion_info_fd) >= 0) {
+                    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                ion_info_fd.fd, 0);
+                    if (MAP_FAILED != data) {
+                        buf->mem_info.main_ion_fd = ion_fd;
+                        buf->mem_info.fd = ion_info_fd.fd;
+                        buf->mem_info.handle = ion_info_fd.handle;
+                        buf->mem_info.size = size;
+                        buf->mem_info.data = data;
+                        return 0;
+                    }
+                    close(ion_info_fd.fd);
+                }
+                {
+                    struct ion_handle_data handle_data;
+                    memset(&handle_data, 0, sizeof(handle_data));
+                    handle_data.handle = alloc.handle;
+                    ioctl(ion_fd, ION_IOC_FREE, &handle_data);
+                }
+            }
+            close(ion_fd);
+        }
+    }
+#endif
+    fd = mkstemp(path);
+    if (fd < 0) {
+        CDBG_ERROR("%s: mkstemp failed %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == data) {
+        close(fd);
+        return -1;
+    }
+    buf->mem_info.fd = fd;
+    buf->mem_info.size = size;
+    buf->mem_info.data = data;
+    return 0;
+}
+
+static void bench_free(mm_camera_app_buf_t *buf)
+{
+    if (NULL != buf->mem_info.data) {
+        munmap(buf->mem_info.data, buf->mem_info.size);
+    }
+    if (buf->mem_info.fd > 0) {
+        close(buf->mem_info.fd);
+    }
+#ifdef USE_ION
+    if (buf->mem_info.main_ion_fd > 0) {
+        struct ion_handle_data handle_data;
+        memset(&handle_data, 0, sizeof(handle_data));
+        handle_data.handle = buf->mem_info.handle;
+        ioctl(buf->mem_info.main_ion_fd, ION_IOC_FREE, &handle_data);
+        close(buf->mem_info.main_ion_fd);
+    }
+#endif
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int32_t bench_get_bufs(cam_frame_len_offset_t *offset,
+                              uint8_t *num_bufs,
+                              uint8_t **initial_reg_flag,
+                              mm_camera_buf_def_t **bufs,
+                              mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                              void *user_data)
+{
+    bench_stream_t *stream = (bench_stream_t *)user_data;
+    mm_camera_buf_def_t *pBufs;
+    uint8_t *reg_flags;
+    uint8_t reuse = 0;
+    int i, j;
+
+    pBufs = (mm_camera_buf_def_t *)calloc(stream->num_bufs, sizeof(mm_camera_buf_def_t));
+    reg_flags = (uint8_t *)calloc(stream->num_bufs, sizeof(uint8_t));
+    if (NULL == pBufs || NULL == reg_flags) {
+        free(pBufs);
+        free(reg_flags);
+        return -1;
+    }
+
+    /* bufs kept over reconfig are reused as mapped if new frame fits */
+    if (stream->bufs_kept) {
+        reuse = 1;
+        for (i = 0; i < stream->num_bufs; i++) {
+            if (stream->bufs[i].mem_info.size < offset->frame_len) {
+                reuse = 0;
+            }
+        }
+        if (!reuse) {
+            for (i = 0; i < stream->num_bufs; i++) {
+                ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+                bench_free(&stream->bufs[i]);
+            }
+        }
+        stream->bufs_kept = 0;
+    }
+
+    for (i = 0; i < stream->num_bufs; i++) {
+        mm_camera_app_buf_t *app_buf = &stream->bufs[i];
+        if (!reuse && 0 != bench_alloc(app_buf, offset->frame_len)) {
+            break;
+        }
+        app_buf->buf.buf_idx = i;
+        app_buf->buf.num_planes = offset->num_planes;
+        app_buf->buf.fd = app_buf->mem_info.fd;
+        app_buf->buf.frame_len = app_buf->mem_info.size;
+        app_buf->buf.buffer = app_buf->mem_info.data;
+        app_buf->buf.mem_info = (void *)&app_buf->mem_info;
+        for (j = 0; j < offset->num_planes; j++) {
+            app_buf->buf.planes[j].length = offset->mp[j].len;
+            app_buf->buf.planes[j].m.userptr = app_buf->buf.fd;
+            app_buf->buf.planes[j].data_offset = offset->mp[j].offset;
+            app_buf->buf.planes[j].reserved[0] = (0 == j) ? 0 :
+                app_buf->buf.planes[j-1].reserved[0] + app_buf->buf.planes[j-1].length;
+        }
+        if (!reuse &&
+            0 != ops_tbl->map_ops(i, -1, app_buf->buf.fd, app_buf->buf.frame_len,
+                                  ops_tbl->userdata)) {
+            bench_free(app_buf);
+            break;
+        }
+        pBufs[i] = app_buf->buf;
+        reg_flags[i] = 1;
+    }
+
+    if (i < stream->num_bufs) {
+        CDBG_ERROR("%s: alloc/map buf %d failed", __func__, i);
+        while (--i >= 0) {
+            ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+            bench_free(&stream->bufs[i]);
+        }
+        free(pBufs);
+        free(reg_flags);
+        return -1;
+    }
+
+    if (reuse) {
+        stream->reuses++;
+    }
+    *num_bufs = stream->num_bufs;
+    *bufs = pBufs;
+    *initial_reg_flag = reg_flags;
+    return 0;
+}
+
+static int32_t bench_put_bufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                              void *user_data)
+{
+    bench_stream_t *stream = (bench_stream_t *)user_data;
+    int i;
+
+    if (stream->keep_bufs) {
+        stream->bufs_kept = 1;
+        return 0;
+    }
+    for (i = 0; i < stream->num_bufs; i++) {
+        ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+        bench_free(&stream->bufs[i]);
+    }
+    return 0;
+}
+
+static bench_stream_t *bench_get_stream(bench_obj_t *obj, uint32_t s_id)
+{
+    int i;
+    for (i = 0; i < obj->num_streams; i++) {
+        if (obj->streams[i].s_id == s_id) {
+            return &obj->streams[i];
+        }
+    }
+    return NULL;
+}
+
+static void bench_account_frame(bench_stream_t *stream,
+                                mm_camera_buf_def_t *frame)
+{
+    if (stream->frames > 0 && frame->frame_idx > stream->last_frame_idx + 1) {
+        stream->drops += frame->frame_idx - stream->last_frame_idx - 1;
+    }
+    stream->last_frame_idx = frame->frame_idx;
+    stream->frames++;
+    bench_lat_add(&stream->cb_lat, bench_age_ms(&frame->ts));
+}
+
+/* called with obj lock held */
+static void bench_account_switch(bench_obj_t *obj)
+{
+    if (!obj->switching && 0 == obj->first_frames++) {
+        clock_gettime(CLOCK_MONOTONIC, &obj->first_ts);
+    }
+}
+
+static void bench_stream_cb(mm_camera_super_buf_t *bufs, void *user_data)
+{
+    bench_obj_t *obj = (bench_obj_t *)user_data;
+    mm_camera_buf_def_t *frame = bufs->bufs[0];
+    bench_stream_t *stream;
+
+    pthread_mutex_lock(&obj->lock);
+    bench_account_switch(obj);
+    stream = bench_get_stream(obj, frame->stream_id);
+    if (NULL != stream) {
+        bench_account_frame(stream, frame);
+    }
+    pthread_mutex_unlock(&obj->lock);
+
+    if (MM_CAMERA_OK != obj->cam->ops->qbuf(bufs->camera_handle, bufs->ch_id, frame)) {
+        CDBG_ERROR("%s: qbuf failed", __func__);
+    }
+}
+
+static void bench_super_buf_cb(mm_camera_super_buf_t *bufs, void *user_data)
+{
+    bench_obj_t *obj = (bench_obj_t *)user_data;
+    bench_stream_t *stream;
+    int i;
+
+    pthread_mutex_lock(&obj->lock);
+    bench_account_switch(obj);
+    obj->super_bufs++;
+    for (i = 0; i < bufs->num_bufs; i++) {
+        stream = bench_get_stream(obj, bufs->bufs[i]->stream_id);
+        if (NULL != stream) {
+            bench_account_frame(stream, bufs->bufs[i]);
+        }
+    }
+    /* latency of the super buf is that of its oldest frame */
+    if (bufs->num_bufs > 0) {
+        double age = 0;
+        for (i = 0; i < bufs->num_bufs; i++) {
+            double a = bench_age_ms(&bufs->bufs[i]->ts);
+            if (a > age) {
+                age = a;
+            }
+        }
+        bench_lat_add(&obj->super_lat, age);
+    }
+    pthread_mutex_unlock(&obj->lock);
+
+    for (i = 0; i < bufs->num_bufs; i++) {
+        if (MM_CAMERA_OK != obj->cam->ops->qbuf(bufs->camera_handle, bufs->ch_id,
+                                                bufs->bufs[i])) {
+            CDBG_ERROR("%s: qbuf failed", __func__);
+        }
+    }
+}
+
+static void bench_fill_config(bench_obj_t *obj, bench_stream_t *stream,
+                              uint8_t bundled, mm_camera_stream_config_t *config)
+{
+    cam_capability_t *cap = (cam_capability_t *)obj->cap_buf.mem_info.data;
+
+    memset(config, 0, sizeof(*config));
+    config->stream_info = stream->info;
+    config->padding_info = cap->padding_info;
+    config->mem_vtbl.get_bufs = bench_get_bufs;
+    config->mem_vtbl.put_bufs = bench_put_bufs;
+    config->mem_vtbl.user_data = stream;
+    /* bundled frames come with super buf */
+    config->stream_cb = bundled ? NULL : bench_stream_cb;
+    config->userdata = obj;
+}
+
+static int bench_add_stream(bench_obj_t *obj, cam_stream_type_t type,
+                            cam_format_t fmt, int width, int height,
+                            uint8_t num_bufs, uint8_t bundled)
+{
+    bench_stream_t *stream = &obj->streams[obj->num_streams];
+    mm_camera_stream_config_t config;
+    int rc;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->type = type;
+    stream->num_bufs = num_bufs;
+    stream->s_id = obj->cam->ops->add_stream(obj->cam->camera_handle, obj->ch_id);
+    if (0 == stream->s_id) {
+        CDBG_ERROR("%s: add stream failed", __func__);
+        return -1;
+    }
+    if (0 != bench_alloc(&stream->info_buf, sizeof(cam_stream_info_t))) {
+        goto error_after_add;
+    }
+    rc = obj->cam->ops->map_stream_buf(obj->cam->camera_handle, obj->ch_id,
+                                       stream->s_id,
+                                       CAM_MAPPING_BUF_TYPE_STREAM_INFO, 0, -1,
+                                       stream->info_buf.mem_info.fd,
+                                       stream->info_buf.mem_info.size);
+    if (MM_CAMERA_OK != rc) {
+        CDBG_ERROR("%s: map stream info failed", __func__);
+        goto error_after_alloc;
+    }
+
+    stream->info = (cam_stream_info_t *)stream->info_buf.mem_info.data;
+    memset(stream->info, 0, sizeof(cam_stream_info_t));
+    stream->info->stream_type = type;
+    stream->info->streaming_mode = CAM_STREAMING_MODE_CONTINUOUS;
+    stream->info->fmt = fmt;
+    stream->info->dim.width = width;
+    stream->info->dim.height = height;
+    if (bundled) {
+        stream->info->bundle_id = obj->ch_id;
+    }
+
+    bench_fill_config(obj, stream, bundled, &config);
+    rc = obj->cam->ops->config_stream(obj->cam->camera_handle, obj->ch_id,
+                                      stream->s_id, &config);
+    if (MM_CAMERA_OK != rc) {
+        CDBG_ERROR("%s: config stream failed", __func__);
+        obj->cam->ops->unmap_stream_buf(obj->cam->camera_handle, obj->ch_id,
+                                        stream->s_id,
+                                        CAM_MAPPING_BUF_TYPE_STREAM_INFO, 0, -1);
+        goto error_after_alloc;
+    }
+    obj->num_streams++;
+    return 0;
+
+error_after_alloc:
+    bench_free(&stream->info_buf);
+error_after_add:
+    obj->cam->ops->delete_stream(obj->cam->camera_handle, obj->ch_id, stream->s_id);
+    stream->s_id = 0;
+    return -1;
+}
+
+static void bench_del_streams(bench_obj_t *obj)
+{
+    bench_stream_t *stream;
+    int i;
+
+    for (i = 0; i < obj->num_streams; i++) {
+        stream = &obj->streams[i];
+        obj->cam->ops->unmap_stream_buf(obj->cam->camera_handle, obj->ch_id,
+                                        stream->s_id,
+                                        CAM_MAPPING_BUF_TYPE_STREAM_INFO, 0, -1);
+        bench_free(&stream->info_buf);
+        obj->cam->ops->delete_stream(obj->cam->camera_handle, obj->ch_id,
+                                     stream->s_id);
+    }
+    obj->num_streams = 0;
+}
+
+static int bench_add_streams(bench_obj_t *obj, int width, int height,
+                             uint8_t num_bufs, uint8_t bundled)
+{
+    if (0 != bench_add_stream(obj, CAM_STREAM_TYPE_PREVIEW, DEFAULT_PREVIEW_FORMAT,
+                              width, height, num_bufs, bundled) ||
+        (bundled &&
+         0 != bench_add_stream(obj, CAM_STREAM_TYPE_VIDEO, DEFAULT_VIDEO_FORMAT,
+                               width, height, num_bufs, 1))) {
+        bench_del_streams(obj);
+        return -1;
+    }
+    return 0;
+}
+
+/* switch preview size, reconfiguring preview stream in place if asked and
+ * possible, else the way HAL did it so far: restart channel with new streams */
+static int bench_switch_size(bench_obj_t *obj, int width, int height,
+                             int in_place, uint8_t bundled)
+{
+    bench_stream_t *stream = &obj->streams[0];
+    uint8_t num_bufs = stream->num_bufs;
+    mm_camera_stream_config_t config;
+    int i, rc = -1;
+
+    if (in_place) {
+        stream->info->dim.width = width;
+        stream->info->dim.height = height;
+        bench_fill_config(obj, stream, bundled, &config);
+        stream->keep_bufs = 1;
+        rc = obj->cam->ops->reconfig_stream(obj->cam->camera_handle, obj->ch_id,
+                                            stream->s_id, &config);
+        stream->keep_bufs = 0;
+        if (stream->bufs_kept) {
+            for (i = 0; i < stream->num_bufs; i++) {
+                obj->cam->ops->unmap_stream_buf(obj->cam->camera_handle,
+                                                obj->ch_id, stream->s_id,
+                                                CAM_MAPPING_BUF_TYPE_STREAM_BUF,
+                                                i, -1);
+                bench_free(&stream->bufs[i]);
+            }
+            stream->bufs_kept = 0;
+        }
+        if (MM_CAMERA_OK == rc) {
+            return 0;
+        }
+        obj->switch_fails++;
+    }
+
+    obj->cam->ops->stop_channel(obj->cam->camera_handle, obj->ch_id);
+    bench_del_streams(obj);
+    if (0 != bench_add_streams(obj, width, height, num_bufs, bundled)) {
+        return -1;
+    }
+    return obj->cam->ops->start_channel(obj->cam->camera_handle, obj->ch_id);
+}
+
+/* alternate preview between given size and 16:9 of same width */
+static int bench_run_switch(bench_obj_t *obj, int seconds, int count,
+                            int in_place, int width, int height,
+                            uint8_t bundled)
+{
+    useconds_t period_us = (useconds_t)(seconds * 1000000LL / (count + 1));
+    struct timespec t0, t1, first;
+    uint32_t frames;
+    int n, wait_ms, h;
+
+    for (n = 0; n < count; n++) {
+        usleep(period_us);
+        h = (0 == n % 2) ? (width * 9 / 16) & ~1 : height;
+
+        pthread_mutex_lock(&obj->lock);
+        obj->switching = 1;
+        pthread_mutex_unlock(&obj->lock);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (0 != bench_switch_size(obj, width, h, in_place, bundled)) {
+            CDBG_ERROR("%s: switch to %dx%d failed", __func__, width, h);
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        /* frames from here on are of new size */
+        pthread_mutex_lock(&obj->lock);
+        obj->switching = 0;
+        obj->first_frames = 0;
+        pthread_mutex_unlock(&obj->lock);
+
+        for (wait_ms = 0; wait_ms < 1000; wait_ms++) {
+            pthread_mutex_lock(&obj->lock);
+            frames = obj->first_frames;
+            first = obj->first_ts;
+            pthread_mutex_unlock(&obj->lock);
+            if (frames > 0) {
+                break;
+            }
+            usleep(1000);
+        }
+        bench_lat_add(&obj->switch_call_lat, bench_diff_us(&t0, &t1) / 1000.0);
+        if (frames > 0) {
+            bench_lat_add(&obj->switch_lat, bench_diff_us(&t0, &first) / 1000.0);
+        }
+    }
+    usleep(period_us);
+    return 0;
+}
+
+/* touch AF/AE at a moving point, as the HAL sends for a tap to focus */
+static void bench_run_parms(bench_obj_t *obj, int seconds, int rate,
+                            int width, int height)
+{
+    parm_buffer_t *p_table = (parm_buffer_t *)obj->parm_buf.mem_info.data;
+    cam_roi_info_t af_roi;
+    cam_set_aec_roi_t aec_roi;
+    struct timespec next, t0, t1, t2;
+    uint32_t n, total = (uint32_t)(seconds * rate);
+    long period_ns = 1000000000L / rate;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (n = 0; n < total; n++) {
+        int32_t x = (int32_t)((n * 37) % (uint32_t)width);
+        int32_t y = (int32_t)((n * 53) % (uint32_t)height);
+
+        memset(&af_roi, 0, sizeof(af_roi));
+        af_roi.frm_id = n;
+        af_roi.num_roi = 1;
+        af_roi.roi[0].left = x;
+        af_roi.roi[0].top = y;
+        af_roi.roi[0].width = width / 10;
+        af_roi.roi[0].height = height / 10;
+        memset(&aec_roi, 0, sizeof(aec_roi));
+        aec_roi.aec_roi_enable = CAM_AEC_ROI_ON;
+        aec_roi.aec_roi_type = CAM_AEC_ROI_BY_COORDINATE;
+        aec_roi.cam_aec_roi_position.coordinate.x = (uint32_t)x;
+        aec_roi.cam_aec_roi_position.coordinate.y = (uint32_t)y;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        cam_parm_batch_init(p_table);
+        cam_parm_batch_set(p_table, CAM_INTF_PARM_AF_ROI, sizeof(af_roi), &af_roi);
+        cam_parm_batch_set(p_table, CAM_INTF_PARM_AEC_ROI, sizeof(aec_roi), &aec_roi);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (MM_CAMERA_OK != obj->cam->ops->set_parms(obj->cam->camera_handle, p_table)) {
+            obj->parm_fails++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        bench_lat_add(&obj->parm_enc_lat, bench_diff_us(&t0, &t1));
+        bench_lat_add(&obj->parm_set_lat, bench_diff_us(&t1, &t2));
+
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+}
+
+static double bench_cpu_ms(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+typedef struct {
+    struct timespec enq_ts[BENCH_MAX_SAMPLES]; /* by frame_idx */
+    bench_lat_t enq_lat;        /* time spent in enqueue, in us */
+    bench_lat_t dispatch_lat;   /* enqueue to cmd thread cb, in us */
+} bench_queue_t;
+
+static void bench_queue_cb(mm_camera_cmdcb_t *cmd_cb, void *user_data)
+{
+    bench_queue_t *q = (bench_queue_t *)user_data;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bench_lat_add(&q->dispatch_lat,
+                  bench_diff_us(&q->enq_ts[cmd_cb->u.buf.frame_idx], &now));
+}
+
+/* one producer feeds a cmd thread at given rate, as poll thread does
+ * with frames of a stream */
+static int bench_run_queue(mm_camera_cmd_queue_type_t type, int seconds,
+                           int rate)
+{
+    static bench_queue_t q;
+    mm_camera_cmd_thread_t cmd_thread;
+    mm_camera_cmdcb_t *node;
+    struct timespec next, t1;
+    uint32_t n, total = (uint32_t)(seconds * rate), overflows;
+    long period_ns = 1000000000L / rate;
+    double cpu_ms;
+
+    if (total > BENCH_MAX_SAMPLES) {
+        total = BENCH_MAX_SAMPLES;
+    }
+    memset(&q, 0, sizeof(q));
+    memset(&cmd_thread, 0, sizeof(cmd_thread));
+    mm_camera_cmd_thread_launch(&cmd_thread, bench_queue_cb, &q,
+                                MM_CAMERA_CMD_POOL_DEPTH_DATA, type);
+
+    cpu_ms = bench_cpu_ms();
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (n = 0; n < total; n++) {
+        node = mm_camera_cmd_thread_alloc_cmd(&cmd_thread);
+        if (NULL == node) {
+            break;
+        }
+        node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
+        node->u.buf.frame_idx = n;
+        clock_gettime(CLOCK_MONOTONIC, &q.enq_ts[n]);
+        if (0 != mm_camera_cmd_thread_enqueue(&cmd_thread, node)) {
+            mm_camera_cmd_thread_free_cmd(&cmd_thread, node);
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        bench_lat_add(&q.enq_lat, bench_diff_us(&q.enq_ts[n], &t1));
+
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    /* cmds still queued are dispatched before exit cmd */
+    overflows = cmd_thread.cmd_pool.overflow_cnt;
+    mm_camera_cmd_thread_release(&cmd_thread);
+    cpu_ms = bench_cpu_ms() - cpu_ms;
+
+    printf("%s cmd queue, %u cmds at %d/s\n",
+           MM_CAMERA_CMD_QUEUE_TYPE_SPSC == type ? "spsc" : "list", n, rate);
+    bench_lat_print("enqueue", &q.enq_lat, "us");
+    bench_lat_print("enqueue->dispatch", &q.dispatch_lat, "us");
+    printf(" pool overflows: %u, cpu: %.1f ms total, %.3f us per cmd\n",
+           overflows, cpu_ms, n > 0 ? cpu_ms * 1000.0 / n : 0.0);
+    return (n == total && q.dispatch_lat.cnt == total) ? 0 : -1;
+}
+
+typedef struct {
+    int32_t fds[2];             /* read end is polled */
+    struct timespec signal_ts;
+    struct bench_poll *poll;
+} bench_poll_fd_t;
+
+/* poll() loop of the poll thread before epoll, as baseline: slot 0 is the
+ * stop pipe, fds are scanned after each wake */
+typedef struct {
+    pthread_t pid;
+    int32_t stop_fds[2];
+    struct pollfd poll_fds[MAX_STREAM_NUM_IN_BUNDLE + 1];
+    bench_poll_fd_t *entries[MAX_STREAM_NUM_IN_BUNDLE];
+    int num_fds;
+} bench_poll_base_t;
+
+typedef struct bench_poll {
+    bench_poll_fd_t fds[BENCH_MAX_POLL_FDS];
+    mm_camera_poll_thread_t threads[BENCH_MAX_POLL_FDS / MAX_STREAM_NUM_IN_BUNDLE];
+    bench_poll_base_t base_threads[BENCH_MAX_POLL_FDS / MAX_STREAM_NUM_IN_BUNDLE];
+    pthread_mutex_t lock;       /* notify comes from all poll threads */
+    uint32_t wakes;
+    bench_lat_t wake_lat;       /* signal to notify, in us */
+} bench_poll_t;
+
+static void bench_poll_notify(void *user_data)
+{
+    bench_poll_fd_t *pfd = (bench_poll_fd_t *)user_data;
+    struct timespec now;
+    char val;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    /* fds are level triggered, consume the signal as dqbuf would */
+    if (read(pfd->fds[0], &val, sizeof(val)) != sizeof(val)) {
+        return;
+    }
+    pthread_mutex_lock(&pfd->poll->lock);
+    pfd->poll->wakes++;
+    bench_lat_add(&pfd->poll->wake_lat, bench_diff_us(&pfd->signal_ts, &now));
+    pthread_mutex_unlock(&pfd->poll->lock);
+}
+
+static void *bench_poll_base_fn(void *data)
+{
+    bench_poll_base_t *t = (bench_poll_base_t *)data;
+    int i, rc;
+
+    for (;;) {
+        for (i = 0; i < t->num_fds; i++) {
+            t->poll_fds[i].events = POLLIN|POLLRDNORM|POLLPRI;
+        }
+        rc = poll(t->poll_fds, t->num_fds, -1);
+        if (rc <= 0) {
+            usleep(10);
+            continue;
+        }
+        if (t->poll_fds[0].revents & POLLIN) {
+            break;
+        }
+        for (i = 1; i < t->num_fds; i++) {
+            if ((t->poll_fds[i].revents & POLLIN) &&
+                (t->poll_fds[i].revents & POLLRDNORM)) {
+                bench_poll_notify(t->entries[i - 1]);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int bench_poll_base_launch(bench_poll_base_t *t)
+{
+    memset(t, 0, sizeof(*t));
+    if (0 != pipe(t->stop_fds)) {
+        return -1;
+    }
+    t->poll_fds[0].fd = t->stop_fds[0];
+    t->num_fds = 1;
+    return 0;
+}
+
+static int bench_poll_base_start(bench_poll_base_t *t)
+{
+    return pthread_create(&t->pid, NULL, bench_poll_base_fn, t);
+}
+
+static void bench_poll_base_release(bench_poll_base_t *t)
+{
+    char one = 1;
+
+    if (0 != t->pid) {
+        if (write(t->stop_fds[1], &one, sizeof(one)) == sizeof(one)) {
+            pthread_join(t->pid, NULL);
+        }
+    }
+    close(t->stop_fds[0]);
+    close(t->stop_fds[1]);
+}
+
+/* many synthetic stream fds, signaled one after another as frames of
+ * streams running at BENCH_POLL_FD_FPS each would be. With baseline set,
+ * they are polled by bench_poll_base_fn threads instead of epoll based
+ * data poll threads */
+static int bench_run_poll(int nfds, int seconds, int baseline)
+{
+    static bench_poll_t p;
+    char one = 1;
+    int nthreads = (nfds + MAX_STREAM_NUM_IN_BUNDLE - 1) / MAX_STREAM_NUM_IN_BUNDLE;
+    uint32_t n, total, signals = 0;
+    long period_ns;
+    struct timespec next, start, end;
+    double cpu_ms, wall_ms;
+    int i, launched = 0, rc = -1;
+
+    if (nfds <= 0 || nfds > BENCH_MAX_POLL_FDS) {
+        CDBG_ERROR("%s: num of fds %d out of range\n", __func__, nfds);
+        return -1;
+    }
+    memset(&p, 0, sizeof(p));
+    pthread_mutex_init(&p.lock, NULL);
+    for (i = 0; i < nfds; i++) {
+        p.fds[i].fds[0] = p.fds[i].fds[1] = -1;
+    }
+    for (launched = 0; launched < nthreads; launched++) {
+        if (baseline) {
+            rc = bench_poll_base_launch(&p.base_threads[launched]);
+        } else {
+            rc = mm_camera_poll_thread_launch(&p.threads[launched],
+                                              MM_CAMERA_POLL_TYPE_DATA);
+        }
+        if (0 != rc) {
+            rc = -1;
+            goto release;
+        }
+    }
+    rc = -1;
+    for (i = 0; i < nfds; i++) {
+        p.fds[i].poll = &p;
+        if (baseline) {
+            bench_poll_base_t *t = &p.base_threads[i / MAX_STREAM_NUM_IN_BUNDLE];
+            if (0 != pipe(p.fds[i].fds)) {
+                CDBG_ERROR("%s: add fd %d failed\n", __func__, i);
+                goto release;
+            }
+            t->poll_fds[t->num_fds].fd = p.fds[i].fds[0];
+            t->entries[t->num_fds - 1] = &p.fds[i];
+            t->num_fds++;
+            continue;
+        }
+        /* pipe reports EPOLLIN | EPOLLRDNORM when readable, as v4l2 does.
+         * index within thread goes in low bits of handler, as for streams */
+        if (0 != pipe(p.fds[i].fds) ||
+            0 != mm_camera_poll_thread_add_poll_fd(
+                     &p.threads[i / MAX_STREAM_NUM_IN_BUNDLE],
+                     mm_camera_util_generate_handler(
+                         (uint8_t)(i % MAX_STREAM_NUM_IN_BUNDLE)),
+                     p.fds[i].fds[0], bench_poll_notify, &p.fds[i])) {
+            CDBG_ERROR("%s: add fd %d failed\n", __func__, i);
+            goto release;
+        }
+    }
+
+    for (i = 0; baseline && i < nthreads; i++) {
+        if (0 != bench_poll_base_start(&p.base_threads[i])) {
+            CDBG_ERROR("%s: start poll thread %d failed\n", __func__, i);
+            goto release;
+        }
+    }
+
+    total = (uint32_t)(seconds * nfds * BENCH_POLL_FD_FPS);
+    period_ns = 1000000000L / (nfds * BENCH_POLL_FD_FPS);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    cpu_ms = bench_cpu_ms();
+    next = start;
+    for (n = 0; n < total; n++) {
+        bench_poll_fd_t *pfd = &p.fds[n % nfds];
+        clock_gettime(CLOCK_MONOTONIC, &pfd->signal_ts);
+        if (write(pfd->fds[1], &one, sizeof(one)) == sizeof(one)) {
+            signals++;
+        }
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    cpu_ms = bench_cpu_ms() - cpu_ms;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    wall_ms = bench_diff_us(&start, &end) / 1000.0;
+
+    pthread_mutex_lock(&p.lock);
+    printf("%s %d fds on %d data poll threads, %d/s each, %.1f s\n",
+           baseline ? "poll()" : "epoll", nfds, nthreads,
+           BENCH_POLL_FD_FPS, wall_ms / 1000.0);
+    printf(" signals: %u, wakes: %u\n", signals, p.wakes);
+    bench_lat_print("signal->notify", &p.wake_lat, "us");
+    printf(" cpu: %.1f ms total, %.1f%% of one core, %.3f us per wake\n",
+           cpu_ms, cpu_ms * 100.0 / wall_ms,
+           p.wakes > 0 ? cpu_ms * 1000.0 / p.wakes : 0.0);
+    pthread_mutex_unlock(&p.lock);
+    rc = 0;
+
+release:
+    for (i = 0; i < launched; i++) {
+        if (baseline) {
+            bench_poll_base_release(&p.base_threads[i]);
+        } else {
+            mm_camera_poll_thread_release(&p.threads[i]);
+        }
+    }
+    for (i = 0; i < nfds; i++) {
+        if (p.fds[i].fds[0] >= 0) {
+            close(p.fds[i].fds[0]);
+            close(p.fds[i].fds[1]);
+        }
+    }
+    pthread_mutex_destroy(&p.lock);
+    return rc;
+}
+
+static void bench_usage(const char *name)
+{
+    printf("usage: %s [-s] [-b] [-c cam] [-t sec] [-w width] [-h height] [-n bufs] [-p rate] [-r|-R n] [-q rate] [-e nfds]\n", name);
+    printf("-s:   use simulated camera backend\n");
+    printf("-b:   bundle a video stream with preview, frames come as super buf\n");
+    printf("-c:   camera index (0)\n");
+    printf("-t:   seconds to stream (10)\n");
+    printf("-w/-h: stream dimension (%dx%d)\n", DEFAULT_PREVIEW_WIDTH, DEFAULT_PREVIEW_HEIGHT);
+    printf("-n:   buffers per stream (%d)\n", PREVIEW_BUF_NUM);
+    printf("-p:   send touch AF/AE parameter updates at this rate per second\n");
+    printf("-r:   switch preview size n times, reconfiguring stream in place\n");
+    printf("-R:   switch preview size n times, restarting channel\n");
+    printf("-q:   no camera, enqueue cmds into cmd thread queues at this rate per second (240)\n");
+    printf("-e:   no camera, poll this many pipes signaled at %d/s each with epoll, then poll() (max %d)\n",
+           BENCH_POLL_FD_FPS, BENCH_MAX_POLL_FDS);
+}
+
+int main(int argc, char **argv)
+{
+    static bench_obj_t obj;
+    mm_camera_channel_attr_t attr;
+    int cam_idx = 0, seconds = 10, bundled = 0;
+    int width = DEFAULT_PREVIEW_WIDTH, height = DEFAULT_PREVIEW_HEIGHT;
+    int num_bufs = PREVIEW_BUF_NUM, parm_rate = 0;
+    int switch_count = 0, switch_in_place = 0, queue_rate = 0, poll_fds = 0;
+    struct timespec start, streaming, end;
+    double cpu_ms, wall_ms, start_ms;
+    uint32_t total_frames = 0;
+    int i, c, rc = -1;
+
+    while ((c = getopt(argc, argv, "sbc:t:w:h:n:p:r:R:q:e:")) != -1) {
+        switch (c) {
+        case 's':
+            setenv("MM_CAMERA_BACKEND", "sim", 1);
+            break;
+        case 'b':
+            bundled = 1;
+            break;
+        case 'c':
+            cam_idx = atoi(optarg);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'w':
+            width = atoi(optarg);
+            break;
+        case 'h':
+            height = atoi(optarg);
+            break;
+        case 'n':
+            num_bufs = atoi(optarg);
+            break;
+        case 'p':
+            parm_rate = atoi(optarg);
+            break;
+        case 'r':
+        case 'R':
+            switch_count = atoi(optarg);
+            switch_in_place = ('r' == c);
+            break;
+        case 'q':
+            queue_rate = atoi(optarg);
+            if (queue_rate <= 0) {
+                queue_rate = 240;
+            }
+            break;
+        case 'e':
+            poll_fds = atoi(optarg);
+            break;
+        default:
+            bench_usage(argv[0]);
+            return 0;
+        }
+    }
+    if (num_bufs <= 0 || num_bufs > MM_CAMERA_MAX_NUM_FRAMES) {
+        num_bufs = PREVIEW_BUF_NUM;
+    }
+    if (queue_rate > 0) {
+        rc = bench_run_queue(MM_CAMERA_CMD_QUEUE_TYPE_SPSC, seconds, queue_rate);
+        if (0 == rc) {
+            rc = bench_run_queue(MM_CAMERA_CMD_QUEUE_TYPE_LIST, seconds, queue_rate);
+        }
+        return rc;
+    }
+    if (poll_fds > 0) {
+        rc = bench_run_poll(poll_fds, seconds, 0);
+        if (0 == rc) {
+            rc = bench_run_poll(poll_fds, seconds, 1);
+        }
+        return rc;
+    }
+
+    memset(&obj, 0, sizeof(obj));
+    pthread_mutex_init(&obj.lock, NULL);
+    if (cam_idx >= get_num_of_cameras()) {
+        CDBG_ERROR("%s: no camera %d\n", __func__, cam_idx);
+        return -1;
+    }
+    obj.cam = camera_open((uint8_t)cam_idx);
+    if (NULL == obj.cam) {
+        CDBG_ERROR("%s: camera_open failed\n", __func__);
+        return -1;
+    }
+
+    if (0 != bench_alloc(&obj.cap_buf, sizeof(cam_capability_t)) ||
+        MM_CAMERA_OK != obj.cam->ops->map_buf(obj.cam->camera_handle,
+                                              CAM_MAPPING_BUF_TYPE_CAPABILITY,
+                                              obj.cap_buf.mem_info.fd,
+                                              obj.cap_buf.mem_info.size) ||
+        MM_CAMERA_OK != obj.cam->ops->query_capability(obj.cam->camera_handle)) {
+        CDBG_ERROR("%s: query capability failed\n", __func__);
+        goto close_camera;
+    }
+    if (parm_rate > 0 &&
+        (0 != bench_alloc(&obj.parm_buf, sizeof(parm_buffer_t)) ||
+         MM_CAMERA_OK != obj.cam->ops->map_buf(obj.cam->camera_handle,
+                                               CAM_MAPPING_BUF_TYPE_PARM_BUF,
+                                               obj.parm_buf.mem_info.fd,
+                                               obj.parm_buf.mem_info.size))) {
+        CDBG_ERROR("%s: map parm buf failed\n", __func__);
+        goto close_camera;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.notify_mode = MM_CAMERA_SUPER_BUF_NOTIFY_CONTINUOUS;
+    attr.water_mark = 1;
+    obj.ch_id = obj.cam->ops->add_channel(obj.cam->camera_handle,
+                                          bundled ? &attr : NULL,
+                                          bundled ? bench_super_buf_cb : NULL,
+                                          &obj);
+    if (0 == obj.ch_id) {
+        CDBG_ERROR("%s: add channel failed\n", __func__);
+        goto close_camera;
+    }
+
+    if (0 != bench_add_streams(&obj, width, height, (uint8_t)num_bufs,
+                               (uint8_t)bundled)) {
+        goto del_channel;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    cpu_ms = bench_cpu_ms();
+    if (MM_CAMERA_OK != obj.cam->ops->start_channel(obj.cam->camera_handle, obj.ch_id)) {
+        CDBG_ERROR("%s: start channel failed\n", __func__);
+        goto del_streams;
+    }
+    /* buffers are allocated, mapped and queued within start_channel */
+    clock_gettime(CLOCK_MONOTONIC, &streaming);
+    start_ms = (double)(streaming.tv_sec - start.tv_sec) * 1000.0 +
+               (double)(streaming.tv_nsec - start.tv_nsec) / 1000000.0;
+    if (switch_count > 0) {
+        if (0 != bench_run_switch(&obj, seconds, switch_count, switch_in_place,
+                                  width, height, (uint8_t)bundled)) {
+            goto del_streams;
+        }
+    } else if (parm_rate > 0) {
+        bench_run_parms(&obj, seconds, parm_rate, width, height);
+    } else {
+        sleep((unsigned int)seconds);
+    }
+    obj.cam->ops->stop_channel(obj.cam->camera_handle, obj.ch_id);
+    cpu_ms = bench_cpu_ms() - cpu_ms;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    wall_ms = (double)(end.tv_sec - start.tv_sec) * 1000.0 +
+              (double)(end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+    printf("%s channel, %dx%d, %d bufs, %.1f s\n",
+           bundled ? "bundled preview+video" : "preview",
+           width, height, num_bufs, wall_ms / 1000.0);
+    printf(" start_channel: %.3f ms\n", start_ms);
+    for (i = 0; i < obj.num_streams; i++) {
+        bench_stream_t *stream = &obj.streams[i];
+        char name[32];
+        total_frames += stream->frames;
+        printf(" stream %d (type %d): %u frames, %.2f fps, %u dropped\n",
+               i, stream->type, stream->frames,
+               stream->frames * 1000.0 / wall_ms, stream->drops);
+        snprintf(name, sizeof(name), "ts->%s cb", bundled ? "super buf" : "stream");
+        bench_lat_print(name, &stream->cb_lat, "ms");
+    }
+    if (bundled) {
+        printf(" super bufs: %u\n", obj.super_bufs);
+        bench_lat_print("ts->super buf (oldest)", &obj.super_lat, "ms");
+    }
+    if (parm_rate > 0) {
+        printf(" parm updates: %u at %d/s, %u failed, batch %u bytes\n",
+               obj.parm_enc_lat.cnt, parm_rate, obj.parm_fails,
+               cam_parm_batch_size((parm_buffer_t *)obj.parm_buf.mem_info.data));
+        bench_lat_print("encode", &obj.parm_enc_lat, "us");
+        bench_lat_print("set_parms", &obj.parm_set_lat, "us");
+    }
+    if (switch_count > 0) {
+        printf(" size switches: %u by %s, %u fell back to restart, %u reused bufs\n",
+               obj.switch_call_lat.cnt,
+               switch_in_place ? "reconfig" : "restart",
+               obj.switch_fails, obj.streams[0].reuses);
+        bench_lat_print("switch->first frame", &obj.switch_lat, "ms");
+        bench_lat_print("switch call", &obj.switch_call_lat, "ms");
+    }
+    printf(" cpu: %.1f ms total, %.1f%% of one core, %.3f ms per frame\n",
+           cpu_ms, cpu_ms * 100.0 / wall_ms,
+           total_frames > 0 ? cpu_ms / total_frames : 0.0);
+    rc = 0;
+
+del_streams:
+    bench_del_streams(&obj);
+del_channel:
+    obj.cam->ops->delete_channel(obj.cam->camera_handle, obj.ch_id);
+close_camera:
+    if (NULL != obj.parm_buf.mem_info.data) {
+        obj.cam->ops->unmap_buf(obj.cam->camera_handle, CAM_MAPPING_BUF_TYPE_PARM_BUF);
+        bench_free(&obj.parm_buf);
+    }
+    if (NULL != obj.cap_buf.mem_info.data) {
+        obj.cam->ops->unmap_buf(obj.cam->camera_handle, CAM_MAPPING_BUF_TYPE_CAPABILITY);
+        bench_free(&obj.cap_buf);
+    }
+    obj.cam->ops->close_camera(obj.cam->camera_handle);
+    return rc;
+}
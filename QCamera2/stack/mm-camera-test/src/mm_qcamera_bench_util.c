@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of Code Aurora Forum, Inc. nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mm_qcamera_bench_util.h"
+
+double bench_diff_us(const struct timespec *from, const struct timespec *to)
+{
+    return (double)(to->tv_sec - from->tv_sec) * 1000000.0 +
+           (double)(to->tv_nsec - from->tv_nsec) / 1000.0;
+}
+
+void bench_lat_add(bench_lat_t *lat, double val)
+{
+    if (lat->cnt < BENCH_MAX_SAMPLES) {
+        lat->samples[lat->cnt++] = val;
+    }
+}
+
+static int bench_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void bench_lat_print(const char *name, bench_lat_t *lat, const char *unit)
+{
+    double sum = 0;
+    uint32_t i;
+
+    if (0 == lat->cnt) {
+        printf("  %-22s no samples\n", name);
+        return;
+    }
+    qsort(lat->samples, lat->cnt, sizeof(double), bench_cmp_double);
+    for (i = 0; i < lat->cnt; i++) {
+        sum += lat->samples[i];
+    }
+    printf("  %-22s n=%-6u mean %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f %s\n",
+           name, lat->cnt, sum / lat->cnt,
+           lat->samples[lat->cnt / 2],
+           lat->samples[(lat->cnt * 90) / 100],
+           lat->samples[(lat->cnt * 99) / 100],
+           lat->samples[lat->cnt - 1], unit);
+}
@@ -0,0 +1,521 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* API call rate benchmark of the camera HAL under frame load. Loads the
+ * HAL module, opens a camera and runs preview into a window backed by
+ * gralloc buffers that are "displayed" right away. Once preview runs, a
+ * number of threads call camera_device ops as fast as they can for a fixed
+ * time while frames keep flowing, and calls per second, call latency and
+ * preview frame rate before and during the calls are reported. By default
+ * the read only queries (msg_type_enabled, preview_enabled,
+ * recording_enabled) are called; with -g get_parameters/put_parameters are
+ * called instead, which go through the state machine thread. Meant to be
+ * run with the simulated backend (-s) so it needs no sensor. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <cutils/properties.h>
+#include <hardware/camera.h>
+#include <hardware/gralloc.h>
+
+#include "mm_qcamera_dbg.h"
+#include "mm_qcamera_bench_util.h"
+
+#define HAL_BENCH_MAX_THREADS   8
+#define HAL_BENCH_SAMPLE_EVERY  64      /* calls per latency sample */
+#define HAL_BENCH_MAX_BUFS      16
+#define HAL_BENCH_MIN_UNDEQUEUED 1
+#define HAL_BENCH_WARMUP_SEC    2
+
+/* preview window, buffers queued for display come back right away */
+typedef struct {
+    preview_stream_ops_t ops;   /* must be first */
+    alloc_device_t *alloc_dev;
+    pthread_mutex_t lock;
+    int width;
+    int height;
+    int format;
+    int usage;
+    int count;
+    int num_bufs;               /* allocated so far */
+    buffer_handle_t bufs[HAL_BENCH_MAX_BUFS];
+    int stride;
+    buffer_handle_t *fifo[HAL_BENCH_MAX_BUFS]; /* owned by window */
+    int fifo_head;
+    int fifo_cnt;
+    uint32_t frames;            /* buffers enqueued for display */
+} hal_bench_window_t;
+
+typedef struct {
+    camera_memory_t mem;        /* must be first */
+    size_t len;
+    int mapped;
+} hal_bench_mem_t;
+
+typedef struct {
+    pthread_t pid;
+    camera_device_t *dev;
+    int round_trip;
+    volatile int *running;
+    uint32_t calls;
+    uint32_t wrong;             /* queries not matching preview running */
+    bench_lat_t lat;            /* in us */
+} hal_bench_thread_t;
+
+/* ------------------------------------------------------------------------
+ * memory and preview window given to HAL
+ * ----------------------------------------------------------------------*/
+static void hal_bench_release_mem(camera_memory_t *mem)
+{
+    hal_bench_mem_t *bench_mem = (hal_bench_mem_t *)mem;
+
+    if (NULL == bench_mem) {
+        return;
+    }
+    if (bench_mem->mapped) {
+        munmap(bench_mem->mem.data, bench_mem->len);
+    } else {
+        free(bench_mem->mem.data);
+    }
+    free(bench_mem);
+}
+
+static camera_memory_t *hal_bench_get_mem(int fd, size_t buf_size,
+                                          unsigned int num_bufs,
+                                          void *user)
+{
+    hal_bench_mem_t *bench_mem;
+
+    bench_mem = (hal_bench_mem_t *)calloc(1, sizeof(hal_bench_mem_t));
+    if (NULL == bench_mem) {
+        return NULL;
+    }
+    bench_mem->len = buf_size * num_bufs;
+    if (fd >= 0) {
+        bench_mem->mem.data = mmap(NULL, bench_mem->len,
+                                   PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == bench_mem->mem.data) {
+            free(bench_mem);
+            return NULL;
+        }
+        bench_mem->mapped = 1;
+    } else {
+        bench_mem->mem.data = malloc(bench_mem->len);
+        if (NULL == bench_mem->mem.data) {
+            free(bench_mem);
+            return NULL;
+        }
+    }
+    bench_mem->mem.size = bench_mem->len;
+    bench_mem->mem.handle = bench_mem;
+    bench_mem->mem.release = hal_bench_release_mem;
+    return &bench_mem->mem;
+}
+
+static void hal_bench_notify_cb(int32_t msg_type, int32_t ext1,
+                                int32_t ext2, void *user)
+{
+}
+
+static void hal_bench_data_cb(int32_t msg_type,
+                              const camera_memory_t *data,
+                              unsigned int index,
+                              camera_frame_metadata_t *metadata,
+                              void *user)
+{
+}
+
+static void hal_bench_data_ts_cb(nsecs_t timestamp,
+                                 int32_t msg_type,
+                                 const camera_memory_t *data,
+                                 unsigned int index,
+                                 void *user)
+{
+}
+
+static int hal_bench_dequeue_buffer(struct preview_stream_ops *w,
+                                    buffer_handle_t **buffer, int *stride)
+{
+    hal_bench_window_t *win = (hal_bench_window_t *)w;
+    int rc = 0;
+
+    pthread_mutex_lock(&win->lock);
+    if (win->num_bufs < win->count) {
+        /* buffers are allocated as HAL first dequeues them */
+        rc = win->alloc_dev->alloc(win->alloc_dev, win->width, win->height,
+                                   win->format, win->usage,
+                                   &win->bufs[win->num_bufs], &win->stride);
+        if (0 == rc) {
+            *buffer = &win->bufs[win->num_bufs++];
+        }
+    } else if (win->fifo_cnt > HAL_BENCH_MIN_UNDEQUEUED) {
+        *buffer = win->fifo[win->fifo_head];
+        win->fifo_head = (win->fifo_head + 1) % HAL_BENCH_MAX_BUFS;
+        win->fifo_cnt--;
+    } else {
+        rc = -1;
+    }
+    *stride = win->stride;
+    pthread_mutex_unlock(&win->lock);
+    return rc;
+}
+
+static void hal_bench_put_buffer(hal_bench_window_t *win, buffer_handle_t *buffer)
+{
+    win->fifo[(win->fifo_head + win->fifo_cnt) % HAL_BENCH_MAX_BUFS] = buffer;
+    win->fifo_cnt++;
+}
+
+static int hal_bench_enqueue_buffer(struct preview_stream_ops *w,
+                                    buffer_handle_t *buffer)
+{
+    hal_bench_window_t *win = (hal_bench_window_t *)w;
+
+    pthread_mutex_lock(&win->lock);
+    hal_bench_put_buffer(win, buffer);
+    win->frames++;
+    pthread_mutex_unlock(&win->lock);
+    return 0;
+}
+
+static int hal_bench_cancel_buffer(struct preview_stream_ops *w,
+                                   buffer_handle_t *buffer)
+{
+    hal_bench_window_t *win = (hal_bench_window_t *)w;
+
+    pthread_mutex_lock(&win->lock);
+    hal_bench_put_buffer(win, buffer);
+    pthread_mutex_unlock(&win->lock);
+    return 0;
+}
+
+static int hal_bench_set_buffer_count(struct preview_stream_ops *w, int count)
+{
+    hal_bench_window_t *win = (hal_bench_window_t *)w;
+
+    if (count > HAL_BENCH_MAX_BUFS) {
+        return -1;
+    }
+    win->count = count;
+    return 0;
+}
+
+static int hal_bench_set_buffers_geometry(struct preview_stream_ops *w,
+                                          int width, int height, int format)
+{
+    hal_bench_window_t *win = (hal_bench_window_t *)w;
+
+    win->width = width;
+    win->height = height;
+    win->format = format;
+    return 0;
+}
+
+static int hal_bench_set_crop(struct preview_stream_ops *w,
+                              int left, int top,
+                              int right, int bottom)
+{
+    return 0;
+}
+
+static int hal_bench_set_usage(struct preview_stream_ops *w, int usage)
+{
+    hal_bench_window_t *win = (hal_bench_window_t *)w;
+
+    win->usage = usage | GRALLOC_USAGE_HW_CAMERA_WRITE;
+    return 0;
+}
+
+static int hal_bench_set_swap_interval(struct preview_stream_ops *w,
+                                       int interval)
+{
+    return 0;
+}
+
+static int hal_bench_get_min_undequeued(const struct preview_stream_ops *w,
+                                        int *count)
+{
+    *count = HAL_BENCH_MIN_UNDEQUEUED;
+    return 0;
+}
+
+static int hal_bench_lock_buffer(struct preview_stream_ops *w,
+                                 buffer_handle_t *buffer)
+{
+    return 0;
+}
+
+static int hal_bench_set_timestamp(struct preview_stream_ops *w,
+                                   int64_t timestamp)
+{
+    return 0;
+}
+
+static int hal_bench_window_init(hal_bench_window_t *win)
+{
+    const hw_module_t *module = NULL;
+
+    memset(win, 0, sizeof(*win));
+    if (0 != hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module) ||
+        0 != gralloc_open(module, &win->alloc_dev)) {
+        CDBG_ERROR("%s: cannot open gralloc\n", __func__);
+        return -1;
+    }
+    pthread_mutex_init(&win->lock, NULL);
+    win->ops.dequeue_buffer = hal_bench_dequeue_buffer;
+    win->ops.enqueue_buffer = hal_bench_enqueue_buffer;
+    win->ops.cancel_buffer = hal_bench_cancel_buffer;
+    win->ops.set_buffer_count = hal_bench_set_buffer_count;
+    win->ops.set_buffers_geometry = hal_bench_set_buffers_geometry;
+    win->ops.set_crop = hal_bench_set_crop;
+    win->ops.set_usage = hal_bench_set_usage;
+    win->ops.set_swap_interval = hal_bench_set_swap_interval;
+    win->ops.get_min_undequeued_buffer_count = hal_bench_get_min_undequeued;
+    win->ops.lock_buffer = hal_bench_lock_buffer;
+    win->ops.set_timestamp = hal_bench_set_timestamp;
+    return 0;
+}
+
+/* only after preview is stopped, HAL has cancelled all buffers by then */
+static void hal_bench_window_deinit(hal_bench_window_t *win)
+{
+    int i;
+
+    for (i = 0; i < win->num_bufs; i++) {
+        win->alloc_dev->free(win->alloc_dev, win->bufs[i]);
+    }
+    gralloc_close(win->alloc_dev);
+    pthread_mutex_destroy(&win->lock);
+}
+
+static uint32_t hal_bench_window_frames(hal_bench_window_t *win)
+{
+    uint32_t frames;
+
+    pthread_mutex_lock(&win->lock);
+    frames = win->frames;
+    pthread_mutex_unlock(&win->lock);
+    return frames;
+}
+
+/* ------------------------------------------------------------------------
+ * API callers
+ * ----------------------------------------------------------------------*/
+static int hal_bench_call(hal_bench_thread_t *t, uint32_t n)
+{
+    camera_device_t *dev = t->dev;
+    char *params;
+
+    if (t->round_trip) {
+        params = dev->ops->get_parameters(dev);
+        if (NULL == params) {
+            return -1;
+        }
+        dev->ops->put_parameters(dev, params);
+        return 0;
+    }
+    switch (n % 3) {
+    case 0:
+        dev->ops->msg_type_enabled(dev, CAMERA_MSG_PREVIEW_FRAME);
+        return 0;
+    case 1:
+        return (1 == dev->ops->preview_enabled(dev)) ? 0 : -1;
+    default:
+        return (0 == dev->ops->recording_enabled(dev)) ? 0 : -1;
+    }
+}
+
+static void *hal_bench_thread(void *data)
+{
+    hal_bench_thread_t *t = (hal_bench_thread_t *)data;
+    struct timespec t0, t1;
+    uint32_t n;
+
+    for (n = 0; *t->running; n++) {
+        if (0 == n % HAL_BENCH_SAMPLE_EVERY) {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+        }
+        if (0 != hal_bench_call(t, n)) {
+            t->wrong++;
+        }
+        if (0 == n % HAL_BENCH_SAMPLE_EVERY) {
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            bench_lat_add(&t->lat, bench_diff_us(&t0, &t1));
+        }
+    }
+    t->calls = n;
+    return NULL;
+}
+
+static void hal_bench_usage(const char *name)
+{
+    printf("usage: %s [-s] [-l lib] [-c cam] [-t sec] [-j threads] [-g]\n", name);
+    printf("-s:   use simulated camera backend\n");
+    printf("-l:   HAL module (/system/lib/hw/camera2.<ro.board.platform>.so)\n");
+    printf("-c:   camera id (0)\n");
+    printf("-t:   seconds to call APIs (10)\n");
+    printf("-j:   num of calling threads (1, max %d)\n", HAL_BENCH_MAX_THREADS);
+    printf("-g:   call get_parameters/put_parameters instead of read only queries\n");
+}
+
+int main(int argc, char **argv)
+{
+    static hal_bench_thread_t threads[HAL_BENCH_MAX_THREADS];
+    static hal_bench_window_t win;
+    char lib[PATH_MAX], platform[PROPERTY_VALUE_MAX], cam_id[8];
+    int cam_idx = 0, seconds = 10, num_threads = 1, round_trip = 0;
+    volatile int running = 1;
+    camera_module_t *module;
+    camera_device_t *dev = NULL;
+    hw_device_t *hw_dev = NULL;
+    struct timespec t0, t1;
+    uint32_t frames, total_calls = 0, total_wrong = 0;
+    double base_ms, load_ms, base_fps;
+    void *handle;
+    int i, c, rc = -1;
+
+    property_get("ro.board.platform", platform, "");
+    snprintf(lib, sizeof(lib), "/system/lib/hw/camera2.%s.so", platform);
+    while ((c = getopt(argc, argv, "sl:c:t:j:g")) != -1) {
+        switch (c) {
+        case 's':
+            setenv("MM_CAMERA_BACKEND", "sim", 1);
+            break;
+        case 'l':
+            strlcpy(lib, optarg, sizeof(lib));
+            break;
+        case 'c':
+            cam_idx = atoi(optarg);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'j':
+            num_threads = atoi(optarg);
+            break;
+        case 'g':
+            round_trip = 1;
+            break;
+        default:
+            hal_bench_usage(argv[0]);
+            return 0;
+        }
+    }
+    if (num_threads <= 0 || num_threads > HAL_BENCH_MAX_THREADS) {
+        num_threads = 1;
+    }
+
+    /* module is named camera2.*, so hw_get_module cannot find it by id */
+    handle = dlopen(lib, RTLD_NOW);
+    if (NULL == handle) {
+        CDBG_ERROR("%s: dlopen %s failed (%s)\n", __func__, lib, dlerror());
+        return -1;
+    }
+    module = (camera_module_t *)dlsym(handle, HAL_MODULE_INFO_SYM_AS_STR);
+    if (NULL == module || cam_idx >= module->get_number_of_cameras()) {
+        CDBG_ERROR("%s: no camera %d in %s\n", __func__, cam_idx, lib);
+        goto close_lib;
+    }
+    if (0 != hal_bench_window_init(&win)) {
+        goto close_lib;
+    }
+    snprintf(cam_id, sizeof(cam_id), "%d", cam_idx);
+    if (0 != module->common.methods->open(&module->common, cam_id, &hw_dev)) {
+        CDBG_ERROR("%s: open camera %d failed\n", __func__, cam_idx);
+        goto deinit_window;
+    }
+    dev = (camera_device_t *)hw_dev;
+    dev->ops->set_callbacks(dev, hal_bench_notify_cb, hal_bench_data_cb,
+                            hal_bench_data_ts_cb, hal_bench_get_mem, NULL);
+    if (0 != dev->ops->set_preview_window(dev, &win.ops) ||
+        0 != dev->ops->start_preview(dev)) {
+        CDBG_ERROR("%s: start preview failed\n", __func__);
+        goto close_camera;
+    }
+
+    /* frame rate without API calls, after preview settles */
+    sleep(HAL_BENCH_WARMUP_SEC);
+    frames = hal_bench_window_frames(&win);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    sleep(HAL_BENCH_WARMUP_SEC);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    base_ms = bench_diff_us(&t0, &t1) / 1000.0;
+    base_fps = (hal_bench_window_frames(&win) - frames) * 1000.0 / base_ms;
+
+    frames = hal_bench_window_frames(&win);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < num_threads; i++) {
+        threads[i].dev = dev;
+        threads[i].round_trip = round_trip;
+        threads[i].running = &running;
+        pthread_create(&threads[i].pid, NULL, hal_bench_thread, &threads[i]);
+    }
+    sleep((unsigned int)seconds);
+    running = 0;
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i].pid, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    load_ms = bench_diff_us(&t0, &t1) / 1000.0;
+    frames = hal_bench_window_frames(&win) - frames;
+
+    dev->ops->stop_preview(dev);
+
+    printf("%d thread(s) calling %s for %.1f s\n", num_threads,
+           round_trip ? "get_parameters/put_parameters" :
+                        "msg_type_enabled/preview_enabled/recording_enabled",
+           load_ms / 1000.0);
+    printf(" preview: %.2f fps before, %.2f fps during calls\n",
+           base_fps, frames * 1000.0 / load_ms);
+    for (i = 0; i < num_threads; i++) {
+        char name[32];
+        total_calls += threads[i].calls;
+        total_wrong += threads[i].wrong;
+        snprintf(name, sizeof(name), "thread %d call", i);
+        bench_lat_print(name, &threads[i].lat, "us");
+    }
+    printf(" calls: %u, %.0f per second, %u failed or wrong\n",
+           total_calls, total_calls * 1000.0 / load_ms, total_wrong);
+    rc = (0 == total_wrong) ? 0 : -1;
+
+close_camera:
+    dev->common.close(&dev->common);
+deinit_window:
+    hal_bench_window_deinit(&win);
+close_lib:
+    dlclose(handle);
+    return rc;
+}
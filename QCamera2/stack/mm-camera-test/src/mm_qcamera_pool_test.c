@@ -0,0 +1,461 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Unit test of the preallocated node pools of mm-camera-interface (cam_queue
+ * nodes, cmd thread nodes and matched super buf nodes). Streams from the
+ * simulated backend and counts heap allocations of the whole process while
+ * frames flow, after a warm up. The test fails if any allocation is seen in
+ * steady state, or if no frame is seen at all. Cases:
+ *   preview   : one preview stream, frames through stream cb
+ *   bundled   : preview + video bundled, frames through super buf cb
+ * malloc/calloc/realloc of the process are interposed to count calls. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+
+#include "mm_qcamera_dbg.h"
+#include "mm_qcamera_app.h"
+
+#define POOL_TEST_WARMUP_MS     500
+#define POOL_TEST_MEASURE_MS    2000
+#define POOL_TEST_FPS           "120"
+#define POOL_TEST_BOOT_HEAP     4096
+
+typedef struct {
+    uint32_t s_id;
+    mm_camera_app_buf_t info_buf;
+    mm_camera_app_buf_t bufs[PREVIEW_BUF_NUM];
+} pool_test_stream_t;
+
+typedef struct {
+    mm_camera_vtbl_t *cam;
+    uint32_t ch_id;
+    mm_camera_app_buf_t cap_buf;
+    uint8_t num_streams;
+    pool_test_stream_t streams[2];
+    uint32_t frames;            /* updated by cb thread, atomic */
+} pool_test_obj_t;
+
+/* ------------------------------------------------------------------------
+ * heap allocation counting
+ * ----------------------------------------------------------------------*/
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int hook_init_running;
+static int counting;
+static uint32_t alloc_cnt;
+
+/* dlsym may calloc before real_calloc is known, served from here */
+static char boot_heap[POOL_TEST_BOOT_HEAP];
+static size_t boot_used;
+
+static void pool_test_hook_init(void)
+{
+    hook_init_running = 1;
+    real_malloc = (void *(*)(size_t))dlsym(RTLD_NEXT, "malloc");
+    real_calloc = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "calloc");
+    real_realloc = (void *(*)(void *, size_t))dlsym(RTLD_NEXT, "realloc");
+    real_free = (void (*)(void *))dlsym(RTLD_NEXT, "free");
+    hook_init_running = 0;
+}
+
+static void pool_test_count_alloc(void)
+{
+    if (__atomic_load_n(&counting, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&alloc_cnt, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int pool_test_is_boot(void *ptr)
+{
+    return (char *)ptr >= boot_heap && (char *)ptr < boot_heap + sizeof(boot_heap);
+}
+
+void *malloc(size_t size)
+{
+    if (NULL == real_malloc) {
+        pool_test_hook_init();
+    }
+    pool_test_count_alloc();
+    return real_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (NULL == real_calloc) {
+        if (hook_init_running) {
+            size_t len = (nmemb * size + 15) & ~((size_t)15);
+            void *ptr = NULL;
+            if (boot_used + len <= sizeof(boot_heap)) {
+                ptr = boot_heap + boot_used;
+                boot_used += len;
+            }
+            return ptr;
+        }
+        pool_test_hook_init();
+    }
+    pool_test_count_alloc();
+    return real_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (NULL == real_realloc) {
+        pool_test_hook_init();
+    }
+    pool_test_count_alloc();
+    return real_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if (NULL == ptr || pool_test_is_boot(ptr)) {
+        return;
+    }
+    if (NULL == real_free) {
+        pool_test_hook_init();
+    }
+    real_free(ptr);
+}
+
+/* ------------------------------------------------------------------------
+ * streaming on sim backend
+ * ----------------------------------------------------------------------*/
+/* sim backend maps fds the same way server does, a tmp file is enough */
+static int pool_test_alloc(mm_camera_app_buf_t *buf, uint32_t size)
+{
+    char path[] = "/tmp/mm-qcamera-pool-test-XXXXXX";
+    void *data;
+    int fd;
+
+    memset(buf, 0, sizeof(*buf));
+    size = (size + 4095) & (~4095);
+    fd = mkstemp(path);
+    if (fd < 0) {
+        CDBG_ERROR("%s: mkstemp failed %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == data) {
+        close(fd);
+        return -1;
+    }
+    buf->mem_info.fd = fd;
+    buf->mem_info.size = size;
+    buf->mem_info.data = data;
+    return 0;
+}
+
+static void pool_test_free(mm_camera_app_buf_t *buf)
+{
+    if (NULL != buf->mem_info.data) {
+        munmap(buf->mem_info.data, buf->mem_info.size);
+    }
+    if (buf->mem_info.fd > 0) {
+        close(buf->mem_info.fd);
+    }
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int32_t pool_test_get_bufs(cam_frame_len_offset_t *offset,
+                                  uint8_t *num_bufs,
+                                  uint8_t **initial_reg_flag,
+                                  mm_camera_buf_def_t **bufs,
+                                  mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                                  void *user_data)
+{
+    pool_test_stream_t *stream = (pool_test_stream_t *)user_data;
+    mm_camera_buf_def_t *pBufs;
+    uint8_t *reg_flags;
+    int i, j;
+
+    pBufs = (mm_camera_buf_def_t *)calloc(PREVIEW_BUF_NUM, sizeof(mm_camera_buf_def_t));
+    reg_flags = (uint8_t *)calloc(PREVIEW_BUF_NUM, sizeof(uint8_t));
+    if (NULL == pBufs || NULL == reg_flags) {
+        free(pBufs);
+        free(reg_flags);
+        return -1;
+    }
+
+    for (i = 0; i < PREVIEW_BUF_NUM; i++) {
+        mm_camera_app_buf_t *app_buf = &stream->bufs[i];
+        if (0 != pool_test_alloc(app_buf, offset->frame_len)) {
+            break;
+        }
+        app_buf->buf.buf_idx = i;
+        app_buf->buf.num_planes = offset->num_planes;
+        app_buf->buf.fd = app_buf->mem_info.fd;
+        app_buf->buf.frame_len = app_buf->mem_info.size;
+        app_buf->buf.buffer = app_buf->mem_info.data;
+        app_buf->buf.mem_info = (void *)&app_buf->mem_info;
+        for (j = 0; j < offset->num_planes; j++) {
+            app_buf->buf.planes[j].length = offset->mp[j].len;
+            app_buf->buf.planes[j].m.userptr = app_buf->buf.fd;
+            app_buf->buf.planes[j].data_offset = offset->mp[j].offset;
+            app_buf->buf.planes[j].reserved[0] = (0 == j) ? 0 :
+                app_buf->buf.planes[j-1].reserved[0] + app_buf->buf.planes[j-1].length;
+        }
+        if (0 != ops_tbl->map_ops(i, -1, app_buf->buf.fd, app_buf->buf.frame_len,
+                                  ops_tbl->userdata)) {
+            pool_test_free(app_buf);
+            break;
+        }
+        pBufs[i] = app_buf->buf;
+        reg_flags[i] = 1;
+    }
+
+    if (i < PREVIEW_BUF_NUM) {
+        CDBG_ERROR("%s: alloc/map buf %d failed", __func__, i);
+        while (--i >= 0) {
+            ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+            pool_test_free(&stream->bufs[i]);
+        }
+        free(pBufs);
+        free(reg_flags);
+        return -1;
+    }
+
+    *num_bufs = PREVIEW_BUF_NUM;
+    *bufs = pBufs;
+    *initial_reg_flag = reg_flags;
+    return 0;
+}
+
+static int32_t pool_test_put_bufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                                  void *user_data)
+{
+    pool_test_stream_t *stream = (pool_test_stream_t *)user_data;
+    int i;
+
+    for (i = 0; i < PREVIEW_BUF_NUM; i++) {
+        ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+        pool_test_free(&stream->bufs[i]);
+    }
+    return 0;
+}
+
+/* stream cb and super buf cb alike: count and return bufs to kernel */
+static void pool_test_cb(mm_camera_super_buf_t *bufs, void *user_data)
+{
+    pool_test_obj_t *obj = (pool_test_obj_t *)user_data;
+    int i;
+
+    __atomic_add_fetch(&obj->frames, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < bufs->num_bufs; i++) {
+        if (MM_CAMERA_OK != obj->cam->ops->qbuf(bufs->camera_handle, bufs->ch_id,
+                                                bufs->bufs[i])) {
+            CDBG_ERROR("%s: qbuf failed", __func__);
+        }
+    }
+}
+
+static int pool_test_add_stream(pool_test_obj_t *obj, cam_stream_type_t type,
+                                cam_format_t fmt, uint8_t bundled)
+{
+    pool_test_stream_t *stream = &obj->streams[obj->num_streams];
+    mm_camera_stream_config_t config;
+    cam_capability_t *cap = (cam_capability_t *)obj->cap_buf.mem_info.data;
+    cam_stream_info_t *info;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->s_id = obj->cam->ops->add_stream(obj->cam->camera_handle, obj->ch_id);
+    if (0 == stream->s_id) {
+        CDBG_ERROR("%s: add stream failed", __func__);
+        return -1;
+    }
+    if (0 != pool_test_alloc(&stream->info_buf, sizeof(cam_stream_info_t)) ||
+        MM_CAMERA_OK != obj->cam->ops->map_stream_buf(obj->cam->camera_handle,
+                                                      obj->ch_id, stream->s_id,
+                                                      CAM_MAPPING_BUF_TYPE_STREAM_INFO,
+                                                      0, -1,
+                                                      stream->info_buf.mem_info.fd,
+                                                      stream->info_buf.mem_info.size)) {
+        CDBG_ERROR("%s: map stream info failed", __func__);
+        pool_test_free(&stream->info_buf);
+        obj->cam->ops->delete_stream(obj->cam->camera_handle, obj->ch_id, stream->s_id);
+        return -1;
+    }
+    /* counted from here on, so cleanup covers it on failure */
+    obj->num_streams++;
+
+    info = (cam_stream_info_t *)stream->info_buf.mem_info.data;
+    memset(info, 0, sizeof(cam_stream_info_t));
+    info->stream_type = type;
+    info->streaming_mode = CAM_STREAMING_MODE_CONTINUOUS;
+    info->fmt = fmt;
+    info->dim.width = DEFAULT_PREVIEW_WIDTH;
+    info->dim.height = DEFAULT_PREVIEW_HEIGHT;
+    if (bundled) {
+        info->bundle_id = obj->ch_id;
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.stream_info = info;
+    config.padding_info = cap->padding_info;
+    config.mem_vtbl.get_bufs = pool_test_get_bufs;
+    config.mem_vtbl.put_bufs = pool_test_put_bufs;
+    config.mem_vtbl.user_data = stream;
+    config.stream_cb = bundled ? NULL : pool_test_cb;
+    config.userdata = obj;
+    if (MM_CAMERA_OK != obj->cam->ops->config_stream(obj->cam->camera_handle,
+                                                     obj->ch_id, stream->s_id,
+                                                     &config)) {
+        CDBG_ERROR("%s: config stream failed", __func__);
+        return -1;
+    }
+    return 0;
+}
+
+static void pool_test_del_streams(pool_test_obj_t *obj)
+{
+    pool_test_stream_t *stream;
+    int i;
+
+    for (i = 0; i < obj->num_streams; i++) {
+        stream = &obj->streams[i];
+        obj->cam->ops->unmap_stream_buf(obj->cam->camera_handle, obj->ch_id,
+                                        stream->s_id,
+                                        CAM_MAPPING_BUF_TYPE_STREAM_INFO, 0, -1);
+        pool_test_free(&stream->info_buf);
+        obj->cam->ops->delete_stream(obj->cam->camera_handle, obj->ch_id,
+                                     stream->s_id);
+    }
+    obj->num_streams = 0;
+}
+
+/* stream for a while, then count allocations over the measuring window */
+static int pool_test_run(pool_test_obj_t *obj, uint8_t bundled)
+{
+    mm_camera_channel_attr_t attr;
+    uint32_t frames, allocs;
+    int rc = -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.notify_mode = MM_CAMERA_SUPER_BUF_NOTIFY_CONTINUOUS;
+    attr.water_mark = 1;
+    obj->frames = 0;
+    obj->ch_id = obj->cam->ops->add_channel(obj->cam->camera_handle,
+                                            bundled ? &attr : NULL,
+                                            bundled ? pool_test_cb : NULL,
+                                            obj);
+    if (0 == obj->ch_id) {
+        CDBG_ERROR("%s: add channel failed\n", __func__);
+        return -1;
+    }
+    if (0 != pool_test_add_stream(obj, CAM_STREAM_TYPE_PREVIEW,
+                                  DEFAULT_PREVIEW_FORMAT, bundled) ||
+        (bundled &&
+         0 != pool_test_add_stream(obj, CAM_STREAM_TYPE_VIDEO,
+                                   DEFAULT_VIDEO_FORMAT, bundled))) {
+        goto del_streams;
+    }
+    if (MM_CAMERA_OK != obj->cam->ops->start_channel(obj->cam->camera_handle,
+                                                     obj->ch_id)) {
+        CDBG_ERROR("%s: start channel failed\n", __func__);
+        goto del_streams;
+    }
+
+    usleep(POOL_TEST_WARMUP_MS * 1000);
+    frames = __atomic_load_n(&obj->frames, __ATOMIC_RELAXED);
+    __atomic_store_n(&alloc_cnt, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+    usleep(POOL_TEST_MEASURE_MS * 1000);
+    __atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+    frames = __atomic_load_n(&obj->frames, __ATOMIC_RELAXED) - frames;
+    allocs = __atomic_load_n(&alloc_cnt, __ATOMIC_RELAXED);
+
+    obj->cam->ops->stop_channel(obj->cam->camera_handle, obj->ch_id);
+
+    printf(" %s: %u %s in %d ms, %u heap allocations\n",
+           bundled ? "bundled" : "preview", frames,
+           bundled ? "super bufs" : "frames", POOL_TEST_MEASURE_MS, allocs);
+    if (frames > 0 && 0 == allocs) {
+        rc = 0;
+    }
+
+del_streams:
+    pool_test_del_streams(obj);
+    obj->cam->ops->delete_channel(obj->cam->camera_handle, obj->ch_id);
+    return rc;
+}
+
+int main()
+{
+    static pool_test_obj_t obj;
+    int rc = -1;
+
+    /* test is about the interface, always on the simulated backend */
+    setenv("MM_CAMERA_BACKEND", "sim", 1);
+    setenv("MM_CAMERA_SIM_FPS", POOL_TEST_FPS, 0);
+
+    memset(&obj, 0, sizeof(obj));
+    if (get_num_of_cameras() <= 0) {
+        CDBG_ERROR("%s: no camera\n", __func__);
+        return -1;
+    }
+    obj.cam = camera_open(0);
+    if (NULL == obj.cam) {
+        CDBG_ERROR("%s: camera_open failed\n", __func__);
+        return -1;
+    }
+    if (0 != pool_test_alloc(&obj.cap_buf, sizeof(cam_capability_t)) ||
+        MM_CAMERA_OK != obj.cam->ops->map_buf(obj.cam->camera_handle,
+                                              CAM_MAPPING_BUF_TYPE_CAPABILITY,
+                                              obj.cap_buf.mem_info.fd,
+                                              obj.cap_buf.mem_info.size) ||
+        MM_CAMERA_OK != obj.cam->ops->query_capability(obj.cam->camera_handle)) {
+        CDBG_ERROR("%s: query capability failed\n", __func__);
+        goto close_camera;
+    }
+
+    printf("\n Verifying no heap allocation per frame...\n");
+    if (0 == pool_test_run(&obj, 0) && 0 == pool_test_run(&obj, 1)) {
+        rc = 0;
+    }
+    printf("\n%s\n", (0 == rc) ? "Passed" : "Failed");
+
+close_camera:
+    if (NULL != obj.cap_buf.mem_info.data) {
+        obj.cam->ops->unmap_buf(obj.cam->camera_handle, CAM_MAPPING_BUF_TYPE_CAPABILITY);
+        pool_test_free(&obj.cap_buf);
+    }
+    obj.cam->ops->close_camera(obj.cam->camera_handle);
+    return rc;
+}
@@ -0,0 +1,692 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Replay test of the super buf matcher of mm-camera-interface. Recorded
+ * multi-stream arrival orders (stream skew, sensor drops, late and repeated
+ * frames) and a seeded random one are replayed by the simulated backend
+ * into a bundled channel, and the super bufs seen in the super buf cb are
+ * compared with the output of the list based matcher the channel used
+ * before the match slot, kept here as reference. A sentinel frame on all
+ * streams ends every replay, so the whole output is known once it shows
+ * up. The test fails on any difference in order or content. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "mm_qcamera_dbg.h"
+#include "mm_qcamera_app.h"
+
+#define REPLAY_TEST_FPS             "2000"
+#define REPLAY_TEST_MAX_STREAMS     3
+#define REPLAY_TEST_MAX_ARRIVALS    2048
+#define REPLAY_TEST_MAX_SUPER_BUFS  1024
+#define REPLAY_TEST_TIMEOUT_S       10
+#define REPLAY_TEST_RANDOM_FRAMES   400
+
+typedef struct {
+    uint8_t stream_idx;
+    uint32_t frame_idx;
+} replay_test_arrival_t;
+
+typedef struct {
+    uint32_t frame_idx[REPLAY_TEST_MAX_STREAMS];
+} replay_test_super_buf_t;
+
+typedef struct {
+    const char *name;
+    uint8_t num_streams;
+    uint32_t post_frame_skip;
+    const char *trace;          /* NULL for seeded random trace */
+} replay_test_case_t;
+
+typedef struct {
+    uint32_t s_id;
+    mm_camera_app_buf_t info_buf;
+    mm_camera_app_buf_t bufs[PREVIEW_BUF_NUM];
+} replay_test_stream_t;
+
+typedef struct {
+    mm_camera_vtbl_t *cam;
+    uint32_t ch_id;
+    mm_camera_app_buf_t cap_buf;
+    uint8_t num_streams;
+    replay_test_stream_t streams[REPLAY_TEST_MAX_STREAMS];
+    char replay_path[64];
+
+    /* filled by super buf cb */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t sentinel;
+    uint8_t done;
+    uint8_t unknown_stream;
+    uint32_t num_got;
+    replay_test_super_buf_t got[REPLAY_TEST_MAX_SUPER_BUFS];
+} replay_test_obj_t;
+
+/* recorded arrival orders, "<stream>:<frame_idx>" as replayed by sim */
+static const replay_test_case_t replay_test_cases[] = {
+    {"in order", 2, 0,
+     "0:1 1:1 0:2 1:2 0:3 1:3 0:4 1:4 0:5 1:5 0:6 1:6 0:7 1:7 0:8 1:8"},
+    {"video first", 2, 0,
+     "1:1 0:1 1:2 0:2 0:3 1:3 1:4 0:4 1:5 0:5 0:6 1:6 1:7 0:7"},
+    {"sensor drops", 2, 0,
+     "0:1 1:1 0:2 0:3 1:3 1:4 0:5 1:5 0:6 1:7 0:7 0:9 1:9 1:10 0:11 1:11"},
+    {"video lags", 2, 0,
+     "0:1 0:2 1:1 1:2 0:3 1:3 0:4 0:5 1:4 1:5 1:6 0:6 0:7 0:8 1:7 0:9 1:8 1:9"},
+    {"late and repeated", 2, 0,
+     "0:1 1:1 0:3 1:2 1:3 0:2 0:4 0:4 1:4 1:5 0:5 1:5 0:7 0:6 1:6 1:7 0:8 1:8"},
+    {"preview video metadata", 3, 0,
+     "0:1 1:1 2:1 0:2 2:2 1:2 0:3 1:3 0:4 2:4 1:4 2:3 0:5 1:5 2:5 2:6 1:6 0:6 "
+     "1:7 0:7 0:8 2:7 1:8 2:8 2:9 0:10 1:10 2:10"},
+    {"post frame skip", 2, 2,
+     "0:1 1:1 0:2 1:2 0:3 1:3 0:4 1:4 0:5 1:5 1:6 0:6 0:7 1:7 0:8 1:8 0:9 1:9"},
+    {"random", 3, 0, NULL},
+    {"random with skip", 3, 1, NULL},
+};
+
+/* ------------------------------------------------------------------------
+ * arrival orders
+ * ----------------------------------------------------------------------*/
+static int replay_test_parse(const char *trace, replay_test_arrival_t *arrivals,
+                             int max)
+{
+    unsigned int stream_idx, frame_idx;
+    int cnt = 0, len;
+
+    while (cnt < max &&
+           2 == sscanf(trace, " %u:%u%n", &stream_idx, &frame_idx, &len)) {
+        arrivals[cnt].stream_idx = (uint8_t)stream_idx;
+        arrivals[cnt].frame_idx = frame_idx;
+        cnt++;
+        trace += len;
+    }
+    return cnt;
+}
+
+/* every stream delivers most frames, arrivals of neighbour frames overlap */
+static int replay_test_random(uint8_t num_streams,
+                              replay_test_arrival_t *arrivals, int max)
+{
+    uint32_t keys[REPLAY_TEST_MAX_ARRIVALS];
+    uint32_t seed = 0x5eed;
+    uint32_t frame_idx, key;
+    replay_test_arrival_t arrival;
+    uint8_t s;
+    int cnt = 0, i;
+
+    for (frame_idx = 1; frame_idx <= REPLAY_TEST_RANDOM_FRAMES; frame_idx++) {
+        for (s = 0; s < num_streams && cnt < max; s++) {
+            seed = seed * 1103515245 + 12345;
+            if (((seed >> 16) % 100) < 8) {
+                continue;
+            }
+            seed = seed * 1103515245 + 12345;
+            key = frame_idx * 4 + (seed >> 16) % 6;
+
+            /* insertion sort on arrival time */
+            arrival.stream_idx = s;
+            arrival.frame_idx = frame_idx;
+            for (i = cnt; i > 0 && keys[i - 1] > key; i--) {
+                keys[i] = keys[i - 1];
+                arrivals[i] = arrivals[i - 1];
+            }
+            keys[i] = key;
+            arrivals[i] = arrival;
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+/* ------------------------------------------------------------------------
+ * reference: list based matcher of mm_channel_superbuf_comp_and_enqueue
+ * as it was before the match slot, on frame indexes only
+ * ----------------------------------------------------------------------*/
+static int8_t replay_test_seq_comp(uint32_t v1, uint32_t v2)
+{
+    if (v1 > v2) {
+        return 1;
+    } else if (v1 < v2) {
+        return -1;
+    }
+    return 0;
+}
+
+static int replay_test_ref_match(const replay_test_arrival_t *arrivals, int cnt,
+                                 uint8_t num_streams, uint32_t post_frame_skip,
+                                 replay_test_super_buf_t *out, int max)
+{
+    replay_test_super_buf_t node;
+    uint8_t has_node = 0, is_new, matched;
+    uint32_t expected_frame_id = 0, frame_idx;
+    int num_out = 0, n, i;
+    uint8_t s;
+
+    for (n = 0; n < cnt; n++) {
+        s = arrivals[n].stream_idx;
+        frame_idx = arrivals[n].frame_idx;
+
+        if (replay_test_seq_comp(frame_idx, expected_frame_id) < 0) {
+            /* older than expected, discarded */
+            continue;
+        }
+
+        if (!has_node) {
+            /* all super bufs in queue are matched, create a new one */
+            memset(&node, 0, sizeof(node));
+            node.frame_idx[s] = frame_idx;
+            has_node = 1;
+            if (1 == num_streams) {
+                matched = 1;
+            } else {
+                continue;
+            }
+        } else if (0 == node.frame_idx[s]) {
+            /* new frame from the stream */
+            is_new = 1;
+            for (i = 0; i < num_streams; i++) {
+                if (0 == node.frame_idx[i]) {
+                    continue;
+                }
+                if (node.frame_idx[i] < frame_idx) {
+                    /* existing frame is older, released */
+                    node.frame_idx[i] = 0;
+                } else if (node.frame_idx[i] > frame_idx) {
+                    /* new frame is older */
+                    is_new = 0;
+                    break;
+                } else {
+                    break;
+                }
+            }
+            if (!is_new) {
+                continue;
+            }
+            node.frame_idx[s] = frame_idx;
+            matched = 1;
+            for (i = 0; i < num_streams; i++) {
+                if (0 == node.frame_idx[i]) {
+                    matched = 0;
+                    break;
+                }
+            }
+        } else {
+            if (node.frame_idx[s] < frame_idx) {
+                /* current frames are older, all released */
+                memset(&node, 0, sizeof(node));
+                node.frame_idx[s] = frame_idx;
+            }
+            continue;
+        }
+
+        if (matched) {
+            expected_frame_id = frame_idx + post_frame_skip;
+            has_node = 0;
+            if (num_out < max) {
+                out[num_out++] = node;
+            }
+        }
+    }
+    return num_out;
+}
+
+/* ------------------------------------------------------------------------
+ * replay on sim backend
+ * ----------------------------------------------------------------------*/
+/* sim backend maps fds the same way server does, a tmp file is enough */
+static int replay_test_alloc(mm_camera_app_buf_t *buf, uint32_t size)
+{
+    char path[] = "/tmp/mm-qcamera-replay-test-XXXXXX";
+    void *data;
+    int fd;
+
+    memset(buf, 0, sizeof(*buf));
+    size = (size + 4095) & (~4095);
+    fd = mkstemp(path);
+    if (fd < 0) {
+        CDBG_ERROR("%s: mkstemp failed %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == data) {
+        close(fd);
+        return -1;
+    }
+    buf->mem_info.fd = fd;
+    buf->mem_info.size = size;
+    buf->mem_info.data = data;
+    return 0;
+}
+
+static void replay_test_free(mm_camera_app_buf_t *buf)
+{
+    if (NULL != buf->mem_info.data) {
+        munmap(buf->mem_info.data, buf->mem_info.size);
+    }
+    if (buf->mem_info.fd > 0) {
+        close(buf->mem_info.fd);
+    }
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int32_t replay_test_get_bufs(cam_frame_len_offset_t *offset,
+                                    uint8_t *num_bufs,
+                                    uint8_t **initial_reg_flag,
+                                    mm_camera_buf_def_t **bufs,
+                                    mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                                    void *user_data)
+{
+    replay_test_stream_t *stream = (replay_test_stream_t *)user_data;
+    mm_camera_buf_def_t *pBufs;
+    uint8_t *reg_flags;
+    int i, j;
+
+    pBufs = (mm_camera_buf_def_t *)calloc(PREVIEW_BUF_NUM, sizeof(mm_camera_buf_def_t));
+    reg_flags = (uint8_t *)calloc(PREVIEW_BUF_NUM, sizeof(uint8_t));
+    if (NULL == pBufs || NULL == reg_flags) {
+        free(pBufs);
+        free(reg_flags);
+        return -1;
+    }
+
+    for (i = 0; i < PREVIEW_BUF_NUM; i++) {
+        mm_camera_app_buf_t *app_buf = &stream->bufs[i];
+        if (0 != replay_test_alloc(app_buf, offset->frame_len)) {
+            break;
+        }
+        app_buf->buf.buf_idx = i;
+        app_buf->buf.num_planes = offset->num_planes;
+        app_buf->buf.fd = app_buf->mem_info.fd;
+        app_buf->buf.frame_len = app_buf->mem_info.size;
+        app_buf->buf.buffer = app_buf->mem_info.data;
+        app_buf->buf.mem_info = (void *)&app_buf->mem_info;
+        for (j = 0; j < offset->num_planes; j++) {
+            app_buf->buf.planes[j].length = offset->mp[j].len;
+            app_buf->buf.planes[j].m.userptr = app_buf->buf.fd;
+            app_buf->buf.planes[j].data_offset = offset->mp[j].offset;
+            app_buf->buf.planes[j].reserved[0] = (0 == j) ? 0 :
+                app_buf->buf.planes[j-1].reserved[0] + app_buf->buf.planes[j-1].length;
+        }
+        if (0 != ops_tbl->map_ops(i, -1, app_buf->buf.fd, app_buf->buf.frame_len,
+                                  ops_tbl->userdata)) {
+            replay_test_free(app_buf);
+            break;
+        }
+        pBufs[i] = app_buf->buf;
+        reg_flags[i] = 1;
+    }
+
+    if (i < PREVIEW_BUF_NUM) {
+        CDBG_ERROR("%s: alloc/map buf %d failed", __func__, i);
+        while (--i >= 0) {
+            ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+            replay_test_free(&stream->bufs[i]);
+        }
+        free(pBufs);
+        free(reg_flags);
+        return -1;
+    }
+
+    *num_bufs = PREVIEW_BUF_NUM;
+    *bufs = pBufs;
+    *initial_reg_flag = reg_flags;
+    return 0;
+}
+
+static int32_t replay_test_put_bufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                                    void *user_data)
+{
+    replay_test_stream_t *stream = (replay_test_stream_t *)user_data;
+    int i;
+
+    for (i = 0; i < PREVIEW_BUF_NUM; i++) {
+        ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+        replay_test_free(&stream->bufs[i]);
+    }
+    return 0;
+}
+
+/* record frame_idx of every stream in the super buf, return bufs to kernel */
+static void replay_test_cb(mm_camera_super_buf_t *bufs, void *user_data)
+{
+    replay_test_obj_t *obj = (replay_test_obj_t *)user_data;
+    replay_test_super_buf_t super_buf;
+    int i, s;
+
+    memset(&super_buf, 0, sizeof(super_buf));
+    for (i = 0; i < bufs->num_bufs; i++) {
+        for (s = 0; s < obj->num_streams; s++) {
+            if (bufs->bufs[i]->stream_id == obj->streams[s].s_id) {
+                super_buf.frame_idx[s] = bufs->bufs[i]->frame_idx;
+                break;
+            }
+        }
+        if (s == obj->num_streams) {
+            obj->unknown_stream = 1;
+        }
+        if (MM_CAMERA_OK != obj->cam->ops->qbuf(bufs->camera_handle, bufs->ch_id,
+                                                bufs->bufs[i])) {
+            CDBG_ERROR("%s: qbuf failed", __func__);
+        }
+    }
+
+    pthread_mutex_lock(&obj->lock);
+    if (obj->num_got < REPLAY_TEST_MAX_SUPER_BUFS) {
+        obj->got[obj->num_got] = super_buf;
+    }
+    obj->num_got++;
+    if (super_buf.frame_idx[0] == obj->sentinel) {
+        obj->done = 1;
+        pthread_cond_signal(&obj->cond);
+    }
+    pthread_mutex_unlock(&obj->lock);
+}
+
+static int replay_test_add_stream(replay_test_obj_t *obj, cam_stream_type_t type)
+{
+    replay_test_stream_t *stream = &obj->streams[obj->num_streams];
+    mm_camera_stream_config_t config;
+    cam_capability_t *cap = (cam_capability_t *)obj->cap_buf.mem_info.data;
+    cam_stream_info_t *info;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->s_id = obj->cam->ops->add_stream(obj->cam->camera_handle, obj->ch_id);
+    if (0 == stream->s_id) {
+        CDBG_ERROR("%s: add stream failed", __func__);
+        return -1;
+    }
+    if (0 != replay_test_alloc(&stream->info_buf, sizeof(cam_stream_info_t)) ||
+        MM_CAMERA_OK != obj->cam->ops->map_stream_buf(obj->cam->camera_handle,
+                                                      obj->ch_id, stream->s_id,
+                                                      CAM_MAPPING_BUF_TYPE_STREAM_INFO,
+                                                      0, -1,
+                                                      stream->info_buf.mem_info.fd,
+                                                      stream->info_buf.mem_info.size)) {
+        CDBG_ERROR("%s: map stream info failed", __func__);
+        replay_test_free(&stream->info_buf);
+        obj->cam->ops->delete_stream(obj->cam->camera_handle, obj->ch_id, stream->s_id);
+        return -1;
+    }
+    /* counted from here on, so cleanup covers it on failure */
+    obj->num_streams++;
+
+    info = (cam_stream_info_t *)stream->info_buf.mem_info.data;
+    memset(info, 0, sizeof(cam_stream_info_t));
+    info->stream_type = type;
+    info->streaming_mode = CAM_STREAMING_MODE_CONTINUOUS;
+    info->fmt = DEFAULT_PREVIEW_FORMAT;
+    info->dim.width = DEFAULT_PREVIEW_WIDTH;
+    info->dim.height = DEFAULT_PREVIEW_HEIGHT;
+    info->bundle_id = obj->ch_id;
+
+    memset(&config, 0, sizeof(config));
+    config.stream_info = info;
+    config.padding_info = cap->padding_info;
+    config.mem_vtbl.get_bufs = replay_test_get_bufs;
+    config.mem_vtbl.put_bufs = replay_test_put_bufs;
+    config.mem_vtbl.user_data = stream;
+    config.stream_cb = NULL;
+    config.userdata = obj;
+    if (MM_CAMERA_OK != obj->cam->ops->config_stream(obj->cam->camera_handle,
+                                                     obj->ch_id, stream->s_id,
+                                                     &config)) {
+        CDBG_ERROR("%s: config stream failed", __func__);
+        return -1;
+    }
+    return 0;
+}
+
+static void replay_test_del_streams(replay_test_obj_t *obj)
+{
+    replay_test_stream_t *stream;
+    int i;
+
+    for (i = 0; i < obj->num_streams; i++) {
+        stream = &obj->streams[i];
+        obj->cam->ops->unmap_stream_buf(obj->cam->camera_handle, obj->ch_id,
+                                        stream->s_id,
+                                        CAM_MAPPING_BUF_TYPE_STREAM_INFO, 0, -1);
+        replay_test_free(&stream->info_buf);
+        obj->cam->ops->delete_stream(obj->cam->camera_handle, obj->ch_id,
+                                     stream->s_id);
+    }
+    obj->num_streams = 0;
+}
+
+static int replay_test_write_trace(const char *path,
+                                   const replay_test_arrival_t *arrivals, int cnt)
+{
+    FILE *fp = fopen(path, "w");
+    int i;
+
+    if (NULL == fp) {
+        CDBG_ERROR("%s: cannot open %s\n", __func__, path);
+        return -1;
+    }
+    for (i = 0; i < cnt; i++) {
+        fprintf(fp, "%u:%u%c", arrivals[i].stream_idx, arrivals[i].frame_idx,
+                (15 == i % 16) ? '\n' : ' ');
+    }
+    fprintf(fp, "\n");
+    fclose(fp);
+    return 0;
+}
+
+/* replay the arrivals into a bundled channel, collect super bufs until the
+ * sentinel shows up */
+static int replay_test_stream(replay_test_obj_t *obj, uint8_t num_streams,
+                              uint32_t post_frame_skip)
+{
+    static const cam_stream_type_t types[REPLAY_TEST_MAX_STREAMS] = {
+        CAM_STREAM_TYPE_PREVIEW,
+        CAM_STREAM_TYPE_VIDEO,
+        CAM_STREAM_TYPE_POSTVIEW,
+    };
+    mm_camera_channel_attr_t attr;
+    struct timespec deadline;
+    uint8_t s;
+    int rc = -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.notify_mode = MM_CAMERA_SUPER_BUF_NOTIFY_CONTINUOUS;
+    attr.water_mark = 1;
+    attr.post_frame_skip = post_frame_skip;
+    obj->num_got = 0;
+    obj->done = 0;
+    obj->unknown_stream = 0;
+    obj->ch_id = obj->cam->ops->add_channel(obj->cam->camera_handle, &attr,
+                                            replay_test_cb, obj);
+    if (0 == obj->ch_id) {
+        CDBG_ERROR("%s: add channel failed\n", __func__);
+        return -1;
+    }
+    for (s = 0; s < num_streams; s++) {
+        if (0 != replay_test_add_stream(obj, types[s])) {
+            goto del_streams;
+        }
+    }
+    if (MM_CAMERA_OK != obj->cam->ops->start_channel(obj->cam->camera_handle,
+                                                     obj->ch_id)) {
+        CDBG_ERROR("%s: start channel failed\n", __func__);
+        goto del_streams;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += REPLAY_TEST_TIMEOUT_S;
+    pthread_mutex_lock(&obj->lock);
+    while (!obj->done &&
+           ETIMEDOUT != pthread_cond_timedwait(&obj->cond, &obj->lock, &deadline)) {
+    }
+    rc = obj->done ? 0 : -1;
+    pthread_mutex_unlock(&obj->lock);
+
+    obj->cam->ops->stop_channel(obj->cam->camera_handle, obj->ch_id);
+    if (0 != rc) {
+        printf(" timed out waiting for the sentinel super buf\n");
+    }
+
+del_streams:
+    replay_test_del_streams(obj);
+    obj->cam->ops->delete_channel(obj->cam->camera_handle, obj->ch_id);
+    return rc;
+}
+
+static int replay_test_run(replay_test_obj_t *obj, const replay_test_case_t *tc)
+{
+    static replay_test_arrival_t arrivals[REPLAY_TEST_MAX_ARRIVALS];
+    static replay_test_super_buf_t expected[REPLAY_TEST_MAX_SUPER_BUFS];
+    int cnt, num_expected, i, s;
+    uint32_t max_frame_idx = 0;
+
+    if (NULL != tc->trace) {
+        cnt = replay_test_parse(tc->trace, arrivals,
+                                REPLAY_TEST_MAX_ARRIVALS - tc->num_streams);
+    } else {
+        cnt = replay_test_random(tc->num_streams, arrivals,
+                                 REPLAY_TEST_MAX_ARRIVALS - tc->num_streams);
+    }
+
+    /* sentinel: a frame newer than all others on every stream */
+    for (i = 0; i < cnt; i++) {
+        if (arrivals[i].frame_idx > max_frame_idx) {
+            max_frame_idx = arrivals[i].frame_idx;
+        }
+    }
+    obj->sentinel = max_frame_idx + tc->post_frame_skip + 16;
+    for (s = 0; s < tc->num_streams; s++) {
+        arrivals[cnt].stream_idx = (uint8_t)s;
+        arrivals[cnt].frame_idx = obj->sentinel;
+        cnt++;
+    }
+
+    num_expected = replay_test_ref_match(arrivals, cnt, tc->num_streams,
+                                         tc->post_frame_skip, expected,
+                                         REPLAY_TEST_MAX_SUPER_BUFS);
+    if (0 != replay_test_write_trace(obj->replay_path, arrivals, cnt) ||
+        0 != replay_test_stream(obj, tc->num_streams, tc->post_frame_skip)) {
+        printf(" %-24s: replay failed\n", tc->name);
+        return -1;
+    }
+
+    if (obj->unknown_stream) {
+        printf(" %-24s: super buf with buf of unknown stream\n", tc->name);
+        return -1;
+    }
+    if ((int)obj->num_got != num_expected) {
+        printf(" %-24s: %u super bufs, %d expected\n",
+               tc->name, obj->num_got, num_expected);
+        return -1;
+    }
+    for (i = 0; i < num_expected; i++) {
+        if (0 != memcmp(&obj->got[i], &expected[i], sizeof(expected[i]))) {
+            printf(" %-24s: super buf %d is frame %u/%u/%u, %u/%u/%u expected\n",
+                   tc->name, i,
+                   obj->got[i].frame_idx[0], obj->got[i].frame_idx[1],
+                   obj->got[i].frame_idx[2], expected[i].frame_idx[0],
+                   expected[i].frame_idx[1], expected[i].frame_idx[2]);
+            return -1;
+        }
+    }
+    printf(" %-24s: %d arrivals on %d streams, %d super bufs identical\n",
+           tc->name, cnt, tc->num_streams, num_expected);
+    return 0;
+}
+
+int main()
+{
+    static replay_test_obj_t obj;
+    int fd, i, rc = 0;
+
+    memset(&obj, 0, sizeof(obj));
+    pthread_mutex_init(&obj.lock, NULL);
+    pthread_cond_init(&obj.cond, NULL);
+
+    /* file is rewritten per case, sim reads it at frame source start */
+    snprintf(obj.replay_path, sizeof(obj.replay_path), "/tmp/mm-qcamera-replay-XXXXXX");
+    fd = mkstemp(obj.replay_path);
+    if (fd < 0) {
+        CDBG_ERROR("%s: mkstemp failed %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    close(fd);
+
+    /* test is about the interface, always on the simulated backend */
+    setenv("MM_CAMERA_BACKEND", "sim", 1);
+    setenv("MM_CAMERA_SIM_REPLAY", obj.replay_path, 1);
+    setenv("MM_CAMERA_SIM_FPS", REPLAY_TEST_FPS, 0);
+
+    if (get_num_of_cameras() <= 0) {
+        CDBG_ERROR("%s: no camera\n", __func__);
+        rc = -1;
+        goto remove_trace;
+    }
+    obj.cam = camera_open(0);
+    if (NULL == obj.cam) {
+        CDBG_ERROR("%s: camera_open failed\n", __func__);
+        rc = -1;
+        goto remove_trace;
+    }
+    if (0 != replay_test_alloc(&obj.cap_buf, sizeof(cam_capability_t)) ||
+        MM_CAMERA_OK != obj.cam->ops->map_buf(obj.cam->camera_handle,
+                                              CAM_MAPPING_BUF_TYPE_CAPABILITY,
+                                              obj.cap_buf.mem_info.fd,
+                                              obj.cap_buf.mem_info.size) ||
+        MM_CAMERA_OK != obj.cam->ops->query_capability(obj.cam->camera_handle)) {
+        CDBG_ERROR("%s: query capability failed\n", __func__);
+        rc = -1;
+        goto close_camera;
+    }
+
+    printf("\n Replaying recorded arrival orders...\n");
+    for (i = 0; i < (int)(sizeof(replay_test_cases) / sizeof(replay_test_cases[0])); i++) {
+        if (0 != replay_test_run(&obj, &replay_test_cases[i])) {
+            rc = -1;
+        }
+    }
+    printf("\n%s\n", (0 == rc) ? "Passed" : "Failed");
+
+close_camera:
+    if (NULL != obj.cap_buf.mem_info.data) {
+        obj.cam->ops->unmap_buf(obj.cam->camera_handle, CAM_MAPPING_BUF_TYPE_CAPABILITY);
+        replay_test_free(&obj.cap_buf);
+    }
+    obj.cam->ops->close_camera(obj.cam->camera_handle);
+remove_trace:
+    unlink(obj.replay_path);
+    return rc;
+}
@@ -0,0 +1,530 @@
+/*
+Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Test of the focus priority super buf queue of mm-camera-interface, as
+ * used by the ZSL channel of the HAL. Preview and metadata streams are
+ * bundled in a burst mode channel on the simulated backend, whose metadata
+ * reports a focus sweep of 8 frames, scanning for the first 5. Cases:
+ *   replayed  : recorded arrivals, so the queue content at request time
+ *               is known, and the exact frames delivered are checked
+ *   streaming : free running frames, delivered frames must be focused
+ * The invalidate op of the metadata stream must be called before each
+ * metadata read in focus priority mode, and never in normal mode. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "mm_qcamera_dbg.h"
+#include "mm_qcamera_app.h"
+
+#define FOCUS_TEST_FPS              "2000"
+#define FOCUS_TEST_AF_PERIOD        "8"
+#define FOCUS_TEST_AF_SCAN          "5"
+#define FOCUS_TEST_SETTLE_MS        500
+#define FOCUS_TEST_TIMEOUT_S        5
+#define FOCUS_TEST_MAX_REQ          4
+
+typedef struct {
+    const char *name;
+    mm_camera_super_buf_priority_t priority;
+    uint32_t num_frames;        /* frames replayed in order, 0 for streaming */
+    uint8_t num_req;            /* super bufs requested */
+    uint32_t expected[FOCUS_TEST_MAX_REQ]; /* frame_idx, 0 for any focused */
+} focus_test_case_t;
+
+typedef struct {
+    uint32_t s_id;
+    uint32_t *invalidates;      /* counter of owning test obj */
+    mm_camera_app_buf_t info_buf;
+    mm_camera_app_buf_t bufs[PREVIEW_BUF_NUM];
+} focus_test_stream_t;
+
+typedef struct {
+    mm_camera_vtbl_t *cam;
+    uint32_t ch_id;
+    mm_camera_app_buf_t cap_buf;
+    uint8_t num_streams;
+    focus_test_stream_t streams[2];    /* preview, metadata */
+    char replay_path[64];
+    uint32_t invalidates;       /* updated by channel thread, atomic */
+
+    /* filled by super buf cb */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t num_got;
+    uint32_t got_frame_idx[FOCUS_TEST_MAX_REQ];
+    cam_autofocus_state_t got_state[FOCUS_TEST_MAX_REQ];
+} focus_test_obj_t;
+
+/* sweep of 8 frames, 5 scanning: frames 5, 6, 7, 13, 14, 15, ... focused.
+ * At most look_back (2) super bufs are kept in queue. */
+static const focus_test_case_t focus_test_cases[] = {
+    /* focused 22 and 23 queued, unfocused 24..26 dropped */
+    {"newest focused",      MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS,  26, 1, {23}},
+    {"burst of focused",    MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS,  26, 2, {22, 23}},
+    /* nothing better, newest unfocused */
+    {"never focused",       MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS,  4,  1, {4}},
+    /* baseline: oldest of the look back window, focused or not */
+    {"normal priority",     MM_CAMERA_SUPER_BUF_PRIORITY_NORMAL, 26, 1, {25}},
+    {"streaming",           MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS,  0,  2, {0, 0}},
+};
+
+/* sim backend maps fds the same way server does, a tmp file is enough */
+static int focus_test_alloc(mm_camera_app_buf_t *buf, uint32_t size)
+{
+    char path[] = "/tmp/mm-qcamera-focus-test-XXXXXX";
+    void *data;
+    int fd;
+
+    memset(buf, 0, sizeof(*buf));
+    size = (size + 4095) & (~4095);
+    fd = mkstemp(path);
+    if (fd < 0) {
+        CDBG_ERROR("%s: mkstemp failed %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == data) {
+        close(fd);
+        return -1;
+    }
+    buf->mem_info.fd = fd;
+    buf->mem_info.size = size;
+    buf->mem_info.data = data;
+    return 0;
+}
+
+static void focus_test_free(mm_camera_app_buf_t *buf)
+{
+    if (NULL != buf->mem_info.data) {
+        munmap(buf->mem_info.data, buf->mem_info.size);
+    }
+    if (buf->mem_info.fd > 0) {
+        close(buf->mem_info.fd);
+    }
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int32_t focus_test_get_bufs(cam_frame_len_offset_t *offset,
+                                    uint8_t *num_bufs,
+                                    uint8_t **initial_reg_flag,
+                                    mm_camera_buf_def_t **bufs,
+                                    mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                                    void *user_data)
+{
+    focus_test_stream_t *stream = (focus_test_stream_t *)user_data;
+    mm_camera_buf_def_t *pBufs;
+    uint8_t *reg_flags;
+    int i, j;
+
+    pBufs = (mm_camera_buf_def_t *)calloc(PREVIEW_BUF_NUM, sizeof(mm_camera_buf_def_t));
+    reg_flags = (uint8_t *)calloc(PREVIEW_BUF_NUM, sizeof(uint8_t));
+    if (NULL == pBufs || NULL == reg_flags) {
+        free(pBufs);
+        free(reg_flags);
+        return -1;
+    }
+
+    for (i = 0; i < PREVIEW_BUF_NUM; i++) {
+        mm_camera_app_buf_t *app_buf = &stream->bufs[i];
+        if (0 != focus_test_alloc(app_buf, offset->frame_len)) {
+            break;
+        }
+        app_buf->buf.buf_idx = i;
+        app_buf->buf.num_planes = offset->num_planes;
+        app_buf->buf.fd = app_buf->mem_info.fd;
+        app_buf->buf.frame_len = app_buf->mem_info.size;
+        app_buf->buf.buffer = app_buf->mem_info.data;
+        app_buf->buf.mem_info = (void *)&app_buf->mem_info;
+        for (j = 0; j < offset->num_planes; j++) {
+            app_buf->buf.planes[j].length = offset->mp[j].len;
+            app_buf->buf.planes[j].m.userptr = app_buf->buf.fd;
+            app_buf->buf.planes[j].data_offset = offset->mp[j].offset;
+            app_buf->buf.planes[j].reserved[0] = (0 == j) ? 0 :
+                app_buf->buf.planes[j-1].reserved[0] + app_buf->buf.planes[j-1].length;
+        }
+        if (0 != ops_tbl->map_ops(i, -1, app_buf->buf.fd, app_buf->buf.frame_len,
+                                  ops_tbl->userdata)) {
+            focus_test_free(app_buf);
+            break;
+        }
+        pBufs[i] = app_buf->buf;
+        reg_flags[i] = 1;
+    }
+
+    if (i < PREVIEW_BUF_NUM) {
+        CDBG_ERROR("%s: alloc/map buf %d failed", __func__, i);
+        while (--i >= 0) {
+            ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+            focus_test_free(&stream->bufs[i]);
+        }
+        free(pBufs);
+        free(reg_flags);
+        return -1;
+    }
+
+    *num_bufs = PREVIEW_BUF_NUM;
+    *bufs = pBufs;
+    *initial_reg_flag = reg_flags;
+    return 0;
+}
+
+static int32_t focus_test_put_bufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                                    void *user_data)
+{
+    focus_test_stream_t *stream = (focus_test_stream_t *)user_data;
+    int i;
+
+    for (i = 0; i < PREVIEW_BUF_NUM; i++) {
+        ops_tbl->unmap_ops(i, -1, ops_tbl->userdata);
+        focus_test_free(&stream->bufs[i]);
+    }
+    return 0;
+}
+
+
+/* metadata bufs are plain shared memory here, only count the calls */
+static int32_t focus_test_invalidate_buf(uint32_t index, void *user_data)
+{
+    focus_test_stream_t *stream = (focus_test_stream_t *)user_data;
+
+    if (index >= PREVIEW_BUF_NUM) {
+        CDBG_ERROR("%s: invalid buf index %u", __func__, index);
+        return -1;
+    }
+    __atomic_add_fetch(stream->invalidates, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* record frame_idx and focus state of the super buf, return bufs to kernel */
+static void focus_test_cb(mm_camera_super_buf_t *bufs, void *user_data)
+{
+    focus_test_obj_t *obj = (focus_test_obj_t *)user_data;
+    cam_autofocus_state_t state = CAM_AF_NOT_FOCUSED;
+    uint32_t frame_idx = 0;
+    int i;
+
+    for (i = 0; i < bufs->num_bufs; i++) {
+        if (bufs->bufs[i]->stream_id == obj->streams[1].s_id) {
+            cam_metadata_info_t *meta = (cam_metadata_info_t *)bufs->bufs[i]->buffer;
+            frame_idx = bufs->bufs[i]->frame_idx;
+            if (meta->is_focus_valid) {
+                state = meta->focus_data.focus_state;
+            }
+        }
+        if (MM_CAMERA_OK != obj->cam->ops->qbuf(bufs->camera_handle, bufs->ch_id,
+                                                bufs->bufs[i])) {
+            CDBG_ERROR("%s: qbuf failed", __func__);
+        }
+    }
+
+    pthread_mutex_lock(&obj->lock);
+    if (obj->num_got < FOCUS_TEST_MAX_REQ) {
+        obj->got_frame_idx[obj->num_got] = frame_idx;
+        obj->got_state[obj->num_got] = state;
+    }
+    obj->num_got++;
+    pthread_cond_signal(&obj->cond);
+    pthread_mutex_unlock(&obj->lock);
+}
+
+static int focus_test_add_stream(focus_test_obj_t *obj, cam_stream_type_t type)
+{
+    focus_test_stream_t *stream = &obj->streams[obj->num_streams];
+    mm_camera_stream_config_t config;
+    cam_capability_t *cap = (cam_capability_t *)obj->cap_buf.mem_info.data;
+    cam_stream_info_t *info;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->invalidates = &obj->invalidates;
+    stream->s_id = obj->cam->ops->add_stream(obj->cam->camera_handle, obj->ch_id);
+    if (0 == stream->s_id) {
+        CDBG_ERROR("%s: add stream failed", __func__);
+        return -1;
+    }
+    if (0 != focus_test_alloc(&stream->info_buf, sizeof(cam_stream_info_t)) ||
+        MM_CAMERA_OK != obj->cam->ops->map_stream_buf(obj->cam->camera_handle,
+                                                      obj->ch_id, stream->s_id,
+                                                      CAM_MAPPING_BUF_TYPE_STREAM_INFO,
+                                                      0, -1,
+                                                      stream->info_buf.mem_info.fd,
+                                                      stream->info_buf.mem_info.size)) {
+        CDBG_ERROR("%s: map stream info failed", __func__);
+        focus_test_free(&stream->info_buf);
+        obj->cam->ops->delete_stream(obj->cam->camera_handle, obj->ch_id, stream->s_id);
+        return -1;
+    }
+    /* counted from here on, so cleanup covers it on failure */
+    obj->num_streams++;
+
+    info = (cam_stream_info_t *)stream->info_buf.mem_info.data;
+    memset(info, 0, sizeof(cam_stream_info_t));
+    info->stream_type = type;
+    info->streaming_mode = CAM_STREAMING_MODE_CONTINUOUS;
+    info->fmt = DEFAULT_PREVIEW_FORMAT;
+    if (CAM_STREAM_TYPE_METADATA == type) {
+        info->dim.width = sizeof(cam_metadata_info_t);
+        info->dim.height = 1;
+    } else {
+        info->dim.width = DEFAULT_PREVIEW_WIDTH;
+        info->dim.height = DEFAULT_PREVIEW_HEIGHT;
+    }
+    info->bundle_id = obj->ch_id;
+
+    memset(&config, 0, sizeof(config));
+    config.stream_info = info;
+    config.padding_info = cap->padding_info;
+    config.mem_vtbl.get_bufs = focus_test_get_bufs;
+    config.mem_vtbl.put_bufs = focus_test_put_bufs;
+    if (CAM_STREAM_TYPE_METADATA == type) {
+        config.mem_vtbl.invalidate_buf = focus_test_invalidate_buf;
+    }
+    config.mem_vtbl.user_data = stream;
+    config.stream_cb = NULL;
+    config.userdata = obj;
+    if (MM_CAMERA_OK != obj->cam->ops->config_stream(obj->cam->camera_handle,
+                                                     obj->ch_id, stream->s_id,
+                                                     &config)) {
+        CDBG_ERROR("%s: config stream failed", __func__);
+        return -1;
+    }
+    return 0;
+}
+
+static void focus_test_del_streams(focus_test_obj_t *obj)
+{
+    focus_test_stream_t *stream;
+    int i;
+
+    for (i = 0; i < obj->num_streams; i++) {
+        stream = &obj->streams[i];
+        obj->cam->ops->unmap_stream_buf(obj->cam->camera_handle, obj->ch_id,
+                                        stream->s_id,
+                                        CAM_MAPPING_BUF_TYPE_STREAM_INFO, 0, -1);
+        focus_test_free(&stream->info_buf);
+        obj->cam->ops->delete_stream(obj->cam->camera_handle, obj->ch_id,
+                                     stream->s_id);
+    }
+    obj->num_streams = 0;
+}
+
+/* frames 1..num_frames in order on both streams, empty file to stream freely */
+static int focus_test_write_trace(const char *path, uint32_t num_frames)
+{
+    FILE *fp = fopen(path, "w");
+    uint32_t i;
+
+    if (NULL == fp) {
+        CDBG_ERROR("%s: cannot open %s\n", __func__, path);
+        return -1;
+    }
+    for (i = 1; i <= num_frames; i++) {
+        fprintf(fp, "0:%u 1:%u\n", i, i);
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* check delivered super bufs against the case */
+static int focus_test_check(focus_test_obj_t *obj, const focus_test_case_t *tc,
+                            uint32_t invalidates)
+{
+    int i;
+
+    if (obj->num_got != tc->num_req) {
+        printf(" %-18s: %u super bufs, %d requested\n",
+               tc->name, obj->num_got, tc->num_req);
+        return -1;
+    }
+    for (i = 0; i < tc->num_req; i++) {
+        if (0 != tc->expected[i] && obj->got_frame_idx[i] != tc->expected[i]) {
+            printf(" %-18s: super buf %d is frame %u, %u expected\n",
+                   tc->name, i, obj->got_frame_idx[i], tc->expected[i]);
+            return -1;
+        }
+        if (0 == tc->expected[i] && CAM_AF_FOCUSED != obj->got_state[i]) {
+            printf(" %-18s: super buf %d (frame %u) not focused\n",
+                   tc->name, i, obj->got_frame_idx[i]);
+            return -1;
+        }
+        if (i > 0 && obj->got_frame_idx[i] <= obj->got_frame_idx[i - 1]) {
+            printf(" %-18s: super buf %d (frame %u) out of order\n",
+                   tc->name, i, obj->got_frame_idx[i]);
+            return -1;
+        }
+    }
+    if ((MM_CAMERA_SUPER_BUF_PRIORITY_FOCUS == tc->priority) != (invalidates > 0)) {
+        printf(" %-18s: metadata invalidated %u times\n", tc->name, invalidates);
+        return -1;
+    }
+    printf(" %-18s: frame", tc->name);
+    for (i = 0; i < tc->num_req; i++) {
+        printf(" %u (%s)", obj->got_frame_idx[i],
+               CAM_AF_FOCUSED == obj->got_state[i] ? "focused" : "scanning");
+    }
+    printf(", %u metadata invalidations\n", invalidates);
+    return 0;
+}
+
+/* queue frames in a burst mode channel as the ZSL channel does, then
+ * request super bufs as for a ZSL snapshot */
+static int focus_test_run(focus_test_obj_t *obj, const focus_test_case_t *tc)
+{
+    mm_camera_channel_attr_t attr;
+    struct timespec deadline;
+    uint32_t invalidates;
+    int rc = -1;
+
+    if (0 != focus_test_write_trace(obj->replay_path, tc->num_frames)) {
+        return -1;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.notify_mode = MM_CAMERA_SUPER_BUF_NOTIFY_BURST;
+    attr.look_back = 2;
+    attr.post_frame_skip = 1;
+    attr.water_mark = 2;
+    attr.priority = tc->priority;
+    obj->num_got = 0;
+    __atomic_store_n(&obj->invalidates, 0, __ATOMIC_RELAXED);
+    obj->ch_id = obj->cam->ops->add_channel(obj->cam->camera_handle, &attr,
+                                            focus_test_cb, obj);
+    if (0 == obj->ch_id) {
+        CDBG_ERROR("%s: add channel failed\n", __func__);
+        return -1;
+    }
+    if (0 != focus_test_add_stream(obj, CAM_STREAM_TYPE_PREVIEW) ||
+        0 != focus_test_add_stream(obj, CAM_STREAM_TYPE_METADATA)) {
+        goto del_streams;
+    }
+    if (MM_CAMERA_OK != obj->cam->ops->start_channel(obj->cam->camera_handle,
+                                                     obj->ch_id)) {
+        CDBG_ERROR("%s: start channel failed\n", __func__);
+        goto del_streams;
+    }
+
+    /* replay is done, or a few focus sweeps went by */
+    usleep(FOCUS_TEST_SETTLE_MS * 1000);
+    if (MM_CAMERA_OK != obj->cam->ops->request_super_buf(obj->cam->camera_handle,
+                                                         obj->ch_id, tc->num_req)) {
+        CDBG_ERROR("%s: request super buf failed\n", __func__);
+    } else {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += FOCUS_TEST_TIMEOUT_S;
+        pthread_mutex_lock(&obj->lock);
+        while (obj->num_got < tc->num_req &&
+               ETIMEDOUT != pthread_cond_timedwait(&obj->cond, &obj->lock, &deadline)) {
+        }
+        pthread_mutex_unlock(&obj->lock);
+    }
+
+    obj->cam->ops->stop_channel(obj->cam->camera_handle, obj->ch_id);
+    invalidates = __atomic_load_n(&obj->invalidates, __ATOMIC_RELAXED);
+    rc = focus_test_check(obj, tc, invalidates);
+
+del_streams:
+    focus_test_del_streams(obj);
+    obj->cam->ops->delete_channel(obj->cam->camera_handle, obj->ch_id);
+    return rc;
+}
+
+int main()
+{
+    static focus_test_obj_t obj;
+    int fd, i, rc = 0;
+
+    memset(&obj, 0, sizeof(obj));
+    pthread_mutex_init(&obj.lock, NULL);
+    pthread_cond_init(&obj.cond, NULL);
+
+    /* file is rewritten per case, sim reads it at frame source start */
+    snprintf(obj.replay_path, sizeof(obj.replay_path), "/tmp/mm-qcamera-focus-XXXXXX");
+    fd = mkstemp(obj.replay_path);
+    if (fd < 0) {
+        CDBG_ERROR("%s: mkstemp failed %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    close(fd);
+
+    /* test is about the interface, always on the simulated backend */
+    setenv("MM_CAMERA_BACKEND", "sim", 1);
+    setenv("MM_CAMERA_SIM_REPLAY", obj.replay_path, 1);
+    setenv("MM_CAMERA_SIM_AF_PERIOD", FOCUS_TEST_AF_PERIOD, 1);
+    setenv("MM_CAMERA_SIM_AF_SCAN", FOCUS_TEST_AF_SCAN, 1);
+    setenv("MM_CAMERA_SIM_FPS", FOCUS_TEST_FPS, 0);
+
+    if (get_num_of_cameras() <= 0) {
+        CDBG_ERROR("%s: no camera\n", __func__);
+        rc = -1;
+        goto remove_trace;
+    }
+    obj.cam = camera_open(0);
+    if (NULL == obj.cam) {
+        CDBG_ERROR("%s: camera_open failed\n", __func__);
+        rc = -1;
+        goto remove_trace;
+    }
+    if (0 != focus_test_alloc(&obj.cap_buf, sizeof(cam_capability_t)) ||
+        MM_CAMERA_OK != obj.cam->ops->map_buf(obj.cam->camera_handle,
+                                              CAM_MAPPING_BUF_TYPE_CAPABILITY,
+                                              obj.cap_buf.mem_info.fd,
+                                              obj.cap_buf.mem_info.size) ||
+        MM_CAMERA_OK != obj.cam->ops->query_capability(obj.cam->camera_handle)) {
+        CDBG_ERROR("%s: query capability failed\n", __func__);
+        rc = -1;
+        goto close_camera;
+    }
+
+    printf("\n Verifying focus priority super buf queue...\n");
+    for (i = 0; i < (int)(sizeof(focus_test_cases) / sizeof(focus_test_cases[0])); i++) {
+        if (0 != focus_test_run(&obj, &focus_test_cases[i])) {
+            rc = -1;
+        }
+    }
+    printf("\n%s\n", (0 == rc) ? "Passed" : "Failed");
+
+close_camera:
+    if (NULL != obj.cap_buf.mem_info.data) {
+        obj.cam->ops->unmap_buf(obj.cam->camera_handle, CAM_MAPPING_BUF_TYPE_CAPABILITY);
+        focus_test_free(&obj.cap_buf);
+    }
+    obj.cam->ops->close_camera(obj.cam->camera_handle);
+remove_trace:
+    unlink(obj.replay_path);
+    return rc;
+}
@@ -38,6 +38,7 @@
 #include "OMX_Component.h"
 #include "QOMX_JpegExtensions.h"
 #include <semaphore.h>
+#include <time.h>
 
 typedef struct {
     struct cam_list list;
@@ -71,9 +72,10 @@ typedef struct {
     uint32_t client_hdl;           /* client handler */
     uint32_t jobId;                /* job ID */
     mm_jpeg_job job;               /* job description */
-    pthread_t cb_pid;              /* cb thread heandler*/
+    struct timespec done_ts;       /* time when job is done, for cb latency */
 
     void* jpeg_obj;                /* ptr to mm_jpeg_obj */
+    void* session;                 /* ptr to OMX session the job is bound to */
     jpeg_job_status_t job_status;  /* job status */
     uint8_t thumbnail_dropped;     /* flag indicating if thumbnail is dropped */
     int32_t jpeg_size;             /* the size of jpeg output after job is done */
@@ -100,6 +102,19 @@ typedef struct {
     mm_jpeg_queue_t job_queue;      /* queue for job to do */
 } mm_jpeg_job_cmd_thread_t;
 
+typedef struct {
+    pthread_t pid;                  /* notify thread ID */
+    sem_t notify_sem;               /* semaphore for notify thread */
+    pthread_mutex_t cb_lock;        /* lock for job in callback */
+    pthread_cond_t cb_cond;         /* signaled when a callback returns */
+    mm_jpeg_job_q_node_t* cb_node;  /* job whose callback is in progress */
+
+    /* job done -> callback delivered latency stats */
+    uint32_t num_cbs;               /* num of callbacks delivered */
+    uint64_t sum_latency_us;        /* sum of cb latency in us */
+    uint64_t max_latency_us;        /* max cb latency in us */
+} mm_jpeg_notify_thread_t;
+
 typedef enum {
     MM_JPEG_EVENT_MASK_JPEG_DONE    = 0x00000001, /* jpeg job is done */
     MM_JPEG_EVENT_MASK_JPEG_ABORT   = 0x00000002, /* jpeg job is aborted */
@@ -113,6 +128,72 @@ typedef struct {
     int omx_value2;  /* only valid when evt_mask == MM_JPEG_EVENT_MASK_CMD_COMPLETE */
 } mm_jpeg_evt_t;
 
+/* max num of OMX encoder sessions, bounded by OMX_COMP_MAX_INSTANCES
+ * of the OMX core */
+#define MM_JPEG_MAX_SESSIONS     3
+/* default num of sessions if not overridden by
+ * persist.camera.jpeg.sessions */
+#define MM_JPEG_DEFAULT_SESSIONS 2
+
+/* num of OMX ports of the encoder: main input, output, thumbnail input */
+#define MM_JPEG_NUM_OMX_PORTS    3
+/* max num of buffers kept registered per port of a warm session */
+#define MM_JPEG_MAX_CACHED_BUFS  8
+
+typedef struct {
+    int fd;                         /* fd of the buffer, 0 if from heap */
+    uint8_t* vaddr;                 /* vaddr of the buffer */
+    uint32_t len;                   /* length of the buffer */
+    QOMX_BUFFER_INFO buf_info;      /* app data passed in OMX_UseBuffer */
+    OMX_BUFFERHEADERTYPE* buf_header; /* header, NULL if not registered yet */
+} mm_jpeg_omx_buf_cache_entry_t;
+
+typedef struct {
+    uint8_t num_bufs;               /* num of valid entries */
+    uint8_t next_evict;             /* entry to be evicted when full */
+    mm_jpeg_omx_buf_cache_entry_t bufs[MM_JPEG_MAX_CACHED_BUFS];
+} mm_jpeg_omx_port_cache_t;
+
+/* geometry and format a warm session is configured with */
+typedef struct {
+    uint8_t src_img_num;
+    jpeg_enc_src_img_fmt_t img_fmt[JPEG_SRC_IMAGE_TYPE_MAX];
+    mm_jpeg_color_format color_format[JPEG_SRC_IMAGE_TYPE_MAX];
+    cam_dimension_t src_dim[JPEG_SRC_IMAGE_TYPE_MAX];
+    cam_dimension_t out_dim[JPEG_SRC_IMAGE_TYPE_MAX];
+    cam_rect_t crop[JPEG_SRC_IMAGE_TYPE_MAX];
+    uint32_t quality[JPEG_SRC_IMAGE_TYPE_MAX];
+    uint32_t frame_len[JPEG_SRC_IMAGE_TYPE_MAX];
+} mm_jpeg_session_cfg_t;
+
+typedef struct {
+    uint8_t idx;                    /* session index */
+    uint8_t is_busy;                /* flag: if a job is bound to the session */
+    uint32_t job_id;                /* job ID bound to the session */
+    void* jpeg_obj;                 /* ptr to mm_jpeg_obj */
+
+    /* OMX related */
+    OMX_HANDLETYPE omx_handle;      /* handle to omx engine */
+    pthread_mutex_t omx_evt_lock;
+    pthread_cond_t omx_evt_cond;
+    mm_jpeg_evt_t omx_evt_rcvd;
+
+    /* warm session: component stays in Executing between jobs of
+     * same cfg, with buffers kept registered */
+    pthread_mutex_t omx_lock;       /* serializes OMX calls on the session */
+    uint8_t keep_warm;              /* flag: if warm session mode is enabled */
+    OMX_STATETYPE omx_state;        /* state the component is in */
+    mm_jpeg_session_cfg_t cfg;      /* cfg of the component when warm */
+    mm_jpeg_omx_port_cache_t port_cache[MM_JPEG_NUM_OMX_PORTS];
+    uint32_t buf_gen;               /* buf_gen of the jobs port_cache is from */
+
+    /* stats */
+    uint32_t num_jobs;              /* num of jobs encoded */
+    uint32_t num_starts;            /* num of Loaded->Executing transitions */
+    uint32_t num_port_cycles;       /* num of port disable/enable cycles */
+    uint32_t num_use_bufs;          /* num of OMX_UseBuffer calls */
+} mm_jpeg_session_t;
+
 #define MAX_JPEG_CLIENT_NUM 8
 typedef struct mm_jpeg_obj_t {
     /* ClientMgr */
@@ -125,15 +206,13 @@ typedef struct mm_jpeg_obj_t {
     mm_jpeg_queue_t ongoing_job_q;                  /* queue for ongoing jobs */
 
     /* Notifier */
-    mm_jpeg_queue_t cb_q;                           /* queue for CB threads */
+    mm_jpeg_queue_t cb_q;                           /* queue for jobs pending CB */
+    mm_jpeg_notify_thread_t notify_mgr;             /* thread delivering CBs in order */
 
     /* OMX related */
-    OMX_HANDLETYPE omx_handle;                      /* handle to omx engine */
     OMX_CALLBACKTYPE omx_callbacks;                 /* callbacks to omx engine */
-
-    pthread_mutex_t omx_evt_lock;
-    pthread_cond_t omx_evt_cond;
-    mm_jpeg_evt_t omx_evt_rcvd;
+    uint32_t num_sessions;                          /* num of valid sessions */
+    mm_jpeg_session_t sessions[MM_JPEG_MAX_SESSIONS]; /* concurrent OMX sessions */
 } mm_jpeg_obj;
 
 extern int32_t mm_jpeg_init(mm_jpeg_obj *my_obj);
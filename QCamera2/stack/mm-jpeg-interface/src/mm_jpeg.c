@@ -35,21 +35,19 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fcntl.h>
 #include <poll.h>
 #include <semaphore.h>
+#include <cutils/properties.h>
 
 #include "mm_jpeg_dbg.h"
 #include "mm_jpeg_interface.h"
 #include "mm_jpeg.h"
 
-/* define max num of supported concurrent jpeg jobs by OMX engine.
- * Current, only one per time */
-#define NUM_MAX_JPEG_CNCURRENT_JOBS 1
-
 #define INPUT_PORT_MAIN         0
 #define INPUT_PORT_THUMBNAIL    2
 #define OUTPUT_PORT             1
 
-void mm_jpeg_job_wait_for_event(mm_jpeg_obj *my_obj, uint32_t evt_mask);
-void mm_jpeg_job_wait_for_cmd_complete(mm_jpeg_obj *my_obj,
+void mm_jpeg_job_wait_for_event(mm_jpeg_session_t *session, uint32_t evt_mask);
+static void mm_jpeg_session_teardown(mm_jpeg_session_t *session);
+void mm_jpeg_job_wait_for_cmd_complete(mm_jpeg_session_t *session,
                                        int cmd,
                                        int status);
 OMX_ERRORTYPE mm_jpeg_etbdone(OMX_HANDLETYPE hComponent,
@@ -69,80 +67,406 @@ int32_t mm_jpeg_queue_update_flag(mm_jpeg_queue_t* queue, uint32_t job_id, uint8
 mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_client_id(mm_jpeg_queue_t* queue, uint32_t client_hdl);
 mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_job_id(mm_jpeg_queue_t* queue, uint32_t job_id);
 
+/* get num of OMX sessions to open, from persist.camera.jpeg.sessions */
+static uint32_t mm_jpeg_get_num_sessions(void)
+{
+    char prop[PROPERTY_VALUE_MAX];
+    int num_sessions;
+
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.jpeg.sessions", prop, "0");
+    num_sessions = atoi(prop);
+    if (num_sessions <= 0) {
+        num_sessions = MM_JPEG_DEFAULT_SESSIONS;
+    } else if (num_sessions > MM_JPEG_MAX_SESSIONS) {
+        num_sessions = MM_JPEG_MAX_SESSIONS;
+    }
+    return (uint32_t)num_sessions;
+}
+
+/* check if OMX sessions stay warm between jobs, from persist.camera.jpeg.warm */
+static uint8_t mm_jpeg_get_keep_warm(void)
+{
+    char prop[PROPERTY_VALUE_MAX];
+
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.jpeg.warm", prop, "1");
+    return (atoi(prop) > 0) ? 1 : 0;
+}
+
 int32_t mm_jpeg_omx_load(mm_jpeg_obj* my_obj)
 {
     int32_t rc = 0;
+    uint32_t i;
+    uint32_t num_sessions = mm_jpeg_get_num_sessions();
+    uint8_t keep_warm = mm_jpeg_get_keep_warm();
+    mm_jpeg_session_t *session = NULL;
+    char comp_name[PROPERTY_VALUE_MAX];
+
+    /* encoder component can be overridden, e.g. with the stub component */
+    memset(comp_name, 0, sizeof(comp_name));
+    property_get("persist.camera.jpeg.component", comp_name,
+                 "OMX.qcom.image.jpeg.encoder");
+
+    rc = OMX_Init();
+    if (0 != rc) {
+        CDBG_ERROR("%s : OMX_Init failed (%d)",__func__, rc);
+        return rc;
+    }
 
     my_obj->omx_callbacks.EmptyBufferDone = mm_jpeg_etbdone;
     my_obj->omx_callbacks.FillBufferDone = mm_jpeg_ftbdone;
     my_obj->omx_callbacks.EventHandler = mm_jpeg_handle_omx_event;
-    rc = OMX_GetHandle(&my_obj->omx_handle,
-                       "OMX.qcom.image.jpeg.encoder",
-                       (void*)my_obj,
-                       &my_obj->omx_callbacks);
 
-    if (0 != rc) {
-        CDBG_ERROR("%s : OMX_GetHandle failed (%d)",__func__, rc);
-        return rc;
+    /* each session owns one instance of the encoder component, and is passed
+     * as app data so that OMX callbacks can be routed back to it */
+    my_obj->num_sessions = 0;
+    for (i = 0; i < num_sessions; i++) {
+        session = &my_obj->sessions[i];
+        rc = OMX_GetHandle(&session->omx_handle,
+                           comp_name,
+                           (void*)session,
+                           &my_obj->omx_callbacks);
+        if (0 != rc) {
+            CDBG_ERROR("%s : OMX_GetHandle failed for session %d (%d)",
+                       __func__, i, rc);
+            session->omx_handle = NULL;
+            break;
+        }
+        session->omx_state = OMX_StateLoaded;
+        session->keep_warm = keep_warm;
+        memset(session->port_cache, 0, sizeof(session->port_cache));
+        session->num_jobs = 0;
+        session->num_starts = 0;
+        session->num_port_cycles = 0;
+        session->num_use_bufs = 0;
+        my_obj->num_sessions++;
     }
 
-    rc = OMX_Init();
-    if (0 != rc) {
-        CDBG_ERROR("%s : OMX_Init failed (%d)",__func__, rc);
+    if (my_obj->num_sessions == 0) {
+        OMX_Deinit();
+        return rc;
     }
 
-    return rc;
+    CDBG_HIGH("%s: %d jpeg sessions opened on %s, keep_warm = %d",
+              __func__, my_obj->num_sessions, comp_name, keep_warm);
+    return 0;
 }
 
 int32_t mm_jpeg_omx_unload(mm_jpeg_obj *my_obj)
 {
     int32_t rc = 0;
+    uint32_t i;
+
+    mm_jpeg_session_t *session = NULL;
+
+    for (i = 0; i < my_obj->num_sessions; i++) {
+        session = &my_obj->sessions[i];
+        if (NULL != session->omx_handle) {
+            pthread_mutex_lock(&session->omx_lock);
+            mm_jpeg_session_teardown(session);
+            pthread_mutex_unlock(&session->omx_lock);
+            CDBG_HIGH("%s: session %d: jobs %d, starts %d, port cycles %d, UseBuffer calls %d",
+                      __func__, i, session->num_jobs, session->num_starts,
+                      session->num_port_cycles, session->num_use_bufs);
+            OMX_FreeHandle(session->omx_handle);
+            session->omx_handle = NULL;
+        }
+    }
+    my_obj->num_sessions = 0;
+
     rc = OMX_Deinit();
     return rc;
 }
 
-int32_t mm_jpeg_clean_omx_job(mm_jpeg_obj *my_obj, mm_jpeg_job_entry* job_entry)
+/* get a free session to bind a job to. Must be called with job_lock held.
+ * returns NULL if all sessions are busy */
+static mm_jpeg_session_t *mm_jpeg_get_free_session(mm_jpeg_obj *my_obj)
+{
+    uint32_t i;
+
+    for (i = 0; i < my_obj->num_sessions; i++) {
+        if (!my_obj->sessions[i].is_busy) {
+            return &my_obj->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+/* unbind job from its session. Must be called with job_lock held */
+static void mm_jpeg_release_session(mm_jpeg_session_t *session)
+{
+    if (NULL != session) {
+        session->is_busy = 0;
+        session->job_id = 0;
+    }
+}
+
+/* reset last OMX event before sending a cmd, so that a stale event from
+ * an earlier cmd or job is not taken as its completion */
+static void mm_jpeg_session_reset_evt(mm_jpeg_session_t *session)
+{
+    pthread_mutex_lock(&session->omx_evt_lock);
+    memset(&session->omx_evt_rcvd, 0, sizeof(mm_jpeg_evt_t));
+    pthread_mutex_unlock(&session->omx_evt_lock);
+}
+
+/* set num of buffers to be registered on a port */
+static void mm_jpeg_omx_config_buf_count(mm_jpeg_session_t *session,
+                                         int port_idx,
+                                         uint32_t count)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE port;
+
+    memset(&port, 0, sizeof(port));
+    port.nPortIndex = port_idx;
+    OMX_GetParameter(session->omx_handle, OMX_IndexParamPortDefinition, &port);
+    port.nBufferCountActual = count;
+    OMX_SetParameter(session->omx_handle, OMX_IndexParamPortDefinition, &port);
+}
+
+/* register cached buffers of a port that are not registered yet */
+static int32_t mm_jpeg_omx_register_port_bufs(mm_jpeg_session_t *session,
+                                              int port_idx)
+{
+    uint8_t i;
+    OMX_ERRORTYPE ret;
+    mm_jpeg_omx_port_cache_t *cache = &session->port_cache[port_idx];
+    mm_jpeg_omx_buf_cache_entry_t *entry = NULL;
+
+    for (i = 0; i < cache->num_bufs; i++) {
+        entry = &cache->bufs[i];
+        if (NULL != entry->buf_header) {
+            continue;
+        }
+        ret = OMX_UseBuffer(session->omx_handle,
+                            &entry->buf_header,
+                            port_idx,
+                            (OUTPUT_PORT == port_idx) ? NULL : &entry->buf_info,
+                            entry->len,
+                            (void *)entry->vaddr);
+        session->num_use_bufs++;
+        if (OMX_ErrorNone != ret) {
+            CDBG_ERROR("%s: UseBuffer failed on port %d (%d)", __func__, port_idx, ret);
+            entry->buf_header = NULL;
+            return -1;
+        }
+        CDBG("%s: port_idx=%d, fd=%d, len=%d, ptr=%p",
+             __func__, port_idx, entry->fd, entry->len, entry->vaddr);
+    }
+    return 0;
+}
+
+/* free registered buffers of a port */
+static void mm_jpeg_omx_free_port_bufs(mm_jpeg_session_t *session, int port_idx)
+{
+    uint8_t i;
+    mm_jpeg_omx_port_cache_t *cache = &session->port_cache[port_idx];
+
+    for (i = 0; i < cache->num_bufs; i++) {
+        if (NULL != cache->bufs[i].buf_header) {
+            OMX_FreeBuffer(session->omx_handle, port_idx, cache->bufs[i].buf_header);
+            cache->bufs[i].buf_header = NULL;
+        }
+    }
+}
+
+/* look up a buffer in the cache of a port, returns NULL if not cached */
+static mm_jpeg_omx_buf_cache_entry_t *mm_jpeg_omx_find_cached_buf(mm_jpeg_session_t *session,
+                                                                  int port_idx,
+                                                                  int fd,
+                                                                  uint8_t *vaddr,
+                                                                  uint32_t len)
+{
+    uint8_t i;
+    mm_jpeg_omx_port_cache_t *cache = &session->port_cache[port_idx];
+
+    for (i = 0; i < cache->num_bufs; i++) {
+        if (cache->bufs[i].fd == fd &&
+            cache->bufs[i].vaddr == vaddr &&
+            cache->bufs[i].len == len) {
+            return &cache->bufs[i];
+        }
+    }
+    return NULL;
+}
+
+/* add a buffer to the cache of a port if not there yet. If component is
+ * already running, the port is cycled to register the new buffer set */
+static int32_t mm_jpeg_omx_cache_buf(mm_jpeg_session_t *session,
+                                     int port_idx,
+                                     int fd,
+                                     uint8_t *vaddr,
+                                     uint32_t len)
 {
     int32_t rc = 0;
-    uint8_t i, j;
-
-    OMX_SendCommand(my_obj->omx_handle, OMX_CommandStateSet, OMX_StateIdle, NULL);
-    OMX_SendCommand(my_obj->omx_handle, OMX_CommandStateSet, OMX_StateLoaded, NULL);
-
-    /* free buffers used in OMX processing */
-    for (i = 0; i < JPEG_SRC_IMAGE_TYPE_MAX; i++) {
-        for (j = 0; j < job_entry->src_bufs[i].num_bufs; j++) {
-            if (NULL != job_entry->src_bufs[i].bufs[j].buf_header) {
-                OMX_FreeBuffer(my_obj->omx_handle,
-                               job_entry->src_bufs[i].bufs[j].portIdx,
-                               job_entry->src_bufs[i].bufs[j].buf_header);
-            }
+    uint8_t idx;
+    mm_jpeg_omx_port_cache_t *cache = &session->port_cache[port_idx];
+    mm_jpeg_omx_buf_cache_entry_t *entry = NULL;
+
+    if (NULL != mm_jpeg_omx_find_cached_buf(session, port_idx, fd, vaddr, len)) {
+        return 0;
+    }
+
+    if (OMX_StateExecuting == session->omx_state) {
+        CDBG("%s: disable port %d for new buf", __func__, port_idx);
+        mm_jpeg_session_reset_evt(session);
+        OMX_SendCommand(session->omx_handle, OMX_CommandPortDisable, port_idx, NULL);
+        mm_jpeg_omx_free_port_bufs(session, port_idx);
+        mm_jpeg_job_wait_for_cmd_complete(session, OMX_CommandPortDisable, port_idx);
+    }
+
+    /* evict round robin when cache is full */
+    if (cache->num_bufs < MM_JPEG_MAX_CACHED_BUFS) {
+        idx = cache->num_bufs++;
+    } else {
+        idx = cache->next_evict;
+        cache->next_evict = (idx + 1) % MM_JPEG_MAX_CACHED_BUFS;
+    }
+    entry = &cache->bufs[idx];
+    memset(entry, 0, sizeof(mm_jpeg_omx_buf_cache_entry_t));
+    entry->fd = fd;
+    entry->vaddr = vaddr;
+    entry->len = len;
+    entry->buf_info.fd = fd;
+    entry->buf_info.offset = 0;
+
+    if (OMX_StateExecuting == session->omx_state) {
+        mm_jpeg_omx_config_buf_count(session, port_idx, cache->num_bufs);
+        mm_jpeg_session_reset_evt(session);
+        OMX_SendCommand(session->omx_handle, OMX_CommandPortEnable, port_idx, NULL);
+        rc = mm_jpeg_omx_register_port_bufs(session, port_idx);
+        if (0 != rc) {
+            /* port will not come up, force a full restart on next job */
+            session->omx_state = OMX_StateInvalid;
+            return rc;
         }
+        mm_jpeg_job_wait_for_cmd_complete(session, OMX_CommandPortEnable, port_idx);
+        session->num_port_cycles++;
     }
-    OMX_FreeBuffer(my_obj->omx_handle,
-                   job_entry->sink_buf.portIdx,
-                   job_entry->sink_buf.buf_header);
 
     return rc;
 }
 
-int32_t mm_jpeg_omx_abort_job(mm_jpeg_obj *my_obj, mm_jpeg_job_entry* job_entry)
+/* bring component from Loaded to Executing, registering all cached buffers */
+static int32_t mm_jpeg_session_start(mm_jpeg_session_t *session)
 {
     int32_t rc = 0;
+    int port_idx;
 
-    OMX_SendCommand(my_obj->omx_handle, OMX_CommandFlush, 0, NULL);
-    mm_jpeg_job_wait_for_event(my_obj,
-        MM_JPEG_EVENT_MASK_JPEG_DONE|MM_JPEG_EVENT_MASK_JPEG_ABORT|MM_JPEG_EVENT_MASK_JPEG_ERROR);
-    CDBG("%s:waitForEvent: OMX_CommandFlush: DONE", __func__);
+    for (port_idx = 0; port_idx < MM_JPEG_NUM_OMX_PORTS; port_idx++) {
+        if (session->port_cache[port_idx].num_bufs > 0) {
+            mm_jpeg_omx_config_buf_count(session, port_idx,
+                                         session->port_cache[port_idx].num_bufs);
+        }
+    }
 
-    /* clean omx job */
-    mm_jpeg_clean_omx_job(my_obj, job_entry);
+    CDBG("%s: Send command to idle\n", __func__);
+    mm_jpeg_session_reset_evt(session);
+    OMX_SendCommand(session->omx_handle, OMX_CommandStateSet, OMX_StateIdle, NULL);
+    for (port_idx = 0; port_idx < MM_JPEG_NUM_OMX_PORTS; port_idx++) {
+        rc = mm_jpeg_omx_register_port_bufs(session, port_idx);
+        if (0 != rc) {
+            session->omx_state = OMX_StateInvalid;
+            return rc;
+        }
+    }
+    mm_jpeg_job_wait_for_cmd_complete(session, OMX_CommandStateSet, OMX_StateIdle);
+    session->omx_state = OMX_StateIdle;
+    CDBG("%s: State changed to OMX_StateIdle\n", __func__);
+
+    CDBG("%s: Send command to executing\n", __func__);
+    mm_jpeg_session_reset_evt(session);
+    OMX_SendCommand(session->omx_handle, OMX_CommandStateSet, OMX_StateExecuting, NULL);
+    mm_jpeg_job_wait_for_cmd_complete(session, OMX_CommandStateSet, OMX_StateExecuting);
+    session->omx_state = OMX_StateExecuting;
+    session->num_starts++;
+
+    return rc;
+}
+
+/* bring component back to Loaded and release all registered buffers.
+ * Waits for OMX events, so must not be called from OMX callbacks */
+static void mm_jpeg_session_teardown(mm_jpeg_session_t *session)
+{
+    int port_idx;
+
+    if (OMX_StateExecuting == session->omx_state) {
+        mm_jpeg_session_reset_evt(session);
+        OMX_SendCommand(session->omx_handle, OMX_CommandStateSet, OMX_StateIdle, NULL);
+        mm_jpeg_job_wait_for_cmd_complete(session, OMX_CommandStateSet, OMX_StateIdle);
+        session->omx_state = OMX_StateIdle;
+    }
+
+    if (OMX_StateIdle == session->omx_state) {
+        mm_jpeg_session_reset_evt(session);
+        OMX_SendCommand(session->omx_handle, OMX_CommandStateSet, OMX_StateLoaded, NULL);
+        for (port_idx = 0; port_idx < MM_JPEG_NUM_OMX_PORTS; port_idx++) {
+            mm_jpeg_omx_free_port_bufs(session, port_idx);
+        }
+        mm_jpeg_job_wait_for_cmd_complete(session, OMX_CommandStateSet, OMX_StateLoaded);
+    } else {
+        /* component failed half way, release whatever got registered */
+        for (port_idx = 0; port_idx < MM_JPEG_NUM_OMX_PORTS; port_idx++) {
+            mm_jpeg_omx_free_port_bufs(session, port_idx);
+        }
+    }
+
+    memset(session->port_cache, 0, sizeof(session->port_cache));
+    session->omx_state = OMX_StateLoaded;
+}
+
+/* get geometry and format of a job, to decide if a warm session can take it */
+static void mm_jpeg_session_get_cfg(mm_jpeg_encode_job* job, mm_jpeg_session_cfg_t *cfg)
+{
+    uint8_t i;
+    src_image_buffer_config *src_imgs = &job->encode_parm.buf_info.src_imgs;
+    src_image_buffer_info *src_buf = NULL;
+
+    /* zero out padding as well, cfg is compared by memcmp */
+    memset(cfg, 0, sizeof(mm_jpeg_session_cfg_t));
+    cfg->src_img_num = src_imgs->src_img_num;
+    for (i = 0; i < src_imgs->src_img_num && i < JPEG_SRC_IMAGE_TYPE_MAX; i++) {
+        src_buf = &src_imgs->src_img[i];
+        cfg->img_fmt[i] = src_buf->img_fmt;
+        cfg->color_format[i] = src_buf->color_format;
+        cfg->src_dim[i] = src_buf->src_dim;
+        cfg->out_dim[i] = src_buf->out_dim;
+        cfg->crop[i] = src_buf->crop;
+        cfg->quality[i] = src_buf->quality;
+        if (JPEG_SRC_IMAGE_FMT_YUV == src_buf->img_fmt) {
+            cfg->frame_len[i] = src_buf->src_image[0].offset.frame_len;
+        } else {
+            cfg->frame_len[i] = src_buf->bit_stream[0].buf_size;
+        }
+    }
+}
+
+int32_t mm_jpeg_omx_abort_job(mm_jpeg_session_t *session, mm_jpeg_job_entry* job_entry)
+{
+    int32_t rc = 0;
+
+    /* wait if job mgr thread is still setting up the job */
+    pthread_mutex_lock(&session->omx_lock);
+
+    /* buffers come back before flush completes */
+    if (OMX_StateExecuting == session->omx_state) {
+        OMX_SendCommand(session->omx_handle, OMX_CommandFlush, OMX_ALL, NULL);
+        mm_jpeg_job_wait_for_event(session,
+            MM_JPEG_EVENT_MASK_JPEG_DONE|MM_JPEG_EVENT_MASK_JPEG_ABORT|
+            MM_JPEG_EVENT_MASK_JPEG_ERROR|MM_JPEG_EVENT_MASK_CMD_COMPLETE);
+        CDBG("%s:waitForEvent: OMX_CommandFlush: DONE", __func__);
+    }
+
+    /* do not trust component state after abort, restart it for next job */
+    mm_jpeg_session_teardown(session);
+    pthread_mutex_unlock(&session->omx_lock);
 
     return rc;
 }
 
 /* TODO: needs revisit after omx lib supports multi src buffers */
-int32_t mm_jpeg_omx_config_main_buffer_offset(mm_jpeg_obj* my_obj,
+int32_t mm_jpeg_omx_config_main_buffer_offset(mm_jpeg_session_t* session,
                                               src_image_buffer_info *src_buf,
                                               uint8_t is_video_frame)
 {
@@ -154,7 +478,7 @@ int32_t mm_jpeg_omx_config_main_buffer_offset(mm_jpeg_obj* my_obj,
     qomx_buffer_offset buffer_offset;
 
     for (i = 0; i < src_buf->num_bufs; i++) {
-        OMX_GetExtensionIndex(my_obj->omx_handle,
+        OMX_GetExtensionIndex(session->omx_handle,
                               "omx.qcom.jpeg.exttype.buffer_offset",
                               &buf_offset_idx);
         memset(&buffer_offset, 0, sizeof(buffer_offset));
@@ -178,7 +502,7 @@ int32_t mm_jpeg_omx_config_main_buffer_offset(mm_jpeg_obj* my_obj,
             }
             CDBG("%s: idx=%d, yOffset =%d, cbcrOffset =%d, totalSize = %d\n",
                  __func__, i, buffer_offset.yOffset, buffer_offset.cbcrOffset, buffer_offset.totalSize);
-            OMX_SetParameter(my_obj->omx_handle, buf_offset_idx, &buffer_offset);
+            OMX_SetParameter(session->omx_handle, buf_offset_idx, &buffer_offset);
 
             /* set acbcr (special case for video-sized live snapshot)*/
             if (is_video_frame) {
@@ -187,8 +511,8 @@ int32_t mm_jpeg_omx_config_main_buffer_offset(mm_jpeg_obj* my_obj,
                 buffer_offset.cbcrOffset = src_buf->src_image[i].offset.mp[0].offset +
                                           src_buf->src_image[i].offset.mp[0].len +
                                           src_buf->src_image[i].offset.mp[1].offset;;
-                OMX_GetExtensionIndex(my_obj->omx_handle,"omx.qcom.jpeg.exttype.acbcr_offset",&buf_offset_idx);
-                OMX_SetParameter(my_obj->omx_handle, buf_offset_idx, &buffer_offset);
+                OMX_GetExtensionIndex(session->omx_handle,"omx.qcom.jpeg.exttype.acbcr_offset",&buf_offset_idx);
+                OMX_SetParameter(session->omx_handle, buf_offset_idx, &buffer_offset);
             }
             break;
         case JPEG_SRC_IMAGE_FMT_BITSTREAM:
@@ -199,7 +523,7 @@ int32_t mm_jpeg_omx_config_main_buffer_offset(mm_jpeg_obj* my_obj,
                 src_buf->bit_stream[i].buf_size;
             CDBG("%s: idx=%d, yOffset =%d, cbcrOffset =%d, totalSize = %d\n",
                  __func__, i, buffer_offset.yOffset, buffer_offset.cbcrOffset, buffer_offset.totalSize);
-            OMX_SetParameter(my_obj->omx_handle, buf_offset_idx, &buffer_offset);
+            OMX_SetParameter(session->omx_handle, buf_offset_idx, &buffer_offset);
             break;
         default:
             break;
@@ -211,7 +535,7 @@ int32_t mm_jpeg_omx_config_main_buffer_offset(mm_jpeg_obj* my_obj,
 }
 
 /* TODO: needs revisit after omx lib supports multi src buffers */
-int32_t mm_jpeg_omx_config_port(mm_jpeg_obj* my_obj, src_image_buffer_info *src_buf, int port_idx)
+int32_t mm_jpeg_omx_config_port(mm_jpeg_session_t* session, src_image_buffer_info *src_buf, int port_idx)
 {
     int32_t rc = 0;
     uint8_t i;
@@ -220,7 +544,7 @@ int32_t mm_jpeg_omx_config_port(mm_jpeg_obj* my_obj, src_image_buffer_info *src_
     for (i = 0; i < src_buf->num_bufs; i++) {
         memset(&input_port, 0, sizeof(input_port));
         input_port.nPortIndex = port_idx;
-        OMX_GetParameter(my_obj->omx_handle, OMX_IndexParamPortDefinition, &input_port);
+        OMX_GetParameter(session->omx_handle, OMX_IndexParamPortDefinition, &input_port);
         input_port.format.image.nFrameWidth = src_buf->src_dim.width;
         input_port.format.image.nFrameHeight =src_buf->src_dim.height;
         input_port.format.image.nStride = src_buf->src_dim.width;
@@ -239,7 +563,7 @@ int32_t mm_jpeg_omx_config_port(mm_jpeg_obj* my_obj, src_image_buffer_info *src_
              input_port.format.image.nFrameWidth, input_port.format.image.nFrameHeight,
              input_port.format.image.nStride, input_port.format.image.nSliceHeight,
              input_port.nBufferSize);
-        OMX_SetParameter(my_obj->omx_handle, OMX_IndexParamPortDefinition, &input_port);
+        OMX_SetParameter(session->omx_handle, OMX_IndexParamPortDefinition, &input_port);
     }
 
     return rc;
@@ -279,7 +603,7 @@ omx_jpeg_color_format map_jpeg_format(mm_jpeg_color_format color_fmt)
     }
 }
 
-int32_t mm_jpeg_omx_config_user_preference(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
+int32_t mm_jpeg_omx_config_user_preference(mm_jpeg_session_t* session, mm_jpeg_encode_job* job)
 {
     int32_t rc = 0;
     OMX_INDEXTYPE user_pref_idx;
@@ -292,7 +616,7 @@ int32_t mm_jpeg_omx_config_user_preference(mm_jpeg_obj* my_obj, mm_jpeg_encode_j
         user_preferences.thumbnail_color_format =
             map_jpeg_format(job->encode_parm.buf_info.src_imgs.src_img[JPEG_SRC_IMAGE_TYPE_THUMB].color_format);
     }
-    OMX_GetExtensionIndex(my_obj->omx_handle,
+    OMX_GetExtensionIndex(session->omx_handle,
                           "omx.qcom.jpeg.exttype.user_preferences",
                           &user_pref_idx);
     CDBG("%s:User Preferences: color_format %d, thumbnail_color_format = %d",
@@ -304,11 +628,11 @@ int32_t mm_jpeg_omx_config_user_preference(mm_jpeg_obj* my_obj, mm_jpeg_encode_j
         user_preferences.preference = OMX_JPEG_PREF_HW_ACCELERATED_PREFERRED;
     }
 
-    OMX_SetParameter(my_obj->omx_handle, user_pref_idx, &user_preferences);
+    OMX_SetParameter(session->omx_handle, user_pref_idx, &user_preferences);
     return rc;
 }
 
-int32_t mm_jpeg_omx_config_thumbnail(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
+int32_t mm_jpeg_omx_config_thumbnail(mm_jpeg_session_t* session, mm_jpeg_encode_job* job)
 {
     int32_t rc = -1;
     OMX_INDEXTYPE thumb_idx, q_idx;
@@ -324,7 +648,7 @@ int32_t mm_jpeg_omx_config_thumbnail(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* jo
 
     /* config port */
     CDBG("%s: config port", __func__);
-    rc = mm_jpeg_omx_config_port(my_obj, src_buf, INPUT_PORT_THUMBNAIL);
+    rc = mm_jpeg_omx_config_port(session, src_buf, INPUT_PORT_THUMBNAIL);
     if (0 != rc) {
         CDBG_ERROR("%s: config port failed", __func__);
         return rc;
@@ -371,17 +695,17 @@ int32_t mm_jpeg_omx_config_thumbnail(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* jo
     }
 
     /* set omx thumbnail info */
-    OMX_GetExtensionIndex(my_obj->omx_handle, "omx.qcom.jpeg.exttype.thumbnail", &thumb_idx);
-    OMX_SetParameter(my_obj->omx_handle, thumb_idx, &thumbnail);
+    OMX_GetExtensionIndex(session->omx_handle, "omx.qcom.jpeg.exttype.thumbnail", &thumb_idx);
+    OMX_SetParameter(session->omx_handle, thumb_idx, &thumbnail);
     CDBG("%s: set thumbnail info: crop_w=%d, crop_h=%d, l=%d, t=%d, w=%d, h=%d, scaling=%d",
           __func__, thumbnail.cropWidth, thumbnail.cropHeight,
           thumbnail.left, thumbnail.top, thumbnail.width, thumbnail.height,
           thumbnail.scaling);
 
-    OMX_GetExtensionIndex(my_obj->omx_handle, "omx.qcom.jpeg.exttype.thumbnail_quality", &q_idx);
-    OMX_GetParameter(my_obj->omx_handle, q_idx, &quality);
+    OMX_GetExtensionIndex(session->omx_handle, "omx.qcom.jpeg.exttype.thumbnail_quality", &q_idx);
+    OMX_GetParameter(session->omx_handle, q_idx, &quality);
     quality.nQFactor = src_buf->quality;
-    OMX_SetParameter(my_obj->omx_handle, q_idx, &quality);
+    OMX_SetParameter(session->omx_handle, q_idx, &quality);
     CDBG("%s: thumbnail_quality=%d", __func__, quality.nQFactor);
 
     rc = 0;
@@ -389,7 +713,7 @@ int32_t mm_jpeg_omx_config_thumbnail(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* jo
 }
 #endif
 
-int32_t mm_jpeg_omx_config_main_crop(mm_jpeg_obj* my_obj, src_image_buffer_info *src_buf)
+int32_t mm_jpeg_omx_config_main_crop(mm_jpeg_session_t* session, src_image_buffer_info *src_buf)
 {
     int32_t rc = 0;
     OMX_CONFIG_RECTTYPE rect_type_in, rect_type_out;
@@ -430,13 +754,13 @@ int32_t mm_jpeg_omx_config_main_crop(mm_jpeg_obj* my_obj, src_image_buffer_info
         }
     }
 
-    OMX_SetConfig(my_obj->omx_handle, OMX_IndexConfigCommonInputCrop, &rect_type_in);
+    OMX_SetConfig(session->omx_handle, OMX_IndexConfigCommonInputCrop, &rect_type_in);
     CDBG("%s: OMX_IndexConfigCommonInputCrop w=%d, h=%d, l=%d, t=%d, port_idx=%d", __func__,
          rect_type_in.nWidth, rect_type_in.nHeight,
          rect_type_in.nLeft, rect_type_in.nTop,
          rect_type_in.nPortIndex);
 
-    OMX_SetConfig(my_obj->omx_handle, OMX_IndexConfigCommonOutputCrop, &rect_type_out);
+    OMX_SetConfig(session->omx_handle, OMX_IndexConfigCommonOutputCrop, &rect_type_out);
     CDBG("%s: OMX_IndexConfigCommonOutputCrop w=%d, h=%d, port_idx=%d", __func__,
          rect_type_out.nWidth, rect_type_out.nHeight,
          rect_type_out.nPortIndex);
@@ -444,7 +768,7 @@ int32_t mm_jpeg_omx_config_main_crop(mm_jpeg_obj* my_obj, src_image_buffer_info
     return rc;
 }
 
-int32_t mm_jpeg_omx_config_main(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
+int32_t mm_jpeg_omx_config_main(mm_jpeg_session_t* session, mm_jpeg_encode_job* job)
 {
     int32_t rc = 0;
     src_image_buffer_info *src_buf =
@@ -453,7 +777,7 @@ int32_t mm_jpeg_omx_config_main(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
 
     /* config port */
     CDBG("%s: config port", __func__);
-    rc = mm_jpeg_omx_config_port(my_obj, src_buf, INPUT_PORT_MAIN);
+    rc = mm_jpeg_omx_config_port(session, src_buf, INPUT_PORT_MAIN);
     if (0 != rc) {
         CDBG_ERROR("%s: config port failed", __func__);
         return rc;
@@ -461,7 +785,7 @@ int32_t mm_jpeg_omx_config_main(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
 
     /* config buffer offset */
     CDBG("%s: config main buf offset", __func__);
-    rc = mm_jpeg_omx_config_main_buffer_offset(my_obj, src_buf, job->encode_parm.buf_info.src_imgs.is_video_frame);
+    rc = mm_jpeg_omx_config_main_buffer_offset(session, src_buf, job->encode_parm.buf_info.src_imgs.is_video_frame);
     if (0 != rc) {
         CDBG_ERROR("%s: config buffer offset failed", __func__);
         return rc;
@@ -469,7 +793,7 @@ int32_t mm_jpeg_omx_config_main(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
 
     /* config crop */
     CDBG("%s: config main crop", __func__);
-    rc = mm_jpeg_omx_config_main_crop(my_obj, src_buf);
+    rc = mm_jpeg_omx_config_main_crop(session, src_buf);
     if (0 != rc) {
         CDBG_ERROR("%s: config crop failed", __func__);
         return rc;
@@ -478,17 +802,17 @@ int32_t mm_jpeg_omx_config_main(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
     /* set quality */
     memset(&q_factor, 0, sizeof(q_factor));
     q_factor.nPortIndex = INPUT_PORT_MAIN;
-    OMX_GetParameter(my_obj->omx_handle, OMX_IndexParamQFactor, &q_factor);
+    OMX_GetParameter(session->omx_handle, OMX_IndexParamQFactor, &q_factor);
     q_factor.nQFactor = src_buf->quality;
-    OMX_SetParameter(my_obj->omx_handle, OMX_IndexParamQFactor, &q_factor);
+    OMX_SetParameter(session->omx_handle, OMX_IndexParamQFactor, &q_factor);
     CDBG("%s: config QFactor: %d", __func__, q_factor.nQFactor);
 
     return rc;
 }
 
-int32_t mm_jpeg_omx_config_common(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
+int32_t mm_jpeg_omx_config_common(mm_jpeg_session_t* session, mm_jpeg_encode_job* job)
 {
-    int32_t rc;
+    int32_t rc = 0;
     int i;
     OMX_INDEXTYPE exif_idx;
     QEXIF_INFO_DATA tag;
@@ -497,7 +821,7 @@ int32_t mm_jpeg_omx_config_common(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
 #if 0
     /* config user prefernces */
     CDBG("%s: config user preferences", __func__);
-    rc = mm_jpeg_omx_config_user_preference(my_obj, job);
+    rc = mm_jpeg_omx_config_user_preference(session, job);
     if (0 != rc) {
         CDBG_ERROR("%s: config user preferences failed", __func__);
         return rc;
@@ -508,198 +832,340 @@ int32_t mm_jpeg_omx_config_common(mm_jpeg_obj* my_obj, mm_jpeg_encode_job* job)
     memset(&rotate, 0, sizeof(rotate));
     rotate.nPortIndex = OUTPUT_PORT;
     rotate.nRotation = job->encode_parm.rotation;
-    OMX_SetConfig(my_obj->omx_handle, OMX_IndexConfigCommonRotate, &rotate);
+    OMX_SetConfig(session->omx_handle, OMX_IndexConfigCommonRotate, &rotate);
     CDBG("%s: Set rotation to %d at port_idx=%d", __func__,
          job->encode_parm.rotation, rotate.nPortIndex);
 
     /* set exif tags */
     CDBG("%s: Set rexif tags", __func__);
-    OMX_GetExtensionIndex(my_obj->omx_handle, "omx.qcom.jpeg.exttype.exif", &exif_idx);
+    OMX_GetExtensionIndex(session->omx_handle, "omx.qcom.jpeg.exttype.exif", &exif_idx);
     for(i = 0; i < job->encode_parm.exif_numEntries; i++) {
         memcpy(&tag, job->encode_parm.exif_data + i, sizeof(QEXIF_INFO_DATA));
-        OMX_SetParameter(my_obj->omx_handle, exif_idx, &tag);
+        OMX_SetParameter(session->omx_handle, exif_idx, &tag);
     }
 
     return rc;
 }
 
-int32_t mm_jpeg_omx_use_buf(mm_jpeg_obj* my_obj,
+/* get fd, vaddr and len of the idx-th buffer of a src image */
+static int32_t mm_jpeg_get_src_buf_desc(src_image_buffer_info *src_buf,
+                                        uint8_t idx,
+                                        int *fd,
+                                        uint8_t **vaddr,
+                                        uint32_t *len)
+{
+    switch (src_buf->img_fmt) {
+    case JPEG_SRC_IMAGE_FMT_YUV:
+        *fd = src_buf->src_image[idx].fd;
+        *vaddr = src_buf->src_image[idx].buf_vaddr;
+        *len = src_buf->src_image[idx].offset.frame_len;
+        break;
+    case JPEG_SRC_IMAGE_FMT_BITSTREAM:
+        *fd = src_buf->bit_stream[idx].fd;
+        *vaddr = src_buf->bit_stream[idx].buf_vaddr;
+        *len = src_buf->bit_stream[idx].buf_size;
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+/* make sure src buffers are registered with the session */
+int32_t mm_jpeg_omx_use_buf(mm_jpeg_session_t* session,
                             src_image_buffer_info *src_buf,
-                            mm_jpeg_omx_src_buf* omx_src_buf,
                             int port_idx)
 {
     int32_t rc = 0;
     uint8_t i;
-#if 0
-    QOMX_BUFFER_OFFSET buffer_info;
+    int fd;
+    uint8_t *vaddr;
+    uint32_t len;
 
-    omx_src_buf->num_bufs = src_buf->num_bufs;
     for (i = 0; i < src_buf->num_bufs; i++) {
-        memset(&buffer_info, 0, sizeof(buffer_info));
-        switch (src_buf->img_fmt) {
-        case JPEG_SRC_IMAGE_FMT_YUV:
-            buffer_info.fd = src_buf->src_image[i].fd;
-            buffer_info.offset = 0;
-            omx_src_buf->bufs[i].portIdx = port_idx;
-            OMX_UseBuffer(my_obj->omx_handle,
-                          &omx_src_buf->bufs[i].buf_header,
-                          port_idx,
-                          &buffer_info,
-                          src_buf->src_image[i].offset.frame_len,
-                          (void *)src_buf->src_image[i].buf_vaddr);
-            CDBG("%s: port_idx=%d, fd=%d, offset=%d, len=%d, ptr=%p",
-                 __func__, port_idx, buffer_info.fd, buffer_info.offset,
-                 src_buf->src_image[i].offset.frame_len,
-                 src_buf->src_image[i].buf_vaddr);
-            break;
-        case JPEG_SRC_IMAGE_FMT_BITSTREAM:
-            buffer_info.fd = src_buf->bit_stream[i].fd;
-            buffer_info.offset = 0;
-            omx_src_buf->bufs[i].portIdx = port_idx;
-            OMX_UseBuffer(my_obj->omx_handle,
-                          &omx_src_buf->bufs[i].buf_header,
-                          port_idx,
-                          &buffer_info,
-                          src_buf->bit_stream[i].buf_size,
-                          (void *)src_buf->bit_stream[i].buf_vaddr);
-            break;
-        default:
-            rc = -1;
+        rc = mm_jpeg_get_src_buf_desc(src_buf, i, &fd, &vaddr, &len);
+        if (0 == rc) {
+            rc = mm_jpeg_omx_cache_buf(session, port_idx, fd, vaddr, len);
+        }
+        if (0 != rc) {
+            CDBG_ERROR("%s: use buf %d on port %d failed", __func__, i, port_idx);
             break;
         }
     }
-#endif
     return rc;
 }
 
-int32_t mm_jpeg_omx_encode(mm_jpeg_obj* my_obj, mm_jpeg_job_entry* job_entry)
+/* get OMX buffer headers of src buffers, once they are all registered */
+static int32_t mm_jpeg_omx_get_buf_headers(mm_jpeg_session_t* session,
+                                           src_image_buffer_info *src_buf,
+                                           mm_jpeg_omx_src_buf* omx_src_buf,
+                                           int port_idx)
+{
+    uint8_t i;
+    int fd;
+    uint8_t *vaddr;
+    uint32_t len;
+    mm_jpeg_omx_buf_cache_entry_t *entry = NULL;
+
+    omx_src_buf->num_bufs = src_buf->num_bufs;
+    for (i = 0; i < src_buf->num_bufs; i++) {
+        if (0 != mm_jpeg_get_src_buf_desc(src_buf, i, &fd, &vaddr, &len)) {
+            return -1;
+        }
+        entry = mm_jpeg_omx_find_cached_buf(session, port_idx, fd, vaddr, len);
+        if (NULL == entry || NULL == entry->buf_header) {
+            return -1;
+        }
+        omx_src_buf->bufs[i].portIdx = port_idx;
+        omx_src_buf->bufs[i].buf_header = entry->buf_header;
+    }
+    return 0;
+}
+
+int32_t mm_jpeg_omx_encode(mm_jpeg_session_t* session, mm_jpeg_job_entry* job_entry)
 {
     int32_t rc = 0;
     uint8_t i;
     mm_jpeg_encode_job* job = &job_entry->job.encode_job;
     uint8_t has_thumbnail = job->encode_parm.buf_info.src_imgs.src_img_num > 1? 1 : 0;
     src_image_buffer_info *src_buf[JPEG_SRC_IMAGE_TYPE_MAX];
-    mm_jpeg_omx_src_buf *omx_src_buf[JPEG_SRC_IMAGE_TYPE_MAX];
+    out_image_buffer_info *sink_img = &job->encode_parm.buf_info.sink_img;
+    mm_jpeg_omx_buf_cache_entry_t *sink_entry = NULL;
+    mm_jpeg_session_cfg_t cfg;
 
-    /* config main img */
-    rc = mm_jpeg_omx_config_main(my_obj, job);
-    if (0 != rc) {
-        CDBG_ERROR("%s: config main img failed", __func__);
-        return rc;
+    src_buf[JPEG_SRC_IMAGE_TYPE_MAIN] = &(job->encode_parm.buf_info.src_imgs.src_img[JPEG_SRC_IMAGE_TYPE_MAIN]);
+    src_buf[JPEG_SRC_IMAGE_TYPE_THUMB] = &(job->encode_parm.buf_info.src_imgs.src_img[JPEG_SRC_IMAGE_TYPE_THUMB]);
+
+    /* a running component is reused only for same geometry and format,
+     * and only if none of the buffers it may have registered got freed */
+    mm_jpeg_session_get_cfg(job, &cfg);
+    if (OMX_StateLoaded != session->omx_state &&
+        (OMX_StateExecuting != session->omx_state ||
+         !session->keep_warm ||
+         0 != memcmp(&cfg, &session->cfg, sizeof(cfg)) ||
+         job->encode_parm.buf_info.buf_gen != session->buf_gen)) {
+        CDBG("%s: reconfig session %d", __func__, session->idx);
+        mm_jpeg_session_teardown(session);
     }
+    session->buf_gen = job->encode_parm.buf_info.buf_gen;
 
-    /* config thumbnail */
-    if (has_thumbnail) {
-#if 0
-        rc = mm_jpeg_omx_config_thumbnail(my_obj, job);
+    if (OMX_StateLoaded == session->omx_state) {
+        /* config main img */
+        rc = mm_jpeg_omx_config_main(session, job);
         if (0 != rc) {
-            CDBG_ERROR("%s: config thumbnail img failed", __func__);
+            CDBG_ERROR("%s: config main img failed", __func__);
             return rc;
         }
+
+        /* config thumbnail */
+        if (has_thumbnail) {
+#if 0
+            rc = mm_jpeg_omx_config_thumbnail(session, job);
+            if (0 != rc) {
+                CDBG_ERROR("%s: config thumbnail img failed", __func__);
+                return rc;
+            }
 #endif
+        }
+        session->cfg = cfg;
     }
 
-    /* common config */
-    rc = mm_jpeg_omx_config_common(my_obj, job);
+    /* common config, can change per job */
+    rc = mm_jpeg_omx_config_common(session, job);
     if (0 != rc) {
         CDBG_ERROR("%s: config common failed", __func__);
         return rc;
     }
 
-    /* config input omx buffer for main input */
-    src_buf[JPEG_SRC_IMAGE_TYPE_MAIN] = &(job->encode_parm.buf_info.src_imgs.src_img[JPEG_SRC_IMAGE_TYPE_MAIN]);
-    omx_src_buf[JPEG_SRC_IMAGE_TYPE_MAIN] = &job_entry->src_bufs[JPEG_SRC_IMAGE_TYPE_MAIN];
-    rc = mm_jpeg_omx_use_buf(my_obj,
-                             src_buf[JPEG_SRC_IMAGE_TYPE_MAIN],
-                             omx_src_buf[JPEG_SRC_IMAGE_TYPE_MAIN],
-                             INPUT_PORT_MAIN);
+    /* register input buffer for main input */
+    rc = mm_jpeg_omx_use_buf(session, src_buf[JPEG_SRC_IMAGE_TYPE_MAIN], INPUT_PORT_MAIN);
     if (0 != rc) {
         CDBG_ERROR("%s: config main input omx buffer failed", __func__);
         return rc;
     }
 
-    /* config input omx buffer for thumbnail input if there is thumbnail */
+    /* register input buffer for thumbnail input if there is thumbnail */
     if (has_thumbnail) {
-        src_buf[JPEG_SRC_IMAGE_TYPE_THUMB] = &(job->encode_parm.buf_info.src_imgs.src_img[JPEG_SRC_IMAGE_TYPE_THUMB]);
-        omx_src_buf[JPEG_SRC_IMAGE_TYPE_THUMB] = &job_entry->src_bufs[JPEG_SRC_IMAGE_TYPE_THUMB];
-        rc = mm_jpeg_omx_use_buf(my_obj,
-                                 src_buf[JPEG_SRC_IMAGE_TYPE_THUMB],
-                                 omx_src_buf[JPEG_SRC_IMAGE_TYPE_THUMB],
-                                 INPUT_PORT_THUMBNAIL);
+        rc = mm_jpeg_omx_use_buf(session, src_buf[JPEG_SRC_IMAGE_TYPE_THUMB], INPUT_PORT_THUMBNAIL);
         if (0 != rc) {
             CDBG_ERROR("%s: config thumbnail input omx buffer failed", __func__);
             return rc;
         }
     }
 
-    /* config output omx buffer */
+    /* register output buffer */
+    rc = mm_jpeg_omx_cache_buf(session, OUTPUT_PORT, sink_img->fd,
+                               sink_img->buf_vaddr, sink_img->buf_len);
+    if (0 != rc) {
+        CDBG_ERROR("%s: config output omx buffer failed", __func__);
+        return rc;
+    }
+
+    /* bring up component if it is not running yet */
+    if (OMX_StateLoaded == session->omx_state) {
+        rc = mm_jpeg_session_start(session);
+        if (0 != rc) {
+            CDBG_ERROR("%s: start session %d failed", __func__, session->idx);
+            return rc;
+        }
+    }
+
+    /* get omx buffers of this job */
+    rc = mm_jpeg_omx_get_buf_headers(session,
+                                     src_buf[JPEG_SRC_IMAGE_TYPE_MAIN],
+                                     &job_entry->src_bufs[JPEG_SRC_IMAGE_TYPE_MAIN],
+                                     INPUT_PORT_MAIN);
+    if (0 == rc && has_thumbnail) {
+        rc = mm_jpeg_omx_get_buf_headers(session,
+                                         src_buf[JPEG_SRC_IMAGE_TYPE_THUMB],
+                                         &job_entry->src_bufs[JPEG_SRC_IMAGE_TYPE_THUMB],
+                                         INPUT_PORT_THUMBNAIL);
+    }
+    sink_entry = mm_jpeg_omx_find_cached_buf(session, OUTPUT_PORT, sink_img->fd,
+                                             sink_img->buf_vaddr, sink_img->buf_len);
+    if (0 != rc || NULL == sink_entry || NULL == sink_entry->buf_header) {
+        CDBG_ERROR("%s: omx buffers not registered", __func__);
+        return -1;
+    }
     job_entry->sink_buf.portIdx = OUTPUT_PORT;
-    OMX_UseBuffer(my_obj->omx_handle,
-                  &job_entry->sink_buf.buf_header,
-                  job_entry->sink_buf.portIdx,
-                  NULL,
-                  job->encode_parm.buf_info.sink_img.buf_len,
-                  (void *)job->encode_parm.buf_info.sink_img.buf_vaddr);
-    CDBG("%s: Use output buf: port_idx=%d, len=%d, ptr=%p",
-         __func__, job_entry->sink_buf.portIdx,
-         job->encode_parm.buf_info.sink_img.buf_len,
-         job->encode_parm.buf_info.sink_img.buf_vaddr);
-
-    /* wait for OMX state ready */
-    CDBG("%s: Wait for state change to idle \n", __func__);
-    mm_jpeg_job_wait_for_cmd_complete(my_obj, OMX_CommandStateSet, OMX_StateIdle);
-    CDBG("%s: State changed to OMX_StateIdle\n", __func__);
+    job_entry->sink_buf.buf_header = sink_entry->buf_header;
+    session->num_jobs++;
 
-    /* start OMX encoding by sending executing cmd */
-    CDBG("%s: Send command to executing\n", __func__);
-    OMX_SendCommand(my_obj->omx_handle, OMX_CommandStateSet, OMX_StateExecuting, NULL);
-    mm_jpeg_job_wait_for_cmd_complete(my_obj, OMX_CommandStateSet, OMX_StateExecuting);
+    /* events from here on belong to this job */
+    mm_jpeg_session_reset_evt(session);
 
     /* start input feeding and output writing */
     CDBG("%s: start main input feeding\n", __func__);
     for (i = 0; i < job_entry->src_bufs[JPEG_SRC_IMAGE_TYPE_MAIN].num_bufs; i++) {
-        OMX_EmptyThisBuffer(my_obj->omx_handle,
+        OMX_EmptyThisBuffer(session->omx_handle,
                             job_entry->src_bufs[JPEG_SRC_IMAGE_TYPE_MAIN].bufs[i].buf_header);
     }
     if (has_thumbnail) {
         CDBG("%s: start thumbnail input feeding\n", __func__);
         for (i = 0; i < job_entry->src_bufs[JPEG_SRC_IMAGE_TYPE_THUMB].num_bufs; i++) {
-            OMX_EmptyThisBuffer(my_obj->omx_handle,
+            OMX_EmptyThisBuffer(session->omx_handle,
                                 job_entry->src_bufs[JPEG_SRC_IMAGE_TYPE_THUMB].bufs[i].buf_header);
         }
     }
     CDBG("%s: start output writing\n", __func__);
-    OMX_FillThisBuffer(my_obj->omx_handle, job_entry->sink_buf.buf_header);
+    OMX_FillThisBuffer(session->omx_handle, job_entry->sink_buf.buf_header);
 
     return rc;
 }
 
-static void *mm_jpeg_notify_thread(void *data)
+/* hand a finished job over to notify thread for callback delivery.
+ * Callbacks are delivered in the order jobs are queued here, so they are
+ * never reordered for the same client */
+static void mm_jpeg_notify_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t* job_node)
 {
-    mm_jpeg_job_q_node_t* job_node = (mm_jpeg_job_q_node_t *)data;
     mm_jpeg_job_entry * job_entry = &job_node->entry;
-    mm_jpeg_obj* my_obj = (mm_jpeg_obj *)job_entry->jpeg_obj;
-    void* node = NULL;
-    int32_t rc = 0;
-    uint32_t jobId = job_entry->jobId;
 
-    if (NULL == my_obj) {
-        CDBG_ERROR("%s: jpeg obj is NULL", __func__);
-        return NULL;
+    if (NULL == job_entry->job.encode_job.jpeg_cb) {
+        CDBG_ERROR("%s: no cb provided, return here", __func__);
+        /* note here we are not freeing any internal memory */
+        free(job_node);
+        return;
     }
 
-    /* call cb */
-    if (NULL != job_entry->job.encode_job.jpeg_cb) {
-        /* Add to cb queue */
-        rc = mm_jpeg_queue_enq(&my_obj->cb_q, data);
-        if (0 != rc) {
-            CDBG_ERROR("%s: enqueue into cb_q failed", __func__);
-            free(job_node);
-            return NULL;
+    clock_gettime(CLOCK_MONOTONIC, &job_entry->done_ts);
+    if (0 != mm_jpeg_queue_enq(&my_obj->cb_q, job_node)) {
+        CDBG_ERROR("%s: enqueue into cb_q failed", __func__);
+        free(job_node);
+        return;
+    }
+    sem_post(&my_obj->notify_mgr.notify_sem);
+}
+
+/* drop pending callbacks of the job with job_id, or of all jobs of
+ * client_hdl when job_id is 0, and wait until the callback in progress
+ * returns if it is one of them. cb_q is checked under cb_lock, which notify
+ * thread also holds from taking a node off cb_q until it is published as
+ * cb_node, so a callback can not be missed in between.
+ * Must be called without job_lock, a callback may abort jobs itself */
+static void mm_jpeg_notify_wait_cb_done(mm_jpeg_obj *my_obj,
+                                        uint32_t client_hdl,
+                                        uint32_t job_id)
+{
+    mm_jpeg_notify_thread_t *notify_mgr = &my_obj->notify_mgr;
+    mm_jpeg_job_q_node_t *cb_node = NULL;
+    void *node = NULL;
+
+    pthread_mutex_lock(&notify_mgr->cb_lock);
+    do {
+        if (job_id != 0) {
+            node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->cb_q, job_id);
+        } else {
+            node = mm_jpeg_queue_remove_job_by_client_id(&my_obj->cb_q, client_hdl);
+        }
+        /* simply delete the job since its callback is not sent yet */
+        free(node);
+    } while (NULL != node);
+
+    /* callback itself may abort jobs, no need to wait in that case */
+    if (pthread_equal(pthread_self(), notify_mgr->pid)) {
+        pthread_mutex_unlock(&notify_mgr->cb_lock);
+        return;
+    }
+
+    while (NULL != (cb_node = notify_mgr->cb_node)) {
+        if (job_id != 0 && cb_node->entry.jobId != job_id) {
+            break;
+        }
+        if (job_id == 0 && cb_node->entry.client_hdl != client_hdl) {
+            break;
+        }
+        pthread_cond_wait(&notify_mgr->cb_cond, &notify_mgr->cb_lock);
+    }
+    pthread_mutex_unlock(&notify_mgr->cb_lock);
+}
+
+static void *mm_jpeg_notify_thread(void *data)
+{
+    int rc = 0;
+    int running = 1;
+    mm_jpeg_obj* my_obj = (mm_jpeg_obj *)data;
+    mm_jpeg_notify_thread_t *notify_mgr = &my_obj->notify_mgr;
+    mm_jpeg_job_q_node_t* node = NULL;
+    mm_jpeg_job_entry * job_entry = NULL;
+    struct timespec now;
+    uint64_t latency_us;
+
+    do {
+        do {
+            rc = sem_wait(&notify_mgr->notify_sem);
+            if (rc != 0 && errno != EINVAL) {
+                CDBG_ERROR("%s: sem_wait error (%s)",
+                           __func__, strerror(errno));
+                return NULL;
+            }
+        } while (rc != 0);
+
+        pthread_mutex_lock(&notify_mgr->cb_lock);
+        node = (mm_jpeg_job_q_node_t *)mm_jpeg_queue_deq(&my_obj->cb_q);
+        if (NULL != node && MM_JPEG_CMD_TYPE_JOB == node->type) {
+            notify_mgr->cb_node = node;
+        }
+        pthread_mutex_unlock(&notify_mgr->cb_lock);
+        if (NULL == node) {
+            /* job got aborted before its callback */
+            continue;
         }
 
-        CDBG("%s: send jpeg callback", __func__);
-        /* has callback, send CB */
+        if (MM_JPEG_CMD_TYPE_EXIT == node->type) {
+            free(node);
+            running = 0;
+            continue;
+        }
+
+        job_entry = &node->entry;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        latency_us =
+            (uint64_t)(now.tv_sec - job_entry->done_ts.tv_sec) * 1000000 +
+            (now.tv_nsec - job_entry->done_ts.tv_nsec) / 1000;
+        CDBG("%s: send jpeg callback for job %d, done->cb latency %llu us",
+             __func__, job_entry->jobId, (unsigned long long)latency_us);
+
         job_entry->job.encode_job.jpeg_cb(job_entry->job_status,
                                           job_entry->thumbnail_dropped,
                                           job_entry->client_hdl,
@@ -708,46 +1174,119 @@ static void *mm_jpeg_notify_thread(void *data)
                                           job_entry->jpeg_size,
                                           job_entry->job.encode_job.userdata);
 
-        /* Remove from cb queue */
-        CDBG_ERROR("%s: remove job %d from cb queue", __func__, jobId);
-        node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->cb_q, jobId);
-        if (NULL != node) {
-            free(node);
+        /* callback returned, wake up anyone aborting this job */
+        pthread_mutex_lock(&notify_mgr->cb_lock);
+        notify_mgr->num_cbs++;
+        notify_mgr->sum_latency_us += latency_us;
+        if (latency_us > notify_mgr->max_latency_us) {
+            notify_mgr->max_latency_us = latency_us;
         }
-    } else {
-        CDBG_ERROR("%s: no cb provided, no action", __func__);
-        /* note here we are not freeing any internal memory */
-        free(data);
-    }
+        notify_mgr->cb_node = NULL;
+        pthread_cond_broadcast(&notify_mgr->cb_cond);
+        pthread_mutex_unlock(&notify_mgr->cb_lock);
+
+        free(node);
+    } while (running);
 
     return NULL;
 }
 
+int32_t mm_jpeg_notify_thread_launch(mm_jpeg_obj * my_obj)
+{
+    int32_t rc = 0;
+    mm_jpeg_notify_thread_t * notify_mgr = &my_obj->notify_mgr;
+
+    memset(notify_mgr, 0, sizeof(mm_jpeg_notify_thread_t));
+    sem_init(&notify_mgr->notify_sem, 0, 0);
+    pthread_mutex_init(&notify_mgr->cb_lock, NULL);
+    pthread_cond_init(&notify_mgr->cb_cond, NULL);
+
+    /* launch the thread */
+    rc = pthread_create(&notify_mgr->pid,
+                        NULL,
+                        mm_jpeg_notify_thread,
+                        (void *)my_obj);
+    if (0 != rc) {
+        CDBG_ERROR("%s: cannot launch notify thread (%d)", __func__, rc);
+        pthread_cond_destroy(&notify_mgr->cb_cond);
+        pthread_mutex_destroy(&notify_mgr->cb_lock);
+        sem_destroy(&notify_mgr->notify_sem);
+        rc = -1;
+    }
+    return rc;
+}
+
+int32_t mm_jpeg_notify_thread_release(mm_jpeg_obj * my_obj)
+{
+    int32_t rc = 0;
+    mm_jpeg_notify_thread_t * notify_mgr = &my_obj->notify_mgr;
+    mm_jpeg_job_q_node_t* node =
+        (mm_jpeg_job_q_node_t *)malloc(sizeof(mm_jpeg_job_q_node_t));
+    if (NULL == node) {
+        CDBG_ERROR("%s: No memory for mm_jpeg_job_q_node_t", __func__);
+        return -1;
+    }
+
+    /* EXIT goes after all pending callbacks, so they are still delivered */
+    memset(node, 0, sizeof(mm_jpeg_job_q_node_t));
+    node->type = MM_JPEG_CMD_TYPE_EXIT;
+
+    mm_jpeg_queue_enq(&my_obj->cb_q, node);
+    sem_post(&notify_mgr->notify_sem);
+
+    /* wait until notify thread exits */
+    if (pthread_join(notify_mgr->pid, NULL) != 0) {
+        CDBG("%s: pthread dead already\n", __func__);
+    }
+
+    if (notify_mgr->num_cbs > 0) {
+        CDBG_HIGH("%s: %d callbacks, done->cb latency avg %llu us, max %llu us",
+                  __func__, notify_mgr->num_cbs,
+                  (unsigned long long)(notify_mgr->sum_latency_us / notify_mgr->num_cbs),
+                  (unsigned long long)notify_mgr->max_latency_us);
+    }
+
+    pthread_cond_destroy(&notify_mgr->cb_cond);
+    pthread_mutex_destroy(&notify_mgr->cb_lock);
+    sem_destroy(&notify_mgr->notify_sem);
+    memset(notify_mgr, 0, sizeof(mm_jpeg_notify_thread_t));
+    return rc;
+}
+
 /* process encoding job */
 int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t* job_node)
 {
     int32_t rc = 0;
     mm_jpeg_job_entry* job_entry = &job_node->entry;
+    mm_jpeg_session_t *session = (mm_jpeg_session_t *)job_entry->session;
+
+    /* job was queued into ongoing queue by jobMgr thread when it was bound
+     * to the session, since ftbdone from the session may come back before
+     * OMX_Encode returns. call OMX_Encode */
+    pthread_mutex_lock(&session->omx_lock);
+    rc = mm_jpeg_omx_encode(session, job_entry);
+    pthread_mutex_unlock(&session->omx_lock);
+    if (0 != rc) {
+        /* take the job back out of ongoing queue, it may have been
+         * aborted already */
+        pthread_mutex_lock(&my_obj->job_lock);
+        job_node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q,
+                                                      job_entry->jobId);
+        mm_jpeg_release_session(session);
+        pthread_mutex_unlock(&my_obj->job_lock);
+        if (NULL == job_node) {
+            return rc;
+        }
+    }
+
+    if (0 != rc) {
+        /* session is free again, wake up jobMgr thread for pending jobs */
+        sem_post(&my_obj->job_mgr.job_sem);
 
-    /* call OMX_Encode */
-    rc = mm_jpeg_omx_encode(my_obj, job_entry);
-    if (0 == rc) {
-        /* sent encode cmd to OMX, queue job into ongoing queue */
-        rc = mm_jpeg_queue_enq(&my_obj->ongoing_job_q, job_node);
-    } else {
         /* OMX encode failed, notify error through callback */
         job_entry->job_status = JPEG_JOB_STATUS_ERROR;
-        if (NULL != job_entry->job.encode_job.jpeg_cb) {
-            /* has callback, create a thread to send CB */
-            pthread_create(&job_entry->cb_pid,
-                           NULL,
-                           mm_jpeg_notify_thread,
-                           (void *)job_node);
-
-        } else {
-            CDBG_ERROR("%s: no cb provided, return here", __func__);
-            free(job_node);
-        }
+        job_entry->session = NULL;
+        mm_jpeg_notify_job(my_obj, job_node);
     }
 
     return rc;
@@ -776,10 +1315,10 @@ static void *mm_jpeg_jobmgr_thread(void *data)
 {
     int rc = 0;
     int running = 1;
-    uint32_t num_ongoing_jobs = 0;
     mm_jpeg_obj *my_obj = (mm_jpeg_obj*)data;
     mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
     mm_jpeg_job_q_node_t* node = NULL;
+    mm_jpeg_session_t *session = NULL;
 
     do {
         do {
@@ -791,19 +1330,43 @@ static void *mm_jpeg_jobmgr_thread(void *data)
             }
         } while (rc != 0);
 
-        /* check ongoing q size */
-        num_ongoing_jobs = mm_jpeg_queue_get_size(&my_obj->ongoing_job_q);
-        if (num_ongoing_jobs >= NUM_MAX_JPEG_CNCURRENT_JOBS) {
-            CDBG("%s: ongoing job already reach max %d", __func__, num_ongoing_jobs);
+        pthread_mutex_lock(&my_obj->job_lock);
+        /* check if there is any free session. EXIT cmd is always
+         * processed since it is enqueued after all pending jobs */
+        session = mm_jpeg_get_free_session(my_obj);
+        node = (mm_jpeg_job_q_node_t*)mm_jpeg_queue_peek(&cmd_thread->job_queue);
+        if (NULL == session && NULL != node && MM_JPEG_CMD_TYPE_JOB == node->type) {
+            CDBG("%s: all %d sessions busy", __func__, my_obj->num_sessions);
+            pthread_mutex_unlock(&my_obj->job_lock);
             continue;
         }
 
-        pthread_mutex_lock(&my_obj->job_lock);
         /* can go ahead with new work */
         node = (mm_jpeg_job_q_node_t*)mm_jpeg_queue_deq(&cmd_thread->job_queue);
+        if (node != NULL && MM_JPEG_CMD_TYPE_JOB == node->type) {
+            /* bind job to the session. It moves from todo queue to ongoing
+             * queue under job_lock, so abort always finds it in one of them */
+            session->is_busy = 1;
+            session->job_id = node->entry.jobId;
+            node->entry.session = (void *)session;
+            if (0 != mm_jpeg_queue_enq(&my_obj->ongoing_job_q, node)) {
+                mm_jpeg_release_session(session);
+                node->entry.session = NULL;
+                node->entry.job_status = JPEG_JOB_STATUS_ERROR;
+                pthread_mutex_unlock(&my_obj->job_lock);
+                /* session is free again, look for next job as well */
+                sem_post(&cmd_thread->job_sem);
+                mm_jpeg_notify_job(my_obj, node);
+                continue;
+            }
+        }
+        pthread_mutex_unlock(&my_obj->job_lock);
+
         if (node != NULL) {
             switch (node->type) {
             case MM_JPEG_CMD_TYPE_JOB:
+                /* OMX setup is done outside of job_lock so that
+                 * other sessions can complete meanwhile */
                 mm_jpeg_process_job(my_obj, node);
                 break;
             case MM_JPEG_CMD_TYPE_EXIT:
@@ -815,7 +1378,6 @@ static void *mm_jpeg_jobmgr_thread(void *data)
                 break;
             }
         }
-        pthread_mutex_unlock(&my_obj->job_lock);
 
     } while (running);
     return NULL;
@@ -869,15 +1431,37 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
 {
     int32_t rc = 0;
 
+    uint32_t i;
+
     /* init locks */
     pthread_mutex_init(&my_obj->job_lock, NULL);
-    pthread_mutex_init(&my_obj->omx_evt_lock, NULL);
-    pthread_cond_init(&my_obj->omx_evt_cond, NULL);
+    for (i = 0; i < MM_JPEG_MAX_SESSIONS; i++) {
+        my_obj->sessions[i].idx = i;
+        my_obj->sessions[i].jpeg_obj = (void *)my_obj;
+        pthread_mutex_init(&my_obj->sessions[i].omx_evt_lock, NULL);
+        pthread_mutex_init(&my_obj->sessions[i].omx_lock, NULL);
+        pthread_cond_init(&my_obj->sessions[i].omx_evt_cond, NULL);
+    }
 
     /* init ongoing job queue */
     rc = mm_jpeg_queue_init(&my_obj->ongoing_job_q);
     rc = mm_jpeg_queue_init(&my_obj->cb_q);
 
+    /* launch notify thread */
+    CDBG("%s : Launch notify thread",__func__);
+    rc = mm_jpeg_notify_thread_launch(my_obj);
+    if (0 != rc) {
+        mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
+        mm_jpeg_queue_deinit(&my_obj->cb_q);
+        pthread_mutex_destroy(&my_obj->job_lock);
+        for (i = 0; i < MM_JPEG_MAX_SESSIONS; i++) {
+            pthread_mutex_destroy(&my_obj->sessions[i].omx_evt_lock);
+            pthread_mutex_destroy(&my_obj->sessions[i].omx_lock);
+            pthread_cond_destroy(&my_obj->sessions[i].omx_evt_cond);
+        }
+        return rc;
+    }
+
     /* init job semaphore and launch jobmgr thread */
     CDBG("%s : Launch jobmgr thread",__func__);
     rc = mm_jpeg_jobmgr_thread_launch(my_obj);
@@ -887,10 +1471,15 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
     if (0 != rc) {
         /* roll back in error case */
         mm_jpeg_jobmgr_thread_release(my_obj);
+        mm_jpeg_notify_thread_release(my_obj);
         mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
+        mm_jpeg_queue_deinit(&my_obj->cb_q);
         pthread_mutex_destroy(&my_obj->job_lock);
-        pthread_mutex_destroy(&my_obj->omx_evt_lock);
-        pthread_cond_destroy(&my_obj->omx_evt_cond);
+        for (i = 0; i < MM_JPEG_MAX_SESSIONS; i++) {
+            pthread_mutex_destroy(&my_obj->sessions[i].omx_evt_lock);
+            pthread_mutex_destroy(&my_obj->sessions[i].omx_lock);
+            pthread_cond_destroy(&my_obj->sessions[i].omx_evt_cond);
+        }
     }
 
     return rc;
@@ -899,6 +1488,7 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
 int32_t mm_jpeg_deinit(mm_jpeg_obj *my_obj)
 {
     int32_t rc = 0;
+    uint32_t i;
 
     /* unload OMX engine */
     rc = mm_jpeg_omx_unload(my_obj);
@@ -906,14 +1496,20 @@ int32_t mm_jpeg_deinit(mm_jpeg_obj *my_obj)
     /* release jobmgr thread */
     rc = mm_jpeg_jobmgr_thread_release(my_obj);
 
+    /* release notify thread after pending callbacks are delivered */
+    rc = mm_jpeg_notify_thread_release(my_obj);
+
     /* deinit ongoing job and cb queue */
     rc = mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
     rc = mm_jpeg_queue_deinit(&my_obj->cb_q);
 
     /* destroy locks */
     pthread_mutex_destroy(&my_obj->job_lock);
-    pthread_mutex_destroy(&my_obj->omx_evt_lock);
-    pthread_cond_destroy(&my_obj->omx_evt_cond);
+    for (i = 0; i < MM_JPEG_MAX_SESSIONS; i++) {
+        pthread_mutex_destroy(&my_obj->sessions[i].omx_evt_lock);
+        pthread_mutex_destroy(&my_obj->sessions[i].omx_lock);
+        pthread_cond_destroy(&my_obj->sessions[i].omx_evt_cond);
+    }
 
     return rc;
 }
@@ -1016,33 +1612,33 @@ int32_t mm_jpeg_abort_job(mm_jpeg_obj *my_obj,
     /* abort job if in ongoing queue */
     node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q, jobId);
     if (NULL != node) {
-        /* find job that is OMX ongoing, ask OMX to abort the job */
+        /* find job that is OMX ongoing, ask OMX to abort the job.
+         * job_lock is not held since OMX callbacks need it */
+        pthread_mutex_unlock(&my_obj->job_lock);
         job_entry = &(((mm_jpeg_job_q_node_t *)node)->entry);
-        rc = mm_jpeg_omx_abort_job(my_obj, job_entry);
+        rc = mm_jpeg_omx_abort_job((mm_jpeg_session_t *)job_entry->session, job_entry);
+        pthread_mutex_lock(&my_obj->job_lock);
+        mm_jpeg_release_session((mm_jpeg_session_t *)job_entry->session);
+        pthread_mutex_unlock(&my_obj->job_lock);
         free(node);
         goto abort_done;
     }
 
     /* abort job if in todo queue */
     node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->job_mgr.job_queue, jobId);
+    pthread_mutex_unlock(&my_obj->job_lock);
     if (NULL != node) {
         /* simply delete it */
         free(node);
         goto abort_done;
     }
-    /* abort job if in cb queue */
-    node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->cb_q, jobId);
-    if (NULL != node) {
-        /* join cb thread */
-        job_entry = &(((mm_jpeg_job_q_node_t *)node)->entry);
-        if (pthread_join(job_entry->cb_pid, NULL) != 0) {
-            CDBG("%s: pthread dead already\n", __func__);
-        }
-        free(node);
-    }
-abort_done:
-    pthread_mutex_unlock(&my_obj->job_lock);
 
+    /* job is done. Its callback may be pending or running right now,
+     * drop it or wait until it returns. job_lock is not held, so the
+     * callback is free to abort or start jobs meanwhile */
+    mm_jpeg_notify_wait_cb_done(my_obj, client_hdl, jobId);
+
+abort_done:
     /* wake up jobMgr thread to work on new job if there is any */
     sem_post(&my_obj->job_mgr.job_sem);
 
@@ -1072,9 +1668,13 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
     CDBG("%s: abort ongoing jobs", __func__);
     node = mm_jpeg_queue_remove_job_by_client_id(&my_obj->ongoing_job_q, client_hdl);
     while (NULL != node) {
-        /* find job that is OMX ongoing, ask OMX to abort the job */
+        /* find job that is OMX ongoing, ask OMX to abort the job.
+         * job_lock is not held since OMX callbacks need it */
         job_entry = &(((mm_jpeg_job_q_node_t *)node)->entry);
-        rc = mm_jpeg_omx_abort_job(my_obj, job_entry);
+        pthread_mutex_unlock(&my_obj->job_lock);
+        rc = mm_jpeg_omx_abort_job((mm_jpeg_session_t *)job_entry->session, job_entry);
+        pthread_mutex_lock(&my_obj->job_lock);
+        mm_jpeg_release_session((mm_jpeg_session_t *)job_entry->session);
         free(node);
 
         /* find next job from ongoing queue that belongs to this client */
@@ -1092,23 +1692,14 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
         node = mm_jpeg_queue_remove_job_by_client_id(&my_obj->job_mgr.job_queue, client_hdl);
     }
 
-    /* abort job if in cb queue */
-    CDBG("%s: abort done jobs in cb threads", __func__);
-    node = mm_jpeg_queue_remove_job_by_client_id(&my_obj->cb_q, client_hdl);
-    while (NULL != node) {
-        /* join cb thread */
-        job_entry = &(((mm_jpeg_job_q_node_t *)node)->entry);
-        if (pthread_join(job_entry->cb_pid, NULL) != 0) {
-            CDBG("%s: pthread dead already\n", __func__);
-        }
-        free(node);
-
-        /* find next job from cb queue that belongs to this client */
-        node = mm_jpeg_queue_remove_job_by_client_id(&my_obj->cb_q, client_hdl);
-    }
-
     pthread_mutex_unlock(&my_obj->job_lock);
 
+    /* drop done jobs pending callback, and wait if a callback of this
+     * client is in progress. No job of the client is left in todo or
+     * ongoing queue, so none can complete into cb queue after this */
+    CDBG("%s: abort done jobs pending callback", __func__);
+    mm_jpeg_notify_wait_cb_done(my_obj, client_hdl, 0);
+
     /* invalidate client entry */
     memset(&my_obj->clnt_mgr[clnt_idx], 0, sizeof(mm_jpeg_client_t));
 
@@ -1117,28 +1708,28 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
     return rc;
 }
 
-void mm_jpeg_job_wait_for_event(mm_jpeg_obj *my_obj, uint32_t evt_mask)
+void mm_jpeg_job_wait_for_event(mm_jpeg_session_t *session, uint32_t evt_mask)
 {
-    pthread_mutex_lock(&my_obj->omx_evt_lock);
-    while (!(my_obj->omx_evt_rcvd.evt & evt_mask)) {
-        pthread_cond_wait(&my_obj->omx_evt_cond, &my_obj->omx_evt_lock);
+    pthread_mutex_lock(&session->omx_evt_lock);
+    while (!(session->omx_evt_rcvd.evt & evt_mask)) {
+        pthread_cond_wait(&session->omx_evt_cond, &session->omx_evt_lock);
     }
     CDBG("%s:done", __func__);
-    pthread_mutex_unlock(&my_obj->omx_evt_lock);
+    pthread_mutex_unlock(&session->omx_evt_lock);
 }
 
-void mm_jpeg_job_wait_for_cmd_complete(mm_jpeg_obj *my_obj,
+void mm_jpeg_job_wait_for_cmd_complete(mm_jpeg_session_t *session,
                                        int cmd,
                                        int status)
 {
-    pthread_mutex_lock(&my_obj->omx_evt_lock);
-    while (!((my_obj->omx_evt_rcvd.evt & MM_JPEG_EVENT_MASK_CMD_COMPLETE) &&
-             (my_obj->omx_evt_rcvd.omx_value1 == cmd) &&
-             (my_obj->omx_evt_rcvd.omx_value2 == status))) {
-        pthread_cond_wait(&my_obj->omx_evt_cond, &my_obj->omx_evt_lock);
+    pthread_mutex_lock(&session->omx_evt_lock);
+    while (!((session->omx_evt_rcvd.evt & MM_JPEG_EVENT_MASK_CMD_COMPLETE) &&
+             (session->omx_evt_rcvd.omx_value1 == cmd) &&
+             (session->omx_evt_rcvd.omx_value2 == status))) {
+        pthread_cond_wait(&session->omx_evt_cond, &session->omx_evt_lock);
     }
     CDBG("%s:done", __func__);
-    pthread_mutex_unlock(&my_obj->omx_evt_lock);
+    pthread_mutex_unlock(&session->omx_evt_lock);
 }
 
 OMX_ERRORTYPE mm_jpeg_etbdone(OMX_HANDLETYPE hComponent,
@@ -1156,27 +1747,27 @@ OMX_ERRORTYPE mm_jpeg_ftbdone(OMX_HANDLETYPE hComponent,
     int rc = 0;
     void* node = NULL;
     mm_jpeg_job_entry* job_entry = NULL;
-    mm_jpeg_obj * my_obj = (mm_jpeg_obj*)pAppData;
+    mm_jpeg_session_t *session = (mm_jpeg_session_t *)pAppData;
+    mm_jpeg_obj * my_obj = NULL;
 
-    if (NULL == my_obj) {
+    if (NULL == session) {
         CDBG_ERROR("%s: pAppData is NULL, return here", __func__);
         return rc;
     }
+    my_obj = (mm_jpeg_obj *)session->jpeg_obj;
 
-    CDBG("%s: jpeg done", __func__);
+    CDBG("%s: jpeg done on session %d", __func__, session->idx);
 
     /* signal JPEG_DONE event */
-    pthread_mutex_lock(&my_obj->omx_evt_lock);
-    my_obj->omx_evt_rcvd.evt = MM_JPEG_EVENT_MASK_JPEG_DONE;
-    pthread_cond_signal(&my_obj->omx_evt_cond);
-    pthread_mutex_unlock(&my_obj->omx_evt_lock);
-
-    /* find job that is OMX ongoing */
-    /* If OMX can support multi encoding, it should provide a way to pass jobID.
-     * then we can find job by jobID from ongoing queue.
-     * For now, since OMX only support one job per time, we simply dequeue it. */
+    pthread_mutex_lock(&session->omx_evt_lock);
+    session->omx_evt_rcvd.evt = MM_JPEG_EVENT_MASK_JPEG_DONE;
+    pthread_cond_signal(&session->omx_evt_cond);
+    pthread_mutex_unlock(&session->omx_evt_lock);
+
+    /* find job that is OMX ongoing on this session */
     pthread_mutex_lock(&my_obj->job_lock);
-    node = mm_jpeg_queue_deq(&my_obj->ongoing_job_q);
+    node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q,
+                                              session->job_id);
     if (NULL != node) {
         job_entry = &(((mm_jpeg_job_q_node_t *)node)->entry);
 
@@ -1186,20 +1777,14 @@ OMX_ERRORTYPE mm_jpeg_ftbdone(OMX_HANDLETYPE hComponent,
         CDBG("%s:filled len = %u, status = %d",
              __func__, job_entry->jpeg_size, job_entry->job_status);
 
-        /* clean omx job */
-        mm_jpeg_clean_omx_job(my_obj, job_entry);
-
-        if (NULL != job_entry->job.encode_job.jpeg_cb) {
-            /* has callback, create a thread to send CB */
-            pthread_create(&job_entry->cb_pid,
-                           NULL,
-                           mm_jpeg_notify_thread,
-                           node);
+        /* make the session available for next job. Component stays in
+         * Executing with its buffers registered; any reconfig is done
+         * by job mgr thread since it has to wait for OMX events */
+        mm_jpeg_release_session(session);
+        job_entry->session = NULL;
 
-        } else {
-            CDBG_ERROR("%s: no cb provided, return here", __func__);
-            free(node);
-        }
+        /* send CB through notify thread */
+        mm_jpeg_notify_job(my_obj, (mm_jpeg_job_q_node_t *)node);
     }
     pthread_mutex_unlock(&my_obj->job_lock);
 
@@ -1219,13 +1804,14 @@ OMX_ERRORTYPE mm_jpeg_handle_omx_event(OMX_HANDLETYPE hComponent,
     int rc = 0;
     void* node = NULL;
     mm_jpeg_job_entry* job_entry = NULL;
-    mm_jpeg_obj * my_obj = (mm_jpeg_obj*)pAppData;
-    uint32_t jobId = 0;
+    mm_jpeg_session_t *session = (mm_jpeg_session_t *)pAppData;
+    mm_jpeg_obj * my_obj = NULL;
 
-    if (NULL == my_obj) {
+    if (NULL == session) {
         CDBG_ERROR("%s: pAppData is NULL, return here", __func__);
         return rc;
     }
+    my_obj = (mm_jpeg_obj *)session->jpeg_obj;
 
     /* signal event */
     switch (eEvent) {
@@ -1234,10 +1820,10 @@ OMX_ERRORTYPE mm_jpeg_handle_omx_event(OMX_HANDLETYPE hComponent,
         {
             CDBG("%s: eEvent=OMX_EVENT_JPEG_ABORT", __func__);
             /* signal error evt */
-            pthread_mutex_lock(&my_obj->omx_evt_lock);
-            my_obj->omx_evt_rcvd.evt = MM_JPEG_EVENT_MASK_JPEG_ABORT;
-            pthread_cond_signal(&my_obj->omx_evt_cond);
-            pthread_mutex_unlock(&my_obj->omx_evt_lock);
+            pthread_mutex_lock(&session->omx_evt_lock);
+            session->omx_evt_rcvd.evt = MM_JPEG_EVENT_MASK_JPEG_ABORT;
+            pthread_cond_signal(&session->omx_evt_cond);
+            pthread_mutex_unlock(&session->omx_evt_lock);
         }
         break;
 #endif
@@ -1248,11 +1834,8 @@ OMX_ERRORTYPE mm_jpeg_handle_omx_event(OMX_HANDLETYPE hComponent,
             case OMX_EVENT_THUMBNAIL_DROPPED:
                 {
                     uint8_t thumbnail_dropped_flag = 1;
-                    mm_jpeg_job_q_node_t* data =
-                        (mm_jpeg_job_q_node_t*)mm_jpeg_queue_peek(&my_obj->ongoing_job_q);
-                    jobId = data->entry.jobId;
                     mm_jpeg_queue_update_flag(&my_obj->ongoing_job_q,
-                                              jobId,
+                                              session->job_id,
                                               thumbnail_dropped_flag);
                 }
                 break;
@@ -1260,36 +1843,26 @@ OMX_ERRORTYPE mm_jpeg_handle_omx_event(OMX_HANDLETYPE hComponent,
             case OMX_EVENT_JPEG_ERROR:
                 {
                     /* signal error evt */
-                    pthread_mutex_lock(&my_obj->omx_evt_lock);
-                    my_obj->omx_evt_rcvd.evt = MM_JPEG_EVENT_MASK_JPEG_ERROR;
-                    pthread_cond_signal(&my_obj->omx_evt_cond);
-                    pthread_mutex_unlock(&my_obj->omx_evt_lock);
+                    pthread_mutex_lock(&session->omx_evt_lock);
+                    session->omx_evt_rcvd.evt = MM_JPEG_EVENT_MASK_JPEG_ERROR;
+                    pthread_cond_signal(&session->omx_evt_cond);
+                    pthread_mutex_unlock(&session->omx_evt_lock);
 
                     /* send CB for error case */
-                    /* If OMX can support multi encoding, it should provide a way to pass jobID.
-                     * then we can find job by jobID from ongoing queue.
-                     * For now, since OMX only support one job per time, we simply dequeue it. */
                     pthread_mutex_lock(&my_obj->job_lock);
-                    node = mm_jpeg_queue_deq(&my_obj->ongoing_job_q);
+                    node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q,
+                                                              session->job_id);
                     if (NULL != node) {
                         job_entry = &(((mm_jpeg_job_q_node_t *)node)->entry);;
 
-                        /* clean omx job */
-                        mm_jpeg_clean_omx_job(my_obj, job_entry);
+                        /* session is restarted before its next job */
+                        session->omx_state = OMX_StateInvalid;
+                        mm_jpeg_release_session(session);
+                        job_entry->session = NULL;
 
                         /* find job that is OMX ongoing */
                         job_entry->job_status = JPEG_JOB_STATUS_ERROR;
-                        if (NULL != job_entry->job.encode_job.jpeg_cb) {
-                            /* has callback, create a thread to send CB */
-                            pthread_create(&job_entry->cb_pid,
-                                           NULL,
-                                           mm_jpeg_notify_thread,
-                                           node);
-
-                        } else {
-                            CDBG_ERROR("%s: no cb provided, return here", __func__);
-                            free(node);
-                        }
+                        mm_jpeg_notify_job(my_obj, (mm_jpeg_job_q_node_t *)node);
                     }
                     pthread_mutex_unlock(&my_obj->job_lock);
 
@@ -1308,12 +1881,12 @@ OMX_ERRORTYPE mm_jpeg_handle_omx_event(OMX_HANDLETYPE hComponent,
             CDBG("%s: eEvent=OMX_EventCmdComplete, value1=%d, value2=%d",
                  __func__, nData1, nData2);
             /* signal cmd complete evt */
-            pthread_mutex_lock(&my_obj->omx_evt_lock);
-            my_obj->omx_evt_rcvd.evt = MM_JPEG_EVENT_MASK_CMD_COMPLETE;
-            my_obj->omx_evt_rcvd.omx_value1 = nData1;
-            my_obj->omx_evt_rcvd.omx_value2 = nData2;
-            pthread_cond_signal(&my_obj->omx_evt_cond);
-            pthread_mutex_unlock(&my_obj->omx_evt_lock);
+            pthread_mutex_lock(&session->omx_evt_lock);
+            session->omx_evt_rcvd.evt = MM_JPEG_EVENT_MASK_CMD_COMPLETE;
+            session->omx_evt_rcvd.omx_value1 = nData1;
+            session->omx_evt_rcvd.omx_value2 = nData2;
+            pthread_cond_signal(&session->omx_evt_cond);
+            pthread_mutex_unlock(&session->omx_evt_lock);
         }
         break;
     default:
@@ -25,3 +25,24 @@ LOCAL_PRELINK_MODULE   := false
 LOCAL_SHARED_LIBRARIES := libcutils libdl
 
 include $(BUILD_SHARED_LIBRARY)
+
+# ------------------------------------------------------------------------------
+#        Make the stub jpeg encoder component (libqomx_jpegenc_stub)
+# ------------------------------------------------------------------------------
+
+include $(CLEAR_VARS)
+LOCAL_PATH := $(OMX_CORE_PATH)
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := $(omx_core_defines)
+LOCAL_CFLAGS += -D_ANDROID_
+
+LOCAL_C_INCLUDES := $(OMX_HEADER_DIR)
+
+LOCAL_SRC_FILES := qomx_stub_component.c
+
+LOCAL_MODULE           := libqomx_jpegenc_stub
+LOCAL_PRELINK_MODULE   := false
+LOCAL_SHARED_LIBRARIES := libcutils
+
+include $(BUILD_SHARED_LIBRARY)
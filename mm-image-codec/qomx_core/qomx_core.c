@@ -40,6 +40,7 @@ omx_core *gomx_core_components;
 component_libname_mapping libNameMapping[] =
 {
   { "OMX.qcom.image.jpeg.encoder", "libqomx_jpegenc.so"},
+  { "OMX.qcom.image.jpeg.encoder.stub", "libqomx_jpegenc_stub.so"},
 };
 
 static int getIndexFromHandle(OMX_IN OMX_HANDLETYPE *ahComp, int *acompIndex,
@@ -61,6 +62,7 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_Init()
   }
   gomx_core_components = malloc(sizeof(omx_core));
   if (gomx_core_components) {
+    memset(gomx_core_components, 0, sizeof(omx_core));
     gomx_core_components->is_initialized = TRUE;
     pthread_mutex_init(&gomx_core_components->core_lock, NULL);
   } else {
@@ -103,7 +105,6 @@ static int getComponentFromList(char *acomponentName){
           lindex = i;
           return lindex;
         }
-        i++;
       }
       else {
         return i;
@@ -184,7 +185,7 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_GetHandle(
   OMX_COMPONENTTYPE *lcomp;
 
   getLibName(componentName, libName);
-  if (libName == NULL) {
+  if (!strlen(libName)) {
      return OMX_ErrorInvalidComponent;
   }
 
@@ -196,6 +197,8 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_GetHandle(
     if (lcomp_index >= 0) {
       //If component already present get the instance index
       if (gomx_core_components->component[lcomp_index]) {
+        //Reuse the loaded library for the new instance
+        core_comp = gomx_core_components->component[lcomp_index];
         linstance_index =
           getInstanceIndex(gomx_core_components->component[lcomp_index]);
       }
@@ -203,7 +206,9 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_GetHandle(
           //Open the library dynamically if its not already open
           if (!gomx_core_components->component[lcomp_index]) {
              core_comp = malloc(sizeof(omx_core_component));
-             core_comp->name = componentName;
+             memset(core_comp, 0, sizeof(omx_core_component));
+             //Keep a copy, caller's name may not outlive the component
+             core_comp->name = strdup(componentName);
              core_comp->lib_handle = loadComponent(libName);
              if (core_comp->lib_handle) {
               core_comp->open = TRUE;
@@ -354,6 +359,7 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_FreeHandle(
         gomx_core_components->component[lcomponentIndex]->obj_ptr = NULL;
         gomx_core_components->component[lcomponentIndex]->comp_func_ptr = NULL;
         gomx_core_components->component[lcomponentIndex]->open = FALSE;
+        free(gomx_core_components->component[lcomponentIndex]->name);
         free(gomx_core_components->component[lcomponentIndex]);
         gomx_core_components->component[lcomponentIndex] = NULL;
         if (lrc) {
@@ -0,0 +1,645 @@
+/*Copyright (c) 2012, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+/* Stand-in for the jpeg encoder OMX component. It follows the OMX IL state
+ * machine (state transitions, port enable/disable, flush, buffer
+ * population) and charges a configurable cost for each transition,
+ * UseBuffer and encode, so that clients of qomx_core can be exercised and
+ * profiled without the hw encoder. The "encoded" image is an empty jpeg
+ * (SOI + EOI). Costs in us are taken from env:
+ *   QOMX_STUB_TRANSITION_US, QOMX_STUB_USEBUF_US, QOMX_STUB_ENCODE_US
+ * It has no Android dependencies and builds on plain Linux. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "OMX_Component.h"
+
+#ifdef _ANDROID_
+#define LOG_TAG "qomx_stub"
+#include <utils/Log.h>
+#define QSTUB_LOG(fmt, args...) ALOGE(fmt, ##args)
+#else
+#define QSTUB_LOG(fmt, args...) fprintf(stderr, fmt "\n", ##args)
+#endif
+
+#define QSTUB_NUM_PORTS 3
+#define QSTUB_INPUT_PORT_MAIN 0
+#define QSTUB_OUTPUT_PORT 1
+#define QSTUB_INPUT_PORT_THUMBNAIL 2
+#define QSTUB_MAX_MSGS 32
+#define QSTUB_MAX_PENDING 4
+
+#define QSTUB_TRANSITION_US_DEFAULT 20000
+#define QSTUB_USEBUF_US_DEFAULT 2000
+#define QSTUB_ENCODE_US_DEFAULT 10000
+
+typedef enum {
+  QSTUB_MSG_CMD,
+  QSTUB_MSG_ETB,
+  QSTUB_MSG_FTB,
+  QSTUB_MSG_EXIT,
+} qstub_msg_type_t;
+
+typedef struct {
+  qstub_msg_type_t type;
+  OMX_COMMANDTYPE cmd;
+  OMX_U32 param;
+  OMX_BUFFERHEADERTYPE *buf;
+} qstub_msg_t;
+
+typedef struct {
+  OMX_PARAM_PORTDEFINITIONTYPE def;
+  OMX_BOOL enabled;
+  OMX_U32 num_registered;
+  OMX_U32 num_pending;
+  OMX_BUFFERHEADERTYPE *pending[QSTUB_MAX_PENDING];
+} qstub_port_t;
+
+typedef struct {
+  OMX_COMPONENTTYPE comp;
+  OMX_CALLBACKTYPE callbacks;
+  OMX_PTR app_data;
+  OMX_STATETYPE state;
+  qstub_port_t ports[QSTUB_NUM_PORTS];
+
+  /* worker thread processing cmds and buffers in order */
+  pthread_t worker;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  qstub_msg_t msgs[QSTUB_MAX_MSGS];
+  int msg_head;
+  int msg_cnt;
+
+  /* simulated costs */
+  useconds_t transition_us;
+  useconds_t usebuf_us;
+  useconds_t encode_us;
+
+  /* stats */
+  OMX_U32 num_transitions;
+  OMX_U32 num_port_cmds;
+  OMX_U32 num_use_buffers;
+  OMX_U32 num_encodes;
+} qstub_comp_t;
+
+/*==============================================================================
+* Function : qstub_get_cost
+* Parameters: env name, default
+* Return Value : cost in us
+* Description: Read simulated cost from the environment
+==============================================================================*/
+static useconds_t qstub_get_cost(const char *aname, useconds_t adefault)
+{
+  const char *lval = getenv(aname);
+  return lval ? (useconds_t)atoi(lval) : adefault;
+}
+
+/*==============================================================================
+* Function : qstub_post_msg
+* Parameters: comp, msg
+* Return Value : OMX_ERRORTYPE
+* Description: Queue a message to the worker thread
+==============================================================================*/
+static OMX_ERRORTYPE qstub_post_msg(qstub_comp_t *acomp, qstub_msg_t *amsg)
+{
+  pthread_mutex_lock(&acomp->lock);
+  if (acomp->msg_cnt >= QSTUB_MAX_MSGS) {
+    pthread_mutex_unlock(&acomp->lock);
+    return OMX_ErrorInsufficientResources;
+  }
+  acomp->msgs[(acomp->msg_head + acomp->msg_cnt) % QSTUB_MAX_MSGS] = *amsg;
+  acomp->msg_cnt++;
+  pthread_cond_broadcast(&acomp->cond);
+  pthread_mutex_unlock(&acomp->lock);
+  return OMX_ErrorNone;
+}
+
+/*==============================================================================
+* Function : qstub_is_populated
+* Parameters: port
+* Return Value : TRUE if the port has all its buffers. Must be called with
+* lock held
+==============================================================================*/
+static int qstub_is_populated(qstub_port_t *aport)
+{
+  return !aport->enabled ||
+    aport->num_registered >= aport->def.nBufferCountActual;
+}
+
+/*==============================================================================
+* Function : qstub_wait_ports
+* Parameters: comp, port index or OMX_ALL, populated
+* Return Value : None
+* Description: Block the worker until the ports are populated, or until all
+* of their buffers are freed. Must be called with lock held
+==============================================================================*/
+static void qstub_wait_ports(qstub_comp_t *acomp, OMX_U32 aport_idx,
+  int apopulated)
+{
+  OMX_U32 i;
+  int ldone = 0;
+
+  while (!ldone) {
+    ldone = 1;
+    for (i = 0; i < QSTUB_NUM_PORTS; i++) {
+      if (aport_idx != OMX_ALL && aport_idx != i) {
+        continue;
+      }
+      if (apopulated ? !qstub_is_populated(&acomp->ports[i]) :
+        acomp->ports[i].num_registered > 0) {
+        ldone = 0;
+      }
+    }
+    if (!ldone) {
+      pthread_cond_wait(&acomp->cond, &acomp->lock);
+    }
+  }
+}
+
+/*==============================================================================
+* Function : qstub_return_bufs
+* Parameters: comp, port index or OMX_ALL
+* Return Value : None
+* Description: Return pending buffers of the ports to the client. Must be
+* called with lock held, which is dropped around the callbacks
+==============================================================================*/
+static void qstub_return_bufs(qstub_comp_t *acomp, OMX_U32 aport_idx)
+{
+  OMX_U32 i;
+  OMX_BUFFERHEADERTYPE *lbuf;
+
+  for (i = 0; i < QSTUB_NUM_PORTS; i++) {
+    if (aport_idx != OMX_ALL && aport_idx != i) {
+      continue;
+    }
+    while (acomp->ports[i].num_pending > 0) {
+      lbuf = acomp->ports[i].pending[--acomp->ports[i].num_pending];
+      pthread_mutex_unlock(&acomp->lock);
+      if (QSTUB_OUTPUT_PORT == i) {
+        lbuf->nFilledLen = 0;
+        acomp->callbacks.FillBufferDone(&acomp->comp, acomp->app_data, lbuf);
+      } else {
+        acomp->callbacks.EmptyBufferDone(&acomp->comp, acomp->app_data, lbuf);
+      }
+      pthread_mutex_lock(&acomp->lock);
+    }
+  }
+}
+
+/*==============================================================================
+* Function : qstub_cmd_complete
+* Parameters: comp, cmd, param
+* Return Value : None
+* Description: Send cmd complete event. Must be called with lock held
+==============================================================================*/
+static void qstub_cmd_complete(qstub_comp_t *acomp, OMX_COMMANDTYPE acmd,
+  OMX_U32 aparam)
+{
+  pthread_mutex_unlock(&acomp->lock);
+  acomp->callbacks.EventHandler(&acomp->comp, acomp->app_data,
+    OMX_EventCmdComplete, acmd, aparam, NULL);
+  pthread_mutex_lock(&acomp->lock);
+}
+
+/*==============================================================================
+* Function : qstub_handle_cmd
+* Parameters: comp, msg
+* Return Value : None
+* Description: Process a cmd sent with SendCommand. Must be called with lock
+* held
+==============================================================================*/
+static void qstub_handle_cmd(qstub_comp_t *acomp, qstub_msg_t *amsg)
+{
+  OMX_U32 i;
+
+  switch (amsg->cmd) {
+  case OMX_CommandStateSet:
+    if (OMX_StateLoaded == acomp->state && OMX_StateIdle == amsg->param) {
+      qstub_wait_ports(acomp, OMX_ALL, 1);
+    } else if (OMX_StateIdle == acomp->state &&
+      OMX_StateLoaded == amsg->param) {
+      qstub_wait_ports(acomp, OMX_ALL, 0);
+    } else if (OMX_StateExecuting == acomp->state &&
+      OMX_StateIdle == amsg->param) {
+      qstub_return_bufs(acomp, OMX_ALL);
+    }
+    pthread_mutex_unlock(&acomp->lock);
+    usleep(acomp->transition_us);
+    pthread_mutex_lock(&acomp->lock);
+    acomp->state = (OMX_STATETYPE)amsg->param;
+    acomp->num_transitions++;
+    qstub_cmd_complete(acomp, OMX_CommandStateSet, amsg->param);
+    break;
+  case OMX_CommandFlush:
+    qstub_return_bufs(acomp, amsg->param);
+    for (i = 0; i < QSTUB_NUM_PORTS; i++) {
+      if (amsg->param == OMX_ALL || amsg->param == i) {
+        qstub_cmd_complete(acomp, OMX_CommandFlush, i);
+      }
+    }
+    break;
+  case OMX_CommandPortDisable:
+    qstub_return_bufs(acomp, amsg->param);
+    qstub_wait_ports(acomp, amsg->param, 0);
+    for (i = 0; i < QSTUB_NUM_PORTS; i++) {
+      if (amsg->param == OMX_ALL || amsg->param == i) {
+        acomp->ports[i].enabled = 0;
+        acomp->num_port_cmds++;
+        qstub_cmd_complete(acomp, OMX_CommandPortDisable, i);
+      }
+    }
+    break;
+  case OMX_CommandPortEnable:
+    for (i = 0; i < QSTUB_NUM_PORTS; i++) {
+      if (amsg->param == OMX_ALL || amsg->param == i) {
+        acomp->ports[i].enabled = 1;
+      }
+    }
+    if (OMX_StateLoaded != acomp->state) {
+      qstub_wait_ports(acomp, amsg->param, 1);
+    }
+    for (i = 0; i < QSTUB_NUM_PORTS; i++) {
+      if (amsg->param == OMX_ALL || amsg->param == i) {
+        acomp->num_port_cmds++;
+        qstub_cmd_complete(acomp, OMX_CommandPortEnable, i);
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+/*==============================================================================
+* Function : qstub_try_encode
+* Parameters: comp
+* Return Value : None
+* Description: Encode once both main input and output buffers are queued.
+* Must be called with lock held
+==============================================================================*/
+static void qstub_try_encode(qstub_comp_t *acomp)
+{
+  qstub_port_t *lin = &acomp->ports[QSTUB_INPUT_PORT_MAIN];
+  qstub_port_t *lout = &acomp->ports[QSTUB_OUTPUT_PORT];
+  qstub_port_t *lthumb = &acomp->ports[QSTUB_INPUT_PORT_THUMBNAIL];
+  OMX_BUFFERHEADERTYPE *lbuf_in, *lbuf_thumb = NULL, *lbuf_out;
+  static const OMX_U8 ljpeg[] = {0xFF, 0xD8, 0xFF, 0xD9};
+
+  if (OMX_StateExecuting != acomp->state ||
+    0 == lin->num_pending || 0 == lout->num_pending) {
+    return;
+  }
+  lbuf_in = lin->pending[--lin->num_pending];
+  lbuf_out = lout->pending[--lout->num_pending];
+  if (lthumb->num_pending > 0) {
+    lbuf_thumb = lthumb->pending[--lthumb->num_pending];
+  }
+  pthread_mutex_unlock(&acomp->lock);
+
+  usleep(acomp->encode_us);
+  if (lbuf_out->nAllocLen >= sizeof(ljpeg)) {
+    memcpy(lbuf_out->pBuffer + lbuf_out->nOffset, ljpeg, sizeof(ljpeg));
+    lbuf_out->nFilledLen = sizeof(ljpeg);
+  } else {
+    lbuf_out->nFilledLen = 0;
+  }
+  acomp->callbacks.EmptyBufferDone(&acomp->comp, acomp->app_data, lbuf_in);
+  if (lbuf_thumb) {
+    acomp->callbacks.EmptyBufferDone(&acomp->comp, acomp->app_data,
+      lbuf_thumb);
+  }
+  acomp->callbacks.FillBufferDone(&acomp->comp, acomp->app_data, lbuf_out);
+
+  pthread_mutex_lock(&acomp->lock);
+  acomp->num_encodes++;
+}
+
+/*==============================================================================
+* Function : qstub_worker
+* Parameters: comp
+* Return Value : NULL
+* Description: Worker thread, processes messages in the order they are posted
+==============================================================================*/
+static void *qstub_worker(void *aobj)
+{
+  qstub_comp_t *lcomp = (qstub_comp_t *)aobj;
+  qstub_msg_t lmsg;
+  qstub_port_t *lport;
+
+  pthread_mutex_lock(&lcomp->lock);
+  while (1) {
+    while (0 == lcomp->msg_cnt) {
+      pthread_cond_wait(&lcomp->cond, &lcomp->lock);
+    }
+    lmsg = lcomp->msgs[lcomp->msg_head];
+    lcomp->msg_head = (lcomp->msg_head + 1) % QSTUB_MAX_MSGS;
+    lcomp->msg_cnt--;
+
+    if (QSTUB_MSG_EXIT == lmsg.type) {
+      break;
+    } else if (QSTUB_MSG_CMD == lmsg.type) {
+      qstub_handle_cmd(lcomp, &lmsg);
+    } else {
+      lport = &lcomp->ports[(QSTUB_MSG_FTB == lmsg.type) ?
+        lmsg.buf->nOutputPortIndex : lmsg.buf->nInputPortIndex];
+      if (lport->num_pending < QSTUB_MAX_PENDING) {
+        lport->pending[lport->num_pending++] = lmsg.buf;
+      }
+      qstub_try_encode(lcomp);
+    }
+  }
+  pthread_mutex_unlock(&lcomp->lock);
+  return NULL;
+}
+
+static OMX_ERRORTYPE qstub_send_command(OMX_HANDLETYPE hComp,
+  OMX_COMMANDTYPE Cmd, OMX_U32 nParam1, OMX_PTR pCmdData)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+  qstub_msg_t lmsg;
+
+  memset(&lmsg, 0, sizeof(lmsg));
+  lmsg.type = QSTUB_MSG_CMD;
+  lmsg.cmd = Cmd;
+  lmsg.param = nParam1;
+  return qstub_post_msg(lcomp, &lmsg);
+}
+
+static OMX_ERRORTYPE qstub_get_parameter(OMX_HANDLETYPE hComp,
+  OMX_INDEXTYPE nParamIndex, OMX_PTR pParam)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+  OMX_PARAM_PORTDEFINITIONTYPE *ldef;
+
+  if (OMX_IndexParamPortDefinition == nParamIndex) {
+    ldef = (OMX_PARAM_PORTDEFINITIONTYPE *)pParam;
+    if (ldef->nPortIndex >= QSTUB_NUM_PORTS) {
+      return OMX_ErrorBadParameter;
+    }
+    pthread_mutex_lock(&lcomp->lock);
+    *ldef = lcomp->ports[ldef->nPortIndex].def;
+    pthread_mutex_unlock(&lcomp->lock);
+  }
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE qstub_set_parameter(OMX_HANDLETYPE hComp,
+  OMX_INDEXTYPE nParamIndex, OMX_PTR pParam)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+  OMX_PARAM_PORTDEFINITIONTYPE *ldef;
+
+  if (OMX_IndexParamPortDefinition == nParamIndex) {
+    ldef = (OMX_PARAM_PORTDEFINITIONTYPE *)pParam;
+    if (ldef->nPortIndex >= QSTUB_NUM_PORTS) {
+      return OMX_ErrorBadParameter;
+    }
+    pthread_mutex_lock(&lcomp->lock);
+    lcomp->ports[ldef->nPortIndex].def = *ldef;
+    pthread_mutex_unlock(&lcomp->lock);
+  }
+  /* other params, e.g. exif tags and quality, are accepted and dropped */
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE qstub_get_config(OMX_HANDLETYPE hComp,
+  OMX_INDEXTYPE nIndex, OMX_PTR pConfig)
+{
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE qstub_set_config(OMX_HANDLETYPE hComp,
+  OMX_INDEXTYPE nIndex, OMX_PTR pConfig)
+{
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE qstub_get_extension_index(OMX_HANDLETYPE hComp,
+  OMX_STRING cParameterName, OMX_INDEXTYPE *pIndexType)
+{
+  *pIndexType = (OMX_INDEXTYPE)OMX_IndexVendorStartUnused;
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE qstub_get_state(OMX_HANDLETYPE hComp,
+  OMX_STATETYPE *pState)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+
+  pthread_mutex_lock(&lcomp->lock);
+  *pState = lcomp->state;
+  pthread_mutex_unlock(&lcomp->lock);
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE qstub_use_buffer(OMX_HANDLETYPE hComp,
+  OMX_BUFFERHEADERTYPE **ppBufferHdr, OMX_U32 nPortIndex,
+  OMX_PTR pAppPrivate, OMX_U32 nSizeBytes, OMX_U8 *pBuffer)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+  OMX_BUFFERHEADERTYPE *lbuf;
+
+  if (nPortIndex >= QSTUB_NUM_PORTS || NULL == ppBufferHdr) {
+    return OMX_ErrorBadParameter;
+  }
+  lbuf = calloc(1, sizeof(OMX_BUFFERHEADERTYPE));
+  if (NULL == lbuf) {
+    return OMX_ErrorInsufficientResources;
+  }
+  lbuf->nSize = sizeof(OMX_BUFFERHEADERTYPE);
+  lbuf->pBuffer = pBuffer;
+  lbuf->nAllocLen = nSizeBytes;
+  lbuf->pAppPrivate = pAppPrivate;
+  if (QSTUB_OUTPUT_PORT == nPortIndex) {
+    lbuf->nOutputPortIndex = nPortIndex;
+  } else {
+    lbuf->nInputPortIndex = nPortIndex;
+  }
+
+  /* simulate buffer mapping */
+  usleep(lcomp->usebuf_us);
+
+  pthread_mutex_lock(&lcomp->lock);
+  lcomp->ports[nPortIndex].num_registered++;
+  lcomp->num_use_buffers++;
+  pthread_cond_broadcast(&lcomp->cond);
+  pthread_mutex_unlock(&lcomp->lock);
+
+  *ppBufferHdr = lbuf;
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE qstub_free_buffer(OMX_HANDLETYPE hComp,
+  OMX_U32 nPortIndex, OMX_BUFFERHEADERTYPE *pBuffer)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+
+  if (nPortIndex >= QSTUB_NUM_PORTS || NULL == pBuffer) {
+    return OMX_ErrorBadParameter;
+  }
+  pthread_mutex_lock(&lcomp->lock);
+  if (lcomp->ports[nPortIndex].num_registered > 0) {
+    lcomp->ports[nPortIndex].num_registered--;
+  }
+  pthread_cond_broadcast(&lcomp->cond);
+  pthread_mutex_unlock(&lcomp->lock);
+  free(pBuffer);
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE qstub_empty_this_buffer(OMX_HANDLETYPE hComp,
+  OMX_BUFFERHEADERTYPE *pBuffer)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+  qstub_msg_t lmsg;
+
+  memset(&lmsg, 0, sizeof(lmsg));
+  lmsg.type = QSTUB_MSG_ETB;
+  lmsg.buf = pBuffer;
+  return qstub_post_msg(lcomp, &lmsg);
+}
+
+static OMX_ERRORTYPE qstub_fill_this_buffer(OMX_HANDLETYPE hComp,
+  OMX_BUFFERHEADERTYPE *pBuffer)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+  qstub_msg_t lmsg;
+
+  memset(&lmsg, 0, sizeof(lmsg));
+  lmsg.type = QSTUB_MSG_FTB;
+  lmsg.buf = pBuffer;
+  return qstub_post_msg(lcomp, &lmsg);
+}
+
+static OMX_ERRORTYPE qstub_set_callbacks(OMX_HANDLETYPE hComp,
+  OMX_CALLBACKTYPE *pCallbacks, OMX_PTR pAppData)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+
+  if (NULL == pCallbacks) {
+    return OMX_ErrorBadParameter;
+  }
+  lcomp->callbacks = *pCallbacks;
+  lcomp->app_data = pAppData;
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE qstub_component_deinit(OMX_HANDLETYPE hComp)
+{
+  qstub_comp_t *lcomp = ((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+  qstub_msg_t lmsg;
+
+  memset(&lmsg, 0, sizeof(lmsg));
+  lmsg.type = QSTUB_MSG_EXIT;
+  if (OMX_ErrorNone == qstub_post_msg(lcomp, &lmsg)) {
+    pthread_join(lcomp->worker, NULL);
+  }
+
+  QSTUB_LOG("%s: %p transitions %u, port cmds %u, UseBuffer %u, encodes %u",
+    __func__, lcomp, (unsigned int)lcomp->num_transitions,
+    (unsigned int)lcomp->num_port_cmds, (unsigned int)lcomp->num_use_buffers,
+    (unsigned int)lcomp->num_encodes);
+
+  pthread_mutex_destroy(&lcomp->lock);
+  pthread_cond_destroy(&lcomp->cond);
+  free(lcomp);
+  return OMX_ErrorNone;
+}
+
+/*==============================================================================
+* Function : getInstance
+* Parameters: None
+* Return Value : new component instance, NULL on failure
+* Description: Called by qomx_core for each OMX_GetHandle
+==============================================================================*/
+void *getInstance(void)
+{
+  qstub_comp_t *lcomp;
+  OMX_U32 i;
+
+  lcomp = calloc(1, sizeof(qstub_comp_t));
+  if (NULL == lcomp) {
+    return NULL;
+  }
+  lcomp->state = OMX_StateLoaded;
+  for (i = 0; i < QSTUB_NUM_PORTS; i++) {
+    lcomp->ports[i].def.nSize = sizeof(OMX_PARAM_PORTDEFINITIONTYPE);
+    lcomp->ports[i].def.nPortIndex = i;
+    lcomp->ports[i].def.nBufferCountActual = 0;
+    lcomp->ports[i].enabled = 1;
+  }
+  lcomp->transition_us = qstub_get_cost("QOMX_STUB_TRANSITION_US",
+    QSTUB_TRANSITION_US_DEFAULT);
+  lcomp->usebuf_us = qstub_get_cost("QOMX_STUB_USEBUF_US",
+    QSTUB_USEBUF_US_DEFAULT);
+  lcomp->encode_us = qstub_get_cost("QOMX_STUB_ENCODE_US",
+    QSTUB_ENCODE_US_DEFAULT);
+
+  pthread_mutex_init(&lcomp->lock, NULL);
+  pthread_cond_init(&lcomp->cond, NULL);
+  if (pthread_create(&lcomp->worker, NULL, qstub_worker, lcomp)) {
+    pthread_mutex_destroy(&lcomp->lock);
+    pthread_cond_destroy(&lcomp->cond);
+    free(lcomp);
+    return NULL;
+  }
+  return lcomp;
+}
+
+/*==============================================================================
+* Function : create_component_fns
+* Parameters: component instance from getInstance
+* Return Value : OMX component handle
+* Description: Map the OMX component functions to the stub implementation
+==============================================================================*/
+void *create_component_fns(OMX_PTR aobj)
+{
+  qstub_comp_t *lcomp = (qstub_comp_t *)aobj;
+
+  if (NULL == lcomp) {
+    return NULL;
+  }
+  lcomp->comp.nSize = sizeof(OMX_COMPONENTTYPE);
+  lcomp->comp.pComponentPrivate = lcomp;
+  lcomp->comp.SendCommand = qstub_send_command;
+  lcomp->comp.GetParameter = qstub_get_parameter;
+  lcomp->comp.SetParameter = qstub_set_parameter;
+  lcomp->comp.GetConfig = qstub_get_config;
+  lcomp->comp.SetConfig = qstub_set_config;
+  lcomp->comp.GetExtensionIndex = qstub_get_extension_index;
+  lcomp->comp.GetState = qstub_get_state;
+  lcomp->comp.UseBuffer = qstub_use_buffer;
+  lcomp->comp.FreeBuffer = qstub_free_buffer;
+  lcomp->comp.EmptyThisBuffer = qstub_empty_this_buffer;
+  lcomp->comp.FillThisBuffer = qstub_fill_this_buffer;
+  lcomp->comp.SetCallbacks = qstub_set_callbacks;
+  lcomp->comp.ComponentDeInit = qstub_component_deinit;
+  return &lcomp->comp;
+}